@@ -0,0 +1,1407 @@
+//
+// Created by Xsakura on 2023/6/25.
+//
+
+// 数据库的性能测试，结构参考 LevelDB 的 db_bench：
+//    massdb_bench [--benchmarks=a,b,...] [其他选项]
+//
+// 按顺序运行 --benchmarks 中的测试，每个测试输出每次操作的平均延迟、
+// 每秒的操作数、吞吐量（MB/s）和延迟的百分位数。
+// 除了通用的键值读写，还有使用合成谱图的测试：
+// 谱图的 precursor m/z、电荷和峰的数量都按接近真实数据的分布生成，
+// value 是 massdb/spectrum.h 中的峰列表格式。
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "massdb/cache.h"
+#include "massdb/db.h"
+#include "massdb/env.h"
+#include "massdb/filter_policy.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "massdb/spectrum.h"
+#include "massdb/table.h"
+#include "massdb/table_builder.h"
+#include "util/hash.h"
+#include "util/histogram.h"
+#include "util/random.h"
+
+namespace massdb {
+namespace {
+
+// 逗号分隔的测试列表，按顺序运行：
+//    fillseq          按 key 的顺序写入 num 个条目（新建数据库）
+//    fillrandom       按随机的顺序写入 num 个条目（新建数据库）
+//    overwrite        按随机的顺序覆盖写入 num 个条目
+//    fillsync         按随机的顺序写入 num / 1000 个条目（新建数据库），
+//                     每次写入都设置 WriteOptions::sync。
+//                     用 --threads 测试组提交时吞吐量与写者线程数的关系
+//    readrandom       随机读取 reads 次
+//    readseq          用迭代器顺序读取 reads 个条目
+//    seekrandom       随机 Seek reads 次，每次之后再读取 seek_nexts 个条目
+//    tableseekrandom  不经过数据库，用 num 个条目生成一个 table 文件并预热
+//                     块缓存（不计时），然后随机 Seek reads 次
+//    multireadrandom  通过 MultiGet() 随机读取 reads 个 key，
+//                     每批 multiget_batch 个，延迟按批统计
+//    readwhilewriting 每个线程随机读取 reads 次，同时另有一个线程不断写入
+//    fillspectra      按扫描号的顺序写入 num 个合成的谱图（新建数据库）
+//    precursorwindow  按已写入的谱图的 precursor m/z 执行 RangeQuery()
+//                     reads 次，读取窗口中的所有谱图
+//    searchspectra    用已写入的谱图作为查询执行 SearchSpectra() reads 次
+//    memtablefillseq  不经过数据库，按 key 的顺序向新建的 MemTable
+//                     写入 num 个条目
+//    memtablefillrandom
+//                     不经过数据库，按随机的顺序向新建的 MemTable
+//                     写入 num 个条目
+//    memtableseekseq  在上一个 memtablefill* 写入的 MemTable 中
+//                     按 key 的顺序 Seek reads 次
+//    memtableseekrandom
+//                     在上一个 memtablefill* 写入的 MemTable 中
+//                     随机 Seek reads 次
+//    memtablescaling  不经过数据库，直接向新建的 MemTable 随机写入 num 个条目，
+//                     写者线程数从 1 开始每次翻倍直到 max_write_threads，
+//                     分别测试 ConcurrentAdd() 和用一个锁保护的 Add()。
+//                     用 --value_size=100000 等测试大 value（例如峰列表）
+//                     的并发分配
+//    filter           不经过数据库，用 num 个 key 分别生成经典的和分块的
+//                     Bloom 过滤器（每个 key bloom_bits 位，默认 10），
+//                     然后用不存在的 key 探测 reads 次，输出误判率。
+//                     filter/* 逐个调用 KeyMayMatch()，
+//                     filterbatch/* 每批 multiget_batch 个调用 KeysMayMatch()
+const char* FLAGS_benchmarks =
+    "fillseq,"
+    "fillrandom,"
+    "overwrite,"
+    "readrandom,"
+    "readrandom,"  // 第二次读取时缓存已经预热
+    "readseq,"
+    "seekrandom,"
+    "readwhilewriting,"
+    "fillspectra,"
+    "precursorwindow,"
+    "searchspectra,";
+
+// 写入的条目数
+int FLAGS_num = 1000000;
+
+// 读取的次数，小于 0 时等于 FLAGS_num
+int FLAGS_reads = -1;
+
+// 并发运行每个测试的线程数
+int FLAGS_threads = 1;
+
+// memtablescaling 的最大写者线程数
+int FLAGS_max_write_threads = 32;
+
+// 为 true 时所有写入测试都设置 WriteOptions::sync
+bool FLAGS_sync = false;
+
+// 键值测试中每个 value 的字节数
+int FLAGS_value_size = 100;
+
+// value 的数据压缩之后大约是原来的这个比例
+double FLAGS_compression_ratio = 0.5;
+
+// 为 true 时输出完整的延迟直方图
+bool FLAGS_histogram = false;
+
+// seekrandom 每次 Seek 之后调用 Next() 的次数
+int FLAGS_seek_nexts = 0;
+
+// multireadrandom 每次调用 MultiGet() 的 key 数
+int FLAGS_multiget_batch = 32;
+
+// 合成谱图的峰数量的中位数，实际数量按对数正态分布生成
+int FLAGS_peaks = 150;
+
+// precursorwindow 和 searchspectra 的 precursor m/z 容差（ppm）
+double FLAGS_tolerance_ppm = 20;
+
+// searchspectra 打分的分箱宽度
+double FLAGS_bin_width = 0.02;
+
+// searchspectra 返回的结果数
+int FLAGS_top_k = 10;
+
+// 以下选项不大于 0 时使用 Options 的默认值
+int FLAGS_write_buffer_size = 0;
+int FLAGS_max_file_size = 0;
+int FLAGS_block_size = 0;
+int FLAGS_open_files = 0;
+
+// 块缓存的字节数，小于 0 时不使用块缓存（数据库的默认设置）
+long long FLAGS_cache_size = -1;
+
+// 布隆过滤器每个 key 的位数，小于 0 时不使用过滤器
+int FLAGS_bloom_bits = -1;
+
+// 压缩算法，小于 0 时使用 Options 的默认值。
+// 命令行中用名字指定：none、snappy、zlib、lz4、zstd 或 spectrum
+int FLAGS_compression = -1;
+
+// 为 true 时使用 mmap 读取 table 文件
+bool FLAGS_mmap_read = false;
+
+// 为 true 时使用 SpectrumKeyComparator()
+bool FLAGS_spectrum_comparator = false;
+
+// 为 true 时键值测试使用 17 字节的谱图 key（precursor m/z 随编号递增），
+// 否则使用 16 字节的十进制数字。与 --spectrum_comparator 一起使用时，
+// 在同样的 key 上比较特化的谱图 key 比较和按字节比较
+bool FLAGS_spectrum_keys = false;
+
+// 为 true 时使用已有的数据库，跳过新建数据库的测试
+bool FLAGS_use_existing_db = false;
+
+// 数据库的目录
+const char* FLAGS_db = nullptr;
+
+// 删除目录 dbname 中的所有文件和这个目录
+void DestroyBenchDB(Env* env, const std::string& dbname) {
+    std::vector<std::string> children;
+    if (!env->GetChildren(dbname, &children).IsOk()) {
+        return;
+    }
+    for (const std::string& child : children) {
+        if (child != "." && child != "..") {
+            env->RemoveFile(dbname + "/" + child);
+        }
+    }
+    env->RemoveDir(dbname);
+}
+
+// 生成 len 字节的可压缩数据：随机生成其中 compression_ratio 的比例，
+// 其余重复这些随机字节
+void CompressibleString(Random* rnd, double compression_ratio, size_t len,
+                        std::string* dst) {
+    size_t raw = static_cast<size_t>(len * compression_ratio);
+    if (raw < 1) {
+        raw = 1;
+    }
+    std::string raw_data;
+    for (size_t i = 0; i < raw; i++) {
+        raw_data.push_back(static_cast<char>(' ' + rnd->Uniform(95)));
+    }
+    dst->clear();
+    while (dst->size() < len) {
+        dst->append(raw_data);
+    }
+    dst->resize(len);
+}
+
+// 键值测试的 value 数据，从一个预先生成的缓冲区中依次截取
+class RandomGenerator {
+public:
+    RandomGenerator() : pos_(0) {
+        // 缓冲区比 table 的块大得多，相邻的 value 不会完全相同
+        Random rnd(301);
+        std::string piece;
+        while (data_.size() < 1048576) {
+            CompressibleString(&rnd, FLAGS_compression_ratio, 100, &piece);
+            data_.append(piece);
+        }
+    }
+
+    Slice Generate(size_t len) {
+        if (pos_ + len > data_.size()) {
+            pos_ = 0;
+        }
+        pos_ += len;
+        return Slice(data_.data() + pos_ - len, len);
+    }
+
+private:
+    std::string data_;
+    size_t pos_;
+};
+
+// 返回 (0, 1) 中均匀分布的随机数
+double NextUniform(Random* rnd) { return rnd->Next() / 2147483647.0; }
+
+// 返回标准正态分布的随机数（Box-Muller 变换）
+double NextGaussian(Random* rnd) {
+    const double u1 = NextUniform(rnd);
+    const double u2 = NextUniform(rnd);
+    const double kPi = 3.14159265358979323846;
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * kPi * u2);
+}
+
+// 合成的谱图。第 index 个谱图的内容只由 index 决定，
+// 读取的测试可以重新算出任意一个已写入的谱图的 key 和 value。
+// 分布大致符合蛋白质组学数据中的二级谱：
+//    precursor m/z  正态分布，均值 750，标准差 250，截取 [350, 2000] 的部分
+//    电荷           1、2、3、4 的比例为 10%、60%、25%、5%
+//    峰的数量       对数正态分布，中位数为 FLAGS_peaks，限制在 [5, 5000]
+//    峰的 m/z       在 [100, min(2000, precursor m/z * 电荷)] 中均匀分布
+//    峰的强度       对数正态分布
+class SpectrumGenerator {
+public:
+    // 生成第 index 个谱图的 precursor m/z 和电荷
+    static void Precursor(uint64_t index, double* mz, int* charge) {
+        Random rnd(Seed(index));
+        Precursor(&rnd, mz, charge);
+    }
+
+    // 生成第 index 个谱图的 key 和 value
+    void Generate(uint64_t index, std::string* key, std::string* value) {
+        Random rnd(Seed(index));
+        double precursor_mz;
+        int charge;
+        Precursor(&rnd, &precursor_mz, &charge);
+        key->clear();
+        EncodeSpectrumKey(precursor_mz, charge, index, key);
+
+        double n = std::exp(std::log(static_cast<double>(FLAGS_peaks)) +
+                            0.6 * NextGaussian(&rnd));
+        n = std::min(std::max(n, 5.0), 5000.0);
+        const size_t num_peaks = static_cast<size_t>(n);
+        const double max_mz = std::min(2000.0, precursor_mz * charge);
+        mz_.resize(num_peaks);
+        intensity_.resize(num_peaks);
+        for (size_t i = 0; i < num_peaks; i++) {
+            mz_[i] = 100.0 + (max_mz - 100.0) * NextUniform(&rnd);
+            intensity_[i] =
+                static_cast<float>(1000.0 * std::exp(2.0 * NextGaussian(&rnd)));
+        }
+        std::sort(mz_.begin(), mz_.end());
+        value->clear();
+        EncodePeakList(mz_.data(), intensity_.data(), num_peaks, value);
+    }
+
+private:
+    static uint32_t Seed(uint64_t index) {
+        // Random 对相近的种子产生相近的序列，先打散
+        char buf[8];
+        std::memcpy(buf, &index, sizeof(buf));
+        return Hash(buf, sizeof(buf), 0xbc9f1d34);
+    }
+
+    static void Precursor(Random* rnd, double* mz, int* charge) {
+        // 超出范围时重新生成，截断会让许多谱图的 precursor m/z 完全相同
+        do {
+            *mz = 750.0 + 250.0 * NextGaussian(rnd);
+        } while (*mz < 350.0 || *mz > 2000.0);
+        const uint32_t c = rnd->Uniform(100);
+        *charge = (c < 10) ? 1 : (c < 70) ? 2 : (c < 95) ? 3 : 4;
+    }
+
+    std::vector<double> mz_;
+    std::vector<float> intensity_;
+};
+
+// 一个线程在一个测试中的统计信息
+class Stats {
+public:
+    Stats() { Start(); }
+
+    void Start() {
+        next_report_ = 100;
+        hist_.Clear();
+        done_ = 0;
+        bytes_ = 0;
+        seconds_ = 0;
+        message_.clear();
+        start_ = finish_ = last_op_finish_ = Env::Default()->NowMicros();
+    }
+
+    void Merge(const Stats& other) {
+        hist_.Merge(other.hist_);
+        done_ += other.done_;
+        bytes_ += other.bytes_;
+        seconds_ += other.seconds_;
+        if (other.start_ < start_) {
+            start_ = other.start_;
+        }
+        if (other.finish_ > finish_) {
+            finish_ = other.finish_;
+        }
+        // 只保留一个线程的消息
+        if (message_.empty()) {
+            message_ = other.message_;
+        }
+    }
+
+    void Stop() {
+        finish_ = Env::Default()->NowMicros();
+        seconds_ = (finish_ - start_) * 1e-6;
+    }
+
+    void AddMessage(const std::string& msg) {
+        if (!message_.empty()) {
+            message_.push_back(' ');
+        }
+        message_.append(msg);
+    }
+
+    // 完成了 n 个操作，记录这一次调用的延迟
+    void FinishedOps(int n) {
+        const double now = Env::Default()->NowMicros();
+        hist_.Add(now - last_op_finish_);
+        last_op_finish_ = now;
+
+        done_ += n;
+        if (done_ >= next_report_) {
+            if (next_report_ < 1000) {
+                next_report_ += 100;
+            } else if (next_report_ < 5000) {
+                next_report_ += 500;
+            } else if (next_report_ < 10000) {
+                next_report_ += 1000;
+            } else if (next_report_ < 50000) {
+                next_report_ += 5000;
+            } else if (next_report_ < 100000) {
+                next_report_ += 10000;
+            } else if (next_report_ < 500000) {
+                next_report_ += 50000;
+            } else {
+                next_report_ += 100000;
+            }
+            std::fprintf(stderr, "... finished %lld ops%30s\r", done_, "");
+            std::fflush(stderr);
+        }
+    }
+
+    void AddBytes(int64_t n) { bytes_ += n; }
+
+    void Report(const std::string& name) {
+        // 没有完成任何操作的测试也输出一行
+        if (done_ < 1) {
+            done_ = 1;
+        }
+
+        // 多个线程时按第一个线程开始到最后一个线程结束的时间计算速率
+        const double elapsed = (finish_ - start_) * 1e-6;
+        std::string extra;
+        if (bytes_ > 0) {
+            char rate[100];
+            std::snprintf(rate, sizeof(rate), " %6.1f MB/s",
+                          (bytes_ / 1048576.0) / elapsed);
+            extra = rate;
+        }
+        if (!message_.empty()) {
+            extra.push_back(' ');
+            extra.append(message_);
+        }
+        std::fprintf(stdout, "%-16s : %11.3f micros/op %10.0f ops/s;%s\n",
+                     name.c_str(), seconds_ * 1e6 / done_, done_ / elapsed,
+                     extra.c_str());
+        std::fprintf(stdout,
+                     "%-16s   P50 %.2f  P95 %.2f  P99 %.2f  P99.9 %.2f  "
+                     "Max %.2f micros\n",
+                     "", hist_.Percentile(50), hist_.Percentile(95),
+                     hist_.Percentile(99), hist_.Percentile(99.9),
+                     hist_.Max());
+        if (FLAGS_histogram) {
+            std::fprintf(stdout, "Microseconds per op:\n%s\n",
+                         hist_.ToString().c_str());
+        }
+        std::fflush(stdout);
+    }
+
+private:
+    double start_;
+    double finish_;
+    double seconds_;
+    long long done_;
+    long long next_report_;
+    int64_t bytes_;
+    double last_op_finish_;
+    Histogram hist_;
+    std::string message_;
+};
+
+// 一个测试的所有线程共享的状态
+struct SharedState {
+    explicit SharedState(int total)
+        : total(total), num_initialized(0), num_done(0), start(false) {}
+
+    std::mutex mu;
+    std::condition_variable cv;
+    int total;
+
+    // 以下字段由 mu 保护。所有线程都初始化之后才开始计时，
+    // readwhilewriting 的写入线程在其他线程都结束之后停止
+    int num_initialized;
+    int num_done;
+    bool start;
+};
+
+// 每个线程的状态
+struct ThreadState {
+    ThreadState(int index, SharedState* shared)
+        : tid(index), rand(1000 + index), shared(shared) {}
+
+    int tid;      // 从 0 开始
+    Random rand;  // 每个线程的随机数序列不同
+    Stats stats;
+    SharedState* shared;
+};
+
+class Benchmark {
+public:
+    Benchmark()
+        : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size)
+                                       : nullptr),
+          filter_policy_(FLAGS_bloom_bits >= 0
+                             ? NewBloomFilterPolicy(FLAGS_bloom_bits)
+                             : nullptr),
+          db_(nullptr),
+          icmp_(FLAGS_spectrum_comparator ? SpectrumKeyComparator()
+                                          : BytewiseComparator()),
+          mem_(nullptr),
+          memtable_concurrent_(false),
+          bench_filter_policy_(nullptr),
+          table_block_cache_(nullptr),
+          table_file_(nullptr),
+          table_(nullptr),
+          num_(FLAGS_num),
+          reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads) {
+        if (!FLAGS_use_existing_db) {
+            DestroyBenchDB(Env::Default(), FLAGS_db);
+        }
+    }
+
+    ~Benchmark() {
+        CloseBenchTable();
+        if (mem_ != nullptr) {
+            mem_->Unref();
+        }
+        delete db_;
+        delete cache_;
+        delete filter_policy_;
+    }
+
+    bool Run() {
+        PrintHeader();
+        if (!Open()) {
+            return false;
+        }
+
+        const char* benchmarks = FLAGS_benchmarks;
+        while (benchmarks != nullptr) {
+            const char* sep = std::strchr(benchmarks, ',');
+            std::string name;
+            if (sep == nullptr) {
+                name = benchmarks;
+                benchmarks = nullptr;
+            } else {
+                name = std::string(benchmarks, sep - benchmarks);
+                benchmarks = sep + 1;
+            }
+            if (name.empty()) {
+                continue;
+            }
+
+            num_ = FLAGS_num;
+            reads_ = (FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads);
+            write_options_ = WriteOptions();
+            write_options_.sync = FLAGS_sync;
+            int num_threads = FLAGS_threads;
+            void (Benchmark::*method)(ThreadState*) = nullptr;
+            bool fresh_db = false;
+
+            if (name == "fillseq") {
+                fresh_db = true;
+                method = &Benchmark::WriteSeq;
+            } else if (name == "fillrandom") {
+                fresh_db = true;
+                method = &Benchmark::WriteRandom;
+            } else if (name == "overwrite") {
+                method = &Benchmark::WriteRandom;
+            } else if (name == "fillsync") {
+                fresh_db = true;
+                num_ = std::max(num_ / 1000, 1);
+                write_options_.sync = true;
+                method = &Benchmark::WriteRandom;
+            } else if (name == "readrandom") {
+                method = &Benchmark::ReadRandom;
+            } else if (name == "readseq") {
+                method = &Benchmark::ReadSequential;
+            } else if (name == "seekrandom") {
+                method = &Benchmark::SeekRandom;
+            } else if (name == "tableseekrandom") {
+                if (!OpenBenchTable()) {
+                    return false;
+                }
+                method = &Benchmark::TableSeekRandom;
+            } else if (name == "multireadrandom") {
+                method = &Benchmark::MultiReadRandom;
+            } else if (name == "readwhilewriting") {
+                num_threads++;  // 额外的写入线程
+                method = &Benchmark::ReadWhileWriting;
+            } else if (name == "fillspectra") {
+                fresh_db = true;
+                method = &Benchmark::WriteSpectra;
+            } else if (name == "precursorwindow") {
+                method = &Benchmark::PrecursorWindow;
+            } else if (name == "searchspectra") {
+                method = &Benchmark::SearchSpectra;
+            } else if (name == "memtablefillseq" ||
+                       name == "memtablefillrandom") {
+                // 按顺序写入时只能有一个写者
+                num_threads = 1;
+                NewMemTable();
+                memtable_concurrent_ = false;
+                method = (name == "memtablefillseq")
+                             ? &Benchmark::MemTableWriteSeq
+                             : &Benchmark::MemTableWriteRandom;
+            } else if (name == "memtableseekseq" ||
+                       name == "memtableseekrandom") {
+                if (mem_ == nullptr) {
+                    std::fprintf(stderr, "%s needs a preceding memtablefill*\n",
+                                 name.c_str());
+                    return false;
+                }
+                method = (name == "memtableseekseq")
+                             ? &Benchmark::MemTableSeekSeq
+                             : &Benchmark::MemTableSeekRandom;
+            } else if (name == "memtablescaling") {
+                MemTableScaling();
+                continue;
+            } else if (name == "filter") {
+                FilterBenchmark();
+                continue;
+            } else {
+                std::fprintf(stderr, "unknown benchmark '%s'\n",
+                             name.c_str());
+                return false;
+            }
+
+            if (fresh_db) {
+                if (FLAGS_use_existing_db) {
+                    std::fprintf(stdout,
+                                 "%-16s : skipped (--use_existing_db)\n",
+                                 name.c_str());
+                    continue;
+                }
+                delete db_;
+                db_ = nullptr;
+                DestroyBenchDB(Env::Default(), FLAGS_db);
+                if (!Open()) {
+                    return false;
+                }
+            }
+            RunBenchmark(num_threads, name, method);
+        }
+        return true;
+    }
+
+private:
+    void PrintHeader() {
+        const int kKeySize =
+            FLAGS_spectrum_keys ? static_cast<int>(kSpectrumKeySize) : 16;
+        PrintEnvironment();
+        std::fprintf(stdout, "Keys:       %d bytes each\n", kKeySize);
+        std::fprintf(
+            stdout, "Values:     %d bytes each (%d bytes after compression)\n",
+            FLAGS_value_size,
+            static_cast<int>(FLAGS_value_size * FLAGS_compression_ratio +
+                             0.5));
+        std::fprintf(stdout, "Entries:    %d\n", num_);
+        std::fprintf(stdout, "RawSize:    %.1f MB (estimated)\n",
+                     ((static_cast<int64_t>(kKeySize + FLAGS_value_size) *
+                       num_) /
+                      1048576.0));
+        std::fprintf(stdout,
+                     "Spectra:    %d peaks (median), %.0f ppm windows\n",
+                     FLAGS_peaks, FLAGS_tolerance_ppm);
+        PrintWarnings();
+        std::fprintf(stdout,
+                     "------------------------------------------------\n");
+    }
+
+    void PrintWarnings() {
+#if !defined(__OPTIMIZE__)
+        std::fprintf(
+            stdout,
+            "WARNING: Optimization is disabled: benchmarks unnecessarily "
+            "slow\n");
+#endif
+#ifndef NDEBUG
+        std::fprintf(
+            stdout,
+            "WARNING: Assertions are enabled; benchmarks unnecessarily slow\n");
+#endif
+    }
+
+    void PrintEnvironment() {
+        std::time_t now = std::time(nullptr);
+        std::fprintf(stderr, "Date:       %s", std::ctime(&now));
+
+#if defined(__linux)
+        FILE* cpuinfo = std::fopen("/proc/cpuinfo", "r");
+        if (cpuinfo != nullptr) {
+            char line[1000];
+            int num_cpus = 0;
+            std::string cpu_type;
+            std::string cache_size;
+            while (std::fgets(line, sizeof(line), cpuinfo) != nullptr) {
+                const char* sep = std::strchr(line, ':');
+                if (sep == nullptr) {
+                    continue;
+                }
+                std::string key(line, sep - line);
+                key.erase(key.find_last_not_of(" \t") + 1);
+                std::string val(sep + 1);
+                val.erase(0, val.find_first_not_of(" \t"));
+                val.erase(val.find_last_not_of(" \t\n") + 1);
+                if (key == "model name") {
+                    ++num_cpus;
+                    cpu_type = val;
+                } else if (key == "cache size") {
+                    cache_size = val;
+                }
+            }
+            std::fclose(cpuinfo);
+            std::fprintf(stderr, "CPU:        %d * %s\n", num_cpus,
+                         cpu_type.c_str());
+            std::fprintf(stderr, "CPUCache:   %s\n", cache_size.c_str());
+        }
+#endif
+    }
+
+    bool Open() {
+        Options options;
+        options.env = Env::Default();
+        options.create_if_missing = !FLAGS_use_existing_db;
+        options.block_cache = cache_;
+        options.filter_policy = filter_policy_;
+        options.use_mmap_reads = FLAGS_mmap_read;
+        if (FLAGS_spectrum_comparator) {
+            options.comparator = SpectrumKeyComparator();
+        }
+        if (FLAGS_write_buffer_size > 0) {
+            options.write_buffer_size = FLAGS_write_buffer_size;
+        }
+        if (FLAGS_max_file_size > 0) {
+            options.max_file_size = FLAGS_max_file_size;
+        }
+        if (FLAGS_block_size > 0) {
+            options.block_size = FLAGS_block_size;
+        }
+        if (FLAGS_open_files > 0) {
+            options.max_open_files = FLAGS_open_files;
+        }
+        if (FLAGS_compression >= 0) {
+            options.compression =
+                static_cast<CompressionType>(FLAGS_compression);
+        }
+        Status s = DB::Open(options, FLAGS_db, &db_);
+        if (!s.IsOk()) {
+            std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
+            return false;
+        }
+        return true;
+    }
+
+    static void ThreadBody(Benchmark* bm, ThreadState* thread,
+                           void (Benchmark::*method)(ThreadState*)) {
+        SharedState* shared = thread->shared;
+        {
+            std::unique_lock<std::mutex> l(shared->mu);
+            shared->num_initialized++;
+            if (shared->num_initialized >= shared->total) {
+                shared->cv.notify_all();
+            }
+            shared->cv.wait(l, [shared] { return shared->start; });
+        }
+
+        thread->stats.Start();
+        (bm->*method)(thread);
+        thread->stats.Stop();
+
+        {
+            std::lock_guard<std::mutex> l(shared->mu);
+            shared->num_done++;
+            if (shared->num_done >= shared->total) {
+                shared->cv.notify_all();
+            }
+        }
+    }
+
+    void RunBenchmark(int n, const std::string& name,
+                      void (Benchmark::*method)(ThreadState*)) {
+        SharedState shared(n);
+        std::vector<ThreadState*> states;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < n; i++) {
+            states.push_back(new ThreadState(i, &shared));
+            threads.emplace_back(&Benchmark::ThreadBody, this, states[i],
+                                 method);
+        }
+
+        {
+            std::unique_lock<std::mutex> l(shared.mu);
+            shared.cv.wait(l, [&shared, n] {
+                return shared.num_initialized >= n;
+            });
+            shared.start = true;
+            shared.cv.notify_all();
+            shared.cv.wait(l, [&shared, n] { return shared.num_done >= n; });
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+
+        for (int i = 1; i < n; i++) {
+            states[0]->stats.Merge(states[i]->stats);
+        }
+        states[0]->stats.Report(name);
+
+        for (ThreadState* state : states) {
+            delete state;
+        }
+    }
+
+    static void FormatKey(int k, std::string* key) {
+        if (FLAGS_spectrum_keys) {
+            key->clear();
+            EncodeSpectrumKey(350.0 + k * 0.001, 2, k, key);
+            return;
+        }
+        char buf[100];
+        std::snprintf(buf, sizeof(buf), "%016d", k);
+        key->assign(buf);
+    }
+
+    void WriteSeq(ThreadState* thread) { DoWrite(thread, true); }
+
+    void WriteRandom(ThreadState* thread) { DoWrite(thread, false); }
+
+    void DoWrite(ThreadState* thread, bool seq) {
+        RandomGenerator gen;
+        std::string key;
+        int64_t bytes = 0;
+        for (int i = 0; i < num_; i++) {
+            const int k = seq ? i : thread->rand.Uniform(FLAGS_num);
+            FormatKey(k, &key);
+            Status s =
+                db_->Put(write_options_, key, gen.Generate(FLAGS_value_size));
+            if (!s.IsOk()) {
+                std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+                std::exit(1);
+            }
+            bytes += FLAGS_value_size + key.size();
+            thread->stats.FinishedOps(1);
+        }
+        thread->stats.AddBytes(bytes);
+    }
+
+    void ReadSequential(ThreadState* thread) {
+        Iterator* iter = db_->NewIterator(ReadOptions());
+        int i = 0;
+        int64_t bytes = 0;
+        for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
+            bytes += iter->key().size() + iter->value().size();
+            thread->stats.FinishedOps(1);
+            ++i;
+        }
+        delete iter;
+        thread->stats.AddBytes(bytes);
+    }
+
+    void ReadRandom(ThreadState* thread) {
+        ReadOptions options;
+        std::string key;
+        std::string value;
+        int found = 0;
+        int64_t bytes = 0;
+        for (int i = 0; i < reads_; i++) {
+            FormatKey(thread->rand.Uniform(FLAGS_num), &key);
+            if (db_->Get(options, key, &value).IsOk()) {
+                found++;
+                bytes += key.size() + value.size();
+            }
+            thread->stats.FinishedOps(1);
+        }
+        thread->stats.AddBytes(bytes);
+        char msg[100];
+        std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+        thread->stats.AddMessage(msg);
+    }
+
+    void SeekRandom(ThreadState* thread) {
+        ReadOptions options;
+        std::string key;
+        int found = 0;
+        int64_t bytes = 0;
+        for (int i = 0; i < reads_; i++) {
+            Iterator* iter = db_->NewIterator(options);
+            FormatKey(thread->rand.Uniform(FLAGS_num), &key);
+            iter->Seek(key);
+            if (iter->Valid() && iter->key() == Slice(key)) {
+                found++;
+            }
+            for (int j = 0; j < FLAGS_seek_nexts && iter->Valid(); j++) {
+                bytes += iter->key().size() + iter->value().size();
+                iter->Next();
+            }
+            delete iter;
+            thread->stats.FinishedOps(1);
+        }
+        thread->stats.AddBytes(bytes);
+        char msg[100];
+        std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+        thread->stats.AddMessage(msg);
+    }
+
+    // 用 num 个条目生成 tableseekrandom 使用的 table 文件并打开。
+    // 没有指定 --cache_size 时使用能放下所有块的缓存，
+    // Seek 的时间主要花在索引块和数据块中的查找上
+    bool OpenBenchTable() {
+        CloseBenchTable();
+        Env* env = Env::Default();
+        Options options;
+        options.comparator = &icmp_;
+        if (FLAGS_block_size > 0) {
+            options.block_size = FLAGS_block_size;
+        }
+        if (FLAGS_compression >= 0) {
+            options.compression =
+                static_cast<CompressionType>(FLAGS_compression);
+        }
+        table_fname_ = std::string(FLAGS_db) + "/tableseek.sst";
+        WritableFile* file;
+        Status s = env->NewWritableFile(table_fname_, &file);
+        if (s.IsOk()) {
+            TableBuilder builder(options, file);
+            RandomGenerator gen;
+            std::string key;
+            for (int i = 0; i < num_; i++) {
+                FormatKey(i, &key);
+                builder.Add(InternalKey(key, 1, kTypeValue).Encode(),
+                            gen.Generate(FLAGS_value_size));
+            }
+            s = builder.Finish();
+            if (s.IsOk()) {
+                s = file->Close();
+            }
+            delete file;
+        }
+        uint64_t file_size = 0;
+        if (s.IsOk()) {
+            s = env->GetFileSize(table_fname_, &file_size);
+        }
+        if (s.IsOk()) {
+            if (cache_ == nullptr) {
+                table_block_cache_ = NewLRUCache(4 * file_size + (1 << 20));
+            }
+            options.block_cache =
+                (cache_ != nullptr) ? cache_ : table_block_cache_;
+            s = FLAGS_mmap_read
+                    ? env->NewMmapReadableFile(table_fname_, &table_file_)
+                    : env->NewRandomAccessFile(table_fname_, &table_file_);
+        }
+        if (s.IsOk()) {
+            s = Table::Open(options, table_file_, file_size, &table_);
+        }
+        if (s.IsOk()) {
+            Iterator* iter = table_->NewIterator(ReadOptions());
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            }
+            s = iter->status();
+            delete iter;
+        }
+        if (!s.IsOk()) {
+            std::fprintf(stderr, "table error: %s\n", s.ToString().c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void CloseBenchTable() {
+        if (table_file_ == nullptr) {
+            return;
+        }
+        delete table_;
+        delete table_file_;
+        delete table_block_cache_;
+        table_ = nullptr;
+        table_file_ = nullptr;
+        table_block_cache_ = nullptr;
+        Env::Default()->RemoveFile(table_fname_);
+    }
+
+    void TableSeekRandom(ThreadState* thread) {
+        Iterator* iter = table_->NewIterator(ReadOptions());
+        std::string key;
+        int found = 0;
+        for (int i = 0; i < reads_; i++) {
+            FormatKey(thread->rand.Uniform(num_), &key);
+            LookupKey lkey(key, kMaxSequenceNumber);
+            iter->Seek(lkey.internal_key());
+            if (iter->Valid() &&
+                ExtractUserKey(iter->key()) == Slice(key)) {
+                found++;
+            }
+            thread->stats.FinishedOps(1);
+        }
+        delete iter;
+        char msg[100];
+        std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+        thread->stats.AddMessage(msg);
+    }
+
+    void MultiReadRandom(ThreadState* thread) {
+        ReadOptions options;
+        std::vector<std::string> key_data(FLAGS_multiget_batch);
+        std::vector<Slice> keys;
+        std::vector<std::string> values;
+        int found = 0;
+        int64_t bytes = 0;
+        for (int i = 0; i < reads_; i += FLAGS_multiget_batch) {
+            const int n = std::min(FLAGS_multiget_batch, reads_ - i);
+            keys.clear();
+            for (int j = 0; j < n; j++) {
+                FormatKey(thread->rand.Uniform(FLAGS_num), &key_data[j]);
+                keys.push_back(key_data[j]);
+            }
+            std::vector<Status> statuses =
+                db_->MultiGet(options, keys, &values);
+            for (int j = 0; j < n; j++) {
+                if (statuses[j].IsOk()) {
+                    found++;
+                    bytes += keys[j].size() + values[j].size();
+                }
+            }
+            thread->stats.FinishedOps(n);
+        }
+        thread->stats.AddBytes(bytes);
+        char msg[100];
+        std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+        thread->stats.AddMessage(msg);
+    }
+
+    void ReadWhileWriting(ThreadState* thread) {
+        if (thread->tid > 0) {
+            ReadRandom(thread);
+            return;
+        }
+
+        // 写入线程不统计操作，一直写到其他线程都结束
+        RandomGenerator gen;
+        std::string key;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> l(thread->shared->mu);
+                if (thread->shared->num_done + 1 >=
+                    thread->shared->num_initialized) {
+                    break;
+                }
+            }
+            FormatKey(thread->rand.Uniform(FLAGS_num), &key);
+            Status s = db_->Put(WriteOptions(), key,
+                                gen.Generate(FLAGS_value_size));
+            if (!s.IsOk()) {
+                std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+                std::exit(1);
+            }
+        }
+    }
+
+    void WriteSpectra(ThreadState* thread) {
+        SpectrumGenerator gen;
+        std::string key;
+        std::string value;
+        int64_t bytes = 0;
+        int64_t value_bytes = 0;
+        for (int i = 0; i < num_; i++) {
+            gen.Generate(i, &key, &value);
+            Status s = db_->Put(write_options_, key, value);
+            if (!s.IsOk()) {
+                std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+                std::exit(1);
+            }
+            bytes += key.size() + value.size();
+            value_bytes += value.size();
+            thread->stats.FinishedOps(1);
+        }
+        thread->stats.AddBytes(bytes);
+        char msg[100];
+        std::snprintf(msg, sizeof(msg), "(%.0f bytes per value)",
+                      num_ > 0 ? static_cast<double>(value_bytes) / num_ : 0.0);
+        thread->stats.AddMessage(msg);
+    }
+
+    void PrecursorWindow(ThreadState* thread) {
+        ReadOptions options;
+        int64_t matches = 0;
+        int64_t bytes = 0;
+        for (int i = 0; i < reads_; i++) {
+            double mz;
+            int charge;
+            SpectrumGenerator::Precursor(thread->rand.Uniform(FLAGS_num), &mz,
+                                         &charge);
+            Iterator* iter = db_->RangeQuery(options, mz, FLAGS_tolerance_ppm);
+            for (; iter->Valid(); iter->Next()) {
+                bytes += iter->key().size() + iter->value().size();
+                matches++;
+            }
+            delete iter;
+            thread->stats.FinishedOps(1);
+        }
+        thread->stats.AddBytes(bytes);
+        char msg[100];
+        std::snprintf(msg, sizeof(msg), "(%.1f spectra per window)",
+                      reads_ > 0 ? static_cast<double>(matches) / reads_ : 0.0);
+        thread->stats.AddMessage(msg);
+    }
+
+    void SearchSpectra(ThreadState* thread) {
+        SpectrumGenerator gen;
+        ReadOptions options;
+        std::string key;
+        std::string query;
+        std::vector<ScoredSpectrum> results;
+        int64_t hits = 0;
+        for (int i = 0; i < reads_; i++) {
+            const uint64_t index = thread->rand.Uniform(FLAGS_num);
+            gen.Generate(index, &key, &query);
+            double mz;
+            int charge;
+            SpectrumGenerator::Precursor(index, &mz, &charge);
+            SpectrumScorer scorer(query, FLAGS_bin_width);
+            Status s = db_->SearchSpectra(options, mz, FLAGS_tolerance_ppm,
+                                          scorer, FLAGS_top_k, &results);
+            if (!s.IsOk()) {
+                std::fprintf(stderr, "search error: %s\n",
+                             s.ToString().c_str());
+                std::exit(1);
+            }
+            // 查询谱图本身应当是分数最高的结果
+            if (!results.empty() && results[0].key == key) {
+                hits++;
+            }
+            thread->stats.FinishedOps(1);
+        }
+        char msg[100];
+        std::snprintf(msg, sizeof(msg), "(%lld of %d ranked first)",
+                      static_cast<long long>(hits), reads_);
+        thread->stats.AddMessage(msg);
+    }
+
+    // 换成一个新的空 MemTable
+    void NewMemTable() {
+        if (mem_ != nullptr) {
+            mem_->Unref();
+        }
+        mem_ = new MemTable(icmp_);
+        mem_->Ref();
+    }
+
+    void MemTableScaling() {
+        const int total = num_;
+        for (int n = 1; n <= FLAGS_max_write_threads; n *= 2) {
+            for (bool concurrent : {false, true}) {
+                NewMemTable();
+                memtable_concurrent_ = concurrent;
+                num_ = total / n;
+                char name[100];
+                std::snprintf(name, sizeof(name), "%s/%d",
+                              concurrent ? "memconcurrent" : "memlocked", n);
+                RunBenchmark(n, name, &Benchmark::MemTableWriteRandom);
+            }
+        }
+        mem_->Unref();
+        mem_ = nullptr;
+    }
+
+    void FilterBenchmark() {
+        const int bits_per_key = FLAGS_bloom_bits >= 0 ? FLAGS_bloom_bits : 10;
+        std::vector<std::string> keys(num_);
+        for (int i = 0; i < num_; i++) {
+            FormatKey(i, &keys[i]);
+        }
+        const std::vector<Slice> slices(keys.begin(), keys.end());
+        const struct {
+            const char* name;
+            const FilterPolicy* policy;
+        } kPolicies[] = {
+            {"classic", NewBloomFilterPolicy(bits_per_key)},
+            {"blocked", NewBlockedBloomFilterPolicy(bits_per_key)},
+        };
+        for (const auto& p : kPolicies) {
+            bench_filter_.clear();
+            p.policy->CreateFilter(slices.data(), num_, &bench_filter_);
+            bench_filter_policy_ = p.policy;
+            for (bool batch : {false, true}) {
+                RunBenchmark(1,
+                             std::string(batch ? "filterbatch/" : "filter/") +
+                                 p.name,
+                             batch ? &Benchmark::FilterProbeBatch
+                                   : &Benchmark::FilterProbe);
+            }
+            delete p.policy;
+        }
+        bench_filter_policy_ = nullptr;
+        bench_filter_.clear();
+    }
+
+    // 探测的 key 都不在过滤器中，匹配的都是误判
+    void FilterProbe(ThreadState* thread) {
+        std::string key;
+        int positives = 0;
+        for (int i = 0; i < reads_; i++) {
+            FormatKey(FLAGS_num + thread->rand.Uniform(FLAGS_num), &key);
+            positives += bench_filter_policy_->KeyMayMatch(key, bench_filter_);
+            thread->stats.FinishedOps(1);
+        }
+        ReportFalsePositives(thread, positives, reads_);
+    }
+
+    void FilterProbeBatch(ThreadState* thread) {
+        const int batch = std::max(FLAGS_multiget_batch, 1);
+        std::vector<std::string> keys(batch);
+        std::vector<Slice> slices(batch);
+        std::unique_ptr<bool[]> results(new bool[batch]);
+        int positives = 0;
+        int probes = 0;
+        while (probes < reads_) {
+            const int n = std::min(batch, reads_ - probes);
+            for (int i = 0; i < n; i++) {
+                FormatKey(FLAGS_num + thread->rand.Uniform(FLAGS_num),
+                          &keys[i]);
+                slices[i] = keys[i];
+            }
+            bench_filter_policy_->KeysMayMatch(slices.data(), n, bench_filter_,
+                                               results.get());
+            for (int i = 0; i < n; i++) {
+                positives += results[i];
+            }
+            probes += n;
+            thread->stats.FinishedOps(n);
+        }
+        ReportFalsePositives(thread, positives, probes);
+    }
+
+    void ReportFalsePositives(ThreadState* thread, int positives, int probes) {
+        char msg[100];
+        std::snprintf(msg, sizeof(msg),
+                      "(false positive rate %.3f%%, %.1f bits per key)",
+                      probes > 0 ? 100.0 * positives / probes : 0.0,
+                      num_ > 0 ? 8.0 * bench_filter_.size() / num_ : 0.0);
+        thread->stats.AddMessage(msg);
+    }
+
+    void MemTableWriteSeq(ThreadState* thread) {
+        DoMemTableWrite(thread, true);
+    }
+
+    void MemTableWriteRandom(ThreadState* thread) {
+        DoMemTableWrite(thread, false);
+    }
+
+    void DoMemTableWrite(ThreadState* thread, bool seq) {
+        RandomGenerator gen;
+        std::string key;
+        int64_t bytes = 0;
+        // 每个线程使用不同范围的序列号，internal key 互不相同
+        const SequenceNumber base =
+            static_cast<SequenceNumber>(thread->tid) * num_ + 1;
+        for (int i = 0; i < num_; i++) {
+            FormatKey(seq ? i : thread->rand.Uniform(FLAGS_num), &key);
+            const Slice value = gen.Generate(FLAGS_value_size);
+            if (memtable_concurrent_) {
+                mem_->ConcurrentAdd(base + i, kTypeValue, key, value);
+            } else {
+                std::lock_guard<std::mutex> l(memtable_mu_);
+                mem_->Add(base + i, kTypeValue, key, value);
+            }
+            bytes += FLAGS_value_size + key.size();
+            thread->stats.FinishedOps(1);
+        }
+        thread->stats.AddBytes(bytes);
+    }
+
+    void MemTableSeekSeq(ThreadState* thread) { DoMemTableSeek(thread, true); }
+
+    void MemTableSeekRandom(ThreadState* thread) {
+        DoMemTableSeek(thread, false);
+    }
+
+    // 每次 Seek 的目标是 user key 的最新版本，与 DB::Get() 查找 MemTable
+    // 的方式相同
+    void DoMemTableSeek(ThreadState* thread, bool seq) {
+        Iterator* iter = mem_->NewIterator();
+        std::string key;
+        int found = 0;
+        for (int i = 0; i < reads_; i++) {
+            FormatKey(seq ? i % FLAGS_num : thread->rand.Uniform(FLAGS_num),
+                      &key);
+            LookupKey lkey(key, kMaxSequenceNumber);
+            iter->Seek(lkey.internal_key());
+            if (iter->Valid() &&
+                ExtractUserKey(iter->key()) == Slice(key)) {
+                found++;
+            }
+            thread->stats.FinishedOps(1);
+        }
+        delete iter;
+        char msg[100];
+        std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+        thread->stats.AddMessage(msg);
+    }
+
+    Cache* cache_;
+    const FilterPolicy* filter_policy_;
+    DB* db_;
+    // 当前测试的写入选项
+    WriteOptions write_options_;
+    // 直接测试 MemTable 时使用，与数据库使用相同的比较器
+    const InternalKeyComparator icmp_;
+    MemTable* mem_;
+    // 为 false 时写者通过 memtable_mu_ 串行调用 Add()
+    bool memtable_concurrent_;
+    std::mutex memtable_mu_;
+    // filter 测试使用的过滤器
+    const FilterPolicy* bench_filter_policy_;
+    std::string bench_filter_;
+    // tableseekrandom 使用的 table 文件
+    std::string table_fname_;
+    Cache* table_block_cache_;
+    RandomAccessFile* table_file_;
+    Table* table_;
+    int num_;
+    int reads_;
+};
+
+// 按名字查找压缩算法，找不到时返回 false
+bool ParseCompression(const char* name, int* type) {
+    static const struct {
+        const char* name;
+        CompressionType type;
+    } kCompressions[] = {
+        {"none", kNoCompression},   {"snappy", kSnappyCompression},
+        {"zlib", kZlibCompression}, {"lz4", kLZ4Compression},
+        {"zstd", kZstdCompression}, {"spectrum", kSpectrumCompression},
+    };
+    for (const auto& c : kCompressions) {
+        if (std::strcmp(name, c.name) == 0) {
+            *type = c.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+}  // namespace massdb
+
+int main(int argc, char** argv) {
+    using namespace massdb;
+    std::string default_db_path;
+
+    for (int i = 1; i < argc; i++) {
+        double d;
+        int n;
+        long long ll;
+        char junk;
+        if (Slice(argv[i]).starts_with("--benchmarks=")) {
+            FLAGS_benchmarks = argv[i] + std::strlen("--benchmarks=");
+        } else if (std::sscanf(argv[i], "--compression_ratio=%lf%c", &d,
+                               &junk) == 1) {
+            FLAGS_compression_ratio = d;
+        } else if (std::sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_histogram = n;
+        } else if (std::sscanf(argv[i], "--spectrum_keys=%d%c", &n,
+                               &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_spectrum_keys = n;
+        } else if (std::sscanf(argv[i], "--use_existing_db=%d%c", &n,
+                               &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_use_existing_db = n;
+        } else if (std::sscanf(argv[i], "--sync=%d%c", &n, &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_sync = n;
+        } else if (std::sscanf(argv[i], "--mmap_read=%d%c", &n, &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_mmap_read = n;
+        } else if (std::sscanf(argv[i], "--spectrum_comparator=%d%c", &n,
+                               &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_spectrum_comparator = n;
+        } else if (std::sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
+            FLAGS_num = n;
+        } else if (std::sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
+            FLAGS_reads = n;
+        } else if (std::sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
+            FLAGS_threads = n;
+        } else if (std::sscanf(argv[i], "--max_write_threads=%d%c", &n,
+                               &junk) == 1 &&
+                   n > 0) {
+            FLAGS_max_write_threads = n;
+        } else if (std::sscanf(argv[i], "--value_size=%d%c", &n, &junk) ==
+                   1) {
+            FLAGS_value_size = n;
+        } else if (std::sscanf(argv[i], "--seek_nexts=%d%c", &n, &junk) ==
+                   1) {
+            FLAGS_seek_nexts = n;
+        } else if (std::sscanf(argv[i], "--multiget_batch=%d%c", &n,
+                               &junk) == 1 &&
+                   n > 0) {
+            FLAGS_multiget_batch = n;
+        } else if (std::sscanf(argv[i], "--peaks=%d%c", &n, &junk) == 1 &&
+                   n > 0) {
+            FLAGS_peaks = n;
+        } else if (std::sscanf(argv[i], "--tolerance_ppm=%lf%c", &d,
+                               &junk) == 1) {
+            FLAGS_tolerance_ppm = d;
+        } else if (std::sscanf(argv[i], "--bin_width=%lf%c", &d, &junk) ==
+                       1 &&
+                   d > 0) {
+            FLAGS_bin_width = d;
+        } else if (std::sscanf(argv[i], "--top_k=%d%c", &n, &junk) == 1) {
+            FLAGS_top_k = n;
+        } else if (std::sscanf(argv[i], "--write_buffer_size=%d%c", &n,
+                               &junk) == 1) {
+            FLAGS_write_buffer_size = n;
+        } else if (std::sscanf(argv[i], "--max_file_size=%d%c", &n,
+                               &junk) == 1) {
+            FLAGS_max_file_size = n;
+        } else if (std::sscanf(argv[i], "--block_size=%d%c", &n, &junk) ==
+                   1) {
+            FLAGS_block_size = n;
+        } else if (std::sscanf(argv[i], "--open_files=%d%c", &n, &junk) ==
+                   1) {
+            FLAGS_open_files = n;
+        } else if (std::sscanf(argv[i], "--cache_size=%lld%c", &ll,
+                               &junk) == 1) {
+            FLAGS_cache_size = ll;
+        } else if (std::sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) ==
+                   1) {
+            FLAGS_bloom_bits = n;
+        } else if (Slice(argv[i]).starts_with("--compression=") &&
+                   ParseCompression(argv[i] + std::strlen("--compression="),
+                                    &FLAGS_compression)) {
+            // 已经解析
+        } else if (Slice(argv[i]).starts_with("--db=")) {
+            FLAGS_db = argv[i] + std::strlen("--db=");
+        } else {
+            std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (FLAGS_db == nullptr) {
+        default_db_path = "/tmp/massdbbench";
+        FLAGS_db = default_db_path.c_str();
+    }
+
+    Benchmark benchmark;
+    return benchmark.Run() ? 0 : 1;
+}
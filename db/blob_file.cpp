@@ -0,0 +1,147 @@
+//
+// Created by Xsakura on 2023/6/20.
+//
+
+#include "db/blob_file.h"
+
+#include <memory>
+
+#include "db/filename.h"
+#include "massdb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace massdb {
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+    PutVarint64(dst, file_number);
+    PutVarint64(dst, offset);
+    PutVarint64(dst, size);
+}
+
+bool BlobIndex::DecodeFrom(const Slice& input) {
+    Slice in = input;
+    return GetVarint64(&in, &file_number) && GetVarint64(&in, &offset) &&
+           GetVarint64(&in, &size) && in.empty() &&
+           offset >= kBlobRecordHeaderSize;
+}
+
+Status BlobFileBuilder::Open(Env* env, const std::string& dbname,
+                             uint64_t number, BlobFileBuilder** result) {
+    *result = nullptr;
+    WritableFile* file;
+    Status s = env->NewWritableFile(BlobFileName(dbname, number), &file);
+    if (s.IsOk()) {
+        *result = new BlobFileBuilder(number, file);
+    }
+    return s;
+}
+
+BlobFileBuilder::~BlobFileBuilder() { delete file_; }
+
+Status BlobFileBuilder::Add(const Slice& value, std::string* blob_index) {
+    char header[kBlobRecordHeaderSize];
+    EncodeFixed32(header, crc32c::Mask(crc32c::Value(value.data(),
+                                                     value.size())));
+    Status s = file_->Append(Slice(header, sizeof(header)));
+    if (s.IsOk()) {
+        s = file_->Append(value);
+    }
+    if (s.IsOk()) {
+        BlobIndex index;
+        index.file_number = number_;
+        index.offset = offset_ + kBlobRecordHeaderSize;
+        index.size = value.size();
+        blob_index->clear();
+        index.EncodeTo(blob_index);
+        offset_ += BlobRecordSize(value.size());
+        num_blobs_++;
+    }
+    return s;
+}
+
+Status BlobFileBuilder::Finish() {
+    Status s = file_->Sync();
+    if (s.IsOk()) {
+        s = file_->Close();
+    }
+    delete file_;
+    file_ = nullptr;
+    return s;
+}
+
+static void DeleteEntry(const Slice& key, void* value) {
+    delete reinterpret_cast<RandomAccessFile*>(value);
+}
+
+BlobFileCache::BlobFileCache(const std::string& dbname, const Options& options,
+                             int entries)
+    : env_(options.env), dbname_(dbname), cache_(NewLRUCache(entries)) {}
+
+BlobFileCache::~BlobFileCache() { delete cache_; }
+
+Status BlobFileCache::FindFile(uint64_t file_number, Cache::Handle** handle) {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    Slice key(buf, sizeof(buf));
+    *handle = cache_->Lookup(key);
+    if (*handle != nullptr) {
+        return Status::Ok();
+    }
+
+    // 打开文件时不持有锁，同时打开同一个文件的线程中后插入的替换先插入的
+    RandomAccessFile* file;
+    Status s =
+        env_->NewRandomAccessFile(BlobFileName(dbname_, file_number), &file);
+    if (s.IsOk()) {
+        *handle = cache_->Insert(key, file, 1, &DeleteEntry);
+    }
+    return s;
+}
+
+Status BlobFileCache::Get(const ReadOptions& options, const Slice& blob_index,
+                          std::string* value) {
+    BlobIndex index;
+    if (!index.DecodeFrom(blob_index)) {
+        return Status::Corruption("bad blob index");
+    }
+    Cache::Handle* handle;
+    Status s = FindFile(index.file_number, &handle);
+    if (!s.IsOk()) {
+        return s;
+    }
+    // 持有句柄期间文件不会被关闭
+    RandomAccessFile* file =
+        reinterpret_cast<RandomAccessFile*>(cache_->Value(handle));
+
+    // 一次读取 crc 和 value
+    const size_t n = static_cast<size_t>(BlobRecordSize(index.size));
+    std::unique_ptr<char[]> scratch(new char[n]);
+    Slice contents;
+    s = file->Read(index.offset - kBlobRecordHeaderSize, n, &contents,
+                   scratch.get());
+    cache_->Release(handle);
+    if (!s.IsOk()) {
+        return s;
+    }
+    if (contents.size() != n) {
+        return Status::Corruption("truncated blob record");
+    }
+    const char* data = contents.data() + kBlobRecordHeaderSize;
+    if (options.verify_checksums) {
+        const uint32_t crc = crc32c::Unmask(DecodeFixed32(contents.data()));
+        if (crc != crc32c::Value(data, index.size)) {
+            return Status::Corruption("blob checksum mismatch");
+        }
+    }
+    value->assign(data, index.size);
+    return s;
+}
+
+void BlobFileCache::Evict(uint64_t file_number) {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    cache_->Erase(Slice(buf, sizeof(buf)));
+}
+
+}  // namespace massdb
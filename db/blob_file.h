@@ -0,0 +1,112 @@
+//
+// Created by Xsakura on 2023/6/20.
+//
+
+#ifndef MASSDB_DB_BLOB_FILE_H
+#define MASSDB_DB_BLOB_FILE_H
+
+#include <cstdint>
+#include <string>
+
+#include "massdb/cache.h"
+#include "massdb/options.h"
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class Env;
+class RandomAccessFile;
+class WritableFile;
+
+// 键值分离时，较大的 value 保存在只追加的 blob 文件中。
+// 文件由连续的记录组成，每条记录的格式为：
+//    crc   : fixed32   // value 的 crc32c（masked）
+//    value : char[size]
+//
+// table 中对应条目的类型为 kTypeBlobIndex，value 是 blob 引用：
+//    file_number : varint64
+//    offset      : varint64   // value 在文件中的偏移（不含 crc）
+//    size        : varint64
+// 读取 value 只需要一次 pread。
+static const size_t kBlobRecordHeaderSize = 4;
+
+// 长度为 value_size 的 value 在 blob 文件中占用的字节数
+inline uint64_t BlobRecordSize(uint64_t value_size) {
+    return kBlobRecordHeaderSize + value_size;
+}
+
+// 解码后的 blob 引用
+struct BlobIndex {
+    uint64_t file_number;
+    uint64_t offset;
+    uint64_t size;
+
+    void EncodeTo(std::string* dst) const;
+    bool DecodeFrom(const Slice& input);
+};
+
+// 顺序写入一个 blob 文件
+class BlobFileBuilder {
+public:
+    // 新建编号为 number 的 blob 文件，成功时将写入它的 builder 存入 *result
+    static Status Open(Env* env, const std::string& dbname, uint64_t number,
+                       BlobFileBuilder** result);
+
+    BlobFileBuilder(const BlobFileBuilder&) = delete;
+    BlobFileBuilder& operator=(const BlobFileBuilder&) = delete;
+
+    // 没有调用 Finish() 时放弃写入，未完成的文件由调用者删除
+    ~BlobFileBuilder();
+
+    // 追加 value，将指向它的 blob 引用存入 *blob_index
+    Status Add(const Slice& value, std::string* blob_index);
+
+    // 持久化并关闭文件
+    Status Finish();
+
+    uint64_t number() const { return number_; }
+    uint64_t NumBlobs() const { return num_blobs_; }
+    uint64_t FileSize() const { return offset_; }
+
+private:
+    BlobFileBuilder(uint64_t number, WritableFile* file)
+        : number_(number), file_(file), offset_(0), num_blobs_(0) {}
+
+    const uint64_t number_;
+    WritableFile* file_;
+    uint64_t offset_;  // 已经写入的字节数
+    uint64_t num_blobs_;
+};
+
+// 缓存已经打开的 blob 文件，最多同时打开 entries 个，
+// 超出时按 LRU 关闭。线程安全
+class BlobFileCache {
+public:
+    BlobFileCache(const std::string& dbname, const Options& options,
+                  int entries);
+
+    BlobFileCache(const BlobFileCache&) = delete;
+    BlobFileCache& operator=(const BlobFileCache&) = delete;
+
+    ~BlobFileCache();
+
+    // 读取 blob 引用 blob_index 指向的 value，存入 *value。
+    // options.verify_checksums 为 true 时检查 crc
+    Status Get(const ReadOptions& options, const Slice& blob_index,
+               std::string* value);
+
+    // 关闭编号为 file_number 的文件（如果已经打开的话）
+    void Evict(uint64_t file_number);
+
+private:
+    Status FindFile(uint64_t file_number, Cache::Handle** handle);
+
+    Env* const env_;
+    const std::string dbname_;
+    Cache* cache_;  // 文件编号 -> RandomAccessFile
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_BLOB_FILE_H
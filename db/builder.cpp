@@ -0,0 +1,202 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "db/builder.h"
+
+#include <cassert>
+
+#include "db/blob_file.h"
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "db/fragment_index.h"
+#include "db/table_cache.h"
+#include "db/version_edit.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/table_builder.h"
+
+namespace massdb {
+
+CompressionType CompressionForLevel(const Options& options, int level,
+                                    bool bottommost) {
+    if (bottommost &&
+        options.bottommost_compression != kDisableCompressionOption) {
+        return options.bottommost_compression;
+    }
+    if (!options.compression_per_level.empty()) {
+        const int n = static_cast<int>(options.compression_per_level.size());
+        return options.compression_per_level[level < n ? level : n - 1];
+    }
+    return options.compression;
+}
+
+// 从 *iter 的当前位置开始构建 table 文件，使用 compression 压缩。
+// max_file_size 大于 0 时，文件大小达到它之后停止
+static Status BuildTableFrom(const std::string& dbname, Env* env,
+                             const Options& options, TableCache* table_cache,
+                             CompressionType compression,
+                             uint64_t max_file_size, Iterator* iter,
+                             FileMetaData* meta, BlobFileMetaData* blob) {
+    Status s;
+    meta->file_size = 0;
+    meta->oldest_blob_file = 0;
+    *blob = BlobFileMetaData();
+
+    std::string fname = TableFileName(dbname, meta->number);
+    if (iter->Valid()) {
+        WritableFile* file;
+        s = env->NewWritableFile(fname, &file);
+        if (!s.IsOk()) {
+            return s;
+        }
+
+        Options table_options = options;
+        table_options.compression = compression;
+        TableBuilder* builder = new TableBuilder(table_options, file);
+        FragmentIndexBuilder* fragment_builder = nullptr;
+        if (options.fragment_index_bin_width > 0) {
+            fragment_builder =
+                new FragmentIndexBuilder(options.fragment_index_bin_width);
+        }
+        BlobFileBuilder* blob_builder = nullptr;
+        ParsedInternalKey ikey;
+        std::string blob_key, blob_index;
+        Slice key;
+        for (; iter->Valid(); iter->Next()) {
+            key = iter->key();
+            const Slice value = iter->value();
+            if (fragment_builder != nullptr) {
+                fragment_builder->Add(key, value);
+            }
+            if (options.min_blob_size > 0 &&
+                value.size() >= options.min_blob_size &&
+                ParseInternalKey(key, &ikey) && ikey.type == kTypeValue) {
+                // 较大的 value 写入与 table 文件同编号的 blob 文件，
+                // table 中只保存引用
+                if (blob_builder == nullptr) {
+                    s = BlobFileBuilder::Open(env, dbname, meta->number,
+                                              &blob_builder);
+                }
+                if (s.IsOk()) {
+                    s = blob_builder->Add(value, &blob_index);
+                }
+                if (!s.IsOk()) {
+                    break;
+                }
+                blob_key.clear();
+                AppendInternalKey(&blob_key,
+                                  ParsedInternalKey(ikey.user_key,
+                                                    ikey.sequence,
+                                                    kTypeBlobIndex));
+                key = blob_key;
+                builder->Add(key, blob_index);
+            } else {
+                builder->Add(key, value);
+            }
+            if (builder->NumEntries() == 1) {
+                meta->smallest.DecodeFrom(key);
+            }
+            if (max_file_size > 0 && builder->FileSize() >= max_file_size) {
+                // key 在 Next() 之后可能失效，先记录最大的 key
+                meta->largest.DecodeFrom(key);
+                key.clear();
+                iter->Next();
+                break;
+            }
+        }
+        if (!key.empty()) {
+            meta->largest.DecodeFrom(key);
+        }
+
+        // 先持久化 blob 文件，table 文件中的引用不会指向丢失的数据
+        if (blob_builder != nullptr) {
+            if (s.IsOk()) {
+                s = blob_builder->Finish();
+            }
+            if (s.IsOk()) {
+                blob->number = meta->number;
+                blob->total_count = blob_builder->NumBlobs();
+                blob->total_bytes = blob_builder->FileSize();
+                meta->oldest_blob_file = meta->number;
+            }
+            delete blob_builder;
+        }
+
+        // 完成构建并检查错误
+        if (s.IsOk()) {
+            s = builder->Finish();
+        } else {
+            builder->Abandon();
+        }
+        if (s.IsOk()) {
+            meta->file_size = builder->FileSize();
+            assert(meta->file_size > 0);
+        }
+        delete builder;
+
+        // 写入对应的碎片离子索引文件
+        if (s.IsOk() && fragment_builder != nullptr) {
+            s = fragment_builder->Finish(
+                FragmentIndexOptions(options), env,
+                FragmentIndexFileName(dbname, meta->number),
+                &meta->fragment_index_size);
+        }
+        delete fragment_builder;
+
+        // 持久化并关闭文件
+        if (s.IsOk()) {
+            s = file->Sync();
+        }
+        if (s.IsOk()) {
+            s = file->Close();
+        }
+        delete file;
+        file = nullptr;
+
+        if (s.IsOk()) {
+            // 确认生成的文件可以正常打开
+            Iterator* it = table_cache->NewIterator(
+                ReadOptions(), meta->number, meta->file_size, 0);
+            s = it->status();
+            delete it;
+        }
+    }
+
+    // 检查迭代器的错误
+    if (!iter->status().IsOk()) {
+        s = iter->status();
+    }
+
+    if (s.IsOk() && meta->file_size > 0) {
+        // 保留生成的文件
+    } else {
+        meta->file_size = 0;
+        meta->oldest_blob_file = 0;
+        *blob = BlobFileMetaData();
+        env->RemoveFile(fname);
+        env->RemoveFile(FragmentIndexFileName(dbname, meta->number));
+        env->RemoveFile(BlobFileName(dbname, meta->number));
+    }
+    return s;
+}
+
+Status BuildTable(const std::string& dbname, Env* env, const Options& options,
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  BlobFileMetaData* blob) {
+    iter->SeekToFirst();
+    return BuildTableFrom(dbname, env, options, table_cache,
+                          CompressionForLevel(options, 0, false), 0, iter,
+                          meta, blob);
+}
+
+Status BuildLevelTable(const std::string& dbname, Env* env,
+                       const Options& options, TableCache* table_cache,
+                       int level, bool bottommost, Iterator* iter,
+                       FileMetaData* meta, BlobFileMetaData* blob) {
+    return BuildTableFrom(dbname, env, options, table_cache,
+                          CompressionForLevel(options, level, bottommost),
+                          options.max_file_size, iter, meta, blob);
+}
+
+}  // namespace massdb
@@ -0,0 +1,50 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_DB_BUILDER_H
+#define MASSDB_DB_BUILDER_H
+
+#include <string>
+
+#include "massdb/options.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+struct BlobFileMetaData;
+struct FileMetaData;
+
+class Env;
+class Iterator;
+class TableCache;
+
+// 返回写入第 level 层的 table 应该使用的压缩算法。
+// bottommost 为 true 表示 table 位于数据库的最底层
+CompressionType CompressionForLevel(const Options& options, int level,
+                                    bool bottommost);
+
+// 用 *iter 的内容构建一个 table 文件，文件名由 meta->number 决定。
+// 成功时将 table 的其余元数据存入 *meta。
+// 如果 *iter 中没有数据，meta->file_size 会被设置为 0，并且不会生成文件。
+// 生成的 table 写入第 0 层，按照第 0 层的设置压缩。
+// options.min_blob_size > 0 时，较大的 value 写入与 table 文件同编号的
+// blob 文件，它的元数据存入 *blob；blob->total_count 为 0 表示没有生成
+// blob 文件
+Status BuildTable(const std::string& dbname, Env* env, const Options& options,
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  BlobFileMetaData* blob);
+
+// 与 BuildTable() 相同，但从 *iter 的当前位置开始写入，生成的 table 按
+// 第 level 层的设置压缩（bottommost 的含义同 CompressionForLevel()）。
+// 文件大小达到 options.max_file_size 后停止，*iter 停在第一个没有写入的
+// 条目上，调用者可以用它继续生成下一个文件。
+// 要求：*iter 中每个 user key 只有一个条目，生成的文件之间不会重叠
+Status BuildLevelTable(const std::string& dbname, Env* env,
+                       const Options& options, TableCache* table_cache,
+                       int level, bool bottommost, Iterator* iter,
+                       FileMetaData* meta, BlobFileMetaData* blob);
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_BUILDER_H
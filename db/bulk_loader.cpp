@@ -0,0 +1,633 @@
+//
+// Created by Xsakura on 2023/6/25.
+//
+
+#include "db/bulk_loader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "db/builder.h"
+#include "db/db_impl.h"
+#include "db/filename.h"
+#include "db/table_cache.h"
+#include "db/version_edit.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/table.h"
+#include "massdb/table_builder.h"
+#include "table/merger.h"
+#include "util/arena.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+// run 的块大小。归并时每个 run 的迭代器缓存一个块，
+// 较大的块让读取 run 接近顺序读
+static const size_t kRunBlockSize = 64 * 1024;
+
+// 每个 run 抽取的 user key 样本数，用于划分归并的范围
+static const size_t kSamplesPerRun = 128;
+
+// 归并的路数上限，每一路占用一个打开的文件
+static const size_t kMaxMergeWidth = 512;
+
+// 缓冲区中的 Arena 每次分配的内存块大小的上限。
+// 内存块不超过缓冲区大小的 1/16，缓冲区的内存占用不会超出上限太多
+static const size_t kMaxBufferBlockSize = 1 << 20;
+
+// 导入期间的压实或者 flush 使目标层不再可用时重新写出文件，
+// 最多写出这么多次
+static const int kMaxBuildAttempts = 3;
+
+struct BulkLoaderImpl::Buffer {
+    explicit Buffer(size_t block_size) : arena(block_size) {}
+
+    size_t MemoryUsage() const {
+        return arena.memory_usage() + entries.capacity() * sizeof(char*);
+    }
+
+    Arena arena;
+    // 条目的格式与 MemTable 相同：
+    //    key_size     : varint32 of internal_key.size()
+    //    key bytes    : char[internal_key.size()]
+    //    value_size   : varint32 of value.size()
+    //    value bytes  : char[value.size()]
+    std::vector<const char*> entries;
+};
+
+struct BulkLoaderImpl::Run {
+    Run() : number(0), file_size(0), file(nullptr), table(nullptr) {}
+
+    uint64_t number;  // 临时文件的编号
+    uint64_t file_size;
+    // 按顺序均匀抽取的 user key 和每个样本代表的字节数
+    std::vector<std::pair<std::string, uint64_t>> samples;
+    Status status;  // 写入 run 的结果
+
+    // OpenRun() 之后有效
+    RandomAccessFile* file;
+    Table* table;
+};
+
+// 最后归并时的一段 key 范围 [start, end)，由一个线程处理
+struct BulkLoaderImpl::Partition {
+    Partition() : has_start(false), has_end(false) {}
+
+    bool has_start;
+    bool has_end;
+    std::string start;
+    std::string end;
+
+    std::vector<uint64_t> numbers;  // 分配的所有文件编号
+    std::vector<FileMetaData> files;
+    std::vector<BlobFileMetaData> blobs;
+    Status status;
+};
+
+namespace {
+
+// 从带长度前缀的数据中取出 Slice
+Slice GetLengthPrefixedSlice(const char* data) {
+    uint32_t len;
+    const char* p = GetVarint32Ptr(data, data + 5, &len);
+    return Slice(p, len);
+}
+
+// 遍历归并后的 run 中 user key 在 [start, end) 中的条目。
+// 同一个 user key 只返回最后添加的条目，即排在最前面的一个。
+// rewrite 为 true 时 key 的序列号换成 sequence。只支持正向遍历
+class LoadIterator : public Iterator {
+public:
+    LoadIterator(Iterator* input, const Comparator* ucmp,
+                 const std::string* start, const std::string* end,
+                 bool rewrite, SequenceNumber sequence)
+        : input_(input),
+          ucmp_(ucmp),
+          start_(start),
+          end_(end),
+          rewrite_(rewrite),
+          sequence_(sequence),
+          valid_(false) {}
+
+    ~LoadIterator() override { delete input_; }
+
+    bool Valid() const override { return valid_; }
+
+    void SeekToFirst() override {
+        if (start_ != nullptr) {
+            InternalKey target(*start_, kMaxSequenceNumber,
+                               kValueTypeForSeek);
+            input_->Seek(target.Encode());
+        } else {
+            input_->SeekToFirst();
+        }
+        Update();
+    }
+
+    void Seek(const Slice& target) override {
+        input_->Seek(target);
+        Update();
+    }
+
+    void Next() override {
+        assert(valid_);
+        // 跳过同一个 user key 更早添加的条目
+        const Slice user_key = ExtractUserKey(key_);
+        do {
+            input_->Next();
+        } while (input_->Valid() &&
+                 ucmp_->Compare(ExtractUserKey(input_->key()), user_key) ==
+                     0);
+        Update();
+    }
+
+    void SeekToLast() override {
+        assert(false);
+        valid_ = false;
+    }
+
+    void Prev() override { assert(false); }
+
+    Slice key() const override {
+        assert(valid_);
+        return key_;
+    }
+
+    Slice value() const override {
+        assert(valid_);
+        return input_->value();
+    }
+
+    Status status() const override { return input_->status(); }
+
+private:
+    void Update() {
+        valid_ = input_->Valid() &&
+                 (end_ == nullptr ||
+                  ucmp_->Compare(ExtractUserKey(input_->key()), *end_) < 0);
+        if (!valid_) {
+            return;
+        }
+        const Slice ikey = input_->key();
+        key_.clear();
+        if (rewrite_) {
+            AppendInternalKey(&key_, ParsedInternalKey(ExtractUserKey(ikey),
+                                                       sequence_, kTypeValue));
+        } else {
+            key_.assign(ikey.data(), ikey.size());
+        }
+    }
+
+    Iterator* const input_;
+    const Comparator* const ucmp_;
+    const std::string* const start_;  // 为 nullptr 时没有下界
+    const std::string* const end_;    // 为 nullptr 时没有上界
+    const bool rewrite_;
+    const SequenceNumber sequence_;
+    bool valid_;
+    std::string key_;
+};
+
+}  // namespace
+
+BulkLoaderImpl::BulkLoaderImpl(DBImpl* db, const BulkLoadOptions& options)
+    : db_(db),
+      options_(options),
+      ucmp_(db->internal_comparator_.user_comparator()),
+      run_options_(db->options_),
+      buffer_size_(options.memory_budget / (options.max_threads + 1)),
+      buffer_(nullptr),
+      next_sequence_(1),
+      finished_(false) {
+    run_options_.compression = kNoCompression;
+    run_options_.filter_policy = nullptr;
+    run_options_.block_cache = nullptr;
+    run_options_.block_size = kRunBlockSize;
+}
+
+BulkLoaderImpl::~BulkLoaderImpl() {
+    if (!finished_) {
+        WaitForSorters();
+        RemoveRuns();
+    }
+    delete buffer_;
+}
+
+Status BulkLoaderImpl::Add(const Slice& key, const Slice& value) {
+    assert(!finished_);
+    if (!status_.IsOk()) {
+        return status_;
+    }
+    if (buffer_ == nullptr) {
+        buffer_ =
+            new Buffer(std::min(kMaxBufferBlockSize, buffer_size_ / 16));
+    }
+
+    const size_t internal_key_size = key.size() + 8;
+    const size_t encoded_len = VarintLength(internal_key_size) +
+                               internal_key_size + VarintLength(value.size()) +
+                               value.size();
+    char* buf = buffer_->arena.Allocate(encoded_len);
+    char* p = EncodeVarint32(buf, internal_key_size);
+    std::memcpy(p, key.data(), key.size());
+    p += key.size();
+    EncodeFixed64(p, PackSequenceAndType(next_sequence_, kTypeValue));
+    p += 8;
+    p = EncodeVarint32(p, value.size());
+    std::memcpy(p, value.data(), value.size());
+    buffer_->entries.push_back(buf);
+
+    if (next_sequence_ == 1 || ucmp_->Compare(key, smallest_) < 0) {
+        smallest_.assign(key.data(), key.size());
+    }
+    if (next_sequence_ == 1 || ucmp_->Compare(key, largest_) > 0) {
+        largest_.assign(key.data(), key.size());
+    }
+    next_sequence_++;
+
+    if (buffer_->MemoryUsage() >= buffer_size_) {
+        status_ = FlushBuffer();
+    }
+    return status_;
+}
+
+Status BulkLoaderImpl::FlushBuffer() {
+    Status s;
+    if (sorters_.size() >= static_cast<size_t>(options_.max_threads)) {
+        sorters_.front().thread.join();
+        s = sorters_.front().run->status;
+        sorters_.pop_front();
+    }
+
+    Run* run = new Run;
+    run->number = db_->NewPendingFileNumber();
+    runs_.push_back(run);
+    Sorter sorter;
+    sorter.run = run;
+    sorter.thread = std::thread(&BulkLoaderImpl::WriteRun, this, buffer_, run);
+    sorters_.push_back(std::move(sorter));
+    buffer_ = nullptr;
+    return s;
+}
+
+Status BulkLoaderImpl::WaitForSorters() {
+    Status s;
+    while (!sorters_.empty()) {
+        sorters_.front().thread.join();
+        if (s.IsOk()) {
+            s = sorters_.front().run->status;
+        }
+        sorters_.pop_front();
+    }
+    return s;
+}
+
+void BulkLoaderImpl::WriteRun(Buffer* buffer, Run* run) {
+    const InternalKeyComparator& icmp = db_->internal_comparator_;
+    std::vector<const char*>& entries = buffer->entries;
+    std::sort(entries.begin(), entries.end(),
+              [&icmp](const char* a, const char* b) {
+                  return icmp.Compare(GetLengthPrefixedSlice(a),
+                                      GetLengthPrefixedSlice(b)) < 0;
+              });
+
+    WritableFile* file;
+    Status s = db_->env_->NewWritableFile(
+        TempFileName(db_->dbname_, run->number), &file);
+    if (s.IsOk()) {
+        TableBuilder builder(run_options_, file);
+        const size_t interval =
+            std::max<size_t>(1, entries.size() / kSamplesPerRun);
+        Slice last_user_key;
+        size_t i = 0;
+        for (const char* entry : entries) {
+            const Slice ikey = GetLengthPrefixedSlice(entry);
+            const Slice value =
+                GetLengthPrefixedSlice(ikey.data() + ikey.size());
+            const Slice user_key = ExtractUserKey(ikey);
+            // 同一个 user key 只保留最后添加的条目，它排在最前面
+            if (i > 0 && ucmp_->Compare(user_key, last_user_key) == 0) {
+                continue;
+            }
+            last_user_key = user_key;
+            if (i % interval == 0) {
+                run->samples.emplace_back(user_key.to_string(), 0);
+            }
+            builder.Add(ikey, value);
+            i++;
+        }
+        s = builder.Finish();
+        run->file_size = builder.FileSize();
+        // 临时文件只在这次导入中使用，不需要持久化
+        if (s.IsOk()) {
+            s = file->Close();
+        }
+        delete file;
+    }
+    for (auto& sample : run->samples) {
+        sample.second = run->file_size / run->samples.size();
+    }
+    run->status = s;
+    delete buffer;
+}
+
+Status BulkLoaderImpl::OpenRun(Run* run) {
+    if (run->table != nullptr) {
+        return Status::Ok();
+    }
+    Status s = db_->env_->NewRandomAccessFile(
+        TempFileName(db_->dbname_, run->number), &run->file);
+    if (s.IsOk()) {
+        run->file->Hint(RandomAccessFile::kSequential);
+        s = Table::Open(run_options_, run->file, run->file_size, &run->table);
+    }
+    return s;
+}
+
+Status BulkLoaderImpl::MergeRuns(size_t n) {
+    assert(n <= runs_.size());
+    Run* output = new Run;
+    output->number = db_->NewPendingFileNumber();
+
+    Status s;
+    ReadOptions read_options;
+    read_options.fill_cache = false;
+    std::vector<Iterator*> children;
+    for (size_t i = 0; i < n && s.IsOk(); i++) {
+        s = OpenRun(runs_[i]);
+        if (s.IsOk()) {
+            children.push_back(runs_[i]->table->NewIterator(read_options));
+        }
+        // 合并后的 run 沿用输入的样本
+        output->samples.insert(output->samples.end(),
+                               runs_[i]->samples.begin(),
+                               runs_[i]->samples.end());
+    }
+    Iterator* input =
+        NewMergingIterator(&db_->internal_comparator_, children.data(),
+                           static_cast<int>(children.size()));
+    if (s.IsOk()) {
+        // 保留原来的序列号，之后的归并仍然能区分添加的先后
+        LoadIterator iter(input, ucmp_, nullptr, nullptr, false, 0);
+        input = nullptr;
+        WritableFile* file;
+        s = db_->env_->NewWritableFile(
+            TempFileName(db_->dbname_, output->number), &file);
+        if (s.IsOk()) {
+            TableBuilder builder(run_options_, file);
+            for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+                builder.Add(iter.key(), iter.value());
+            }
+            s = iter.status();
+            if (s.IsOk()) {
+                s = builder.Finish();
+            } else {
+                builder.Abandon();
+            }
+            output->file_size = builder.FileSize();
+            if (s.IsOk()) {
+                s = file->Close();
+            }
+            delete file;
+        }
+    }
+    delete input;
+
+    // 被合并的 run 不再需要
+    std::vector<Run*> merged(runs_.begin(), runs_.begin() + n);
+    runs_.erase(runs_.begin(), runs_.begin() + n);
+    runs_.push_back(output);
+    std::vector<uint64_t> numbers;
+    for (Run* run : merged) {
+        delete run->table;
+        delete run->file;
+        db_->env_->RemoveFile(TempFileName(db_->dbname_, run->number));
+        numbers.push_back(run->number);
+        delete run;
+    }
+    db_->ReleasePendingFiles(numbers);
+    return s;
+}
+
+void BulkLoaderImpl::GenPartitions(size_t n,
+                                   std::vector<Partition>* partitions) const {
+    // 合并所有 run 的样本，按累计的数据量等分
+    std::vector<std::pair<std::string, uint64_t>> samples;
+    uint64_t total_bytes = 0;
+    for (const Run* run : runs_) {
+        samples.insert(samples.end(), run->samples.begin(),
+                       run->samples.end());
+    }
+    std::sort(samples.begin(), samples.end(),
+              [this](const std::pair<std::string, uint64_t>& a,
+                     const std::pair<std::string, uint64_t>& b) {
+                  return ucmp_->Compare(a.first, b.first) < 0;
+              });
+    for (const auto& sample : samples) {
+        total_bytes += sample.second;
+    }
+
+    std::vector<std::string> boundaries;
+    uint64_t bytes = 0;
+    size_t next = 1;
+    for (const auto& sample : samples) {
+        if (next >= n) {
+            break;
+        }
+        if (bytes >= next * total_bytes / n) {
+            // 边界是下一段的第一个 user key，保证严格递增
+            if (boundaries.empty() ||
+                ucmp_->Compare(boundaries.back(), sample.first) < 0) {
+                boundaries.push_back(sample.first);
+            }
+            next++;
+        }
+        bytes += sample.second;
+    }
+
+    partitions->resize(boundaries.size() + 1);
+    for (size_t i = 0; i < boundaries.size(); i++) {
+        Partition* partition = &(*partitions)[i];
+        Partition* following = &(*partitions)[i + 1];
+        partition->has_end = true;
+        partition->end = boundaries[i];
+        following->has_start = true;
+        following->start = boundaries[i];
+    }
+}
+
+void BulkLoaderImpl::WritePartition(Partition* partition,
+                                    SequenceNumber sequence, int level,
+                                    bool bottommost) {
+    ReadOptions read_options;
+    read_options.fill_cache = false;
+    std::vector<Iterator*> children;
+    children.reserve(runs_.size());
+    for (Run* run : runs_) {
+        children.push_back(run->table->NewIterator(read_options));
+    }
+    LoadIterator iter(
+        NewMergingIterator(&db_->internal_comparator_, children.data(),
+                           static_cast<int>(children.size())),
+        ucmp_, partition->has_start ? &partition->start : nullptr,
+        partition->has_end ? &partition->end : nullptr, true, sequence);
+
+    // 每个 table 文件写到 max_file_size 为止，从下一个条目开始写下一个文件
+    Status s;
+    iter.SeekToFirst();
+    while (s.IsOk() && iter.Valid()) {
+        FileMetaData meta;
+        meta.number = db_->NewPendingFileNumber();
+        partition->numbers.push_back(meta.number);
+        BlobFileMetaData blob;
+        s = BuildLevelTable(db_->dbname_, db_->env_, db_->options_,
+                            db_->table_cache_, level, bottommost, &iter, &meta,
+                            &blob);
+        if (s.IsOk() && meta.file_size > 0) {
+            partition->files.push_back(meta);
+            if (blob.total_count > 0) {
+                partition->blobs.push_back(blob);
+            }
+        }
+    }
+    if (s.IsOk()) {
+        s = iter.status();
+    }
+    partition->status = s;
+}
+
+Status BulkLoaderImpl::Finish() {
+    assert(!finished_);
+    finished_ = true;
+
+    Status s = status_;
+    if (s.IsOk() && buffer_ != nullptr && !buffer_->entries.empty()) {
+        s = FlushBuffer();
+    }
+    Status sorted = WaitForSorters();
+    if (s.IsOk()) {
+        s = sorted;
+    }
+    if (!s.IsOk() || runs_.empty()) {
+        RemoveRuns();
+        return s;
+    }
+
+    // 每一段至少写出约一个 table 文件
+    uint64_t total_bytes = 0;
+    for (const Run* run : runs_) {
+        total_bytes += run->file_size;
+    }
+    const size_t num_partitions = static_cast<size_t>(std::min<uint64_t>(
+        options_.max_threads, total_bytes / db_->options_.max_file_size + 1));
+
+    // 排序用的缓冲区都已经释放，归并时每一段的每个 run 缓存一个块。
+    // run 太多时先把最早的几个归并成一个
+    const size_t max_width = std::min(
+        kMaxMergeWidth,
+        std::max<size_t>(2, options_.memory_budget /
+                                (num_partitions * kRunBlockSize)));
+    while (s.IsOk() && runs_.size() > max_width) {
+        s = MergeRuns(max_width);
+    }
+    for (size_t i = 0; i < runs_.size() && s.IsOk(); i++) {
+        s = OpenRun(runs_[i]);
+    }
+
+    DBImpl::BulkLoad* load = nullptr;
+    if (s.IsOk()) {
+        s = db_->BeginBulkLoad(smallest_, largest_, &load);
+    }
+
+    bool installed = false;
+    for (int attempt = 0; s.IsOk() && !installed; attempt++) {
+        if (attempt == kMaxBuildAttempts) {
+            s = Status::InvalidArgument(
+                "target level of the bulk load keeps changing");
+            break;
+        }
+        std::vector<Partition> partitions;
+        s = WritePartitions(num_partitions, load, &partitions);
+
+        std::vector<FileMetaData> files;
+        std::vector<BlobFileMetaData> blobs;
+        std::vector<uint64_t> numbers;
+        for (const Partition& partition : partitions) {
+            files.insert(files.end(), partition.files.begin(),
+                         partition.files.end());
+            blobs.insert(blobs.end(), partition.blobs.begin(),
+                         partition.blobs.end());
+            numbers.insert(numbers.end(), partition.numbers.begin(),
+                           partition.numbers.end());
+        }
+        bool rebuild = false;
+        if (s.IsOk()) {
+            s = db_->InstallBulkLoad(load, files, blobs, &rebuild);
+            if (!rebuild) {
+                // 无论成功与否，load 都已经释放
+                load = nullptr;
+                installed = s.IsOk();
+            }
+        }
+        if (!installed) {
+            // 没有安装的文件不会再被使用
+            RemoveOutputs(numbers);
+        }
+        db_->ReleasePendingFiles(numbers);
+    }
+    if (load != nullptr) {
+        db_->AbortBulkLoad(load);
+    }
+    RemoveRuns();
+    return s;
+}
+
+Status BulkLoaderImpl::WritePartitions(size_t n, const DBImpl::BulkLoad* load,
+                                       std::vector<Partition>* partitions) {
+    // 第一段在当前线程写入，其余的各自使用一个新线程
+    GenPartitions(n, partitions);
+    std::vector<std::thread> threads;
+    threads.reserve(partitions->size() - 1);
+    for (size_t i = 1; i < partitions->size(); i++) {
+        threads.emplace_back(&BulkLoaderImpl::WritePartition, this,
+                             &(*partitions)[i], load->sequence, load->level,
+                             load->bottommost);
+    }
+    WritePartition(&(*partitions)[0], load->sequence, load->level,
+                   load->bottommost);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (const Partition& partition : *partitions) {
+        if (!partition.status.IsOk()) {
+            return partition.status;
+        }
+    }
+    return Status::Ok();
+}
+
+void BulkLoaderImpl::RemoveOutputs(const std::vector<uint64_t>& numbers) {
+    for (uint64_t number : numbers) {
+        db_->table_cache_->Evict(number);
+        db_->env_->RemoveFile(TableFileName(db_->dbname_, number));
+        db_->env_->RemoveFile(FragmentIndexFileName(db_->dbname_, number));
+        db_->env_->RemoveFile(BlobFileName(db_->dbname_, number));
+    }
+}
+
+void BulkLoaderImpl::RemoveRuns() {
+    std::vector<uint64_t> numbers;
+    for (Run* run : runs_) {
+        delete run->table;
+        delete run->file;
+        db_->env_->RemoveFile(TempFileName(db_->dbname_, run->number));
+        numbers.push_back(run->number);
+        delete run;
+    }
+    runs_.clear();
+    db_->ReleasePendingFiles(numbers);
+}
+
+}  // namespace massdb
@@ -0,0 +1,106 @@
+//
+// Created by Xsakura on 2023/6/25.
+//
+
+#ifndef MASSDB_DB_BULK_LOADER_H
+#define MASSDB_DB_BULK_LOADER_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "db/db_impl.h"
+#include "db/dbformat.h"
+#include "massdb/db.h"
+#include "massdb/options.h"
+
+namespace massdb {
+
+// DB::NewBulkLoader() 返回的实现，是一个外部归并排序：
+// Add() 的条目放入内存中的缓冲区，缓冲区写满后交给一个新线程排序，
+// 写成一个按 internal key 排列的临时文件（run）。
+// Finish() 把 key 空间按数据量划分成几段，各段并行地归并所有 run，
+// 去掉被覆盖的条目后直接写成目标层的 table 文件，最后一次性安装
+class BulkLoaderImpl : public BulkLoader {
+public:
+    BulkLoaderImpl(DBImpl* db, const BulkLoadOptions& options);
+    ~BulkLoaderImpl() override;
+
+    Status Add(const Slice& key, const Slice& value) override;
+    Status Finish() override;
+
+private:
+    struct Buffer;
+    struct Run;
+    struct Partition;
+
+    // 正在把一个缓冲区写成 run 的线程
+    struct Sorter {
+        std::thread thread;
+        Run* run;
+    };
+
+    // 把 buffer_ 交给一个新线程写成 run。正在运行的线程达到
+    // options_.max_threads 时先等待最早的一个结束，返回它遇到的错误
+    Status FlushBuffer();
+
+    // 等待所有排序线程结束，返回遇到的第一个错误
+    Status WaitForSorters();
+
+    // 排序 *buffer 中的条目并写入 run 的临时文件，完成后删除 buffer。
+    // 在排序线程中执行
+    void WriteRun(Buffer* buffer, Run* run);
+
+    // 打开 run 的临时文件以便读取
+    Status OpenRun(Run* run);
+
+    // 归并 runs_ 中最早的 n 个 run，替换为一个新的 run
+    Status MergeRuns(size_t n);
+
+    // 把 partition 范围内的条目写成第 level 层的 table 文件，
+    // 序列号都为 sequence。结果存入 partition->status
+    void WritePartition(Partition* partition, SequenceNumber sequence,
+                        int level, bool bottommost);
+
+    // 把 key 空间划分成最多 n 段，并行地写出 load 的 table 文件，
+    // 结果存入 *partitions。返回遇到的第一个错误
+    Status WritePartitions(size_t n, const DBImpl::BulkLoad* load,
+                           std::vector<Partition>* partitions);
+
+    // 删除没有安装的输出文件
+    void RemoveOutputs(const std::vector<uint64_t>& numbers);
+
+    // 按 run 中的样本把 key 空间划分成最多 n 段，每段的数据量大致相同
+    void GenPartitions(size_t n, std::vector<Partition>* partitions) const;
+
+    // 关闭并删除所有 run 的临时文件
+    void RemoveRuns();
+
+    DBImpl* const db_;
+    const BulkLoadOptions options_;
+    const Comparator* const ucmp_;
+    // 写入和读取 run 使用的选项：不压缩，不使用过滤器和块缓存
+    Options run_options_;
+    // 每个缓冲区的内存上限。正在填充的缓冲区和每个排序线程各有一个
+    const size_t buffer_size_;
+
+    Buffer* buffer_;  // 正在填充的缓冲区
+    std::deque<Sorter> sorters_;
+    std::vector<Run*> runs_;
+
+    // 按添加的顺序给条目编号，同一个 user key 后添加的排在前面
+    SequenceNumber next_sequence_;
+    // 添加过的最小和最大的 user key
+    std::string smallest_;
+    std::string largest_;
+
+    bool finished_;
+    Status status_;  // 排序线程或者 Add() 遇到的第一个错误
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_BULK_LOADER_H
@@ -0,0 +1,401 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "db/db_impl.h"
+#include "db/filename.h"
+#include "gtest/gtest.h"
+#include "massdb/db.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+static std::string Key(int i) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "key%06d", i);
+    return std::string(buf);
+}
+
+// 在导入写出 table 文件和写描述文件时调用测试设置的回调，每个回调只调用一次
+class HookEnv : public test::EnvWrapper {
+public:
+    explicit HookEnv(Env* target) : EnvWrapper(target) {}
+
+    // 下一次创建 table 文件时调用 hook
+    void OnNewTable(std::function<void()> hook) {
+        table_hook_ = hook;
+        table_armed_.store(true);
+    }
+
+    // 下一次写描述文件时调用 hook，此时 LogAndApply() 没有持有锁
+    void OnManifestWrite(std::function<void()> hook) {
+        manifest_hook_ = hook;
+        manifest_armed_.store(true);
+    }
+
+    Status NewWritableFile(const std::string& fname,
+                           WritableFile** result) override {
+        Status s = target()->NewWritableFile(fname, result);
+        uint64_t number;
+        FileType type;
+        if (s.IsOk() &&
+            ParseFileName(fname.substr(fname.rfind('/') + 1), &number,
+                          &type)) {
+            if (type == kTableFile && table_armed_.exchange(false)) {
+                table_hook_();
+            } else if (type == kDescriptorFile) {
+                *result = new ManifestFile(this, *result);
+            }
+        }
+        return s;
+    }
+
+private:
+    class ManifestFile : public WritableFile {
+    public:
+        ManifestFile(HookEnv* env, WritableFile* file)
+            : env_(env), file_(file) {}
+        ~ManifestFile() override { delete file_; }
+
+        Status Append(const Slice& data) override {
+            if (env_->manifest_armed_.exchange(false)) {
+                env_->manifest_hook_();
+            }
+            return file_->Append(data);
+        }
+        Status Close() override { return file_->Close(); }
+        Status Flush() override { return file_->Flush(); }
+        Status Sync() override { return file_->Sync(); }
+
+    private:
+        HookEnv* const env_;
+        WritableFile* const file_;
+    };
+
+    std::atomic<bool> table_armed_{false};
+    std::function<void()> table_hook_;
+    std::atomic<bool> manifest_armed_{false};
+    std::function<void()> manifest_hook_;
+};
+
+class BulkLoaderTest : public testing::Test {
+public:
+    BulkLoaderTest()
+        : env_(Env::Default()),
+          dbname_(test::NewTestDirectory("bulk_loader_test")),
+          db_(nullptr) {
+        options_.create_if_missing = true;
+        options_.env = &env_;
+        Reopen();
+    }
+
+    ~BulkLoaderTest() override {
+        delete db_;
+        test::DestroyDirectory(Env::Default(), dbname_);
+    }
+
+    void Reopen() {
+        delete db_;
+        db_ = nullptr;
+        ASSERT_TRUE(DB::Open(options_, dbname_, &db_).IsOk());
+    }
+
+    DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+    std::string Get(const std::string& key,
+                    const Snapshot* snapshot = nullptr) {
+        ReadOptions options;
+        options.snapshot = snapshot;
+        std::string value;
+        Status s = db_->Get(options, key, &value);
+        if (s.IsNotFound()) {
+            return "NOT_FOUND";
+        } else if (!s.IsOk()) {
+            return s.ToString();
+        }
+        return value;
+    }
+
+    // 在 snapshot 中用 MultiGet() 查找 keys，结果与逐个调用 Get() 比较
+    void CheckMultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot) {
+        ReadOptions options;
+        options.snapshot = snapshot;
+        std::vector<Slice> slices(keys.begin(), keys.end());
+        std::vector<std::string> values;
+        std::vector<Status> statuses = db_->MultiGet(options, slices, &values);
+        ASSERT_EQ(keys.size(), statuses.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            const std::string expected = Get(keys[i], snapshot);
+            if (statuses[i].IsNotFound()) {
+                ASSERT_EQ("NOT_FOUND", expected);
+            } else {
+                ASSERT_TRUE(statuses[i].IsOk());
+                ASSERT_EQ(expected, values[i]);
+            }
+        }
+    }
+
+    // 用迭代器读出所有条目
+    std::map<std::string, std::string> Contents(
+        const Snapshot* snapshot = nullptr) {
+        ReadOptions options;
+        options.snapshot = snapshot;
+        std::map<std::string, std::string> result;
+        Iterator* iter = db_->NewIterator(options);
+        std::string last;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            EXPECT_TRUE(result.empty() || last < iter->key().to_string());
+            last = iter->key().to_string();
+            result[last] = iter->value().to_string();
+        }
+        EXPECT_TRUE(iter->status().IsOk());
+        delete iter;
+        return result;
+    }
+
+    // 添加 key [0, n) 的条目，顺序打乱，每个 key 最后添加的 value 写入 *model
+    void AddEntries(BulkLoader* loader, int n,
+                    std::map<std::string, std::string>* model) {
+        Random rnd(301);
+        for (int i = 0; i < 2 * n; i++) {
+            const std::string key = Key(rnd.Uniform(n));
+            const std::string value = test::RandomString(&rnd, 100);
+            ASSERT_TRUE(loader->Add(key, value).IsOk());
+            (*model)[key] = value;
+        }
+    }
+
+    int CountFiles(FileType wanted) {
+        std::vector<std::string> children;
+        Env::Default()->GetChildren(dbname_, &children);
+        int count = 0;
+        for (const std::string& child : children) {
+            uint64_t number;
+            FileType type;
+            if (ParseFileName(child, &number, &type) && type == wanted) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    int TotalTableFiles() {
+        int files = 0;
+        for (int level = 0; level < config::kNumLevels; level++) {
+            files += dbfull()->TEST_NumLevelFiles(level);
+        }
+        return files;
+    }
+
+    HookEnv env_;
+    const std::string dbname_;
+    Options options_;
+    DB* db_;
+};
+
+TEST_F(BulkLoaderTest, Empty) {
+    BulkLoader* loader;
+    ASSERT_TRUE(db_->NewBulkLoader(BulkLoadOptions(), &loader).IsOk());
+    ASSERT_TRUE(loader->Finish().IsOk());
+    delete loader;
+    ASSERT_EQ(0, TotalTableFiles());
+    ASSERT_TRUE(Contents().empty());
+}
+
+TEST_F(BulkLoaderTest, LoadThenRead) {
+    ASSERT_TRUE(db_->Put(WriteOptions(), "a", "before").IsOk());
+
+    // 内存上限很小：产生很多 run，需要先归并，并且分成几段并行写出
+    BulkLoadOptions load_options;
+    load_options.memory_budget = 256 * 1024;
+    load_options.max_threads = 4;
+    BulkLoader* loader;
+    ASSERT_TRUE(db_->NewBulkLoader(load_options, &loader).IsOk());
+    std::map<std::string, std::string> model;
+    AddEntries(loader, 10000, &model);
+    ASSERT_TRUE(loader->Finish().IsOk());
+    delete loader;
+
+    // 每一段各自写出文件
+    ASSERT_GT(TotalTableFiles(), 1);
+    // 临时文件都已经删除
+    ASSERT_EQ(0, CountFiles(kTempFile));
+
+    model["a"] = "before";
+    ASSERT_EQ(model, Contents());
+    for (const auto& entry : model) {
+        ASSERT_EQ(entry.second, Get(entry.first));
+    }
+    ASSERT_EQ("NOT_FOUND", Get(Key(10000)));
+
+    // 之后的写入比导入的数据新
+    ASSERT_TRUE(db_->Put(WriteOptions(), Key(5), "after").IsOk());
+    ASSERT_EQ("after", Get(Key(5)));
+}
+
+TEST_F(BulkLoaderTest, Abort) {
+    ASSERT_TRUE(db_->Put(WriteOptions(), Key(1), "v1").IsOk());
+    BulkLoadOptions load_options;
+    load_options.memory_budget = 256 * 1024;
+    BulkLoader* loader;
+    ASSERT_TRUE(db_->NewBulkLoader(load_options, &loader).IsOk());
+    std::map<std::string, std::string> model;
+    AddEntries(loader, 5000, &model);
+    // 没有调用 Finish()，数据库不变，已经写出的 run 都被删除
+    delete loader;
+
+    ASSERT_EQ(0, CountFiles(kTempFile));
+    ASSERT_EQ(0, TotalTableFiles());
+    ASSERT_EQ("v1", Get(Key(1)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(2)));
+}
+
+TEST_F(BulkLoaderTest, ConflictingWrite) {
+    BulkLoader* loader;
+    ASSERT_TRUE(db_->NewBulkLoader(BulkLoadOptions(), &loader).IsOk());
+    std::map<std::string, std::string> model;
+    AddEntries(loader, 1000, &model);
+
+    // 开始导入之后，写出文件期间有写入落在导入的范围中
+    env_.OnNewTable([this]() {
+        ASSERT_TRUE(db_->Put(WriteOptions(), Key(7), "concurrent").IsOk());
+    });
+    ASSERT_TRUE(loader->Finish().IsInvalidArgument());
+    delete loader;
+
+    ASSERT_EQ(0, TotalTableFiles());
+    ASSERT_EQ(0, CountFiles(kTempFile));
+    ASSERT_EQ(0, CountFiles(kTableFile));
+    ASSERT_EQ("concurrent", Get(Key(7)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(8)));
+}
+
+TEST_F(BulkLoaderTest, WriteOutsideRange) {
+    BulkLoader* loader;
+    ASSERT_TRUE(db_->NewBulkLoader(BulkLoadOptions(), &loader).IsOk());
+    std::map<std::string, std::string> model;
+    AddEntries(loader, 1000, &model);
+
+    // 范围之外的写入不影响导入，导入的数据改用全局序列号安装
+    env_.OnNewTable([this]() {
+        ASSERT_TRUE(db_->Put(WriteOptions(), "zzz", "concurrent").IsOk());
+    });
+    ASSERT_TRUE(loader->Finish().IsOk());
+    delete loader;
+
+    model["zzz"] = "concurrent";
+    ASSERT_EQ(model, Contents());
+    ASSERT_TRUE(db_->Put(WriteOptions(), Key(3), "after").IsOk());
+    ASSERT_EQ("after", Get(Key(3)));
+}
+
+// 在安装写描述文件期间创建的快照，之后也看不到导入的数据
+static void SnapshotDuringInstall(BulkLoaderTest* t, bool write_during_load) {
+    DB* db = t->db_;
+    ASSERT_TRUE(db->Put(WriteOptions(), Key(0), "old").IsOk());
+    // 与导入重叠的 MemTable 先写入 table 文件，不触发下面的回调
+    ASSERT_TRUE(t->dbfull()->TEST_CompactMemTable().IsOk());
+    const Snapshot* before = db->GetSnapshot();
+
+    BulkLoader* loader;
+    ASSERT_TRUE(db->NewBulkLoader(BulkLoadOptions(), &loader).IsOk());
+    std::map<std::string, std::string> model;
+    t->AddEntries(loader, 1000, &model);
+
+    if (write_during_load) {
+        t->env_.OnNewTable([db]() {
+            ASSERT_TRUE(db->Put(WriteOptions(), "zzz", "concurrent").IsOk());
+        });
+    }
+    const Snapshot* during = nullptr;
+    t->env_.OnManifestWrite([t, db, &during]() {
+        during = db->GetSnapshot();
+        EXPECT_EQ("old", t->Get(Key(0), during));
+    });
+    ASSERT_TRUE(loader->Finish().IsOk());
+    delete loader;
+    ASSERT_TRUE(during != nullptr);
+
+    for (const Snapshot* snapshot : {before, during}) {
+        ASSERT_EQ("old", t->Get(Key(0), snapshot));
+        std::map<std::string, std::string> contents = t->Contents(snapshot);
+        ASSERT_EQ("old", contents[Key(0)]);
+        for (int i = 1; i < 1000; i++) {
+            ASSERT_EQ("NOT_FOUND", t->Get(Key(i), snapshot));
+            ASSERT_EQ(0u, contents.count(Key(i)));
+        }
+    }
+    ASSERT_EQ(write_during_load ? "concurrent" : "NOT_FOUND",
+              t->Get("zzz", during));
+
+    // 新的快照看到导入的数据
+    const Snapshot* after = db->GetSnapshot();
+    for (const auto& entry : model) {
+        ASSERT_EQ(entry.second, t->Get(entry.first, after));
+    }
+
+    // 有全局序列号时 MultiGet() 同样改写文件中的序列号
+    std::vector<std::string> keys;
+    for (int i = 0; i < 1100; i += 3) {
+        keys.push_back(Key(i));
+    }
+    keys.push_back("zzz");
+    for (const Snapshot* snapshot : {before, during, after}) {
+        t->CheckMultiGet(keys, snapshot);
+    }
+    db->ReleaseSnapshot(before);
+    db->ReleaseSnapshot(during);
+    db->ReleaseSnapshot(after);
+}
+
+TEST_F(BulkLoaderTest, SnapshotDuringInstall) {
+    SnapshotDuringInstall(this, false);
+}
+
+TEST_F(BulkLoaderTest, SnapshotDuringInstallWithConcurrentWrite) {
+    SnapshotDuringInstall(this, true);
+}
+
+TEST_F(BulkLoaderTest, ReopenAfterLoad) {
+    for (int write_during_load = 0; write_during_load < 2;
+         write_during_load++) {
+        BulkLoader* loader;
+        ASSERT_TRUE(db_->NewBulkLoader(BulkLoadOptions(), &loader).IsOk());
+        std::map<std::string, std::string> model = Contents();
+        AddEntries(loader, 2000, &model);
+        if (write_during_load) {
+            env_.OnNewTable([this]() {
+                ASSERT_TRUE(
+                    db_->Put(WriteOptions(), "zzz", "concurrent").IsOk());
+            });
+            model["zzz"] = "concurrent";
+        }
+        ASSERT_TRUE(loader->Finish().IsOk());
+        delete loader;
+
+        Reopen();
+        ASSERT_EQ(model, Contents());
+
+        // 重新打开之后的写入仍然比导入的数据新，
+        // 全局序列号写入了描述文件
+        ASSERT_TRUE(db_->Put(WriteOptions(), Key(11), "after").IsOk());
+        ASSERT_EQ("after", Get(Key(11)));
+        ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+        Reopen();
+        ASSERT_EQ("after", Get(Key(11)));
+    }
+}
+
+}  // namespace massdb
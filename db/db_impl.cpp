@@ -0,0 +1,2234 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#include "db/db_impl.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "db/blob_file.h"
+#include "db/builder.h"
+#include "db/bulk_loader.h"
+#include "db/db_iter.h"
+#include "db/filename.h"
+#include "db/fragment_index.h"
+#include "db/log_reader.h"
+#include "db/log_writer.h"
+#include "db/memtable.h"
+#include "db/range_iter.h"
+#include "db/table_cache.h"
+#include "db/version_set.h"
+#include "db/write_batch_internal.h"
+#include "massdb/comparator.h"
+#include "massdb/env.h"
+#include "massdb/spectrum.h"
+#include "massdb/table_builder.h"
+#include "table/merger.h"
+#include "util/compression.h"
+
+namespace massdb {
+
+// 一次合并写入的最大字节数
+static const size_t kMaxBatchGroupSize = 1 << 20;
+
+// 在 writers_ 中等待的写者
+struct DBImpl::Writer {
+    explicit Writer(WriteBatch* b, bool s)
+        : batch(b), sync(s), done(false), insert_mem(nullptr) {}
+
+    Status status;
+    WriteBatch* batch;  // 为 nullptr 时不写入数据，只是等待成为队首
+    bool sync;
+    bool done;
+    // 不为 nullptr 时，leader 要求这个写者将 batch 并发地插入 insert_mem
+    MemTable* insert_mem;
+    std::condition_variable cv;
+};
+
+// 压实的一部分：合并 user key 在 [start, end) 中的输入。
+// 一次压实可以拆分成多个子压实，由不同的线程执行，它们的输出文件互不重叠
+struct DBImpl::Subcompaction {
+    // 压实输出的文件
+    struct Output {
+        uint64_t number;
+        uint64_t file_size;
+        uint64_t fragment_index_size;  // 没有写入碎片离子索引时为 0
+        uint64_t oldest_blob_file;     // 见 FileMetaData
+        InternalKey smallest, largest;
+    };
+
+    Subcompaction()
+        : has_start(false),
+          has_end(false),
+          outfile(nullptr),
+          builder(nullptr),
+          fragment_builder(nullptr),
+          blob_builder(nullptr),
+          total_bytes(0) {}
+
+    Output* current_output() { return &outputs[outputs.size() - 1]; }
+
+    // has_start 为 false 表示从第一个 key 开始，
+    // has_end 为 false 表示直到最后一个 key
+    bool has_start;
+    bool has_end;
+    std::string start;
+    std::string end;
+
+    Compaction::Cursor cursor;
+
+    std::vector<Output> outputs;
+
+    // 正在写入的输出文件
+    WritableFile* outfile;
+    TableBuilder* builder;
+    // 启用碎片离子索引时，收集正在写入的文件的索引
+    FragmentIndexBuilder* fragment_builder;
+
+    // 搬走的和新分离出的 value 写入的 blob 文件，一个子压实最多一个
+    BlobFileBuilder* blob_builder;
+    std::vector<BlobFileMetaData> blob_outputs;
+    // 每个 blob 文件中因为这次压实而失效的 value 的数量和字节数
+    std::map<uint64_t, BlobFileMetaData> blob_garbage;
+
+    uint64_t total_bytes;
+    Status status;
+};
+
+// 一次压实的状态
+struct DBImpl::CompactionState {
+    explicit CompactionState(Compaction* c)
+        : compaction(c), smallest_snapshot(0) {}
+
+    Compaction* const compaction;
+
+    // 返回能看到序列号为 sequence 的版本的最早的快照在 snapshots 中的
+    // 下标，这个版本属于 (snapshots[i-1], snapshots[i]] 这一段
+    size_t SnapshotStripe(SequenceNumber sequence) const {
+        return std::lower_bound(snapshots.begin(), snapshots.end(),
+                                sequence) -
+               snapshots.begin();
+    }
+
+    // 压实开始时存活的快照的序列号，按升序排列，
+    // 最后一个是当时最新的序列号（之后开始的读者使用的隐式快照）。
+    // 每一个快照只能看到同一个 user key 在它之前最新的版本：
+    // 同一段中的多个版本只需要保留最新的一个
+    std::vector<SequenceNumber> snapshots;
+
+    // 最旧的快照。序列号不大于它的版本对所有读者都可见
+    SequenceNumber smallest_snapshot;
+
+    // 失效数据较多的 blob 文件，压实时把其中仍然有效的 value 搬走
+    std::set<uint64_t> blob_gc_files;
+
+    // 按 key 的范围排列，相邻的两个子压实中前一个的 end 等于后一个的 start
+    std::vector<Subcompaction> subcompactions;
+};
+
+// 一次压实的所有子压实。压实线程和调度到 Env 后台线程池中的任务
+// 都从 next 领取下一个子压实执行，直到全部被领取。
+// 压实线程领取不到新的子压实后等待其他线程领取的完成；线程池没有空闲的
+// 线程时压实线程自己执行所有子压实，不会因为等待排队的任务而阻塞。
+// 排队的任务可能在压实完成之后才运行，这时只访问这个对象本身，
+// 对象由压实线程和这些任务共同引用
+struct DBImpl::SubcompactionJob {
+    SubcompactionJob(DBImpl* d, CompactionState* c)
+        : db(d), compact(c), next(0), done(0), refs(1) {}
+
+    // 领取并执行子压实，直到所有子压实都被领取
+    void Run() {
+        std::vector<Subcompaction>& subs = compact->subcompactions;
+        while (true) {
+            const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= subs.size()) {
+                break;
+            }
+            db->ProcessSubcompaction(compact, &subs[i]);
+            std::lock_guard<std::mutex> l(mu);
+            if (++done == subs.size()) {
+                cv.notify_all();
+            }
+        }
+    }
+
+    void Unref() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    DBImpl* const db;
+    CompactionState* const compact;
+    std::atomic<size_t> next;  // 下一个要领取的子压实
+    std::mutex mu;
+    std::condition_variable cv;
+    size_t done;  // 已经完成的子压实数量，由 mu 保护
+    std::atomic<int> refs;
+};
+
+// 日志、描述文件等 table 缓存之外的文件预留的数量
+static const int kNumNonTableCacheFiles = 10;
+
+// 将 *ptr 限制在 [minvalue, maxvalue] 之间
+template <class T, class V>
+static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
+    if (static_cast<V>(*ptr) > maxvalue) *ptr = maxvalue;
+    if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
+}
+
+Options SanitizeOptions(const std::string& dbname,
+                        const InternalKeyComparator* icmp,
+                        const InternalFilterPolicy* ipolicy,
+                        const Options& src) {
+    Options result = src;
+    result.comparator = icmp;
+    result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+    ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
+    ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
+    ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+    if (result.block_restart_interval < 1) {
+        result.block_restart_interval = 1;
+    }
+    ClipToRange(&result.compression_min_savings, 0.0, 0.99);
+    // 没有编译进来的压缩算法换成可用的算法，而不是每个块都尝试压缩失败
+    result.compression = SupportedCompression(result.compression);
+    result.bottommost_compression =
+        SupportedCompression(result.bottommost_compression);
+    for (CompressionType& type : result.compression_per_level) {
+        type = SupportedCompression(type);
+    }
+    if (result.arena_block_size == 0) {
+        result.arena_block_size = result.write_buffer_size / 8;
+        ClipToRange(&result.arena_block_size, 4 << 10, 8 << 20);
+    }
+
+    // 第 0 层的三个阈值必须依次递增
+    if (result.level0_file_num_compaction_trigger < 1) {
+        result.level0_file_num_compaction_trigger = 1;
+    }
+    if (result.level0_slowdown_writes_trigger <
+        result.level0_file_num_compaction_trigger) {
+        result.level0_slowdown_writes_trigger =
+            result.level0_file_num_compaction_trigger;
+    }
+    if (result.level0_stop_writes_trigger <
+        result.level0_slowdown_writes_trigger) {
+        result.level0_stop_writes_trigger =
+            result.level0_slowdown_writes_trigger;
+    }
+    if (result.max_bytes_for_level_base < result.max_file_size) {
+        result.max_bytes_for_level_base = result.max_file_size;
+    }
+    if (result.max_bytes_for_level_multiplier < 1) {
+        result.max_bytes_for_level_multiplier = 1;
+    }
+    ClipToRange(&result.max_background_jobs, 1, 64);
+    ClipToRange(&result.max_subcompactions, 1, 64);
+    // 箱宽度不是正数（包括 NaN）时不生成碎片离子索引
+    if (!(result.fragment_index_bin_width > 0)) {
+        result.fragment_index_bin_width = 0;
+    }
+    return result;
+}
+
+// blob 文件的缓存可以同时打开的文件数。启用键值分离时占四分之一；
+// 没有启用时只需要读取以前分离出的 value，留少量的位置
+static int BlobCacheSize(const Options& sanitized_options) {
+    const int n = sanitized_options.max_open_files - kNumNonTableCacheFiles;
+    return sanitized_options.min_blob_size > 0 ? n / 4 : n / 16;
+}
+
+// table 文件的缓存可以同时打开的文件数。
+// 启用碎片离子索引时，除去 blob 文件的部分一半留给索引文件的缓存
+static int TableCacheSize(const Options& sanitized_options) {
+    const int n = sanitized_options.max_open_files - kNumNonTableCacheFiles -
+                  BlobCacheSize(sanitized_options);
+    return sanitized_options.fragment_index_bin_width > 0 ? n - n / 2 : n;
+}
+
+// 碎片离子索引文件的缓存可以同时打开的文件数
+static int FragmentCacheSize(const Options& sanitized_options) {
+    const int n = sanitized_options.max_open_files - kNumNonTableCacheFiles -
+                  BlobCacheSize(sanitized_options);
+    return n - TableCacheSize(sanitized_options);
+}
+
+DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
+    : env_(raw_options.env),
+      internal_comparator_(raw_options.comparator),
+      internal_filter_policy_(raw_options.filter_policy),
+      options_(SanitizeOptions(dbname, &internal_comparator_,
+                               &internal_filter_policy_, raw_options)),
+      dbname_(dbname),
+      table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
+      blob_cache_(
+          new BlobFileCache(dbname_, options_, BlobCacheSize(options_))),
+      fragment_options_(FragmentIndexOptions(options_)),
+      fragment_cache_(new TableCache(dbname_, fragment_options_,
+                                     FragmentCacheSize(options_),
+                                     FragmentIndexFileName)),
+      db_lock_(nullptr),
+      shutting_down_(false),
+      mem_(NewMemTable()),
+      imm_(nullptr),
+      logfile_(nullptr),
+      logfile_number_(0),
+      log_(nullptr),
+      tmp_batch_(new WriteBatch),
+      pending_inserts_(0),
+      background_flush_scheduled_(false),
+      background_compaction_scheduled_(false),
+      bulk_load_installs_(0),
+      versions_(new VersionSet(dbname_, &options_, table_cache_,
+                               &internal_comparator_)) {
+    mem_->Ref();
+    env_->SetBackgroundThreads(options_.max_background_jobs);
+}
+
+DBImpl::~DBImpl() {
+    std::unique_lock<std::mutex> l(mutex_);
+    // 等待后台任务结束
+    shutting_down_.store(true, std::memory_order_release);
+    while (background_flush_scheduled_ || background_compaction_scheduled_) {
+        background_work_finished_signal_.wait(l);
+    }
+    l.unlock();
+
+    if (db_lock_ != nullptr) {
+        env_->UnlockFile(db_lock_);
+    }
+
+    delete versions_;
+    // mem_ 和 imm_ 中的数据都记录在日志中，下次打开时会被恢复
+    if (imm_ != nullptr) imm_->Unref();
+    mem_->Unref();
+    delete tmp_batch_;
+    delete log_;
+    delete logfile_;
+
+    delete fragment_cache_;
+    delete blob_cache_;
+    delete table_cache_;
+}
+
+Status DBImpl::NewDB() {
+    VersionEdit new_db;
+    new_db.SetComparatorName(internal_comparator_.user_comparator()->Name());
+    new_db.SetLogNumber(0);
+    new_db.SetNextFile(2);
+    new_db.SetLastSequence(0);
+
+    const std::string manifest = DescriptorFileName(dbname_, 1);
+    WritableFile* file;
+    Status s = env_->NewWritableFile(manifest, &file);
+    if (!s.IsOk()) {
+        return s;
+    }
+    {
+        log::Writer log(file);
+        std::string record;
+        new_db.EncodeTo(&record);
+        s = log.AddRecord(record);
+        if (s.IsOk()) {
+            s = file->Sync();
+        }
+        if (s.IsOk()) {
+            s = file->Close();
+        }
+    }
+    delete file;
+    if (s.IsOk()) {
+        // 让 CURRENT 指向新的描述文件
+        s = SetCurrentFile(env_, dbname_, 1);
+    } else {
+        env_->RemoveFile(manifest);
+    }
+    return s;
+}
+
+Status DBImpl::Recover(std::unique_lock<std::mutex>& l) {
+    // 忽略 CreateDir 的错误，数据库目录可能已经存在
+    env_->CreateDir(dbname_);
+    Status s = env_->LockFile(LockFileName(dbname_), &db_lock_);
+    if (!s.IsOk()) {
+        return s;
+    }
+
+    if (!env_->FileExists(CurrentFileName(dbname_))) {
+        if (options_.create_if_missing) {
+            s = NewDB();
+            if (!s.IsOk()) {
+                return s;
+            }
+        } else {
+            return Status::InvalidArgument(
+                dbname_, "does not exist (create_if_missing is false)");
+        }
+    } else if (options_.error_if_exists) {
+        return Status::InvalidArgument(dbname_,
+                                       "exists (error_if_exists is true)");
+    }
+
+    s = versions_->Recover();
+    if (!s.IsOk()) {
+        return s;
+    }
+
+    // 描述文件中记录的日志编号之后的日志还没有写入 table 文件，需要重放。
+    // 同时检查描述文件引用的 table 文件是否都存在
+    std::vector<std::string> filenames;
+    s = env_->GetChildren(dbname_, &filenames);
+    if (!s.IsOk()) {
+        return s;
+    }
+    std::set<uint64_t> expected;
+    versions_->AddLiveFiles(&expected);
+    const uint64_t min_log = versions_->LogNumber();
+    std::vector<uint64_t> logs;
+    uint64_t number;
+    FileType type;
+    for (const std::string& filename : filenames) {
+        if (ParseFileName(filename, &number, &type)) {
+            expected.erase(number);
+            if (type == kLogFile && number >= min_log) {
+                logs.push_back(number);
+            }
+        }
+    }
+    if (!expected.empty()) {
+        char buf[50];
+        std::snprintf(buf, sizeof(buf), "%d missing files; e.g.",
+                      static_cast<int>(expected.size()));
+        return Status::Corruption(
+            buf, TableFileName(dbname_, *(expected.begin())));
+    }
+
+    // 按从旧到新的顺序重放日志
+    VersionEdit edit;
+    SequenceNumber max_sequence = versions_->LastSequence();
+    std::sort(logs.begin(), logs.end());
+    for (uint64_t log_number : logs) {
+        s = RecoverLogFile(log_number, l, &edit, &max_sequence);
+        if (!s.IsOk()) {
+            return s;
+        }
+        // 之前的数据库可能在分配了这个编号之后没有写入描述文件就退出了
+        versions_->MarkFileNumberUsed(log_number);
+    }
+    versions_->SetLastSequence(max_sequence);
+
+    // 创建新的日志文件，之前的日志都已经写入了 table 文件
+    const uint64_t new_log_number = versions_->NewFileNumber();
+    WritableFile* lfile;
+    s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+    if (!s.IsOk()) {
+        return s;
+    }
+    logfile_ = lfile;
+    logfile_number_ = new_log_number;
+    log_ = new log::Writer(lfile);
+
+    // 写入新的描述文件，记录重放日志生成的 table 文件和新的日志编号
+    edit.SetLogNumber(new_log_number);
+    s = versions_->LogAndApply(&edit, l);
+    // 恢复期间没有后台任务，所有正在写入的文件都来自重放的日志
+    pending_outputs_.clear();
+    if (!s.IsOk()) {
+        return s;
+    }
+    RemoveObsoleteFiles(l);
+    MaybeScheduleCompaction();
+    return Status::Ok();
+}
+
+Status DBImpl::RecoverLogFile(uint64_t log_number,
+                              std::unique_lock<std::mutex>& l,
+                              VersionEdit* edit,
+                              SequenceNumber* max_sequence) {
+    struct LogReporter : public log::Reader::Reporter {
+        Status* status;  // paranoid_checks 为 false 时为 nullptr
+        void Corruption(size_t bytes, const Status& s) override {
+            if (status != nullptr && status->IsOk()) *status = s;
+        }
+    };
+
+    // 打开日志文件
+    std::string fname = LogFileName(dbname_, log_number);
+    SequentialFile* file;
+    Status status = env_->NewSequentialFile(fname, &file);
+    if (!status.IsOk()) {
+        return status;
+    }
+
+    // 创建日志读取器。paranoid_checks 为 false 时忽略损坏的记录，
+    // 尽可能多地恢复数据
+    LogReporter reporter;
+    reporter.status = (options_.paranoid_checks ? &status : nullptr);
+    log::Reader reader(file, &reporter, true /*checksum*/);
+
+    // 读取所有的记录并插入 memtable
+    std::string scratch;
+    Slice record;
+    WriteBatch batch;
+    MemTable* mem = nullptr;
+    while (reader.ReadRecord(&record, &scratch) && status.IsOk()) {
+        if (record.size() < 12) {
+            reporter.Corruption(record.size(),
+                                Status::Corruption("log record too small"));
+            continue;
+        }
+        WriteBatchInternal::SetContents(&batch, record);
+
+        if (mem == nullptr) {
+            mem = NewMemTable();
+            mem->Ref();
+        }
+        status = WriteBatchInternal::InsertInto(&batch, mem);
+        if (!status.IsOk()) {
+            break;
+        }
+        const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
+                                        WriteBatchInternal::Count(&batch) - 1;
+        if (last_seq > *max_sequence) {
+            *max_sequence = last_seq;
+        }
+
+        if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+            FileMetaData meta;
+            status = WriteLevel0Table(mem, edit, &meta, l);
+            mem->Unref();
+            mem = nullptr;
+        }
+    }
+    delete file;
+
+    if (status.IsOk() && mem != nullptr) {
+        FileMetaData meta;
+        status = WriteLevel0Table(mem, edit, &meta, l);
+    }
+    if (mem != nullptr) mem->Unref();
+    return status;
+}
+
+void DBImpl::RemoveObsoleteFiles(std::unique_lock<std::mutex>& l) {
+    if (!bg_error_.IsOk()) {
+        // 出错之后不确定哪些文件还有用，不删除任何文件
+        return;
+    }
+
+    // 正在写入的文件和所有 Version 引用的文件都还有用
+    std::set<uint64_t> live = pending_outputs_;
+    versions_->AddLiveFiles(&live);
+    // blob 文件的编号可能与 table 文件相同，单独判断
+    std::set<uint64_t> live_blobs = pending_outputs_;
+    versions_->AddLiveBlobFiles(&live_blobs);
+
+    std::vector<std::string> filenames;
+    env_->GetChildren(dbname_, &filenames);  // 忽略错误
+    std::vector<std::string> files_to_delete;
+    uint64_t number;
+    FileType type;
+    for (std::string& filename : filenames) {
+        if (ParseFileName(filename, &number, &type)) {
+            bool keep = true;
+            switch (type) {
+                case kLogFile:
+                    keep = (number >= versions_->LogNumber());
+                    break;
+                case kDescriptorFile:
+                    // 保留当前的描述文件和之后可能创建的描述文件
+                    keep = (number >= versions_->ManifestFileNumber());
+                    break;
+                case kTableFile:
+                case kFragmentIndexFile:
+                    keep = (live.find(number) != live.end());
+                    break;
+                case kBlobFile:
+                    keep = (live_blobs.find(number) != live_blobs.end());
+                    break;
+                case kTempFile:
+                    // 打开数据库和批量导入时会写入临时文件，
+                    // 正在使用的在 pending_outputs_ 中，
+                    // 剩下的是之前异常退出时留下的
+                    keep = (live.find(number) != live.end());
+                    break;
+                case kCurrentFile:
+                case kDBLockFile:
+                    keep = true;
+                    break;
+            }
+
+            if (!keep) {
+                files_to_delete.push_back(std::move(filename));
+                if (type == kTableFile) {
+                    table_cache_->Evict(number);
+                } else if (type == kFragmentIndexFile) {
+                    fragment_cache_->Evict(number);
+                } else if (type == kBlobFile) {
+                    blob_cache_->Evict(number);
+                }
+            }
+        }
+    }
+
+    // 删除文件时不需要持有锁，这些文件已经不会再被访问了
+    l.unlock();
+    for (const std::string& filename : files_to_delete) {
+        env_->RemoveFile(dbname_ + "/" + filename);
+    }
+    l.lock();
+}
+
+Status DBImpl::Put(const WriteOptions& options, const Slice& key,
+                   const Slice& value) {
+    WriteBatch batch;
+    batch.Put(key, value);
+    return Write(options, &batch);
+}
+
+Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
+    WriteBatch batch;
+    batch.Delete(key);
+    return Write(options, &batch);
+}
+
+Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+    Writer w(updates, options.sync);
+
+    std::unique_lock<std::mutex> l(mutex_);
+    writers_.push_back(&w);
+    while (!w.done && &w != writers_.front()) {
+        w.cv.wait(l);
+        if (w.insert_mem != nullptr) {
+            // leader 已经将这一组更新写入了日志，
+            // 要求这个写者将自己的更新并发地插入 MemTable
+            MemTable* mem = w.insert_mem;
+            l.unlock();
+            Status s =
+                WriteBatchInternal::InsertInto(w.batch, mem, true /*concurrent*/);
+            l.lock();
+            // leader 等待所有插入完成后从 w.status 收集错误
+            w.status = s;
+            w.insert_mem = nullptr;
+            if (--pending_inserts_ == 0) {
+                parallel_insert_done_.notify_one();
+            }
+        }
+    }
+    if (w.done) {
+        // 已经由其他 leader 写入
+        return w.status;
+    }
+
+    // 成为 leader：将队列中等待的更新合并后一起写入
+    Status status = MakeRoomForWrite(l);
+    uint64_t last_sequence = LastAllocatedSequence();
+    Writer* last_writer = &w;
+    if (status.IsOk()) {
+        WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+        if (!bulk_loads_.empty()) {
+            CheckBulkLoadConflicts(write_batch);
+        }
+        WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+        last_sequence += WriteBatchInternal::Count(write_batch);
+
+        // 写日志和插入 MemTable 时不持有锁。
+        // &w 是队首，其他写者只会加入队列并等待，不会同时写日志或修改 mem_
+        bool sync_error = false;
+        {
+            l.unlock();
+            status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+            if (status.IsOk() && options.sync) {
+                status = logfile_->Sync();
+                if (!status.IsOk()) {
+                    sync_error = true;
+                }
+            }
+            l.lock();
+        }
+
+        if (status.IsOk()) {
+            if (options_.allow_concurrent_memtable_write &&
+                last_writer != &w) {
+                status = ParallelInsert(
+                    last_writer, WriteBatchInternal::Sequence(write_batch), l);
+            } else {
+                l.unlock();
+                status = WriteBatchInternal::InsertInto(write_batch, mem_);
+                l.lock();
+            }
+        }
+        if (sync_error) {
+            // 日志文件的状态不确定：刚才的记录在重新打开数据库之后可能出现，
+            // 也可能不出现，所以之后的写入都要失败
+            RecordBackgroundError(status);
+        }
+        if (write_batch == tmp_batch_) tmp_batch_->Clear();
+
+        // 这一组更新全部完成后才对读者可见
+        versions_->SetLastSequence(last_sequence);
+    }
+
+    while (true) {
+        Writer* ready = writers_.front();
+        writers_.pop_front();
+        if (ready != &w) {
+            ready->status = status;
+            ready->done = true;
+            ready->cv.notify_one();
+        }
+        if (ready == last_writer) break;
+    }
+
+    // 唤醒新的队首
+    if (!writers_.empty()) {
+        writers_.front()->cv.notify_one();
+    }
+
+    return status;
+}
+
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+    assert(!writers_.empty());
+    Writer* first = writers_.front();
+    WriteBatch* result = first->batch;
+    assert(result != nullptr);
+
+    size_t size = WriteBatchInternal::ByteSize(first->batch);
+
+    // 限制合并的大小。如果第一个写者的更新很小，
+    // 就限制得更小一些，以免让小的写入等待太久
+    size_t max_size = kMaxBatchGroupSize;
+    if (size <= (128 << 10)) {
+        max_size = size + (128 << 10);
+    }
+
+    *last_writer = first;
+    auto iter = writers_.begin();
+    ++iter;  // 跳过 first
+    for (; iter != writers_.end(); ++iter) {
+        Writer* w = *iter;
+        if (w->batch == nullptr) {
+            // 不写入数据的写者需要自己成为队首
+            break;
+        }
+        if (w->sync && !first->sync) {
+            // 不要把需要同步的写入合并到不同步的写入中
+            break;
+        }
+
+        size += WriteBatchInternal::ByteSize(w->batch);
+        if (size > max_size) {
+            // 合并的大小超过限制
+            break;
+        }
+
+        // 每个写者的更新使用连续的序列号，并发插入 MemTable 时各自使用
+        if (result == first->batch) {
+            // 切换到 tmp_batch_，不修改调用者的 batch
+            result = tmp_batch_;
+            assert(WriteBatchInternal::Count(result) == 0);
+            WriteBatchInternal::Append(result, first->batch);
+        }
+        WriteBatchInternal::Append(result, w->batch);
+        *last_writer = w;
+    }
+    return result;
+}
+
+Status DBImpl::ParallelInsert(Writer* last_writer,
+                              SequenceNumber first_sequence,
+                              std::unique_lock<std::mutex>& l) {
+    // 按合并的顺序为每个写者分配序列号
+    Writer* leader = writers_.front();
+    SequenceNumber seq = first_sequence;
+    for (Writer* w : writers_) {
+        WriteBatchInternal::SetSequence(w->batch, seq);
+        seq += WriteBatchInternal::Count(w->batch);
+        if (w != leader) {
+            w->insert_mem = mem_;
+            pending_inserts_++;
+            w->cv.notify_one();
+        }
+        if (w == last_writer) break;
+    }
+
+    l.unlock();
+    Status status =
+        WriteBatchInternal::InsertInto(leader->batch, mem_, true /*concurrent*/);
+    l.lock();
+    while (pending_inserts_ > 0) {
+        parallel_insert_done_.wait(l);
+    }
+    for (Writer* w : writers_) {
+        if (status.IsOk() && w != leader) {
+            status = w->status;
+        }
+        if (w == last_writer) break;
+    }
+    return status;
+}
+
+void DBImpl::RecordBackgroundError(const Status& s) {
+    if (bg_error_.IsOk()) {
+        bg_error_ = s;
+        background_work_finished_signal_.notify_all();
+    }
+}
+
+Status DBImpl::MakeRoomForWrite(std::unique_lock<std::mutex>& l,
+                                bool force) {
+    bool allow_delay = true;
+    while (true) {
+        if (!bg_error_.IsOk()) {
+            // 后台出错，拒绝写入
+            return bg_error_;
+        } else if (allow_delay && versions_->NumLevelFiles(0) >=
+                                      options_.level0_slowdown_writes_trigger) {
+            // 第 0 层的文件快要达到上限了。
+            // 与其在达到上限时让一次写入等待几秒，不如让每次写入延迟 1ms，
+            // 把延迟分摊到许多写入上，同时把 CPU 让给压实线程。
+            // 每次写入最多延迟一次
+            l.unlock();
+            env_->SleepForMicroseconds(1000);
+            allow_delay = false;
+            l.lock();
+        } else if (!force && mem_->ApproximateMemoryUsage() <
+                                 options_.write_buffer_size) {
+            // 当前的 MemTable 还有空间
+            return Status::Ok();
+        } else if (imm_ != nullptr) {
+            // 上一个 MemTable 还在写入磁盘，等待它完成
+            background_work_finished_signal_.wait(l);
+        } else if (versions_->NumLevelFiles(0) >=
+                   options_.level0_stop_writes_trigger) {
+            // 第 0 层的文件太多了，等待压实完成
+            background_work_finished_signal_.wait(l);
+        } else {
+            // 当前的 MemTable 已经写满，转换为不可变的 MemTable，
+            // 并在后台写入 table 文件。新的 MemTable 使用新的日志文件
+            assert(logfile_number_ > 0);
+            const uint64_t new_log_number = versions_->NewFileNumber();
+            WritableFile* lfile = nullptr;
+            Status s = env_->NewWritableFile(
+                LogFileName(dbname_, new_log_number), &lfile);
+            if (!s.IsOk()) {
+                // 避免在日志编号序列中留下空洞
+                versions_->ReuseFileNumber(new_log_number);
+                return s;
+            }
+            delete log_;
+            s = logfile_->Close();
+            if (!s.IsOk()) {
+                // 旧日志中可能有写入丢失了，之后的写入都要失败
+                RecordBackgroundError(s);
+            }
+            delete logfile_;
+
+            logfile_ = lfile;
+            logfile_number_ = new_log_number;
+            log_ = new log::Writer(lfile);
+            imm_ = mem_;
+            mem_ = NewMemTable();
+            mem_->Ref();
+            force = false;  // 切换一次就够了
+            MaybeScheduleFlush();
+        }
+    }
+}
+
+MemTable* DBImpl::NewMemTable() const {
+    return new MemTable(internal_comparator_, options_.arena_block_size,
+                        options_.memtable_huge_page_size);
+}
+
+void DBImpl::MaybeScheduleFlush() {
+    if (background_flush_scheduled_) {
+        // 已经调度过了
+    } else if (shutting_down_.load(std::memory_order_acquire)) {
+        // 数据库正在关闭，不再调度新的任务
+    } else if (!bg_error_.IsOk()) {
+        // 已经出错，不再写入
+    } else if (imm_ == nullptr) {
+        // 没有需要写入的 MemTable
+    } else {
+        background_flush_scheduled_ = true;
+        env_->Schedule(&DBImpl::BGFlushWork, this);
+    }
+}
+
+void DBImpl::MaybeScheduleCompaction() {
+    if (background_compaction_scheduled_) {
+        // 已经调度过了
+    } else if (shutting_down_.load(std::memory_order_acquire)) {
+        // 数据库正在关闭，不再调度新的任务
+    } else if (!bg_error_.IsOk()) {
+        // 已经出错，不再写入
+    } else if (bulk_load_installs_ > 0) {
+        // 批量导入正在安装，完成之后再调度
+    } else if (!versions_->NeedsCompaction()) {
+        // 没有需要压实的层
+    } else {
+        background_compaction_scheduled_ = true;
+        env_->Schedule(&DBImpl::BGCompactionWork, this);
+    }
+}
+
+void DBImpl::BGFlushWork(void* db) {
+    reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BGCompactionWork(void* db) {
+    reinterpret_cast<DBImpl*>(db)->BackgroundCompactionCall();
+}
+
+void DBImpl::BGSubcompactionWork(void* job) {
+    SubcompactionJob* j = reinterpret_cast<SubcompactionJob*>(job);
+    j->Run();
+    j->Unref();
+}
+
+void DBImpl::BackgroundFlushCall() {
+    std::unique_lock<std::mutex> l(mutex_);
+    assert(background_flush_scheduled_);
+    if (shutting_down_.load(std::memory_order_acquire)) {
+        // imm_ 的内容记录在日志中，下次打开时会被恢复
+    } else if (bg_error_.IsOk() && imm_ != nullptr) {
+        FlushMemTable(l);
+    }
+    background_flush_scheduled_ = false;
+
+    // 新的第 0 层文件可能触发压实
+    MaybeScheduleFlush();
+    MaybeScheduleCompaction();
+    background_work_finished_signal_.notify_all();
+}
+
+void DBImpl::BackgroundCompactionCall() {
+    std::unique_lock<std::mutex> l(mutex_);
+    assert(background_compaction_scheduled_);
+    if (shutting_down_.load(std::memory_order_acquire)) {
+        // 不再开始新的压实
+    } else if (bg_error_.IsOk()) {
+        BackgroundCompaction(l);
+    }
+    background_compaction_scheduled_ = false;
+
+    // 一次压实可能让下一层的大小超过目标，需要继续压实
+    MaybeScheduleCompaction();
+    background_work_finished_signal_.notify_all();
+}
+
+void DBImpl::FlushMemTable(std::unique_lock<std::mutex>& l) {
+    assert(imm_ != nullptr);
+    // imm_ 是在 leader 写入之前切换的，之前的写入组都已经完成了插入，
+    // 所以 imm_ 的内容已经完整，不会再被修改
+    VersionEdit edit;
+    FileMetaData meta;
+    Status s = WriteLevel0Table(imm_, &edit, &meta, l);
+
+    if (s.IsOk()) {
+        // imm_ 对应的日志以及更早的日志都不再需要了
+        edit.SetLogNumber(logfile_number_);
+        s = versions_->LogAndApply(&edit, l);
+    }
+    // 新文件已经在 current 中，或者写入失败之后不再需要
+    pending_outputs_.erase(meta.number);
+
+    if (s.IsOk()) {
+        imm_->Unref();
+        imm_ = nullptr;
+        RemoveObsoleteFiles(l);
+    } else {
+        RecordBackgroundError(s);
+    }
+}
+
+Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
+                                FileMetaData* meta,
+                                std::unique_lock<std::mutex>& l) {
+    meta->number = versions_->NewFileNumber();
+    pending_outputs_.insert(meta->number);
+    Iterator* iter = mem->NewIterator();
+
+    Status s;
+    BlobFileMetaData blob;
+    {
+        // 写文件时不持有锁，mem 已经不再接收写入，不会被修改
+        l.unlock();
+        s = BuildTable(dbname_, env_, options_, table_cache_, iter, meta,
+                       &blob);
+        l.lock();
+    }
+    delete iter;
+
+    // file_size 为 0 说明 mem 是空的，没有生成文件
+    if (s.IsOk() && meta->file_size > 0) {
+        edit->AddFile(0, meta->number, meta->file_size,
+                      meta->fragment_index_size, 0, meta->oldest_blob_file,
+                      meta->smallest, meta->largest);
+        if (blob.total_count > 0) {
+            edit->AddBlobFile(blob.number, blob.total_count,
+                              blob.total_bytes);
+        }
+    }
+    return s;
+}
+
+void DBImpl::BackgroundCompaction(std::unique_lock<std::mutex>& l) {
+    Compaction* c = versions_->PickCompaction();
+    if (c == nullptr) {
+        return;
+    }
+
+    Status status;
+    if (c->IsTrivialMove()) {
+        // 直接把文件移动到下一层，不需要读写数据
+        assert(c->num_input_files(0) == 1);
+        FileMetaData* f = c->input(0, 0);
+        c->edit()->RemoveFile(c->level(), f->number);
+        c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
+                           f->fragment_index_size, f->global_sequence,
+                           f->oldest_blob_file, f->smallest, f->largest);
+        status = versions_->LogAndApply(c->edit(), l);
+    } else {
+        CompactionState* compact = new CompactionState(c);
+        status = DoCompactionWork(compact, l);
+        CleanupCompaction(compact);
+        c->ReleaseInputs();
+        if (status.IsOk()) {
+            RemoveObsoleteFiles(l);
+        }
+    }
+    delete c;
+
+    if (status.IsOk()) {
+        // 完成
+    } else if (shutting_down_.load(std::memory_order_acquire)) {
+        // 关闭数据库时中止的压实不算错误
+    } else {
+        RecordBackgroundError(status);
+    }
+}
+
+void DBImpl::CleanupCompaction(CompactionState* compact) {
+    for (Subcompaction& sub : compact->subcompactions) {
+        if (sub.builder != nullptr) {
+            // 压实中途失败，放弃正在写入的文件
+            sub.builder->Abandon();
+            delete sub.builder;
+        } else {
+            assert(sub.outfile == nullptr);
+        }
+        delete sub.outfile;
+        delete sub.fragment_builder;
+        // 压实中途失败，放弃正在写入的 blob 文件
+        delete sub.blob_builder;
+        for (const BlobFileMetaData& blob : sub.blob_outputs) {
+            pending_outputs_.erase(blob.number);
+        }
+        for (const Subcompaction::Output& out : sub.outputs) {
+            pending_outputs_.erase(out.number);
+        }
+    }
+    delete compact;
+}
+
+Status DBImpl::OpenCompactionOutputFile(CompactionState* compact,
+                                        Subcompaction* sub) {
+    assert(compact != nullptr);
+    assert(sub->builder == nullptr);
+    uint64_t file_number;
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        file_number = versions_->NewFileNumber();
+        pending_outputs_.insert(file_number);
+        Subcompaction::Output out;
+        out.number = file_number;
+        out.file_size = 0;
+        out.fragment_index_size = 0;
+        out.oldest_blob_file = 0;
+        sub->outputs.push_back(out);
+    }
+
+    // 输出文件按输出层的设置压缩
+    std::string fname = TableFileName(dbname_, file_number);
+    Status s = env_->NewWritableFile(fname, &sub->outfile);
+    if (s.IsOk()) {
+        Options table_options = options_;
+        table_options.compression = compact->compaction->output_compression();
+        sub->builder = new TableBuilder(table_options, sub->outfile);
+        if (options_.fragment_index_bin_width > 0) {
+            sub->fragment_builder =
+                new FragmentIndexBuilder(options_.fragment_index_bin_width);
+        }
+    }
+    return s;
+}
+
+Status DBImpl::FinishCompactionOutputFile(Subcompaction* sub,
+                                          Iterator* input) {
+    assert(sub != nullptr);
+    assert(sub->outfile != nullptr);
+    assert(sub->builder != nullptr);
+
+    const uint64_t output_number = sub->current_output()->number;
+    assert(output_number != 0);
+
+    // 检查输入的错误
+    Status s = input->status();
+    const uint64_t current_entries = sub->builder->NumEntries();
+    if (s.IsOk()) {
+        s = sub->builder->Finish();
+    } else {
+        sub->builder->Abandon();
+    }
+    const uint64_t current_bytes = sub->builder->FileSize();
+    sub->current_output()->file_size = current_bytes;
+    sub->total_bytes += current_bytes;
+    delete sub->builder;
+    sub->builder = nullptr;
+
+    // 持久化并关闭文件
+    if (s.IsOk()) {
+        s = sub->outfile->Sync();
+    }
+    if (s.IsOk()) {
+        s = sub->outfile->Close();
+    }
+    delete sub->outfile;
+    sub->outfile = nullptr;
+
+    if (s.IsOk() && sub->fragment_builder != nullptr) {
+        s = sub->fragment_builder->Finish(
+            fragment_options_, env_,
+            FragmentIndexFileName(dbname_, output_number),
+            &sub->current_output()->fragment_index_size);
+    }
+    delete sub->fragment_builder;
+    sub->fragment_builder = nullptr;
+
+    if (s.IsOk() && current_entries > 0) {
+        // 确认生成的文件可以正常打开
+        Iterator* iter = table_cache_->NewIterator(ReadOptions(),
+                                                   output_number,
+                                                   current_bytes, 0);
+        s = iter->status();
+        delete iter;
+    }
+    return s;
+}
+
+Status DBImpl::InstallCompactionResults(CompactionState* compact,
+                                        std::unique_lock<std::mutex>& l) {
+    // 输入文件在压实期间不会被其他任务删除：同一时刻只有一个压实，
+    // 写入 MemTable 只会在第 0 层加入新文件。
+    // 所有子压实的输出在同一个 VersionEdit 中加入，读者不会看到只完成了
+    // 一部分的压实
+    compact->compaction->AddInputDeletions(compact->compaction->edit());
+    const int level = compact->compaction->output_level();
+    for (const Subcompaction& sub : compact->subcompactions) {
+        for (const Subcompaction::Output& out : sub.outputs) {
+            compact->compaction->edit()->AddFile(
+                level, out.number, out.file_size, out.fragment_index_size, 0,
+                out.oldest_blob_file, out.smallest, out.largest);
+        }
+        // 新写入的 blob 文件与引用它的 table 文件一起生效
+        for (const BlobFileMetaData& blob : sub.blob_outputs) {
+            compact->compaction->edit()->AddBlobFile(
+                blob.number, blob.total_count, blob.total_bytes);
+        }
+        for (const auto& entry : sub.blob_garbage) {
+            const BlobFileMetaData& garbage = entry.second;
+            compact->compaction->edit()->AddBlobGarbage(
+                garbage.number, garbage.garbage_count, garbage.garbage_bytes);
+        }
+    }
+    return versions_->LogAndApply(compact->compaction->edit(), l);
+}
+
+void DBImpl::GenSubcompactionBoundaries(CompactionState* compact) {
+    Compaction* const c = compact->compaction;
+    compact->subcompactions.resize(1);
+    if (options_.max_subcompactions <= 1) {
+        return;
+    }
+
+    // 每个子压实至少处理约 max_file_size 字节的输入，
+    // 避免小的压实被拆分得过细
+    uint64_t total_bytes = 0;
+    for (int which = 0; which < 2; which++) {
+        for (int i = 0; i < c->num_input_files(which); i++) {
+            total_bytes += c->input(which, i)->file_size;
+        }
+    }
+    const uint64_t limit = total_bytes / options_.max_file_size + 1;
+    const int n = static_cast<int>(
+        std::min<uint64_t>(options_.max_subcompactions, limit));
+    if (n <= 1) {
+        return;
+    }
+
+    // 索引块中的每个 key 对应一个数据块，
+    // 合并所有输入文件的索引 key 后按数量均分，
+    // 每一段中的数据量大致相同
+    std::vector<std::string> index_keys;
+    for (int which = 0; which < 2; which++) {
+        for (int i = 0; i < c->num_input_files(which); i++) {
+            const FileMetaData* f = c->input(which, i);
+            Status s = table_cache_->GetIndexKeys(f->number, f->file_size,
+                                                  &index_keys);
+            if (!s.IsOk()) {
+                // 读取失败时不拆分，错误留给合并时报告
+                return;
+            }
+        }
+    }
+
+    // 子压实按 user key 划分，同一个 user key 的所有版本
+    // 必须由同一个子压实处理，否则无法判断旧的版本能否丢弃
+    const Comparator* ucmp = internal_comparator_.user_comparator();
+    std::vector<Slice> user_keys;
+    user_keys.reserve(index_keys.size());
+    for (const std::string& key : index_keys) {
+        user_keys.push_back(ExtractUserKey(key));
+    }
+    std::sort(user_keys.begin(), user_keys.end(),
+              [ucmp](const Slice& a, const Slice& b) {
+                  return ucmp->Compare(a, b) < 0;
+              });
+    user_keys.erase(std::unique(user_keys.begin(), user_keys.end(),
+                                [ucmp](const Slice& a, const Slice& b) {
+                                    return ucmp->Compare(a, b) == 0;
+                                }),
+                    user_keys.end());
+
+    // 在第 i 段的最后一个 key 和第 i + 1 段的第一个 key 之间
+    // 选择最短的分隔 key 作为边界
+    std::vector<std::string> boundaries;
+    for (int i = 1; i < n; i++) {
+        const size_t index = i * user_keys.size() / n;
+        if (index == 0) {
+            continue;
+        }
+        std::string boundary = user_keys[index - 1].to_string();
+        ucmp->FindShortestSeparator(&boundary, user_keys[index]);
+        if (boundaries.empty() ||
+            ucmp->Compare(boundaries.back(), boundary) < 0) {
+            boundaries.push_back(boundary);
+        }
+    }
+
+    compact->subcompactions.resize(boundaries.size() + 1);
+    for (size_t i = 0; i < boundaries.size(); i++) {
+        Subcompaction* sub = &compact->subcompactions[i];
+        Subcompaction* next = &compact->subcompactions[i + 1];
+        sub->has_end = true;
+        sub->end = boundaries[i];
+        next->has_start = true;
+        next->start = boundaries[i];
+    }
+}
+
+Status DBImpl::AddCompactionBlob(Subcompaction* sub, const Slice& value,
+                                 std::string* blob_index) {
+    if (sub->blob_builder == nullptr) {
+        BlobFileMetaData blob;
+        {
+            std::lock_guard<std::mutex> l(mutex_);
+            blob.number = versions_->NewFileNumber();
+            pending_outputs_.insert(blob.number);
+        }
+        sub->blob_outputs.push_back(blob);
+        Status s = BlobFileBuilder::Open(env_, dbname_, blob.number,
+                                         &sub->blob_builder);
+        if (!s.IsOk()) {
+            return s;
+        }
+    }
+    return sub->blob_builder->Add(value, blob_index);
+}
+
+// 记录 blob 引用指向的 value 已经失效
+static void RecordBlobGarbage(const Slice& blob_index,
+                              std::map<uint64_t, BlobFileMetaData>* garbage) {
+    BlobIndex index;
+    if (index.DecodeFrom(blob_index)) {
+        BlobFileMetaData& f = (*garbage)[index.file_number];
+        f.number = index.file_number;
+        f.garbage_count++;
+        f.garbage_bytes += BlobRecordSize(index.size);
+    }
+}
+
+void DBImpl::ProcessSubcompaction(CompactionState* compact,
+                                  Subcompaction* sub) {
+    Iterator* input = versions_->MakeInputIterator(compact->compaction);
+    if (sub->has_start) {
+        InternalKey start(sub->start, kMaxSequenceNumber, kValueTypeForSeek);
+        input->Seek(start.Encode());
+    } else {
+        input->SeekToFirst();
+    }
+
+    Status status;
+    ParsedInternalKey ikey;
+    std::string current_user_key;
+    bool has_current_user_key = false;
+    // 同一个 user key 上一个（更新的）版本所在的快照段
+    const size_t kNoStripe = compact->snapshots.size() + 1;
+    size_t last_stripe_for_key = kNoStripe;
+    const Comparator* ucmp = internal_comparator_.user_comparator();
+    ReadOptions blob_options;
+    blob_options.verify_checksums = options_.paranoid_checks;
+    std::string blob_key, blob_index, blob_value;
+    while (input->Valid() &&
+           !shutting_down_.load(std::memory_order_acquire)) {
+        Slice key = input->key();
+        if (sub->has_end && key.size() >= 8 &&
+            ucmp->Compare(ExtractUserKey(key), sub->end) >= 0) {
+            // 剩下的 key 属于下一个子压实
+            break;
+        }
+        if (compact->compaction->ShouldStopBefore(key, &sub->cursor) &&
+            sub->builder != nullptr) {
+            status = FinishCompactionOutputFile(sub, input);
+            if (!status.IsOk()) {
+                break;
+            }
+        }
+
+        // 判断是否丢弃这个 key
+        bool drop = false;
+        if (!ParseInternalKey(key, &ikey)) {
+            // 不丢弃损坏的 key，保留下来以便之后排查
+            current_user_key.clear();
+            has_current_user_key = false;
+            last_stripe_for_key = kNoStripe;
+        } else {
+            if (!has_current_user_key ||
+                ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
+                // 第一次遇到这个 user key
+                current_user_key.assign(ikey.user_key.data(),
+                                        ikey.user_key.size());
+                has_current_user_key = true;
+                last_stripe_for_key = kNoStripe;
+            }
+
+            const size_t stripe = compact->SnapshotStripe(ikey.sequence);
+            if (stripe == last_stripe_for_key) {
+                // 同一个 user key 有更新的版本，并且能看到这个版本的快照
+                // 也都能看到更新的版本，这个版本不会再被读到
+                drop = true;
+            } else if (ikey.type == kTypeDeletion &&
+                       ikey.sequence <= compact->smallest_snapshot &&
+                       compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                              &sub->cursor)) {
+                // 对于这个 user key：
+                // (1) 更深的层中没有数据
+                // (2) 更浅的层中的数据序列号更大
+                // (3) 这一层中序列号更小的数据会在接下来的循环中被丢弃
+                // 所以删除标记已经不再需要
+                drop = true;
+            }
+
+            last_stripe_for_key = stripe;
+        }
+
+        if (drop) {
+            if (ikey.type == kTypeBlobIndex) {
+                RecordBlobGarbage(input->value(), &sub->blob_garbage);
+            }
+        } else {
+            // 需要时打开新的输出文件
+            if (sub->builder == nullptr) {
+                status = OpenCompactionOutputFile(compact, sub);
+                if (!status.IsOk()) {
+                    break;
+                }
+            }
+
+            // 一般只复制 key 和 blob 引用，以下两种情况需要写 blob 文件：
+            // (1) 引用指向失效数据较多的 blob 文件，把 value 搬到新文件中
+            // (2) 启用键值分离之前写入的较大的 value
+            Slice value = input->value();
+            Slice user_value = value;  // 用户的 value，碎片离子索引使用
+            uint64_t blob_file = 0;    // 写入的引用指向的 blob 文件
+            if (has_current_user_key && ikey.type == kTypeBlobIndex) {
+                BlobIndex index;
+                const bool decoded = index.DecodeFrom(value);
+                const bool relocate =
+                    decoded &&
+                    compact->blob_gc_files.count(index.file_number) > 0;
+                if (decoded) {
+                    blob_file = index.file_number;
+                }
+                if (relocate || sub->fragment_builder != nullptr) {
+                    status = blob_cache_->Get(blob_options, value,
+                                              &blob_value);
+                    if (!status.IsOk()) {
+                        break;
+                    }
+                    user_value = blob_value;
+                }
+                if (relocate) {
+                    status = AddCompactionBlob(sub, blob_value, &blob_index);
+                    if (!status.IsOk()) {
+                        break;
+                    }
+                    RecordBlobGarbage(value, &sub->blob_garbage);
+                    value = blob_index;
+                    blob_file = sub->blob_outputs.back().number;
+                }
+            } else if (has_current_user_key && ikey.type == kTypeValue &&
+                       options_.min_blob_size > 0 &&
+                       value.size() >= options_.min_blob_size) {
+                status = AddCompactionBlob(sub, value, &blob_index);
+                if (!status.IsOk()) {
+                    break;
+                }
+                blob_key.clear();
+                AppendInternalKey(&blob_key,
+                                  ParsedInternalKey(ikey.user_key,
+                                                    ikey.sequence,
+                                                    kTypeBlobIndex));
+                key = blob_key;
+                value = blob_index;
+                blob_file = sub->blob_outputs.back().number;
+            }
+
+            uint64_t& oldest_blob_file =
+                sub->current_output()->oldest_blob_file;
+            if (blob_file != 0 &&
+                (oldest_blob_file == 0 || blob_file < oldest_blob_file)) {
+                oldest_blob_file = blob_file;
+            }
+            if (sub->builder->NumEntries() == 0) {
+                sub->current_output()->smallest.DecodeFrom(key);
+            }
+            sub->current_output()->largest.DecodeFrom(key);
+            sub->builder->Add(key, value);
+            if (sub->fragment_builder != nullptr) {
+                sub->fragment_builder->Add(key, user_value);
+            }
+
+            // 输出文件足够大时结束它
+            if (sub->builder->FileSize() >=
+                compact->compaction->MaxOutputFileSize()) {
+                status = FinishCompactionOutputFile(sub, input);
+                if (!status.IsOk()) {
+                    break;
+                }
+            }
+        }
+
+        input->Next();
+    }
+
+    if (status.IsOk() && shutting_down_.load(std::memory_order_acquire)) {
+        status = Status::IOError("Deleting DB during compaction");
+    }
+    if (status.IsOk() && sub->builder != nullptr) {
+        status = FinishCompactionOutputFile(sub, input);
+    }
+    if (status.IsOk() && sub->blob_builder != nullptr) {
+        status = sub->blob_builder->Finish();
+        if (status.IsOk()) {
+            BlobFileMetaData& blob = sub->blob_outputs.back();
+            blob.total_count = sub->blob_builder->NumBlobs();
+            blob.total_bytes = sub->blob_builder->FileSize();
+            delete sub->blob_builder;
+            sub->blob_builder = nullptr;
+        }
+    }
+    if (status.IsOk()) {
+        status = input->status();
+    }
+    delete input;
+    sub->status = status;
+}
+
+Status DBImpl::DoCompactionWork(CompactionState* compact,
+                                std::unique_lock<std::mutex>& l) {
+    assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+    assert(compact->subcompactions.empty());
+    snapshots_.GetAll(&compact->snapshots);
+    if (compact->snapshots.empty() ||
+        compact->snapshots.back() != versions_->LastSequence()) {
+        compact->snapshots.push_back(versions_->LastSequence());
+    }
+    compact->smallest_snapshot = compact->snapshots.front();
+    versions_->current()->GetBlobFilesForGC(options_.blob_gc_garbage_ratio,
+                                            &compact->blob_gc_files);
+
+    // 合并时不持有锁，前台的读写和写入 MemTable 的后台任务可以继续进行
+    l.unlock();
+
+    GenSubcompactionBoundaries(compact);
+
+    // 当前线程也执行子压实，后台线程池中最多再使用
+    // max_background_jobs - 1 个线程，同时运行的合并不超过线程池的大小
+    std::vector<Subcompaction>& subs = compact->subcompactions;
+    if (subs.size() == 1) {
+        ProcessSubcompaction(compact, &subs[0]);
+    } else {
+        SubcompactionJob* job = new SubcompactionJob(this, compact);
+        const size_t helpers = std::min<size_t>(
+            subs.size() - 1, options_.max_background_jobs - 1);
+        for (size_t i = 0; i < helpers; i++) {
+            job->refs.fetch_add(1, std::memory_order_relaxed);
+            env_->Schedule(&DBImpl::BGSubcompactionWork, job);
+        }
+        job->Run();
+        {
+            std::unique_lock<std::mutex> job_lock(job->mu);
+            job->cv.wait(job_lock,
+                         [job, &subs] { return job->done == subs.size(); });
+        }
+        job->Unref();
+    }
+
+    Status status;
+    for (const Subcompaction& sub : subs) {
+        if (!sub.status.IsOk()) {
+            status = sub.status;
+            break;
+        }
+    }
+
+    l.lock();
+    if (status.IsOk()) {
+        status = InstallCompactionResults(compact, l);
+    }
+    return status;
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   std::string* value) {
+    Status s;
+    SequenceNumber snapshot;
+    MemTable* mem;
+    MemTable* imm;
+    Version* current;
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        if (options.snapshot != nullptr) {
+            snapshot = static_cast<const SnapshotImpl*>(options.snapshot)
+                           ->sequence_number();
+        } else {
+            snapshot = versions_->LastSequence();
+        }
+        mem = mem_;
+        imm = imm_;
+        current = versions_->current();
+        mem->Ref();
+        if (imm != nullptr) imm->Ref();
+        current->Ref();
+    }
+
+    // 查找时不持有锁：SkipList 的读操作是无锁的，Version 不会被修改。
+    // 按从新到旧的顺序查找：mem、imm、table 文件
+    LookupKey lkey(key, snapshot);
+    if (mem->Get(lkey, value, &s)) {
+        // 在 mem 中找到
+    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+        // 在 imm 中找到
+    } else {
+        bool is_blob_index = false;
+        s = current->Get(options, lkey, value, &is_blob_index);
+        if (s.IsOk() && is_blob_index) {
+            // 在释放 current 之前读取，blob 文件不会在读取期间被删除
+            std::string blob_index;
+            std::swap(blob_index, *value);
+            s = blob_cache_->Get(options, blob_index, value);
+        }
+    }
+
+    std::lock_guard<std::mutex> l(mutex_);
+    mem->Unref();
+    if (imm != nullptr) imm->Unref();
+    current->Unref();
+    return s;
+}
+
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options,
+                                     const std::vector<Slice>& keys,
+                                     std::vector<std::string>* values) {
+    SequenceNumber snapshot;
+    MemTable* mem;
+    MemTable* imm;
+    Version* current;
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        if (options.snapshot != nullptr) {
+            snapshot = static_cast<const SnapshotImpl*>(options.snapshot)
+                           ->sequence_number();
+        } else {
+            snapshot = versions_->LastSequence();
+        }
+        mem = mem_;
+        imm = imm_;
+        current = versions_->current();
+        mem->Ref();
+        if (imm != nullptr) imm->Ref();
+        current->Ref();
+    }
+
+    // 按 user key 排序并去掉重复的 key，之后每一层都只需要顺序地查找一遍
+    const Comparator* ucmp = internal_comparator_.user_comparator();
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return ucmp->Compare(keys[a], keys[b]) < 0;
+    });
+    // owner[i] 是 keys[order[i]] 去重后的下标
+    std::vector<size_t> owner(order.size());
+    std::deque<LookupKey> lkeys;
+    std::vector<const LookupKey*> lkey_ptrs;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (i == 0 || ucmp->Compare(keys[order[i - 1]], keys[order[i]]) != 0) {
+            lkeys.emplace_back(keys[order[i]], snapshot);
+            lkey_ptrs.push_back(&lkeys.back());
+        }
+        owner[i] = lkey_ptrs.size() - 1;
+    }
+
+    // 查找时不持有锁。按从新到旧的顺序查找：mem、imm、table 文件，
+    // 每一步只查找之前没有结果的 key
+    const size_t n = lkey_ptrs.size();
+    std::vector<std::string> found(n);
+    std::vector<Status> statuses(n);
+    std::unique_ptr<bool[]> done(new bool[n]());
+    std::unique_ptr<bool[]> is_blob_index(new bool[n]());
+    mem->MultiGet(lkey_ptrs.data(), n, found.data(), statuses.data(),
+                  done.get());
+    if (imm != nullptr) {
+        imm->MultiGet(lkey_ptrs.data(), n, found.data(), statuses.data(),
+                      done.get());
+    }
+    current->MultiGet(options, lkey_ptrs.data(), n, found.data(),
+                      is_blob_index.get(), statuses.data(), done.get());
+    for (size_t i = 0; i < n; i++) {
+        if (!done[i]) {
+            statuses[i] = Status::NotFound(Slice());
+        } else if (statuses[i].IsOk() && is_blob_index[i]) {
+            // 在释放 current 之前读取，blob 文件不会在读取期间被删除
+            std::string blob_index;
+            std::swap(blob_index, found[i]);
+            statuses[i] = blob_cache_->Get(options, blob_index, &found[i]);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        mem->Unref();
+        if (imm != nullptr) imm->Unref();
+        current->Unref();
+    }
+
+    std::vector<Status> result(keys.size());
+    values->resize(keys.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        result[order[i]] = statuses[owner[i]];
+        if (statuses[owner[i]].IsOk()) {
+            (*values)[order[i]] = found[owner[i]];
+        }
+    }
+    return result;
+}
+
+namespace {
+
+// 内部迭代器持有的资源，迭代器析构时释放
+struct IterState {
+    IterState(std::mutex* mutex, MemTable* mem, MemTable* imm,
+              Version* version)
+        : mu(mutex), mem(mem), imm(imm), version(version) {}
+
+    std::mutex* const mu;
+    MemTable* const mem;     // 由 mu 保护
+    MemTable* const imm;     // 由 mu 保护
+    Version* const version;  // 由 mu 保护
+};
+
+}  // namespace
+
+static void CleanupIteratorState(void* arg1, void* arg2) {
+    IterState* state = reinterpret_cast<IterState*>(arg1);
+    state->mu->lock();
+    state->mem->Unref();
+    if (state->imm != nullptr) state->imm->Unref();
+    state->version->Unref();
+    state->mu->unlock();
+    delete state;
+}
+
+Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
+                                      SequenceNumber* latest_snapshot) {
+    std::lock_guard<std::mutex> l(mutex_);
+    *latest_snapshot = versions_->LastSequence();
+
+    // 收集所有的子迭代器
+    std::vector<Iterator*> list;
+    list.push_back(mem_->NewIterator());
+    mem_->Ref();
+    if (imm_ != nullptr) {
+        list.push_back(imm_->NewIterator());
+        imm_->Ref();
+    }
+    Version* current = versions_->current();
+    current->AddIterators(options, &list);
+    current->Ref();
+    Iterator* internal_iter = NewMergingIterator(
+        &internal_comparator_, &list[0], static_cast<int>(list.size()));
+
+    IterState* cleanup = new IterState(&mutex_, mem_, imm_, current);
+    internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
+    return internal_iter;
+}
+
+Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+    SequenceNumber latest_snapshot;
+    Iterator* iter = NewInternalIterator(options, &latest_snapshot);
+    if (options.snapshot != nullptr) {
+        latest_snapshot = static_cast<const SnapshotImpl*>(options.snapshot)
+                              ->sequence_number();
+    }
+    return NewDBIterator(internal_comparator_.user_comparator(), iter,
+                         latest_snapshot, blob_cache_, options);
+}
+
+const Snapshot* DBImpl::GetSnapshot() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return snapshots_.New(versions_->LastSequence());
+}
+
+void DBImpl::ReleaseSnapshot(const Snapshot* snapshot) {
+    std::lock_guard<std::mutex> l(mutex_);
+    snapshots_.Delete(static_cast<const SnapshotImpl*>(snapshot));
+}
+
+Iterator* DBImpl::RangeQuery(const ReadOptions& options, double precursor_mz,
+                             double tolerance_ppm) {
+    std::string lower, upper;
+    PrecursorMzRange(precursor_mz, tolerance_ppm, &lower, &upper);
+    Iterator* iter =
+        NewRangeIterator(internal_comparator_.user_comparator(),
+                         NewIterator(options), lower, upper);
+    iter->SeekToFirst();
+    return iter;
+}
+
+Status DBImpl::SearchFragments(const ReadOptions& options, const Slice& query,
+                               uint32_t min_shared_peaks,
+                               std::vector<FragmentMatch>* results) {
+    results->clear();
+    const double bin_width = options_.fragment_index_bin_width;
+    if (bin_width == 0) {
+        return Status::NotSupported("fragment index is disabled");
+    }
+    std::vector<int32_t> query_bins;
+    if (!GetPeakBins(query, bin_width, &query_bins)) {
+        return Status::InvalidArgument("query is not a peak list");
+    }
+    if (min_shared_peaks == 0) {
+        min_shared_peaks = 1;
+    }
+    if (query_bins.size() < min_shared_peaks) {
+        return Status::Ok();
+    }
+
+    // 两步之间可能有新的写入：第二步在第一步开始时的快照上读取，
+    // 这时的版本都在第一步扫描的 MemTable 和 table 文件中
+    ReadOptions read_options = options;
+    const Snapshot* implicit_snapshot = nullptr;
+    MemTable* mem;
+    MemTable* imm;
+    Version* current;
+    {
+        std::unique_lock<std::mutex> l(mutex_);
+        if (read_options.snapshot == nullptr) {
+            implicit_snapshot = snapshots_.New(versions_->LastSequence());
+            read_options.snapshot = implicit_snapshot;
+        }
+        mem = mem_;
+        mem->Ref();
+        imm = imm_;
+        if (imm != nullptr) imm->Ref();
+        current = versions_->current();
+        current->Ref();
+    }
+
+    // 第一步：收集候选。只要某个 MemTable 或者 table 文件中 key 的某个版本
+    // 满足条件，key 就是候选，所以快照能看到的满足条件的版本一定在候选中。
+    // MemTable 很小，直接扫描；table 文件使用索引，
+    // 没有索引或者索引的箱宽度不同时扫描整个文件
+    std::vector<std::string> candidates;
+    Iterator* iter = mem->NewIterator();
+    Status s = ScanFragments(iter, blob_cache_, options, bin_width,
+                             query_bins, min_shared_peaks, &candidates);
+    delete iter;
+    if (s.IsOk() && imm != nullptr) {
+        iter = imm->NewIterator();
+        s = ScanFragments(iter, blob_cache_, options, bin_width, query_bins,
+                          min_shared_peaks, &candidates);
+        delete iter;
+    }
+    std::vector<FileMetaData*> files;
+    current->GetAllFiles(&files);
+    for (size_t i = 0; i < files.size() && s.IsOk(); i++) {
+        const FileMetaData* f = files[i];
+        bool usable = false;
+        if (f->fragment_index_size > 0) {
+            // 索引的大小在生成文件时记录，读取索引的错误直接返回
+            iter = fragment_cache_->NewIterator(options, f->number,
+                                                f->fragment_index_size, 0);
+            s = SearchFragmentIndex(iter, bin_width, query_bins,
+                                    min_shared_peaks, &usable, &candidates);
+            delete iter;
+        }
+        if (s.IsOk() && !usable) {
+            iter = table_cache_->NewIterator(options, f->number, f->file_size,
+                                             f->global_sequence);
+            s = ScanFragments(iter, blob_cache_, options, bin_width,
+                              query_bins, min_shared_peaks, &candidates);
+            delete iter;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        mem->Unref();
+        if (imm != nullptr) imm->Unref();
+        current->Unref();
+    }
+
+    // 第二步：在快照上读取每个候选，重新计算相同的箱的数量。
+    // 已经删除或者更新后不再满足条件的候选在这里被去掉
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+    std::string value;
+    std::vector<int32_t> bins;
+    for (size_t i = 0; i < candidates.size() && s.IsOk(); i++) {
+        const std::string& key = candidates[i];
+        s = Get(read_options, key, &value);
+        if (s.IsNotFound()) {
+            s = Status::Ok();
+            continue;
+        }
+        if (!s.IsOk() || !GetPeakBins(value, bin_width, &bins)) {
+            continue;
+        }
+        const uint32_t shared = CountSharedBins(query_bins, bins);
+        if (shared >= min_shared_peaks) {
+            results->push_back(FragmentMatch{key, shared});
+        }
+    }
+    if (implicit_snapshot != nullptr) {
+        ReleaseSnapshot(implicit_snapshot);
+    }
+    if (!s.IsOk()) {
+        results->clear();
+        return s;
+    }
+
+    // 相同的箱多的排在前面，数量相同时按 key 排序
+    std::stable_sort(results->begin(), results->end(),
+                     [](const FragmentMatch& a, const FragmentMatch& b) {
+                         return a.shared_peaks > b.shared_peaks;
+                     });
+    return Status::Ok();
+}
+
+Status DBImpl::NewBulkLoader(const BulkLoadOptions& options,
+                             BulkLoader** result) {
+    *result = nullptr;
+    if (options.max_threads < 1 || options.memory_budget == 0) {
+        return Status::InvalidArgument("invalid bulk load options");
+    }
+    *result = new BulkLoaderImpl(this, options);
+    return Status::Ok();
+}
+
+uint64_t DBImpl::NewPendingFileNumber() {
+    std::lock_guard<std::mutex> l(mutex_);
+    const uint64_t number = versions_->NewFileNumber();
+    pending_outputs_.insert(number);
+    return number;
+}
+
+void DBImpl::ReleasePendingFiles(const std::vector<uint64_t>& numbers) {
+    std::lock_guard<std::mutex> l(mutex_);
+    for (uint64_t number : numbers) {
+        pending_outputs_.erase(number);
+    }
+}
+
+// mem 中是否有 user key 在 [smallest, largest] 中的条目
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest, const Slice& largest) {
+    Iterator* iter = mem->NewIterator();
+    InternalKey begin(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+    iter->Seek(begin.Encode());
+    const bool overlaps =
+        iter->Valid() &&
+        ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+    delete iter;
+    return overlaps;
+}
+
+Status DBImpl::BeginBulkLoad(const Slice& smallest, const Slice& largest,
+                             BulkLoad** load) {
+    // 像写入一样在写者队列中排队。成为队首时没有其他写者正在写入 mem_，
+    // 分配的序列号比之前的写入都大，比之后的写入都小
+    Writer w(nullptr, false);
+    std::unique_lock<std::mutex> l(mutex_);
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+        w.cv.wait(l);
+    }
+
+    // MemTable 中与导入重叠的条目比导入的数据旧，导入的文件要放在它们的
+    // 上面，所以先把它们写入 table 文件
+    const Comparator* ucmp = internal_comparator_.user_comparator();
+    Status s = bg_error_;
+    if (s.IsOk() && MemTableOverlaps(mem_, ucmp, smallest, largest)) {
+        s = MakeRoomForWrite(l, true /*force*/);
+    }
+    while (s.IsOk() && imm_ != nullptr &&
+           MemTableOverlaps(imm_, ucmp, smallest, largest)) {
+        background_work_finished_signal_.wait(l);
+        s = bg_error_;
+    }
+
+    if (s.IsOk()) {
+        // 只预留序列号。之后的写入由 LastAllocatedSequence() 跳过它，
+        // 并且都由 CheckBulkLoadConflicts() 检查
+        *load = new BulkLoad{smallest.to_string(), largest.to_string(),
+                             LastAllocatedSequence() + 1, 0, false, false};
+        PlaceBulkLoad(*load);
+        bulk_loads_.push_back(*load);
+    }
+
+    writers_.pop_front();
+    if (!writers_.empty()) {
+        writers_.front()->cv.notify_one();
+    }
+    return s;
+}
+
+int DBImpl::PickBulkLoadLevel(const Slice& smallest, const Slice& largest) {
+    // 没有冲突的写入时，与导入重叠的文件都比导入的数据旧。
+    // 第 0 层的文件按编号区分新旧，导入的文件编号更大，
+    // 所以第 0 层有重叠时仍然可以放入第 0 层。没有重叠时放入最底层
+    InternalKey begin(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+    InternalKey end(largest, 0, static_cast<ValueType>(0));
+    Version* current = versions_->current();
+    std::vector<FileMetaData*> overlaps;
+    for (int level = 0; level < config::kNumLevels; level++) {
+        current->GetOverlappingInputs(level, &begin, &end, &overlaps);
+        if (!overlaps.empty()) {
+            return std::max(level - 1, 0);
+        }
+    }
+    return config::kNumLevels - 1;
+}
+
+void DBImpl::PlaceBulkLoad(BulkLoad* load) {
+    load->level = PickBulkLoadLevel(load->smallest, load->largest);
+    load->bottommost = IsBottommostLevel(load->level);
+}
+
+bool DBImpl::IsBottommostLevel(int level) const {
+    for (int lvl = level + 1; lvl < config::kNumLevels; lvl++) {
+        if (versions_->NumLevelFiles(lvl) > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SequenceNumber DBImpl::LastAllocatedSequence() const {
+    SequenceNumber last = versions_->LastSequence();
+    for (const BulkLoad* load : bulk_loads_) {
+        last = std::max(last, load->sequence);
+    }
+    return last;
+}
+
+void DBImpl::CheckBulkLoadConflicts(const WriteBatch* batch) {
+    class ConflictChecker : public WriteBatch::Handler {
+    public:
+        ConflictChecker(const Comparator* ucmp,
+                        const std::vector<BulkLoad*>& loads)
+            : ucmp_(ucmp), loads_(loads) {}
+
+        void Put(const Slice& key, const Slice& value) override {
+            Check(key);
+        }
+        void Delete(const Slice& key) override { Check(key); }
+
+    private:
+        void Check(const Slice& key) {
+            for (BulkLoad* load : loads_) {
+                if (ucmp_->Compare(key, load->smallest) >= 0 &&
+                    ucmp_->Compare(key, load->largest) <= 0) {
+                    load->conflict = true;
+                }
+            }
+        }
+
+        const Comparator* const ucmp_;
+        const std::vector<BulkLoad*>& loads_;
+    };
+
+    ConflictChecker checker(internal_comparator_.user_comparator(),
+                            bulk_loads_);
+    batch->Iterate(&checker);
+}
+
+// 返回 user key 和类型与 key 相同、序列号为 sequence 的 internal key
+static InternalKey WithSequence(const InternalKey& key,
+                                SequenceNumber sequence) {
+    // key 是 table 文件的边界，总能解析成功
+    ParsedInternalKey parsed;
+    if (!ParseInternalKey(key.Encode(), &parsed)) {
+        assert(false);
+        return key;
+    }
+    return InternalKey(parsed.user_key, sequence, parsed.type);
+}
+
+Status DBImpl::InstallBulkLoad(BulkLoad* load,
+                               const std::vector<FileMetaData>& files,
+                               const std::vector<BlobFileMetaData>& blobs,
+                               bool* rebuild) {
+    *rebuild = false;
+    // 像写入一样在写者队列中排队。成为队首时没有写者持有已经分配、
+    // 但还没有公开的序列号，下面选择的序列号不会与它们交错
+    Writer w(nullptr, false);
+    std::unique_lock<std::mutex> l(mutex_);
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+        w.cv.wait(l);
+    }
+    // 压实的输出文件可能跨过导入的 key 范围，与同一层中导入的文件重叠。
+    // 暂停调度新的压实，并等待正在进行的压实结束
+    bulk_load_installs_++;
+    while (background_compaction_scheduled_) {
+        background_work_finished_signal_.wait(l);
+    }
+
+    Status s = bg_error_;
+    if (s.IsOk() && load->conflict) {
+        s = Status::InvalidArgument("concurrent writes overlap the bulk load");
+    }
+    if (s.IsOk()) {
+        // 开始之后的压实和 flush 可能把与导入重叠的文件放到了
+        // load->level 或者更浅的层，或者在更深的层中加入了文件，
+        // 改变了这一层的压缩方式。这时文件要按新的位置重新写出
+        const int level = load->level;
+        const bool level_free =
+            level == 0 ||
+            level <= PickBulkLoadLevel(load->smallest, load->largest);
+        if (!level_free ||
+            CompressionForLevel(options_, level, IsBottommostLevel(level)) !=
+                CompressionForLevel(options_, level, load->bottommost)) {
+            PlaceBulkLoad(load);
+            *rebuild = true;
+            bulk_load_installs_--;
+            MaybeScheduleCompaction();
+            writers_.pop_front();
+            if (!writers_.empty()) {
+                writers_.front()->cv.notify_one();
+            }
+            return Status::Ok();
+        }
+
+        // 导入期间有其他写入完成时，预留的序列号已经不大于 LastSequence()，
+        // 这之后创建的快照（包括下面写描述文件期间创建的）按预留的序列号
+        // 安装时会看到导入的数据。这时改用一个比已经分配的都大的新序列号，
+        // 记录为文件的全局序列号，读取时改写文件中的序列号，
+        // 不需要重新写出文件，快照也不需要等待导入结束
+        SequenceNumber sequence = load->sequence;
+        if (sequence <= versions_->LastSequence()) {
+            sequence = LastAllocatedSequence() + 1;
+        }
+        VersionEdit edit;
+        for (const FileMetaData& f : files) {
+            if (sequence == load->sequence) {
+                edit.AddFile(level, f.number, f.file_size,
+                             f.fragment_index_size, 0, f.oldest_blob_file,
+                             f.smallest, f.largest);
+            } else {
+                edit.AddFile(level, f.number, f.file_size,
+                             f.fragment_index_size, sequence,
+                             f.oldest_blob_file,
+                             WithSequence(f.smallest, sequence),
+                             WithSequence(f.largest, sequence));
+            }
+        }
+        // blob 文件与引用它的 table 文件一起生效
+        for (const BlobFileMetaData& blob : blobs) {
+            edit.AddBlobFile(blob.number, blob.total_count, blob.total_bytes);
+        }
+        // 序列号总是比 LastSequence() 大，与文件一起写入描述文件，
+        // 写完之后才公开：LogAndApply() 写描述文件时不持有锁，
+        // 这期间创建的快照的序列号比导入的数据小，之后也看不到它们
+        assert(sequence > versions_->LastSequence());
+        edit.SetLastSequence(sequence);
+        s = versions_->LogAndApply(&edit, l);
+        if (s.IsOk()) {
+            versions_->SetLastSequence(sequence);
+        }
+    }
+
+    bulk_loads_.erase(
+        std::find(bulk_loads_.begin(), bulk_loads_.end(), load));
+    delete load;
+    bulk_load_installs_--;
+    MaybeScheduleCompaction();
+    writers_.pop_front();
+    if (!writers_.empty()) {
+        writers_.front()->cv.notify_one();
+    }
+    return s;
+}
+
+void DBImpl::AbortBulkLoad(BulkLoad* load) {
+    std::lock_guard<std::mutex> l(mutex_);
+    bulk_loads_.erase(
+        std::find(bulk_loads_.begin(), bulk_loads_.end(), load));
+    delete load;
+}
+
+Status DBImpl::TEST_CompactMemTable() {
+    // 像写入一样排队，切换 MemTable 时没有其他写者正在写入 mem_
+    Writer w(nullptr, false);
+    std::unique_lock<std::mutex> l(mutex_);
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+        w.cv.wait(l);
+    }
+    Status s = MakeRoomForWrite(l, true /*force*/);
+    writers_.pop_front();
+    if (!writers_.empty()) {
+        writers_.front()->cv.notify_one();
+    }
+
+    while (s.IsOk() && imm_ != nullptr) {
+        background_work_finished_signal_.wait(l);
+        s = bg_error_;
+    }
+    return s;
+}
+
+Status DBImpl::TEST_WaitForBackgroundWork() {
+    std::unique_lock<std::mutex> l(mutex_);
+    while (bg_error_.IsOk() &&
+           (background_flush_scheduled_ || background_compaction_scheduled_ ||
+            imm_ != nullptr || versions_->NeedsCompaction())) {
+        background_work_finished_signal_.wait(l);
+    }
+    return bg_error_;
+}
+
+int DBImpl::TEST_NumLevelFiles(int level) {
+    std::lock_guard<std::mutex> l(mutex_);
+    return versions_->NumLevelFiles(level);
+}
+
+Iterator* DBImpl::TEST_NewInternalIterator() {
+    SequenceNumber ignored;
+    return NewInternalIterator(ReadOptions(), &ignored);
+}
+
+Snapshot::~Snapshot() = default;
+
+BulkLoader::~BulkLoader() = default;
+
+DB::~DB() = default;
+
+// 分数高的排在前面，分数相同时按 key 排序
+static bool HigherScore(const ScoredSpectrum& a, const ScoredSpectrum& b) {
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    return a.key < b.key;
+}
+
+Status DB::SearchSpectra(const ReadOptions& options, double precursor_mz,
+                         double tolerance_ppm, const SpectrumScorer& scorer,
+                         size_t top_k, std::vector<ScoredSpectrum>* results) {
+    results->clear();
+    if (!scorer.valid()) {
+        return Status::InvalidArgument("invalid bin width");
+    }
+    if (top_k == 0) {
+        return Status::Ok();
+    }
+
+    // *results 是按 HigherScore 排列的堆，堆顶是目前分数最低的结果。
+    // 正向遍历时 value() 直接指向 MemTable 或者块中的数据，
+    // 只有进入堆的 key 会被复制
+    Iterator* iter = RangeQuery(options, precursor_mz, tolerance_ppm);
+    float score;
+    for (; iter->Valid(); iter->Next()) {
+        if (!scorer.Score(iter->value(), &score)) {
+            continue;
+        }
+        if (results->size() < top_k) {
+            results->push_back(ScoredSpectrum{iter->key().to_string(), score});
+            std::push_heap(results->begin(), results->end(), HigherScore);
+        } else if (score > results->front().score) {
+            std::pop_heap(results->begin(), results->end(), HigherScore);
+            ScoredSpectrum& slot = results->back();
+            slot.key.assign(iter->key().data(), iter->key().size());
+            slot.score = score;
+            std::push_heap(results->begin(), results->end(), HigherScore);
+        }
+    }
+    Status s = iter->status();
+    delete iter;
+
+    std::sort_heap(results->begin(), results->end(), HigherScore);
+    if (!s.IsOk()) {
+        results->clear();
+    }
+    return s;
+}
+
+Status DB::Open(const Options& options, const std::string& dbname,
+                DB** dbptr) {
+    *dbptr = nullptr;
+    if (options.comparator == nullptr) {
+        return Status::InvalidArgument(dbname, "comparator is null");
+    }
+    if (options.env == nullptr) {
+        return Status::InvalidArgument(dbname, "env is null");
+    }
+
+    DBImpl* impl = new DBImpl(options, dbname);
+    Status s;
+    {
+        std::unique_lock<std::mutex> l(impl->mutex_);
+        s = impl->Recover(l);
+    }
+    if (s.IsOk()) {
+        *dbptr = impl;
+    } else {
+        delete impl;
+    }
+    return s;
+}
+
+}  // namespace massdb
@@ -0,0 +1,349 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#ifndef MASSDB_DB_DB_IMPL_H
+#define MASSDB_DB_DB_IMPL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/snapshot.h"
+#include "massdb/db.h"
+
+namespace massdb {
+
+struct BlobFileMetaData;
+class BlobFileCache;
+class BulkLoaderImpl;
+class Compaction;
+class FileLock;
+struct FileMetaData;
+class MemTable;
+class TableCache;
+class Version;
+class VersionEdit;
+class VersionSet;
+class WritableFile;
+
+namespace log {
+class Writer;
+}  // namespace log
+
+class DBImpl : public DB {
+public:
+    DBImpl(const Options& options, const std::string& dbname);
+
+    DBImpl(const DBImpl&) = delete;
+    DBImpl& operator=(const DBImpl&) = delete;
+
+    ~DBImpl() override;
+
+    // DB 接口的实现
+    Status Put(const WriteOptions& options, const Slice& key,
+               const Slice& value) override;
+    Status Delete(const WriteOptions& options, const Slice& key) override;
+    Status Write(const WriteOptions& options, WriteBatch* updates) override;
+    Status Get(const ReadOptions& options, const Slice& key,
+               std::string* value) override;
+    std::vector<Status> MultiGet(const ReadOptions& options,
+                                 const std::vector<Slice>& keys,
+                                 std::vector<std::string>* values) override;
+    Iterator* NewIterator(const ReadOptions& options) override;
+    const Snapshot* GetSnapshot() override;
+    void ReleaseSnapshot(const Snapshot* snapshot) override;
+    Status SearchFragments(const ReadOptions& options, const Slice& query,
+                           uint32_t min_shared_peaks,
+                           std::vector<FragmentMatch>* results) override;
+    Iterator* RangeQuery(const ReadOptions& options, double precursor_mz,
+                         double tolerance_ppm) override;
+    Status NewBulkLoader(const BulkLoadOptions& options,
+                         BulkLoader** result) override;
+
+    // 以下只用于测试
+
+    // 将当前的 MemTable 写入 table 文件，并等待写入完成
+    Status TEST_CompactMemTable();
+
+    // 等待 flush 和压实都完成，并且没有需要压实的层，返回后台错误
+    Status TEST_WaitForBackgroundWork();
+
+    // 返回第 level 层的文件数量
+    int TEST_NumLevelFiles(int level);
+
+    // 返回遍历所有 internal key 的迭代器，包括旧版本和删除标记
+    Iterator* TEST_NewInternalIterator();
+
+private:
+    friend class BulkLoaderImpl;
+    friend class DB;
+    struct CompactionState;
+    struct Subcompaction;
+    struct SubcompactionJob;
+    struct Writer;
+
+    // 一次正在进行的批量导入
+    struct BulkLoad {
+        // 导入的 user key 范围 [smallest, largest]
+        std::string smallest;
+        std::string largest;
+        // 预留给导入的数据的序列号，安装之前对读者不可见
+        SequenceNumber sequence;
+        // 导入的文件放入的层，写出文件时按这一层选择压缩方式
+        int level;
+        bool bottommost;
+        // 导入开始之后有写入落在这个范围中。这些写入比导入的数据新，
+        // 但它们只会写入第 0 层，无法保证排在导入的文件的上面
+        bool conflict;
+    };
+
+    // 创建一个空的数据库：写入初始的描述文件并让 CURRENT 指向它
+    Status NewDB();
+
+    // 打开数据库目录，从描述文件中恢复 table 文件的列表，
+    // 并重放描述文件之后的日志。恢复完成后创建一个新的日志文件。
+    // 要求：持有 mutex_
+    Status Recover(std::unique_lock<std::mutex>& l);
+
+    // 重放编号为 log_number 的日志文件，日志的内容会被写入新的 table 文件，
+    // 新文件记录在 *edit 中。日志中最大的序列号合并到 *max_sequence 中。
+    // 要求：持有 mutex_
+    Status RecoverLogFile(uint64_t log_number, std::unique_lock<std::mutex>& l,
+                          VersionEdit* edit, SequenceNumber* max_sequence);
+
+    // 删除已经不再需要的文件：不再被任何 Version 引用的 table 文件和
+    // blob 文件、已经写入 table 文件的日志和旧的描述文件。要求：持有 mutex_
+    void RemoveObsoleteFiles(std::unique_lock<std::mutex>& l);
+
+    // 将 writers_ 队首开始的若干个写者的更新合并为一个 WriteBatch，
+    // 并将最后一个被合并的写者存入 *last_writer。
+    // 要求：持有 mutex_，writers_ 不为空
+    WriteBatch* BuildBatchGroup(Writer** last_writer);
+
+    // 由 leader 调用：让 [writers_.front(), last_writer] 中的其他写者
+    // 各自将自己的更新并发地插入 mem_，
+    // leader 插入自己的部分后等待它们全部完成。
+    // first_sequence 是写入日志的合并后的更新的第一个序列号，
+    // 各写者按合并的顺序从它开始使用连续的序列号。
+    // 返回第一个失败的插入的状态。
+    // 要求：持有 mutex_，插入期间会暂时释放锁
+    Status ParallelInsert(Writer* last_writer, SequenceNumber first_sequence,
+                        std::unique_lock<std::mutex>& l);
+
+    // 记录后台（或日志同步）发生的错误，之后的写入都会失败。
+    // 要求：持有 mutex_
+    void RecordBackgroundError(const Status& s);
+
+    // 保证 mem_ 有空间容纳新的写入：
+    // mem_ 的内存占用达到 write_buffer_size 时将其转换为不可变的 imm_，
+    // 新建一个 mem_ 和对应的日志文件，并调度后台线程将 imm_ 写入 table 文件。
+    // 如果上一个 imm_ 还没有写完，则等待它完成。
+    // 第 0 层的文件过多时延迟或者暂停写入，等待后台的压实。
+    // force 为 true 时即使 mem_ 没有写满也进行切换。
+    // 要求：持有 mutex_，并且调用者是 writers_ 的队首
+    Status MakeRoomForWrite(std::unique_lock<std::mutex>& l,
+                            bool force = false);
+
+    // 按 options_ 新建一个 MemTable
+    MemTable* NewMemTable() const;
+
+    // 返回一个合并了 mem_、imm_ 和当前 Version 中所有 table 文件的
+    // internal key 迭代器，
+    // 并将当前可见的最大序列号存入 *latest_snapshot。
+    // 迭代器包含所有版本，由调用者按快照过滤
+    Iterator* NewInternalIterator(const ReadOptions& options,
+                                  SequenceNumber* latest_snapshot);
+
+    // 将 mem 的内容写入一个新的第 0 层 table 文件，将其元数据存入 *meta，
+    // 并在 *edit 中记录它。mem 为空时不生成文件，meta->file_size 为 0。
+    // meta->number 会留在 pending_outputs_ 中，
+    // 调用者在 *edit 被应用之后负责将它移除。
+    // 要求：持有 mutex_，写文件期间会暂时释放锁
+    Status WriteLevel0Table(MemTable* mem, VersionEdit* edit,
+                            FileMetaData* meta,
+                            std::unique_lock<std::mutex>& l);
+
+    // 写入 MemTable 和压实是两个独立调度的后台任务，
+    // 各自同一时刻最多只有一个在执行
+    void MaybeScheduleFlush();
+    void MaybeScheduleCompaction();
+    static void BGFlushWork(void* db);
+    static void BGCompactionWork(void* db);
+    // 在线程池中执行 SubcompactionJob 的子压实
+    static void BGSubcompactionWork(void* job);
+    void BackgroundFlushCall();
+    void BackgroundCompactionCall();
+
+    // 将 imm_ 写入 table 文件。要求：持有 mutex_
+    void FlushMemTable(std::unique_lock<std::mutex>& l);
+
+    // 选择并执行一次压实。要求：持有 mutex_
+    void BackgroundCompaction(std::unique_lock<std::mutex>& l);
+
+    // 释放压实过程中创建的资源。要求：持有 mutex_
+    void CleanupCompaction(CompactionState* compact);
+
+    // 合并压实的输入，写入新的 table 文件，并在完成后应用结果。
+    // 按 options_.max_subcompactions 把压实拆分成多个子压实，
+    // 在当前线程和 Env 的后台线程池中并行合并。
+    // 要求：持有 mutex_，合并期间会释放锁
+    Status DoCompactionWork(CompactionState* compact,
+                            std::unique_lock<std::mutex>& l);
+
+    // 根据输入文件的索引块，把压实的 key 范围划分成数据量大致相同的
+    // 若干段，存入 compact->subcompactions。要求：不持有 mutex_
+    void GenSubcompactionBoundaries(CompactionState* compact);
+
+    // 将 value 追加到 *sub 写入的 blob 文件中，需要时先新建文件，
+    // 指向它的 blob 引用存入 *blob_index。要求：不持有 mutex_
+    Status AddCompactionBlob(Subcompaction* sub, const Slice& value,
+                             std::string* blob_index);
+
+    // 合并 *sub 范围内的输入，结果存入 sub->status。要求：不持有 mutex_
+    void ProcessSubcompaction(CompactionState* compact, Subcompaction* sub);
+
+    // 要求：不持有 mutex_
+    Status OpenCompactionOutputFile(CompactionState* compact,
+                                    Subcompaction* sub);
+    Status FinishCompactionOutputFile(Subcompaction* sub, Iterator* input);
+
+    // 删除压实的输入文件，加入输出文件。要求：持有 mutex_
+    Status InstallCompactionResults(CompactionState* compact,
+                                    std::unique_lock<std::mutex>& l);
+
+    // 以下由批量导入（BulkLoaderImpl）使用，都不要求持有 mutex_
+
+    // 分配一个文件编号并加入 pending_outputs_，
+    // 防止正在写入的文件被 RemoveObsoleteFiles() 删除
+    uint64_t NewPendingFileNumber();
+
+    // 从 pending_outputs_ 中移除 numbers
+    void ReleasePendingFiles(const std::vector<uint64_t>& numbers);
+
+    // 开始导入 user key 在 [smallest, largest] 中的数据。
+    // 与这个范围重叠的 MemTable 先写入 table 文件，然后为导入预留一个
+    // 比之前所有写入都大的序列号（load->sequence）。
+    // 预留的序列号在 InstallBulkLoad() 时才对读者可见，之后的写入
+    // 使用更大的序列号。按当前的状态，导入的文件放入第 load->level 层，
+    // load->bottommost 表示更深的层中没有文件。
+    // 成功时将导入的状态存入 *load，调用者最后要将它传给
+    // InstallBulkLoad() 或者 AbortBulkLoad()
+    Status BeginBulkLoad(const Slice& smallest, const Slice& largest,
+                         BulkLoad** load);
+
+    // 将按 load->level 和 load->bottommost 写出的 table 文件 files 和
+    // blob 文件 blobs 原子地加入第 load->level 层，公开预留的序列号，
+    // 并释放 load。导入开始之后有写入落在导入的范围中时返回错误。
+    // 开始之后的压实或者 flush 使这一层不再可用、或者压缩设置改变时
+    // 不安装也不释放 load，*rebuild 设为 true，load->level 和
+    // load->bottommost 更新为新的位置，调用者重新写出文件后再次调用。
+    // 开始之后有其他写入完成时，文件改用一个比已经分配的序列号都大的
+    // 全局序列号安装（见 FileMetaData::global_sequence）
+    Status InstallBulkLoad(BulkLoad* load,
+                           const std::vector<FileMetaData>& files,
+                           const std::vector<BlobFileMetaData>& blobs,
+                           bool* rebuild);
+
+    // 放弃导入并释放 load，预留的序列号不会公开
+    void AbortBulkLoad(BulkLoad* load);
+
+    // 选择 user key 在 [smallest, largest] 中的导入数据放入的层，
+    // 即第一个有重叠文件的层的上一层。要求：持有 mutex_
+    int PickBulkLoadLevel(const Slice& smallest, const Slice& largest);
+
+    // 按当前的版本设置 load->level 和 load->bottommost。要求：持有 mutex_
+    void PlaceBulkLoad(BulkLoad* load);
+
+    // 比 level 更深的层中是否没有文件。要求：持有 mutex_
+    bool IsBottommostLevel(int level) const;
+
+    // 返回已经分配的最大序列号，包括正在进行的导入预留的序列号。
+    // 新的写入和导入从它的下一个开始分配。要求：持有 mutex_
+    SequenceNumber LastAllocatedSequence() const;
+
+    // 记录落在正在进行的导入的范围中的写入。要求：持有 mutex_
+    void CheckBulkLoadConflicts(const WriteBatch* batch);
+
+    // 构造之后不再改变的状态
+    Env* const env_;
+    const InternalKeyComparator internal_comparator_;
+    const InternalFilterPolicy internal_filter_policy_;
+    const Options options_;  // options_.comparator == &internal_comparator_
+    const std::string dbname_;
+
+    // table_cache_ 和 blob_cache_ 提供自己的同步
+    TableCache* const table_cache_;
+    BlobFileCache* const blob_cache_;
+
+    // 读取碎片离子索引文件的选项和缓存，
+    // 只在 options_.fragment_index_bin_width > 0 时使用
+    const Options fragment_options_;
+    TableCache* const fragment_cache_;
+
+    // 数据库锁文件，防止多个进程同时打开同一个数据库
+    FileLock* db_lock_;
+
+    // 保护下面的状态
+    std::mutex mutex_;
+    // 压实在不持有锁时也会检查这个标志，以便尽快结束
+    std::atomic<bool> shutting_down_;
+    // 后台任务完成时通知等待者
+    std::condition_variable background_work_finished_signal_;
+
+    MemTable* mem_;  // 当前接收写入的 MemTable
+    // 已经写满、正在被写入 table 文件的 MemTable
+    MemTable* imm_;
+
+    // 当前的日志文件，记录了 mem_ 中的所有写入
+    WritableFile* logfile_;
+    uint64_t logfile_number_;
+    log::Writer* log_;
+
+    // 等待写入的写者队列，队首的写者（leader）负责将队列中的更新合并后
+    // 一起写入日志和 MemTable
+    std::deque<Writer*> writers_;
+    WriteBatch* tmp_batch_;  // 合并多个写者的更新时使用
+    // 并行插入 MemTable 时还没有完成插入的写者数量
+    int pending_inserts_;
+    std::condition_variable parallel_insert_done_;
+
+    // 正在写入的 table 文件，防止它们被 RemoveObsoleteFiles() 删除
+    std::set<uint64_t> pending_outputs_;
+
+    // 已经调度了后台的 flush 任务
+    bool background_flush_scheduled_;
+    // 已经调度了后台的压实任务
+    bool background_compaction_scheduled_;
+    // 正在等待安装的批量导入数量，不为 0 时不调度新的压实
+    int bulk_load_installs_;
+    // 正在进行的批量导入
+    std::vector<BulkLoad*> bulk_loads_;
+    // 后台任务出错时记录错误，之后的写入都会失败
+    Status bg_error_;
+
+    // 用户持有的快照，压实需要保留它们能看到的版本
+    SnapshotList snapshots_;
+
+    // 记录每一层的 table 文件和其他持久化的状态。
+    // versions_->LastSequence() 是已经对读者可见的最大序列号，
+    // 小于等于它的写入都已经写入日志并完成了 MemTable 的插入
+    VersionSet* const versions_;
+};
+
+// 修正用户传入的参数。
+// 结果中的 comparator 为 icmp，table 文件中保存的是 internal key。
+// 设置了过滤器策略时替换为 ipolicy，过滤器只针对 user key 构建
+Options SanitizeOptions(const std::string& dbname,
+                        const InternalKeyComparator* icmp,
+                        const InternalFilterPolicy* ipolicy,
+                        const Options& src);
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_DB_IMPL_H
@@ -0,0 +1,330 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "db/db_iter.h"
+
+#include <string>
+
+#include "db/blob_file.h"
+#include "massdb/comparator.h"
+
+namespace massdb {
+
+namespace {
+
+// MemTable 和 table 中的 key 是 internal key，同一个 user key
+// 可能有多个版本（按序列号从新到旧排列），也可能有删除标记。
+// DBIter 将它们合并为 user key 的视图：
+// 跳过被删除的 key 以及同一个 user key 的旧版本。
+class DBIter : public Iterator {
+public:
+    // 迭代的方向：
+    // (1) kForward 时，内部迭代器正好指向 this->key() 对应的条目
+    // (2) kReverse 时，内部迭代器指向 this->key() 对应的所有条目之前的位置，
+    //     this->key() 和 this->value() 保存在 saved_key_ 和 saved_value_ 中
+    enum Direction { kForward, kReverse };
+
+    DBIter(const Comparator* cmp, Iterator* iter, SequenceNumber s,
+           BlobFileCache* blob_cache, const ReadOptions& options)
+        : user_comparator_(cmp),
+          iter_(iter),
+          sequence_(s),
+          blob_cache_(blob_cache),
+          read_options_(options),
+          direction_(kForward),
+          valid_(false),
+          blob_loaded_(false) {}
+
+    DBIter(const DBIter&) = delete;
+    DBIter& operator=(const DBIter&) = delete;
+
+    ~DBIter() override { delete iter_; }
+
+    bool Valid() const override { return valid_; }
+    Slice key() const override {
+        assert(valid_);
+        return (direction_ == kForward) ? ExtractUserKey(iter_->key())
+                                        : Slice(saved_key_);
+    }
+    Slice value() const override {
+        assert(valid_);
+        if (direction_ == kReverse) {
+            return saved_value_;
+        }
+        if (!IsBlobIndex(iter_->key())) {
+            return iter_->value();
+        }
+        // 读取 blob 的结果缓存在 blob_value_ 中，直到迭代器移动
+        if (!blob_loaded_) {
+            blob_loaded_ = true;
+            Status s = ReadBlob(iter_->value(), &blob_value_);
+            if (!s.IsOk() && blob_status_.IsOk()) {
+                blob_status_ = s;
+            }
+        }
+        return blob_value_;
+    }
+    Status status() const override {
+        if (!status_.IsOk()) {
+            return status_;
+        } else if (!blob_status_.IsOk()) {
+            return blob_status_;
+        } else {
+            return iter_->status();
+        }
+    }
+
+    void Next() override;
+    void Prev() override;
+    void Seek(const Slice& target) override;
+    void SeekToFirst() override;
+    void SeekToLast() override;
+
+private:
+    void FindNextUserEntry(bool skipping, std::string* skip);
+    void FindPrevUserEntry();
+    bool ParseKey(ParsedInternalKey* key);
+
+    static bool IsBlobIndex(const Slice& internal_key) {
+        return internal_key[internal_key.size() - 8] ==
+               static_cast<char>(kTypeBlobIndex);
+    }
+
+    Status ReadBlob(const Slice& blob_index, std::string* value) const {
+        value->clear();
+        if (blob_cache_ == nullptr) {
+            return Status::Corruption("unexpected blob index in DBIter");
+        }
+        return blob_cache_->Get(read_options_, blob_index, value);
+    }
+
+    inline void SaveKey(const Slice& k, std::string* dst) {
+        dst->assign(k.data(), k.size());
+    }
+
+    inline void ClearSavedValue() {
+        if (saved_value_.capacity() > 1048576) {
+            std::string empty;
+            std::swap(empty, saved_value_);
+        } else {
+            saved_value_.clear();
+        }
+    }
+
+    const Comparator* const user_comparator_;
+    Iterator* const iter_;
+    SequenceNumber const sequence_;
+    BlobFileCache* const blob_cache_;
+    const ReadOptions read_options_;
+    Status status_;
+    std::string saved_key_;    // 方向为 kReverse 时保存当前的 key
+    std::string saved_value_;  // 方向为 kReverse 时保存当前的 value
+    Direction direction_;
+    bool valid_;
+
+    // 方向为 kForward 并且当前条目是 blob 引用时，value() 读取的 value
+    mutable bool blob_loaded_;
+    mutable std::string blob_value_;
+    mutable Status blob_status_;
+};
+
+inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
+    Slice k = iter_->key();
+    if (!ParseInternalKey(k, ikey)) {
+        status_ = Status::Corruption("corrupted internal key in DBIter");
+        return false;
+    } else {
+        return true;
+    }
+}
+
+void DBIter::Next() {
+    assert(valid_);
+
+    if (direction_ == kReverse) {  // 切换方向
+        direction_ = kForward;
+        // iter_ 指向 this->key() 对应的条目之前的位置，
+        // 先进入 this->key() 的范围，再用下面的逻辑跳过它
+        if (!iter_->Valid()) {
+            iter_->SeekToFirst();
+        } else {
+            iter_->Next();
+        }
+        if (!iter_->Valid()) {
+            valid_ = false;
+            saved_key_.clear();
+            return;
+        }
+        // saved_key_ 中已经保存了需要跳过的 key
+    } else {
+        // 将当前的 key 存入 saved_key_，之后跳过它的所有旧版本
+        SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+
+        // iter_ 指向当前的 key，可以直接跳到下一个条目
+        iter_->Next();
+        if (!iter_->Valid()) {
+            valid_ = false;
+            saved_key_.clear();
+            return;
+        }
+    }
+
+    FindNextUserEntry(true, &saved_key_);
+}
+
+void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
+    // 循环直到找到一个可以返回的条目
+    assert(iter_->Valid());
+    assert(direction_ == kForward);
+    do {
+        ParsedInternalKey ikey;
+        if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+            switch (ikey.type) {
+                case kTypeDeletion:
+                    // 跳过这个 key 之后的所有旧版本
+                    SaveKey(ikey.user_key, skip);
+                    skipping = true;
+                    break;
+                case kTypeValue:
+                case kTypeBlobIndex:
+                    if (skipping &&
+                        user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+                        // 这个条目被覆盖了
+                    } else {
+                        valid_ = true;
+                        saved_key_.clear();
+                        blob_loaded_ = false;
+                        return;
+                    }
+                    break;
+            }
+        }
+        iter_->Next();
+    } while (iter_->Valid());
+    saved_key_.clear();
+    valid_ = false;
+}
+
+void DBIter::Prev() {
+    assert(valid_);
+
+    if (direction_ == kForward) {  // 切换方向
+        // iter_ 指向当前的条目，向前移动直到 key 小于当前的 key，
+        // 然后用下面的 FindPrevUserEntry() 找到前一个 user key
+        assert(iter_->Valid());
+        SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+        while (true) {
+            iter_->Prev();
+            if (!iter_->Valid()) {
+                valid_ = false;
+                saved_key_.clear();
+                ClearSavedValue();
+                return;
+            }
+            if (user_comparator_->Compare(ExtractUserKey(iter_->key()),
+                                          saved_key_) < 0) {
+                break;
+            }
+        }
+        direction_ = kReverse;
+    }
+
+    FindPrevUserEntry();
+}
+
+void DBIter::FindPrevUserEntry() {
+    assert(direction_ == kReverse);
+
+    ValueType value_type = kTypeDeletion;
+    if (iter_->Valid()) {
+        do {
+            ParsedInternalKey ikey;
+            if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+                if ((value_type != kTypeDeletion) &&
+                    user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
+                    // 遇到了前一个 user key 的条目，
+                    // saved_key_ 中保存的就是要返回的结果
+                    break;
+                }
+                value_type = ikey.type;
+                if (value_type == kTypeDeletion) {
+                    saved_key_.clear();
+                    ClearSavedValue();
+                } else {
+                    Slice raw_value = iter_->value();
+                    if (saved_value_.capacity() > raw_value.size() + 1048576) {
+                        std::string empty;
+                        std::swap(empty, saved_value_);
+                    }
+                    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+                    saved_value_.assign(raw_value.data(), raw_value.size());
+                }
+            }
+            iter_->Prev();
+        } while (iter_->Valid());
+    }
+
+    if (value_type == kTypeDeletion) {
+        // 到达了开头
+        valid_ = false;
+        saved_key_.clear();
+        ClearSavedValue();
+        direction_ = kForward;
+    } else {
+        valid_ = true;
+        if (value_type == kTypeBlobIndex) {
+            // saved_value_ 中是 blob 引用，替换为读取的 value
+            std::string blob_index;
+            std::swap(blob_index, saved_value_);
+            Status s = ReadBlob(blob_index, &saved_value_);
+            if (!s.IsOk() && blob_status_.IsOk()) {
+                blob_status_ = s;
+            }
+        }
+    }
+}
+
+void DBIter::Seek(const Slice& target) {
+    direction_ = kForward;
+    ClearSavedValue();
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_,
+                      ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+        FindNextUserEntry(false, &saved_key_ /* 临时存储 */);
+    } else {
+        valid_ = false;
+    }
+}
+
+void DBIter::SeekToFirst() {
+    direction_ = kForward;
+    ClearSavedValue();
+    iter_->SeekToFirst();
+    if (iter_->Valid()) {
+        FindNextUserEntry(false, &saved_key_ /* 临时存储 */);
+    } else {
+        valid_ = false;
+    }
+}
+
+void DBIter::SeekToLast() {
+    direction_ = kReverse;
+    ClearSavedValue();
+    iter_->SeekToLast();
+    FindPrevUserEntry();
+}
+
+}  // namespace
+
+Iterator* NewDBIterator(const Comparator* user_key_comparator,
+                        Iterator* internal_iter, SequenceNumber sequence,
+                        BlobFileCache* blob_cache,
+                        const ReadOptions& options) {
+    return new DBIter(user_key_comparator, internal_iter, sequence,
+                      blob_cache, options);
+}
+
+}  // namespace massdb
@@ -0,0 +1,28 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_DB_DB_ITER_H
+#define MASSDB_DB_DB_ITER_H
+
+#include "db/dbformat.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+
+namespace massdb {
+
+class BlobFileCache;
+
+// 返回一个新的迭代器，将 internal_iter 产生的 internal key
+// 转换为在序列号 sequence 时刻可见的 user key 和 value。
+// 同一个 user key 只返回最新的版本，被删除的 key 会被跳过。
+// 类型为 kTypeBlobIndex 的条目在第一次调用 value() 时
+// 按 options 从 blob_cache 中读取 value
+Iterator* NewDBIterator(const Comparator* user_key_comparator,
+                        Iterator* internal_iter, SequenceNumber sequence,
+                        BlobFileCache* blob_cache,
+                        const ReadOptions& options);
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_DB_ITER_H
@@ -0,0 +1,797 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "db/db_impl.h"
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "db/fragment_index.h"
+#include "gtest/gtest.h"
+#include "massdb/db.h"
+#include "massdb/cache.h"
+#include "massdb/comparator.h"
+#include "massdb/env.h"
+#include "massdb/filter_policy.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "massdb/spectrum.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+static std::string Key(int i) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "key%06d", i);
+    return std::string(buf);
+}
+
+// MultiRead() 使用 Env 的默认实现依次读取，
+// 相当于没有 io_uring 也没有读取线程的平台
+class SequentialReadEnv : public test::EnvWrapper {
+public:
+    explicit SequentialReadEnv(Env* target) : EnvWrapper(target) {}
+
+    void MultiRead(ReadRequest* requests, size_t n) override {
+        Env::MultiRead(requests, n);
+    }
+};
+
+// 统计 Schedule() 调用的次数
+class CountingScheduleEnv : public test::EnvWrapper {
+public:
+    explicit CountingScheduleEnv(Env* target) : EnvWrapper(target) {}
+
+    void Schedule(void (*function)(void* arg), void* arg) override {
+        schedules_.fetch_add(1);
+        EnvWrapper::Schedule(function, arg);
+    }
+
+    std::atomic<int> schedules_{0};
+};
+
+// 按字节比较，记录是否用 probe_ 作为参数比较过
+class RecordingComparator : public Comparator {
+public:
+    int Compare(const Slice& a, const Slice& b) const override {
+        if (a == Slice(probe_) || b == Slice(probe_)) {
+            saw_probe_.store(true);
+        }
+        return BytewiseComparator()->Compare(a, b);
+    }
+
+    const char* Name() const override {
+        return "massdb.test.RecordingComparator";
+    }
+
+    void FindShortestSeparator(std::string* start,
+                               const Slice& limit) const override {
+        BytewiseComparator()->FindShortestSeparator(start, limit);
+    }
+
+    void FindShortestSuccessor(std::string* key) const override {
+        BytewiseComparator()->FindShortestSuccessor(key);
+    }
+
+    std::string probe_;
+    mutable std::atomic<bool> saw_probe_{false};
+};
+
+class DBTest : public testing::Test {
+public:
+    DBTest()
+        : env_(Env::Default()),
+          dbname_(test::NewTestDirectory("db_test")),
+          db_(nullptr) {
+        options_.create_if_missing = true;
+        Reopen();
+    }
+
+    ~DBTest() override {
+        delete db_;
+        test::DestroyDirectory(env_, dbname_);
+    }
+
+    void Reopen() {
+        delete db_;
+        db_ = nullptr;
+        ASSERT_TRUE(DB::Open(options_, dbname_, &db_).IsOk());
+    }
+
+    void DestroyAndReopen() {
+        delete db_;
+        db_ = nullptr;
+        test::DestroyDirectory(env_, dbname_);
+        Reopen();
+    }
+
+    DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+    Status Put(const std::string& key, const std::string& value) {
+        return db_->Put(WriteOptions(), key, value);
+    }
+
+    Status Delete(const std::string& key) {
+        return db_->Delete(WriteOptions(), key);
+    }
+
+    std::string Get(const std::string& key,
+                    const Snapshot* snapshot = nullptr) {
+        ReadOptions options;
+        options.snapshot = snapshot;
+        std::string value;
+        Status s = db_->Get(options, key, &value);
+        if (s.IsNotFound()) {
+            return "NOT_FOUND";
+        } else if (!s.IsOk()) {
+            return s.ToString();
+        }
+        return value;
+    }
+
+    // 用 MultiGet() 查找 keys，结果的格式与 Get() 相同
+    std::vector<std::string> MultiGet(const std::vector<std::string>& keys,
+                                      const ReadOptions& options) {
+        std::vector<Slice> slices(keys.begin(), keys.end());
+        std::vector<std::string> values;
+        std::vector<Status> statuses = db_->MultiGet(options, slices, &values);
+        EXPECT_EQ(keys.size(), statuses.size());
+        EXPECT_EQ(keys.size(), values.size());
+        std::vector<std::string> result;
+        for (size_t i = 0; i < statuses.size(); i++) {
+            if (statuses[i].IsNotFound()) {
+                result.push_back("NOT_FOUND");
+            } else if (!statuses[i].IsOk()) {
+                result.push_back(statuses[i].ToString());
+            } else {
+                result.push_back(values[i]);
+            }
+        }
+        return result;
+    }
+
+    // 用迭代器读出所有条目
+    std::map<std::string, std::string> Contents(
+        const Snapshot* snapshot = nullptr) {
+        ReadOptions options;
+        options.snapshot = snapshot;
+        std::map<std::string, std::string> result;
+        Iterator* iter = db_->NewIterator(options);
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            result[iter->key().to_string()] = iter->value().to_string();
+        }
+        EXPECT_TRUE(iter->status().IsOk());
+        delete iter;
+        return result;
+    }
+
+    // 返回 user key 为 key 的所有 internal key 的数量，包括旧版本和删除标记
+    int CountVersions(const std::string& key) {
+        int count = 0;
+        Iterator* iter = dbfull()->TEST_NewInternalIterator();
+        InternalKey target(key, kMaxSequenceNumber, kValueTypeForSeek);
+        for (iter->Seek(target.Encode()); iter->Valid(); iter->Next()) {
+            if (ExtractUserKey(iter->key()) != Slice(key)) {
+                break;
+            }
+            count++;
+        }
+        EXPECT_TRUE(iter->status().IsOk());
+        delete iter;
+        return count;
+    }
+
+    // 返回数据库目录中所有 blob 文件的编号
+    std::set<uint64_t> BlobFiles() {
+        std::vector<std::string> children;
+        EXPECT_TRUE(env_->GetChildren(dbname_, &children).IsOk());
+        std::set<uint64_t> result;
+        for (const std::string& child : children) {
+            uint64_t number;
+            FileType type;
+            if (ParseFileName(child, &number, &type) && type == kBlobFile) {
+                result.insert(number);
+            }
+        }
+        return result;
+    }
+
+    // 把 MemTable 写入 table 文件，并补充覆盖所有测试 key 的第 0 层文件
+    // 触发至少一次压实，直到第 0 层的文件都被合并到更深的层
+    void CompactAll() {
+        ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+        bool compacted = false;
+        while (true) {
+            ASSERT_TRUE(dbfull()->TEST_WaitForBackgroundWork().IsOk());
+            const int files = dbfull()->TEST_NumLevelFiles(0);
+            if (files == 0 && compacted) {
+                break;
+            }
+            compacted = true;
+            for (int i = files; i < options_.level0_file_num_compaction_trigger;
+                 i++) {
+                ASSERT_TRUE(Put(Key(0), "filler").IsOk());
+                ASSERT_TRUE(Put(Key(1000), "filler").IsOk());
+                ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+            }
+        }
+    }
+
+    Env* const env_;
+    const std::string dbname_;
+    Options options_;
+    DB* db_;
+};
+
+TEST_F(DBTest, SnapshotReadsSurviveFlushAndCompaction) {
+    ASSERT_TRUE(Put(Key(1), "v1").IsOk());
+    const Snapshot* s1 = db_->GetSnapshot();
+    ASSERT_TRUE(Put(Key(1), "v2").IsOk());
+    ASSERT_TRUE(Put(Key(2), "w1").IsOk());
+    const Snapshot* s2 = db_->GetSnapshot();
+    ASSERT_TRUE(Delete(Key(1)).IsOk());
+    const Snapshot* s3 = db_->GetSnapshot();
+    ASSERT_TRUE(Put(Key(1), "v3").IsOk());
+
+    // MemTable、第 0 层文件和压实之后的文件中读到的结果相同
+    for (int phase = 0; phase < 3; phase++) {
+        if (phase == 1) {
+            ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+            ASSERT_GT(dbfull()->TEST_NumLevelFiles(0), 0);
+        } else if (phase == 2) {
+            CompactAll();
+        }
+        ASSERT_EQ("v1", Get(Key(1), s1));
+        ASSERT_EQ("NOT_FOUND", Get(Key(2), s1));
+        ASSERT_EQ("v2", Get(Key(1), s2));
+        ASSERT_EQ("w1", Get(Key(2), s2));
+        ASSERT_EQ("NOT_FOUND", Get(Key(1), s3));
+        ASSERT_EQ("v3", Get(Key(1)));
+
+        std::map<std::string, std::string> contents = Contents(s2);
+        ASSERT_EQ("v2", contents[Key(1)]);
+        ASSERT_EQ("w1", contents[Key(2)]);
+        ASSERT_EQ(0u, Contents(s3).count(Key(1)));
+    }
+
+    db_->ReleaseSnapshot(s1);
+    db_->ReleaseSnapshot(s2);
+    db_->ReleaseSnapshot(s3);
+}
+
+TEST_F(DBTest, CompactionKeepsOneVersionPerSnapshotStripe) {
+    std::vector<const Snapshot*> snapshots;
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(Put(Key(1), "v" + std::to_string(i)).IsOk());
+        if (i == 2 || i == 6) {
+            snapshots.push_back(db_->GetSnapshot());
+        }
+    }
+    ASSERT_TRUE(Put(Key(2), "x").IsOk());
+    ASSERT_TRUE(Delete(Key(2)).IsOk());
+    ASSERT_EQ(10, CountVersions(Key(1)));
+    ASSERT_EQ(2, CountVersions(Key(2)));
+
+    // 每个快照只需要它能看到的最新版本：v2、v6 和最新的 v9。
+    // 删除标记比最早的快照新，要保留，被它覆盖的值丢弃
+    CompactAll();
+    ASSERT_EQ(3, CountVersions(Key(1)));
+    ASSERT_EQ(1, CountVersions(Key(2)));
+    ASSERT_EQ("v2", Get(Key(1), snapshots[0]));
+    ASSERT_EQ("v6", Get(Key(1), snapshots[1]));
+    ASSERT_EQ("v9", Get(Key(1)));
+
+    // 释放快照之后，它所在的区间中的版本在下一次压实时丢弃
+    db_->ReleaseSnapshot(snapshots[0]);
+    CompactAll();
+    ASSERT_EQ(2, CountVersions(Key(1)));
+    ASSERT_EQ("v6", Get(Key(1), snapshots[1]));
+
+    // 没有快照之后，最深的层中的删除标记也被丢弃
+    db_->ReleaseSnapshot(snapshots[1]);
+    CompactAll();
+    ASSERT_EQ(1, CountVersions(Key(1)));
+    ASSERT_EQ(0, CountVersions(Key(2)));
+    ASSERT_EQ("v9", Get(Key(1)));
+}
+
+TEST_F(DBTest, SubcompactionsMatchSingleCompaction) {
+    // 写入四个重叠的第 0 层文件，每个约 1.5MB，
+    // 第四个文件触发一次把它们全部合并到第 1 层的压实
+    struct Config {
+        int max_subcompactions;
+        int max_background_jobs;
+    };
+    const Config kConfigs[] = {{1, 4}, {4, 4}, {4, 1}};
+    std::vector<std::vector<std::string>> outputs;
+    std::vector<int> schedules;
+    for (const Config& config : kConfigs) {
+        CountingScheduleEnv env(env_);
+        options_.env = &env;
+        options_.write_buffer_size = 64 << 20;
+        options_.max_file_size = 1 << 20;
+        options_.max_subcompactions = config.max_subcompactions;
+        options_.max_background_jobs = config.max_background_jobs;
+        DestroyAndReopen();
+
+        Random rnd(301);
+        const Snapshot* snapshot = nullptr;
+        for (int round = 0; round < 4; round++) {
+            for (int i = 0; i < 1500; i++) {
+                const int k = rnd.Uniform(3000);
+                if (rnd.OneIn(10)) {
+                    ASSERT_TRUE(Delete(Key(k)).IsOk());
+                } else {
+                    ASSERT_TRUE(Put(Key(k), test::RandomString(&rnd, 1000))
+                                    .IsOk());
+                }
+            }
+            if (round == 1) {
+                snapshot = db_->GetSnapshot();
+            }
+            ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+        }
+        ASSERT_TRUE(dbfull()->TEST_WaitForBackgroundWork().IsOk());
+        ASSERT_EQ(0, dbfull()->TEST_NumLevelFiles(0));
+        ASSERT_GT(dbfull()->TEST_NumLevelFiles(1), 1);
+
+        // 所有 internal key 和 value，包括快照需要的旧版本和删除标记
+        std::vector<std::string> output;
+        Iterator* iter = dbfull()->TEST_NewInternalIterator();
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            output.push_back(iter->key().to_string() + "=" +
+                             iter->value().to_string());
+        }
+        ASSERT_TRUE(iter->status().IsOk());
+        delete iter;
+        outputs.push_back(output);
+        schedules.push_back(env.schedules_.load());
+
+        db_->ReleaseSnapshot(snapshot);
+        delete db_;
+        db_ = nullptr;
+    }
+    ASSERT_EQ(outputs[0], outputs[1]);
+    ASSERT_EQ(outputs[0], outputs[2]);
+    // 拆分的压实在线程池中调度了 max_background_jobs - 1 个任务，
+    // 线程池只有一个线程时压实线程自己执行所有子压实
+    ASSERT_EQ(schedules[0] + 3, schedules[1]);
+    ASSERT_EQ(schedules[0], schedules[2]);
+
+    options_ = Options();
+    options_.create_if_missing = true;
+    Reopen();
+}
+
+TEST_F(DBTest, SnapshotIteratorIsStable) {
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(Put(Key(i), "old").IsOk());
+    }
+    const Snapshot* snapshot = db_->GetSnapshot();
+    const std::map<std::string, std::string> expected = Contents();
+
+    // 快照之后的覆盖、删除和新增，以及它们引起的 flush 和压实
+    Random rnd(301);
+    for (int i = 0; i < 2000; i++) {
+        const int k = rnd.Uniform(200);
+        if (rnd.OneIn(3)) {
+            ASSERT_TRUE(Delete(Key(k)).IsOk());
+        } else {
+            ASSERT_TRUE(Put(Key(k), test::RandomString(&rnd, 20)).IsOk());
+        }
+        if (i % 500 == 0) {
+            ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+        }
+    }
+    ASSERT_EQ(expected, Contents(snapshot));
+    CompactAll();
+    ASSERT_EQ(expected, Contents(snapshot));
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ("old", Get(Key(i), snapshot));
+    }
+    db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, MultiGetMatchesGet) {
+    SequentialReadEnv sequential_env(Env::Default());
+    const FilterPolicy* filter = NewBloomFilterPolicy(10);
+    Cache* cache = NewLRUCache(64 * 1024);
+    // 块很小，一次查找很多 key 时相邻的块合并读取，并且超过单次读取的上限
+    options_.block_size = 256;
+    options_.filter_policy = filter;
+    options_.block_cache = cache;
+    options_.min_blob_size = 512;
+
+    for (int config = 0; config < 4; config++) {
+        options_.env = (config & 1) ? &sequential_env : Env::Default();
+        options_.use_mmap_reads = (config & 2) != 0;
+        DestroyAndReopen();
+
+        // 覆盖、删除、分离到 blob 文件的大 value，分布在 MemTable、
+        // 第 0 层和更深的层中
+        Random rnd(301 + config);
+        const int kNumKeys = 3000;
+        const Snapshot* snapshot = nullptr;
+        for (int i = 0; i < 4 * kNumKeys; i++) {
+            const std::string key = Key(rnd.Uniform(kNumKeys));
+            if (rnd.OneIn(8)) {
+                ASSERT_TRUE(Delete(key).IsOk());
+            } else {
+                const int len = rnd.OneIn(10) ? 1000 : 10 + rnd.Uniform(300);
+                ASSERT_TRUE(Put(key, test::RandomString(&rnd, len)).IsOk());
+            }
+            if (i == 2 * kNumKeys) {
+                snapshot = db_->GetSnapshot();
+            }
+            if (i % kNumKeys == kNumKeys - 1) {
+                CompactAll();
+            } else if (i % 1000 == 999) {
+                ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+            }
+        }
+
+        for (int round = 0; round < 20; round++) {
+            // 随机的一组不重复的 key，包括从未写入的 key（一般被过滤器排除）
+            // 和范围之外的 key。最后一轮查找所有的 key
+            std::vector<std::string> keys;
+            for (int i = 0; i < kNumKeys + 100; i++) {
+                if (round == 19 || rnd.OneIn(20)) {
+                    keys.push_back(Key(i));
+                }
+            }
+            keys.push_back("zzz");
+            for (int s = 0; s < 2; s++) {
+                ReadOptions options;
+                options.snapshot = (s == 1) ? snapshot : nullptr;
+                // 不填充块缓存，每一轮都要从文件读取
+                options.fill_cache = (round % 2 == 0);
+                // 先调用 MultiGet()，读取的块不会已经由 Get() 放入缓存
+                const std::vector<std::string> actual = MultiGet(keys, options);
+                std::vector<std::string> expected;
+                for (const std::string& key : keys) {
+                    expected.push_back(Get(key, options.snapshot));
+                }
+                ASSERT_EQ(expected, actual)
+                    << "config " << config << " round " << round;
+            }
+        }
+        db_->ReleaseSnapshot(snapshot);
+    }
+
+    delete db_;
+    db_ = nullptr;
+    delete cache;
+    delete filter;
+}
+
+TEST_F(DBTest, BlobValuesSurviveGarbageCollection) {
+    options_.min_blob_size = 1024;
+    options_.blob_gc_garbage_ratio = 0.5;
+    DestroyAndReopen();
+
+    // 检查 Get()、MultiGet() 和迭代器读到的结果都与 model 一致，
+    // 其中的 key 不包括 CompactAll() 写入的 Key(0) 和 Key(1000)
+    const int kNumKeys = 400;
+    auto check = [this](const std::map<std::string, std::string>& model,
+                        const Snapshot* snapshot) {
+        std::vector<std::string> keys;
+        std::vector<std::string> expected;
+        for (int i = 1; i <= kNumKeys; i++) {
+            auto it = model.find(Key(i));
+            keys.push_back(Key(i));
+            expected.push_back(it == model.end() ? "NOT_FOUND" : it->second);
+            ASSERT_EQ(expected.back(), Get(Key(i), snapshot)) << Key(i);
+        }
+        ReadOptions options;
+        options.snapshot = snapshot;
+        options.verify_checksums = true;
+        ASSERT_EQ(expected, MultiGet(keys, options));
+        std::map<std::string, std::string> contents = Contents(snapshot);
+        contents.erase(Key(0));
+        contents.erase(Key(1000));
+        ASSERT_EQ(model, contents);
+    };
+
+    // 长度正好是 min_blob_size 的 value 也分离到 blob 文件中
+    std::map<std::string, std::string> model;
+    Random rnd(301);
+    for (int i = 1; i <= kNumKeys; i++) {
+        const int len = (i % 4 == 0) ? 1023 : (i % 4 == 1) ? 1024
+                                                           : 1024 + rnd.Uniform(4096);
+        model[Key(i)] = test::RandomString(&rnd, len);
+        ASSERT_TRUE(Put(Key(i), model[Key(i)]).IsOk());
+    }
+    CompactAll();
+    Iterator* iter = dbfull()->TEST_NewInternalIterator();
+    int blob_indexes = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ParsedInternalKey ikey;
+        ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+        auto it = model.find(ikey.user_key.to_string());
+        if (it == model.end()) {
+            continue;
+        }
+        const bool separated = it->second.size() >= options_.min_blob_size;
+        ASSERT_EQ(separated ? kTypeBlobIndex : kTypeValue, ikey.type)
+            << it->first;
+        ASSERT_LT(iter->value().size(), options_.min_blob_size);
+        blob_indexes += separated ? 1 : 0;
+    }
+    ASSERT_TRUE(iter->status().IsOk());
+    delete iter;
+    ASSERT_EQ(kNumKeys / 4 * 3, blob_indexes);
+    const std::set<uint64_t> old_blob_files = BlobFiles();
+    ASSERT_FALSE(old_blob_files.empty());
+    check(model, nullptr);
+
+    // 覆盖或删除四分之三的大 value。快照仍然引用旧的 blob 文件
+    const Snapshot* snapshot = db_->GetSnapshot();
+    const std::map<std::string, std::string> old_model = model;
+    for (int i = 1; i <= kNumKeys; i++) {
+        if (i % 4 == 0 || i % 4 == 1) {
+            continue;
+        }
+        if (rnd.OneIn(8)) {
+            ASSERT_TRUE(Delete(Key(i)).IsOk());
+            model.erase(Key(i));
+        } else {
+            model[Key(i)] = test::RandomString(&rnd, 2048);
+            ASSERT_TRUE(Put(Key(i), model[Key(i)]).IsOk());
+        }
+    }
+    CompactAll();
+    check(model, nullptr);
+    check(old_model, snapshot);
+    for (uint64_t number : old_blob_files) {
+        ASSERT_EQ(1u, BlobFiles().count(number));
+    }
+
+    // 释放快照后，第一次压实丢弃旧版本，旧 blob 文件中的失效数据超过一半；
+    // 第二次压实把其余的 value 搬到新文件中，旧文件被删除
+    db_->ReleaseSnapshot(snapshot);
+    CompactAll();
+    CompactAll();
+    const std::set<uint64_t> new_blob_files = BlobFiles();
+    ASSERT_FALSE(new_blob_files.empty());
+    for (uint64_t number : old_blob_files) {
+        ASSERT_EQ(0u, new_blob_files.count(number)) << number;
+    }
+    check(model, nullptr);
+
+    // 重新打开后 MANIFEST 中记录的 blob 文件与目录中的一致
+    Reopen();
+    ASSERT_EQ(new_blob_files, BlobFiles());
+    check(model, nullptr);
+}
+
+TEST_F(DBTest, BlobGarbageCollectedWithoutManualCompaction) {
+    options_.min_blob_size = 1024;
+    options_.blob_gc_garbage_ratio = 0.5;
+    options_.write_buffer_size = 100 << 10;
+    DestroyAndReopen();
+
+    // 只有写入，MemTable 写满后自动刷写，第 0 层的文件数达到阈值后自动压实
+    const int kNumKeys = 400;
+    std::map<std::string, std::string> model;
+    Random rnd(301);
+    for (int i = 0; i < kNumKeys; i++) {
+        model[Key(i)] = test::RandomString(&rnd, 2048);
+        ASSERT_TRUE(Put(Key(i), model[Key(i)]).IsOk());
+    }
+    ASSERT_TRUE(dbfull()->TEST_WaitForBackgroundWork().IsOk());
+    const std::set<uint64_t> old_blob_files = BlobFiles();
+    ASSERT_FALSE(old_blob_files.empty());
+
+    // 覆盖四分之三的 key，再写入同样多的新 key，把覆盖的版本推到第 1 层。
+    // 合并新旧版本的压实丢弃旧的 value，
+    // 剩下的 value 所在的 table 由后台选中重写，旧 blob 文件被删除
+    for (int i = 0; i < kNumKeys; i++) {
+        if (i % 4 != 0) {
+            model[Key(i)] = test::RandomString(&rnd, 2048);
+            ASSERT_TRUE(Put(Key(i), model[Key(i)]).IsOk());
+        }
+    }
+    for (int i = kNumKeys; i < 2 * kNumKeys; i++) {
+        model[Key(i)] = test::RandomString(&rnd, 2048);
+        ASSERT_TRUE(Put(Key(i), model[Key(i)]).IsOk());
+    }
+    ASSERT_TRUE(dbfull()->TEST_WaitForBackgroundWork().IsOk());
+    const std::set<uint64_t> new_blob_files = BlobFiles();
+    for (uint64_t number : old_blob_files) {
+        ASSERT_EQ(0u, new_blob_files.count(number)) << number;
+    }
+    ASSERT_EQ(model, Contents());
+
+    // 重新打开时 MemTable 写入新的 blob 文件，之前的都保留
+    Reopen();
+    const std::set<uint64_t> reopened_blob_files = BlobFiles();
+    for (uint64_t number : new_blob_files) {
+        ASSERT_EQ(1u, reopened_blob_files.count(number)) << number;
+    }
+    for (uint64_t number : old_blob_files) {
+        ASSERT_EQ(0u, reopened_blob_files.count(number)) << number;
+    }
+    ASSERT_EQ(model, Contents());
+}
+
+TEST_F(DBTest, SearchFragmentsMatchesScan) {
+    const double kBinWidth = 1.0;
+    options_.fragment_index_bin_width = kBinWidth;
+    options_.min_blob_size = 400;
+    DestroyAndReopen();
+
+    // 随机的峰列表，m/z 在 [100, 400) 中，每个箱被很多谱图共有，
+    // posting list 有多个块。common 为 true 时都有 m/z 为 50 的峰，
+    // 编号连续的谱图共有这个箱
+    Random rnd(301);
+    auto spectrum = [&rnd](bool common) {
+        std::vector<double> mz;
+        std::vector<float> intensity;
+        if (common) {
+            mz.push_back(50.0);
+            intensity.push_back(1.0f);
+        }
+        const int n = 5 + rnd.Uniform(40);
+        for (int i = 0; i < n; i++) {
+            mz.push_back(100.0 + rnd.Uniform(300000) / 1000.0);
+            intensity.push_back(static_cast<float>(rnd.Uniform(1000)));
+        }
+        std::sort(mz.begin(), mz.end());
+        std::string value;
+        EncodePeakList(mz.data(), intensity.data(), mz.size(), &value);
+        return value;
+    };
+    auto check = [&](const char* state) {
+        const std::map<std::string, std::string> contents = Contents();
+        for (int q = 0; q < 30; q++) {
+            const std::string query = spectrum(q % 3 == 0);
+            const uint32_t min_shared = q == 0 ? 1 : 1 + rnd.Uniform(6);
+            std::vector<FragmentMatch> results;
+            ASSERT_TRUE(db_->SearchFragments(ReadOptions(), query, min_shared,
+                                             &results)
+                            .IsOk());
+
+            std::vector<int32_t> query_bins, bins;
+            ASSERT_TRUE(GetPeakBins(query, kBinWidth, &query_bins));
+            std::vector<std::pair<uint32_t, std::string>> expected;
+            for (const auto& kv : contents) {
+                if (!GetPeakBins(kv.second, kBinWidth, &bins)) continue;
+                const uint32_t shared = CountSharedBins(query_bins, bins);
+                if (shared >= min_shared) {
+                    expected.emplace_back(shared, kv.first);
+                }
+            }
+            std::stable_sort(expected.begin(), expected.end(),
+                             [](const std::pair<uint32_t, std::string>& a,
+                                const std::pair<uint32_t, std::string>& b) {
+                                 return a.first > b.first;
+                             });
+            std::vector<std::pair<uint32_t, std::string>> actual;
+            for (const FragmentMatch& match : results) {
+                actual.emplace_back(match.shared_peaks, match.key);
+            }
+            ASSERT_EQ(expected, actual) << state << " query " << q;
+        }
+    };
+    auto index_files = [this]() {
+        std::vector<std::string> children;
+        EXPECT_TRUE(env_->GetChildren(dbname_, &children).IsOk());
+        int result = 0;
+        for (const std::string& child : children) {
+            uint64_t number;
+            FileType type;
+            if (ParseFileName(child, &number, &type) &&
+                type == kFragmentIndexFile) {
+                result++;
+            }
+        }
+        return result;
+    };
+
+    // 第一批写入 table 文件，第二批覆盖、删除一部分并留在 MemTable 中。
+    // 较大的 value 分离到 blob 文件中，还有不是峰列表的 value
+    const int kNumKeys = 2000;
+    for (int i = 1; i <= kNumKeys; i++) {
+        ASSERT_TRUE(
+            Put(Key(i), i % 50 == 0 ? "not a spectrum" : spectrum(i < 1500))
+                .IsOk());
+    }
+    check("memtable");
+    ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+    ASSERT_GT(index_files(), 0);
+    for (int i = 1; i <= kNumKeys; i += 1 + rnd.Uniform(8)) {
+        if (rnd.OneIn(4)) {
+            ASSERT_TRUE(Delete(Key(i)).IsOk());
+        } else {
+            ASSERT_TRUE(Put(Key(i), spectrum(rnd.OneIn(2))).IsOk());
+        }
+    }
+    check("memtable and table");
+
+    CompactAll();
+    ASSERT_EQ(0, dbfull()->TEST_NumLevelFiles(0));
+    check("compacted");
+
+    // 重新打开后从文件中读取索引
+    Reopen();
+    check("reopened");
+}
+
+TEST_F(DBTest, RangeQueryMatchesScan) {
+    RecordingComparator recording;
+    const Comparator* comparators[] = {BytewiseComparator(),
+                                       SpectrumKeyComparator(), &recording};
+    for (const Comparator* cmp : comparators) {
+        options_.comparator = cmp;
+        DestroyAndReopen();
+
+        // 谱图分布在 MemTable 和 table 文件中，有相同的 precursor m/z、
+        // 被删除的谱图，以及不是谱图 key 的条目
+        Random rnd(301);
+        ASSERT_TRUE(Put("meta", "v").IsOk());
+        ASSERT_TRUE(Put("\xff\xff", "v").IsOk());
+        std::vector<std::string> keys;
+        for (int i = 0; i < 3000; i++) {
+            const double mz = 100.0 + rnd.Uniform(100000) / 1000.0;
+            std::string key;
+            EncodeSpectrumKey(mz, 1 + rnd.Uniform(4), rnd.Uniform(1000), &key);
+            keys.push_back(key);
+            ASSERT_TRUE(Put(key, "v").IsOk());
+            if (i == 1500) {
+                ASSERT_TRUE(dbfull()->TEST_CompactMemTable().IsOk());
+            }
+        }
+        for (int i = 0; i < 300; i++) {
+            ASSERT_TRUE(Delete(keys[rnd.Uniform(3000)]).IsOk());
+        }
+
+        for (int q = 0; q < 100; q++) {
+            const double mz = 95.0 + rnd.Uniform(110000) / 1000.0;
+            const double ppm = (q == 0) ? 0 : 1 + rnd.Uniform(200);
+            std::string lower, upper;
+            PrecursorMzRange(mz, ppm, &lower, &upper);
+            recording.probe_ = upper;
+            recording.saw_probe_.store(false);
+
+            std::vector<std::string> actual;
+            Iterator* iter = db_->RangeQuery(ReadOptions(), mz, ppm);
+            for (; iter->Valid(); iter->Next()) {
+                actual.push_back(iter->key().to_string());
+            }
+            ASSERT_TRUE(iter->status().IsOk());
+            delete iter;
+
+            const double delta = std::fabs(mz * ppm) * 1e-6;
+            std::vector<std::string> expected;
+            for (const auto& kv : Contents()) {
+                double m;
+                int charge;
+                uint64_t scan;
+                if (DecodeSpectrumKey(kv.first, &m, &charge, &scan) &&
+                    m >= mz - delta && m <= mz + delta) {
+                    expected.push_back(kv.first);
+                }
+            }
+            ASSERT_EQ(expected, actual) << cmp->Name() << " query " << q;
+
+            // 范围的上界由数据库的比较器判断
+            if (cmp == &recording && !actual.empty()) {
+                ASSERT_TRUE(recording.saw_probe_.load());
+            }
+        }
+    }
+
+    delete db_;
+    db_ = nullptr;
+}
+
+}  // namespace massdb
@@ -0,0 +1,140 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#include "db/dbformat.h"
+
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+namespace massdb {
+
+void AppendInternalKey(std::string* result, const ParsedInternalKey& key) {
+    result->append(key.user_key.data(), key.user_key.size());
+    PutFixed64(result, PackSequenceAndType(key.sequence, key.type));
+}
+
+std::string ParsedInternalKey::DebugString() const {
+    std::ostringstream ss;
+    ss << '\'' << user_key.to_string() << "' @ " << sequence << " : "
+       << static_cast<int>(type);
+    return ss.str();
+}
+
+std::string InternalKey::DebugString() const {
+    ParsedInternalKey parsed;
+    if (ParseInternalKey(rep_, &parsed)) {
+        return parsed.DebugString();
+    }
+    std::ostringstream ss;
+    ss << "(bad)" << rep_;
+    return ss.str();
+}
+
+const char* InternalKeyComparator::Name() const {
+    return "massdb.InternalKeyComparator";
+}
+
+InternalKeyComparator::InternalKeyComparator(const Comparator* c)
+    : user_comparator_(c), user_key_kind_(kOtherUserKey) {
+    if (c == BytewiseComparator()) {
+        user_key_kind_ = kBytewiseUserKey;
+    } else if (c == SpectrumKeyComparator()) {
+        user_key_kind_ = kSpectrumUserKey;
+    }
+}
+
+int InternalKeyComparator::Compare(const Slice& akey, const Slice& bkey) const {
+    return CompareKeys(akey, bkey);
+}
+
+InternalKeyComparator::UserKeyKind GetUserKeyKind(const Comparator* cmp) {
+    const InternalKeyComparator* icmp =
+        dynamic_cast<const InternalKeyComparator*>(cmp);
+    if (icmp == nullptr) {
+        return InternalKeyComparator::kOtherUserKey;
+    }
+    return icmp->user_key_kind();
+}
+
+void InternalKeyComparator::FindShortestSeparator(std::string* start,
+                                                  const Slice& limit) const {
+    // 尝试缩短 key 中 user key 的部分
+    Slice user_start = ExtractUserKey(*start);
+    Slice user_limit = ExtractUserKey(limit);
+    std::string tmp(user_start.data(), user_start.size());
+    user_comparator_->FindShortestSeparator(&tmp, user_limit);
+    if (tmp.size() < user_start.size() &&
+        user_comparator_->Compare(user_start, tmp) < 0) {
+        // user key 在物理上变短了，但逻辑上变大了。
+        // 追加最大的 tag，使其排在所有相同 user key 之前
+        PutFixed64(&tmp,
+                   PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek));
+        assert(this->Compare(*start, tmp) < 0);
+        assert(this->Compare(tmp, limit) < 0);
+        start->swap(tmp);
+    }
+}
+
+void InternalKeyComparator::FindShortestSuccessor(std::string* key) const {
+    Slice user_key = ExtractUserKey(*key);
+    std::string tmp(user_key.data(), user_key.size());
+    user_comparator_->FindShortestSuccessor(&tmp);
+    if (tmp.size() < user_key.size() &&
+        user_comparator_->Compare(user_key, tmp) < 0) {
+        PutFixed64(&tmp,
+                   PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek));
+        assert(this->Compare(*key, tmp) < 0);
+        key->swap(tmp);
+    }
+}
+
+const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
+
+void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
+                                        std::string* dst) const {
+    // 就地把 keys 中的 internal key 替换为 user key。
+    // 调用者（FilterBlockBuilder）不会再使用这些 Slice，所以可以修改
+    Slice* mkey = const_cast<Slice*>(keys);
+    for (int i = 0; i < n; i++) {
+        mkey[i] = ExtractUserKey(keys[i]);
+    }
+    user_policy_->CreateFilter(keys, n, dst);
+}
+
+bool InternalFilterPolicy::KeyMayMatch(const Slice& key,
+                                       const Slice& filter) const {
+    return user_policy_->KeyMayMatch(ExtractUserKey(key), filter);
+}
+
+void InternalFilterPolicy::KeysMayMatch(const Slice* keys, int n,
+                                        const Slice& filter,
+                                        bool* results) const {
+    std::vector<Slice> user_keys(n);
+    for (int i = 0; i < n; i++) {
+        user_keys[i] = ExtractUserKey(keys[i]);
+    }
+    user_policy_->KeysMayMatch(user_keys.data(), n, filter, results);
+}
+
+LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
+    size_t usize = user_key.size();
+    size_t needed = usize + 13;  // 保守估计：varint32 最多 5 字节，tag 8 字节
+    char* dst;
+    if (needed <= sizeof(space_)) {
+        dst = space_;
+    } else {
+        dst = new char[needed];
+    }
+    start_ = dst;
+    dst = EncodeVarint32(dst, usize + 8);
+    kstart_ = dst;
+    std::memcpy(dst, user_key.data(), usize);
+    dst += usize;
+    EncodeFixed64(dst, PackSequenceAndType(s, kValueTypeForSeek));
+    dst += 8;
+    end_ = dst;
+}
+
+}  // namespace massdb
@@ -0,0 +1,262 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#ifndef MASSDB_DB_DBFORMAT_H
+#define MASSDB_DB_DBFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "massdb/comparator.h"
+#include "massdb/filter_policy.h"
+#include "massdb/slice.h"
+#include "util/coding.h"
+#include "util/key_compare.h"
+
+namespace massdb {
+
+// 不能修改的常量，修改后无法打开已有的数据库
+namespace config {
+// 层的数量
+static const int kNumLevels = 7;
+}  // namespace config
+
+// ValueType 会被编码到 internal key 的最后一个字节中。
+// 注意：不要更改现有条目的值，因为这些值是磁盘上持久格式的一部分。
+// kTypeBlobIndex 只出现在 table 文件中，value 是指向 blob 文件的引用，
+// 见 db/blob_file.h
+enum ValueType {
+    kTypeDeletion = 0x0,
+    kTypeValue = 0x1,
+    kTypeBlobIndex = 0x2,
+};
+
+// kValueTypeForSeek 定义了构造用于查找的 ParsedInternalKey 时使用的 ValueType。
+// 因为相同的 user key 按序列号降序、再按类型降序排列，
+// 所以查找时应使用数值最大的 ValueType
+static const ValueType kValueTypeForSeek = kTypeBlobIndex;
+
+typedef uint64_t SequenceNumber;
+
+// 序列号只占用低 56 位，剩下的 8 位留给 ValueType，
+// 这样两者可以一起打包进一个 64 位整数中
+static const SequenceNumber kMaxSequenceNumber = ((0x1ull << 56) - 1);
+
+// internal key 的格式：
+//    user_key       : char[user_key.size()]
+//    sequence       : 56 bits
+//    type           : 8 bits
+// 后两者以 (sequence << 8 | type) 的形式编码为一个 fixed64
+struct ParsedInternalKey {
+    Slice user_key;
+    SequenceNumber sequence;
+    ValueType type;
+
+    ParsedInternalKey() {}  // 故意不初始化（为了速度）
+    ParsedInternalKey(const Slice& u, const SequenceNumber& seq, ValueType t)
+        : user_key(u), sequence(seq), type(t) {}
+    std::string DebugString() const;
+};
+
+// 返回 key 编码成 internal key 之后的长度
+inline size_t InternalKeyEncodingLength(const ParsedInternalKey& key) {
+    return key.user_key.size() + 8;
+}
+
+// 将 sequence 和 type 打包成一个 64 位整数
+inline uint64_t PackSequenceAndType(uint64_t seq, ValueType t) {
+    assert(seq <= kMaxSequenceNumber);
+    assert(t <= kValueTypeForSeek);
+    return (seq << 8) | t;
+}
+
+// 将 key 的序列化结果追加到 result 中
+void AppendInternalKey(std::string* result, const ParsedInternalKey& key);
+
+// 尝试从 internal_key 中解析出 user key、序列号和类型。
+// 成功时将结果存入 result 并返回 true，否则返回 false
+bool ParseInternalKey(const Slice& internal_key, ParsedInternalKey* result);
+
+// 返回 internal key 中的 user key 部分
+inline Slice ExtractUserKey(const Slice& internal_key) {
+    assert(internal_key.size() >= 8);
+    return Slice(internal_key.data(), internal_key.size() - 8);
+}
+
+// 用 user key 的比较函数 ucmp 比较两个 internal key：
+// 先按 user key 升序排列，user key 相同时按序列号降序排列
+template <typename UserKeyCompare>
+inline int CompareInternalKey(const UserKeyCompare& ucmp, const Slice& a,
+                              const Slice& b) {
+    int r = ucmp(ExtractUserKey(a), ExtractUserKey(b));
+    if (r == 0) {
+        const uint64_t anum = DecodeFixed64(a.data() + a.size() - 8);
+        const uint64_t bnum = DecodeFixed64(b.data() + b.size() - 8);
+        if (anum > bnum) {
+            r = -1;
+        } else if (anum < bnum) {
+            r = +1;
+        }
+    }
+    return r;
+}
+
+// 比较 internal key 的比较器。
+// 先按 user key 升序排列，user key 相同时按序列号降序排列，
+// 这样同一个 user key 最新的版本总是排在最前面
+class InternalKeyComparator : public Comparator {
+public:
+    // user comparator 的类型。已知的类型可以使用编译期特化的比较函数
+    enum UserKeyKind {
+        kOtherUserKey,     // 只能通过虚函数比较
+        kBytewiseUserKey,  // BytewiseComparator()
+        kSpectrumUserKey,  // SpectrumKeyComparator()
+    };
+
+    explicit InternalKeyComparator(const Comparator* c);
+
+    const char* Name() const override;
+    int Compare(const Slice& a, const Slice& b) const override;
+    void FindShortestSeparator(std::string* start,
+                               const Slice& limit) const override;
+    void FindShortestSuccessor(std::string* key) const override;
+
+    const Comparator* user_comparator() const { return user_comparator_; }
+    UserKeyKind user_key_kind() const { return user_key_kind_; }
+
+    // 与 Compare() 相同，但不是虚函数，可以在调用处内联。
+    // 每次调用只有一个固定的分支，不再通过虚函数比较 user key
+    int CompareKeys(const Slice& a, const Slice& b) const {
+        switch (user_key_kind_) {
+            case kBytewiseUserKey:
+                return CompareInternalKey(BytewiseKeyCompare(), a, b);
+            case kSpectrumUserKey:
+                return CompareInternalKey(SpectrumKeyCompare(), a, b);
+            default:
+                return CompareInternalKey(VirtualKeyCompare(user_comparator_),
+                                          a, b);
+        }
+    }
+
+private:
+    const Comparator* user_comparator_;
+    UserKeyKind user_key_kind_;
+};
+
+// 比较 internal key 的函数对象，user key 使用 UserKeyCompare 比较
+template <typename UserKeyCompare>
+struct InternalKeyCompare {
+    int operator()(const Slice& a, const Slice& b) const {
+        return CompareInternalKey(UserKeyCompare(), a, b);
+    }
+};
+
+// 如果 cmp 是 InternalKeyComparator，返回它的 user key 类型，
+// 否则返回 kOtherUserKey。
+// 块迭代器和归并迭代器据此选择编译期特化的比较函数
+InternalKeyComparator::UserKeyKind GetUserKeyKind(const Comparator* cmp);
+
+// 过滤器策略的封装，将 internal key 转换为 user key 之后交给用户的策略
+class InternalFilterPolicy : public FilterPolicy {
+public:
+    explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) {}
+
+    const char* Name() const override;
+    void CreateFilter(const Slice* keys, int n,
+                      std::string* dst) const override;
+    bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
+    void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                      bool* results) const override;
+
+private:
+    const FilterPolicy* const user_policy_;
+};
+
+// internal key 的封装，避免误把 internal key 当作 user key 使用
+class InternalKey {
+public:
+    InternalKey() {}  // 空的 InternalKey 是无效的
+    InternalKey(const Slice& user_key, SequenceNumber s, ValueType t) {
+        AppendInternalKey(&rep_, ParsedInternalKey(user_key, s, t));
+    }
+
+    bool DecodeFrom(const Slice& s) {
+        rep_.assign(s.data(), s.size());
+        return !rep_.empty();
+    }
+
+    Slice Encode() const {
+        assert(!rep_.empty());
+        return rep_;
+    }
+
+    Slice user_key() const { return ExtractUserKey(rep_); }
+
+    void SetFrom(const ParsedInternalKey& p) {
+        rep_.clear();
+        AppendInternalKey(&rep_, p);
+    }
+
+    void Clear() { rep_.clear(); }
+
+    std::string DebugString() const;
+
+private:
+    std::string rep_;
+};
+
+inline bool ParseInternalKey(const Slice& internal_key,
+                             ParsedInternalKey* result) {
+    const size_t n = internal_key.size();
+    if (n < 8) return false;
+    uint64_t num = DecodeFixed64(internal_key.data() + n - 8);
+    uint8_t c = num & 0xff;
+    result->sequence = num >> 8;
+    result->type = static_cast<ValueType>(c);
+    result->user_key = Slice(internal_key.data(), n - 8);
+    return (c <= static_cast<uint8_t>(kTypeBlobIndex));
+}
+
+// 用于 DBImpl::Get() 的辅助类。
+// 一次性构造出 MemTable 查找所需的 key（带长度前缀的 internal key）
+class LookupKey {
+public:
+    // 用于在快照 sequence 下查找 user_key
+    LookupKey(const Slice& user_key, SequenceNumber sequence);
+
+    LookupKey(const LookupKey&) = delete;
+    LookupKey& operator=(const LookupKey&) = delete;
+
+    ~LookupKey();
+
+    // 返回适合在 MemTable 中查找的 key
+    Slice memtable_key() const { return Slice(start_, end_ - start_); }
+
+    // 返回 internal key（适合传给内部迭代器）
+    Slice internal_key() const { return Slice(kstart_, end_ - kstart_); }
+
+    // 返回 user key
+    Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
+
+private:
+    // 构造的 key 格式如下：
+    //    klength  varint32               <-- start_
+    //    userkey  char[klength]          <-- kstart_
+    //    tag      uint64
+    //                                    <-- end_
+    // 数组足够容纳绝大多数较短的 key
+    const char* start_;
+    const char* kstart_;
+    const char* end_;
+    char space_[200];  // 避免为短 key 分配内存
+};
+
+inline LookupKey::~LookupKey() {
+    if (start_ != space_) delete[] start_;
+}
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_DBFORMAT_H
@@ -0,0 +1,157 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "db/filename.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "massdb/env.h"
+#include "massdb/slice.h"
+
+namespace massdb {
+
+static std::string MakeFileName(const std::string& dbname, uint64_t number,
+                                const char* suffix) {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "/%06llu.%s",
+                  static_cast<unsigned long long>(number), suffix);
+    return dbname + buf;
+}
+
+std::string LogFileName(const std::string& dbname, uint64_t number) {
+    assert(number > 0);
+    return MakeFileName(dbname, number, "log");
+}
+
+std::string TableFileName(const std::string& dbname, uint64_t number) {
+    assert(number > 0);
+    return MakeFileName(dbname, number, "sst");
+}
+
+std::string FragmentIndexFileName(const std::string& dbname, uint64_t number) {
+    assert(number > 0);
+    return MakeFileName(dbname, number, "fidx");
+}
+
+std::string BlobFileName(const std::string& dbname, uint64_t number) {
+    assert(number > 0);
+    return MakeFileName(dbname, number, "blob");
+}
+
+std::string DescriptorFileName(const std::string& dbname, uint64_t number) {
+    assert(number > 0);
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "/MANIFEST-%06llu",
+                  static_cast<unsigned long long>(number));
+    return dbname + buf;
+}
+
+std::string CurrentFileName(const std::string& dbname) {
+    return dbname + "/CURRENT";
+}
+
+std::string LockFileName(const std::string& dbname) { return dbname + "/LOCK"; }
+
+std::string TempFileName(const std::string& dbname, uint64_t number) {
+    assert(number > 0);
+    return MakeFileName(dbname, number, "dbtmp");
+}
+
+// 解析 in 开头的十进制数字并存入 *val，同时从 in 中移除已经解析的部分。
+// 溢出或者没有数字时返回 false
+static bool ConsumeDecimalNumber(Slice* in, uint64_t* val) {
+    const uint64_t kMaxUint64 = ~static_cast<uint64_t>(0);
+    const uint64_t kLastDigitOfMaxUint64 = kMaxUint64 % 10;
+
+    uint64_t value = 0;
+    size_t digits = 0;
+    while (digits < in->size()) {
+        const char ch = (*in)[digits];
+        if (ch < '0' || ch > '9') {
+            break;
+        }
+        const uint64_t digit = static_cast<uint64_t>(ch - '0');
+        // 检查 value * 10 + digit 是否溢出
+        if (value > kMaxUint64 / 10 ||
+            (value == kMaxUint64 / 10 && digit > kLastDigitOfMaxUint64)) {
+            return false;
+        }
+        value = value * 10 + digit;
+        digits++;
+    }
+    *val = value;
+    in->remove_prefix(digits);
+    return digits != 0;
+}
+
+// 数据库目录下的文件名：
+//    dbname/CURRENT
+//    dbname/LOCK
+//    dbname/MANIFEST-[0-9]+
+//    dbname/[0-9]+.(log|sst|dbtmp|fidx|blob)
+bool ParseFileName(const std::string& filename, uint64_t* number,
+                   FileType* type) {
+    Slice rest(filename);
+    if (rest == "CURRENT") {
+        *number = 0;
+        *type = kCurrentFile;
+    } else if (rest == "LOCK") {
+        *number = 0;
+        *type = kDBLockFile;
+    } else if (rest.starts_with("MANIFEST-")) {
+        rest.remove_prefix(strlen("MANIFEST-"));
+        uint64_t num;
+        if (!ConsumeDecimalNumber(&rest, &num)) {
+            return false;
+        }
+        if (!rest.empty()) {
+            return false;
+        }
+        *type = kDescriptorFile;
+        *number = num;
+    } else {
+        uint64_t num;
+        if (!ConsumeDecimalNumber(&rest, &num)) {
+            return false;
+        }
+        Slice suffix = rest;
+        if (suffix == Slice(".log")) {
+            *type = kLogFile;
+        } else if (suffix == Slice(".sst")) {
+            *type = kTableFile;
+        } else if (suffix == Slice(".dbtmp")) {
+            *type = kTempFile;
+        } else if (suffix == Slice(".fidx")) {
+            *type = kFragmentIndexFile;
+        } else if (suffix == Slice(".blob")) {
+            *type = kBlobFile;
+        } else {
+            return false;
+        }
+        *number = num;
+    }
+    return true;
+}
+
+Status SetCurrentFile(Env* env, const std::string& dbname,
+                      uint64_t descriptor_number) {
+    // CURRENT 中保存的是不含目录的文件名
+    std::string manifest = DescriptorFileName(dbname, descriptor_number);
+    Slice contents = manifest;
+    assert(contents.starts_with(dbname + "/"));
+    contents.remove_prefix(dbname.size() + 1);
+    std::string tmp = TempFileName(dbname, descriptor_number);
+    Status s = WriteStringToFileSync(env, contents.to_string() + "\n", tmp);
+    if (s.IsOk()) {
+        s = env->RenameFile(tmp, CurrentFileName(dbname));
+    }
+    if (!s.IsOk()) {
+        env->RemoveFile(tmp);
+    }
+    return s;
+}
+
+}  // namespace massdb
@@ -0,0 +1,73 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_DB_FILENAME_H
+#define MASSDB_DB_FILENAME_H
+
+#include <cstdint>
+#include <string>
+
+#include "massdb/status.h"
+
+namespace massdb {
+
+class Env;
+
+// 数据库目录下文件的类型
+enum FileType {
+    kLogFile,
+    kDBLockFile,
+    kTableFile,
+    kDescriptorFile,
+    kCurrentFile,
+    kTempFile,
+    kFragmentIndexFile,
+    kBlobFile,
+};
+
+// 返回数据库 dbname 中编号为 number 的日志文件的名字。
+// 结果以 dbname 为前缀
+std::string LogFileName(const std::string& dbname, uint64_t number);
+
+// 返回数据库 dbname 中编号为 number 的 table 文件的名字。
+// 结果以 dbname 为前缀
+std::string TableFileName(const std::string& dbname, uint64_t number);
+
+// 返回数据库 dbname 中编号为 number 的 table 文件的碎片离子索引文件的名字。
+// 结果以 dbname 为前缀
+std::string FragmentIndexFileName(const std::string& dbname, uint64_t number);
+
+// 返回数据库 dbname 中编号为 number 的 blob 文件的名字。
+// 结果以 dbname 为前缀
+std::string BlobFileName(const std::string& dbname, uint64_t number);
+
+// 返回数据库 dbname 中编号为 number 的描述文件（manifest）的名字。
+// 结果以 dbname 为前缀
+std::string DescriptorFileName(const std::string& dbname, uint64_t number);
+
+// 返回数据库 dbname 的 CURRENT 文件的名字，
+// 它的内容是当前正在使用的描述文件的名字。结果以 dbname 为前缀
+std::string CurrentFileName(const std::string& dbname);
+
+// 返回数据库 dbname 的锁文件的名字。结果以 dbname 为前缀
+std::string LockFileName(const std::string& dbname);
+
+// 返回数据库 dbname 中编号为 number 的临时文件的名字。
+// 结果以 dbname 为前缀
+std::string TempFileName(const std::string& dbname, uint64_t number);
+
+// 如果 filename 是一个 massdb 文件，将其类型存入 *type，
+// 编号存入 *number（对于锁文件，*number 为 0）并返回 true。
+// 否则返回 false
+bool ParseFileName(const std::string& filename, uint64_t* number,
+                   FileType* type);
+
+// 让 CURRENT 文件指向编号为 descriptor_number 的描述文件。
+// 先写入临时文件再重命名，保证 CURRENT 要么是旧的内容，要么是新的内容
+Status SetCurrentFile(Env* env, const std::string& dbname,
+                      uint64_t descriptor_number);
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_FILENAME_H
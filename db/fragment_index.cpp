@@ -0,0 +1,358 @@
+//
+// Created by Xsakura on 2023/6/18.
+//
+
+#include "db/fragment_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "db/blob_file.h"
+#include "db/dbformat.h"
+#include "massdb/comparator.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/spectrum.h"
+#include "massdb/table_builder.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+static const char kBinTag = 'b';
+static const char kKeyTag = 'k';
+static const char kMetaTag = 'm';
+static const size_t kIndexKeySize = 5;
+static const size_t kLegacyMetaSize = 12;
+static const size_t kMetaSize = 13;
+static const uint8_t kPostingFormat = 1;
+static const uint32_t kPostingBlockSize = 128;
+
+// 将 tag 和按大端序存放的 value 写入 buf
+static Slice EncodeIndexKey(char tag, uint32_t value, char* buf) {
+    buf[0] = tag;
+    buf[1] = static_cast<char>(value >> 24);
+    buf[2] = static_cast<char>(value >> 16);
+    buf[3] = static_cast<char>(value >> 8);
+    buf[4] = static_cast<char>(value);
+    return Slice(buf, kIndexKeySize);
+}
+
+// 箱号加上 2^31 之后按无符号数比较的顺序与箱号的顺序一致
+static uint32_t BiasBin(int32_t bin) {
+    return static_cast<uint32_t>(bin) ^ 0x80000000u;
+}
+
+Options FragmentIndexOptions(const Options& db_options) {
+    Options result = db_options;
+    result.comparator = BytewiseComparator();
+    result.filter_policy = nullptr;
+    result.compression = kNoCompression;
+    result.compression_per_level.clear();
+    result.bottommost_compression = kDisableCompressionOption;
+    return result;
+}
+
+// 将 n 个值按 width 位从低位开始紧密排列，追加到 *dst 中。要求：值小于 2^width
+static void PackBits(const uint32_t* values, uint32_t n, int width,
+                     std::string* dst) {
+    uint64_t acc = 0;
+    int bits = 0;
+    for (uint32_t k = 0; k < n; k++) {
+        acc |= static_cast<uint64_t>(values[k]) << bits;
+        bits += width;
+        while (bits >= 8) {
+            dst->push_back(static_cast<char>(acc));
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0) {
+        dst->push_back(static_cast<char>(acc));
+    }
+}
+
+// 写入一个 posting list，ids 升序且不重复
+static void EncodePostingList(const uint32_t* ids, uint32_t count,
+                              std::string* dst) {
+    PutVarint32(dst, count);
+    if (count == 0) {
+        return;
+    }
+    PutVarint32(dst, ids[0]);
+    uint32_t deltas[kPostingBlockSize];
+    for (uint32_t i = 1; i < count; i += kPostingBlockSize) {
+        const uint32_t n = std::min(kPostingBlockSize, count - i);
+        uint32_t max_delta = 0;
+        for (uint32_t k = 0; k < n; k++) {
+            deltas[k] = ids[i + k] - ids[i + k - 1] - 1;
+            max_delta |= deltas[k];
+        }
+        int width = 0;
+        while (width < 32 && (max_delta >> width) != 0) {
+            width++;
+        }
+        dst->push_back(static_cast<char>(width));
+        PackBits(deltas, n, width, dst);
+    }
+}
+
+FragmentIndexBuilder::FragmentIndexBuilder(double bin_width)
+    : bin_width_(bin_width) {
+    assert(bin_width > 0);
+}
+
+void FragmentIndexBuilder::Add(const Slice& internal_key, const Slice& value) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(internal_key, &ikey) ||
+        ikey.type == kTypeDeletion || !GetPeakBins(value, bin_width_, &bins_)) {
+        return;
+    }
+
+    // 同一个 user key 的多个版本相邻，共用一个编号，
+    // 重复的 (bin, id) 在 Finish() 中去掉
+    if (keys_.empty() || Slice(keys_.back()) != ikey.user_key) {
+        keys_.push_back(ikey.user_key.to_string());
+    }
+    const uint64_t id = keys_.size() - 1;
+    for (int32_t bin : bins_) {
+        postings_.push_back(static_cast<uint64_t>(BiasBin(bin)) << 32 | id);
+    }
+}
+
+Status FragmentIndexBuilder::Finish(const Options& options, Env* env,
+                                    const std::string& fname,
+                                    uint64_t* file_size) {
+    std::sort(postings_.begin(), postings_.end());
+    postings_.erase(std::unique(postings_.begin(), postings_.end()),
+                    postings_.end());
+
+    WritableFile* file;
+    Status s = env->NewWritableFile(fname, &file);
+    if (!s.IsOk()) {
+        return s;
+    }
+    TableBuilder builder(options, file);
+    char buf[kIndexKeySize];
+    std::string posting_list;
+    std::vector<uint32_t> ids;
+    size_t i = 0;
+    while (i < postings_.size()) {
+        const uint32_t bin = static_cast<uint32_t>(postings_[i] >> 32);
+        ids.clear();
+        for (; i < postings_.size() &&
+               static_cast<uint32_t>(postings_[i] >> 32) == bin;
+             i++) {
+            ids.push_back(static_cast<uint32_t>(postings_[i]));
+        }
+        posting_list.clear();
+        EncodePostingList(ids.data(), static_cast<uint32_t>(ids.size()),
+                          &posting_list);
+        builder.Add(EncodeIndexKey(kBinTag, bin, buf), posting_list);
+    }
+    for (uint32_t id = 0; id < keys_.size(); id++) {
+        builder.Add(EncodeIndexKey(kKeyTag, id, buf), keys_[id]);
+    }
+    std::string meta;
+    uint64_t bits;
+    std::memcpy(&bits, &bin_width_, sizeof(bits));
+    PutFixed64(&meta, bits);
+    PutFixed32(&meta, NumSpectra());
+    meta.push_back(static_cast<char>(kPostingFormat));
+    builder.Add(Slice(&kMetaTag, 1), meta);
+
+    s = builder.Finish();
+    if (s.IsOk()) {
+        *file_size = builder.FileSize();
+        s = file->Sync();
+    }
+    if (s.IsOk()) {
+        s = file->Close();
+    }
+    delete file;
+    if (!s.IsOk()) {
+        env->RemoveFile(fname);
+    }
+    return s;
+}
+
+uint32_t CountSharedBins(const std::vector<int32_t>& a,
+                         const std::vector<int32_t>& b) {
+    uint32_t shared = 0;
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (a[i] > b[j]) {
+            j++;
+        } else {
+            shared++;
+            i++;
+            j++;
+        }
+    }
+    return shared;
+}
+
+// 从 p 开始的 bytes 个字节中取出 n 个 width 位的值。
+// 块复制到补零的缓冲区中，每个值都用一次 8 字节的读取、移位和掩码得到，
+// 循环中没有分支。要求：n <= kPostingBlockSize，bytes 与 n、width 一致
+static void UnpackBits(const char* p, size_t bytes, uint32_t n, int width,
+                       uint32_t* out) {
+    char buf[kPostingBlockSize * 4 + 8];
+    std::memcpy(buf, p, bytes);
+    std::memset(buf + bytes, 0, 8);
+    const uint64_t mask = (static_cast<uint64_t>(1) << width) - 1;
+    for (uint32_t k = 0; k < n; k++) {
+        const size_t bit = static_cast<size_t>(k) * width;
+        out[k] = static_cast<uint32_t>(
+            (DecodeFixed64(buf + (bit >> 3)) >> (bit & 7)) & mask);
+    }
+}
+
+// 解码 posting list，将其中每个编号的计数加 1。
+// 格式错误或者编号不小于 num_ids 时返回 false
+static bool CountPostings(Slice input, uint32_t num_ids,
+                          std::vector<uint32_t>* counts) {
+    uint32_t count;
+    if (!GetVarint32(&input, &count)) {
+        return false;
+    }
+    if (count == 0) {
+        return input.empty();
+    }
+    uint32_t first;
+    if (!GetVarint32(&input, &first) || first >= num_ids) {
+        return false;
+    }
+    uint32_t* const c = counts->data();
+    c[first]++;
+    uint64_t id = first;
+    uint32_t deltas[kPostingBlockSize];
+    for (uint32_t remaining = count - 1; remaining > 0;) {
+        const uint32_t n = std::min(kPostingBlockSize, remaining);
+        remaining -= n;
+        if (input.empty()) {
+            return false;
+        }
+        const int width = static_cast<uint8_t>(input[0]);
+        input.remove_prefix(1);
+        const size_t bytes = (static_cast<size_t>(n) * width + 7) / 8;
+        if (width > 32 || input.size() < bytes) {
+            return false;
+        }
+        if (width == 0) {
+            // 编号连续，常见于很多谱图共有的箱
+            if (id + n >= num_ids) {
+                return false;
+            }
+            for (uint32_t k = 0; k < n; k++) {
+                c[++id]++;
+            }
+            continue;
+        }
+        UnpackBits(input.data(), bytes, n, width, deltas);
+        input.remove_prefix(bytes);
+        for (uint32_t k = 0; k < n; k++) {
+            id += static_cast<uint64_t>(deltas[k]) + 1;
+            if (id >= num_ids) {
+                return false;
+            }
+            c[id]++;
+        }
+    }
+    return input.empty();
+}
+
+Status SearchFragmentIndex(Iterator* iter, double bin_width,
+                           const std::vector<int32_t>& query_bins,
+                           uint32_t min_shared, bool* usable,
+                           std::vector<std::string>* keys) {
+    assert(min_shared > 0);
+    *usable = false;
+    iter->Seek(Slice(&kMetaTag, 1));
+    if (!iter->Valid() || iter->key() != Slice(&kMetaTag, 1)) {
+        Status s = iter->status();
+        return s.IsOk() ? Status::Corruption("missing fragment index meta")
+                        : s;
+    }
+    if (iter->value().size() == kLegacyMetaSize) {
+        return Status::Ok();  // 旧的格式，由调用者扫描 table 文件
+    }
+    if (iter->value().size() != kMetaSize ||
+        static_cast<uint8_t>(iter->value()[12]) != kPostingFormat) {
+        return Status::Corruption("bad fragment index meta");
+    }
+    const uint64_t bits = DecodeFixed64(iter->value().data());
+    double index_bin_width;
+    std::memcpy(&index_bin_width, &bits, sizeof(index_bin_width));
+    const uint32_t num_ids = DecodeFixed32(iter->value().data() + 8);
+    if (index_bin_width != bin_width) {
+        return Status::Ok();
+    }
+    *usable = true;
+    if (num_ids == 0) {
+        return Status::Ok();
+    }
+
+    // 箱在索引中按顺序排列，按顺序 Seek 时相邻的箱通常在同一个块中
+    std::vector<uint32_t> counts(num_ids, 0);
+    char buf[kIndexKeySize];
+    for (int32_t bin : query_bins) {
+        const Slice target = EncodeIndexKey(kBinTag, BiasBin(bin), buf);
+        iter->Seek(target);
+        if (iter->Valid() && iter->key() == target &&
+            !CountPostings(iter->value(), num_ids, &counts)) {
+            return Status::Corruption("bad fragment index posting list");
+        }
+    }
+
+    Status s = iter->status();
+    for (uint32_t id = 0; id < num_ids && s.IsOk(); id++) {
+        if (counts[id] < min_shared) {
+            continue;
+        }
+        const Slice target = EncodeIndexKey(kKeyTag, id, buf);
+        iter->Seek(target);
+        if (iter->Valid() && iter->key() == target) {
+            keys->push_back(iter->value().to_string());
+        } else {
+            s = iter->status();
+            if (s.IsOk()) {
+                s = Status::Corruption("missing fragment index key");
+            }
+        }
+    }
+    return s;
+}
+
+Status ScanFragments(Iterator* iter, BlobFileCache* blob_cache,
+                     const ReadOptions& options, double bin_width,
+                     const std::vector<int32_t>& query_bins,
+                     uint32_t min_shared, std::vector<std::string>* keys) {
+    assert(min_shared > 0);
+    std::vector<int32_t> bins;
+    std::string blob_value;
+    ParsedInternalKey ikey;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        if (!ParseInternalKey(iter->key(), &ikey) ||
+            ikey.type == kTypeDeletion) {
+            continue;
+        }
+        Slice value = iter->value();
+        if (ikey.type == kTypeBlobIndex) {
+            Status s = blob_cache->Get(options, value, &blob_value);
+            if (!s.IsOk()) {
+                return s;
+            }
+            value = blob_value;
+        }
+        if (GetPeakBins(value, bin_width, &bins) &&
+            CountSharedBins(query_bins, bins) >= min_shared) {
+            keys->push_back(ikey.user_key.to_string());
+        }
+    }
+    return iter->status();
+}
+
+}  // namespace massdb
@@ -0,0 +1,103 @@
+//
+// Created by Xsakura on 2023/6/18.
+//
+
+#ifndef MASSDB_DB_FRAGMENT_INDEX_H
+#define MASSDB_DB_FRAGMENT_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "massdb/options.h"
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class BlobFileCache;
+class Env;
+class Iterator;
+
+// 碎片离子倒排索引。
+//
+// 启用 Options::fragment_index_bin_width 时，每个 table 文件都有一个同编号的
+// 索引文件（见 FragmentIndexFileName()），在写入 MemTable 和压实生成
+// table 文件时一起生成，随 table 文件一起删除。
+// 索引文件本身也是一个 table，key 按字节比较：
+//    'b' + bin  -> posting list：包含这个箱的谱图的编号
+//    'k' + id   -> 编号为 id 的谱图的 user key
+//    'm'        -> bin_width : fixed64   // double 的位模式
+//                  num_ids   : fixed32
+//                  format    : uint8     // posting list 的格式，当前为 1
+// bin 是箱号加上 2^31 后按大端序存放的 4 字节，id 按大端序存放。
+// table 中 value 是峰列表格式的 user key 按顺序从 0 开始编号，
+// 同一个 user key 的多个版本共用一个编号。posting list 的格式为：
+//    count : varint32
+//    first : varint32             // 第一个编号
+//    block[ceil((count - 1) / 128)]
+// 其余 count - 1 个编号与上一个编号的差减 1 后每 128 个一块，
+// 最后一块可能不满。块内的差值使用相同的位数，按顺序从低位开始紧密排列：
+//    width : uint8                // 块中最大差值的位数，0 到 32
+//    bits  : char[ceil(n * width / 8)]
+// 没有 format 的旧索引文件使用 varint 编码的差值，读取时按不可用处理
+
+// 返回读写索引文件使用的选项：按字节比较 key，不使用过滤器，
+// posting list 已经压缩过，块不再压缩
+Options FragmentIndexOptions(const Options& db_options);
+
+// 在生成 table 文件的同时收集索引的内容，完成时写入索引文件
+class FragmentIndexBuilder {
+public:
+    explicit FragmentIndexBuilder(double bin_width);
+
+    FragmentIndexBuilder(const FragmentIndexBuilder&) = delete;
+    FragmentIndexBuilder& operator=(const FragmentIndexBuilder&) = delete;
+
+    // 加入 table 中的一个条目。value 是用户写入的 value，
+    // 类型为 kTypeBlobIndex 时是引用指向的 value。要求：internal key 按顺序加入
+    void Add(const Slice& internal_key, const Slice& value);
+
+    // 已经编号的谱图数量
+    uint32_t NumSpectra() const {
+        return static_cast<uint32_t>(keys_.size());
+    }
+
+    // 将索引写入新建的文件 fname 并持久化，成功时在 *file_size 中
+    // 返回文件的大小。options 由 FragmentIndexOptions() 得到
+    Status Finish(const Options& options, Env* env, const std::string& fname,
+                  uint64_t* file_size);
+
+private:
+    const double bin_width_;
+    std::vector<std::string> keys_;  // 每个编号的 user key
+    // (bin + 2^31) << 32 | id，完成时排序后按箱分组
+    std::vector<uint64_t> postings_;
+    std::vector<int32_t> bins_;  // Add() 中使用的临时空间
+};
+
+// 返回两组升序、不重复的箱中相同的箱的数量
+uint32_t CountSharedBins(const std::vector<int32_t>& a,
+                         const std::vector<int32_t>& b);
+
+// 在索引文件的迭代器 *iter 中查找与 query_bins 至少有 min_shared 个相同的箱
+// 的谱图，将它们的 user key 追加到 *keys 中。
+// 索引的箱宽度与 bin_width 不同或者是旧的格式时 *usable 为 false，
+// 不修改 *keys。
+// 要求：query_bins 升序且不重复，min_shared > 0
+Status SearchFragmentIndex(Iterator* iter, double bin_width,
+                           const std::vector<int32_t>& query_bins,
+                           uint32_t min_shared, bool* usable,
+                           std::vector<std::string>* keys);
+
+// 没有可用的索引时，逐个检查 internal key 迭代器 *iter 中的谱图，
+// 将满足条件的 user key 追加到 *keys 中。blob 引用指向的 value 通过
+// *blob_cache 读取。其余参数的含义同 SearchFragmentIndex()
+Status ScanFragments(Iterator* iter, BlobFileCache* blob_cache,
+                     const ReadOptions& options, double bin_width,
+                     const std::vector<int32_t>& query_bins,
+                     uint32_t min_shared, std::vector<std::string>* keys);
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_FRAGMENT_INDEX_H
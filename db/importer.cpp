@@ -0,0 +1,890 @@
+//
+// Created by Xsakura on 2023/6/25.
+//
+
+#include "massdb/importer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "massdb/db.h"
+#include "massdb/env.h"
+#include "massdb/spectrum.h"
+#include "massdb/write_batch.h"
+#include "util/coding.h"
+#include "util/compression.h"
+
+namespace massdb {
+
+namespace {
+
+// 在 [begin, end) 中查找 needle，找不到时返回 nullptr。
+// 先用 memchr() 找首字符，读取线程每一块都要扫描一遍
+const char* Find(const char* begin, const char* end, const char* needle) {
+    const size_t n = std::strlen(needle);
+    while (static_cast<size_t>(end - begin) >= n) {
+        const char* p = static_cast<const char*>(
+            std::memchr(begin, needle[0], end - begin - n + 1));
+        if (p == nullptr) {
+            return nullptr;
+        }
+        if (std::memcmp(p, needle, n) == 0) {
+            return p;
+        }
+        begin = p + 1;
+    }
+    return nullptr;
+}
+
+bool StartsWith(const char* begin, const char* end, const char* prefix) {
+    const size_t n = std::strlen(prefix);
+    return static_cast<size_t>(end - begin) >= n &&
+           std::memcmp(begin, prefix, n) == 0;
+}
+
+bool EndsWithIgnoreCase(const std::string& s, const char* suffix) {
+    const size_t n = std::strlen(suffix);
+    if (s.size() < n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (std::tolower(static_cast<unsigned char>(s[s.size() - n + i])) !=
+            std::tolower(static_cast<unsigned char>(suffix[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 块在最后一个谱图结束的标记之后切分
+const char* EndMarker(SpectrumFileFormat format) {
+    return format == kMgfFormat ? "END IONS" : "</spectrum>";
+}
+
+// 一个解析出的谱图
+struct Spectrum {
+    void Clear() {
+        has_precursor = false;
+        precursor_mz = 0;
+        charge = 0;
+        has_scan = false;
+        scan = 0;
+        peaks.clear();
+    }
+
+    bool has_precursor;
+    double precursor_mz;
+    int charge;
+    bool has_scan;
+    uint64_t scan;
+    std::vector<std::pair<double, float>> peaks;  // (m/z, 强度)
+};
+
+// 解析文件中的一块，生成写入数据库的 WriteBatch。
+// 数字通过 strtod() 解析，要求块的数据后面有一个 '\0'（std::string 保证）
+class ChunkParser {
+public:
+    ChunkParser(const ImportOptions& options, WriteBatch* batch)
+        : options_(options),
+          batch_(batch),
+          spectra_(0),
+          skipped_(0),
+          bytes_(0) {}
+
+    // 解析 [begin, end) 中的所有谱图。
+    // ordinal 是块中第一个谱图在文件中的序号，没有扫描号时使用
+    void ParseMgf(const char* begin, const char* end, uint64_t ordinal);
+    void ParseMzML(const char* begin, const char* end, uint64_t ordinal);
+
+    uint64_t spectra() const { return spectra_; }
+    uint64_t skipped() const { return skipped_; }
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    // 编码 spectrum_ 并加入 batch_
+    void Emit(uint64_t ordinal);
+
+    // 解析一个 <spectrum> 元素，[begin, end) 是元素的内容
+    bool ParseMzMLSpectrum(const char* begin, const char* end,
+                           uint64_t ordinal);
+
+    // 解码一个 <binaryDataArray> 元素，默认有 n 个值。
+    // 结果存入 *values，*is_mz 表示是不是 m/z 数组，
+    // 既不是 m/z 也不是强度的数组存入 *other
+    bool DecodeBinaryArray(const char* begin, const char* end, size_t n,
+                           std::vector<double>* values, bool* is_mz,
+                           bool* other);
+
+    const ImportOptions& options_;
+    WriteBatch* const batch_;
+    uint64_t spectra_;
+    uint64_t skipped_;
+    uint64_t bytes_;
+
+    // 在块中的谱图之间复用
+    Spectrum spectrum_;
+    std::string key_;
+    std::string value_;
+    std::vector<double> mz_;
+    std::vector<float> intensity_;
+    std::string binary_;
+    std::string decoded_;
+};
+
+void ChunkParser::Emit(uint64_t ordinal) {
+    if (!spectrum_.has_precursor) {
+        skipped_++;
+        return;
+    }
+    std::vector<std::pair<double, float>>& peaks = spectrum_.peaks;
+    if (!std::is_sorted(peaks.begin(), peaks.end())) {
+        std::sort(peaks.begin(), peaks.end());
+    }
+    mz_.resize(peaks.size());
+    intensity_.resize(peaks.size());
+    for (size_t i = 0; i < peaks.size(); i++) {
+        mz_[i] = peaks[i].first;
+        intensity_[i] = peaks[i].second;
+    }
+
+    // 扫描号只使用低 32 位，高 32 位区分文件
+    const uint64_t scan = spectrum_.has_scan ? spectrum_.scan : ordinal;
+    const uint64_t scan_id =
+        static_cast<uint64_t>(options_.file_id) << 32 | (scan & 0xffffffffu);
+    const int charge = std::max(-128, std::min(127, spectrum_.charge));
+    key_.clear();
+    EncodeSpectrumKey(spectrum_.precursor_mz, charge, scan_id, &key_);
+    value_.clear();
+    EncodePeakList(mz_.data(), intensity_.data(), peaks.size(), &value_);
+    batch_->Put(key_, value_);
+    spectra_++;
+    bytes_ += key_.size() + value_.size();
+}
+
+// 解析 "scan=123" 形式的扫描号，TITLE 和 mzML 的 id 中常见
+bool ParseScanNumber(const char* begin, const char* end, uint64_t* scan) {
+    const char* p = Find(begin, end, "scan=");
+    if (p == nullptr) {
+        return false;
+    }
+    p += 5;
+    if (p == end || !std::isdigit(static_cast<unsigned char>(*p))) {
+        return false;
+    }
+    *scan = std::strtoull(p, nullptr, 10);
+    return true;
+}
+
+// 跳过 [p, end) 开头的空格和制表符。
+// strtod() 等函数会跳过包括换行在内的所有空白，解析之前先确认还在同一行
+const char* SkipBlanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+// 解析 "2+"、"3-"、"+2" 或者 "2+ and 3+" 形式的电荷，多个时取第一个
+int ParseCharge(const char* p) {
+    char* rest;
+    long charge = std::strtol(p, &rest, 10);
+    if (*rest == '-') {
+        charge = -charge;
+    }
+    return static_cast<int>(charge);
+}
+
+void ChunkParser::ParseMgf(const char* begin, const char* end,
+                           uint64_t ordinal) {
+    bool in_ions = false;
+    const char* line = begin;
+    while (line < end) {
+        const char* eol = static_cast<const char*>(
+            std::memchr(line, '\n', end - line));
+        if (eol == nullptr) {
+            eol = end;
+        }
+        const char* next = eol + (eol < end ? 1 : 0);
+        // 去掉行首的空白和行尾的 '\r'
+        while (line < eol && (*line == ' ' || *line == '\t')) {
+            line++;
+        }
+        const char* last = eol;
+        while (last > line && (last[-1] == '\r' || last[-1] == ' ')) {
+            last--;
+        }
+
+        if (line == last || *line == '#' || *line == ';') {
+            // 空行和注释
+        } else if (StartsWith(line, last, "BEGIN IONS")) {
+            in_ions = true;
+            spectrum_.Clear();
+        } else if (StartsWith(line, last, "END IONS")) {
+            if (in_ions) {
+                Emit(ordinal);
+                ordinal++;
+            }
+            in_ions = false;
+        } else if (!in_ions) {
+            // 文件开头的全局参数
+        } else if (std::isdigit(static_cast<unsigned char>(*line)) ||
+                   *line == '.' || *line == '-') {
+            // 峰："m/z 强度 [电荷]"，没有强度时为 0
+            char* rest;
+            const double mz = std::strtod(line, &rest);
+            const char* field = SkipBlanks(rest, last);
+            const float intensity =
+                field < last ? std::strtof(field, nullptr) : 0;
+            spectrum_.peaks.emplace_back(mz, intensity);
+        } else if (StartsWith(line, last, "PEPMASS=")) {
+            const char* field = SkipBlanks(line + 8, last);
+            if (field < last) {
+                char* rest;
+                spectrum_.precursor_mz = std::strtod(field, &rest);
+                spectrum_.has_precursor = rest != field;
+            }
+        } else if (StartsWith(line, last, "CHARGE=")) {
+            const char* field = SkipBlanks(line + 7, last);
+            if (field < last) {
+                spectrum_.charge = ParseCharge(field);
+            }
+        } else if (StartsWith(line, last, "SCANS=")) {
+            if (std::isdigit(static_cast<unsigned char>(line[6]))) {
+                spectrum_.scan = std::strtoull(line + 6, nullptr, 10);
+                spectrum_.has_scan = true;
+            }
+        } else if (StartsWith(line, last, "TITLE=")) {
+            // SCANS 优先于 TITLE 中的扫描号
+            if (!spectrum_.has_scan) {
+                spectrum_.has_scan =
+                    ParseScanNumber(line + 6, last, &spectrum_.scan);
+            }
+        }
+        line = next;
+    }
+    if (in_ions) {
+        // 文件末尾被截断的谱图
+        skipped_++;
+    }
+}
+
+// 在 [begin, end) 中找到 accession 属性为 accession 的 cvParam，
+// 将它的 value 属性存入 *value
+bool FindCvParam(const char* begin, const char* end, const char* accession,
+                 Slice* value) {
+    std::string needle = "accession=\"";
+    needle += accession;
+    needle += '"';
+    const char* p = Find(begin, end, needle.c_str());
+    if (p == nullptr) {
+        return false;
+    }
+    // value 属性可能在 accession 的前面，在整个标签中查找
+    const char* tag_begin = p;
+    while (tag_begin > begin && *tag_begin != '<') {
+        tag_begin--;
+    }
+    const char* tag_end =
+        static_cast<const char*>(std::memchr(p, '>', end - p));
+    if (tag_end == nullptr) {
+        return false;
+    }
+    const char* v = Find(tag_begin, tag_end, " value=\"");
+    if (v == nullptr) {
+        *value = Slice();
+        return true;
+    }
+    v += 8;
+    const char* q = static_cast<const char*>(std::memchr(v, '"', tag_end - v));
+    if (q == nullptr) {
+        return false;
+    }
+    *value = Slice(v, q - v);
+    return true;
+}
+
+// 读取 [begin, end) 中第一个 name 属性的值
+bool FindAttribute(const char* begin, const char* end, const char* name,
+                   Slice* value) {
+    std::string needle = " ";
+    needle += name;
+    needle += "=\"";
+    const char* p = Find(begin, end, needle.c_str());
+    if (p == nullptr) {
+        return false;
+    }
+    p += needle.size();
+    const char* q = static_cast<const char*>(std::memchr(p, '"', end - p));
+    if (q == nullptr) {
+        return false;
+    }
+    *value = Slice(p, q - p);
+    return true;
+}
+
+// 解码 base64，忽略空白。遇到其他非法字符时返回 false
+bool DecodeBase64(const char* begin, const char* end, std::string* output) {
+    static const signed char* const kTable = [] {
+        static signed char table[256];
+        std::memset(table, -1, sizeof(table));
+        const char* alphabet =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; i++) {
+            table[static_cast<unsigned char>(alphabet[i])] =
+                static_cast<signed char>(i);
+        }
+        return table;
+    }();
+
+    output->clear();
+    output->reserve((end - begin) / 4 * 3);
+    uint32_t bits = 0;
+    int nbits = 0;
+    for (const char* p = begin; p < end; p++) {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        const int v = kTable[c];
+        if (v < 0) {
+            if (c == '=') {
+                break;
+            }
+            if (std::isspace(c)) {
+                continue;
+            }
+            return false;
+        }
+        bits = bits << 6 | static_cast<uint32_t>(v);
+        nbits += 6;
+        if (nbits >= 8) {
+            nbits -= 8;
+            output->push_back(static_cast<char>((bits >> nbits) & 0xff));
+        }
+    }
+    return true;
+}
+
+// mzML 中用到的受控词表
+static const char kMsLevel[] = "MS:1000511";
+static const char kSelectedIonMz[] = "MS:1000744";
+static const char kChargeState[] = "MS:1000041";
+static const char kFloat32[] = "MS:1000521";
+static const char kFloat64[] = "MS:1000523";
+static const char kZlibCompressed[] = "MS:1000574";
+static const char kNoCompressionParam[] = "MS:1000576";
+static const char kMzArray[] = "MS:1000514";
+static const char kIntensityArray[] = "MS:1000515";
+
+bool ChunkParser::DecodeBinaryArray(const char* begin, const char* end,
+                                    size_t n, std::vector<double>* values,
+                                    bool* is_mz, bool* other) {
+    // cvParam 都在 <binary> 之前，不在 base64 数据中查找
+    const char* b = Find(begin + 1, end, "<binary");
+    const char* params_end = b == nullptr ? end : b;
+    Slice ignored;
+    *is_mz = FindCvParam(begin, params_end, kMzArray, &ignored);
+    *other = !*is_mz &&
+             !FindCvParam(begin, params_end, kIntensityArray, &ignored);
+    if (*other) {
+        return true;
+    }
+
+    size_t width;
+    if (FindCvParam(begin, params_end, kFloat64, &ignored)) {
+        width = 8;
+    } else if (FindCvParam(begin, params_end, kFloat32, &ignored)) {
+        width = 4;
+    } else {
+        return false;
+    }
+    const bool zlib =
+        FindCvParam(begin, params_end, kZlibCompressed, &ignored);
+    if (!zlib &&
+        !FindCvParam(begin, params_end, kNoCompressionParam, &ignored)) {
+        // 例如 MS-Numpress 等不支持的编码
+        return false;
+    }
+    // 数组自己的长度优先于谱图的 defaultArrayLength
+    const char* tag_end =
+        static_cast<const char*>(std::memchr(begin, '>', end - begin));
+    Slice length;
+    if (tag_end != nullptr &&
+        FindAttribute(begin, tag_end, "arrayLength", &length)) {
+        n = std::strtoull(length.data(), nullptr, 10);
+    }
+
+    const char* e = b == nullptr ? nullptr : Find(b, end, "</binary>");
+    if (b == nullptr || e == nullptr || b[7] != '>') {
+        // 空数组可能写成 <binary/>
+        values->clear();
+        return n == 0;
+    }
+    if (!DecodeBase64(b + 8, e, &binary_)) {
+        return false;
+    }
+    const char* data = binary_.data();
+    const size_t size = n * width;
+    if (zlib) {
+        const CompressionCodec* codec = GetCompressionCodec(kZlibCompression);
+        decoded_.resize(size);
+        if (codec == nullptr ||
+            !codec->Uncompress(binary_, &decoded_[0], size)) {
+            return false;
+        }
+        data = decoded_.data();
+    } else if (binary_.size() != size) {
+        return false;
+    }
+
+    values->resize(n);
+    for (size_t i = 0; i < n; i++) {
+        if (width == 8) {
+            const uint64_t bits = DecodeFixed64(data + i * 8);
+            std::memcpy(&(*values)[i], &bits, sizeof(bits));
+        } else {
+            const uint32_t bits = DecodeFixed32(data + i * 4);
+            float f;
+            std::memcpy(&f, &bits, sizeof(bits));
+            (*values)[i] = f;
+        }
+    }
+    return true;
+}
+
+bool ChunkParser::ParseMzMLSpectrum(const char* begin, const char* end,
+                                    uint64_t ordinal) {
+    spectrum_.Clear();
+    const char* tag_end =
+        static_cast<const char*>(std::memchr(begin, '>', end - begin));
+    if (tag_end == nullptr) {
+        return false;
+    }
+    Slice attr;
+    size_t n = 0;
+    if (FindAttribute(begin, tag_end, "defaultArrayLength", &attr)) {
+        n = std::strtoull(attr.data(), nullptr, 10);
+    }
+    if (FindAttribute(begin, tag_end, "id", &attr)) {
+        spectrum_.has_scan =
+            ParseScanNumber(attr.data(), attr.data() + attr.size(),
+                            &spectrum_.scan);
+    }
+    if (!spectrum_.has_scan &&
+        FindAttribute(begin, tag_end, "index", &attr)) {
+        spectrum_.scan = std::strtoull(attr.data(), nullptr, 10);
+        spectrum_.has_scan = true;
+    }
+
+    // 谱图的 cvParam 都在数据数组之前
+    const char* arrays = Find(begin, end, "<binaryDataArrayList");
+    const char* params_end = arrays == nullptr ? end : arrays;
+
+    // 只导入有 precursor 的二级谱
+    if (FindCvParam(begin, params_end, kMsLevel, &attr) &&
+        std::atoi(attr.to_string().c_str()) != 2) {
+        return false;
+    }
+    if (!FindCvParam(begin, params_end, kSelectedIonMz, &attr)) {
+        return false;
+    }
+    spectrum_.precursor_mz = std::strtod(attr.to_string().c_str(), nullptr);
+    spectrum_.has_precursor = true;
+    if (FindCvParam(begin, params_end, kChargeState, &attr)) {
+        spectrum_.charge = std::atoi(attr.to_string().c_str());
+    }
+
+    std::vector<double> mz, intensity, values;
+    bool has_mz = false, has_intensity = false;
+    const char* p = params_end;
+    while ((p = Find(p, end, "<binaryDataArray")) != nullptr) {
+        // 跳过 <binaryDataArrayList>
+        if (p[16] == 'L') {
+            p += 16;
+            continue;
+        }
+        const char* q = Find(p, end, "</binaryDataArray>");
+        if (q == nullptr) {
+            return false;
+        }
+        bool is_mz, other;
+        if (!DecodeBinaryArray(p, q, n, &values, &is_mz, &other)) {
+            return false;
+        }
+        if (!other) {
+            (is_mz ? mz : intensity).swap(values);
+            (is_mz ? has_mz : has_intensity) = true;
+        }
+        p = q;
+    }
+    if (!has_mz || !has_intensity || mz.size() != intensity.size()) {
+        return false;
+    }
+    spectrum_.peaks.resize(mz.size());
+    for (size_t i = 0; i < mz.size(); i++) {
+        spectrum_.peaks[i] =
+            std::make_pair(mz[i], static_cast<float>(intensity[i]));
+    }
+    Emit(ordinal);
+    return true;
+}
+
+void ChunkParser::ParseMzML(const char* begin, const char* end,
+                            uint64_t ordinal) {
+    const char* p = begin;
+    while ((p = Find(p, end, "<spectrum")) != nullptr) {
+        // 跳过 <spectrumList> 等名字以 spectrum 开头的元素
+        const char c = p + 9 < end ? p[9] : '\0';
+        if (c != ' ' && c != '>' && c != '\n' && c != '\t' && c != '\r') {
+            p += 9;
+            continue;
+        }
+        const char* q = Find(p, end, "</spectrum>");
+        if (q == nullptr) {
+            // 文件末尾被截断的谱图
+            skipped_++;
+            break;
+        }
+        if (!ParseMzMLSpectrum(p, q, ordinal)) {
+            skipped_++;
+        }
+        ordinal++;
+        p = q;
+    }
+}
+
+// 将 WriteBatch 中的条目交给 BulkLoader
+class BatchLoader : public WriteBatch::Handler {
+public:
+    explicit BatchLoader(BulkLoader* loader) : loader_(loader) {}
+
+    void Put(const Slice& key, const Slice& value) override {
+        if (status_.IsOk()) {
+            status_ = loader_->Add(key, value);
+        }
+    }
+
+    void Delete(const Slice& key) override {
+        // 导入只会生成 Put，BulkLoader 也不能表示删除
+        if (status_.IsOk()) {
+            status_ = Status::NotSupported("bulk load cannot delete", key);
+        }
+    }
+
+    const Status& status() const { return status_; }
+
+private:
+    BulkLoader* const loader_;
+    Status status_;
+};
+
+// 导入的流水线：
+//   读取线程：按 chunk_size 读取文件，在谱图的边界处切分成块；
+//   解析线程：并行地解析块，将谱图编码成 key 和 value 放入 WriteBatch；
+//   调用者的线程：按文件中的顺序写入数据库。
+// 读取但还没有写入的块不超过 max_pending_chunks 个，
+// 写入跟不上时读取线程会等待，解析线程随之空闲
+class SpectrumImporter {
+public:
+    SpectrumImporter(DB* db, SequentialFile* file, SpectrumFileFormat format,
+                     const ImportOptions& options)
+        : db_(db),
+          file_(file),
+          format_(format),
+          options_(options),
+          bytes_read_(0),
+          read_done_(false),
+          stop_(false) {}
+
+    Status Run(ImportStats* stats);
+
+private:
+    struct Chunk {
+        Chunk()
+            : ordinal(0), parsed(false), spectra(0), skipped(0), bytes(0) {}
+
+        std::string data;
+        uint64_t ordinal;  // 块中第一个谱图在文件中的序号
+        bool parsed;
+        WriteBatch batch;
+        uint64_t spectra;
+        uint64_t skipped;
+        uint64_t bytes;
+    };
+
+    void ReadFile();
+    void ParseChunks();
+
+    // 写入一个块。要求：不持有 mu_
+    Status WriteChunk(Chunk* chunk, BulkLoader* loader);
+
+    // 出错时让所有线程停止
+    void Stop(const Status& s);
+
+    DB* const db_;
+    SequentialFile* const file_;
+    const SpectrumFileFormat format_;
+    const ImportOptions& options_;
+
+    std::mutex mu_;
+    std::condition_variable read_cv_;   // pending_ 有空位
+    std::condition_variable parse_cv_;  // unparsed_ 不为空
+    std::condition_variable write_cv_;  // pending_ 的队首已经解析
+    // 读取但还没有写入的块，按文件中的顺序
+    std::deque<Chunk*> pending_;
+    // pending_ 中还没有解析的块
+    std::deque<Chunk*> unparsed_;
+    uint64_t bytes_read_;
+    bool read_done_;
+    bool stop_;
+    Status status_;  // 第一个错误
+};
+
+void SpectrumImporter::Stop(const Status& s) {
+    std::lock_guard<std::mutex> l(mu_);
+    if (status_.IsOk()) {
+        status_ = s;
+    }
+    stop_ = true;
+    read_cv_.notify_all();
+    parse_cv_.notify_all();
+    write_cv_.notify_all();
+}
+
+void SpectrumImporter::ReadFile() {
+    const char* marker = EndMarker(format_);
+    const size_t marker_len = std::strlen(marker);
+    const size_t chunk_size = std::max<size_t>(options_.chunk_size, 4096);
+    uint64_t ordinal = 0;
+    std::string carry;
+    bool eof = false;
+    while (!eof) {
+        Chunk* chunk = new Chunk;
+        chunk->data.swap(carry);
+        size_t split = std::string::npos;
+        uint64_t markers = 0;  // 块中的结束标记数，即完整的谱图数
+        Status s;
+        // 一直读到包含一个完整的谱图为止
+        while (split == std::string::npos && !eof) {
+            const size_t base = chunk->data.size();
+            chunk->data.resize(base + chunk_size);
+            char* scratch = &chunk->data[base];
+            Slice result;
+            s = file_->Read(chunk_size, &result, scratch);
+            if (!s.IsOk()) {
+                break;
+            }
+            if (result.data() != scratch) {
+                std::memmove(scratch, result.data(), result.size());
+            }
+            chunk->data.resize(base + result.size());
+            eof = result.empty();
+            {
+                std::lock_guard<std::mutex> l(mu_);
+                bytes_read_ += result.size();
+            }
+
+            // 在最后一个结束标记的末尾切分。
+            // 标记可能跨过上次读取的末尾，往前多找 marker_len 个字节
+            const size_t from = base > marker_len ? base - marker_len : 0;
+            const char* data = chunk->data.data();
+            const char* limit = data + chunk->data.size();
+            const char* found = nullptr;
+            for (const char* p = Find(data + from, limit, marker); p != nullptr;
+                 p = Find(p + marker_len, limit, marker)) {
+                found = p;
+                markers++;
+            }
+            if (found != nullptr) {
+                split = found - data + marker_len;
+            } else if (eof) {
+                split = chunk->data.size();
+            }
+        }
+        if (!s.IsOk()) {
+            delete chunk;
+            Stop(s);
+            break;
+        }
+
+        carry.assign(chunk->data, split, std::string::npos);
+        chunk->data.resize(split);
+        chunk->ordinal = ordinal;
+        ordinal += markers;
+
+        std::unique_lock<std::mutex> l(mu_);
+        while (!stop_ && pending_.size() >=
+                             static_cast<size_t>(options_.max_pending_chunks)) {
+            read_cv_.wait(l);
+        }
+        if (stop_) {
+            delete chunk;
+            break;
+        }
+        pending_.push_back(chunk);
+        unparsed_.push_back(chunk);
+        parse_cv_.notify_one();
+    }
+
+    std::lock_guard<std::mutex> l(mu_);
+    read_done_ = true;
+    parse_cv_.notify_all();
+    write_cv_.notify_all();
+}
+
+void SpectrumImporter::ParseChunks() {
+    std::unique_lock<std::mutex> l(mu_);
+    while (true) {
+        while (!stop_ && unparsed_.empty() && !read_done_) {
+            parse_cv_.wait(l);
+        }
+        if (stop_ || unparsed_.empty()) {
+            break;
+        }
+        Chunk* chunk = unparsed_.front();
+        unparsed_.pop_front();
+        l.unlock();
+
+        ChunkParser parser(options_, &chunk->batch);
+        const char* begin = chunk->data.data();
+        const char* end = begin + chunk->data.size();
+        if (format_ == kMgfFormat) {
+            parser.ParseMgf(begin, end, chunk->ordinal);
+        } else {
+            parser.ParseMzML(begin, end, chunk->ordinal);
+        }
+        chunk->spectra = parser.spectra();
+        chunk->skipped = parser.skipped();
+        chunk->bytes = parser.bytes();
+        // 文本已经不再需要
+        std::string().swap(chunk->data);
+
+        l.lock();
+        chunk->parsed = true;
+        if (chunk == pending_.front()) {
+            write_cv_.notify_one();
+        }
+    }
+}
+
+Status SpectrumImporter::WriteChunk(Chunk* chunk, BulkLoader* loader) {
+    if (chunk->spectra == 0) {
+        return Status::Ok();
+    }
+    if (loader == nullptr) {
+        return db_->Write(options_.write_options, &chunk->batch);
+    }
+    BatchLoader handler(loader);
+    Status s = chunk->batch.Iterate(&handler);
+    return s.IsOk() ? handler.status() : s;
+}
+
+Status SpectrumImporter::Run(ImportStats* stats) {
+    BulkLoader* loader = nullptr;
+    if (options_.bulk_load) {
+        Status s = db_->NewBulkLoader(options_.bulk_load_options, &loader);
+        if (!s.IsOk()) {
+            return s;
+        }
+    }
+
+    std::thread reader(&SpectrumImporter::ReadFile, this);
+    std::vector<std::thread> parsers;
+    for (int i = 0; i < std::max(options_.parse_threads, 1); i++) {
+        parsers.emplace_back(&SpectrumImporter::ParseChunks, this);
+    }
+
+    // 按文件中的顺序写入，同一个 key 后出现的谱图覆盖先出现的
+    ImportStats result;
+    std::unique_lock<std::mutex> l(mu_);
+    while (true) {
+        while (!stop_ && (pending_.empty() || !pending_.front()->parsed) &&
+               !(read_done_ && pending_.empty())) {
+            write_cv_.wait(l);
+        }
+        if (stop_ || pending_.empty()) {
+            break;
+        }
+        Chunk* chunk = pending_.front();
+        pending_.pop_front();
+        read_cv_.notify_one();
+        l.unlock();
+
+        Status s = WriteChunk(chunk, loader);
+        result.spectra += chunk->spectra;
+        result.skipped += chunk->skipped;
+        result.bytes_written += chunk->bytes;
+        delete chunk;
+
+        l.lock();
+        if (!s.IsOk()) {
+            l.unlock();
+            Stop(s);
+            l.lock();
+            break;
+        }
+        // 下一个块可能在等待时已经解析完
+    }
+    l.unlock();
+
+    reader.join();
+    for (std::thread& parser : parsers) {
+        parser.join();
+    }
+    // 出错时剩下的块没有写入
+    for (Chunk* chunk : pending_) {
+        delete chunk;
+    }
+    pending_.clear();
+    unparsed_.clear();
+
+    Status s = status_;
+    if (loader != nullptr) {
+        if (s.IsOk()) {
+            s = loader->Finish();
+        }
+        delete loader;
+    }
+    result.bytes_read = bytes_read_;
+    if (stats != nullptr) {
+        *stats = result;
+    }
+    return s;
+}
+
+}  // namespace
+
+Status ImportSpectra(DB* db, const std::string& fname,
+                     const ImportOptions& options, ImportStats* stats) {
+    SpectrumFileFormat format = options.format;
+    if (format == kAutoDetectFormat) {
+        if (EndsWithIgnoreCase(fname, ".mgf")) {
+            format = kMgfFormat;
+        } else if (EndsWithIgnoreCase(fname, ".mzml")) {
+            format = kMzMLFormat;
+        } else {
+            return Status::InvalidArgument(fname,
+                                           "unknown spectrum file format");
+        }
+    }
+    if (options.max_pending_chunks < 1) {
+        return Status::InvalidArgument("max_pending_chunks must be positive");
+    }
+
+    SequentialFile* file;
+    Status s = Env::Default()->NewSequentialFile(fname, &file);
+    if (!s.IsOk()) {
+        return s;
+    }
+    SpectrumImporter importer(db, file, format, options);
+    s = importer.Run(stats);
+    delete file;
+    return s;
+}
+
+}  // namespace massdb
@@ -0,0 +1,392 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "massdb/importer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "massdb/db.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "massdb/spectrum.h"
+#include "util/coding.h"
+#include "util/compression.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+namespace {
+
+// 测试文件中的一个谱图
+struct TestSpectrum {
+    double precursor_mz;
+    int charge;
+    bool has_scan;
+    uint64_t scan;
+    std::vector<std::pair<double, float>> peaks;  // 文件中的顺序
+};
+
+std::string Format(const char* fmt, double v) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), fmt, v);
+    return buf;
+}
+
+// 导入之后 spectrum 应该对应的 key 和 value。
+// 没有扫描号时使用 ordinal，即谱图在文件中的序号
+void AddExpected(const TestSpectrum& spectrum, uint64_t ordinal,
+                 uint32_t file_id, std::map<std::string, std::string>* model) {
+    std::vector<std::pair<double, float>> peaks = spectrum.peaks;
+    std::sort(peaks.begin(), peaks.end());
+    std::vector<double> mz;
+    std::vector<float> intensity;
+    for (const auto& peak : peaks) {
+        mz.push_back(peak.first);
+        intensity.push_back(peak.second);
+    }
+    const uint64_t scan = spectrum.has_scan ? spectrum.scan : ordinal;
+    std::string key, value;
+    EncodeSpectrumKey(spectrum.precursor_mz, spectrum.charge,
+                      static_cast<uint64_t>(file_id) << 32 | scan, &key);
+    EncodePeakList(mz.data(), intensity.data(), mz.size(), &value);
+    (*model)[key] = value;  // 后出现的谱图覆盖先出现的
+}
+
+// 随机生成谱图，其中一部分与之前的谱图 key 相同
+std::vector<TestSpectrum> RandomSpectra(Random* rnd, int n) {
+    std::vector<TestSpectrum> result;
+    for (int i = 0; i < n; i++) {
+        TestSpectrum s;
+        if (i > 0 && rnd->OneIn(10)) {
+            s = result[rnd->Uniform(i)];
+        } else {
+            s.precursor_mz = 300.0 + rnd->Uniform(1000000) / 997.0;
+            s.charge = 1 + rnd->Uniform(4);
+            s.has_scan = !rnd->OneIn(4);
+            s.scan = 1000 + rnd->Uniform(100000);
+        }
+        s.peaks.clear();
+        const int peaks = rnd->Uniform(40);
+        for (int p = 0; p < peaks; p++) {
+            s.peaks.emplace_back(100.0 + rnd->Uniform(2000000) / 1009.0,
+                                 static_cast<float>(rnd->Uniform(100000)) / 7);
+        }
+        result.push_back(s);
+    }
+    return result;
+}
+
+// 编码成 MGF。有扫描号的谱图交替使用 SCANS 和 TITLE 中的 scan=，
+// 并混入注释、空行和 CRLF 换行
+std::string ToMgf(const std::vector<TestSpectrum>& spectra) {
+    std::string mgf = "# generated\nMASS=Monoisotopic\n\n";
+    for (size_t i = 0; i < spectra.size(); i++) {
+        const TestSpectrum& s = spectra[i];
+        const char* eol = (i % 3 == 0) ? "\r\n" : "\n";
+        mgf += "BEGIN IONS";
+        mgf += eol;
+        if (s.has_scan && i % 2 == 0) {
+            mgf += "TITLE=run.raw NativeID:\"controllerType=0 scan=" +
+                   std::to_string(s.scan) + "\"" + eol;
+        } else {
+            mgf += "TITLE=spectrum " + std::to_string(i) + eol;
+            if (s.has_scan) {
+                mgf += "SCANS=" + std::to_string(s.scan) + eol;
+            }
+        }
+        mgf += "PEPMASS=" + Format("%.17g", s.precursor_mz) + " 12345.6" + eol;
+        mgf += "CHARGE=" + std::to_string(s.charge) + "+" + eol;
+        for (const auto& peak : s.peaks) {
+            mgf += Format("%.17g", peak.first) + " " +
+                   Format("%.9g", peak.second) + eol;
+        }
+        mgf += "END IONS";
+        mgf += eol;
+        mgf += eol;
+    }
+    return mgf;
+}
+
+std::string EncodeBase64(const std::string& data) {
+    static const char kAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        const uint32_t v = static_cast<uint8_t>(data[i]) << 16 |
+                           static_cast<uint8_t>(data[i + 1]) << 8 |
+                           static_cast<uint8_t>(data[i + 2]);
+        result.push_back(kAlphabet[v >> 18]);
+        result.push_back(kAlphabet[(v >> 12) & 63]);
+        result.push_back(kAlphabet[(v >> 6) & 63]);
+        result.push_back(kAlphabet[v & 63]);
+    }
+    if (i + 1 == data.size()) {
+        const uint32_t v = static_cast<uint8_t>(data[i]) << 16;
+        result.push_back(kAlphabet[v >> 18]);
+        result.push_back(kAlphabet[(v >> 12) & 63]);
+        result += "==";
+    } else if (i + 2 == data.size()) {
+        const uint32_t v = static_cast<uint8_t>(data[i]) << 16 |
+                           static_cast<uint8_t>(data[i + 1]) << 8;
+        result.push_back(kAlphabet[v >> 18]);
+        result.push_back(kAlphabet[(v >> 12) & 63]);
+        result.push_back(kAlphabet[(v >> 6) & 63]);
+        result.push_back('=');
+    }
+    return result;
+}
+
+std::string CvParam(const char* accession, const std::string& value = "") {
+    std::string result = "<cvParam cvRef=\"MS\" accession=\"";
+    result += accession;
+    result += "\" name=\"x\"";
+    if (!value.empty()) {
+        result += " value=\"" + value + "\"";
+    }
+    return result + "/>\n";
+}
+
+// 编码成 mzML：m/z 为未压缩的 64 位浮点数，强度为 32 位浮点数，
+// zlib 可用时压缩强度数组。每隔几个谱图插入一个一级谱
+std::string ToMzML(const std::vector<TestSpectrum>& spectra) {
+    const CompressionCodec* zlib = GetCompressionCodec(kZlibCompression);
+    std::string xml =
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<mzML>\n<run>\n"
+        "<spectrumList count=\"" +
+        std::to_string(spectra.size()) + "\">\n";
+    for (size_t i = 0; i < spectra.size(); i++) {
+        const TestSpectrum& s = spectra[i];
+        const std::string n = std::to_string(s.peaks.size());
+        if (i % 5 == 4) {
+            xml += "<spectrum id=\"scan=1\" defaultArrayLength=\"0\">\n" +
+                   CvParam("MS:1000511", "1") + "</spectrum>\n";
+        }
+        // 没有扫描号的谱图不写 id 中的 scan= 和 index
+        xml += "<spectrum";
+        if (s.has_scan) {
+            xml += " index=\"" + std::to_string(i) +
+                   "\" id=\"controllerType=0 controllerNumber=1 scan=" +
+                   std::to_string(s.scan) + "\"";
+        } else {
+            xml += " id=\"spectrum" + std::to_string(i) + "\"";
+        }
+        xml += " defaultArrayLength=\"" + n + "\">\n";
+        xml += CvParam("MS:1000511", "2");
+        xml += "<precursorList count=\"1\"><precursor><selectedIonList>\n";
+        xml += CvParam("MS:1000744", Format("%.17g", s.precursor_mz));
+        xml += CvParam("MS:1000041", std::to_string(s.charge));
+        xml += "</selectedIonList></precursor></precursorList>\n";
+
+        std::string mz, intensity;
+        for (const auto& peak : s.peaks) {
+            uint64_t bits;
+            std::memcpy(&bits, &peak.first, sizeof(bits));
+            PutFixed64(&mz, bits);
+            uint32_t fbits;
+            std::memcpy(&fbits, &peak.second, sizeof(fbits));
+            PutFixed32(&intensity, fbits);
+        }
+        const bool compress = zlib != nullptr && i % 2 == 0;
+        if (compress) {
+            std::string compressed;
+            EXPECT_TRUE(zlib->Compress(intensity, 0, &compressed));
+            intensity.swap(compressed);
+        }
+        xml += "<binaryDataArrayList count=\"2\">\n";
+        xml += "<binaryDataArray encodedLength=\"0\">\n" +
+               CvParam("MS:1000523") + CvParam("MS:1000576") +
+               CvParam("MS:1000514") + "<binary>" + EncodeBase64(mz) +
+               "</binary>\n</binaryDataArray>\n";
+        xml += "<binaryDataArray arrayLength=\"" + n + "\">\n" +
+               CvParam("MS:1000521") +
+               CvParam(compress ? "MS:1000574" : "MS:1000576") +
+               CvParam("MS:1000515") + "<binary>" + EncodeBase64(intensity) +
+               "</binary>\n</binaryDataArray>\n";
+        xml += "</binaryDataArrayList>\n</spectrum>\n";
+    }
+    xml += "</spectrumList>\n</run>\n</mzML>\n";
+    return xml;
+}
+
+}  // namespace
+
+class ImporterTest : public testing::Test {
+public:
+    ImporterTest()
+        : env_(Env::Default()),
+          dbname_(test::NewTestDirectory("importer_test")),
+          db_(nullptr) {
+        options_.create_if_missing = true;
+        DestroyAndReopen();
+    }
+
+    ~ImporterTest() override {
+        delete db_;
+        test::DestroyDirectory(env_, dbname_);
+    }
+
+    void DestroyAndReopen() {
+        delete db_;
+        db_ = nullptr;
+        test::DestroyDirectory(env_, dbname_);
+        ASSERT_TRUE(DB::Open(options_, dbname_, &db_).IsOk());
+    }
+
+    // 把 contents 写入数据库目录外的文件 name，返回文件名
+    std::string WriteFile(const std::string& name,
+                          const std::string& contents) {
+        const std::string fname = dbname_ + "-" + name;
+        WritableFile* file;
+        EXPECT_TRUE(env_->NewWritableFile(fname, &file).IsOk());
+        EXPECT_TRUE(file->Append(contents).IsOk());
+        EXPECT_TRUE(file->Close().IsOk());
+        delete file;
+        files_.push_back(fname);
+        return fname;
+    }
+
+    std::map<std::string, std::string> Contents() {
+        std::map<std::string, std::string> result;
+        Iterator* iter = db_->NewIterator(ReadOptions());
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            result[iter->key().to_string()] = iter->value().to_string();
+        }
+        EXPECT_TRUE(iter->status().IsOk());
+        delete iter;
+        return result;
+    }
+
+    void TearDown() override {
+        for (const std::string& fname : files_) {
+            env_->RemoveFile(fname);
+        }
+    }
+
+    Env* const env_;
+    const std::string dbname_;
+    Options options_;
+    DB* db_;
+    std::vector<std::string> files_;
+};
+
+TEST_F(ImporterTest, MgfFields) {
+    const std::string mgf =
+        "SEARCH=MIS\n"
+        "BEGIN IONS\n"
+        "TITLE=a.raw scan=42\n"
+        "PEPMASS=500.25 1000\n"
+        "CHARGE=3-\n"
+        "  200.5 10\n"
+        "100.25\t20.5\r\n"
+        "150 \n"
+        "END IONS\n"
+        "BEGIN IONS\n"
+        "TITLE=no precursor\n"
+        "100 1\n"
+        "END IONS\n"
+        "BEGIN IONS\n"
+        "SCANS=7\n"
+        "TITLE=scan=99\n"
+        "PEPMASS=600\n"
+        "END IONS\n"
+        "BEGIN IONS\n"
+        "PEPMASS=700\n"
+        "100 1\n";  // 文件末尾被截断
+
+    ImportOptions import_options;
+    import_options.file_id = 5;
+    ImportStats stats;
+    ASSERT_TRUE(ImportSpectra(db_, WriteFile("fields.mgf", mgf),
+                              import_options, &stats)
+                    .IsOk());
+    ASSERT_EQ(2u, stats.spectra);
+    ASSERT_EQ(2u, stats.skipped);
+    ASSERT_EQ(mgf.size(), stats.bytes_read);
+
+    // 峰按 m/z 排序，没有强度的峰强度为 0；SCANS 优先于 TITLE
+    std::map<std::string, std::string> expected;
+    AddExpected({500.25, -3, true, 42,
+                 {{200.5, 10.0f}, {100.25, 20.5f}, {150, 0.0f}}},
+                0, 5, &expected);
+    AddExpected({600, 0, true, 7, {}}, 2, 5, &expected);
+    ASSERT_EQ(expected, Contents());
+}
+
+TEST_F(ImporterTest, MgfChunksAndDuplicates) {
+    Random rnd(301);
+    const std::vector<TestSpectrum> spectra = RandomSpectra(&rnd, 400);
+    std::map<std::string, std::string> expected;
+    for (size_t i = 0; i < spectra.size(); i++) {
+        AddExpected(spectra[i], i, 0, &expected);
+    }
+    const std::string fname = WriteFile("chunks.mgf", ToMgf(spectra));
+
+    // 块的大小依次错开一个字节，结束标记会在不同的位置跨过读取的边界
+    for (size_t extra = 0; extra <= std::strlen("END IONS"); extra++) {
+        for (int bulk = 0; bulk < 2; bulk++) {
+            DestroyAndReopen();
+            ImportOptions import_options;
+            import_options.chunk_size = 4096 + extra;
+            import_options.parse_threads = 3;
+            import_options.max_pending_chunks = 2;
+            import_options.bulk_load = (bulk == 1);
+            ImportStats stats;
+            ASSERT_TRUE(ImportSpectra(db_, fname, import_options, &stats)
+                            .IsOk());
+            ASSERT_EQ(spectra.size(), stats.spectra);
+            ASSERT_EQ(0u, stats.skipped);
+            ASSERT_EQ(expected, Contents())
+                << "chunk size " << import_options.chunk_size << " bulk "
+                << bulk;
+        }
+    }
+}
+
+TEST_F(ImporterTest, MzML) {
+    Random rnd(301);
+    const std::vector<TestSpectrum> spectra = RandomSpectra(&rnd, 200);
+    std::map<std::string, std::string> expected;
+    uint64_t ordinal = 0;
+    for (size_t i = 0; i < spectra.size(); i++) {
+        if (i % 5 == 4) {
+            ordinal++;  // 一级谱也占用一个序号
+        }
+        AddExpected(spectra[i], ordinal++, 1, &expected);
+    }
+    const std::string fname = WriteFile("run.mzML", ToMzML(spectra));
+
+    for (size_t extra = 0; extra <= std::strlen("</spectrum>"); extra += 3) {
+        DestroyAndReopen();
+        ImportOptions import_options;
+        import_options.chunk_size = 4096 + extra;
+        import_options.file_id = 1;
+        ImportStats stats;
+        ASSERT_TRUE(ImportSpectra(db_, fname, import_options, &stats).IsOk());
+        ASSERT_EQ(spectra.size(), stats.spectra);
+        ASSERT_EQ(spectra.size() / 5, stats.skipped);
+        ASSERT_EQ(expected, Contents());
+    }
+}
+
+TEST_F(ImporterTest, UnknownFormat) {
+    const std::string fname = WriteFile("spectra.txt", "BEGIN IONS\n");
+    ASSERT_TRUE(ImportSpectra(db_, fname, ImportOptions(), nullptr)
+                    .IsInvalidArgument());
+    ImportOptions import_options;
+    import_options.format = kMgfFormat;
+    ASSERT_TRUE(ImportSpectra(db_, fname, import_options, nullptr).IsOk());
+    ASSERT_TRUE(Contents().empty());
+}
+
+}  // namespace massdb
@@ -0,0 +1,42 @@
+//
+// Created by Xsakura on 2023/4/29.
+//
+
+// 日志文件的格式：
+// 文件由一系列 32KB 的块组成，每个块中存放若干条记录（record）的片段。
+// 一条记录可能跨越多个块，被拆分为 FIRST、MIDDLE、LAST 几个片段。
+// 每个片段的格式：
+//     checksum: uint32  // type 和 data 的 crc32c
+//     length: uint16    // data 的长度
+//     type: uint8       // 片段类型
+//     data: uint8[length]
+// 块的剩余空间不足以放下片段头部时用 0 填充
+
+#ifndef MASSDB_DB_LOG_FORMAT_H
+#define MASSDB_DB_LOG_FORMAT_H
+
+namespace massdb {
+namespace log {
+
+enum RecordType {
+    // 保留给预分配的文件使用
+    kZeroType = 0,
+
+    kFullType = 1,
+
+    // 记录被拆分成多个片段时使用
+    kFirstType = 2,
+    kMiddleType = 3,
+    kLastType = 4
+};
+static const int kMaxRecordType = kLastType;
+
+static const int kBlockSize = 32768;
+
+// 片段头部：checksum (4 bytes), length (2 bytes), type (1 byte)
+static const int kHeaderSize = 4 + 2 + 1;
+
+}  // namespace log
+}  // namespace massdb
+
+#endif  // MASSDB_DB_LOG_FORMAT_H
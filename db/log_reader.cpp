@@ -0,0 +1,185 @@
+//
+// Created by Xsakura on 2023/4/29.
+//
+
+#include "db/log_reader.h"
+
+#include <cstdio>
+
+#include "massdb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace massdb {
+namespace log {
+
+Reader::Reporter::~Reporter() = default;
+
+Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum)
+    : file_(file),
+      reporter_(reporter),
+      checksum_(checksum),
+      backing_store_(new char[kBlockSize]),
+      buffer_(),
+      eof_(false) {}
+
+Reader::~Reader() { delete[] backing_store_; }
+
+bool Reader::ReadRecord(Slice* record, std::string* scratch) {
+    scratch->clear();
+    record->clear();
+    bool in_fragmented_record = false;
+
+    Slice fragment;
+    while (true) {
+        const unsigned int record_type = ReadPhysicalRecord(&fragment);
+        switch (record_type) {
+            case kFullType:
+                if (in_fragmented_record && !scratch->empty()) {
+                    ReportCorruption(scratch->size(),
+                                     "partial record without end(1)");
+                }
+                scratch->clear();
+                *record = fragment;
+                return true;
+
+            case kFirstType:
+                if (in_fragmented_record && !scratch->empty()) {
+                    ReportCorruption(scratch->size(),
+                                     "partial record without end(2)");
+                }
+                scratch->assign(fragment.data(), fragment.size());
+                in_fragmented_record = true;
+                break;
+
+            case kMiddleType:
+                if (!in_fragmented_record) {
+                    ReportCorruption(fragment.size(),
+                                     "missing start of fragmented record(1)");
+                } else {
+                    scratch->append(fragment.data(), fragment.size());
+                }
+                break;
+
+            case kLastType:
+                if (!in_fragmented_record) {
+                    ReportCorruption(fragment.size(),
+                                     "missing start of fragmented record(2)");
+                } else {
+                    scratch->append(fragment.data(), fragment.size());
+                    *record = Slice(*scratch);
+                    return true;
+                }
+                break;
+
+            case kEof:
+                // 写者可能在写完一条记录之前崩溃了，
+                // 末尾不完整的记录直接忽略，不报告错误
+                scratch->clear();
+                return false;
+
+            case kBadRecord:
+                if (in_fragmented_record) {
+                    ReportCorruption(scratch->size(),
+                                     "error in middle of record");
+                    in_fragmented_record = false;
+                    scratch->clear();
+                }
+                break;
+
+            default: {
+                char buf[40];
+                std::snprintf(buf, sizeof(buf), "unknown record type %u",
+                              record_type);
+                ReportCorruption((fragment.size() +
+                                  (in_fragmented_record ? scratch->size() : 0)),
+                                 buf);
+                in_fragmented_record = false;
+                scratch->clear();
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+void Reader::ReportCorruption(uint64_t bytes, const char* reason) {
+    ReportDrop(bytes, Status::Corruption(reason));
+}
+
+void Reader::ReportDrop(uint64_t bytes, const Status& reason) {
+    if (reporter_ != nullptr) {
+        reporter_->Corruption(static_cast<size_t>(bytes), reason);
+    }
+}
+
+unsigned int Reader::ReadPhysicalRecord(Slice* result) {
+    while (true) {
+        if (buffer_.size() < kHeaderSize) {
+            if (!eof_) {
+                // 上一次读到的是一个完整的块，剩余的部分是块尾的填充，跳过它
+                buffer_.clear();
+                Status status =
+                    file_->Read(kBlockSize, &buffer_, backing_store_);
+                if (!status.IsOk()) {
+                    buffer_.clear();
+                    ReportDrop(kBlockSize, status);
+                    eof_ = true;
+                    return kEof;
+                } else if (buffer_.size() < kBlockSize) {
+                    eof_ = true;
+                }
+                continue;
+            } else {
+                // 文件末尾有一个不完整的片段头部，
+                // 可能是写者在写头部的过程中崩溃了，不报告错误
+                buffer_.clear();
+                return kEof;
+            }
+        }
+
+        // 解析片段头部
+        const char* header = buffer_.data();
+        const uint32_t a = static_cast<uint32_t>(header[4]) & 0xff;
+        const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
+        const unsigned int type = header[6];
+        const uint32_t length = a | (b << 8);
+        if (kHeaderSize + length > buffer_.size()) {
+            size_t drop_size = buffer_.size();
+            buffer_.clear();
+            if (!eof_) {
+                ReportCorruption(drop_size, "bad record length");
+                return kBadRecord;
+            }
+            // 文件末尾的片段不完整，可能是写者在写数据的过程中崩溃了，
+            // 不报告错误
+            return kEof;
+        }
+
+        if (type == kZeroType && length == 0) {
+            // 预分配的文件中全为 0 的区域，跳过而不报告错误
+            buffer_.clear();
+            return kBadRecord;
+        }
+
+        // 校验 crc
+        if (checksum_) {
+            uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
+            uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+            if (actual_crc != expected_crc) {
+                // 长度字段本身可能已经损坏，丢弃整个缓冲区
+                size_t drop_size = buffer_.size();
+                buffer_.clear();
+                ReportCorruption(drop_size, "checksum mismatch");
+                return kBadRecord;
+            }
+        }
+
+        buffer_.remove_prefix(kHeaderSize + length);
+        *result = Slice(header + kHeaderSize, length);
+        return type;
+    }
+}
+
+}  // namespace log
+}  // namespace massdb
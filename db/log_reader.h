@@ -0,0 +1,79 @@
+//
+// Created by Xsakura on 2023/4/29.
+//
+
+#ifndef MASSDB_DB_LOG_READER_H
+#define MASSDB_DB_LOG_READER_H
+
+#include <cstdint>
+#include <string>
+
+#include "db/log_format.h"
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class SequentialFile;
+
+namespace log {
+
+class Reader {
+public:
+    // 用于报告数据损坏的接口
+    class Reporter {
+    public:
+        virtual ~Reporter();
+
+        // 发现了数据损坏。bytes 是因为损坏而丢弃的大致字节数
+        virtual void Corruption(size_t bytes, const Status& status) = 0;
+    };
+
+    // 创建一个从 *file 中读取记录的 Reader。
+    // *file 在 Reader 的生命周期内必须一直有效。
+    //
+    // reporter 不为 nullptr 时，发现数据损坏会通过它报告，
+    // 它在 Reader 的生命周期内也必须一直有效。
+    //
+    // checksum 为 true 时校验每个片段的 crc
+    Reader(SequentialFile* file, Reporter* reporter, bool checksum);
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    ~Reader();
+
+    // 将下一条记录读到 *record 中。读到时返回 true，到达文件末尾时返回 false。
+    // *record 可能使用 *scratch 作为临时存储，
+    // 它只在下次修改 Reader 或者修改 *scratch 之前有效
+    bool ReadRecord(Slice* record, std::string* scratch);
+
+private:
+    // ReadPhysicalRecord 使用的额外类型
+    enum {
+        kEof = kMaxRecordType + 1,
+        // 遇到了无效的片段，可能是：
+        // * crc 校验失败（ReadPhysicalRecord 会报告错误）
+        // * 长度为 0 的片段（不报告错误）
+        kBadRecord = kMaxRecordType + 2
+    };
+
+    // 返回片段的类型，或者上面的特殊值之一
+    unsigned int ReadPhysicalRecord(Slice* result);
+
+    // 通过 reporter 报告丢弃的字节数
+    void ReportCorruption(uint64_t bytes, const char* reason);
+    void ReportDrop(uint64_t bytes, const Status& reason);
+
+    SequentialFile* const file_;
+    Reporter* const reporter_;
+    bool const checksum_;
+    char* const backing_store_;
+    Slice buffer_;
+    bool eof_;  // 上一次 Read() 读到的数据小于 kBlockSize 时为 true
+};
+
+}  // namespace log
+}  // namespace massdb
+
+#endif  // MASSDB_DB_LOG_READER_H
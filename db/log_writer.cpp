@@ -0,0 +1,113 @@
+//
+// Created by Xsakura on 2023/4/29.
+//
+
+#include "db/log_writer.h"
+
+#include <cassert>
+#include <cstdint>
+
+#include "massdb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace massdb {
+namespace log {
+
+static void InitTypeCrc(uint32_t* type_crc) {
+    for (int i = 0; i <= kMaxRecordType; i++) {
+        char t = static_cast<char>(i);
+        type_crc[i] = crc32c::Value(&t, 1);
+    }
+}
+
+Writer::Writer(WritableFile* dest) : dest_(dest), block_offset_(0) {
+    InitTypeCrc(type_crc_);
+}
+
+Writer::Writer(WritableFile* dest, uint64_t dest_length)
+    : dest_(dest), block_offset_(dest_length % kBlockSize) {
+    InitTypeCrc(type_crc_);
+}
+
+Writer::~Writer() = default;
+
+Status Writer::AddRecord(const Slice& slice) {
+    const char* ptr = slice.data();
+    size_t left = slice.size();
+
+    // 必要时将记录拆分成多个片段。
+    // 即使 slice 为空，也要写入一个长度为 0 的片段
+    Status s;
+    bool begin = true;
+    do {
+        const int leftover = kBlockSize - block_offset_;
+        assert(leftover >= 0);
+        if (leftover < kHeaderSize) {
+            // 切换到新的块
+            if (leftover > 0) {
+                // 用 0 填充块的剩余部分
+                static_assert(kHeaderSize == 7, "");
+                dest_->Append(Slice("\x00\x00\x00\x00\x00\x00", leftover));
+            }
+            block_offset_ = 0;
+        }
+
+        // 不变式：块中至少剩余 kHeaderSize 个字节
+        assert(kBlockSize - block_offset_ - kHeaderSize >= 0);
+
+        const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+        const size_t fragment_length = (left < avail) ? left : avail;
+
+        RecordType type;
+        const bool end = (left == fragment_length);
+        if (begin && end) {
+            type = kFullType;
+        } else if (begin) {
+            type = kFirstType;
+        } else if (end) {
+            type = kLastType;
+        } else {
+            type = kMiddleType;
+        }
+
+        s = EmitPhysicalRecord(type, ptr, fragment_length);
+        ptr += fragment_length;
+        left -= fragment_length;
+        begin = false;
+    } while (s.IsOk() && left > 0);
+
+    // 所有片段写入缓冲区之后一次性交给操作系统
+    if (s.IsOk()) {
+        s = dest_->Flush();
+    }
+    return s;
+}
+
+Status Writer::EmitPhysicalRecord(RecordType t, const char* ptr,
+                                  size_t length) {
+    assert(length <= 0xffff);  // 长度必须能用两个字节表示
+    assert(block_offset_ + kHeaderSize + length <= kBlockSize);
+
+    // 构造片段头部
+    char buf[kHeaderSize];
+    buf[4] = static_cast<char>(length & 0xff);
+    buf[5] = static_cast<char>(length >> 8);
+    buf[6] = static_cast<char>(t);
+
+    // 计算 type 和 data 的 crc
+    uint32_t crc = crc32c::Extend(type_crc_[t], ptr, length);
+    crc = crc32c::Mask(crc);  // 调整后再存储
+    EncodeFixed32(buf, crc);
+
+    // 写入头部和数据
+    Status s = dest_->Append(Slice(buf, kHeaderSize));
+    if (s.IsOk()) {
+        s = dest_->Append(Slice(ptr, length));
+    }
+    block_offset_ += kHeaderSize + length;
+    return s;
+}
+
+}  // namespace log
+}  // namespace massdb
@@ -0,0 +1,52 @@
+//
+// Created by Xsakura on 2023/4/29.
+//
+
+#ifndef MASSDB_DB_LOG_WRITER_H
+#define MASSDB_DB_LOG_WRITER_H
+
+#include <cstdint>
+
+#include "db/log_format.h"
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class WritableFile;
+
+namespace log {
+
+class Writer {
+public:
+    // 创建一个向 *dest 追加数据的 Writer。
+    // *dest 必须初始为空，并且在 Writer 的生命周期内一直有效
+    explicit Writer(WritableFile* dest);
+
+    // 创建一个向 *dest 追加数据的 Writer。
+    // *dest 的初始长度必须为 dest_length
+    Writer(WritableFile* dest, uint64_t dest_length);
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer();
+
+    // 追加一条记录，并将其交给操作系统（一次 write() 调用）
+    Status AddRecord(const Slice& slice);
+
+private:
+    Status EmitPhysicalRecord(RecordType type, const char* ptr, size_t length);
+
+    WritableFile* dest_;
+    int block_offset_;  // 当前块中已经写入的字节数
+
+    // 预先计算好的所有片段类型的 crc32c，
+    // 用于减少计算片段头部中 crc 的开销
+    uint32_t type_crc_[kMaxRecordType + 1];
+};
+
+}  // namespace log
+}  // namespace massdb
+
+#endif  // MASSDB_DB_LOG_WRITER_H
@@ -0,0 +1,141 @@
+//
+// Created by Xsakura on 2023/6/25.
+//
+
+// 将 MGF 或 mzML 格式的谱图文件导入数据库：
+//    massdb_import [选项] <数据库目录> <文件>...
+//
+// 选项：
+//    --threads=N             解析线程数（默认 4）
+//    --chunk_size=N          每次读取的字节数（默认 4MB）
+//    --max_pending_chunks=N  读取但还没有写入的块数上限（默认 16）
+//    --first_file_id=N       第一个文件的编号，之后的文件依次加一（默认 0）
+//    --bulk_load=0|1         通过批量导入写入（默认 0）
+//    --memory_budget=N       批量导入的内存上限（默认 256MB）
+//    --spectrum_comparator=0|1
+//                            使用 SpectrumKeyComparator()（默认 0），
+//                            打开已有的数据库时必须与创建时一致
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "massdb/db.h"
+#include "massdb/importer.h"
+#include "massdb/options.h"
+#include "massdb/spectrum.h"
+
+namespace massdb {
+namespace {
+
+void Usage() {
+    std::fprintf(stderr,
+                 "Usage: massdb_import [--threads=N] [--chunk_size=N]\n"
+                 "           [--max_pending_chunks=N] [--first_file_id=N]\n"
+                 "           [--bulk_load=0|1] [--memory_budget=N]\n"
+                 "           [--spectrum_comparator=0|1] <dbname> <file>...\n");
+}
+
+bool Run(int argc, char** argv) {
+    ImportOptions import_options;
+    Options options;
+    options.create_if_missing = true;
+    unsigned long long n;
+    int flag;
+    char junk;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        if (std::sscanf(argv[i], "--threads=%d%c", &flag, &junk) == 1) {
+            import_options.parse_threads = flag;
+        } else if (std::sscanf(argv[i], "--chunk_size=%llu%c", &n, &junk) ==
+                   1) {
+            import_options.chunk_size = n;
+        } else if (std::sscanf(argv[i], "--max_pending_chunks=%d%c", &flag,
+                               &junk) == 1) {
+            import_options.max_pending_chunks = flag;
+        } else if (std::sscanf(argv[i], "--first_file_id=%llu%c", &n,
+                               &junk) == 1) {
+            import_options.file_id = static_cast<uint32_t>(n);
+        } else if (std::sscanf(argv[i], "--bulk_load=%d%c", &flag, &junk) ==
+                       1 &&
+                   (flag == 0 || flag == 1)) {
+            import_options.bulk_load = flag;
+        } else if (std::sscanf(argv[i], "--memory_budget=%llu%c", &n,
+                               &junk) == 1) {
+            import_options.bulk_load_options.memory_budget = n;
+        } else if (std::sscanf(argv[i], "--spectrum_comparator=%d%c", &flag,
+                               &junk) == 1 &&
+                   (flag == 0 || flag == 1)) {
+            if (flag) {
+                options.comparator = SpectrumKeyComparator();
+            }
+        } else if (std::strncmp(argv[i], "--", 2) == 0) {
+            std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            return false;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.size() < 2) {
+        Usage();
+        return false;
+    }
+    import_options.bulk_load_options.max_threads =
+        import_options.parse_threads;
+
+    DB* db;
+    Status s = DB::Open(options, args[0], &db);
+    if (!s.IsOk()) {
+        std::fprintf(stderr, "%s\n", s.ToString().c_str());
+        return false;
+    }
+
+    ImportStats total;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 1; i < args.size() && s.IsOk(); i++) {
+        const auto file_start = std::chrono::steady_clock::now();
+        ImportStats stats;
+        s = ImportSpectra(db, args[i], import_options, &stats);
+        const double seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() -
+                                   file_start)
+                                   .count();
+        std::fprintf(stdout,
+                     "%s: %llu spectra, %llu skipped, %.1f MB in %.2f s "
+                     "(%.1f MB/s)\n",
+                     args[i].c_str(),
+                     static_cast<unsigned long long>(stats.spectra),
+                     static_cast<unsigned long long>(stats.skipped),
+                     stats.bytes_read / 1048576.0, seconds,
+                     stats.bytes_read / 1048576.0 / seconds);
+        if (!s.IsOk()) {
+            std::fprintf(stderr, "%s: %s\n", args[i].c_str(),
+                         s.ToString().c_str());
+        }
+        total.bytes_read += stats.bytes_read;
+        total.spectra += stats.spectra;
+        total.skipped += stats.skipped;
+        total.bytes_written += stats.bytes_written;
+        import_options.file_id++;
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    std::fprintf(stdout,
+                 "total: %llu spectra (%.0f/s), %llu skipped, "
+                 "read %.1f MB/s, wrote %.1f MB/s\n",
+                 static_cast<unsigned long long>(total.spectra),
+                 total.spectra / seconds,
+                 static_cast<unsigned long long>(total.skipped),
+                 total.bytes_read / 1048576.0 / seconds,
+                 total.bytes_written / 1048576.0 / seconds);
+    delete db;
+    return s.IsOk();
+}
+
+}  // namespace
+}  // namespace massdb
+
+int main(int argc, char** argv) { return massdb::Run(argc, argv) ? 0 : 1; }
@@ -0,0 +1,186 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#include "db/memtable.h"
+
+namespace massdb {
+
+// 从带长度前缀的数据中取出 Slice
+static Slice GetLengthPrefixedSlice(const char* data) {
+    uint32_t len;
+    const char* p = data;
+    p = GetVarint32Ptr(p, p + 5, &len);  // 假设 p 之后至少有 5 个字节
+    return Slice(p, len);
+}
+
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   size_t arena_block_size, size_t huge_page_size)
+    : comparator_(comparator),
+      refs_(0),
+      arena_(arena_block_size, huge_page_size),
+      table_(comparator_, &arena_) {}
+
+MemTable::~MemTable() { assert(refs_ == 0); }
+
+size_t MemTable::ApproximateMemoryUsage() { return arena_.memory_usage(); }
+
+MemTable::KeyComparator::KeyComparator(const InternalKeyComparator& c)
+    : comparator(c),
+      bytewise_prefix(c.user_key_kind() !=
+                      InternalKeyComparator::kOtherUserKey) {}
+
+uint64_t MemTable::KeyComparator::Prefix(const char* key) const {
+    if (!bytewise_prefix) {
+        // 其他比较器的顺序和字节序无关，所有前缀都相等，总是比较完整的 key
+        return 0;
+    }
+    uint32_t key_length;
+    const char* key_ptr = GetVarint32Ptr(key, key + 5, &key_length);
+    return DecodeBigEndianPrefix(key_ptr, key_length - 8);
+}
+
+int MemTable::KeyComparator::operator()(const char* aptr,
+                                        const char* bptr) const {
+    // SkipList 中存储的都是带长度前缀的 internal key
+    Slice a = GetLengthPrefixedSlice(aptr);
+    Slice b = GetLengthPrefixedSlice(bptr);
+    return comparator.CompareKeys(a, b);
+}
+
+// 将 target 编码成带长度前缀的 internal key 放入 scratch 中，
+// 并返回指向它的指针
+static const char* EncodeKey(std::string* scratch, const Slice& target) {
+    scratch->clear();
+    PutVarint32(scratch, target.size());
+    scratch->append(target.data(), target.size());
+    return scratch->data();
+}
+
+class MemTableIterator : public Iterator {
+public:
+    explicit MemTableIterator(MemTable::Table* table) : iter_(table) {}
+
+    MemTableIterator(const MemTableIterator&) = delete;
+    MemTableIterator& operator=(const MemTableIterator&) = delete;
+
+    ~MemTableIterator() override = default;
+
+    bool Valid() const override { return iter_.Valid(); }
+    void Seek(const Slice& k) override { iter_.Seek(EncodeKey(&tmp_, k)); }
+    void SeekToFirst() override { iter_.SeekToFirst(); }
+    void SeekToLast() override { iter_.SeekToLast(); }
+    void Next() override { iter_.Next(); }
+    void Prev() override { iter_.Prev(); }
+    Slice key() const override { return GetLengthPrefixedSlice(iter_.key()); }
+    Slice value() const override {
+        Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+        return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
+    }
+
+    Status status() const override { return Status::Ok(); }
+
+private:
+    MemTable::Table::Iterator iter_;
+    std::string tmp_;  // 用于给 Seek() 编码 key
+};
+
+Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
+
+size_t MemTable::EncodedLength(const Slice& key, const Slice& value) {
+    size_t internal_key_size = key.size() + 8;
+    return VarintLength(internal_key_size) + internal_key_size +
+           VarintLength(value.size()) + value.size();
+}
+
+void MemTable::EncodeEntry(char* buf, SequenceNumber s, ValueType type,
+                           const Slice& key, const Slice& value) {
+    // 条目的格式：
+    //    key_size     : varint32 of internal_key.size()
+    //    key bytes    : char[internal_key.size()]
+    //    tag          : uint64((sequence << 8) | type)
+    //    value_size   : varint32 of value.size()
+    //    value bytes  : char[value.size()]
+    size_t key_size = key.size();
+    size_t val_size = value.size();
+    char* p = EncodeVarint32(buf, key_size + 8);
+    std::memcpy(p, key.data(), key_size);
+    p += key_size;
+    EncodeFixed64(p, PackSequenceAndType(s, type));
+    p += 8;
+    p = EncodeVarint32(p, val_size);
+    std::memcpy(p, value.data(), val_size);
+    assert(p + val_size == buf + EncodedLength(key, value));
+}
+
+void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
+                   const Slice& value) {
+    char* buf = table_.AllocateKey(EncodedLength(key, value));
+    EncodeEntry(buf, s, type, key, value);
+    table_.Insert(buf);
+}
+
+void MemTable::ConcurrentAdd(SequenceNumber s, ValueType type,
+                             const Slice& key, const Slice& value) {
+    char* buf = table_.AllocateKey(EncodedLength(key, value));
+    EncodeEntry(buf, s, type, key, value);
+    table_.ConcurrentInsert(buf);
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+    Slice memkey = key.memtable_key();
+    Table::Iterator iter(&table_);
+    iter.Seek(memkey.data());
+    return GetFromEntry(iter.Valid() ? iter.key() : nullptr, key, value, s);
+}
+
+void MemTable::MultiGet(const LookupKey* const* keys, size_t n,
+                        std::string* values, Status* statuses, bool* done) {
+    Table::Iterator iter(&table_);
+    for (size_t i = 0; i < n; i++) {
+        if (done[i]) {
+            continue;
+        }
+        iter.SeekForward(keys[i]->memtable_key().data());
+        done[i] = GetFromEntry(iter.Valid() ? iter.key() : nullptr, *keys[i],
+                               &values[i], &statuses[i]);
+    }
+}
+
+bool MemTable::GetFromEntry(const char* entry, const LookupKey& key,
+                            std::string* value, Status* s) const {
+    if (entry != nullptr) {
+        // 条目的格式：
+        //    klength  varint32
+        //    userkey  char[klength - 8]
+        //    tag      uint64
+        //    vlength  varint32
+        //    value    char[vlength]
+        // Seek 定位到的是第一个大于等于 memkey 的条目，
+        // 需要检查它是否属于同一个 user key。
+        // 这里不需要检查序列号，因为 Seek() 已经跳过了序列号更大的条目
+        uint32_t key_length;
+        const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
+        if (comparator_.comparator.user_comparator()->Compare(
+                Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
+            // 同一个 user key
+            const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+            switch (static_cast<ValueType>(tag & 0xff)) {
+                case kTypeValue: {
+                    Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+                    value->assign(v.data(), v.size());
+                    return true;
+                }
+                case kTypeDeletion:
+                    *s = Status::NotFound(Slice());
+                    return true;
+                case kTypeBlobIndex:
+                    // 只有 table 文件中才有 blob 引用
+                    break;
+            }
+        }
+    }
+    return false;
+}
+
+}  // namespace massdb
@@ -0,0 +1,114 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#ifndef MASSDB_DB_MEMTABLE_H
+#define MASSDB_DB_MEMTABLE_H
+
+#include <string>
+
+#include "db/dbformat.h"
+#include "db/skiptlist.h"
+#include "massdb/iterator.h"
+#include "util/concurrent_arena.h"
+
+namespace massdb {
+
+class MemTableIterator;
+
+// 内存中的写缓存，所有写操作都会先写入 MemTable。
+// MemTable 使用引用计数管理生命周期，初始引用计数为 0，
+// 调用者至少需要调用一次 Ref()
+class MemTable {
+public:
+    // arena_block_size 和 huge_page_size 用于构造 MemTable 使用的
+    // ConcurrentArena，含义见 Options 中的同名参数
+    explicit MemTable(const InternalKeyComparator& comparator,
+                      size_t arena_block_size = Arena::kMinBlockSize,
+                      size_t huge_page_size = 0);
+
+    MemTable(const MemTable&) = delete;
+    MemTable& operator=(const MemTable&) = delete;
+
+    // 增加引用计数
+    void Ref() { ++refs_; }
+
+    // 减少引用计数，引用计数为 0 时删除自身
+    void Unref() {
+        --refs_;
+        assert(refs_ >= 0);
+        if (refs_ <= 0) {
+            delete this;
+        }
+    }
+
+    // 返回这个 MemTable 使用的数据结构大概占用的字节数。
+    // 在 MemTable 被修改的同时调用也是安全的
+    size_t ApproximateMemoryUsage();
+
+    // 返回一个遍历 MemTable 内容的迭代器。
+    // 调用者需要保证迭代器存活期间 MemTable 也一直存活。
+    // 迭代器返回的 key 是 internal key（AppendInternalKey 编码的格式）
+    Iterator* NewIterator();
+
+    // 向 MemTable 中添加一个条目：在序列号 seq 下将 key 映射到 value，
+    // 如果 type == kTypeDeletion 的话 value 通常为空
+    void Add(SequenceNumber seq, ValueType type, const Slice& key,
+             const Slice& value);
+
+    // 与 Add() 相同，但允许多个线程同时调用。
+    // 要求：不能与 Add() 同时调用
+    void ConcurrentAdd(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
+    // 如果 MemTable 中有 key 对应的 value，将其存入 *value 并返回 true。
+    // 如果 MemTable 中有 key 对应的删除记录，将 NotFound() 存入 *s 并返回 true。
+    // 否则返回 false
+    bool Get(const LookupKey& key, std::string* value, Status* s);
+
+    // 依次查找 keys[0, n - 1] 中 done[i] 为 false 的 key，
+    // 要求 keys 按 internal key 升序排列。
+    // 每个 key 从上一个 key 的位置继续查找，整个过程只遍历一次 SkipList。
+    // 对于 Get() 会返回 true 的 key，结果存入 values[i] 和 statuses[i]，
+    // 并将 done[i] 设置为 true
+    void MultiGet(const LookupKey* const* keys, size_t n, std::string* values,
+                  Status* statuses, bool* done);
+
+private:
+    friend class MemTableIterator;
+
+    // 比较 SkipList 中带长度前缀的 internal key
+    struct KeyComparator {
+        const InternalKeyComparator comparator;
+        // user comparator 是按字节比较时，user key 的前 8 个字节
+        // 可以作为 SkipList 节点中缓存的有序前缀
+        const bool bytewise_prefix;
+        explicit KeyComparator(const InternalKeyComparator& c);
+        int operator()(const char* a, const char* b) const;
+        uint64_t Prefix(const char* key) const;
+    };
+
+    typedef SkipList<KeyComparator> Table;
+
+    // entry 是第一个大于等于 key 的条目（可能为 nullptr），
+    // 判断 key 的结果，含义同 Get()
+    bool GetFromEntry(const char* entry, const LookupKey& key,
+                      std::string* value, Status* s) const;
+
+    ~MemTable();  // 私有，只能通过 Unref() 删除
+
+    // 返回条目编码后的长度
+    static size_t EncodedLength(const Slice& key, const Slice& value);
+    // 将条目编码到 buf 中，buf 的长度为 EncodedLength(key, value)
+    static void EncodeEntry(char* buf, SequenceNumber seq, ValueType type,
+                            const Slice& key, const Slice& value);
+
+    KeyComparator comparator_;
+    int refs_;
+    ConcurrentArena arena_;
+    Table table_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_MEMTABLE_H
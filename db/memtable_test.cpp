@@ -0,0 +1,244 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "db/memtable.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "gtest/gtest.h"
+#include "massdb/comparator.h"
+#include "massdb/spectrum.h"
+#include "util/random.h"
+
+namespace massdb {
+
+namespace {
+
+// 与字节序相反的顺序，MemTable 不能使用缓存的前缀
+class ReverseComparator : public Comparator {
+public:
+    int Compare(const Slice& a, const Slice& b) const override {
+        return -BytewiseComparator()->Compare(a, b);
+    }
+    const char* Name() const override { return "massdb.test.Reverse"; }
+    void FindShortestSeparator(std::string*, const Slice&) const override {}
+    void FindShortestSuccessor(std::string*) const override {}
+};
+
+// 一个版本：序列号和 value，deleted 为 true 表示删除记录
+struct Version {
+    SequenceNumber sequence;
+    bool deleted;
+    std::string value;
+};
+
+// 生成长度和前缀都容易冲突的 key：短于 8 字节、前 8 字节相同、
+// 互为前缀，以及包含 '\0' 的 key
+std::string RandomKey(Random* rnd) {
+    static const char* const kPrefixes[] = {"", "a", "ab", "abcdefgh",
+                                            "abcdefghi", "zz"};
+    std::string key = kPrefixes[rnd->Uniform(6)];
+    const int extra = rnd->Uniform(4);
+    for (int i = 0; i < extra; i++) {
+        key.push_back(static_cast<char>("\0az\xff"[rnd->Uniform(4)]));
+    }
+    return key;
+}
+
+}  // namespace
+
+class MemTableReadTest : public testing::Test {
+public:
+    void Reset(const Comparator* ucmp) {
+        icmp_.reset(new InternalKeyComparator(ucmp));
+        if (mem_ != nullptr) mem_->Unref();
+        mem_ = new MemTable(*icmp_);
+        mem_->Ref();
+        model_.clear();
+    }
+
+    ~MemTableReadTest() override {
+        if (mem_ != nullptr) mem_->Unref();
+    }
+
+    void Add(SequenceNumber seq, ValueType type, const std::string& key,
+             const std::string& value) {
+        mem_->Add(seq, type, key, value);
+        model_[key].push_back(Version{seq, type == kTypeDeletion, value});
+    }
+
+    // 在快照 seq 下查找 key，格式与 DB 测试相同；MemTable 中没有时返回 "MISS"
+    std::string Get(const std::string& key, SequenceNumber seq) {
+        LookupKey lkey(key, seq);
+        std::string value;
+        Status s;
+        if (!mem_->Get(lkey, &value, &s)) {
+            return "MISS";
+        }
+        return s.IsNotFound() ? "NOT_FOUND" : value;
+    }
+
+    std::string Expected(const std::string& key, SequenceNumber seq) {
+        auto it = model_.find(key);
+        if (it == model_.end()) return "MISS";
+        const Version* best = nullptr;
+        for (const Version& v : it->second) {
+            if (v.sequence <= seq &&
+                (best == nullptr || v.sequence > best->sequence)) {
+                best = &v;
+            }
+        }
+        if (best == nullptr) return "MISS";
+        return best->deleted ? "NOT_FOUND" : best->value;
+    }
+
+    // 随机写入，再按随机的快照检查 Get()、MultiGet() 和迭代器
+    void RandomCheck(const Comparator* ucmp) {
+        Reset(ucmp);
+        Random rnd(301);
+        SequenceNumber seq = 0;
+        std::vector<std::string> keys;
+        for (int i = 0; i < 3000; i++) {
+            const std::string key = RandomKey(&rnd);
+            keys.push_back(key);
+            seq += 1 + rnd.Uniform(3);
+            if (rnd.OneIn(4)) {
+                Add(seq, kTypeDeletion, key, "");
+            } else {
+                Add(seq, kTypeValue, key, "v" + std::to_string(seq));
+            }
+        }
+        keys.push_back("missing");
+
+        for (int round = 0; round < 50; round++) {
+            const SequenceNumber snapshot = rnd.Uniform(seq + 2);
+            for (const std::string& key : keys) {
+                ASSERT_EQ(Expected(key, snapshot), Get(key, snapshot))
+                    << "key " << key << " seq " << snapshot;
+            }
+
+            // MultiGet() 要求 key 按 internal key 排序，且不重复
+            std::vector<std::string> sorted = keys;
+            std::sort(sorted.begin(), sorted.end(),
+                      [ucmp](const std::string& a, const std::string& b) {
+                          return ucmp->Compare(a, b) < 0;
+                      });
+            sorted.erase(std::unique(sorted.begin(), sorted.end()),
+                         sorted.end());
+            std::vector<std::unique_ptr<LookupKey>> lkeys;
+            std::vector<const LookupKey*> ptrs;
+            for (const std::string& key : sorted) {
+                lkeys.emplace_back(new LookupKey(key, snapshot));
+                ptrs.push_back(lkeys.back().get());
+            }
+            const size_t n = sorted.size();
+            std::vector<std::string> values(n);
+            std::vector<Status> statuses(n);
+            std::unique_ptr<bool[]> done(new bool[n]);
+            std::fill(done.get(), done.get() + n, false);
+            mem_->MultiGet(ptrs.data(), n, values.data(), statuses.data(),
+                           done.get());
+            for (size_t i = 0; i < n; i++) {
+                std::string actual = "MISS";
+                if (done[i]) {
+                    actual = statuses[i].IsNotFound() ? "NOT_FOUND" : values[i];
+                }
+                ASSERT_EQ(Expected(sorted[i], snapshot), actual);
+            }
+        }
+
+        // 迭代器按 user key 升序、序列号降序产生所有条目
+        std::vector<std::string> expected;
+        for (const auto& kv : model_) {
+            for (const Version& v : kv.second) {
+                std::string ikey;
+                AppendInternalKey(
+                    &ikey, ParsedInternalKey(kv.first, v.sequence,
+                                             v.deleted ? kTypeDeletion
+                                                       : kTypeValue));
+                expected.push_back(ikey);
+            }
+        }
+        std::sort(expected.begin(), expected.end(),
+                  [this](const std::string& a, const std::string& b) {
+                      return icmp_->Compare(a, b) < 0;
+                  });
+        std::unique_ptr<Iterator> iter(mem_->NewIterator());
+        iter->SeekToFirst();
+        for (const std::string& ikey : expected) {
+            ASSERT_TRUE(iter->Valid());
+            ASSERT_EQ(Slice(ikey), iter->key());
+            iter->Next();
+        }
+        ASSERT_FALSE(iter->Valid());
+        iter->SeekToLast();
+        for (auto it = expected.rbegin(); it != expected.rend(); ++it) {
+            ASSERT_TRUE(iter->Valid());
+            ASSERT_EQ(Slice(*it), iter->key());
+            iter->Prev();
+        }
+        ASSERT_FALSE(iter->Valid());
+        for (size_t i = 0; i < expected.size(); i += 7) {
+            iter->Seek(expected[i]);
+            ASSERT_TRUE(iter->Valid());
+            ASSERT_EQ(Slice(expected[i]), iter->key());
+        }
+    }
+
+    std::unique_ptr<InternalKeyComparator> icmp_;
+    MemTable* mem_ = nullptr;
+    std::map<std::string, std::vector<Version>> model_;
+};
+
+TEST_F(MemTableReadTest, GetSemantics) {
+    Reset(BytewiseComparator());
+    ASSERT_EQ("MISS", Get("k", kMaxSequenceNumber));
+
+    Add(10, kTypeValue, "k", "v10");
+    Add(20, kTypeDeletion, "k", "");
+    Add(30, kTypeValue, "k", "v30");
+    Add(15, kTypeValue, "k2", "");
+    // 快照之前没有版本时 MemTable 中没有结果
+    ASSERT_EQ("MISS", Get("k", 9));
+    ASSERT_EQ("v10", Get("k", 10));
+    ASSERT_EQ("v10", Get("k", 19));
+    ASSERT_EQ("NOT_FOUND", Get("k", 20));
+    ASSERT_EQ("NOT_FOUND", Get("k", 29));
+    ASSERT_EQ("v30", Get("k", kMaxSequenceNumber));
+    // 空 value 与删除不同；user key 是其他 key 的前缀时不会混淆
+    ASSERT_EQ("", Get("k2", 15));
+    ASSERT_EQ("MISS", Get("k1", kMaxSequenceNumber));
+    ASSERT_EQ("MISS", Get("", kMaxSequenceNumber));
+    ASSERT_EQ("MISS", Get(std::string("k\0", 2), kMaxSequenceNumber));
+
+    std::unique_ptr<Iterator> iter(mem_->NewIterator());
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    ParsedInternalKey ikey;
+    ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    ASSERT_EQ("k", ikey.user_key.to_string());
+    ASSERT_EQ(30u, ikey.sequence);
+    ASSERT_EQ("v30", iter->value().to_string());
+    ASSERT_GT(mem_->ApproximateMemoryUsage(), 0u);
+}
+
+TEST_F(MemTableReadTest, RandomBytewise) { RandomCheck(BytewiseComparator()); }
+
+TEST_F(MemTableReadTest, RandomSpectrumKeyComparator) {
+    RandomCheck(SpectrumKeyComparator());
+}
+
+TEST_F(MemTableReadTest, RandomCustomComparator) {
+    ReverseComparator reverse;
+    RandomCheck(&reverse);
+    mem_->Unref();
+    mem_ = nullptr;
+}
+
+}  // namespace massdb
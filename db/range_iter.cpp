@@ -0,0 +1,105 @@
+//
+// Created by Xsakura on 2023/6/10.
+//
+
+#include "db/range_iter.h"
+
+#include <cassert>
+#include <string>
+
+#include "massdb/comparator.h"
+
+namespace massdb {
+
+namespace {
+
+// 把底层迭代器限制在 [lower_, upper_) 之间。
+// 底层迭代器越过边界后这个迭代器就无效，不会继续扫描范围之外的条目
+class RangeIterator : public Iterator {
+public:
+    RangeIterator(const Comparator* cmp, Iterator* iter, const Slice& lower,
+                  const Slice& upper)
+        : cmp_(cmp),
+          iter_(iter),
+          lower_(lower.data(), lower.size()),
+          upper_(upper.data(), upper.size()) {}
+
+    RangeIterator(const RangeIterator&) = delete;
+    RangeIterator& operator=(const RangeIterator&) = delete;
+
+    ~RangeIterator() override { delete iter_; }
+
+    bool Valid() const override {
+        return iter_->Valid() && !BeforeLower(iter_->key()) &&
+               !AfterUpper(iter_->key());
+    }
+
+    void SeekToFirst() override { iter_->Seek(lower_); }
+
+    void SeekToLast() override {
+        if (upper_.empty()) {
+            iter_->SeekToLast();
+        } else {
+            // 定位到第一个不小于 upper_ 的条目的前一个条目
+            iter_->Seek(upper_);
+            if (iter_->Valid()) {
+                iter_->Prev();
+            } else {
+                iter_->SeekToLast();
+            }
+        }
+    }
+
+    void Seek(const Slice& target) override {
+        if (BeforeLower(target)) {
+            iter_->Seek(lower_);
+        } else {
+            iter_->Seek(target);
+        }
+    }
+
+    void Next() override {
+        assert(Valid());
+        iter_->Next();
+    }
+
+    void Prev() override {
+        assert(Valid());
+        iter_->Prev();
+    }
+
+    Slice key() const override {
+        assert(Valid());
+        return iter_->key();
+    }
+
+    Slice value() const override {
+        assert(Valid());
+        return iter_->value();
+    }
+
+    Status status() const override { return iter_->status(); }
+
+private:
+    bool BeforeLower(const Slice& key) const {
+        return cmp_->Compare(key, lower_) < 0;
+    }
+
+    bool AfterUpper(const Slice& key) const {
+        return !upper_.empty() && cmp_->Compare(key, upper_) >= 0;
+    }
+
+    const Comparator* const cmp_;
+    Iterator* const iter_;
+    const std::string lower_;
+    const std::string upper_;
+};
+
+}  // namespace
+
+Iterator* NewRangeIterator(const Comparator* cmp, Iterator* iter,
+                           const Slice& lower, const Slice& upper) {
+    return new RangeIterator(cmp, iter, lower, upper);
+}
+
+}  // namespace massdb
@@ -0,0 +1,23 @@
+//
+// Created by Xsakura on 2023/6/10.
+//
+
+#ifndef MASSDB_DB_RANGE_ITER_H
+#define MASSDB_DB_RANGE_ITER_H
+
+#include "massdb/iterator.h"
+#include "massdb/slice.h"
+
+namespace massdb {
+
+class Comparator;
+
+// 返回一个新的迭代器，只产生 iter 中满足 lower <= key < upper 的条目。
+// upper 为空表示没有上界。返回的迭代器拥有 iter，删除时一起删除它。
+// 比较 key 时使用 cmp
+Iterator* NewRangeIterator(const Comparator* cmp, Iterator* iter,
+                           const Slice& lower, const Slice& upper);
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_RANGE_ITER_H
@@ -0,0 +1,361 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db/db_impl.h"
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "db/write_batch_internal.h"
+#include "gtest/gtest.h"
+#include "massdb/db.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "massdb/write_batch.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+static std::string Key(int i) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "key%06d", i);
+    return std::string(buf);
+}
+
+// 设置 stall_ 后，日志文件的下一次 Sync() 等待 stall_ 被清除，
+// 让 leader 停在写日志的阶段，之后的写者在队列中排队
+class StallSyncEnv : public test::EnvWrapper {
+public:
+    explicit StallSyncEnv(Env* target) : EnvWrapper(target) {}
+
+    std::atomic<bool> stall_{false};
+    std::atomic<bool> stalled_{false};
+
+    Status NewWritableFile(const std::string& fname,
+                           WritableFile** result) override {
+        Status s = target()->NewWritableFile(fname, result);
+        uint64_t number;
+        FileType type;
+        if (s.IsOk() &&
+            ParseFileName(fname.substr(fname.rfind('/') + 1), &number,
+                          &type) &&
+            type == kLogFile) {
+            *result = new LogFile(this, *result);
+        }
+        return s;
+    }
+
+private:
+    class LogFile : public WritableFile {
+    public:
+        LogFile(StallSyncEnv* env, WritableFile* file)
+            : env_(env), file_(file) {}
+        ~LogFile() override { delete file_; }
+
+        Status Append(const Slice& data) override {
+            return file_->Append(data);
+        }
+        Status Close() override { return file_->Close(); }
+        Status Flush() override { return file_->Flush(); }
+        Status Sync() override {
+            if (env_->stall_.load()) {
+                env_->stalled_.store(true);
+                while (env_->stall_.load()) {
+                    env_->SleepForMicroseconds(1000);
+                }
+            }
+            return file_->Sync();
+        }
+
+    private:
+        StallSyncEnv* const env_;
+        WritableFile* const file_;
+    };
+};
+
+class RecoveryTest : public testing::Test {
+public:
+    RecoveryTest()
+        : env_(Env::Default()),
+          dbname_(test::NewTestDirectory("recovery_test")),
+          db_(nullptr) {
+        options_.create_if_missing = true;
+        Reopen();
+    }
+
+    ~RecoveryTest() override {
+        delete db_;
+        test::DestroyDirectory(env_, dbname_);
+    }
+
+    void Close() {
+        delete db_;
+        db_ = nullptr;
+    }
+
+    void Reopen() {
+        Close();
+        ASSERT_TRUE(DB::Open(options_, dbname_, &db_).IsOk());
+    }
+
+    DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+    std::string Get(const std::string& key) {
+        std::string value;
+        Status s = db_->Get(ReadOptions(), key, &value);
+        if (s.IsNotFound()) {
+            return "NOT_FOUND";
+        } else if (!s.IsOk()) {
+            return s.ToString();
+        }
+        return value;
+    }
+
+    std::map<std::string, std::string> Contents() {
+        std::map<std::string, std::string> result;
+        Iterator* iter = db_->NewIterator(ReadOptions());
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            result[iter->key().to_string()] = iter->value().to_string();
+        }
+        EXPECT_TRUE(iter->status().IsOk());
+        delete iter;
+        return result;
+    }
+
+    // 返回每个 user key 最新版本的序列号
+    std::map<std::string, SequenceNumber> Sequences() {
+        std::map<std::string, SequenceNumber> result;
+        Iterator* iter = dbfull()->TEST_NewInternalIterator();
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            ParsedInternalKey ikey;
+            if (!ParseInternalKey(iter->key(), &ikey)) {
+                ADD_FAILURE() << "bad internal key";
+                continue;
+            }
+            result.insert(std::make_pair(ikey.user_key.to_string(),
+                                         ikey.sequence));
+        }
+        EXPECT_TRUE(iter->status().IsOk());
+        delete iter;
+        return result;
+    }
+
+    // 返回编号最大的日志文件的名字
+    std::string NewestLogFile() {
+        std::vector<std::string> children;
+        EXPECT_TRUE(env_->GetChildren(dbname_, &children).IsOk());
+        uint64_t newest = 0;
+        for (const std::string& child : children) {
+            uint64_t number;
+            FileType type;
+            if (ParseFileName(child, &number, &type) && type == kLogFile &&
+                number > newest) {
+                newest = number;
+            }
+        }
+        EXPECT_GT(newest, 0u);
+        return LogFileName(dbname_, newest);
+    }
+
+    // 去掉文件 fname 最后的 n 个字节
+    void TruncateTail(const std::string& fname, size_t n) {
+        uint64_t size;
+        ASSERT_TRUE(env_->GetFileSize(fname, &size).IsOk());
+        ASSERT_GE(size, n);
+        SequentialFile* src;
+        ASSERT_TRUE(env_->NewSequentialFile(fname, &src).IsOk());
+        std::string contents(size - n, '\0');
+        Slice result;
+        ASSERT_TRUE(src->Read(contents.size(), &result, &contents[0]).IsOk());
+        ASSERT_EQ(contents.size(), result.size());
+        const std::string data = result.to_string();
+        delete src;
+
+        WritableFile* dst;
+        ASSERT_TRUE(env_->NewWritableFile(fname, &dst).IsOk());
+        ASSERT_TRUE(dst->Append(data).IsOk());
+        ASSERT_TRUE(dst->Close().IsOk());
+        delete dst;
+    }
+
+    Env* const env_;
+    const std::string dbname_;
+    Options options_;
+    DB* db_;
+};
+
+TEST_F(RecoveryTest, ReopenAfterWrites) {
+    for (int sync = 0; sync < 2; sync++) {
+        WriteOptions write_options;
+        write_options.sync = (sync == 1);
+        std::map<std::string, std::string> model = Contents();
+        Random rnd(301 + sync);
+        for (int i = 0; i < 2000; i++) {
+            const std::string key = Key(rnd.Uniform(500));
+            if (rnd.OneIn(5)) {
+                ASSERT_TRUE(db_->Delete(write_options, key).IsOk());
+                model.erase(key);
+            } else {
+                const std::string value = test::RandomString(&rnd, 50);
+                ASSERT_TRUE(db_->Put(write_options, key, value).IsOk());
+                model[key] = value;
+            }
+        }
+        // 没有写入 table 文件的更新都从日志中恢复
+        Reopen();
+        ASSERT_EQ(model, Contents());
+        Reopen();
+        ASSERT_EQ(model, Contents());
+    }
+}
+
+TEST_F(RecoveryTest, ReopenAcrossMemTableSwitches) {
+    options_.write_buffer_size = 64 * 1024;
+    Reopen();
+    std::map<std::string, std::string> model;
+    Random rnd(301);
+    for (int i = 0; i < 5000; i++) {
+        const std::string key = Key(rnd.Uniform(2000));
+        const std::string value = test::RandomString(&rnd, 100);
+        ASSERT_TRUE(db_->Put(WriteOptions(), key, value).IsOk());
+        model[key] = value;
+    }
+    Reopen();
+    ASSERT_EQ(model, Contents());
+}
+
+TEST_F(RecoveryTest, TornTailRecord) {
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(db_->Put(WriteOptions(), Key(i), "v").IsOk());
+    }
+    Close();
+
+    // 最后一次写入的记录只写出了一部分，恢复时忽略它，之前的写入都保留
+    TruncateTail(NewestLogFile(), 3);
+    Reopen();
+    for (int i = 0; i < 99; i++) {
+        ASSERT_EQ("v", Get(Key(i)));
+    }
+    ASSERT_EQ("NOT_FOUND", Get(Key(99)));
+
+    // 之后的写入正常恢复
+    ASSERT_TRUE(db_->Put(WriteOptions(), Key(99), "again").IsOk());
+    Reopen();
+    ASSERT_EQ("again", Get(Key(99)));
+    ASSERT_EQ("v", Get(Key(98)));
+}
+
+TEST_F(RecoveryTest, ConcurrentWritersSequences) {
+    const int kThreads = 8;
+    const int kBatches = 500;
+    const int kBatchSize = 3;
+    ASSERT_TRUE(options_.allow_concurrent_memtable_write);
+
+    // 每个线程依次写入自己的 key，一次写入一个 batch。
+    // 合并写入时各写者并发插入 MemTable，使用的序列号必须与日志中的一致
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([this, t]() {
+            for (int b = 0; b < kBatches; b++) {
+                WriteBatch batch;
+                for (int k = 0; k < kBatchSize; k++) {
+                    char key[32];
+                    std::snprintf(key, sizeof(key), "t%d-%06d", t,
+                                  b * kBatchSize + k);
+                    batch.Put(key, "v");
+                }
+                ASSERT_TRUE(db_->Write(WriteOptions(), &batch).IsOk());
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const std::map<std::string, SequenceNumber> sequences = Sequences();
+    const SequenceNumber total = kThreads * kBatches * kBatchSize;
+    ASSERT_EQ(total, sequences.size());
+    std::vector<bool> used(total + 1, false);
+    for (int t = 0; t < kThreads; t++) {
+        SequenceNumber last = 0;
+        for (int i = 0; i < kBatches * kBatchSize; i++) {
+            char key[32];
+            std::snprintf(key, sizeof(key), "t%d-%06d", t, i);
+            const SequenceNumber seq = sequences.at(key);
+            ASSERT_GE(seq, 1u);
+            ASSERT_LE(seq, total);
+            ASSERT_FALSE(used[seq]);
+            used[seq] = true;
+            // 同一个线程的写入依次完成，序列号递增；
+            // 一个 batch 中的条目使用连续的序列号
+            ASSERT_GT(seq, last);
+            if (i % kBatchSize != 0) {
+                ASSERT_EQ(last + 1, seq);
+            }
+            last = seq;
+        }
+    }
+
+    // 从日志恢复之后序列号不变
+    Reopen();
+    ASSERT_EQ(sequences, Sequences());
+}
+
+TEST_F(RecoveryTest, ConcurrentInsertErrorIsReported) {
+    StallSyncEnv env(Env::Default());
+    options_.env = &env;
+    Reopen();
+    ASSERT_TRUE(options_.allow_concurrent_memtable_write);
+
+    // 记录中的 tag 无效，插入 MemTable 时返回 Corruption
+    WriteBatch bad;
+    bad.Put("bad", "v");
+    std::string contents = WriteBatchInternal::Contents(&bad).to_string();
+    contents.push_back('\x7f');
+    WriteBatchInternal::SetContents(&bad, contents);
+    WriteBatchInternal::SetCount(&bad, 2);
+
+    // 第一个写者同步日志时停住，good 和 bad 依次排队，
+    // 之后合并成一组：good 是 leader，bad 由自己的线程并发插入 MemTable
+    WriteOptions sync_options;
+    sync_options.sync = true;
+    env.stall_.store(true);
+    std::thread first([&]() {
+        ASSERT_TRUE(db_->Put(sync_options, "first", "v").IsOk());
+    });
+    while (!env.stalled_.load()) {
+        env.SleepForMicroseconds(1000);
+    }
+    Status good_status, bad_status;
+    std::thread good([&]() {
+        WriteBatch batch;
+        batch.Put("good", "v");
+        good_status = db_->Write(sync_options, &batch);
+    });
+    env.SleepForMicroseconds(50000);
+    std::thread follower([&]() {
+        bad_status = db_->Write(sync_options, &bad);
+    });
+    env.SleepForMicroseconds(50000);
+    env.stall_.store(false);
+    first.join();
+    good.join();
+    follower.join();
+
+    // 插入失败不能被当作成功返回，同一组的写者都得到这个错误
+    ASSERT_TRUE(bad_status.IsCorruption()) << bad_status.ToString();
+    ASSERT_TRUE(good_status.IsCorruption()) << good_status.ToString();
+    ASSERT_EQ("v", Get("first"));
+    Close();
+}
+
+}  // namespace massdb
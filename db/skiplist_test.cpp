@@ -0,0 +1,521 @@
+//
+// Created by Xsakura on 2023/6/26.
+//
+
+#include "db/skiptlist.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "gtest/gtest.h"
+#include "massdb/comparator.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/concurrent_arena.h"
+#include "util/random.h"
+
+namespace massdb {
+
+typedef uint64_t Key;
+
+// key 以 8 字节大端序内联存放在节点中
+struct TestComparator {
+    // use_prefix 为 false 时所有前缀都相等，每次都比较完整的 key
+    explicit TestComparator(bool use_prefix) : use_prefix(use_prefix) {}
+
+    int operator()(const char* a, const char* b) const {
+        const Key x = Decode(a);
+        const Key y = Decode(b);
+        return (x < y) ? -1 : (x > y);
+    }
+
+    uint64_t Prefix(const char* key) const {
+        return use_prefix ? Decode(key) : 0;
+    }
+
+    static Key Decode(const char* p) { return DecodeBigEndianPrefix(p, 8); }
+
+    bool use_prefix;
+};
+
+typedef SkipList<TestComparator> TestList;
+
+static void InsertKey(TestList* list, Key key, bool concurrent) {
+    char* buf = list->AllocateKey(sizeof(Key));
+    EncodeBigEndian64(buf, key);
+    if (concurrent) {
+        list->ConcurrentInsert(buf);
+    } else {
+        list->Insert(buf);
+    }
+}
+
+static bool ListContains(const TestList& list, Key key) {
+    char buf[sizeof(Key)];
+    EncodeBigEndian64(buf, key);
+    return list.Contains(buf);
+}
+
+TEST(SkipTest, Empty) {
+    Arena arena;
+    TestList list(TestComparator(true), &arena);
+    ASSERT_TRUE(!ListContains(list, 10));
+
+    TestList::Iterator iter(&list);
+    ASSERT_TRUE(!iter.Valid());
+    iter.SeekToFirst();
+    ASSERT_TRUE(!iter.Valid());
+    char buf[sizeof(Key)];
+    EncodeBigEndian64(buf, 100);
+    iter.Seek(buf);
+    ASSERT_TRUE(!iter.Valid());
+    iter.SeekToLast();
+    ASSERT_TRUE(!iter.Valid());
+}
+
+TEST(SkipTest, InsertAndLookup) {
+    for (bool use_prefix : {true, false}) {
+        const int N = 2000;
+        const int R = 5000;
+        Random rnd(1000);
+        std::set<Key> keys;
+        Arena arena;
+        TestList list(TestComparator(use_prefix), &arena);
+        for (int i = 0; i < N; i++) {
+            Key key = rnd.Next() % R;
+            if (keys.insert(key).second) {
+                InsertKey(&list, key, false);
+            }
+        }
+
+        for (int i = 0; i < R; i++) {
+            ASSERT_EQ(keys.count(i) == 1, ListContains(list, i));
+        }
+
+        // 正向和反向遍历的结果都与 std::set 一致
+        TestList::Iterator iter(&list);
+        iter.SeekToFirst();
+        for (Key key : keys) {
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(key, TestComparator::Decode(iter.key()));
+            iter.Next();
+        }
+        ASSERT_TRUE(!iter.Valid());
+
+        iter.SeekToLast();
+        for (auto it = keys.rbegin(); it != keys.rend(); ++it) {
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(*it, TestComparator::Decode(iter.key()));
+            iter.Prev();
+        }
+        ASSERT_TRUE(!iter.Valid());
+
+        // Seek() 和 SeekForward() 找到第一个大于等于 target 的 key
+        TestList::Iterator forward(&list);
+        char buf[sizeof(Key)];
+        for (int i = 0; i < R; i++) {
+            EncodeBigEndian64(buf, i);
+            iter.Seek(buf);
+            forward.SeekForward(buf);
+            auto expected = keys.lower_bound(i);
+            if (expected == keys.end()) {
+                ASSERT_TRUE(!iter.Valid());
+                ASSERT_TRUE(!forward.Valid());
+            } else {
+                ASSERT_TRUE(iter.Valid());
+                ASSERT_EQ(*expected, TestComparator::Decode(iter.key()));
+                ASSERT_TRUE(forward.Valid());
+                ASSERT_EQ(*expected, TestComparator::Decode(forward.key()));
+            }
+        }
+    }
+}
+
+// 按 order 的顺序插入不重复的 key，然后检查正向和反向遍历的顺序，
+// 以及每个 key 都能找到。concurrent[i] 为 true 的 key 用 ConcurrentInsert()
+// 插入，它们会让 Insert() 记录的插入位置过期
+static void CheckInsertOrder(const std::vector<Key>& order,
+                             const std::vector<bool>& concurrent) {
+    for (bool use_prefix : {true, false}) {
+        ConcurrentArena arena;
+        TestList list(TestComparator(use_prefix), &arena);
+        for (size_t i = 0; i < order.size(); i++) {
+            InsertKey(&list, order[i], !concurrent.empty() && concurrent[i]);
+        }
+
+        std::vector<Key> sorted = order;
+        std::sort(sorted.begin(), sorted.end());
+        TestList::Iterator iter(&list);
+        iter.SeekToFirst();
+        for (Key key : sorted) {
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(key, TestComparator::Decode(iter.key()));
+            iter.Next();
+        }
+        ASSERT_TRUE(!iter.Valid());
+        iter.SeekToLast();
+        for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(*it, TestComparator::Decode(iter.key()));
+            iter.Prev();
+        }
+        ASSERT_TRUE(!iter.Valid());
+        for (Key key : sorted) {
+            ASSERT_TRUE(ListContains(list, key));
+            ASSERT_TRUE(!ListContains(list, key + 1) ||
+                        std::binary_search(sorted.begin(), sorted.end(),
+                                           key + 1));
+        }
+    }
+}
+
+TEST(SkipTest, InsertAscending) {
+    // 每次都插入在上一次的位置之后，finger 直接命中
+    std::vector<Key> order;
+    for (Key i = 0; i < 5000; i++) order.push_back(i * 2);
+    CheckInsertOrder(order, {});
+}
+
+TEST(SkipTest, InsertDescending) {
+    // 每次都插入在上一次的位置之前，finger 在每一层都要重新查找
+    std::vector<Key> order;
+    for (Key i = 5000; i > 0; i--) order.push_back(i * 2);
+    CheckInsertOrder(order, {});
+}
+
+TEST(SkipTest, InsertRandom) {
+    std::vector<Key> order;
+    for (Key i = 0; i < 5000; i++) order.push_back(i * 2);
+    Random rnd(301);
+    for (size_t i = order.size() - 1; i > 0; i--) {
+        std::swap(order[i], order[rnd.Uniform(static_cast<int>(i) + 1)]);
+    }
+    CheckInsertOrder(order, {});
+}
+
+TEST(SkipTest, InsertInterleaved) {
+    // 两段递增的 key 交替插入：finger 在两个区域之间来回跳；
+    // 递增的段中间夹着跳回更早位置的 key
+    std::vector<Key> order;
+    for (Key i = 0; i < 2000; i++) {
+        order.push_back(i * 2);
+        order.push_back(100000 + i * 2);
+        if (i % 7 == 6) {
+            order.push_back(i * 2 - 11);
+        }
+    }
+    CheckInsertOrder(order, {});
+
+    // 几段各自递增、段与段之间随机的 key
+    Random rnd(301);
+    std::set<Key> used;
+    order.clear();
+    while (order.size() < 5000) {
+        Key start = rnd.Uniform(1000000);
+        const int run = 1 + rnd.Uniform(50);
+        for (int k = 0; k < run; k++) {
+            if (used.insert(start).second) {
+                order.push_back(start);
+            }
+            start += 1 + rnd.Uniform(3);
+        }
+    }
+    CheckInsertOrder(order, {});
+}
+
+TEST(SkipTest, InsertMixedWithConcurrentInsert) {
+    // ConcurrentInsert() 插入的节点可能落在 finger 与 key 之间，
+    // 之后的 Insert() 必须发现 finger 已经过期
+    Random rnd(301);
+    std::vector<Key> order;
+    std::vector<bool> concurrent;
+    for (Key i = 0; i < 4000; i++) {
+        order.push_back(i * 4);
+        concurrent.push_back(false);
+        if (rnd.OneIn(3)) {
+            order.push_back(i * 4 + 1 + rnd.Uniform(2));
+            concurrent.push_back(true);
+        }
+        if (i > 10 && rnd.OneIn(5)) {
+            order.push_back(i * 4 - 37);
+            concurrent.push_back(rnd.OneIn(2));
+        }
+    }
+    CheckInsertOrder(order, concurrent);
+}
+
+// 多个写者通过 ConcurrentInsert() 插入互不相同的 key，同时一个读者不加锁地
+// 反复遍历和查找。第 t 个写者按随机顺序插入所有模 num_writers 余 t 的 key，
+// 每插入一个就公布自己的进度。读者检查：
+//    每次遍历看到的 key 严格递增；
+//    遍历之前已经公布的 key 都能看到，并且都能通过 Contains() 找到
+class ConcurrentInsertTest {
+public:
+    ConcurrentInsertTest(bool use_prefix, int num_writers, int keys_per_writer)
+        : list_(TestComparator(use_prefix), &arena_),
+          num_writers_(num_writers),
+          keys_per_writer_(keys_per_writer),
+          order_(num_writers),
+          progress_(new std::atomic<int>[num_writers]),
+          writers_done_(0),
+          passes_(0) {
+        for (int t = 0; t < num_writers; t++) {
+            for (int i = 0; i < keys_per_writer; i++) {
+                order_[t].push_back(static_cast<Key>(i) * num_writers + t);
+            }
+            Random rnd(301 + t);
+            for (int i = keys_per_writer - 1; i > 0; i--) {
+                std::swap(order_[t][i], order_[t][rnd.Uniform(i + 1)]);
+            }
+            progress_[t].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Run() {
+        std::thread reader(&ConcurrentInsertTest::ReadLoop, this);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < num_writers_; t++) {
+            writers.emplace_back(&ConcurrentInsertTest::WriteLoop, this, t);
+        }
+        for (std::thread& w : writers) {
+            w.join();
+        }
+        reader.join();
+
+        // 所有 key 都已经插入，并且按顺序排列
+        TestList::Iterator iter(&list_);
+        iter.SeekToFirst();
+        const Key total = static_cast<Key>(num_writers_) * keys_per_writer_;
+        for (Key key = 0; key < total; key++) {
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(key, TestComparator::Decode(iter.key()));
+            ASSERT_TRUE(ListContains(list_, key));
+            iter.Next();
+        }
+        ASSERT_TRUE(!iter.Valid());
+        EXPECT_GT(passes_, 0);
+    }
+
+private:
+    void WriteLoop(int t) {
+        for (int i = 0; i < keys_per_writer_; i++) {
+            InsertKey(&list_, order_[t][i], true);
+            progress_[t].store(i + 1, std::memory_order_release);
+        }
+        writers_done_.fetch_add(1);
+    }
+
+    void ReadLoop() {
+        Random rnd(17);
+        std::vector<int> published(num_writers_);
+        bool last = false;
+        while (!last) {
+            // 写者都结束之后再检查一次
+            last = (writers_done_.load() == num_writers_);
+            long long expected = 0;
+            for (int t = 0; t < num_writers_; t++) {
+                published[t] = progress_[t].load(std::memory_order_acquire);
+                expected += published[t];
+            }
+
+            long long count = 0;
+            bool has_prev = false;
+            Key prev = 0;
+            TestList::Iterator iter(&list_);
+            for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+                const Key key = TestComparator::Decode(iter.key());
+                if (has_prev) {
+                    ASSERT_LT(prev, key);
+                }
+                prev = key;
+                has_prev = true;
+                count++;
+            }
+            ASSERT_GE(count, expected);
+
+            for (int t = 0; t < num_writers_; t++) {
+                if (published[t] == 0) {
+                    continue;
+                }
+                for (int j = 0; j < 8; j++) {
+                    const Key key = order_[t][rnd.Uniform(published[t])];
+                    ASSERT_TRUE(ListContains(list_, key)) << key;
+                }
+            }
+            passes_++;
+        }
+    }
+
+    ConcurrentArena arena_;
+    TestList list_;
+    const int num_writers_;
+    const int keys_per_writer_;
+    // 每个写者插入 key 的顺序
+    std::vector<std::vector<Key>> order_;
+    // 每个写者已经插入的 key 的数量
+    std::unique_ptr<std::atomic<int>[]> progress_;
+    std::atomic<int> writers_done_;
+    int passes_;  // 只由读者修改
+};
+
+TEST(SkipTest, ConcurrentInsert) {
+    ConcurrentInsertTest(true, 8, 20000).Run();
+}
+
+TEST(SkipTest, ConcurrentInsertWithoutPrefix) {
+    ConcurrentInsertTest(false, 8, 10000).Run();
+}
+
+TEST(SkipTest, ConcurrentInsertManyWriters) {
+    ConcurrentInsertTest(true, 32, 2000).Run();
+}
+
+// MemTable::ConcurrentAdd() 的压力测试。每个写者写入所有 user key 的
+// 一个版本，序列号互不相同；读者同时检查 internal key 的顺序，
+// 并且已经公布的条目都能通过 Get() 读到
+class ConcurrentAddTest {
+public:
+    ConcurrentAddTest(int num_writers, int num_keys)
+        : icmp_(BytewiseComparator()),
+          mem_(new MemTable(icmp_)),
+          num_writers_(num_writers),
+          num_keys_(num_keys),
+          progress_(new std::atomic<int>[num_writers]),
+          writers_done_(0) {
+        mem_->Ref();
+        for (int t = 0; t < num_writers; t++) {
+            progress_[t].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~ConcurrentAddTest() { mem_->Unref(); }
+
+    void Run() {
+        std::thread reader(&ConcurrentAddTest::ReadLoop, this);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < num_writers_; t++) {
+            writers.emplace_back(&ConcurrentAddTest::WriteLoop, this, t);
+        }
+        for (std::thread& w : writers) {
+            w.join();
+        }
+        reader.join();
+
+        // 每个 user key 有 num_writers_ 个版本，按序列号从大到小排列
+        Iterator* iter = mem_->NewIterator();
+        iter->SeekToFirst();
+        for (int k = 0; k < num_keys_; k++) {
+            for (int t = num_writers_ - 1; t >= 0; t--) {
+                ASSERT_TRUE(iter->Valid());
+                ParsedInternalKey ikey;
+                ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+                ASSERT_EQ(UserKey(k), ikey.user_key.to_string());
+                ASSERT_EQ(Sequence(k, t), ikey.sequence);
+                ASSERT_EQ(Value(k, t), iter->value().to_string());
+                iter->Next();
+            }
+        }
+        ASSERT_TRUE(!iter->Valid());
+        delete iter;
+
+        // 最新的快照读到序列号最大的版本
+        for (int k = 0; k < num_keys_; k++) {
+            std::string value;
+            Status s;
+            ASSERT_TRUE(mem_->Get(LookupKey(UserKey(k), kMaxSequenceNumber),
+                                  &value, &s));
+            ASSERT_TRUE(s.IsOk());
+            ASSERT_EQ(Value(k, num_writers_ - 1), value);
+        }
+    }
+
+private:
+    static std::string UserKey(int k) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "key%08d", k);
+        return buf;
+    }
+
+    SequenceNumber Sequence(int k, int t) const {
+        return static_cast<SequenceNumber>(k) * num_writers_ + t + 1;
+    }
+
+    static std::string Value(int k, int t) {
+        return "value" + std::to_string(k) + "." + std::to_string(t);
+    }
+
+    void WriteLoop(int t) {
+        // 不同的写者从不同的位置开始，同一个 user key 的版本交错插入
+        const int start = t * num_keys_ / num_writers_;
+        for (int i = 0; i < num_keys_; i++) {
+            const int k = (start + i) % num_keys_;
+            mem_->ConcurrentAdd(Sequence(k, t), kTypeValue, UserKey(k),
+                                Value(k, t));
+            progress_[t].store(i + 1, std::memory_order_release);
+        }
+        writers_done_.fetch_add(1);
+    }
+
+    void ReadLoop() {
+        Random rnd(29);
+        std::vector<int> published(num_writers_);
+        bool last = false;
+        while (!last) {
+            last = (writers_done_.load() == num_writers_);
+            long long expected = 0;
+            for (int t = 0; t < num_writers_; t++) {
+                published[t] = progress_[t].load(std::memory_order_acquire);
+                expected += published[t];
+            }
+
+            long long count = 0;
+            std::string prev;
+            Iterator* iter = mem_->NewIterator();
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                if (!prev.empty()) {
+                    ASSERT_LT(icmp_.Compare(prev, iter->key()), 0);
+                }
+                prev.assign(iter->key().data(), iter->key().size());
+                count++;
+            }
+            delete iter;
+            ASSERT_GE(count, expected);
+
+            // 已经公布的版本可以在它的序列号下读到
+            for (int t = 0; t < num_writers_; t++) {
+                if (published[t] == 0) {
+                    continue;
+                }
+                const int start = t * num_keys_ / num_writers_;
+                for (int j = 0; j < 8; j++) {
+                    const int k = (start + rnd.Uniform(published[t])) %
+                                  num_keys_;
+                    std::string value;
+                    Status s;
+                    ASSERT_TRUE(mem_->Get(LookupKey(UserKey(k), Sequence(k, t)),
+                                          &value, &s));
+                    ASSERT_EQ(Value(k, t), value);
+                }
+            }
+        }
+    }
+
+    const InternalKeyComparator icmp_;
+    MemTable* const mem_;
+    const int num_writers_;
+    const int num_keys_;
+    std::unique_ptr<std::atomic<int>[]> progress_;
+    std::atomic<int> writers_done_;
+};
+
+TEST(MemTableTest, ConcurrentAdd) { ConcurrentAddTest(8, 10000).Run(); }
+
+}  // namespace massdb
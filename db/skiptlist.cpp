@@ -1,143 +0,0 @@
-//
-// Created by Xsakura on 2023/3/31.
-//
-
-#include "skiptlist.h"
-
-namespace massdb {
-
-template <typename Key, typename Comparator>
-SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
-    : compare_(cmp),
-      arena_(arena),
-      head_(NewNode(0 /* 任意键都可以 */, kMaxHeight)),
-      max_height_(1),
-      rnd_(0xdeadbeef) {
-    for (int i = 0; i < kMaxHeight; i++) {
-        head_->SetNext(i, nullptr);
-    }
-}
-
-template <typename Key, typename Comparator>
-void SkipList<Key, Comparator>::Insert(const Key& key) {
-    Node* prev[kMaxHeight];
-    // 如果是第一个值呢
-    Node* x = FindGreaterOrEqual(key, prev);
-
-    assert(x == nullptr || !Equal(key, x->key));
-
-    int height = RandomHeight();
-    if (height > GetMaxHeight()) {
-        for (int i = GetMaxHeight(); i < height; i++) {
-            prev[i] = head_;
-        }
-        max_height_.store(height, std::memory_order_relaxed);
-    }
-
-    x = NewNode(key, height);
-    for (int i = 0; i < height; i++) {
-        x->NoBarrier_SetNext(i, prev[i]->NoBarrier_Next(i));
-        prev[i]->SetNext(i, x);
-    }
-}
-
-template <typename Key, typename Comparator>
-bool SkipList<Key, Comparator>::Contians(const Key& key) const {
-    return false;
-}
-
-template <typename Key, typename Comparator>
-bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key& key,
-                                               SkipList::Node* n) const {
-    return (n != nullptr) && (compare_(n->key, key) < 0);
-}
-
-template <typename Key, typename Comparator>
-typename SkipList<Key, Comparator>::Node*
-SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key,
-                                              SkipList::Node** prev) const {
-    Node* x = head_;
-    int level = GetMaxHeight() - 1;
-    // 用 while(true) 循环减少判断
-    while (true) {
-        Node* next = x->Next(level);
-        if (KeyIsAfterNode(key, next)) {
-            // 如果 next->key 小于 key，同层向后找
-            x = next;
-        } else {
-            if (prev != nullptr) prev[level] = x;
-            if (level == 0) {
-                return next;
-            } else {
-                // 去下一层，也就是下一个 list
-                level--;
-            }
-        }
-    }
-}
-
-template <typename Key, typename Comparator>
-typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
-    const Key& key, int height) {
-    char* const node_memory = arena_->AllocateAligned(
-        sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
-    // new (node_memory) Node(key) 表示对象构造在已有的内存上
-    return new (node_memory) Node(key);
-}
-
-template <typename Key, typename Comparator>
-int SkipList<Key, Comparator>::RandomHeight() {
-    static const unsigned int kBranching = 4;
-    int height = 1;
-    // 1/kBranching 的概率增加高度
-    // SkipList 默认最大有 12，所以生成 i 层节点的概率为：1/(4^i)
-    while (height <= kMaxHeight && rnd_.OneIn(kBranching)) {
-        height++;
-    }
-    assert(height > 0);
-    assert(height <= kMaxHeight);
-    return height;
-}
-
-template <typename Key, typename Comparator>
-typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
-    const {
-    Node* x = head_;
-    int level = GetMaxHeight() - 1;
-    while (true) {
-        Node* next = x->Next(level);
-        if (next == nullptr) {
-            if (level == 0) {
-                return x;
-            } else {
-                // Switch to next list
-                // 去下一层
-                level--;
-            }
-        } else {
-            x = next;
-        }
-    }
-}
-
-template <typename Key, typename Comparator>
-typename SkipList<Key, Comparator>::Node*
-SkipList<Key, Comparator>::FindLessThan(const Key& key) const {
-    Node* x = head_;
-    int level = GetMaxHeight() - 1;
-    while (true) {
-        assert(x == head_ || compare_(x->key, key) < 0);
-        Node* next = x->Next(level);
-        if (next == nullptr || compare_(next->key, key) >= 0) {
-            if (level == 0) {
-                return x;
-            } else {
-                level--;
-            }
-        } else {
-            x = next;
-        }
-    }
-}
-
-}  // namespace massdb
@@ -7,29 +7,110 @@
 
 #include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <thread>
 
-#include "util/arena.h"
+#include "util/allocator.h"
 #include "util/random.h"
 
 namespace massdb {
 
-template <typename Key, typename Comparator>
+// SkipList 中的 key 是一段编码后的字节（例如 MemTable 中带长度前缀的
+// internal key），直接内联存放在节点中，不需要再通过指针跳转到另一块内存。
+//
+// Comparator 需要提供：
+//    int operator()(const char* a, const char* b) const;
+//        比较两个编码后的 key
+//    uint64_t Prefix(const char* key) const;
+//        返回 key 的 8 字节前缀，要求 Prefix(a) < Prefix(b) 时 a < b。
+//        前缀相等时才会调用 operator() 比较完整的 key。
+//        无法提供有序前缀的比较器可以总是返回 0
+template <typename Comparator>
 class SkipList {
 private:
     struct Node;  // SkipList 中的节点
 
+    enum { kMaxHeight = 12 };  // level 最大高度
+
 public:
     // 创建一个 SkipList 使用 "cmp" 比较 keys，并且使用 "arena" 分配内存。
-    explicit SkipList(Comparator cmp, Arena* arena);
+    // 使用 ConcurrentInsert() 时 arena 必须是线程安全的（ConcurrentArena）
+    explicit SkipList(Comparator cmp, Allocator* arena);
 
     SkipList(const SkipList&) = delete;
     SkipList& operator=(const SkipList&) = delete;
 
-    // 将关键字插入列表中。
+    // 分配一个可以容纳 key_size 字节 key 的节点，返回存放 key 的位置。
+    // 调用者写入 key 之后，再将返回的指针传给 Insert() 或 ConcurrentInsert()。
+    // 在插入之前 key 对其他线程不可见
+    char* AllocateKey(size_t key_size);
+
+    // 将关键字插入列表中。key 必须是 AllocateKey() 返回的指针。
+    // 从上一次 Insert() 的插入位置开始查找，
+    // 按顺序插入相邻的 key（例如排好序的 WriteBatch）时不需要每次都从 head_
+    // 开始查找。
     // 要求：当前 list 中没有与关键字相等的任何内容。
-    void Insert(const Key& key);
-    // 当且仅当 list 中存在 key 相同的条目（entry)
-    bool Contians(const Key& key) const;
+    void Insert(const char* key);
+
+    // 与 Insert() 相同，但允许多个线程同时调用。
+    // 每一层通过 CAS 将新节点链接到前驱节点之后，
+    // CAS 失败时从原来的前驱节点开始重新查找该层的插入位置后重试。
+    // 读者仍然不需要加锁。
+    // 要求：不能与 Insert() 同时调用；arena 的分配需要是线程安全的
+    void ConcurrentInsert(const char* key);
+
+    // 当且仅当 list 中存在 key 相同的条目（entry）时返回 true
+    bool Contains(const char* key) const;
+
+    // 遍历 SkipList 的迭代器
+    class Iterator {
+    public:
+        // 在指定的 list 上初始化一个迭代器。
+        // 返回的迭代器是无效的
+        explicit Iterator(const SkipList* list);
+
+        // 当迭代器指向一个有效节点时返回 true
+        bool Valid() const;
+
+        // 返回当前位置的 key。要求：Valid()
+        const char* key() const;
+
+        // 移动到下一个位置。要求：Valid()
+        void Next();
+
+        // 移动到上一个位置。要求：Valid()
+        void Prev();
+
+        // 移动到第一个大于等于 target 的位置。
+        // target 不需要是 AllocateKey() 分配的
+        void Seek(const char* target);
+
+        // 与 Seek() 相同，但是从上一次 SeekForward() 在每一层停下的位置
+        // 继续查找。依次查找一组升序排列的 target 时只需要遍历一次 list，
+        // 相邻的 target 越接近，需要访问的节点越少。
+        // 要求：target 不小于上一次 SeekForward() 的 target
+        void SeekForward(const char* target);
+
+        // 移动到 list 的第一个位置。
+        // 调用后当且仅当 list 非空时迭代器有效
+        void SeekToFirst();
+
+        // 移动到 list 的最后一个位置。
+        // 调用后当且仅当 list 非空时迭代器有效
+        void SeekToLast();
+
+    private:
+        const SkipList* list_;
+        Node* node_;
+        // 上一次 SeekForward() 在每一层停下的节点，都小于上一次的 target。
+        // finger_height_ 为 0 表示还没有调用过 SeekForward()
+        Node* finger_[kMaxHeight];
+        int finger_height_;
+        // 故意允许拷贝
+    };
 
 private:
     // 获取当前 SkipList 的最大高度
@@ -37,41 +118,88 @@ private:
         return max_height_.load(std::memory_order_relaxed);
     }
 
-    // 随机生成高度。默认最大为 12
-    int RandomHeight();
-    // 当前节点的值小于等于 key 返回 true
-    bool KeyIsAfterNode(const Key& key, Node* n) const;
+    // 随机生成高度。默认最大为 12。
+    // 节点在 AllocateKey() 时就要确定高度，这时还不知道之后会走哪种插入方式，
+    // 所以总是使用线程局部的随机数生成器
+    static int RandomHeight();
+    // 当前节点的值小于 key 返回 true。
+    // key_prefix 是 compare_.Prefix(key)，由调用者计算一次后重复使用
+    bool KeyIsAfterNode(const char* key, uint64_t key_prefix, Node* n) const;
     // 当两个键相等时，返回 true
-    bool Equal(const Key& a, const Key& b) const {
+    bool Equal(const char* a, const char* b) const {
         return (compare_(a, b) == 0);
     }
 
-    // 在 Arena 的基础上新建一个节点
-    Node* NewNode(const Key& key, int height);
+    // 在 Arena 的基础上新建一个高度为 height、可以容纳 key_size 字节 key 的节点
+    Node* AllocateNode(size_t key_size, int height);
     // 将每个 list 中大于等于 key 的前一个节点记录在 prev 中
     // 并返回 level 0 中第一个大于等于 key 的节点
-    Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
-    // 在 SkipList 中找第一个大于等于 key 的节点
-    Node* FindLessThan(const Key& key) const;
+    Node* FindGreaterOrEqual(const char* key, Node** prev) const;
+    // 从 before 开始在第 level 层向后查找，
+    // 使得 *out_prev < key <= *out_next（*out_next 可能为 nullptr）
+    void FindSpliceForLevel(const char* key, uint64_t key_prefix, Node* before,
+                            int level, Node** out_prev, Node** out_next) const;
+    // 在 SkipList 中找最后一个小于 key 的节点，没有的话返回 head_
+    Node* FindLessThan(const char* key) const;
+    // 当 splice_ 在第 level 层仍然是 key 的插入位置时返回 true
+    bool SpliceContains(const char* key, uint64_t key_prefix, int level) const;
     // 找 SkipList 中最后一个元素
     Node* FindLast() const;
 
 private:
-    enum { kMaxHeight = 12 };  // level 最大高度
-
-    Node* const head_;          // SkipList 的空头节点
+    // 注意成员的声明顺序：构造函数中 head_ 依赖 arena_ 分配内存，
+    // 所以 compare_ 和 arena_ 必须声明在 head_ 之前
     Comparator const compare_;  // 比较类
-    Arena* const arena_;        // 内存分配器类
+    Allocator* const arena_;    // 内存分配器类
+
+    Node* const head_;  // SkipList 的空头节点
 
-    Random rnd_;  // 随机生成器类
+    // 当前 SkipList 的高度。只由 Insert() 和 ConcurrentInsert() 修改，
+    // 读者可以并发读取，读到过期的值也没有问题
+    std::atomic<int> max_height_;
 
-    std::atomic<int> max_height_;  // 当前 SkipList 的高度
+    // 上一次 Insert() 在每一层的插入位置（finger）：
+    // prev[i] < 上一个 key <= next[i]。插入之后 prev[i] 更新为新节点，
+    // 下一个 key 稍大时，低层的位置多半仍然可用。
+    // prev[height] 总是 head_，next[height] 总是 nullptr。
+    // 只由 Insert() 使用，ConcurrentInsert() 插入的节点会让它过期
+    struct Splice {
+        int height;  // 已经计算过的层数，0 表示还没有插入过
+        Node* prev[kMaxHeight + 1];
+        Node* next[kMaxHeight + 1];
+    };
+    Splice splice_;
 };
 
 // 跳表节点类型
-template <typename Key, typename Comparator>
-struct SkipList<Key, Comparator>::Node {
-    explicit Node(const Key& key) : key(key) {}
+//
+// 一个高度为 h 的节点在内存中的布局如下：
+//    next_[h-1] ... next_[1]     : 第 1 ~ h-1 层的指针（tower）
+//    prefix                      : key 的 8 字节前缀      <-- Node*
+//    next_[0]                    : 第 0 层的指针
+//    key                         : 内联存放的 key         <-- Key()
+// 这样查找时沿着指针访问到一个节点后，前缀和第 0 层指针在同一条缓存行中，
+// 绝大多数比较只需要比较一次 prefix，不需要访问 key 本身。
+// 由 Key() 也可以直接算出节点的地址
+template <typename Comparator>
+struct SkipList<Comparator>::Node {
+    // 返回内联存放在节点之后的 key
+    const char* Key() const { return reinterpret_cast<const char*>(this + 1); }
+
+    // 由 AllocateKey() 返回的 key 指针得到对应的节点
+    static Node* FromKey(const char* key) {
+        return reinterpret_cast<Node*>(const_cast<char*>(key)) - 1;
+    }
+
+    // 插入之前暂时把节点的高度保存在 next_[0] 中
+    void StashHeight(int height) {
+        next0_.store(reinterpret_cast<Node*>(static_cast<intptr_t>(height)),
+                     std::memory_order_relaxed);
+    }
+    int UnstashHeight() const {
+        return static_cast<int>(reinterpret_cast<intptr_t>(
+            next0_.load(std::memory_order_relaxed)));
+    }
 
     // links 的存取器和修改器。
 
@@ -85,7 +213,7 @@ struct SkipList<Key, Comparator>::Node {
         // std::memory_order_acquire 用于保证一种原子的或更新的
         // 操作读取到的变量的是其最新值，而不是缓存中的旧值。
         // 这样可以避免线程间的数据竞争和其他并发问题
-        return next_[n].load(std::memory_order_acquire);
+        return Link(n)->load(std::memory_order_acquire);
     }
     // 向跳表的第 n 层，赋值 x
     void SetNext(int n, Node* x) {
@@ -101,7 +229,7 @@ struct SkipList<Key, Comparator>::Node {
         // 当写入操作使用 std::memory_order_release 标记时，
         // 其他线程使用 std::memory_order_acquire 标记来读取该变量时，
         // 都将看到最新的值。
-        next_[n].store(x, std::memory_order_release);
+        Link(n)->store(x, std::memory_order_release);
     }
 
     // 可以在少数地方安全使用的无屏障变量（No-barrier variants）
@@ -112,26 +240,412 @@ struct SkipList<Key, Comparator>::Node {
         // 硬件都不需要对内存访问进行任何同步操作，因此读写操作可以乱序执行，
         // 可以在不牺牲正确性和线程安全性的前提下提高代码的性能，
         // 可能会导致读写操作的结果不一致。
-        return next_[n].load(std::memory_order_relaxed);
+        return Link(n)->load(std::memory_order_relaxed);
+    }
+    // 当第 n 层的后继仍然是 expected 时将其替换为 x。
+    // 成功时带有 release 语义，保证其他线程看到 x 时 x 已经完全初始化
+    bool CASNext(int n, Node* expected, Node* x) {
+        assert(n >= 0);
+        return Link(n)->compare_exchange_strong(expected, x,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire);
     }
+
     void NoBarrier_SetNext(int n, Node* x) {
         assert(n >= 0);
         // 当确保没有其他线程读的情况可以始终这个方法存储，
         // 可以将内存访问的开销降到最低，提高程序的性能。
         // 如果该操作后面还有其他与该存储操作相关的读操作，
         // 那么这些读操作将无法读到最新的存储值。
-        next_[n].store(x, std::memory_order_relaxed);
+        Link(n)->store(x, std::memory_order_relaxed);
     }
 
-    Key const key;
+    // key 的前 8 个字节（大端序），在节点插入之前写入，之后不再改变
+    uint64_t prefix;
 
 private:
-    // next_ 数组的长度即是跳表节点的高度。
-    // next_[0] 就是 level 0
-    // 这里先用长度为 1 的数组占位
-    std::atomic<Node*> next_[1];
+    // 第 0 层的指针在节点内，第 n (n > 0) 层的指针位于节点之前
+    std::atomic<Node*>* Link(int n) {
+        if (n == 0) {
+            return &next0_;
+        }
+        return reinterpret_cast<std::atomic<Node*>*>(this) - n;
+    }
+
+    std::atomic<Node*> next0_;
 };
 
+// SkipList 的实现
+
+template <typename Comparator>
+inline SkipList<Comparator>::Iterator::Iterator(const SkipList* list) {
+    list_ = list;
+    node_ = nullptr;
+    finger_height_ = 0;
+}
+
+template <typename Comparator>
+inline bool SkipList<Comparator>::Iterator::Valid() const {
+    return node_ != nullptr;
+}
+
+template <typename Comparator>
+inline const char* SkipList<Comparator>::Iterator::key() const {
+    assert(Valid());
+    return node_->Key();
+}
+
+template <typename Comparator>
+inline void SkipList<Comparator>::Iterator::Next() {
+    assert(Valid());
+    node_ = node_->Next(0);
+}
+
+template <typename Comparator>
+inline void SkipList<Comparator>::Iterator::Prev() {
+    // 节点中没有前向指针，所以直接查找最后一个小于 key 的节点
+    assert(Valid());
+    node_ = list_->FindLessThan(node_->Key());
+    if (node_ == list_->head_) {
+        node_ = nullptr;
+    }
+}
+
+template <typename Comparator>
+inline void SkipList<Comparator>::Iterator::Seek(const char* target) {
+    node_ = list_->FindGreaterOrEqual(target, nullptr);
+}
+
+template <typename Comparator>
+inline void SkipList<Comparator>::Iterator::SeekForward(const char* target) {
+    const uint64_t target_prefix = list_->compare_.Prefix(target);
+    // 自底向上找到最低的一层，其中 finger_ 的后继不小于 target，
+    // 从这一层的 finger_ 开始向下查找即可。
+    // 之后插入的节点不影响正确性：查找时总是沿着当前的链接向后走
+    int level = 0;
+    while (level < finger_height_ &&
+           list_->KeyIsAfterNode(target, target_prefix,
+                                 finger_[level]->Next(level))) {
+        level++;
+    }
+    Node* x;
+    if (level < finger_height_) {
+        x = finger_[level];
+    } else {
+        x = list_->head_;
+        level = list_->GetMaxHeight() - 1;
+        finger_height_ = level + 1;
+    }
+    while (true) {
+        Node* next = x->Next(level);
+        if (list_->KeyIsAfterNode(target, target_prefix, next)) {
+            x = next;
+        } else {
+            finger_[level] = x;
+            if (level == 0) {
+                node_ = next;
+                return;
+            }
+            level--;
+        }
+    }
+}
+
+template <typename Comparator>
+inline void SkipList<Comparator>::Iterator::SeekToFirst() {
+    node_ = list_->head_->Next(0);
+}
+
+template <typename Comparator>
+inline void SkipList<Comparator>::Iterator::SeekToLast() {
+    node_ = list_->FindLast();
+    if (node_ == list_->head_) {
+        node_ = nullptr;
+    }
+}
+
+template <typename Comparator>
+SkipList<Comparator>::SkipList(Comparator cmp, Allocator* arena)
+    : compare_(cmp),
+      arena_(arena),
+      head_(AllocateNode(0 /* 头节点不存放 key */, kMaxHeight)),
+      max_height_(1) {
+    head_->prefix = 0;
+    for (int i = 0; i < kMaxHeight; i++) {
+        head_->SetNext(i, nullptr);
+    }
+    splice_.height = 0;
+}
+
+template <typename Comparator>
+char* SkipList<Comparator>::AllocateKey(size_t key_size) {
+    int height = RandomHeight();
+    Node* x = AllocateNode(key_size, height);
+    x->StashHeight(height);
+    return const_cast<char*>(x->Key());
+}
+
+template <typename Comparator>
+void SkipList<Comparator>::Insert(const char* key) {
+    Node* x = Node::FromKey(key);
+    const int height = x->UnstashHeight();
+    assert(height >= 1 && height <= kMaxHeight);
+    const uint64_t key_prefix = compare_.Prefix(key);
+    x->prefix = key_prefix;
+
+    // 自底向上找到从哪一层开始 splice_ 仍然可用：
+    // 第 recompute 层及以上、直到新节点的高度的每一层都是 key 的插入位置。
+    // 低层的插入位置范围小，key 离上一个 key 越近，需要重新计算的层越少
+    Splice* const s = &splice_;
+    const int max_height = GetMaxHeight();
+    int recompute = max_height;
+    if (s->height < max_height) {
+        // 第一次插入，或者 list 变高了：从 head_ 开始重新计算所有层
+        s->height = max_height;
+        s->prev[max_height] = head_;
+        s->next[max_height] = nullptr;
+    } else {
+        recompute = 0;
+        for (int i = 0; i < max_height; i++) {
+            if (!SpliceContains(key, key_prefix, i)) {
+                recompute = i + 1;
+            } else if (i + 1 >= height) {
+                break;
+            }
+        }
+    }
+    for (int i = recompute - 1; i >= 0; i--) {
+        FindSpliceForLevel(key, key_prefix, s->prev[i + 1], i, &s->prev[i],
+                           &s->next[i]);
+    }
+
+    // 不允许插入重复的 key
+    assert(s->next[0] == nullptr || !Equal(key, s->next[0]->Key()));
+
+    if (height > max_height) {
+        for (int i = max_height; i < height; i++) {
+            s->prev[i] = head_;
+            s->next[i] = nullptr;
+        }
+        s->height = height;
+        s->prev[height] = head_;
+        s->next[height] = nullptr;
+        // 这里不需要与并发的读者做任何同步。
+        // 读者如果读到了新的 max_height_，会看到 head_ 中新层级的
+        // 值为 nullptr（还没链接上新节点）或者新节点本身，两者都没有问题：
+        // nullptr 会让读者立刻下降到下一层
+        max_height_.store(height, std::memory_order_relaxed);
+    }
+
+    for (int i = 0; i < height; i++) {
+        // 先设置 x 的后继可以不加屏障，
+        // 因为随后 prev[i] 的 SetNext 会发布 x
+        x->NoBarrier_SetNext(i, s->next[i]);
+        s->prev[i]->SetNext(i, x);
+        // 下一个更大的 key 的插入位置在 x 之后
+        s->prev[i] = x;
+    }
+}
+
+template <typename Comparator>
+bool SkipList<Comparator>::SpliceContains(const char* key,
+                                          uint64_t key_prefix,
+                                          int level) const {
+    const Splice& s = splice_;
+    // ConcurrentInsert() 可能在 prev 和 next 之间插入了节点
+    if (s.prev[level]->NoBarrier_Next(level) != s.next[level]) {
+        return false;
+    }
+    // 要求 prev < key <= next，head_ 小于所有 key
+    if (s.prev[level] != head_ &&
+        !KeyIsAfterNode(key, key_prefix, s.prev[level])) {
+        return false;
+    }
+    return !KeyIsAfterNode(key, key_prefix, s.next[level]);
+}
+
+template <typename Comparator>
+void SkipList<Comparator>::ConcurrentInsert(const char* key) {
+    Node* x = Node::FromKey(key);
+    const int height = x->UnstashHeight();
+    assert(height >= 1 && height <= kMaxHeight);
+    const uint64_t key_prefix = compare_.Prefix(key);
+    x->prefix = key_prefix;
+
+    // 用 CAS 提高 max_height_，失败说明其他写者已经修改过，
+    // 重新读取后再判断是否还需要提高
+    int max_height = max_height_.load(std::memory_order_relaxed);
+    while (height > max_height) {
+        if (max_height_.compare_exchange_weak(max_height, height)) {
+            max_height = height;
+            break;
+        }
+    }
+
+    // 自顶向下计算每一层的插入位置（splice）。
+    // 上一层找到的前驱节点一定小于 key，可以作为下一层查找的起点
+    Node* prev[kMaxHeight];
+    Node* next[kMaxHeight];
+    Node* before = head_;
+    for (int i = max_height - 1; i >= 0; i--) {
+        FindSpliceForLevel(key, key_prefix, before, i, &prev[i], &next[i]);
+        before = prev[i];
+    }
+
+    // 不允许插入重复的 key
+    assert(next[0] == nullptr || !Equal(key, next[0]->Key()));
+
+    // 从 level 0 开始自底向上链接，保证节点在高层可见时，在低层也一定可见
+    for (int i = 0; i < height; i++) {
+        while (true) {
+            x->NoBarrier_SetNext(i, next[i]);
+            if (prev[i]->CASNext(i, next[i], x)) {
+                break;
+            }
+            // 有其他写者在 prev[i] 和 next[i] 之间插入了节点。
+            // 节点永远不会被删除，所以 prev[i] 仍然小于 key，
+            // 从它开始重新查找这一层的插入位置即可
+            FindSpliceForLevel(key, key_prefix, prev[i], i, &prev[i],
+                               &next[i]);
+            assert(next[i] == nullptr || !Equal(key, next[i]->Key()));
+        }
+    }
+}
+
+template <typename Comparator>
+void SkipList<Comparator>::FindSpliceForLevel(const char* key,
+                                              uint64_t key_prefix,
+                                              Node* before, int level,
+                                              Node** out_prev,
+                                              Node** out_next) const {
+    while (true) {
+        Node* next = before->Next(level);
+        if (KeyIsAfterNode(key, key_prefix, next)) {
+            before = next;
+        } else {
+            *out_prev = before;
+            *out_next = next;
+            return;
+        }
+    }
+}
+
+template <typename Comparator>
+bool SkipList<Comparator>::Contains(const char* key) const {
+    Node* x = FindGreaterOrEqual(key, nullptr);
+    return x != nullptr && Equal(key, x->Key());
+}
+
+template <typename Comparator>
+inline bool SkipList<Comparator>::KeyIsAfterNode(const char* key,
+                                                 uint64_t key_prefix,
+                                                 Node* n) const {
+    if (n == nullptr) {
+        return false;
+    }
+    // 前缀不同时可以直接得出结果，不需要访问 key 本身
+    if (n->prefix != key_prefix) {
+        return n->prefix < key_prefix;
+    }
+    return compare_(n->Key(), key) < 0;
+}
+
+template <typename Comparator>
+typename SkipList<Comparator>::Node*
+SkipList<Comparator>::FindGreaterOrEqual(const char* key, Node** prev) const {
+    const uint64_t key_prefix = compare_.Prefix(key);
+    Node* x = head_;
+    int level = GetMaxHeight() - 1;
+    // 用 while(true) 循环减少判断
+    while (true) {
+        Node* next = x->Next(level);
+        if (KeyIsAfterNode(key, key_prefix, next)) {
+            // 如果 next->key 小于 key，同层向后找
+            x = next;
+        } else {
+            if (prev != nullptr) prev[level] = x;
+            if (level == 0) {
+                return next;
+            } else {
+                // 去下一层，也就是下一个 list
+                level--;
+            }
+        }
+    }
+}
+
+template <typename Comparator>
+typename SkipList<Comparator>::Node* SkipList<Comparator>::AllocateNode(
+    size_t key_size, int height) {
+    // tower 放在节点之前，key 放在节点之后
+    const size_t prefix_bytes = sizeof(std::atomic<Node*>) * (height - 1);
+    char* const raw =
+        arena_->AllocateAligned(prefix_bytes + sizeof(Node) + key_size);
+    // new (raw) T 表示对象构造在已有的内存上
+    for (int i = 0; i < height - 1; i++) {
+        new (raw + i * sizeof(std::atomic<Node*>)) std::atomic<Node*>(nullptr);
+    }
+    return new (raw + prefix_bytes) Node();
+}
+
+template <typename Comparator>
+int SkipList<Comparator>::RandomHeight() {
+    // 每个线程使用自己的随机数生成器，种子由线程 id 决定
+    static thread_local Random rnd(static_cast<uint32_t>(
+        std::hash<std::thread::id>()(std::this_thread::get_id())));
+    static const unsigned int kBranching = 4;
+    int height = 1;
+    // 1/kBranching 的概率增加高度
+    // SkipList 默认最大有 12，所以生成 i 层节点的概率为：1/(4^(i-1))
+    while (height < kMaxHeight && rnd.OneIn(kBranching)) {
+        height++;
+    }
+    assert(height > 0);
+    assert(height <= kMaxHeight);
+    return height;
+}
+
+template <typename Comparator>
+typename SkipList<Comparator>::Node* SkipList<Comparator>::FindLast() const {
+    Node* x = head_;
+    int level = GetMaxHeight() - 1;
+    while (true) {
+        Node* next = x->Next(level);
+        if (next == nullptr) {
+            if (level == 0) {
+                return x;
+            } else {
+                // Switch to next list
+                // 去下一层
+                level--;
+            }
+        } else {
+            x = next;
+        }
+    }
+}
+
+template <typename Comparator>
+typename SkipList<Comparator>::Node* SkipList<Comparator>::FindLessThan(
+    const char* key) const {
+    const uint64_t key_prefix = compare_.Prefix(key);
+    Node* x = head_;
+    int level = GetMaxHeight() - 1;
+    while (true) {
+        assert(x == head_ || compare_(x->Key(), key) < 0);
+        Node* next = x->Next(level);
+        if (!KeyIsAfterNode(key, key_prefix, next)) {
+            if (level == 0) {
+                return x;
+            } else {
+                level--;
+            }
+        } else {
+            x = next;
+        }
+    }
+}
+
 }  // namespace massdb
 
 #endif  // MASSDB_SKIPTLIST_H
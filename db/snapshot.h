@@ -0,0 +1,104 @@
+//
+// Created by Xsakura on 2023/6/22.
+//
+
+#ifndef MASSDB_DB_SNAPSHOT_H
+#define MASSDB_DB_SNAPSHOT_H
+
+#include <cassert>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "massdb/db.h"
+
+namespace massdb {
+
+class SnapshotList;
+
+// 快照就是一个序列号：读者只能看到序列号不大于它的版本。
+// 快照保存在 DBImpl 的双向链表中，由 DBImpl::mutex_ 保护
+class SnapshotImpl : public Snapshot {
+public:
+    explicit SnapshotImpl(SequenceNumber sequence_number)
+        : sequence_number_(sequence_number) {}
+
+    SequenceNumber sequence_number() const { return sequence_number_; }
+
+private:
+    friend class SnapshotList;
+
+    // SnapshotImpl 是 SnapshotList 中的节点
+    SnapshotImpl* prev_;
+    SnapshotImpl* next_;
+
+    const SequenceNumber sequence_number_;
+
+#ifndef NDEBUG
+    // 用于检查快照是否属于这个链表
+    SnapshotList* list_ = nullptr;
+#endif
+};
+
+// 按序列号升序排列的快照链表
+class SnapshotList {
+public:
+    SnapshotList() : head_(0) {
+        head_.prev_ = &head_;
+        head_.next_ = &head_;
+    }
+
+    bool empty() const { return head_.next_ == &head_; }
+    SnapshotImpl* oldest() const {
+        assert(!empty());
+        return head_.next_;
+    }
+    SnapshotImpl* newest() const {
+        assert(!empty());
+        return head_.prev_;
+    }
+
+    // 新建一个快照追加到链表的尾部。
+    // 要求：sequence_number 不小于链表中所有快照的序列号
+    SnapshotImpl* New(SequenceNumber sequence_number) {
+        assert(empty() || newest()->sequence_number_ <= sequence_number);
+
+        SnapshotImpl* snapshot = new SnapshotImpl(sequence_number);
+#ifndef NDEBUG
+        snapshot->list_ = this;
+#endif
+        snapshot->next_ = &head_;
+        snapshot->prev_ = head_.prev_;
+        snapshot->prev_->next_ = snapshot;
+        snapshot->next_->prev_ = snapshot;
+        return snapshot;
+    }
+
+    // 从链表中移除并删除 snapshot
+    void Delete(const SnapshotImpl* snapshot) {
+#ifndef NDEBUG
+        assert(snapshot->list_ == this);
+#endif
+        snapshot->prev_->next_ = snapshot->next_;
+        snapshot->next_->prev_ = snapshot->prev_;
+        delete snapshot;
+    }
+
+    // 将所有快照的序列号按升序存入 *sequences，相同的序列号只保留一个
+    void GetAll(std::vector<SequenceNumber>* sequences) const {
+        sequences->clear();
+        for (const SnapshotImpl* s = head_.next_; s != &head_; s = s->next_) {
+            if (sequences->empty() ||
+                sequences->back() != s->sequence_number_) {
+                sequences->push_back(s->sequence_number_);
+            }
+        }
+    }
+
+private:
+    // 链表的空头节点，head_.prev_ 是最新的快照，head_.next_ 是最旧的快照
+    SnapshotImpl head_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_SNAPSHOT_H
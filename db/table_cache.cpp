@@ -0,0 +1,541 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "db/table_cache.h"
+
+#include <memory>
+#include <mutex>
+
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/table.h"
+#include "table/format.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+struct TableAndFile {
+    RandomAccessFile* file;
+    Table* table;
+    // 打开文件时给出的访问提示，没有顺序扫描时恢复为它
+    RandomAccessFile::AccessPattern pattern;
+    uint64_t data_end;  // 数据块和过滤器块之后的位置，扫描只会读到这里
+    std::mutex mu;   // 保护 scans、sequential 和对 file 的提示
+    int scans;       // 正在顺序扫描这个文件的迭代器数量
+    bool sequential;  // 扫描给出了顺序读取的提示，还没有恢复
+};
+
+static void DeleteEntry(const Slice& key, void* value) {
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+    delete tf->table;
+    delete tf->file;
+    delete tf;
+}
+
+static void UnrefEntry(void* arg1, void* arg2) {
+    Cache* cache = reinterpret_cast<Cache*>(arg1);
+    Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
+    cache->Release(h);
+}
+
+namespace {
+
+// fill_cache 为 false 的迭代器通常来自压实或者批量扫描，从定位的位置开始
+// 顺序读到文件末尾。文件在缓存中与点查共享，所以只提示从定位的数据块到
+// 数据块末尾的范围会被顺序读取，最后一个扫描结束时恢复原来的提示。
+//
+// 定位本身只读取一个数据块，所以提示推迟到第一次 Next() 时才计算，
+// 只定位不遍历（例如合并迭代器定位后只读取第一个 key）时不需要
+// 查找索引块。之后的定位落在已经提示过的范围内时也不再重复提示
+class ScanIterator : public Iterator {
+public:
+    ScanIterator(const Comparator* icmp, TableAndFile* tf, Iterator* iter)
+        : icmp_(icmp),
+          tf_(tf),
+          iter_(iter),
+          hint_pending_(false),
+          hinted_(false) {
+        std::lock_guard<std::mutex> l(tf_->mu);
+        tf_->scans++;
+    }
+
+    ScanIterator(const ScanIterator&) = delete;
+    ScanIterator& operator=(const ScanIterator&) = delete;
+
+    ~ScanIterator() override {
+        delete iter_;
+        std::lock_guard<std::mutex> l(tf_->mu);
+        if (--tf_->scans == 0 && tf_->sequential) {
+            tf_->file->Hint(tf_->pattern);
+            tf_->sequential = false;
+        }
+    }
+
+    bool Valid() const override { return iter_->Valid(); }
+    void Seek(const Slice& target) override {
+        iter_->Seek(target);
+        hint_pending_ = true;
+    }
+    void SeekToFirst() override {
+        iter_->SeekToFirst();
+        hint_pending_ = true;
+    }
+    void SeekToLast() override {
+        iter_->SeekToLast();
+        hint_pending_ = false;
+    }
+    void Next() override {
+        if (hint_pending_) {
+            HintSequential();
+        }
+        iter_->Next();
+    }
+    void Prev() override { iter_->Prev(); }
+    Slice key() const override { return iter_->key(); }
+    Slice value() const override { return iter_->value(); }
+    Status status() const override { return iter_->status(); }
+
+private:
+    // 提示从当前位置到数据块末尾会被顺序读取
+    void HintSequential() {
+        hint_pending_ = false;
+        const Slice key = iter_->key();
+        if (hinted_ && icmp_->Compare(key, hinted_key_) >= 0) {
+            return;  // 已经提示过更大的范围
+        }
+        const uint64_t offset = tf_->table->ApproximateOffsetOf(key);
+        const uint64_t end = tf_->data_end;
+        if (offset < end) {
+            std::lock_guard<std::mutex> l(tf_->mu);
+            tf_->file->HintRange(RandomAccessFile::kSequential, offset,
+                                 end - offset);
+            tf_->sequential = true;
+        }
+        hinted_ = true;
+        hinted_key_.assign(key.data(), key.size());
+    }
+
+    const Comparator* const icmp_;
+    TableAndFile* const tf_;
+    Iterator* const iter_;
+    bool hint_pending_;  // 定位之后还没有检查是否需要提示
+    bool hinted_;        // 已经提示过从 hinted_key_ 开始的范围
+    std::string hinted_key_;
+};
+
+// 将 key 的序列号改写为 sequence，类型不变，结果存入 *result
+void ReplaceSequence(const Slice& key, SequenceNumber sequence,
+                     std::string* result) {
+    const Slice user_key = ExtractUserKey(key);
+    const ValueType type = static_cast<ValueType>(
+        DecodeFixed64(key.data() + user_key.size()) & 0xff);
+    result->assign(user_key.data(), user_key.size());
+    PutFixed64(result, PackSequenceAndType(sequence, type));
+}
+
+// 有全局序列号的文件的迭代器，返回的 key 的序列号都改写为全局序列号。
+// 文件中的 user key 互不相同，改写之后的顺序不变，但文件中的序列号
+// 与改写之后的不同，定位时要先按 user key 找到位置
+class GlobalSequenceIterator : public Iterator {
+public:
+    GlobalSequenceIterator(const Comparator* icmp, SequenceNumber sequence,
+                           Iterator* iter)
+        : icmp_(icmp), sequence_(sequence), iter_(iter) {}
+
+    GlobalSequenceIterator(const GlobalSequenceIterator&) = delete;
+    GlobalSequenceIterator& operator=(const GlobalSequenceIterator&) = delete;
+
+    ~GlobalSequenceIterator() override { delete iter_; }
+
+    bool Valid() const override { return iter_->Valid(); }
+    void Seek(const Slice& target) override {
+        std::string seek_key;
+        AppendInternalKey(&seek_key,
+                          ParsedInternalKey(ExtractUserKey(target),
+                                            kMaxSequenceNumber,
+                                            kValueTypeForSeek));
+        iter_->Seek(seek_key);
+        Update();
+        // 改写之后序列号比 target 的大时排在 target 的前面
+        while (iter_->Valid() && icmp_->Compare(key_, target) < 0) {
+            iter_->Next();
+            Update();
+        }
+    }
+    void SeekToFirst() override {
+        iter_->SeekToFirst();
+        Update();
+    }
+    void SeekToLast() override {
+        iter_->SeekToLast();
+        Update();
+    }
+    void Next() override {
+        iter_->Next();
+        Update();
+    }
+    void Prev() override {
+        iter_->Prev();
+        Update();
+    }
+    Slice key() const override { return key_; }
+    Slice value() const override { return iter_->value(); }
+    Status status() const override { return iter_->status(); }
+
+private:
+    void Update() {
+        if (iter_->Valid()) {
+            ReplaceSequence(iter_->key(), sequence_, &key_);
+        }
+    }
+
+    const Comparator* const icmp_;
+    const SequenceNumber sequence_;
+    Iterator* const iter_;
+    std::string key_;
+};
+
+// Get() 查找有全局序列号的文件时传给 Table::InternalGet() 的参数
+struct GlobalSequenceSaver {
+    SequenceNumber sequence;
+    void* arg;
+    void (*handle_result)(void*, const Slice&, const Slice&);
+};
+
+void SaveWithGlobalSequence(void* arg, const Slice& k, const Slice& v) {
+    GlobalSequenceSaver* saver = reinterpret_cast<GlobalSequenceSaver*>(arg);
+    std::string key;
+    ReplaceSequence(k, saver->sequence, &key);
+    (*saver->handle_result)(saver->arg, key, v);
+}
+
+}  // namespace
+
+// MultiGet() 合并读取时，相邻两个数据块之间的空隙不超过这么多字节
+// 就一起读取：多读一点数据比多一次 I/O 便宜
+static const uint64_t kMultiGetCoalesceGap = 4096;
+// 合并后的一次读取最多这么多字节
+static const uint64_t kMultiGetMaxReadSize = 256 * 1024;
+
+namespace {
+
+// MultiGet() 中需要从文件读取的一个数据块
+struct PendingBlock {
+    size_t batch;  // 所在的 GetBatch
+    BlockHandle handle;
+    // 在这个块中查找的 key 在 block_keys 中的范围 [first_key, last_key)
+    size_t first_key;
+    size_t last_key;
+    size_t request;  // 包含这个块的读取请求
+};
+
+}  // namespace
+
+// 在 iter 指向的数据块中依次查找 batch.keys[key_index[first, last)]，
+// 完成后删除 iter
+static Status SeekInBlock(const Comparator* icmp, Iterator* iter,
+                          const TableCache::GetBatch& batch,
+                          const size_t* key_index, size_t first, size_t last,
+                          void (*handle_result)(void*, const Slice&,
+                                                const Slice&)) {
+    if (batch.global_sequence > 0) {
+        iter = new GlobalSequenceIterator(icmp, batch.global_sequence, iter);
+    }
+    for (size_t k = first; k < last && iter->status().IsOk(); k++) {
+        const size_t i = key_index[k];
+        iter->Seek(batch.keys[i]);
+        if (iter->Valid()) {
+            (*handle_result)(batch.args[i], iter->key(), iter->value());
+        }
+    }
+    Status s = iter->status();
+    delete iter;
+    return s;
+}
+
+TableCache::TableCache(const std::string& dbname, const Options& options,
+                       int entries, FileNameFunction file_name)
+    : env_(options.env),
+      dbname_(dbname),
+      options_(options),
+      file_name_(file_name),
+      cache_(NewLRUCache(entries)) {}
+
+TableCache::~TableCache() { delete cache_; }
+
+Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+                             Cache::Handle** handle) {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    Slice key(buf, sizeof(buf));
+    *handle = cache_->Lookup(key);
+    if (*handle != nullptr) {
+        return Status::Ok();
+    }
+
+    // 打开文件时不持有任何锁。多个线程同时打开同一个文件时，
+    // 后插入的条目替换先插入的，先插入的在句柄释放后关闭
+    std::string fname = (*file_name_)(dbname_, file_number);
+    RandomAccessFile* file = nullptr;
+    Table* table = nullptr;
+    Status s = options_.use_mmap_reads
+                   ? env_->NewMmapReadableFile(fname, &file)
+                   : env_->NewRandomAccessFile(fname, &file);
+    // 点查只读取一两个块，预读的页大多用不到
+    const RandomAccessFile::AccessPattern pattern =
+        options_.use_mmap_reads ? RandomAccessFile::kRandom
+                                : RandomAccessFile::kNormal;
+    if (s.IsOk() && pattern != RandomAccessFile::kNormal) {
+        file->Hint(pattern);
+    }
+    if (s.IsOk()) {
+        s = Table::Open(options_, file, file_size, &table);
+    }
+
+    if (!s.IsOk()) {
+        assert(table == nullptr);
+        delete file;
+        // 不缓存错误的结果，这样错误恢复之后（例如文件被修复）可以重新打开
+        return s;
+    }
+
+    TableAndFile* tf = new TableAndFile;
+    tf->file = file;
+    tf->table = table;
+    tf->pattern = pattern;
+    tf->data_end = table->DataEndOffset();
+    tf->scans = 0;
+    tf->sequential = false;
+    *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+    return s;
+}
+
+Iterator* TableCache::NewIterator(const ReadOptions& options,
+                                  uint64_t file_number, uint64_t file_size,
+                                  SequenceNumber global_sequence,
+                                  Table** tableptr) {
+    if (tableptr != nullptr) {
+        *tableptr = nullptr;
+    }
+
+    Cache::Handle* handle = nullptr;
+    Status s = FindTable(file_number, file_size, &handle);
+    if (!s.IsOk()) {
+        return NewErrorIterator(s);
+    }
+
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    // 迭代器持有句柄，期间文件不会被关闭
+    Iterator* result = tf->table->NewIterator(options);
+    if (!options.fill_cache) {
+        result = new ScanIterator(options_.comparator, tf, result);
+    }
+    if (global_sequence > 0) {
+        result = new GlobalSequenceIterator(options_.comparator,
+                                            global_sequence, result);
+    }
+    result->RegisterCleanup(&UnrefEntry, cache_, handle);
+    if (tableptr != nullptr) {
+        *tableptr = tf->table;
+    }
+    return result;
+}
+
+Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
+                       uint64_t file_size, SequenceNumber global_sequence,
+                       const Slice& k, void* arg,
+                       void (*handle_result)(void*, const Slice&,
+                                             const Slice&)) {
+    GlobalSequenceSaver saver;
+    if (global_sequence > 0) {
+        // 文件中的 user key 互不相同，k 的序列号比全局序列号小时
+        // 看不到文件中的任何版本。否则文件中的序列号比全局序列号小，
+        // 按 k 查找能找到同一个 user key，只需要改写找到的 key
+        if (global_sequence > DecodeFixed64(k.data() + k.size() - 8) >> 8) {
+            return Status::Ok();
+        }
+        saver.sequence = global_sequence;
+        saver.arg = arg;
+        saver.handle_result = handle_result;
+        arg = &saver;
+        handle_result = &SaveWithGlobalSequence;
+    }
+
+    Cache::Handle* handle = nullptr;
+    Status s = FindTable(file_number, file_size, &handle);
+    if (s.IsOk()) {
+        Table* t =
+            reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+        s = t->InternalGet(options, k, arg, handle_result);
+        cache_->Release(handle);
+    }
+    return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options, GetBatch* batches,
+                            size_t n,
+                            void (*handle_result)(void*, const Slice&,
+                                                  const Slice&)) {
+    std::vector<Cache::Handle*> handles;
+    std::vector<TableAndFile*> tables(n);
+    // 按数据块分组后的 key 在各自 GetBatch 中的下标
+    std::vector<size_t> block_keys;
+    std::vector<PendingBlock> pending;
+    std::vector<BlockHandle> block_handles;
+    Status s;
+
+    // 第一步：检查过滤器，在索引块中找到每个 key 所在的数据块，
+    // 块缓存中已有的块直接查找
+    for (size_t b = 0; b < n && s.IsOk(); b++) {
+        const GetBatch& batch = batches[b];
+        Cache::Handle* handle = nullptr;
+        s = FindTable(batch.file_number, batch.file_size, &handle);
+        if (!s.IsOk()) {
+            break;
+        }
+        handles.push_back(handle);
+        TableAndFile* tf =
+            reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+        tables[b] = tf;
+
+        const size_t m = batch.keys.size();
+        std::unique_ptr<bool[]> may_match(new bool[m]);
+        block_handles.resize(m);
+        s = tf->table->PrepareMultiGet(batch.keys.data(), m, may_match.get(),
+                                       block_handles.data());
+        // keys 有序，同一个数据块中的 key 是相邻的
+        size_t i = 0;
+        while (i < m && s.IsOk()) {
+            if (!may_match[i]) {
+                i++;
+                continue;
+            }
+            const BlockHandle block_handle = block_handles[i];
+            const size_t first = block_keys.size();
+            for (; i < m; i++) {
+                if (may_match[i]) {
+                    if (block_handles[i].offset() != block_handle.offset()) {
+                        break;
+                    }
+                    block_keys.push_back(i);
+                }
+            }
+
+            Iterator* iter = tf->table->CachedBlockIterator(block_handle);
+            if (iter == nullptr && options_.use_mmap_reads) {
+                // 读取映射的文件不需要等待 I/O，并且可以直接使用映射的页
+                BlockContents contents;
+                s = ReadBlock(tf->file, options, block_handle, &contents);
+                if (s.IsOk()) {
+                    iter = tf->table->NewBlockIterator(options, block_handle,
+                                                       contents);
+                }
+            }
+            if (iter != nullptr) {
+                s = SeekInBlock(options_.comparator, iter, batch,
+                                block_keys.data(), first, block_keys.size(),
+                                handle_result);
+                block_keys.resize(first);
+            } else if (s.IsOk()) {
+                pending.push_back(PendingBlock{b, block_handle, first,
+                                               block_keys.size(), 0});
+            }
+        }
+    }
+
+    // 第二步：合并同一个文件中相邻的数据块，所有读取一起提交
+    std::vector<ReadRequest> requests;
+    std::vector<std::unique_ptr<char[]>> buffers;
+    if (s.IsOk() && !pending.empty()) {
+        for (size_t p = 0; p < pending.size(); p++) {
+            PendingBlock& block = pending[p];
+            const uint64_t start = block.handle.offset();
+            const uint64_t end =
+                start + block.handle.size() + kBlockTrailerSize;
+            if (p > 0 && pending[p - 1].batch == block.batch) {
+                ReadRequest& last = requests.back();
+                const uint64_t last_end = last.offset + last.n;
+                if (start >= last_end &&
+                    start - last_end <= kMultiGetCoalesceGap &&
+                    end - last.offset <= kMultiGetMaxReadSize) {
+                    last.n = static_cast<size_t>(end - last.offset);
+                    block.request = requests.size() - 1;
+                    continue;
+                }
+            }
+            ReadRequest r;
+            r.file = tables[block.batch]->file;
+            r.offset = start;
+            r.n = static_cast<size_t>(end - start);
+            r.scratch = nullptr;
+            block.request = requests.size();
+            requests.push_back(r);
+        }
+        for (ReadRequest& r : requests) {
+            buffers.emplace_back(new char[r.n]);
+            r.scratch = buffers.back().get();
+        }
+        env_->MultiRead(requests.data(), requests.size());
+
+        // 第三步：解码读到的数据块，放入块缓存并查找
+        for (const PendingBlock& block : pending) {
+            const ReadRequest& r = requests[block.request];
+            s = r.status;
+            if (!s.IsOk()) {
+                break;
+            }
+            const uint64_t skip = block.handle.offset() - r.offset;
+            const size_t size = block.handle.size() + kBlockTrailerSize;
+            if (r.result.size() < skip + size) {
+                s = Status::Corruption("truncated block read");
+                break;
+            }
+            BlockContents contents;
+            s = DecodeBlock(options, Slice(r.result.data() + skip, size),
+                            &contents);
+            if (!s.IsOk()) {
+                break;
+            }
+            Iterator* iter = tables[block.batch]->table->NewBlockIterator(
+                options, block.handle, contents);
+            s = SeekInBlock(options_.comparator, iter, batches[block.batch],
+                            block_keys.data(), block.first_key,
+                            block.last_key, handle_result);
+            if (!s.IsOk()) {
+                break;
+            }
+        }
+    }
+
+    for (Cache::Handle* handle : handles) {
+        cache_->Release(handle);
+    }
+    return s;
+}
+
+Status TableCache::GetIndexKeys(uint64_t file_number, uint64_t file_size,
+                                std::vector<std::string>* keys) {
+    Cache::Handle* handle = nullptr;
+    Status s = FindTable(file_number, file_size, &handle);
+    if (s.IsOk()) {
+        Table* t =
+            reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+        Iterator* iter = t->NewIndexIterator();
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            keys->push_back(iter->key().to_string());
+        }
+        s = iter->status();
+        delete iter;
+        cache_->Release(handle);
+    }
+    return s;
+}
+
+void TableCache::Evict(uint64_t file_number) {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    cache_->Erase(Slice(buf, sizeof(buf)));
+}
+
+}  // namespace massdb
@@ -0,0 +1,105 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_DB_TABLE_CACHE_H
+#define MASSDB_DB_TABLE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "massdb/cache.h"
+#include "massdb/options.h"
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class Env;
+class Iterator;
+class RandomAccessFile;
+class Table;
+
+// 缓存已经打开的 table 文件，避免每次读取都重新打开文件并解析索引块。
+// 打开的文件保存在分片的 LRU 缓存中，数量超过上限时关闭最久没有使用的文件，
+// 不同分片的查找互不阻塞。线程安全
+class TableCache {
+public:
+    // 由数据库名和文件编号得到文件名的函数
+    typedef std::string (*FileNameFunction)(const std::string& dbname,
+                                             uint64_t number);
+
+    // 文件名由 file_name 决定，默认打开数据库中的 table 文件。
+    // 最多保持 entries 个文件打开，正在被迭代器使用的文件不会被关闭，
+    // 可能暂时超过上限
+    TableCache(const std::string& dbname, const Options& options, int entries,
+               FileNameFunction file_name = TableFileName);
+
+    TableCache(const TableCache&) = delete;
+    TableCache& operator=(const TableCache&) = delete;
+
+    ~TableCache();
+
+    // 返回编号为 file_number 的 table 文件的迭代器，
+    // 要求 file_size 与文件的实际大小相同。global_sequence 不为 0 时
+    // 迭代器返回的 key 的序列号都改写为它（见 FileMetaData）。
+    //
+    // 如果 tableptr 不为 nullptr，将迭代器底层的 Table 存入 *tableptr，
+    // 它属于 TableCache，调用者不能删除它，并且只在迭代器存活期间有效
+    Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
+                          uint64_t file_size, SequenceNumber global_sequence,
+                          Table** tableptr = nullptr);
+
+    // 在指定的文件中查找 internal key k，
+    // 找到时调用 (*handle_result)(arg, found_key, found_value)。
+    // global_sequence 与 NewIterator() 相同
+    Status Get(const ReadOptions& options, uint64_t file_number,
+               uint64_t file_size, SequenceNumber global_sequence,
+               const Slice& k, void* arg,
+               void (*handle_result)(void*, const Slice&, const Slice&));
+
+    // MultiGet() 中在一个 table 文件里查找的一组 key
+    struct GetBatch {
+        uint64_t file_number;
+        uint64_t file_size;
+        SequenceNumber global_sequence;  // 与 NewIterator() 相同
+        std::vector<Slice> keys;  // internal key，按升序排列
+        std::vector<void*> args;  // 找到 keys[i] 时传给 handle_result 的 arg
+    };
+
+    // 在 batches[0, n - 1] 中查找，结果与对每个 key 调用 Get() 相同。
+    // 同一个文件的 key 批量检查过滤器，落在同一个数据块中的 key 只读取一次。
+    // 不在块缓存中的数据块合并相邻的区域后，所有文件的读取一起交给
+    // Env::MultiRead()
+    Status MultiGet(const ReadOptions& options, GetBatch* batches, size_t n,
+                    void (*handle_result)(void*, const Slice&, const Slice&));
+
+    // 将指定文件的索引块中的 key 追加到 *keys 中。
+    // 每个 key 对应一个数据块，相邻的 key 之间大约是 block_size 字节的数据，
+    // 可以用来按数据量划分文件的 key 范围
+    Status GetIndexKeys(uint64_t file_number, uint64_t file_size,
+                        std::vector<std::string>* keys);
+
+    // 将编号为 file_number 的文件移出缓存，
+    // 文件在所有使用它的迭代器都被删除之后关闭
+    void Evict(uint64_t file_number);
+
+private:
+    // 在缓存中查找文件，没有时打开文件并加入缓存。
+    // 成功时将句柄存入 *handle，调用者用完之后需要 Release()
+    Status FindTable(uint64_t file_number, uint64_t file_size,
+                     Cache::Handle** handle);
+
+    Env* const env_;
+    const std::string dbname_;
+    const Options& options_;
+    const FileNameFunction file_name_;
+    Cache* cache_;  // 文件编号 -> TableAndFile
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_TABLE_CACHE_H
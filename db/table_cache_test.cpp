@@ -0,0 +1,369 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "db/table_cache.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "gtest/gtest.h"
+#include "massdb/comparator.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "massdb/table_builder.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+namespace {
+
+// 记录同时打开的随机读取文件的数量以及它的最大值
+class CountingEnv : public test::EnvWrapper {
+public:
+    explicit CountingEnv(Env* target)
+        : EnvWrapper(target),
+          open_files_(0),
+          max_open_files_(0),
+          total_opens_(0) {}
+
+    Status NewRandomAccessFile(const std::string& fname,
+                               RandomAccessFile** result) override {
+        Status s = target()->NewRandomAccessFile(fname, result);
+        if (s.IsOk()) *result = new CountingFile(this, *result);
+        return s;
+    }
+    Status NewMmapReadableFile(const std::string& fname,
+                               RandomAccessFile** result) override {
+        Status s = target()->NewMmapReadableFile(fname, result);
+        if (s.IsOk()) *result = new CountingFile(this, *result);
+        return s;
+    }
+
+    int open_files() const { return open_files_.load(); }
+    int max_open_files() const { return max_open_files_.load(); }
+    int total_opens() const { return total_opens_.load(); }
+
+    // 返回并清空记录的访问提示，例如 "hint 1" 或者 "range 2 4096"，
+    // 数字是 AccessPattern 和范围的起点
+    std::vector<std::string> TakeHints() {
+        std::lock_guard<std::mutex> l(mu_);
+        std::vector<std::string> result;
+        result.swap(hints_);
+        return result;
+    }
+    void ResetMax() { max_open_files_.store(open_files_.load()); }
+
+private:
+    class CountingFile : public RandomAccessFile {
+    public:
+        CountingFile(CountingEnv* env, RandomAccessFile* target)
+            : env_(env), target_(target) {
+            ++env_->total_opens_;
+            const int n = ++env_->open_files_;
+            int max = env_->max_open_files_.load();
+            while (n > max && !env_->max_open_files_.compare_exchange_weak(max, n)) {
+            }
+        }
+        ~CountingFile() override {
+            delete target_;
+            --env_->open_files_;
+        }
+
+        Status Read(uint64_t offset, size_t n, Slice* result,
+                    char* scratch) const override {
+            return target_->Read(offset, n, result, scratch);
+        }
+        void Hint(AccessPattern pattern) override {
+            env_->RecordHint("hint " + std::to_string(pattern));
+            target_->Hint(pattern);
+        }
+        void HintRange(AccessPattern pattern, uint64_t offset,
+                       uint64_t n) override {
+            env_->RecordHint("range " + std::to_string(pattern) + " " +
+                             std::to_string(offset));
+            target_->HintRange(pattern, offset, n);
+        }
+
+    private:
+        CountingEnv* const env_;
+        RandomAccessFile* const target_;
+    };
+
+    std::atomic<int> open_files_;
+    std::atomic<int> max_open_files_;
+    std::atomic<int> total_opens_;
+
+    void RecordHint(const std::string& hint) {
+        std::lock_guard<std::mutex> l(mu_);
+        hints_.push_back(hint);
+    }
+
+    std::mutex mu_;
+    std::vector<std::string> hints_;
+};
+
+std::string FileKey(int file, int i) {
+    return "file" + std::to_string(1000 + file) + "-key" +
+           std::to_string(1000 + i);
+}
+
+void SaveValue(void* arg, const Slice& key, const Slice& value) {
+    *reinterpret_cast<std::string*>(arg) = value.to_string();
+}
+
+}  // namespace
+
+static const int kNumFiles = 100;
+static const int kKeysPerFile = 20;
+
+class TableCacheTest : public testing::Test {
+public:
+    TableCacheTest()
+        : env_(Env::Default()),
+          dbname_(test::NewTestDirectory("table_cache_test")),
+          icmp_(BytewiseComparator()) {
+        env_.CreateDir(dbname_);
+        options_.env = &env_;
+        options_.comparator = &icmp_;
+        for (int f = 0; f < kNumFiles; f++) {
+            BuildFile(f, kKeysPerFile);
+        }
+    }
+
+    ~TableCacheTest() override {
+        cache_.reset();
+        test::DestroyDirectory(&env_, dbname_);
+    }
+
+    // 文件 f 的编号是 f + 1
+    void BuildFile(int f, int num_keys) {
+        WritableFile* file;
+        ASSERT_TRUE(
+            env_.NewWritableFile(TableFileName(dbname_, f + 1), &file).IsOk());
+        TableBuilder builder(options_, file);
+        for (int i = 0; i < num_keys; i++) {
+            InternalKey key(FileKey(f, i), 1, kTypeValue);
+            builder.Add(key.Encode(), "value" + std::to_string(f * 100 + i));
+        }
+        ASSERT_TRUE(builder.Finish().IsOk());
+        ASSERT_TRUE(file->Close().IsOk());
+        delete file;
+        sizes_.resize(f + 1);
+        sizes_[f] = builder.FileSize();
+    }
+
+    static std::string SeekKey(int f, int i) {
+        return InternalKey(FileKey(f, i), kMaxSequenceNumber, kValueTypeForSeek)
+            .Encode()
+            .to_string();
+    }
+
+    std::string Get(int f, int i) {
+        InternalKey key(FileKey(f, i), kMaxSequenceNumber, kValueTypeForSeek);
+        std::string value = "NOT_FOUND";
+        Status s = cache_->Get(ReadOptions(), f + 1, sizes_[f], 0,
+                               key.Encode(), &value, &SaveValue);
+        return s.IsOk() ? value : s.ToString();
+    }
+
+    CountingEnv env_;
+    const std::string dbname_;
+    InternalKeyComparator icmp_;
+    Options options_;
+    std::vector<uint64_t> sizes_;
+    std::unique_ptr<TableCache> cache_;
+};
+
+TEST_F(TableCacheTest, OpenFilesBounded) {
+    for (int entries : {1, 7, 16, 20, 50}) {
+        cache_.reset(new TableCache(dbname_, options_, entries));
+        ASSERT_EQ(0, env_.open_files());
+        env_.ResetMax();
+        Random rnd(entries);
+        for (int n = 0; n < 2000; n++) {
+            const int f = rnd.Uniform(kNumFiles);
+            const int i = rnd.Uniform(kKeysPerFile);
+            ASSERT_EQ("value" + std::to_string(f * 100 + i), Get(f, i));
+            ASSERT_LE(env_.open_files(), entries);
+        }
+        // 新文件在加入缓存、淘汰旧文件之前打开，所以会短暂地多出一个
+        ASSERT_LE(env_.max_open_files(), entries + 1) << entries;
+    }
+
+    // 容量足够时每个文件只打开一次，之后都命中缓存
+    cache_.reset(new TableCache(dbname_, options_, kNumFiles));
+    const int opens = env_.total_opens();
+    for (int round = 0; round < 3; round++) {
+        for (int f = 0; f < 8; f++) {
+            ASSERT_EQ("value" + std::to_string(f * 100), Get(f, 0));
+        }
+    }
+    ASSERT_EQ(8, env_.open_files());
+    ASSERT_EQ(opens + 8, env_.total_opens());
+    cache_.reset();
+    ASSERT_EQ(0, env_.open_files());
+}
+
+TEST_F(TableCacheTest, IteratorsPinFiles) {
+    const int kEntries = 16;
+    cache_.reset(new TableCache(dbname_, options_, kEntries));
+
+    // 正在使用的文件不会被关闭，可以暂时超过上限
+    std::vector<std::unique_ptr<Iterator>> iters;
+    for (int f = 0; f < 40; f++) {
+        iters.emplace_back(
+            cache_->NewIterator(ReadOptions(), f + 1, sizes_[f], 0));
+    }
+    ASSERT_EQ(40, env_.open_files());
+    for (int f = 0; f < 40; f++) {
+        Iterator* iter = iters[f].get();
+        iter->SeekToFirst();
+        int count = 0;
+        for (; iter->Valid(); iter->Next()) count++;
+        ASSERT_EQ(kKeysPerFile, count);
+        ASSERT_TRUE(iter->status().IsOk());
+    }
+    // 迭代器被删除之后回到上限之内
+    iters.clear();
+    ASSERT_LE(env_.open_files(), kEntries);
+
+    // Evict() 在最后一个使用者释放文件后关闭它
+    cache_.reset(new TableCache(dbname_, options_, kEntries));
+    ASSERT_EQ("value0", Get(0, 0));
+    std::unique_ptr<Iterator> iter(
+        cache_->NewIterator(ReadOptions(), 1, sizes_[0], 0));
+    ASSERT_EQ(1, env_.open_files());
+    cache_->Evict(1);
+    ASSERT_EQ(1, env_.open_files());
+    iter.reset();
+    ASSERT_EQ(0, env_.open_files());
+    ASSERT_EQ("value1", Get(0, 1));
+    ASSERT_EQ(1, env_.open_files());
+}
+
+TEST_F(TableCacheTest, ConcurrentLookups) {
+    const int kEntries = 32;
+    const int kThreads = 8;
+    cache_.reset(new TableCache(dbname_, options_, kEntries));
+    env_.ResetMax();
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([this, t, &failed]() {
+            Random rnd(301 + t);
+            for (int n = 0; n < 3000 && !failed.load(); n++) {
+                // 大部分查找集中在少数文件上
+                const int f = rnd.OneIn(4) ? rnd.Uniform(kNumFiles)
+                                           : rnd.Uniform(8);
+                const int i = rnd.Uniform(kKeysPerFile);
+                if (Get(f, i) != "value" + std::to_string(f * 100 + i)) {
+                    failed.store(true);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    ASSERT_FALSE(failed.load());
+    // 每个线程最多持有一个已经被淘汰的文件，以及一个还没有加入缓存的文件
+    ASSERT_LE(env_.max_open_files(), kEntries + 2 * kThreads);
+    ASSERT_LE(env_.open_files(), kEntries);
+}
+
+TEST_F(TableCacheTest, ScanHints) {
+    // 一个有很多数据块的文件
+    const int f = kNumFiles;
+    options_.block_size = 256;
+    BuildFile(f, 2000);
+    options_.block_size = Options().block_size;
+    const std::string range = "range " +
+                              std::to_string(RandomAccessFile::kSequential) +
+                              " ";
+    const std::string restore =
+        "hint " + std::to_string(RandomAccessFile::kNormal);
+
+    for (bool mmap : {false, true}) {
+        options_.use_mmap_reads = mmap;
+        cache_.reset(new TableCache(dbname_, options_, 10));
+        ASSERT_EQ("value" + std::to_string(f * 100 + 7), Get(f, 7));
+        std::string opened = restore;
+        if (mmap) {
+            // 映射的文件打开时提示随机读取，扫描之后也恢复为它
+            opened = "hint " + std::to_string(RandomAccessFile::kRandom);
+            ASSERT_EQ(std::vector<std::string>{opened}, env_.TakeHints());
+        }
+        ASSERT_TRUE(env_.TakeHints().empty());
+
+        ReadOptions scan;
+        scan.fill_cache = false;
+        std::unique_ptr<Iterator> iter(
+            cache_->NewIterator(scan, f + 1, sizes_[f], 0));
+
+        // 只定位不遍历时不给出提示
+        for (int i = 0; i < 2000; i += 100) {
+            iter->Seek(SeekKey(f, i));
+            ASSERT_TRUE(iter->Valid());
+        }
+        ASSERT_TRUE(env_.TakeHints().empty());
+
+        // 第一次 Next() 时提示从定位的数据块开始的范围
+        iter->Seek(SeekKey(f, 1000));
+        iter->Next();
+        std::vector<std::string> hints = env_.TakeHints();
+        ASSERT_EQ(1u, hints.size());
+        ASSERT_EQ(0u, hints[0].find(range));
+        const uint64_t offset = std::stoull(hints[0].substr(range.size()));
+        ASSERT_GT(offset, sizes_[f] / 4);
+        ASSERT_LT(offset, sizes_[f]);
+
+        // 已经提示过的范围内的定位和遍历不再提示
+        for (int i = 1000; i < 2000; i += 50) {
+            iter->Seek(SeekKey(f, i));
+            for (int n = 0; n < 10 && iter->Valid(); n++) iter->Next();
+        }
+        ASSERT_TRUE(env_.TakeHints().empty());
+
+        // 定位到提示过的范围之前时提示更大的范围
+        iter->SeekToFirst();
+        iter->Next();
+        ASSERT_EQ(std::vector<std::string>{range + "0"}, env_.TakeHints());
+        iter->Seek(SeekKey(f, 10));
+        iter->Next();
+        ASSERT_TRUE(env_.TakeHints().empty());
+
+        // 另一个扫描结束时还有扫描在进行，不恢复提示；
+        // 最后一个扫描结束时恢复打开文件时的提示
+        std::unique_ptr<Iterator> other(
+            cache_->NewIterator(scan, f + 1, sizes_[f], 0));
+        other->SeekToFirst();
+        other->Next();
+        ASSERT_EQ(std::vector<std::string>{range + "0"}, env_.TakeHints());
+        other.reset();
+        ASSERT_TRUE(env_.TakeHints().empty());
+        iter.reset();
+        ASSERT_EQ(std::vector<std::string>{opened}, env_.TakeHints());
+
+        // 没有给出提示的扫描不需要恢复，fill_cache 为 true 的迭代器不提示
+        iter.reset(cache_->NewIterator(scan, f + 1, sizes_[f], 0));
+        iter->Seek(SeekKey(f, 500));
+        iter.reset();
+        iter.reset(cache_->NewIterator(ReadOptions(), f + 1, sizes_[f], 0));
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        }
+        iter.reset();
+        ASSERT_TRUE(env_.TakeHints().empty());
+        ASSERT_EQ("value" + std::to_string(f * 100 + 1999), Get(f, 1999));
+    }
+}
+
+}  // namespace massdb
@@ -0,0 +1,316 @@
+//
+// Created by Xsakura on 2023/6/3.
+//
+
+#include "db/version_edit.h"
+
+#include <sstream>
+
+#include "util/coding.h"
+
+namespace massdb {
+
+// 写入描述文件时使用的标签。
+// 注意：不要更改现有标签的值，因为这些值是磁盘上持久格式的一部分。
+enum Tag {
+    kComparator = 1,
+    kLogNumber = 2,
+    kNextFileNumber = 3,
+    kLastSequence = 4,
+    kCompactPointer = 5,
+    kDeletedFile = 6,
+    kNewFile = 7,
+    kNewBlobFile = 8,
+    kBlobGarbage = 9,
+    // 与 kNewFile 相同，最后多一个碎片离子索引文件的大小。
+    // 只用于有索引的文件，没有索引的文件仍然使用 kNewFile
+    kNewFile2 = 10,
+    // 与 kNewFile2 相同，最后再多一个全局序列号。
+    // 只用于设置了全局序列号的文件
+    kNewFile3 = 11,
+    // 与 kNewFile3 相同，最后再多一个引用的编号最小的 blob 文件。
+    // 只用于引用了 blob 文件的文件
+    kNewFile4 = 12,
+};
+
+void VersionEdit::Clear() {
+    comparator_.clear();
+    log_number_ = 0;
+    next_file_number_ = 0;
+    last_sequence_ = 0;
+    has_comparator_ = false;
+    has_log_number_ = false;
+    has_next_file_number_ = false;
+    has_last_sequence_ = false;
+    compact_pointers_.clear();
+    deleted_files_.clear();
+    new_files_.clear();
+    new_blob_files_.clear();
+    blob_garbage_.clear();
+}
+
+void VersionEdit::EncodeTo(std::string* dst) const {
+    if (has_comparator_) {
+        PutVarint32(dst, kComparator);
+        PutLengthPrefixedSlice(dst, comparator_);
+    }
+    if (has_log_number_) {
+        PutVarint32(dst, kLogNumber);
+        PutVarint64(dst, log_number_);
+    }
+    if (has_next_file_number_) {
+        PutVarint32(dst, kNextFileNumber);
+        PutVarint64(dst, next_file_number_);
+    }
+    if (has_last_sequence_) {
+        PutVarint32(dst, kLastSequence);
+        PutVarint64(dst, last_sequence_);
+    }
+
+    for (const auto& pointer : compact_pointers_) {
+        PutVarint32(dst, kCompactPointer);
+        PutVarint32(dst, pointer.first);  // level
+        PutLengthPrefixedSlice(dst, pointer.second.Encode());
+    }
+
+    for (const auto& deleted_file : deleted_files_) {
+        PutVarint32(dst, kDeletedFile);
+        PutVarint32(dst, deleted_file.first);   // level
+        PutVarint64(dst, deleted_file.second);  // file number
+    }
+
+    for (const auto& new_file : new_files_) {
+        const FileMetaData& f = new_file.second;
+        Tag tag = kNewFile;
+        if (f.oldest_blob_file > 0) {
+            tag = kNewFile4;
+        } else if (f.global_sequence > 0) {
+            tag = kNewFile3;
+        } else if (f.fragment_index_size > 0) {
+            tag = kNewFile2;
+        }
+        PutVarint32(dst, tag);
+        PutVarint32(dst, new_file.first);  // level
+        PutVarint64(dst, f.number);
+        PutVarint64(dst, f.file_size);
+        PutLengthPrefixedSlice(dst, f.smallest.Encode());
+        PutLengthPrefixedSlice(dst, f.largest.Encode());
+        if (tag != kNewFile) {
+            PutVarint64(dst, f.fragment_index_size);
+        }
+        if (tag == kNewFile3 || tag == kNewFile4) {
+            PutVarint64(dst, f.global_sequence);
+        }
+        if (tag == kNewFile4) {
+            PutVarint64(dst, f.oldest_blob_file);
+        }
+    }
+
+    for (const BlobFileMetaData& f : new_blob_files_) {
+        PutVarint32(dst, kNewBlobFile);
+        PutVarint64(dst, f.number);
+        PutVarint64(dst, f.total_count);
+        PutVarint64(dst, f.total_bytes);
+    }
+
+    for (const BlobFileMetaData& f : blob_garbage_) {
+        PutVarint32(dst, kBlobGarbage);
+        PutVarint64(dst, f.number);
+        PutVarint64(dst, f.garbage_count);
+        PutVarint64(dst, f.garbage_bytes);
+    }
+}
+
+static bool GetInternalKey(Slice* input, InternalKey* dst) {
+    Slice str;
+    if (GetLengthPrefixedSlice(input, &str)) {
+        return dst->DecodeFrom(str);
+    }
+    return false;
+}
+
+static bool GetLevel(Slice* input, int* level) {
+    uint32_t v;
+    if (GetVarint32(input, &v) && v < config::kNumLevels) {
+        *level = static_cast<int>(v);
+        return true;
+    }
+    return false;
+}
+
+Status VersionEdit::DecodeFrom(const Slice& src) {
+    Clear();
+    Slice input = src;
+    const char* msg = nullptr;
+    uint32_t tag;
+
+    // 解析时使用的临时变量
+    int level;
+    uint64_t number;
+    FileMetaData f;
+    BlobFileMetaData blob;
+    Slice str;
+    InternalKey key;
+
+    while (msg == nullptr && GetVarint32(&input, &tag)) {
+        switch (tag) {
+            case kComparator:
+                if (GetLengthPrefixedSlice(&input, &str)) {
+                    comparator_ = str.to_string();
+                    has_comparator_ = true;
+                } else {
+                    msg = "comparator name";
+                }
+                break;
+
+            case kLogNumber:
+                if (GetVarint64(&input, &log_number_)) {
+                    has_log_number_ = true;
+                } else {
+                    msg = "log number";
+                }
+                break;
+
+            case kNextFileNumber:
+                if (GetVarint64(&input, &next_file_number_)) {
+                    has_next_file_number_ = true;
+                } else {
+                    msg = "next file number";
+                }
+                break;
+
+            case kLastSequence:
+                if (GetVarint64(&input, &last_sequence_)) {
+                    has_last_sequence_ = true;
+                } else {
+                    msg = "last sequence number";
+                }
+                break;
+
+            case kCompactPointer:
+                if (GetLevel(&input, &level) && GetInternalKey(&input, &key)) {
+                    compact_pointers_.push_back(std::make_pair(level, key));
+                } else {
+                    msg = "compaction pointer";
+                }
+                break;
+
+            case kDeletedFile:
+                if (GetLevel(&input, &level) && GetVarint64(&input, &number)) {
+                    deleted_files_.insert(std::make_pair(level, number));
+                } else {
+                    msg = "deleted file";
+                }
+                break;
+
+            case kNewFile:
+            case kNewFile2:
+            case kNewFile3:
+            case kNewFile4:
+                f.fragment_index_size = 0;
+                f.global_sequence = 0;
+                f.oldest_blob_file = 0;
+                if (GetLevel(&input, &level) &&
+                    GetVarint64(&input, &f.number) &&
+                    GetVarint64(&input, &f.file_size) &&
+                    GetInternalKey(&input, &f.smallest) &&
+                    GetInternalKey(&input, &f.largest) &&
+                    (tag == kNewFile ||
+                     GetVarint64(&input, &f.fragment_index_size)) &&
+                    (tag == kNewFile || tag == kNewFile2 ||
+                     GetVarint64(&input, &f.global_sequence)) &&
+                    (tag != kNewFile4 ||
+                     GetVarint64(&input, &f.oldest_blob_file))) {
+                    new_files_.push_back(std::make_pair(level, f));
+                } else {
+                    msg = "new-file entry";
+                }
+                break;
+
+            case kNewBlobFile:
+                blob = BlobFileMetaData();
+                if (GetVarint64(&input, &blob.number) &&
+                    GetVarint64(&input, &blob.total_count) &&
+                    GetVarint64(&input, &blob.total_bytes)) {
+                    new_blob_files_.push_back(blob);
+                } else {
+                    msg = "new-blob-file entry";
+                }
+                break;
+
+            case kBlobGarbage:
+                blob = BlobFileMetaData();
+                if (GetVarint64(&input, &blob.number) &&
+                    GetVarint64(&input, &blob.garbage_count) &&
+                    GetVarint64(&input, &blob.garbage_bytes)) {
+                    blob_garbage_.push_back(blob);
+                } else {
+                    msg = "blob-garbage entry";
+                }
+                break;
+
+            default:
+                msg = "unknown tag";
+                break;
+        }
+    }
+
+    if (msg == nullptr && !input.empty()) {
+        msg = "invalid tag";
+    }
+
+    Status result;
+    if (msg != nullptr) {
+        result = Status::Corruption("VersionEdit", msg);
+    }
+    return result;
+}
+
+std::string VersionEdit::DebugString() const {
+    std::ostringstream ss;
+    ss << "VersionEdit {";
+    if (has_comparator_) {
+        ss << "\n  Comparator: " << comparator_;
+    }
+    if (has_log_number_) {
+        ss << "\n  LogNumber: " << log_number_;
+    }
+    if (has_next_file_number_) {
+        ss << "\n  NextFile: " << next_file_number_;
+    }
+    if (has_last_sequence_) {
+        ss << "\n  LastSeq: " << last_sequence_;
+    }
+    for (const auto& pointer : compact_pointers_) {
+        ss << "\n  CompactPointer: " << pointer.first << " "
+           << pointer.second.DebugString();
+    }
+    for (const auto& deleted_file : deleted_files_) {
+        ss << "\n  RemoveFile: " << deleted_file.first << " "
+           << deleted_file.second;
+    }
+    for (const auto& new_file : new_files_) {
+        const FileMetaData& f = new_file.second;
+        ss << "\n  AddFile: " << new_file.first << " " << f.number << " "
+           << f.file_size << " " << f.smallest.DebugString() << " .. "
+           << f.largest.DebugString();
+        if (f.global_sequence > 0) {
+            ss << " @" << f.global_sequence;
+        }
+        if (f.oldest_blob_file > 0) {
+            ss << " blob " << f.oldest_blob_file;
+        }
+    }
+    for (const BlobFileMetaData& f : new_blob_files_) {
+        ss << "\n  AddBlobFile: " << f.number << " " << f.total_count << " "
+           << f.total_bytes;
+    }
+    for (const BlobFileMetaData& f : blob_garbage_) {
+        ss << "\n  BlobGarbage: " << f.number << " " << f.garbage_count << " "
+           << f.garbage_bytes;
+    }
+    ss << "\n}\n";
+    return ss.str();
+}
+
+}  // namespace massdb
@@ -0,0 +1,164 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_DB_VERSION_EDIT_H
+#define MASSDB_DB_VERSION_EDIT_H
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class VersionSet;
+
+// 一个 table 文件的元数据
+struct FileMetaData {
+    FileMetaData()
+        : refs(0),
+          number(0),
+          file_size(0),
+          fragment_index_size(0),
+          global_sequence(0),
+          oldest_blob_file(0) {}
+
+    int refs;  // 引用这个文件的 Version 的数量
+    uint64_t number;
+    uint64_t file_size;  // 文件大小（字节）
+    // 同编号的碎片离子索引文件的大小（字节），为 0 表示生成时没有写入索引
+    uint64_t fragment_index_size;
+    // 不为 0 时文件中所有 key 的序列号都视为这个值，读取时改写。
+    // 只用于 user key 互不相同的批量导入文件，见 DBImpl::InstallBulkLoad()
+    SequenceNumber global_sequence;
+    // 文件中的 blob 引用指向的编号最小的 blob 文件，没有引用时为 0。
+    // 这个 blob 文件中失效的数据足够多时，重写这个 table 文件来回收空间
+    uint64_t oldest_blob_file;
+    InternalKey smallest;  // 文件中最小的 internal key
+    InternalKey largest;   // 文件中最大的 internal key
+};
+
+// 一个 blob 文件的元数据。total_* 在文件生成时确定，
+// garbage_* 随着压实丢弃或者搬走其中的 value 而增加
+struct BlobFileMetaData {
+    BlobFileMetaData()
+        : number(0),
+          total_count(0),
+          total_bytes(0),
+          garbage_count(0),
+          garbage_bytes(0) {}
+
+    uint64_t number;
+    uint64_t total_count;    // 文件中 value 的数量
+    uint64_t total_bytes;    // 文件中所有记录的字节数
+    uint64_t garbage_count;  // 已经失效的 value 的数量
+    uint64_t garbage_bytes;  // 已经失效的记录的字节数
+};
+
+// 从一个 Version 到下一个 Version 的变化，
+// 描述文件（manifest）由一系列编码后的 VersionEdit 组成
+class VersionEdit {
+public:
+    VersionEdit() { Clear(); }
+    ~VersionEdit() = default;
+
+    void Clear();
+
+    void SetComparatorName(const Slice& name) {
+        has_comparator_ = true;
+        comparator_ = name.to_string();
+    }
+    void SetLogNumber(uint64_t num) {
+        has_log_number_ = true;
+        log_number_ = num;
+    }
+    void SetNextFile(uint64_t num) {
+        has_next_file_number_ = true;
+        next_file_number_ = num;
+    }
+    void SetLastSequence(SequenceNumber seq) {
+        has_last_sequence_ = true;
+        last_sequence_ = seq;
+    }
+    void SetCompactPointer(int level, const InternalKey& key) {
+        compact_pointers_.push_back(std::make_pair(level, key));
+    }
+
+    // 在第 level 层加入指定的文件。fragment_index_size 是同编号的
+    // 碎片离子索引文件的大小，没有索引时为 0。global_sequence 见
+    // FileMetaData，一般为 0。oldest_blob_file 见 FileMetaData。
+    // 要求：smallest 和 largest 分别是文件中最小和最大的 key
+    // （按 global_sequence 改写之后）
+    void AddFile(int level, uint64_t file, uint64_t file_size,
+                 uint64_t fragment_index_size, SequenceNumber global_sequence,
+                 uint64_t oldest_blob_file, const InternalKey& smallest,
+                 const InternalKey& largest) {
+        FileMetaData f;
+        f.number = file;
+        f.file_size = file_size;
+        f.fragment_index_size = fragment_index_size;
+        f.global_sequence = global_sequence;
+        f.oldest_blob_file = oldest_blob_file;
+        f.smallest = smallest;
+        f.largest = largest;
+        new_files_.push_back(std::make_pair(level, f));
+    }
+
+    // 从第 level 层删除指定的文件
+    void RemoveFile(int level, uint64_t file) {
+        deleted_files_.insert(std::make_pair(level, file));
+    }
+
+    // 加入一个包含 count 个 value、共 bytes 字节的 blob 文件
+    void AddBlobFile(uint64_t number, uint64_t count, uint64_t bytes) {
+        BlobFileMetaData f;
+        f.number = number;
+        f.total_count = count;
+        f.total_bytes = bytes;
+        new_blob_files_.push_back(f);
+    }
+
+    // 记录 blob 文件中又有 count 个、共 bytes 字节的 value 失效。
+    // 所有 value 都失效的文件不再属于新的 Version
+    void AddBlobGarbage(uint64_t number, uint64_t count, uint64_t bytes) {
+        BlobFileMetaData f;
+        f.number = number;
+        f.garbage_count = count;
+        f.garbage_bytes = bytes;
+        blob_garbage_.push_back(f);
+    }
+
+    void EncodeTo(std::string* dst) const;
+    Status DecodeFrom(const Slice& src);
+
+    std::string DebugString() const;
+
+private:
+    friend class VersionSet;
+
+    typedef std::set<std::pair<int, uint64_t>> DeletedFileSet;
+
+    std::string comparator_;
+    uint64_t log_number_;
+    uint64_t next_file_number_;
+    SequenceNumber last_sequence_;
+    bool has_comparator_;
+    bool has_log_number_;
+    bool has_next_file_number_;
+    bool has_last_sequence_;
+
+    std::vector<std::pair<int, InternalKey>> compact_pointers_;
+    DeletedFileSet deleted_files_;
+    std::vector<std::pair<int, FileMetaData>> new_files_;
+    std::vector<BlobFileMetaData> new_blob_files_;
+    std::vector<BlobFileMetaData> blob_garbage_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_VERSION_EDIT_H
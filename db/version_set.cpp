@@ -0,0 +1,1432 @@
+//
+// Created by Xsakura on 2023/6/3.
+//
+
+#include "db/version_set.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#include "db/builder.h"
+#include "db/filename.h"
+#include "db/log_reader.h"
+#include "db/log_writer.h"
+#include "db/table_cache.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "table/merger.h"
+#include "table/two_level_iterator.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+static size_t TargetFileSize(const Options* options) {
+    return options->max_file_size;
+}
+
+// 压实输出的一个文件最多与这么多字节的 level + 2 层文件重叠，
+// 超过时切换到新的输出文件
+static int64_t MaxGrandParentOverlapBytes(const Options* options) {
+    return 10 * TargetFileSize(options);
+}
+
+// 扩大压实在 level 层的输入时，两层输入的总大小的上限
+static int64_t ExpandedCompactionByteSizeLimit(const Options* options) {
+    return 25 * TargetFileSize(options);
+}
+
+// 第 level 层的目标大小
+static double MaxBytesForLevel(const Options* options, int level) {
+    // 第 0 层由文件数量而不是大小决定是否压实，这里的结果不会用到
+    double result = static_cast<double>(options->max_bytes_for_level_base);
+    while (level > 1) {
+        result *= options->max_bytes_for_level_multiplier;
+        level--;
+    }
+    return result;
+}
+
+static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
+    int64_t sum = 0;
+    for (const FileMetaData* f : files) {
+        sum += f->file_size;
+    }
+    return sum;
+}
+
+Version::~Version() {
+    assert(refs_ == 0);
+
+    // 从链表中移除
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+
+    // 释放对文件的引用
+    for (int level = 0; level < config::kNumLevels; level++) {
+        for (FileMetaData* f : files_[level]) {
+            assert(f->refs > 0);
+            f->refs--;
+            if (f->refs <= 0) {
+                delete f;
+            }
+        }
+    }
+}
+
+int FindFile(const InternalKeyComparator& icmp,
+             const std::vector<FileMetaData*>& files, const Slice& key) {
+    uint32_t left = 0;
+    uint32_t right = static_cast<uint32_t>(files.size());
+    while (left < right) {
+        uint32_t mid = (left + right) / 2;
+        const FileMetaData* f = files[mid];
+        if (icmp.Compare(f->largest.Encode(), key) < 0) {
+            // mid 及之前的文件的 largest 都小于 key
+            left = mid + 1;
+        } else {
+            // mid 之后的文件都不是第一个 largest >= key 的文件
+            right = mid;
+        }
+    }
+    return static_cast<int>(right);
+}
+
+// user_key 在文件 f 之后
+static bool AfterFile(const Comparator* ucmp, const Slice* user_key,
+                      const FileMetaData* f) {
+    // nullptr 表示 user_key 比所有 key 都小
+    return (user_key != nullptr &&
+            ucmp->Compare(*user_key, f->largest.user_key()) > 0);
+}
+
+// user_key 在文件 f 之前
+static bool BeforeFile(const Comparator* ucmp, const Slice* user_key,
+                       const FileMetaData* f) {
+    // nullptr 表示 user_key 比所有 key 都大
+    return (user_key != nullptr &&
+            ucmp->Compare(*user_key, f->smallest.user_key()) < 0);
+}
+
+bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
+                           bool disjoint_sorted_files,
+                           const std::vector<FileMetaData*>& files,
+                           const Slice* smallest_user_key,
+                           const Slice* largest_user_key) {
+    const Comparator* ucmp = icmp.user_comparator();
+    if (!disjoint_sorted_files) {
+        // 需要检查每一个文件
+        for (const FileMetaData* f : files) {
+            if (AfterFile(ucmp, smallest_user_key, f) ||
+                BeforeFile(ucmp, largest_user_key, f)) {
+                // 不重叠
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 在有序的文件中二分查找
+    uint32_t index = 0;
+    if (smallest_user_key != nullptr) {
+        // 找到第一个可能包含 smallest_user_key 的文件
+        InternalKey small_key(*smallest_user_key, kMaxSequenceNumber,
+                              kValueTypeForSeek);
+        index = FindFile(icmp, files, small_key.Encode());
+    }
+
+    if (index >= files.size()) {
+        // 所有文件都在 smallest_user_key 之前
+        return false;
+    }
+
+    return !BeforeFile(ucmp, largest_user_key, files[index]);
+}
+
+// 遍历一层中的文件的迭代器，这一层的文件互不重叠并且有序。
+// key() 是文件中最大的 key，
+// value() 是 24 字节的文件编号、文件大小和全局序列号，都编码为 fixed64
+class Version::LevelFileNumIterator : public Iterator {
+public:
+    LevelFileNumIterator(const InternalKeyComparator& icmp,
+                         const std::vector<FileMetaData*>* flist)
+        : icmp_(icmp), flist_(flist), index_(flist->size()) {}
+
+    bool Valid() const override { return index_ < flist_->size(); }
+    void Seek(const Slice& target) override {
+        index_ = FindFile(icmp_, *flist_, target);
+    }
+    void SeekToFirst() override { index_ = 0; }
+    void SeekToLast() override {
+        index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    }
+    void Next() override {
+        assert(Valid());
+        index_++;
+    }
+    void Prev() override {
+        assert(Valid());
+        if (index_ == 0) {
+            index_ = flist_->size();  // 标记为无效
+        } else {
+            index_--;
+        }
+    }
+    Slice key() const override {
+        assert(Valid());
+        return (*flist_)[index_]->largest.Encode();
+    }
+    Slice value() const override {
+        assert(Valid());
+        EncodeFixed64(value_buf_, (*flist_)[index_]->number);
+        EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+        EncodeFixed64(value_buf_ + 16, (*flist_)[index_]->global_sequence);
+        return Slice(value_buf_, sizeof(value_buf_));
+    }
+    Status status() const override { return Status::Ok(); }
+
+private:
+    const InternalKeyComparator icmp_;
+    const std::vector<FileMetaData*>* const flist_;
+    size_t index_;
+
+    // value() 返回的内容的存储空间
+    mutable char value_buf_[24];
+};
+
+// 将 LevelFileNumIterator 的 value 转换为对应文件的迭代器
+static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
+                                 const Slice& file_value) {
+    TableCache* cache = reinterpret_cast<TableCache*>(arg);
+    if (file_value.size() != 24) {
+        return NewErrorIterator(
+            Status::Corruption("FileReader invoked with unexpected value"));
+    }
+    return cache->NewIterator(options, DecodeFixed64(file_value.data()),
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed64(file_value.data() + 16));
+}
+
+Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
+                                            int level) const {
+    return NewTwoLevelIterator(
+        new LevelFileNumIterator(vset_->icmp_, &files_[level]),
+        &GetFileIterator, vset_->table_cache_, options);
+}
+
+void Version::AddIterators(const ReadOptions& options,
+                           std::vector<Iterator*>* iters) {
+    // 第 0 层的文件之间可能重叠，每个文件需要单独的迭代器
+    for (const FileMetaData* f : files_[0]) {
+        iters->push_back(vset_->table_cache_->NewIterator(
+            options, f->number, f->file_size, f->global_sequence));
+    }
+
+    // 更深的层中文件互不重叠，每一层使用一个依次打开文件的迭代器
+    for (int level = 1; level < config::kNumLevels; level++) {
+        if (!files_[level].empty()) {
+            iters->push_back(NewConcatenatingIterator(options, level));
+        }
+    }
+}
+
+void Version::GetAllFiles(std::vector<FileMetaData*>* files) const {
+    for (int level = 0; level < config::kNumLevels; level++) {
+        files->insert(files->end(), files_[level].begin(),
+                      files_[level].end());
+    }
+}
+
+void Version::GetBlobFilesForGC(double garbage_ratio,
+                                std::set<uint64_t>* files) const {
+    for (const auto& entry : blob_files_) {
+        const BlobFileMetaData& f = entry.second;
+        if (f.garbage_bytes >= garbage_ratio * f.total_bytes) {
+            files->insert(f.number);
+        }
+    }
+}
+
+namespace {
+
+// 在 table 文件中查找时的状态
+enum SaverState {
+    kNotFound,
+    kFound,
+    kDeleted,
+    kCorrupt,
+};
+
+struct Saver {
+    SaverState state;
+    const Comparator* ucmp;
+    Slice user_key;
+    std::string* value;
+    bool is_blob_index;
+};
+
+}  // namespace
+
+static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+    Saver* s = reinterpret_cast<Saver*>(arg);
+    ParsedInternalKey parsed_key;
+    if (!ParseInternalKey(ikey, &parsed_key)) {
+        s->state = kCorrupt;
+    } else {
+        if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
+            s->state = (parsed_key.type == kTypeDeletion) ? kDeleted : kFound;
+            if (s->state == kFound) {
+                s->value->assign(v.data(), v.size());
+                s->is_blob_index = (parsed_key.type == kTypeBlobIndex);
+            }
+        }
+    }
+}
+
+static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
+    return a->number > b->number;
+}
+
+Status Version::Get(const ReadOptions& options, const LookupKey& k,
+                    std::string* value, bool* is_blob_index) {
+    const Slice ikey = k.internal_key();
+    const Slice user_key = k.user_key();
+    const Comparator* ucmp = vset_->icmp_.user_comparator();
+
+    std::vector<FileMetaData*> tmp;
+    for (int level = 0; level < config::kNumLevels; level++) {
+        const std::vector<FileMetaData*>& files = files_[level];
+        if (files.empty()) continue;
+
+        tmp.clear();
+        if (level == 0) {
+            // 第 0 层的文件之间可能重叠，找出所有包含 user_key 的文件，
+            // 按从新到旧的顺序查找
+            for (FileMetaData* f : files) {
+                if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+                    ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+                    tmp.push_back(f);
+                }
+            }
+            std::sort(tmp.begin(), tmp.end(), NewestFirst);
+        } else {
+            // 其他层中最多只有一个文件可能包含 user_key
+            uint32_t index = FindFile(vset_->icmp_, files, ikey);
+            if (index < files.size() &&
+                ucmp->Compare(user_key, files[index]->smallest.user_key()) >=
+                    0) {
+                tmp.push_back(files[index]);
+            }
+        }
+
+        for (FileMetaData* f : tmp) {
+            Saver saver;
+            saver.state = kNotFound;
+            saver.ucmp = ucmp;
+            saver.user_key = user_key;
+            saver.value = value;
+            saver.is_blob_index = false;
+            Status s = vset_->table_cache_->Get(options, f->number,
+                                                f->file_size,
+                                                f->global_sequence, ikey,
+                                                &saver, SaveValue);
+            if (!s.IsOk()) {
+                return s;
+            }
+            switch (saver.state) {
+                case kNotFound:
+                    break;  // 继续在更旧的文件中查找
+                case kFound:
+                    *is_blob_index = saver.is_blob_index;
+                    return s;
+                case kDeleted:
+                    return Status::NotFound(Slice());
+                case kCorrupt:
+                    return Status::Corruption("corrupted key for ", user_key);
+            }
+        }
+    }
+
+    return Status::NotFound(Slice());
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const LookupKey* const* keys, size_t n,
+                       std::string* values, bool* is_blob_index,
+                       Status* statuses, bool* done) {
+    const Comparator* ucmp = vset_->icmp_.user_comparator();
+    std::vector<Saver> savers(n);
+    for (size_t i = 0; i < n; i++) {
+        savers[i].state = kNotFound;
+        savers[i].ucmp = ucmp;
+        savers[i].user_key = keys[i]->user_key();
+        savers[i].value = &values[i];
+        savers[i].is_blob_index = false;
+    }
+
+    // 每一轮在一组文件中查找，之后把有结果的 key 标记为完成。
+    // 第 0 层的文件之间可能重叠，每个文件单独一轮，按从新到旧的顺序查找；
+    // 其他层中每个 key 最多在一个文件中，整层一轮
+    std::vector<TableCache::GetBatch> batches;
+    auto finish_round = [&]() {
+        if (batches.empty()) return;
+        Status s = vset_->table_cache_->MultiGet(
+            options, batches.data(), batches.size(), SaveValue);
+        for (const TableCache::GetBatch& batch : batches) {
+            for (void* arg : batch.args) {
+                Saver* saver = reinterpret_cast<Saver*>(arg);
+                const size_t i = saver - savers.data();
+                if (!s.IsOk()) {
+                    statuses[i] = s;
+                    done[i] = true;
+                    continue;
+                }
+                switch (saver->state) {
+                    case kNotFound:
+                        break;  // 继续在更旧的文件中查找
+                    case kFound:
+                        is_blob_index[i] = saver->is_blob_index;
+                        statuses[i] = Status::Ok();
+                        done[i] = true;
+                        break;
+                    case kDeleted:
+                        statuses[i] = Status::NotFound(Slice());
+                        done[i] = true;
+                        break;
+                    case kCorrupt:
+                        statuses[i] = Status::Corruption("corrupted key for ",
+                                                         saver->user_key);
+                        done[i] = true;
+                        break;
+                }
+            }
+        }
+        batches.clear();
+    };
+    auto add_key = [&](FileMetaData* f, size_t i) {
+        if (batches.empty() || batches.back().file_number != f->number) {
+            batches.emplace_back();
+            batches.back().file_number = f->number;
+            batches.back().file_size = f->file_size;
+            batches.back().global_sequence = f->global_sequence;
+        }
+        batches.back().keys.push_back(keys[i]->internal_key());
+        batches.back().args.push_back(&savers[i]);
+    };
+
+    std::vector<FileMetaData*> tmp;
+    for (int level = 0; level < config::kNumLevels; level++) {
+        const std::vector<FileMetaData*>& files = files_[level];
+        if (files.empty()) continue;
+
+        if (level == 0) {
+            tmp = files;
+            std::sort(tmp.begin(), tmp.end(), NewestFirst);
+            for (FileMetaData* f : tmp) {
+                for (size_t i = 0; i < n; i++) {
+                    const Slice user_key = keys[i]->user_key();
+                    if (!done[i] &&
+                        ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+                        ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+                        add_key(f, i);
+                    }
+                }
+                finish_round();
+            }
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                if (done[i]) continue;
+                const Slice ikey = keys[i]->internal_key();
+                uint32_t index = FindFile(vset_->icmp_, files, ikey);
+                if (index < files.size() &&
+                    ucmp->Compare(keys[i]->user_key(),
+                                  files[index]->smallest.user_key()) >= 0) {
+                    add_key(files[index], i);
+                }
+            }
+            finish_round();
+        }
+    }
+}
+
+void Version::Ref() { ++refs_; }
+
+void Version::Unref() {
+    assert(this != &vset_->dummy_versions_);
+    assert(refs_ >= 1);
+    --refs_;
+    if (refs_ == 0) {
+        delete this;
+    }
+}
+
+bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
+                             const Slice* largest_user_key) {
+    return SomeFileOverlapsRange(vset_->icmp_, (level > 0), files_[level],
+                                 smallest_user_key, largest_user_key);
+}
+
+void Version::GetOverlappingInputs(int level, const InternalKey* begin,
+                                   const InternalKey* end,
+                                   std::vector<FileMetaData*>* inputs) {
+    assert(level >= 0);
+    assert(level < config::kNumLevels);
+    inputs->clear();
+    Slice user_begin, user_end;
+    if (begin != nullptr) {
+        user_begin = begin->user_key();
+    }
+    if (end != nullptr) {
+        user_end = end->user_key();
+    }
+    const Comparator* user_cmp = vset_->icmp_.user_comparator();
+    for (size_t i = 0; i < files_[level].size();) {
+        FileMetaData* f = files_[level][i++];
+        const Slice file_start = f->smallest.user_key();
+        const Slice file_limit = f->largest.user_key();
+        if (begin != nullptr && user_cmp->Compare(file_limit, user_begin) < 0) {
+            // f 完全在范围之前，跳过
+        } else if (end != nullptr &&
+                   user_cmp->Compare(file_start, user_end) > 0) {
+            // f 完全在范围之后，跳过
+        } else {
+            inputs->push_back(f);
+            if (level == 0) {
+                // 第 0 层的文件之间可能重叠。
+                // f 扩大了范围时，用新的范围重新开始查找
+                if (begin != nullptr &&
+                    user_cmp->Compare(file_start, user_begin) < 0) {
+                    user_begin = file_start;
+                    inputs->clear();
+                    i = 0;
+                } else if (end != nullptr &&
+                           user_cmp->Compare(file_limit, user_end) > 0) {
+                    user_end = file_limit;
+                    inputs->clear();
+                    i = 0;
+                }
+            }
+        }
+    }
+}
+
+std::string Version::DebugString() const {
+    std::ostringstream ss;
+    for (int level = 0; level < config::kNumLevels; level++) {
+        // 例如：
+        //   --- level 1 ---
+        //   17:123['a' .. 'd']
+        //   20:43['e' .. 'g']
+        ss << "--- level " << level << " ---\n";
+        for (const FileMetaData* f : files_[level]) {
+            ss << ' ' << f->number << ':' << f->file_size << '['
+               << f->smallest.DebugString() << " .. "
+               << f->largest.DebugString() << "]\n";
+        }
+    }
+    // 例如：
+    //   --- blob files ---
+    //   21:100/5242880 garbage 30/1572864
+    ss << "--- blob files ---\n";
+    for (const auto& entry : blob_files_) {
+        const BlobFileMetaData& f = entry.second;
+        ss << ' ' << f.number << ':' << f.total_count << '/' << f.total_bytes
+           << " garbage " << f.garbage_count << '/' << f.garbage_bytes
+           << '\n';
+    }
+    return ss.str();
+}
+
+// 高效地将一系列 VersionEdit 应用到一个 Version 上，
+// 不需要为每个 VersionEdit 生成一个中间 Version
+class VersionSet::Builder {
+public:
+    // 初始状态为 base
+    Builder(VersionSet* vset, Version* base)
+        : vset_(vset), base_(base), blob_files_(base->blob_files_) {
+        base_->Ref();
+        BySmallestKey cmp;
+        cmp.internal_comparator = &vset_->icmp_;
+        for (int level = 0; level < config::kNumLevels; level++) {
+            levels_[level].added_files = new FileSet(cmp);
+        }
+    }
+
+    Builder(const Builder&) = delete;
+    Builder& operator=(const Builder&) = delete;
+
+    ~Builder() {
+        for (int level = 0; level < config::kNumLevels; level++) {
+            const FileSet* added = levels_[level].added_files;
+            std::vector<FileMetaData*> to_unref;
+            to_unref.reserve(added->size());
+            for (FileMetaData* f : *added) {
+                to_unref.push_back(f);
+            }
+            delete added;
+            for (FileMetaData* f : to_unref) {
+                f->refs--;
+                if (f->refs <= 0) {
+                    delete f;
+                }
+            }
+        }
+        base_->Unref();
+    }
+
+    // 将 *edit 应用到当前的状态上
+    void Apply(const VersionEdit* edit) {
+        for (const auto& pointer : edit->compact_pointers_) {
+            const int level = pointer.first;
+            vset_->compact_pointer_[level] =
+                pointer.second.Encode().to_string();
+        }
+
+        for (const auto& deleted_file : edit->deleted_files_) {
+            const int level = deleted_file.first;
+            const uint64_t number = deleted_file.second;
+            levels_[level].deleted_files.insert(number);
+        }
+
+        for (const auto& new_file : edit->new_files_) {
+            const int level = new_file.first;
+            FileMetaData* f = new FileMetaData(new_file.second);
+            f->refs = 1;
+            levels_[level].deleted_files.erase(f->number);
+            levels_[level].added_files->insert(f);
+        }
+
+        for (const BlobFileMetaData& f : edit->new_blob_files_) {
+            blob_files_[f.number] = f;
+        }
+
+        for (const BlobFileMetaData& garbage : edit->blob_garbage_) {
+            auto iter = blob_files_.find(garbage.number);
+            if (iter != blob_files_.end()) {
+                iter->second.garbage_count += garbage.garbage_count;
+                iter->second.garbage_bytes += garbage.garbage_bytes;
+            }
+        }
+    }
+
+    // 将当前的状态保存到 *v 中
+    void SaveTo(Version* v) {
+        BySmallestKey cmp;
+        cmp.internal_comparator = &vset_->icmp_;
+        for (int level = 0; level < config::kNumLevels; level++) {
+            // 将新加入的文件与 base_ 中已有的文件按顺序合并，
+            // 同时去掉被删除的文件
+            const std::vector<FileMetaData*>& base_files =
+                base_->files_[level];
+            auto base_iter = base_files.begin();
+            auto base_end = base_files.end();
+            const FileSet* added_files = levels_[level].added_files;
+            v->files_[level].reserve(base_files.size() + added_files->size());
+            for (FileMetaData* added_file : *added_files) {
+                // 加入 base_ 中所有排在 added_file 之前的文件
+                for (auto bpos = std::upper_bound(base_iter, base_end,
+                                                  added_file, cmp);
+                     base_iter != bpos; ++base_iter) {
+                    MaybeAddFile(v, level, *base_iter);
+                }
+                MaybeAddFile(v, level, added_file);
+            }
+
+            // 加入剩下的文件
+            for (; base_iter != base_end; ++base_iter) {
+                MaybeAddFile(v, level, *base_iter);
+            }
+
+#ifndef NDEBUG
+            // 确认第 0 层以外的文件互不重叠
+            if (level > 0) {
+                for (size_t i = 1; i < v->files_[level].size(); i++) {
+                    const InternalKey& prev_end =
+                        v->files_[level][i - 1]->largest;
+                    const InternalKey& this_begin =
+                        v->files_[level][i]->smallest;
+                    if (vset_->icmp_.Compare(prev_end.Encode(),
+                                             this_begin.Encode()) >= 0) {
+                        std::fprintf(stderr, "overlapping ranges in same "
+                                             "level %s vs. %s\n",
+                                     prev_end.DebugString().c_str(),
+                                     this_begin.DebugString().c_str());
+                        std::abort();
+                    }
+                }
+            }
+#endif
+        }
+
+        // 所有 value 都已经失效的 blob 文件不再被引用
+        for (const auto& entry : blob_files_) {
+            if (entry.second.garbage_count < entry.second.total_count) {
+                v->blob_files_.insert(entry);
+            }
+        }
+    }
+
+private:
+    // 按最小的 key 排序，key 相同时按文件编号排序
+    struct BySmallestKey {
+        const InternalKeyComparator* internal_comparator;
+
+        bool operator()(FileMetaData* f1, FileMetaData* f2) const {
+            int r = internal_comparator->Compare(f1->smallest.Encode(),
+                                                 f2->smallest.Encode());
+            if (r != 0) {
+                return (r < 0);
+            } else {
+                return (f1->number < f2->number);
+            }
+        }
+    };
+
+    typedef std::set<FileMetaData*, BySmallestKey> FileSet;
+
+    struct LevelState {
+        std::set<uint64_t> deleted_files;
+        FileSet* added_files;
+    };
+
+    void MaybeAddFile(Version* v, int level, FileMetaData* f) {
+        if (levels_[level].deleted_files.count(f->number) > 0) {
+            // 文件已经被删除
+        } else {
+            std::vector<FileMetaData*>* files = &v->files_[level];
+            if (level > 0 && !files->empty()) {
+                // 同一层中的文件不能重叠
+                assert(vset_->icmp_.Compare((*files)[files->size() - 1]
+                                                ->largest.Encode(),
+                                            f->smallest.Encode()) < 0);
+            }
+            f->refs++;
+            files->push_back(f);
+        }
+    }
+
+    VersionSet* vset_;
+    Version* base_;
+    LevelState levels_[config::kNumLevels];
+    std::map<uint64_t, BlobFileMetaData> blob_files_;
+};
+
+VersionSet::VersionSet(const std::string& dbname, const Options* options,
+                       TableCache* table_cache,
+                       const InternalKeyComparator* cmp)
+    : env_(options->env),
+      dbname_(dbname),
+      options_(options),
+      table_cache_(table_cache),
+      icmp_(*cmp),
+      next_file_number_(2),
+      manifest_file_number_(0),  // 由 Recover() 设置
+      last_sequence_(0),
+      log_number_(0),
+      descriptor_file_(nullptr),
+      descriptor_log_(nullptr),
+      manifest_writing_(false),
+      dummy_versions_(this),
+      current_(nullptr) {
+    AppendVersion(new Version(this));
+}
+
+VersionSet::~VersionSet() {
+    current_->Unref();
+    assert(dummy_versions_.next_ == &dummy_versions_);  // 链表为空
+    delete descriptor_log_;
+    delete descriptor_file_;
+}
+
+void VersionSet::AppendVersion(Version* v) {
+    assert(v->refs_ == 0);
+    assert(v != current_);
+    if (current_ != nullptr) {
+        current_->Unref();
+    }
+    current_ = v;
+    v->Ref();
+
+    // 加入链表的末尾
+    v->prev_ = dummy_versions_.prev_;
+    v->next_ = &dummy_versions_;
+    v->prev_->next_ = v;
+    v->next_->prev_ = v;
+}
+
+Status VersionSet::LogAndApply(VersionEdit* edit,
+                               std::unique_lock<std::mutex>& l) {
+    // 等待正在写描述文件的调用者完成，之后 current_ 才是最新的
+    while (manifest_writing_) {
+        manifest_write_done_.wait(l);
+    }
+
+    if (edit->has_log_number_) {
+        assert(edit->log_number_ >= log_number_);
+        assert(edit->log_number_ < next_file_number_);
+    } else {
+        edit->SetLogNumber(log_number_);
+    }
+
+    edit->SetNextFile(next_file_number_);
+    // 调用者设置了更大的序列号时保留它
+    if (!edit->has_last_sequence_ || edit->last_sequence_ < last_sequence_) {
+        edit->SetLastSequence(last_sequence_);
+    }
+
+    Version* v = new Version(this);
+    {
+        Builder builder(this, current_);
+        builder.Apply(edit);
+        builder.SaveTo(v);
+    }
+    Finalize(v);
+
+    // 打开数据库之后第一次调用时创建新的描述文件，
+    // 先写入当前状态的快照
+    std::string new_manifest_file;
+    Status s;
+    if (descriptor_log_ == nullptr) {
+        assert(descriptor_file_ == nullptr);
+        new_manifest_file = DescriptorFileName(dbname_, manifest_file_number_);
+        s = env_->NewWritableFile(new_manifest_file, &descriptor_file_);
+        if (s.IsOk()) {
+            descriptor_log_ = new log::Writer(descriptor_file_);
+            s = WriteSnapshot(descriptor_log_);
+        }
+    }
+
+    // 写描述文件时不持有锁，其他调用者会在开头等待
+    {
+        manifest_writing_ = true;
+        l.unlock();
+
+        if (s.IsOk()) {
+            std::string record;
+            edit->EncodeTo(&record);
+            s = descriptor_log_->AddRecord(record);
+            if (s.IsOk()) {
+                s = descriptor_file_->Sync();
+            }
+        }
+
+        // 创建了新的描述文件时，让 CURRENT 指向它
+        if (s.IsOk() && !new_manifest_file.empty()) {
+            s = SetCurrentFile(env_, dbname_, manifest_file_number_);
+        }
+
+        l.lock();
+        manifest_writing_ = false;
+        manifest_write_done_.notify_all();
+    }
+
+    if (s.IsOk()) {
+        AppendVersion(v);
+        log_number_ = edit->log_number_;
+    } else {
+        delete v;
+        if (!new_manifest_file.empty()) {
+            delete descriptor_log_;
+            delete descriptor_file_;
+            descriptor_log_ = nullptr;
+            descriptor_file_ = nullptr;
+            env_->RemoveFile(new_manifest_file);
+        }
+    }
+
+    return s;
+}
+
+Status VersionSet::Recover() {
+    struct LogReporter : public log::Reader::Reporter {
+        Status* status;
+        void Corruption(size_t bytes, const Status& s) override {
+            if (status->IsOk()) *status = s;
+        }
+    };
+
+    // 读取 CURRENT，找到当前的描述文件
+    std::string current;
+    Status s = ReadFileToString(env_, CurrentFileName(dbname_), &current);
+    if (!s.IsOk()) {
+        return s;
+    }
+    if (current.empty() || current[current.size() - 1] != '\n') {
+        return Status::Corruption("CURRENT file does not end with newline");
+    }
+    current.resize(current.size() - 1);
+
+    std::string dscname = dbname_ + "/" + current;
+    SequentialFile* file;
+    s = env_->NewSequentialFile(dscname, &file);
+    if (!s.IsOk()) {
+        if (s.IsNotFound()) {
+            return Status::Corruption("CURRENT points to a non-existent file",
+                                      s.ToString());
+        }
+        return s;
+    }
+
+    bool have_log_number = false;
+    bool have_next_file = false;
+    bool have_last_sequence = false;
+    uint64_t next_file = 0;
+    uint64_t last_sequence = 0;
+    uint64_t log_number = 0;
+    Builder builder(this, current_);
+
+    {
+        LogReporter reporter;
+        reporter.status = &s;
+        log::Reader reader(file, &reporter, true /*checksum*/);
+        Slice record;
+        std::string scratch;
+        while (reader.ReadRecord(&record, &scratch) && s.IsOk()) {
+            VersionEdit edit;
+            s = edit.DecodeFrom(record);
+            if (s.IsOk()) {
+                if (edit.has_comparator_ &&
+                    edit.comparator_ != icmp_.user_comparator()->Name()) {
+                    s = Status::InvalidArgument(
+                        edit.comparator_ +
+                            " does not match existing comparator ",
+                        icmp_.user_comparator()->Name());
+                }
+            }
+
+            if (s.IsOk()) {
+                builder.Apply(&edit);
+            }
+
+            if (edit.has_log_number_) {
+                log_number = edit.log_number_;
+                have_log_number = true;
+            }
+
+            if (edit.has_next_file_number_) {
+                next_file = edit.next_file_number_;
+                have_next_file = true;
+            }
+
+            if (edit.has_last_sequence_) {
+                last_sequence = edit.last_sequence_;
+                have_last_sequence = true;
+            }
+        }
+    }
+    delete file;
+    file = nullptr;
+
+    if (s.IsOk()) {
+        if (!have_next_file) {
+            s = Status::Corruption("no meta-nextfile entry in descriptor");
+        } else if (!have_log_number) {
+            s = Status::Corruption("no meta-lognumber entry in descriptor");
+        } else if (!have_last_sequence) {
+            s = Status::Corruption(
+                "no last-sequence-number entry in descriptor");
+        }
+    }
+
+    if (s.IsOk()) {
+        MarkFileNumberUsed(log_number);
+
+        Version* v = new Version(this);
+        builder.SaveTo(v);
+        Finalize(v);
+        AppendVersion(v);
+
+        // 打开数据库之后使用新的描述文件，旧的描述文件会被删除
+        manifest_file_number_ = next_file;
+        next_file_number_ = next_file + 1;
+        last_sequence_ = last_sequence;
+        log_number_ = log_number;
+    }
+
+    return s;
+}
+
+void VersionSet::MarkFileNumberUsed(uint64_t number) {
+    if (next_file_number_ <= number) {
+        next_file_number_ = number + 1;
+    }
+}
+
+void VersionSet::Finalize(Version* v) {
+    // 找到分数最高的层
+    int best_level = -1;
+    double best_score = -1;
+
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+        double score;
+        if (level == 0) {
+            // 第 0 层按文件数量而不是大小计算分数：
+            // 1. 写缓冲区较大时，第 0 层的文件少而大，不应该频繁压实
+            // 2. 每次读取都要合并第 0 层的所有文件，文件数量才是关键
+            score = v->files_[level].size() /
+                    static_cast<double>(
+                        options_->level0_file_num_compaction_trigger);
+        } else {
+            const int64_t level_bytes = TotalFileSize(v->files_[level]);
+            score = static_cast<double>(level_bytes) /
+                    MaxBytesForLevel(options_, level);
+        }
+
+        if (score > best_score) {
+            best_level = level;
+            best_score = score;
+        }
+    }
+
+    v->compaction_level_ = best_level;
+    v->compaction_score_ = best_score;
+
+    // 找到一个引用的最旧的 blob 文件需要回收的 table 文件。
+    // 只检查第 0 层以下：第 0 层的文件很快会被压实到下一层，
+    // 原地重写也会改变它们之间的新旧顺序
+    v->file_to_gc_ = nullptr;
+    v->file_to_gc_level_ = -1;
+    std::set<uint64_t> gc_files;
+    v->GetBlobFilesForGC(options_->blob_gc_garbage_ratio, &gc_files);
+    for (int level = 1; level < config::kNumLevels && !gc_files.empty();
+         level++) {
+        for (FileMetaData* f : v->files_[level]) {
+            if (f->oldest_blob_file != 0 &&
+                gc_files.count(f->oldest_blob_file) > 0) {
+                v->file_to_gc_ = f;
+                v->file_to_gc_level_ = level;
+                return;
+            }
+        }
+    }
+}
+
+Status VersionSet::WriteSnapshot(log::Writer* log) {
+    VersionEdit edit;
+    edit.SetComparatorName(icmp_.user_comparator()->Name());
+
+    // 保存压实的位置
+    for (int level = 0; level < config::kNumLevels; level++) {
+        if (!compact_pointer_[level].empty()) {
+            InternalKey key;
+            key.DecodeFrom(compact_pointer_[level]);
+            edit.SetCompactPointer(level, key);
+        }
+    }
+
+    // 保存所有的文件
+    for (int level = 0; level < config::kNumLevels; level++) {
+        for (const FileMetaData* f : current_->files_[level]) {
+            edit.AddFile(level, f->number, f->file_size,
+                         f->fragment_index_size, f->global_sequence,
+                         f->oldest_blob_file, f->smallest, f->largest);
+        }
+    }
+
+    // 保存所有的 blob 文件和其中失效数据的统计
+    for (const auto& entry : current_->blob_files_) {
+        const BlobFileMetaData& f = entry.second;
+        edit.AddBlobFile(f.number, f.total_count, f.total_bytes);
+        if (f.garbage_count > 0) {
+            edit.AddBlobGarbage(f.number, f.garbage_count, f.garbage_bytes);
+        }
+    }
+
+    std::string record;
+    edit.EncodeTo(&record);
+    return log->AddRecord(record);
+}
+
+int VersionSet::NumLevelFiles(int level) const {
+    assert(level >= 0);
+    assert(level < config::kNumLevels);
+    return current_->NumFiles(level);
+}
+
+const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
+    static_assert(config::kNumLevels == 7, "");
+    std::snprintf(scratch->buffer, sizeof(scratch->buffer),
+                  "files[ %d %d %d %d %d %d %d ]",
+                  NumLevelFiles(0), NumLevelFiles(1), NumLevelFiles(2),
+                  NumLevelFiles(3), NumLevelFiles(4), NumLevelFiles(5),
+                  NumLevelFiles(6));
+    return scratch->buffer;
+}
+
+void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
+    for (Version* v = dummy_versions_.next_; v != &dummy_versions_;
+         v = v->next_) {
+        for (int level = 0; level < config::kNumLevels; level++) {
+            for (const FileMetaData* f : v->files_[level]) {
+                live->insert(f->number);
+            }
+        }
+    }
+}
+
+void VersionSet::AddLiveBlobFiles(std::set<uint64_t>* live) {
+    for (Version* v = dummy_versions_.next_; v != &dummy_versions_;
+         v = v->next_) {
+        for (const auto& entry : v->blob_files_) {
+            live->insert(entry.first);
+        }
+    }
+}
+
+int64_t VersionSet::NumLevelBytes(int level) const {
+    assert(level >= 0);
+    assert(level < config::kNumLevels);
+    return TotalFileSize(current_->files_[level]);
+}
+
+void VersionSet::GetRange(const std::vector<FileMetaData*>& inputs,
+                          InternalKey* smallest, InternalKey* largest) {
+    assert(!inputs.empty());
+    smallest->Clear();
+    largest->Clear();
+    for (size_t i = 0; i < inputs.size(); i++) {
+        FileMetaData* f = inputs[i];
+        if (i == 0) {
+            *smallest = f->smallest;
+            *largest = f->largest;
+        } else {
+            if (icmp_.Compare(f->smallest.Encode(), smallest->Encode()) < 0) {
+                *smallest = f->smallest;
+            }
+            if (icmp_.Compare(f->largest.Encode(), largest->Encode()) > 0) {
+                *largest = f->largest;
+            }
+        }
+    }
+}
+
+void VersionSet::GetRange2(const std::vector<FileMetaData*>& inputs1,
+                           const std::vector<FileMetaData*>& inputs2,
+                           InternalKey* smallest, InternalKey* largest) {
+    std::vector<FileMetaData*> all = inputs1;
+    all.insert(all.end(), inputs2.begin(), inputs2.end());
+    GetRange(all, smallest, largest);
+}
+
+Iterator* VersionSet::MakeInputIterator(Compaction* c) {
+    ReadOptions options;
+    options.verify_checksums = options_->paranoid_checks;
+    options.fill_cache = false;
+
+    // 第 0 层的每个文件需要单独的迭代器，
+    // 其他层的文件使用一个依次打开文件的迭代器
+    const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+    Iterator** list = new Iterator*[space];
+    int num = 0;
+    for (int which = 0; which < 2; which++) {
+        if (!c->inputs_[which].empty()) {
+            if (c->level() + which == 0) {
+                for (const FileMetaData* f : c->inputs_[which]) {
+                    list[num++] = table_cache_->NewIterator(
+                        options, f->number, f->file_size, f->global_sequence);
+                }
+            } else {
+                list[num++] = NewTwoLevelIterator(
+                    new Version::LevelFileNumIterator(icmp_,
+                                                      &c->inputs_[which]),
+                    &GetFileIterator, table_cache_, options);
+            }
+        }
+    }
+    assert(num <= space);
+    Iterator* result = NewMergingIterator(&icmp_, list, num);
+    delete[] list;
+    return result;
+}
+
+Compaction* VersionSet::PickCompaction() {
+    if (!NeedsCompaction()) {
+        return nullptr;
+    }
+
+    if (current_->compaction_score_ < 1) {
+        return PickBlobGCCompaction();
+    }
+
+    const int level = current_->compaction_level_;
+    assert(level >= 0);
+    assert(level + 1 < config::kNumLevels);
+    Compaction* c = new Compaction(options_, level);
+
+    // 选择 compact_pointer_[level] 之后的第一个文件
+    for (FileMetaData* f : current_->files_[level]) {
+        if (compact_pointer_[level].empty() ||
+            icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
+            c->inputs_[0].push_back(f);
+            break;
+        }
+    }
+    if (c->inputs_[0].empty()) {
+        // 已经到达这一层的末尾，从头开始
+        c->inputs_[0].push_back(current_->files_[level][0]);
+    }
+
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+
+    // 第 0 层的文件之间可能重叠，加入所有与选中的文件重叠的文件
+    if (level == 0) {
+        InternalKey smallest, largest;
+        GetRange(c->inputs_[0], &smallest, &largest);
+        current_->GetOverlappingInputs(0, &smallest, &largest,
+                                       &c->inputs_[0]);
+        assert(!c->inputs_[0].empty());
+    }
+
+    SetupOtherInputs(c);
+
+    return c;
+}
+
+// 在 files 中找到 user key 与 largest_key 相同、
+// 并且 smallest 大于 largest_key 的文件中 smallest 最小的一个。
+// 没有这样的文件时返回 nullptr
+static FileMetaData* FindSmallestBoundaryFile(
+    const InternalKeyComparator& icmp,
+    const std::vector<FileMetaData*>& level_files,
+    const InternalKey& largest_key) {
+    const Comparator* user_cmp = icmp.user_comparator();
+    FileMetaData* smallest_boundary_file = nullptr;
+    for (FileMetaData* f : level_files) {
+        if (icmp.Compare(f->smallest.Encode(), largest_key.Encode()) > 0 &&
+            user_cmp->Compare(f->smallest.user_key(),
+                              largest_key.user_key()) == 0) {
+            if (smallest_boundary_file == nullptr ||
+                icmp.Compare(f->smallest.Encode(),
+                             smallest_boundary_file->smallest.Encode()) < 0) {
+                smallest_boundary_file = f;
+            }
+        }
+    }
+    return smallest_boundary_file;
+}
+
+// 同一个 user key 的不同版本可能被拆分到相邻的两个文件中。
+// 如果只压实了其中前一个文件，较旧的版本会被写入下一层，
+// 而较新的版本还留在这一层，之后的读取会在下一层中找到旧的版本。
+// 这里把这样的相邻文件也加入 *compaction_files
+static void AddBoundaryInputs(const InternalKeyComparator& icmp,
+                              const std::vector<FileMetaData*>& level_files,
+                              std::vector<FileMetaData*>* compaction_files) {
+    if (compaction_files->empty()) {
+        return;
+    }
+
+    // 找到输入中最大的 key
+    InternalKey largest_key = (*compaction_files)[0]->largest;
+    for (const FileMetaData* f : *compaction_files) {
+        if (icmp.Compare(f->largest.Encode(), largest_key.Encode()) > 0) {
+            largest_key = f->largest;
+        }
+    }
+
+    while (true) {
+        FileMetaData* smallest_boundary_file =
+            FindSmallestBoundaryFile(icmp, level_files, largest_key);
+        if (smallest_boundary_file == nullptr) {
+            break;
+        }
+        compaction_files->push_back(smallest_boundary_file);
+        largest_key = smallest_boundary_file->largest;
+    }
+}
+
+void VersionSet::SetupOtherInputs(Compaction* c) {
+    const int level = c->level();
+    InternalKey smallest, largest;
+
+    AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
+    GetRange(c->inputs_[0], &smallest, &largest);
+
+    current_->GetOverlappingInputs(level + 1, &smallest, &largest,
+                                   &c->inputs_[1]);
+    AddBoundaryInputs(icmp_, current_->files_[level + 1], &c->inputs_[1]);
+
+    // 整个压实的 key 范围
+    InternalKey all_start, all_limit;
+    GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+
+    // 在不改变 level + 1 层输入的前提下，尽量加入更多 level 层的文件
+    if (!c->inputs_[1].empty()) {
+        std::vector<FileMetaData*> expanded0;
+        current_->GetOverlappingInputs(level, &all_start, &all_limit,
+                                       &expanded0);
+        AddBoundaryInputs(icmp_, current_->files_[level], &expanded0);
+        const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
+        const int64_t expanded0_size = TotalFileSize(expanded0);
+        if (expanded0.size() > c->inputs_[0].size() &&
+            inputs1_size + expanded0_size <
+                ExpandedCompactionByteSizeLimit(options_)) {
+            InternalKey new_start, new_limit;
+            GetRange(expanded0, &new_start, &new_limit);
+            std::vector<FileMetaData*> expanded1;
+            current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
+                                           &expanded1);
+            AddBoundaryInputs(icmp_, current_->files_[level + 1],
+                              &expanded1);
+            if (expanded1.size() == c->inputs_[1].size()) {
+                smallest = new_start;
+                largest = new_limit;
+                c->inputs_[0] = expanded0;
+                c->inputs_[1] = expanded1;
+                GetRange2(c->inputs_[0], c->inputs_[1], &all_start,
+                          &all_limit);
+            }
+        }
+    }
+
+    // 记录与压实范围重叠的 level + 2 层的文件
+    if (level + 2 < config::kNumLevels) {
+        current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+                                       &c->grandparents_);
+    }
+
+    // 更深的层中没有文件时，输出层就是最底层
+    bool bottommost = true;
+    for (int lvl = level + 2; lvl < config::kNumLevels; lvl++) {
+        if (!current_->files_[lvl].empty()) {
+            bottommost = false;
+            break;
+        }
+    }
+    c->output_compression_ =
+        CompressionForLevel(*options_, level + 1, bottommost);
+
+    // 下一次压实这一层时从这次压实的范围之后开始，
+    // 这里立即更新，而不是等到 VersionEdit 被应用之后，
+    // 这样即使这次压实失败，下一次也会尝试不同的范围
+    compact_pointer_[level] = largest.Encode().to_string();
+    c->edit_.SetCompactPointer(level, largest);
+}
+
+Compaction* VersionSet::PickBlobGCCompaction() {
+    const int level = current_->file_to_gc_level_;
+    assert(level > 0);
+    Compaction* c = new Compaction(options_, level);
+    c->output_level_ = level;
+    c->inputs_[0].push_back(current_->file_to_gc_);
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+
+    // 同一个 user key 延续到下一个文件时一起重写，
+    // 否则可能丢弃下一个文件中旧版本需要的删除标记
+    AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
+    InternalKey smallest, largest;
+    GetRange(c->inputs_[0], &smallest, &largest);
+    bool bottommost = true;
+    for (int lvl = level + 1; lvl < config::kNumLevels; lvl++) {
+        if (!current_->files_[lvl].empty()) {
+            bottommost = false;
+            break;
+        }
+    }
+    if (level + 1 < config::kNumLevels) {
+        current_->GetOverlappingInputs(level + 1, &smallest, &largest,
+                                       &c->grandparents_);
+    }
+    c->output_compression_ = CompressionForLevel(*options_, level, bottommost);
+    return c;
+}
+
+Compaction::Compaction(const Options* options, int level)
+    : level_(level),
+      output_level_(level + 1),
+      max_output_file_size_(TargetFileSize(options)),
+      output_compression_(options->compression),
+      input_version_(nullptr) {}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
+    for (int i = 0; i < config::kNumLevels; i++) {
+        level_ptrs[i] = 0;
+    }
+}
+
+Compaction::~Compaction() {
+    if (input_version_ != nullptr) {
+        input_version_->Unref();
+    }
+}
+
+bool Compaction::IsTrivialMove() const {
+    const VersionSet* vset = input_version_->vset_;
+    // 与太多 level + 2 层的文件重叠时不能直接移动，
+    // 否则以后压实这个文件的代价很高。
+    // 输出使用的压缩算法与输入所在的层不同时（例如移动到最底层）也要重写文件
+    return (output_level_ == level_ + 1 && num_input_files(0) == 1 &&
+            num_input_files(1) == 0 &&
+            CompressionForLevel(*vset->options_, level_, false) ==
+                output_compression_ &&
+            TotalFileSize(grandparents_) <=
+                MaxGrandParentOverlapBytes(vset->options_));
+}
+
+void Compaction::AddInputDeletions(VersionEdit* edit) {
+    for (int which = 0; which < 2; which++) {
+        for (const FileMetaData* f : inputs_[which]) {
+            edit->RemoveFile(level_ + which, f->number);
+        }
+    }
+}
+
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
+    const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+    for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
+        const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
+        size_t& ptr = cursor->level_ptrs[lvl];
+        while (ptr < files.size()) {
+            FileMetaData* f = files[ptr];
+            if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
+                // 已经到达可能包含 user_key 的文件
+                if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
+                    // user_key 在这个文件的范围内
+                    return false;
+                }
+                break;
+            }
+            ptr++;
+        }
+    }
+    return true;
+}
+
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
+    const VersionSet* vset = input_version_->vset_;
+    // 跳过所有在 internal_key 之前的 grandparent 文件
+    const InternalKeyComparator* icmp = &vset->icmp_;
+    size_t& index = cursor->grandparent_index;
+    while (index < grandparents_.size() &&
+           icmp->Compare(internal_key, grandparents_[index]->largest.Encode()) >
+               0) {
+        if (cursor->seen_key) {
+            cursor->overlapped_bytes += grandparents_[index]->file_size;
+        }
+        index++;
+    }
+    cursor->seen_key = true;
+
+    if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
+        // 当前输出文件重叠得太多了，开始一个新的输出文件
+        cursor->overlapped_bytes = 0;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+void Compaction::ReleaseInputs() {
+    if (input_version_ != nullptr) {
+        input_version_->Unref();
+        input_version_ = nullptr;
+    }
+}
+
+}  // namespace massdb
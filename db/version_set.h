@@ -0,0 +1,390 @@
+//
+// Created by Xsakura on 2023/6/3.
+//
+
+#ifndef MASSDB_DB_VERSION_SET_H
+#define MASSDB_DB_VERSION_SET_H
+
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/version_edit.h"
+#include "massdb/options.h"
+
+namespace massdb {
+
+// 数据库的磁盘状态由一组 Version 表示，每个 Version 记录了每一层中的
+// table 文件。最新的 Version 称为 current，较旧的 Version 可能还被
+// 迭代器或者正在进行的压实引用着。
+//
+// VersionSet 在描述文件（manifest）中记录每次变化，
+// 打开数据库时通过重放描述文件恢复 current
+
+namespace log {
+class Writer;
+}  // namespace log
+
+class Compaction;
+class Iterator;
+class LookupKey;
+class TableCache;
+class VersionSet;
+class WritableFile;
+
+// 返回 files 中第一个 largest >= key 的文件的下标。
+// files 中的文件互不重叠并且按顺序排列。
+// 没有这样的文件时返回 files.size()
+int FindFile(const InternalKeyComparator& icmp,
+             const std::vector<FileMetaData*>& files, const Slice& key);
+
+// 如果 files 中有文件与 user key 的范围 [*smallest, *largest] 重叠，
+// 返回 true。smallest 为 nullptr 表示比所有 key 都小，
+// largest 为 nullptr 表示比所有 key 都大。
+// disjoint_sorted_files 为 true 时要求 files 中的文件互不重叠并且按顺序排列
+bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
+                           bool disjoint_sorted_files,
+                           const std::vector<FileMetaData*>& files,
+                           const Slice* smallest_user_key,
+                           const Slice* largest_user_key);
+
+class Version {
+public:
+    // 将遍历这个 Version 中所有文件的迭代器追加到 *iters 中，
+    // 与 MemTable 的迭代器合并后得到整个数据库的内容
+    void AddIterators(const ReadOptions& options,
+                      std::vector<Iterator*>* iters);
+
+    // 在这个 Version 中查找 key。找到时将 value 存入 *val 并返回 Ok，
+    // 否则返回一个非 Ok 的状态。
+    // 找到的条目的类型是 kTypeBlobIndex 时，*val 是 blob 引用，
+    // *is_blob_index 为 true。要求：不持有锁
+    Status Get(const ReadOptions& options, const LookupKey& key,
+               std::string* val, bool* is_blob_index);
+
+    // 批量查找 *keys[0, n - 1] 中 done[i] 为 false 的 key，keys 按 user key
+    // 升序排列。有结果（找到、已删除或出错）的 key 设置 statuses[i] 并将
+    // done[i] 置为 true，其余 key 不修改。
+    // 同一个文件中的 key 一起查找，每一层未缓存的数据块一起读取。
+    // 要求：不持有锁
+    void MultiGet(const ReadOptions& options, const LookupKey* const* keys,
+                  size_t n, std::string* values, bool* is_blob_index,
+                  Status* statuses, bool* done);
+
+    // 引用计数的修改要求持有数据库的锁
+    void Ref();
+    void Unref();
+
+    // 将第 level 层中与 [begin, end] 重叠的文件存入 *inputs。
+    // begin 为 nullptr 表示比所有 key 都小，end 为 nullptr 表示比所有 key
+    // 都大
+    void GetOverlappingInputs(int level, const InternalKey* begin,
+                              const InternalKey* end,
+                              std::vector<FileMetaData*>* inputs);
+
+    // 如果第 level 层中有文件与 user key 的范围 [*smallest, *largest]
+    // 重叠，返回 true
+    bool OverlapInLevel(int level, const Slice* smallest_user_key,
+                        const Slice* largest_user_key);
+
+    // 将所有层的文件追加到 *files 中
+    void GetAllFiles(std::vector<FileMetaData*>* files) const;
+
+    // 将失效数据的比例不低于 garbage_ratio 的 blob 文件的编号存入 *files
+    void GetBlobFilesForGC(double garbage_ratio,
+                           std::set<uint64_t>* files) const;
+
+    int NumFiles(int level) const {
+        return static_cast<int>(files_[level].size());
+    }
+
+    // 返回描述这个 Version 的内容的字符串
+    std::string DebugString() const;
+
+private:
+    friend class Compaction;
+    friend class VersionSet;
+
+    class LevelFileNumIterator;
+
+    explicit Version(VersionSet* vset)
+        : vset_(vset),
+          next_(this),
+          prev_(this),
+          refs_(0),
+          compaction_score_(-1),
+          compaction_level_(-1),
+          file_to_gc_(nullptr),
+          file_to_gc_level_(-1) {}
+
+    Version(const Version&) = delete;
+    Version& operator=(const Version&) = delete;
+
+    ~Version();
+
+    // 返回依次遍历第 level 层（level > 0）中所有文件的迭代器，
+    // 只在需要时才打开文件
+    Iterator* NewConcatenatingIterator(const ReadOptions& options,
+                                       int level) const;
+
+    VersionSet* vset_;  // 这个 Version 所属的 VersionSet
+    Version* next_;     // 链表中的下一个 Version
+    Version* prev_;     // 链表中的上一个 Version
+    int refs_;          // 这个 Version 的引用计数
+
+    // 每一层的文件
+    std::vector<FileMetaData*> files_[config::kNumLevels];
+
+    // 还有有效 value 的 blob 文件，按编号排列
+    std::map<uint64_t, BlobFileMetaData> blob_files_;
+
+    // 下一次应该压实的层和它的分数。
+    // 分数 < 1 表示不需要压实。由 Finalize() 计算
+    double compaction_score_;
+    int compaction_level_;
+
+    // 引用的最旧的 blob 文件失效数据较多、需要重写的 table 文件和它所在的层。
+    // 没有时为 nullptr。由 Finalize() 计算
+    FileMetaData* file_to_gc_;
+    int file_to_gc_level_;
+};
+
+class VersionSet {
+public:
+    VersionSet(const std::string& dbname, const Options* options,
+               TableCache* table_cache, const InternalKeyComparator*);
+
+    VersionSet(const VersionSet&) = delete;
+    VersionSet& operator=(const VersionSet&) = delete;
+
+    ~VersionSet();
+
+    // 将 *edit 应用到 current 上得到新的 Version，
+    // 写入描述文件后把它设为新的 current。
+    // 写描述文件期间会暂时释放锁，同一时刻只有一个调用者在写描述文件，
+    // 其他调用者等待它完成后再基于新的 current 应用自己的 *edit。
+    // *edit 中设置了比 LastSequence() 大的序列号时把它写入描述文件，
+    // 但不修改 LastSequence()，由调用者在返回之后公开。
+    // 要求：持有 l
+    Status LogAndApply(VersionEdit* edit, std::unique_lock<std::mutex>& l);
+
+    // 从描述文件中恢复最后保存的状态
+    Status Recover();
+
+    // 返回当前的 Version
+    Version* current() const { return current_; }
+
+    // 返回当前描述文件的编号
+    uint64_t ManifestFileNumber() const { return manifest_file_number_; }
+
+    // 分配并返回一个新的文件编号
+    uint64_t NewFileNumber() { return next_file_number_++; }
+
+    // 归还 NewFileNumber() 分配的文件编号。
+    // 要求：file_number 是最后一次分配的编号
+    void ReuseFileNumber(uint64_t file_number) {
+        if (next_file_number_ == file_number + 1) {
+            next_file_number_ = file_number;
+        }
+    }
+
+    // 返回第 level 层的文件数量
+    int NumLevelFiles(int level) const;
+
+    // 返回第 level 层的文件的总大小
+    int64_t NumLevelBytes(int level) const;
+
+    // 返回最后一个写入的序列号
+    uint64_t LastSequence() const { return last_sequence_; }
+
+    // 设置最后一个写入的序列号
+    void SetLastSequence(uint64_t s) {
+        assert(s >= last_sequence_);
+        last_sequence_ = s;
+    }
+
+    // 保证不再分配小于等于 number 的文件编号
+    void MarkFileNumberUsed(uint64_t number);
+
+    // 返回当前的日志文件编号，编号更小的日志都已经不再需要
+    uint64_t LogNumber() const { return log_number_; }
+
+    // 选择下一次压实的层和输入文件。
+    // 不需要压实时返回 nullptr，否则返回一个描述压实的对象，
+    // 调用者负责删除它
+    Compaction* PickCompaction();
+
+    // 返回遍历压实的所有输入文件的迭代器，
+    // 调用者不再需要时负责删除它
+    Iterator* MakeInputIterator(Compaction* c);
+
+    // 如果某一层需要压实，或者有 table 文件需要重写来回收 blob 文件的
+    // 空间，返回 true
+    bool NeedsCompaction() const {
+        return current_->compaction_score_ >= 1 ||
+               current_->file_to_gc_ != nullptr;
+    }
+
+    // 将所有 Version 引用的文件加入 *live
+    void AddLiveFiles(std::set<uint64_t>* live);
+
+    // 将所有 Version 引用的 blob 文件加入 *live
+    void AddLiveBlobFiles(std::set<uint64_t>* live);
+
+    // 返回每一层的文件数量的简要描述，例如 "files[ 1 4 0 0 0 0 0 ]"
+    struct LevelSummaryStorage {
+        char buffer[100];
+    };
+    const char* LevelSummary(LevelSummaryStorage* scratch) const;
+
+private:
+    class Builder;
+
+    friend class Compaction;
+    friend class Version;
+
+    // 计算 v 下一次应该压实的层
+    void Finalize(Version* v);
+
+    // 将 inputs 中所有文件的 key 的范围存入 *smallest 和 *largest。
+    // 要求：inputs 不为空
+    void GetRange(const std::vector<FileMetaData*>& inputs,
+                  InternalKey* smallest, InternalKey* largest);
+
+    // 将 inputs1 和 inputs2 中所有文件的 key 的范围
+    // 存入 *smallest 和 *largest
+    void GetRange2(const std::vector<FileMetaData*>& inputs1,
+                   const std::vector<FileMetaData*>& inputs2,
+                   InternalKey* smallest, InternalKey* largest);
+
+    // 确定压实在下一层的输入文件，并在不引入更多下一层文件的前提下
+    // 尽量扩大这一层的输入
+    void SetupOtherInputs(Compaction* c);
+
+    // 原地重写 current_->file_to_gc_，把其中引用指向的失效数据较多的
+    // blob 文件中的 value 搬到新的 blob 文件
+    Compaction* PickBlobGCCompaction();
+
+    // 将 current 的完整内容写入一个新的描述文件
+    Status WriteSnapshot(log::Writer* log);
+
+    // 将 v 设为新的 current
+    void AppendVersion(Version* v);
+
+    Env* const env_;
+    const std::string dbname_;
+    const Options* const options_;
+    TableCache* const table_cache_;
+    const InternalKeyComparator icmp_;
+    uint64_t next_file_number_;
+    uint64_t manifest_file_number_;
+    uint64_t last_sequence_;
+    uint64_t log_number_;
+
+    // 正在写入的描述文件，打开数据库之后第一次 LogAndApply() 时创建
+    WritableFile* descriptor_file_;
+    log::Writer* descriptor_log_;
+
+    // 有线程正在释放锁写入描述文件
+    bool manifest_writing_;
+    std::condition_variable manifest_write_done_;
+
+    Version dummy_versions_;  // 所有 Version 组成的双向循环链表的头节点
+    Version* current_;        // == dummy_versions_.prev_
+
+    // 每一层下一次压实开始的 key，为空表示从头开始。
+    // 同一层的压实在 key 空间中轮转进行
+    std::string compact_pointer_[config::kNumLevels];
+};
+
+// 一次压实的信息
+class Compaction {
+public:
+    ~Compaction();
+
+    // 压实的输入所在的层
+    int level() const { return level_; }
+
+    // 输出写入的层。一般是 level() + 1；回收 blob 文件空间时原地重写
+    // level() 层的文件，输出仍然写入 level() 层
+    int output_level() const { return output_level_; }
+
+    // 返回描述压实结果的 VersionEdit
+    VersionEdit* edit() { return &edit_; }
+
+    // which 为 0 或 1，分别表示 level() 层和 level() + 1 层的输入
+    int num_input_files(int which) const {
+        return static_cast<int>(inputs_[which].size());
+    }
+
+    // 返回 level() + which 层的第 i 个输入文件
+    FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
+
+    // 压实输出的文件的最大大小
+    uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
+
+    // 输出文件使用的压缩算法
+    CompressionType output_compression() const { return output_compression_; }
+
+    // 如果可以直接把唯一的输入文件移动到下一层，
+    // 不需要合并或者拆分，返回 true
+    bool IsTrivialMove() const;
+
+    // 在 *edit 中删除所有的输入文件
+    void AddInputDeletions(VersionEdit* edit);
+
+    // 按 key 的顺序遍历输入时的位置。
+    // 遍历的 key 是递增的，这些位置只会向后移动。
+    // 压实被拆分成多个子压实并行执行时，每个子压实使用自己的 Cursor
+    struct Cursor {
+        Cursor();
+
+        size_t grandparent_index;  // ShouldStopBefore() 检查到的位置
+        bool seen_key;             // 已经输出过 key
+        // 当前输出文件与 grandparents_ 重叠的字节数
+        int64_t overlapped_bytes;
+        // IsBaseLevelForKey() 在每一层中检查到的位置
+        size_t level_ptrs[config::kNumLevels];
+    };
+
+    // 如果 user_key 在比输出层更深的层中不存在，返回 true。
+    // 此时 user_key 的删除标记可以直接丢弃
+    bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+    // 如果在写入 internal_key 之前应该结束当前的输出文件，返回 true。
+    // 避免一个输出文件与太多 output_level() + 1 层的文件重叠，
+    // 否则以后压实这个文件时需要合并太多的数据
+    bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+    // 压实完成后释放对输入 Version 的引用
+    void ReleaseInputs();
+
+private:
+    friend class Version;
+    friend class VersionSet;
+
+    Compaction(const Options* options, int level);
+
+    int level_;
+    int output_level_;
+    uint64_t max_output_file_size_;
+    CompressionType output_compression_;
+    Version* input_version_;
+    VersionEdit edit_;
+
+    // 每次压实从 level_ 和 level_ + 1 层读取输入
+    std::vector<FileMetaData*> inputs_[2];
+
+    // 与压实的 key 范围重叠的 output_level_ + 1 层的文件
+    std::vector<FileMetaData*> grandparents_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_VERSION_SET_H
@@ -0,0 +1,355 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "db/version_set.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "db/filename.h"
+#include "db/log_writer.h"
+#include "db/table_cache.h"
+#include "db/version_edit.h"
+#include "gtest/gtest.h"
+#include "massdb/comparator.h"
+#include "massdb/env.h"
+#include "massdb/options.h"
+#include "massdb/spectrum.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+static InternalKey Key(const std::string& user_key, SequenceNumber seq) {
+    return InternalKey(user_key, seq, kTypeValue);
+}
+
+TEST(VersionEditTest, EncodeDecode) {
+    VersionEdit edit;
+    edit.SetComparatorName("massdb.BytewiseComparator");
+    edit.SetLogNumber(10);
+    edit.SetNextFile(20);
+    edit.SetLastSequence(30);
+    for (int i = 0; i < 4; i++) {
+        edit.AddFile(i, 100 + i, 1000 + i, i * 10, i == 3 ? 77 : 0,
+                     i == 2 ? 300 : 0, Key("a" + std::to_string(i), 5),
+                     Key("z" + std::to_string(i), 6));
+        edit.RemoveFile(i + 1, 200 + i);
+        edit.SetCompactPointer(i, Key("p" + std::to_string(i), 7));
+        edit.AddBlobFile(300 + i, 50 + i, 5000 + i);
+        edit.AddBlobGarbage(300 + i, i, i * 100);
+    }
+
+    std::string encoded;
+    edit.EncodeTo(&encoded);
+    VersionEdit parsed;
+    ASSERT_TRUE(parsed.DecodeFrom(encoded).IsOk());
+    std::string encoded2;
+    parsed.EncodeTo(&encoded2);
+    ASSERT_EQ(encoded, encoded2);
+    ASSERT_EQ(edit.DebugString(), parsed.DebugString());
+
+    // 记录由一系列带标签的字段组成，在字段的边界截断得到较短的记录，
+    // 其他位置截断都不能被解析
+    int boundaries = 0;
+    for (size_t len = 1; len < encoded.size(); len++) {
+        VersionEdit truncated;
+        const Slice prefix(encoded.data(), len);
+        if (truncated.DecodeFrom(prefix).IsOk()) {
+            std::string reencoded;
+            truncated.EncodeTo(&reencoded);
+            ASSERT_EQ(prefix.to_string(), reencoded) << "length " << len;
+            boundaries++;
+        }
+    }
+    ASSERT_LT(boundaries, 40);
+}
+
+class VersionSetTest : public testing::Test {
+public:
+    VersionSetTest()
+        : env_(Env::Default()),
+          dbname_(test::NewTestDirectory("version_set_test")),
+          icmp_(BytewiseComparator()) {
+        env_->CreateDir(dbname_);
+        options_.env = env_;
+        options_.comparator = &icmp_;
+        options_.level0_file_num_compaction_trigger = 4;
+        options_.max_bytes_for_level_base = 10000;
+        options_.max_bytes_for_level_multiplier = 10;
+        options_.max_file_size = 1000;
+        table_cache_.reset(new TableCache(dbname_, options_, 10));
+    }
+
+    ~VersionSetTest() override {
+        vset_.reset();
+        test::DestroyDirectory(env_, dbname_);
+    }
+
+    // 与 DBImpl::NewDB() 相同，写入一个空数据库的描述文件
+    void NewDB() {
+        VersionEdit new_db;
+        new_db.SetComparatorName(icmp_.user_comparator()->Name());
+        new_db.SetLogNumber(0);
+        new_db.SetNextFile(2);
+        new_db.SetLastSequence(0);
+
+        WritableFile* file;
+        ASSERT_TRUE(
+            env_->NewWritableFile(DescriptorFileName(dbname_, 1), &file).IsOk());
+        {
+            log::Writer log(file);
+            std::string record;
+            new_db.EncodeTo(&record);
+            ASSERT_TRUE(log.AddRecord(record).IsOk());
+        }
+        ASSERT_TRUE(file->Close().IsOk());
+        delete file;
+        ASSERT_TRUE(SetCurrentFile(env_, dbname_, 1).IsOk());
+    }
+
+    Status Reopen() {
+        vset_.reset();
+        vset_.reset(
+            new VersionSet(dbname_, &options_, table_cache_.get(), &icmp_));
+        return vset_->Recover();
+    }
+
+    Status Apply(VersionEdit* edit) {
+        std::unique_lock<std::mutex> l(mutex_);
+        return vset_->LogAndApply(edit, l);
+    }
+
+    // 在 level 层加入一个 [smallest, largest] 范围内的文件，返回文件编号
+    uint64_t AddFile(int level, const std::string& smallest,
+                     const std::string& largest, uint64_t size,
+                     SequenceNumber seq = 100) {
+        const uint64_t number = vset_->NewFileNumber();
+        VersionEdit edit;
+        edit.AddFile(level, number, size, 0, 0, 0, Key(smallest, seq),
+                     Key(largest, seq));
+        EXPECT_TRUE(Apply(&edit).IsOk());
+        return number;
+    }
+
+    // 每一层的文件编号，例如 "L0: 5 6 L2: 7"
+    std::string Files() {
+        std::string result;
+        for (int level = 0; level < config::kNumLevels; level++) {
+            std::vector<FileMetaData*> files;
+            vset_->current()->GetOverlappingInputs(level, nullptr, nullptr,
+                                                   &files);
+            if (files.empty()) continue;
+            if (!result.empty()) result += " ";
+            result += "L" + std::to_string(level) + ":";
+            for (const FileMetaData* f : files) {
+                result += " " + std::to_string(f->number);
+            }
+        }
+        return result;
+    }
+
+    // 压实的两层输入的文件编号，例如 "3 4 | 7"
+    static std::string Inputs(Compaction* c) {
+        std::string result;
+        for (int which = 0; which < 2; which++) {
+            if (which == 1) result += " |";
+            for (int i = 0; i < c->num_input_files(which); i++) {
+                if (!result.empty()) result += " ";
+                result += std::to_string(c->input(which, i)->number);
+            }
+        }
+        return result;
+    }
+
+    Env* const env_;
+    const std::string dbname_;
+    InternalKeyComparator icmp_;
+    Options options_;
+    std::unique_ptr<TableCache> table_cache_;
+    std::unique_ptr<VersionSet> vset_;
+    std::mutex mutex_;
+};
+
+TEST_F(VersionSetTest, RecoverFiles) {
+    NewDB();
+    ASSERT_TRUE(Reopen().IsOk());
+    ASSERT_EQ("", Files());
+
+    const uint64_t f1 = AddFile(0, "a", "c", 100);
+    const uint64_t f2 = AddFile(0, "b", "d", 100);
+    const uint64_t f3 = AddFile(2, "e", "g", 100);
+    VersionEdit edit;
+    edit.RemoveFile(0, f1);
+    edit.AddFile(1, vset_->NewFileNumber(), 200, 0, 0, 0, Key("a", 100),
+                 Key("c", 100));
+    edit.SetLastSequence(500);
+    ASSERT_TRUE(Apply(&edit).IsOk());
+    vset_->SetLastSequence(500);
+    const std::string files = Files();
+    ASSERT_EQ("L0: " + std::to_string(f2) + " L1: " + std::to_string(f3 + 1) +
+                  " L2: " + std::to_string(f3),
+              files);
+    const uint64_t next_file = vset_->NewFileNumber();
+
+    // 重新打开后得到相同的状态，新分配的文件编号不会与已有的文件重复
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(Reopen().IsOk());
+        ASSERT_EQ(files, Files());
+        ASSERT_EQ(500u, vset_->LastSequence());
+        ASSERT_GT(vset_->NewFileNumber(), next_file);
+        // 每次重新打开后的第一次 LogAndApply() 写入新的描述文件
+        VersionEdit empty;
+        ASSERT_TRUE(Apply(&empty).IsOk());
+    }
+
+    // 日志编号也被保存
+    VersionEdit log_edit;
+    const uint64_t log_number = vset_->NewFileNumber();
+    log_edit.SetLogNumber(log_number);
+    ASSERT_TRUE(Apply(&log_edit).IsOk());
+    ASSERT_TRUE(Reopen().IsOk());
+    ASSERT_EQ(log_number, vset_->LogNumber());
+    ASSERT_GT(vset_->NewFileNumber(), log_number);
+}
+
+TEST_F(VersionSetTest, RecoverErrors) {
+    NewDB();
+    ASSERT_TRUE(Reopen().IsOk());
+    AddFile(1, "a", "b", 100);
+
+    // 比较器不一致
+    InternalKeyComparator other(SpectrumKeyComparator());
+    vset_.reset(new VersionSet(dbname_, &options_, table_cache_.get(), &other));
+    ASSERT_TRUE(vset_->Recover().IsInvalidArgument());
+
+    // CURRENT 不以换行结尾，或者指向不存在的描述文件
+    std::string current;
+    ASSERT_TRUE(ReadFileToString(env_, CurrentFileName(dbname_), &current).IsOk());
+    ASSERT_TRUE(WriteStringToFile(env_, current.substr(0, current.size() - 1),
+                                  CurrentFileName(dbname_))
+                    .IsOk());
+    ASSERT_TRUE(Reopen().IsCorruption());
+    ASSERT_TRUE(
+        WriteStringToFile(env_, "MANIFEST-999999\n", CurrentFileName(dbname_))
+            .IsOk());
+    ASSERT_TRUE(Reopen().IsCorruption());
+    ASSERT_TRUE(WriteStringToFile(env_, current, CurrentFileName(dbname_)).IsOk());
+    ASSERT_TRUE(Reopen().IsOk());
+    ASSERT_EQ(1, vset_->NumLevelFiles(1));
+}
+
+TEST_F(VersionSetTest, PickLevel0Compaction) {
+    NewDB();
+    ASSERT_TRUE(Reopen().IsOk());
+    AddFile(1, "a", "b", 100);
+    const uint64_t l1 = AddFile(1, "g", "i", 100);
+    AddFile(1, "m", "n", 100);
+
+    // 第 0 层的文件数量达到 level0_file_num_compaction_trigger 时才压实
+    const uint64_t f1 = AddFile(0, "c", "f", 100, 10);
+    const uint64_t f2 = AddFile(0, "i", "l", 100, 20);
+    const uint64_t f3 = AddFile(0, "e", "h", 100, 30);
+    ASSERT_FALSE(vset_->NeedsCompaction());
+    ASSERT_EQ(nullptr, vset_->PickCompaction());
+    const uint64_t f4 = AddFile(0, "s", "t", 100, 40);
+    ASSERT_TRUE(vset_->NeedsCompaction());
+
+    // 从 key 最小的文件开始，加入与它重叠的第 0 层的文件 [c, h] 和第 1 层
+    // 与之重叠的文件 [g, i]。之后扩大第 0 层的输入，加入 [i, l]，
+    // 这不会引入更多第 1 层的文件
+    std::unique_ptr<Compaction> c(vset_->PickCompaction());
+    ASSERT_TRUE(c != nullptr);
+    ASSERT_EQ(0, c->level());
+    ASSERT_EQ(std::to_string(f1) + " " + std::to_string(f3) + " " +
+                  std::to_string(f2) + " | " + std::to_string(l1),
+              Inputs(c.get()));
+
+    // 第 0 层只剩下与第 1 层不重叠的 [s, t] 时直接移动到第 1 层。
+    // 第 1 层是最底层，默认使用不同的压缩算法，这时需要重写文件
+    c->AddInputDeletions(c->edit());
+    ASSERT_TRUE(Apply(c->edit()).IsOk());
+    c.reset();
+    AddFile(0, "u", "v", 100);
+    AddFile(0, "w", "w", 100);
+    AddFile(0, "x", "y", 100);
+    c.reset(vset_->PickCompaction());
+    ASSERT_EQ(std::to_string(f4) + " |", Inputs(c.get()));
+    ASSERT_FALSE(c->IsTrivialMove());
+    // 各层使用相同的算法时直接移动下一个文件 [u, v]
+    options_.bottommost_compression = kDisableCompressionOption;
+    c.reset(vset_->PickCompaction());
+    ASSERT_EQ(1, c->num_input_files(0));
+    ASSERT_EQ(0, c->num_input_files(1));
+    ASSERT_TRUE(c->IsTrivialMove());
+}
+
+TEST_F(VersionSetTest, PickBySizeAndRotate) {
+    NewDB();
+    ASSERT_TRUE(Reopen().IsOk());
+    // 第 1 层的目标大小是 10000 字节，第 2 层是 100000 字节
+    std::vector<uint64_t> l1;
+    for (char c = 'a'; c <= 'f'; c++) {
+        l1.push_back(AddFile(1, std::string(1, c) + "0", std::string(1, c) + "9",
+                             1000));
+    }
+    const uint64_t l2 = AddFile(2, "c", "d", 1000);
+    ASSERT_FALSE(vset_->NeedsCompaction());
+    for (char c = 'g'; c <= 'k'; c++) {
+        l1.push_back(AddFile(1, std::string(1, c) + "0", std::string(1, c) + "9",
+                             1000));
+    }
+    // 11000 字节超过了目标大小
+    ASSERT_TRUE(vset_->NeedsCompaction());
+
+    // 同一层的压实在 key 空间中轮转，从上一次压实的范围之后开始
+    std::unique_ptr<Compaction> c(vset_->PickCompaction());
+    ASSERT_EQ(1, c->level());
+    ASSERT_EQ(std::to_string(l1[0]) + " |", Inputs(c.get()));
+    c.reset(vset_->PickCompaction());
+    ASSERT_EQ(std::to_string(l1[1]) + " |", Inputs(c.get()));
+    c.reset(vset_->PickCompaction());
+    ASSERT_EQ(std::to_string(l1[2]) + " | " + std::to_string(l2),
+              Inputs(c.get()));
+
+    // 压实的位置保存在描述文件中，重新打开后继续轮转
+    c->AddInputDeletions(c->edit());
+    ASSERT_TRUE(Apply(c->edit()).IsOk());
+    c.reset();
+    ASSERT_TRUE(Reopen().IsOk());
+    ASSERT_EQ(10, vset_->NumLevelFiles(1));
+    ASSERT_EQ(0, vset_->NumLevelFiles(2));
+    AddFile(1, "l0", "l9", 1000);
+    c.reset(vset_->PickCompaction());
+    ASSERT_EQ(1, c->level());
+    ASSERT_EQ(std::to_string(l1[3]) + " |", Inputs(c.get()));
+
+    // 到达这一层的末尾后从头开始
+    for (int i = 0; i < 9; i++) {
+        c.reset(vset_->PickCompaction());
+    }
+    ASSERT_EQ(std::to_string(l1[0]) + " |", Inputs(c.get()));
+}
+
+TEST_F(VersionSetTest, PickHighestScore) {
+    NewDB();
+    ASSERT_TRUE(Reopen().IsOk());
+    // 第 1 层是目标大小的 1.2 倍，第 2 层是 1.5 倍
+    AddFile(1, "a", "b", 12000);
+    const uint64_t l2 = AddFile(2, "m", "n", 150000);
+    AddFile(0, "a", "z", 100);
+    std::unique_ptr<Compaction> c(vset_->PickCompaction());
+    ASSERT_EQ(2, c->level());
+    ASSERT_EQ(std::to_string(l2) + " |", Inputs(c.get()));
+
+    // 第 0 层的文件数量的分数更高时优先压实第 0 层
+    for (int i = 0; i < 7; i++) {
+        AddFile(0, "c", "d", 100);
+    }
+    c.reset(vset_->PickCompaction());
+    ASSERT_EQ(0, c->level());
+}
+
+}  // namespace massdb
@@ -0,0 +1,56 @@
+//
+// Created by Xsakura on 2023/4/29.
+//
+
+#ifndef MASSDB_DB_WRITE_BATCH_INTERNAL_H
+#define MASSDB_DB_WRITE_BATCH_INTERNAL_H
+
+#include "db/dbformat.h"
+#include "massdb/write_batch.h"
+
+namespace massdb {
+
+class MemTable;
+
+// WriteBatchInternal 提供了一些操作 WriteBatch 的静态方法，
+// 这些方法不应该出现在公开的 WriteBatch 接口中
+class WriteBatchInternal {
+public:
+    // 返回 batch 中的更新数量
+    static int Count(const WriteBatch* batch);
+
+    // 设置 batch 中的更新数量
+    static void SetCount(WriteBatch* batch, int n);
+
+    // 返回 batch 起始的序列号
+    static SequenceNumber Sequence(const WriteBatch* batch);
+
+    // 设置 batch 起始的序列号，
+    // batch 中的第 i 个更新使用序列号 seq + i
+    static void SetSequence(WriteBatch* batch, SequenceNumber seq);
+
+    // 返回 batch 的序列化表示，可以直接作为一条日志记录写入
+    static Slice Contents(const WriteBatch* batch) {
+        return Slice(batch->rep_);
+    }
+
+    static size_t ByteSize(const WriteBatch* batch) {
+        return batch->rep_.size();
+    }
+
+    // 用日志记录中的内容替换 batch 的内容
+    static void SetContents(WriteBatch* batch, const Slice& contents);
+
+    // 将 batch 中的更新插入 memtable。
+    // concurrent 为 true 时使用 MemTable::ConcurrentAdd()，
+    // 允许多个线程同时向同一个 memtable 插入
+    static Status InsertInto(const WriteBatch* batch, MemTable* memtable,
+                             bool concurrent = false);
+
+    // 将 src 中的更新追加到 dst 之后
+    static void Append(WriteBatch* dst, const WriteBatch* src);
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_DB_WRITE_BATCH_INTERNAL_H
@@ -0,0 +1,84 @@
+//
+// Created by Xsakura on 2023/5/6.
+//
+
+// Cache 是一个将 key 映射到 value 的接口。
+// 它有内部的同步，可以被多个线程安全地并发访问。
+// 它可能会自动淘汰条目，为新的条目腾出空间。
+// value 对缓存容量有一个指定的开销（charge），
+// 例如一个以字符串长度为开销的缓存。
+//
+// 内置的缓存实现使用最近最少使用（LRU）的淘汰策略。
+// 调用者可以自己实现更复杂的缓存（例如防止扫描污染的策略）
+
+#ifndef MASSDB_INCLUDE_CACHE_H
+#define MASSDB_INCLUDE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "massdb/slice.h"
+
+namespace massdb {
+
+class Cache;
+
+// 创建一个容量固定、使用 LRU 淘汰策略的缓存。
+// 缓存被分成多个分片，每个分片有自己的锁，以减少并发访问时的锁竞争
+Cache* NewLRUCache(size_t capacity);
+
+class Cache {
+public:
+    Cache() = default;
+
+    Cache(const Cache&) = delete;
+    Cache& operator=(const Cache&) = delete;
+
+    // 销毁所有的条目，对每个条目调用插入时传入的 deleter
+    virtual ~Cache();
+
+    // 指向缓存中条目的不透明句柄。
+    // 持有句柄期间条目不会被释放（即使已经被淘汰），
+    // 所以读者可以直接使用条目的 value 而不需要复制
+    struct Handle {};
+
+    // 将 key -> value 插入缓存，并为其分配 charge 的开销。
+    //
+    // 返回对应条目的句柄，调用者不再需要时必须调用 Release(handle)。
+    //
+    // 条目不再需要时，key 和 value 会被传给 deleter
+    virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                           void (*deleter)(const Slice& key, void* value)) = 0;
+
+    // 如果缓存中没有 key 对应的条目，返回 nullptr。
+    //
+    // 否则返回对应条目的句柄，调用者不再需要时必须调用 Release(handle)
+    virtual Handle* Lookup(const Slice& key) = 0;
+
+    // 释放之前 Lookup() 或 Insert() 返回的句柄。
+    // 要求：handle 还没有被释放过
+    virtual void Release(Handle* handle) = 0;
+
+    // 返回句柄对应的 value。
+    // 要求：handle 还没有被释放过
+    virtual void* Value(Handle* handle) = 0;
+
+    // 如果缓存中有 key 对应的条目，将其删除。
+    // 条目会在所有指向它的句柄都被释放之后才真正释放
+    virtual void Erase(const Slice& key) = 0;
+
+    // 返回一个新的 id。共享同一个缓存的多个客户端可以用它划分 key 空间，
+    // 通常在启动时分配一个 id，并将其作为 key 的前缀
+    virtual uint64_t NewId() = 0;
+
+    // 删除所有没有被使用的条目。
+    // 内存受限的应用可以调用此方法来减少内存占用
+    virtual void Prune() {}
+
+    // 返回缓存中所有条目的开销总和的估计值
+    virtual size_t TotalCharge() const = 0;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_CACHE_H
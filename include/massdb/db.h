@@ -0,0 +1,157 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#ifndef MASSDB_INCLUDE_DB_H
+#define MASSDB_INCLUDE_DB_H
+
+#include <string>
+#include <vector>
+
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "massdb/slice.h"
+#include "massdb/spectrum.h"
+#include "massdb/status.h"
+#include "massdb/write_batch.h"
+
+namespace massdb {
+
+// 数据库在某一时刻的一致视图，由 DB::GetSnapshot() 创建。
+// 通过 ReadOptions::snapshot 读取时只能看到创建快照之前完成的写入，
+// 之后的写入不影响读到的结果。快照是不可变的，可以被多个线程同时使用
+class Snapshot {
+protected:
+    virtual ~Snapshot();
+};
+
+// 批量导入大量条目，由 DB::NewBulkLoader() 创建。
+// 条目不经过日志和 MemTable，排序后直接写成 table 文件。
+// 不是线程安全的，同一时刻只能由一个线程使用
+class BulkLoader {
+public:
+    BulkLoader() = default;
+
+    BulkLoader(const BulkLoader&) = delete;
+    BulkLoader& operator=(const BulkLoader&) = delete;
+
+    // 没有调用 Finish() 或者 Finish() 失败时，删除已经写入的所有文件，
+    // 数据库不受影响
+    virtual ~BulkLoader();
+
+    // 添加一个条目。key 可以按任意顺序添加，
+    // 同一个 key 添加多次时保留最后一次添加的 value
+    virtual Status Add(const Slice& key, const Slice& value) = 0;
+
+    // 对所有条目做外部归并排序，写成 table 文件并原子地加入数据库：
+    // 成功时所有条目同时对读者可见，失败时数据库不变。
+    // 导入的条目比调用 Finish() 之前完成的所有写入都新。
+    // 之后不能再调用 Add() 和 Finish()
+    virtual Status Finish() = 0;
+};
+
+// DB 是一个持久化的、有序的 key 到 value 的映射。
+// DB 可以被多个线程同时访问而不需要任何外部同步
+class DB {
+public:
+    // 用指定的名字打开数据库。
+    // 成功时将指向堆上分配的数据库的指针存入 *dbptr 并返回 Ok。
+    // 失败时将 nullptr 存入 *dbptr 并返回一个非 Ok 的状态。
+    // 调用者在不需要数据库时应当 delete *dbptr
+    static Status Open(const Options& options, const std::string& name,
+                       DB** dbptr);
+
+    DB() = default;
+
+    DB(const DB&) = delete;
+    DB& operator=(const DB&) = delete;
+
+    virtual ~DB();
+
+    // 将 "key" 对应的条目设置为 "value"。成功时返回 Ok，失败时返回非 Ok 的状态
+    virtual Status Put(const WriteOptions& options, const Slice& key,
+                       const Slice& value) = 0;
+
+    // 删除 "key" 对应的条目（如果存在的话）。成功时返回 Ok。
+    // 如果 "key" 不存在，这不算是一个错误
+    virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
+
+    // 将 updates 中的更新原子地写入数据库。成功时返回 Ok，失败时返回非 Ok 的状态。
+    // 注意：options.sync 为 true 时会等待数据持久化之后才返回
+    virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
+
+    // 如果数据库中有 "key" 对应的条目，将对应的 value 存入 *value 并返回 Ok。
+    // 如果没有，保持 *value 不变并返回一个 IsNotFound() 为 true 的状态。
+    // 出错时返回其他错误状态
+    virtual Status Get(const ReadOptions& options, const Slice& key,
+                       std::string* value) = 0;
+
+    // 批量查找 keys，结果与对每个 key 调用 Get() 相同：返回的第 i 个状态
+    // 对应 keys[i]，找到时 value 存入 (*values)[i]。
+    // 所有 key 在同一个快照中查找。同一个文件中的 key 一起检查过滤器，
+    // 不在缓存中的数据块合并后并发读取，适合一次查找大量 key
+    virtual std::vector<Status> MultiGet(const ReadOptions& options,
+                                         const std::vector<Slice>& keys,
+                                         std::vector<std::string>* values) = 0;
+
+    // 创建一个批量导入器，成功时存入 *result，
+    // 调用者在不需要时应当删除它，并且必须在删除数据库之前删除。
+    // 用于一次导入大量数据（例如一个新的公共谱图库）：导入的 table 文件
+    // 直接放入不与已有数据重叠的最深的一层，之后不需要压实反复重写。
+    // 导入期间可以正常读写数据库，但如果 Finish() 执行期间有写入落在
+    // 导入的 key 范围中，Finish() 会失败。Finish() 最后安装文件时像一次
+    // 写入一样排队，安装期间其他写入需要等待
+    virtual Status NewBulkLoader(const BulkLoadOptions& options,
+                                 BulkLoader** result) = 0;
+
+    // 返回一个遍历数据库内容的迭代器，迭代器返回的是 user key。
+    // 返回的迭代器初始时无效，调用者必须先调用 Seek 方法。
+    // 迭代器只能看到创建时（或者 options.snapshot）已经完成的写入。
+    // 调用者在不需要迭代器时应当删除它，并且必须在删除数据库之前删除
+    virtual Iterator* NewIterator(const ReadOptions& options) = 0;
+
+    // 返回当前数据库状态的快照。使用这个快照读取时看到的数据不会再变化，
+    // 压实会保留快照能看到的旧版本。创建和读取快照都不会阻塞写入。
+    // 调用者在不需要快照时必须调用 ReleaseSnapshot(result)，
+    // 并且必须在删除数据库之前释放
+    virtual const Snapshot* GetSnapshot() = 0;
+
+    // 释放之前获取的快照，调用之后不能再使用它
+    virtual void ReleaseSnapshot(const Snapshot* snapshot) = 0;
+
+    // 开放式搜索：不限制 precursor m/z，找出与峰列表格式的 query 至少有
+    // min_shared_peaks 个相同的箱的所有谱图，按相同的箱的数量降序存入
+    // *results。min_shared_peaks 等于 query 的箱数时就是求交集。
+    // 分箱方式见 GetPeakBins()，箱宽度为 Options::fragment_index_bin_width。
+    // 候选谱图来自碎片离子索引，结果按 options.snapshot（没有指定时为
+    // 调用时的数据库状态）中的 value 确认。
+    // 没有启用索引时返回 IsNotSupportedError() 为 true 的状态
+    virtual Status SearchFragments(const ReadOptions& options,
+                                   const Slice& query,
+                                   uint32_t min_shared_peaks,
+                                   std::vector<FragmentMatch>* results) = 0;
+
+    // 返回一个迭代器，依次产生 precursor m/z 与 precursor_mz 相差不超过
+    // tolerance_ppm（百万分之一）的所有谱图，key 的格式见 massdb/spectrum.h。
+    // 返回的迭代器已经定位到第一个匹配的谱图，越过范围之后变为无效，
+    // 不会扫描范围之外的数据。
+    // 范围的边界用数据库的比较器比较。
+    // 要求：数据库的比较器对谱图 key 的顺序与 BytewiseComparator() 相同
+    // （例如 BytewiseComparator() 或 SpectrumKeyComparator()），
+    // 谱图的 key 由 EncodeSpectrumKey() 生成
+    virtual Iterator* RangeQuery(const ReadOptions& options,
+                                 double precursor_mz, double tolerance_ppm) = 0;
+
+    // 对 precursor m/z 在 RangeQuery() 范围内的所有谱图用 scorer 打分，
+    // 将分数最高的 top_k 个谱图按分数降序存入 *results。
+    // value 直接在 MemTable 和块缓存中的块上打分，只复制进入结果的 key。
+    // value 不是峰列表格式的条目会被跳过。
+    // scorer 的箱宽度无效时返回 InvalidArgument。要求同 RangeQuery()
+    Status SearchSpectra(const ReadOptions& options, double precursor_mz,
+                         double tolerance_ppm, const SpectrumScorer& scorer,
+                         size_t top_k, std::vector<ScoredSpectrum>* results);
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_DB_H
@@ -0,0 +1,222 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_INCLUDE_ENV_H
+#define MASSDB_INCLUDE_ENV_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class FileLock;
+class RandomAccessFile;
+class SequentialFile;
+class WritableFile;
+
+// Env::MultiRead() 中的一个读取请求
+struct ReadRequest {
+    // 从 file 的 offset 开始读取 n 个字节，scratch 至少有 n 个字节
+    const RandomAccessFile* file;
+    uint64_t offset;
+    size_t n;
+    char* scratch;
+
+    // 读取的结果，含义同 RandomAccessFile::Read()
+    Slice result;
+    Status status;
+};
+
+// Env 是数据库访问操作系统功能（例如文件系统）的接口。
+// 调用者可以在打开数据库时提供自定义的 Env 对象，以实现更细粒度的控制，
+// 例如限制文件系统操作的速率。
+//
+// Env 的所有实现都必须是线程安全的
+class Env {
+public:
+    Env() = default;
+
+    Env(const Env&) = delete;
+    Env& operator=(const Env&) = delete;
+
+    virtual ~Env();
+
+    // 返回适合当前操作系统的默认 Env。
+    // 调用者不应该删除返回的对象，它属于 massdb
+    static Env* Default();
+
+    // 创建一个顺序读取指定文件的对象。
+    // 成功时将新文件存入 *result 并返回 Ok；失败时 *result 为 nullptr。
+    // 文件不存在时返回 NotFound。
+    // 返回的文件同一时刻只能被一个线程访问
+    virtual Status NewSequentialFile(const std::string& fname,
+                                     SequentialFile** result) = 0;
+
+    // 创建一个随机读取指定文件的对象。
+    // 返回的文件可以被多个线程并发访问
+    virtual Status NewRandomAccessFile(const std::string& fname,
+                                       RandomAccessFile** result) = 0;
+
+    // 与 NewRandomAccessFile() 相同，但是通过 mmap 读取文件：
+    // Read() 不使用 scratch，返回的数据直接指向映射的页，
+    // 在文件对象存活期间一直有效。
+    // 文件在打开期间不能被截断。默认实现不映射，等同于 NewRandomAccessFile()
+    virtual Status NewMmapReadableFile(const std::string& fname,
+                                       RandomAccessFile** result);
+
+    // 执行 requests[0, n - 1] 中的所有读取请求，请求可以来自不同的文件。
+    // 返回时所有请求都已经完成，结果存入各自的 result 和 status。
+    // 实现可以同时提交这些请求，以利用存储设备的队列深度。
+    // 默认实现依次调用 RandomAccessFile::Read()
+    virtual void MultiRead(ReadRequest* requests, size_t n);
+
+    // 创建一个写入新文件的对象，同名的旧文件会被删除。
+    // 返回的文件同一时刻只能被一个线程访问
+    virtual Status NewWritableFile(const std::string& fname,
+                                   WritableFile** result) = 0;
+
+    // 如果文件存在返回 true
+    virtual bool FileExists(const std::string& fname) = 0;
+
+    // 将指定目录下的文件名（不含路径）存入 *result
+    virtual Status GetChildren(const std::string& dir,
+                               std::vector<std::string>* result) = 0;
+
+    // 删除指定的文件
+    virtual Status RemoveFile(const std::string& fname) = 0;
+
+    // 创建指定的目录
+    virtual Status CreateDir(const std::string& dirname) = 0;
+
+    // 删除指定的目录
+    virtual Status RemoveDir(const std::string& dirname) = 0;
+
+    // 将文件大小存入 *file_size
+    virtual Status GetFileSize(const std::string& fname,
+                               uint64_t* file_size) = 0;
+
+    // 将 src 重命名为 target
+    virtual Status RenameFile(const std::string& src,
+                              const std::string& target) = 0;
+
+    // 锁定指定的文件，用于防止多个进程同时打开同一个数据库。
+    // 成功时将锁存入 *lock，调用者之后需要调用 UnlockFile(*lock) 释放锁
+    virtual Status LockFile(const std::string& fname, FileLock** lock) = 0;
+
+    // 释放之前 LockFile() 得到的锁
+    virtual Status UnlockFile(FileLock* lock) = 0;
+
+    // 在后台线程中执行一次 (*function)(arg)。
+    // function 可能在一个不确定的线程中执行
+    virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
+
+    // 保证执行 Schedule() 的任务的后台线程至少有 number 个，
+    // 多个任务可以在这些线程中同时执行。线程的数量只会增加不会减少
+    virtual void SetBackgroundThreads(int number) = 0;
+
+    // 启动一个新线程执行 (*function)(arg)，function 返回时线程结束
+    virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
+
+    // 返回从某个固定时间点开始的微秒数，只适合计算时间差
+    virtual uint64_t NowMicros() = 0;
+
+    // 睡眠指定的微秒数
+    virtual void SleepForMicroseconds(int micros) = 0;
+};
+
+// 顺序读取的文件
+class SequentialFile {
+public:
+    SequentialFile() = default;
+
+    SequentialFile(const SequentialFile&) = delete;
+    SequentialFile& operator=(const SequentialFile&) = delete;
+
+    virtual ~SequentialFile();
+
+    // 从文件中最多读取 n 个字节。"scratch[0..n-1]" 可能会被写入。
+    // "*result" 指向读取到的数据（可能指向 scratch），
+    // 读到文件末尾时 result 的长度小于 n。
+    // 要求：外部同步
+    virtual Status Read(size_t n, Slice* result, char* scratch) = 0;
+
+    // 跳过 n 个字节。要求：外部同步
+    virtual Status Skip(uint64_t n) = 0;
+};
+
+// 随机读取的文件
+class RandomAccessFile {
+public:
+    RandomAccessFile() = default;
+
+    RandomAccessFile(const RandomAccessFile&) = delete;
+    RandomAccessFile& operator=(const RandomAccessFile&) = delete;
+
+    virtual ~RandomAccessFile();
+
+    // 之后读取文件的方式，实现可以据此调整预读等策略
+    enum AccessPattern { kNormal, kRandom, kSequential, kWillNeed, kDontNeed };
+
+    // 从 offset 开始最多读取 n 个字节。"scratch[0..n-1]" 可能会被写入。
+    // "*result" 指向读取到的数据（可能指向 scratch）。
+    // 多个线程可以同时调用
+    virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                        char* scratch) const = 0;
+
+    // 提示之后的访问模式，只影响性能。默认实现忽略提示
+    virtual void Hint(AccessPattern pattern) {}
+
+    // 与 Hint() 相同，但只作用于 [offset, offset + n)，n 为 0 表示直到
+    // 文件末尾。实现可能把提示扩大到整个文件。默认实现忽略提示
+    virtual void HintRange(AccessPattern pattern, uint64_t offset,
+                           uint64_t n) {}
+};
+
+// 顺序写入的文件。实现需要提供缓冲，因为调用者可能每次只追加很少的数据
+class WritableFile {
+public:
+    WritableFile() = default;
+
+    WritableFile(const WritableFile&) = delete;
+    WritableFile& operator=(const WritableFile&) = delete;
+
+    virtual ~WritableFile();
+
+    virtual Status Append(const Slice& data) = 0;
+    virtual Status Close() = 0;
+    // 将缓冲区中的数据交给操作系统
+    virtual Status Flush() = 0;
+    // 将数据持久化到存储设备上
+    virtual Status Sync() = 0;
+};
+
+// 文件锁
+class FileLock {
+public:
+    FileLock() = default;
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+    virtual ~FileLock();
+};
+
+// 将 data 写入指定的文件
+Status WriteStringToFile(Env* env, const Slice& data,
+                         const std::string& fname);
+
+// 将 data 写入指定的文件并持久化
+Status WriteStringToFileSync(Env* env, const Slice& data,
+                             const std::string& fname);
+
+// 将指定文件的内容读到 *data 中
+Status ReadFileToString(Env* env, const std::string& fname, std::string* data);
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_ENV_H
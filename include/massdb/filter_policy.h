@@ -0,0 +1,66 @@
+//
+// Created by Xsakura on 2023/5/13.
+//
+
+#ifndef MASSDB_INCLUDE_FILTER_POLICY_H
+#define MASSDB_INCLUDE_FILTER_POLICY_H
+
+#include <string>
+
+namespace massdb {
+
+class Slice;
+
+// 数据库可以为每个 table 配置一个自定义的 FilterPolicy 对象。
+// 该对象负责根据一组 key 创建一个很小的过滤器，存储在 table 中。
+// 查找时先用过滤器判断 key 是否可能存在，从而避免读取不包含该 key 的数据块。
+// 对于大量查找不存在的 key（例如不存在的谱图 ID）的负载，可以显著减少磁盘读取
+class FilterPolicy {
+public:
+    virtual ~FilterPolicy();
+
+    // 返回过滤器策略的名字。
+    // 如果过滤器的编码方式发生了不兼容的变化，必须修改名字，
+    // 否则旧的过滤器可能会被错误地传给新的 KeyMayMatch()
+    virtual const char* Name() const = 0;
+
+    // keys[0,n-1] 为一组 key（可能有重复），按照 comparator 有序。
+    // 将为这些 key 构造的过滤器追加到 *dst 中。
+    //
+    // 注意：不要修改 *dst 中已有的内容，只能追加
+    virtual void CreateFilter(const Slice* keys, int n,
+                              std::string* dst) const = 0;
+
+    // filter 为 CreateFilter() 生成的过滤器。
+    // 如果 key 在创建过滤器的 key 列表中，必须返回 true；
+    // 否则可以返回 true 或 false，但应该尽量以高概率返回 false
+    virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+    // 依次判断 keys[0, n - 1] 是否可能在 filter 中，结果存入 results[i]，
+    // 含义同 KeyMayMatch()。实现可以先算出所有 key 要访问的位置并预取，
+    // 让多个缓存未命中互相重叠。默认实现逐个调用 KeyMayMatch()
+    virtual void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                              bool* results) const;
+};
+
+// 返回一个经典 Bloom 过滤器策略（与 LevelDB 相同的编码），
+// 每个 key 大约使用 bits_per_key 个比特。10 是一个不错的值，
+// 误判率约为 1%。每次探测的比特分散在整个过滤器中，
+// 一个 key 需要访问多达 k 条不同的缓存行。
+//
+// 调用者必须在所有使用该策略的数据库关闭之后删除返回的对象
+const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
+
+// 返回一个按缓存行分块的 Bloom 过滤器策略。
+// 每个 key 只映射到一个 64 字节（512 比特）的块中，所有探测都落在
+// 这一条缓存行内，查找只会产生一次缓存未命中。
+// 在支持 AVX2 的 CPU 上探测会使用向量指令一次检查所有比特。
+// 相同的 bits_per_key 下误判率略高于经典的 Bloom 过滤器，
+// 但查找速度明显更快。
+//
+// 调用者必须在所有使用该策略的数据库关闭之后删除返回的对象
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key);
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_FILTER_POLICY_H
@@ -0,0 +1,77 @@
+//
+// Created by Xsakura on 2023/6/25.
+//
+
+#ifndef MASSDB_INCLUDE_IMPORTER_H
+#define MASSDB_INCLUDE_IMPORTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "massdb/options.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class DB;
+
+// 导入的谱图文件格式
+enum SpectrumFileFormat {
+    kAutoDetectFormat,  // 按文件的扩展名（.mgf 或 .mzML，不区分大小写）判断
+    kMgfFormat,         // Mascot Generic Format
+    kMzMLFormat,        // HUPO-PSI mzML
+};
+
+// 控制导入（ImportSpectra()）的选项
+struct ImportOptions {
+    SpectrumFileFormat format = kAutoDetectFormat;
+
+    // 解析线程数。读取文件和写入数据库各自另有一个线程
+    int parse_threads = 4;
+
+    // 每次从文件读取的字节数。读到的数据在谱图的边界处切分成块，
+    // 一块中的谱图由一个解析线程解析，写入数据库时作为一个 WriteBatch
+    size_t chunk_size = 4 * 1024 * 1024;
+
+    // 已经读取、还没有写入数据库的块的数量上限。
+    // 写入跟不上时读取和解析会暂停，内存占用大约为
+    // max_pending_chunks * chunk_size 的两到三倍
+    int max_pending_chunks = 16;
+
+    // 谱图 key 中扫描号的高 32 位，导入多个文件时用于区分
+    // 扫描号相同的谱图。文件中的扫描号只使用低 32 位
+    uint32_t file_id = 0;
+
+    // 写入数据库使用的选项
+    WriteOptions write_options;
+
+    // 为 true 时通过 DB::NewBulkLoader() 导入，不经过日志和 MemTable，
+    // 文件中的谱图在导入结束时一起可见
+    bool bulk_load = false;
+    BulkLoadOptions bulk_load_options;
+};
+
+// 导入的统计信息
+struct ImportStats {
+    uint64_t bytes_read = 0;     // 从文件读取的字节数
+    uint64_t spectra = 0;        // 写入数据库的谱图数
+    uint64_t skipped = 0;        // 无法解析或者不是二级谱的谱图数
+    uint64_t bytes_written = 0;  // 写入的 key 和 value 的总字节数
+};
+
+// 将谱图文件 fname 中的二级谱导入 db。
+// key 由 EncodeSpectrumKey() 根据 precursor m/z、电荷和扫描号生成，
+// value 是 massdb/spectrum.h 中的峰列表格式。
+// 读取文件、解析和写入数据库以流水线的方式并行执行，
+// 同一个文件中 key 相同的谱图保留后出现的一个。
+// 没有 precursor m/z 的谱图、mzML 中的一级谱和无法解码的数据数组会被跳过，
+// 计入 stats->skipped。
+// 出错时已经写入的谱图不会回滚（bulk_load 为 true 时不会写入任何谱图）。
+// stats 可以为 nullptr
+Status ImportSpectra(DB* db, const std::string& fname,
+                     const ImportOptions& options, ImportStats* stats);
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_IMPORTER_H
@@ -0,0 +1,87 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#ifndef MASSDB_INCLUDE_ITERATOR_H
+#define MASSDB_INCLUDE_ITERATOR_H
+
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+// 迭代器从某个数据源中按顺序产生一系列 key/value 对。
+//
+// 多个线程可以同时调用一个迭代器的 const 方法，
+// 但只要有线程调用非 const 方法，就需要外部同步。
+class Iterator {
+public:
+    Iterator();
+
+    Iterator(const Iterator&) = delete;
+    Iterator& operator=(const Iterator&) = delete;
+
+    virtual ~Iterator();
+
+    // 迭代器要么指向一个 key/value 对，要么无效。
+    // 当且仅当迭代器有效时返回 true
+    virtual bool Valid() const = 0;
+
+    // 定位到数据源中的第一个 key。调用后当且仅当数据源非空时 Valid() 为 true
+    virtual void SeekToFirst() = 0;
+
+    // 定位到数据源中的最后一个 key。调用后当且仅当数据源非空时 Valid() 为 true
+    virtual void SeekToLast() = 0;
+
+    // 定位到第一个大于等于 target 的 key。
+    // 调用后当且仅当存在这样的 key 时 Valid() 为 true
+    virtual void Seek(const Slice& target) = 0;
+
+    // 移动到下一个条目。要求：Valid()
+    virtual void Next() = 0;
+
+    // 移动到上一个条目。要求：Valid()
+    virtual void Prev() = 0;
+
+    // 返回当前条目的 key。返回的 slice 只在迭代器下次被修改前有效。
+    // 要求：Valid()
+    virtual Slice key() const = 0;
+
+    // 返回当前条目的 value。返回的 slice 只在迭代器下次被修改前有效。
+    // 要求：Valid()
+    virtual Slice value() const = 0;
+
+    // 如果发生了错误则返回该错误，否则返回 Ok
+    virtual Status status() const = 0;
+
+    // 调用者可以注册一个清理函数，迭代器析构时会调用 function(arg1, arg2)。
+    // 通常用于释放迭代器引用的资源（例如 MemTable 的引用计数）
+    using CleanupFunction = void (*)(void* arg1, void* arg2);
+    void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
+
+private:
+    // 清理函数保存在一个单链表中，链表头直接内联在迭代器里
+    struct CleanupNode {
+        bool IsEmpty() const { return function == nullptr; }
+        void Run() {
+            assert(function != nullptr);
+            (*function)(arg1, arg2);
+        }
+
+        CleanupFunction function;
+        void* arg1;
+        void* arg2;
+        CleanupNode* next;
+    };
+    CleanupNode cleanup_head_;
+};
+
+// 返回一个空的迭代器
+Iterator* NewEmptyIterator();
+
+// 返回一个带有指定错误状态的空迭代器
+Iterator* NewErrorIterator(const Status& status);
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_ITERATOR_H
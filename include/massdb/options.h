@@ -6,16 +6,37 @@
 #define MASSDB_INCLUDE_OPTIONS_H
 
 #include <cstddef>
+#include <vector>
 
 namespace massdb {
 
+class Cache;
+class Comparator;
+class Env;
+class FilterPolicy;
+class Snapshot;
+
 // DB 内容存储在一组块中，每个块都包含一系列键值对。
 // 每个块在存储到文件之前可能会被压缩。
 // 以下枚举类描述用于压缩块的压缩方法
+//
+// 除 kNoCompression 之外的算法需要在编译时找到对应的库，
+// 选择了没有编译进来的算法时块会以不压缩的形式写入
 enum CompressionType {
     // 注意：不要更改现有条目的值，因为这些值是磁盘上持久格式的一部分。
-    kNoCompression = 0x0,     // 不压缩
-    kSnappyCompression = 0x1  // 使用 Snappy 压缩算法
+    kNoCompression = 0x0,      // 不压缩
+    kSnappyCompression = 0x1,  // 使用 Snappy 压缩算法
+    kZlibCompression = 0x2,    // 使用 zlib（deflate）压缩算法
+    kLZ4Compression = 0x3,     // 使用 LZ4 压缩算法
+    kZstdCompression = 0x4,    // 使用 Zstandard 压缩算法
+
+    // 针对质谱峰列表的无损压缩，不依赖外部库。
+    // 符合 massdb/spectrum.h 中格式的 value 会对 m/z 做差分编码、
+    // 对强度做 Gorilla 风格的 XOR 编码，其余内容原样保存
+    kSpectrumCompression = 0x5,
+
+    // 不会写入磁盘，只用于 Options::bottommost_compression 表示不单独设置
+    kDisableCompressionOption = 0xff
 };
 
 // 用于控制数据库行为的选项（传递给 DB:Open()）
@@ -26,6 +47,13 @@ struct Options {
     // -------------------
     // 影响数据库行为的参数
 
+    // 用于定义表中 key 顺序的比较器。
+    // 默认值：使用字典序逐字节比较的比较器
+    //
+    // 要求：客户端必须保证此处提供的比较器与之前打开同一个数据库时
+    // 使用的比较器具有相同的名字并且对 key 的排序结果完全相同。
+    const Comparator* comparator;
+
     // If true，缺失数据库的话将会创建一个新的数据库
     bool create_if_missing = false;
 
@@ -40,6 +68,10 @@ struct Options {
     // paranoid 偏执狂
     bool paranoid_checks = false;
 
+    // 用于和操作系统交互，例如读写文件、调度后台任务。
+    // 默认值：Env::Default()
+    Env* env;
+
     // -------------------
     // 影响数据库性能的参数
 
@@ -61,6 +93,24 @@ struct Options {
     // 这样做的目的是减少磁盘写入操作的次数，提高写入操作的效率。
     size_t write_buffer_size = 4 * 1024 * 1024;
 
+    // If true，允许多个写线程同时向 MemTable 中插入数据。
+    // 序列号的分配仍然是串行的，但插入 SkipList 的过程可以在多个核上并行，
+    // 读操作只会看到序列号连续、已经全部插入完成的写入。
+    bool allow_concurrent_memtable_write = true;
+
+    // MemTable 的内存分配器每次向系统申请的内存块大小。
+    // 为 0 时取 write_buffer_size 的 1/8，并限制在 [4KB, 8MB] 之间。
+    // 较大的块（例如 1MB ~ 8MB）可以减少 malloc 的次数。
+    size_t arena_block_size = 0;
+
+    // 不为 0 时，MemTable 的内存块通过 mmap(MAP_HUGETLB) 从大页中分配，
+    // 此参数为大页的大小（通常为 2MB）。
+    // 系统没有预留大页时会退化为普通内存并通过 madvise(MADV_HUGEPAGE)
+    // 建议内核使用透明大页。
+    // 使用大页可以减少 SkipList 遍历时的 TLB 未命中。
+    // 建议将 arena_block_size 设置为大页大小的整数倍。
+    size_t memtable_huge_page_size = 0;
+
     // DB 能打开文件的数量
     // 在运行期间可能会打开许多文件，例如数据文件、日志文件、元数据文件等等。
     // max_open_files 就是用来限制数据库可以同时打开的文件数目，
@@ -69,11 +119,21 @@ struct Options {
     // 以避免过多文件被频繁地打开和关闭，从而提高读写操作的性能。
     int max_open_files = 1000;
 
+    // 为 true 时通过 mmap 读取 table 文件：未压缩的块直接使用映射的页，
+    // 不再复制到堆上，也不放入块缓存。映射随文件一起由 table 缓存管理，
+    // 数量同样受 max_open_files 限制。
+    // 适合以读为主、数据大多在页缓存中的场景
+    bool use_mmap_reads = false;
+
     // 控制 blocks（用户的数据存储在一组 blocks 中，一个 block
     // 是最小的读取单元） 如果非空，使用指定的 block 缓存
-    // 如果为空，数据库会默认创建并使用一个 8MB 的内部缓存
+    // 如果为空，不缓存块，每次读取都从文件（通常是操作系统的页缓存）中读取。
+    // 缓存放不下经常访问的块时，每次读取都要插入并淘汰，比不缓存更慢，
+    // 所以容量应当按照需要缓存的数据量设置，例如索引和常用的谱图所在的块
     //
-    //    Cache* block_cache = nullptr;
+    // 缓存中的块按解压后的字节数计算开销。
+    // 多个数据库可以共享同一个缓存，调用者负责在所有数据库关闭后删除它
+    Cache* block_cache = nullptr;
 
     // 每个块中打包的用户数据的大概大小。
     // 请注意，此处指定的块大小对应于未压缩的数据。
@@ -93,21 +153,112 @@ struct Options {
     // 另一个增加此参数的原因可能是当您首次填充大型数据库时。
     size_t max_file_size = 2 * 1024 * 1024;
 
+    // -------------------
+    // 控制压实（compaction）的参数
+    //
+    // 数据库按层组织 table 文件：MemTable 写入第 0 层，第 0 层的文件之间
+    // key 的范围可能重叠；第 1 层及更深的层中同一层的文件互不重叠，
+    // 每一层的容量是上一层的若干倍。压实把一层中的文件与下一层中范围重叠的
+    // 文件合并，输出到下一层，从而限制读取时需要查找的文件数量。
+
+    // 第 0 层的文件数量达到这个值时开始压实第 0 层
+    int level0_file_num_compaction_trigger = 4;
+
+    // 第 0 层的文件数量达到这个值时，每次写入延迟 1ms，
+    // 让后台的压实跟上写入的速度
+    int level0_slowdown_writes_trigger = 8;
+
+    // 第 0 层的文件数量达到这个值时停止写入，直到压实完成
+    int level0_stop_writes_trigger = 12;
+
+    // 第 1 层的目标大小（字节）。
+    // 第 L 层（L > 1）的目标大小为
+    // max_bytes_for_level_base * max_bytes_for_level_multiplier^(L-1)，
+    // 一层的总大小超过目标大小时开始压实这一层
+    size_t max_bytes_for_level_base = 10 * 1024 * 1024;
+
+    // 相邻两层目标大小的倍数
+    double max_bytes_for_level_multiplier = 10;
+
+    // 后台线程池中的线程数量，用于将 MemTable 写入磁盘和执行压实。
+    // 写入 MemTable 和压实作为不同的任务调度，
+    // 至少有 2 个线程时写入 MemTable 不会排在耗时的压实之后。
+    // 线程池属于 Env，由使用同一个 Env 的所有数据库共享，
+    // 线程数量取所有数据库中的最大值
+    int max_background_jobs = 2;
+
+    // 一次压实最多拆分成多少个子压实。
+    // 大于 1 时，根据输入文件的索引块把压实的 key 范围划分成互不重叠的
+    // 若干段，由压实线程和 Env 的后台线程池并行合并，
+    // 同时合并的线程不超过 max_background_jobs 个，所有输出在完成后一起应用。
+    // 实际的数量还受输入的大小限制，每个子压实至少处理约
+    // max_file_size 字节的输入
+    int max_subcompactions = 1;
+
     // 使用指定的压缩算法压缩块。此参数可以动态更改。
     //
-    // 默认值：kSnappyCompression，提供轻量级但快速的压缩。
+    // 默认值：kLZ4Compression，提供轻量级但快速的压缩。
+    // 这些速度显着快于大多数持久存储速度，通常不值得切换到 kNoCompression。
+    // 即使输入数据不可压缩，也会高效检测到这一点，并切换到未压缩模式。
     //
-    // 在 Intel(R) Core(TM)2 2.4GHz上，kSnappyCompression 的典型速度为：
-    //      ~200-500MB/s 压缩
-    //      ~400-800MB/s 解压缩
+    // 打开数据库时，没有编译进来的算法会被替换成特性相近的可用算法，
+    // 快速的算法都不可用时不压缩，见 SupportedCompression()
+    CompressionType compression = kLZ4Compression;
+
+    // 如果非空，第 i 层的 table 使用 compression_per_level[i] 压缩，
+    // 超出数组长度的层使用最后一项，此时会忽略 compression。
+    // 例如 {kNoCompression, kLZ4Compression, kZstdCompression}
+    // 表示 L0 不压缩，L1 使用 LZ4，L2 及更深的层使用 Zstd。
     //
-    // 注意：这些速度显着快于大多数持久存储速度，通常不值得切换到 kNoCompression
-    // 即使输入数据不可压缩，kSnappyCompression 也将高效检测到这一点，
-    // 并切换到未压缩模式。
-    //     CompressionType compression = kSnappyCompression;
+    // 上层的数据很快会被合并到下层，应该选择速度快的算法
+    std::vector<CompressionType> compression_per_level;
+
+    // 最底层的 table 使用的压缩算法，优先于上面两个参数。
+    // 最底层保存了绝大部分数据并且很少被重写，适合使用压缩率高的算法。
+    // Zstd 不可用时依次替换成 zlib、LZ4、Snappy。
+    // 设为 kDisableCompressionOption 时与其他层的选择方式相同
+    //
+    // 默认值：kZstdCompression
+    CompressionType bottommost_compression = kZstdCompression;
+
+    // 传给压缩算法的压缩级别，目前对 zlib 和 Zstd 有效。
+    // 为 0 时使用算法的默认级别
+    int compression_level = 0;
+
+    // 压缩节省的空间少于原始大小的这个比例时，块以不压缩的形式存储，
+    // 避免读取时为很小的收益付出解压的开销。取值范围 [0, 1)
+    double compression_min_savings = 0.125;
 
     // 如果非空，则使用指定的过滤器策略以减少磁盘读取。
-    //    const FilterPolicy* filter_policy = nullptr;
+    // 每个 table 会为其中所有的 key 构建一个过滤器，
+    // 点查时先检查过滤器，不存在的 key 通常不需要读取任何数据块。
+    // 许多应用可以从这里传入 NewBlockedBloomFilterPolicy() 中获益。
+    //
+    // 调用者负责在数据库关闭之后删除它
+    const FilterPolicy* filter_policy = nullptr;
+
+    // 碎片离子索引的箱宽度（m/z）。
+    // 大于 0 时，写入 MemTable 和压实生成 table 文件的同时，为其中峰列表格式
+    // 的 value 生成一个碎片离子倒排索引文件，把每个箱映射到包含它的谱图，
+    // DB::SearchFragments() 不需要扫描整个数据库就能找到候选谱图。
+    // 启用之前生成的 table 文件没有索引，查询时会扫描它们，直到被压实重写。
+    // 默认值 0 表示不生成索引
+    double fragment_index_bin_width = 0;
+
+    // 键值分离：长度不小于 min_blob_size 的 value 在写入 table 文件时
+    // 被移到只追加的 blob 文件中，table 中只保存 (文件, 偏移, 长度) 的引用。
+    // 压实只需要重写较小的 key 和引用，不再重写很大的 value；
+    // 点查比不分离时多一次 pread。
+    // 默认值 0 表示不分离
+    size_t min_blob_size = 0;
+
+    // blob 文件中已经失效的数据（value 被覆盖或者删除）达到这个比例时，
+    // 压实遇到指向这个文件的引用会把仍然有效的 value 搬到新的 blob 文件中，
+    // 所有引用都被搬走或者删除之后旧文件被删除。
+    // 没有其他压实时，后台会原地重写引用的最旧的 blob 文件达到这个比例的
+    // table 文件（第 0 层除外），不需要等到写入触发的压实经过这些引用。
+    // 失效数据的统计由压实维护，记录在描述文件中。大于 1 时不回收
+    double blob_gc_garbage_ratio = 0.5;
 };
 
 // 控制读操作的选项
@@ -117,7 +268,14 @@ struct ReadOptions {
 
     // 在此迭代中读取的数据是否应缓存在内存中？
     // 调用者可能希望将此字段设置为 false 以进行批量扫描。
+    // 为 false 时仍然会使用缓存中已有的块，但不会把新读取的块放入缓存，
+    // 所以批量扫描不会淘汰缓存中的热点块。
     bool fill_cache = true;
+
+    // 不为 nullptr 时，按这个快照读取（快照必须属于被读取的数据库，
+    // 并且还没有被释放）。
+    // 为 nullptr 时，使用开始读取时数据库状态的隐式快照。
+    const Snapshot* snapshot = nullptr;
 };
 
 // 控制写操作的选项
@@ -138,6 +296,18 @@ struct WriteOptions {
     bool sync = false;
 };
 
+// 控制批量导入（DB::NewBulkLoader()）的选项
+struct BulkLoadOptions {
+    // 导入使用的内存上限（字节）。
+    // 添加的条目先放入内存中的缓冲区，写满后排序并写入临时文件；
+    // 正在填充和正在排序的缓冲区，以及归并临时文件时的读缓冲加起来
+    // 不超过这个值。越大临时文件越少，归并越快
+    size_t memory_budget = 256 * 1024 * 1024;
+
+    // 并行排序缓冲区和写入 table 文件的线程数
+    int max_threads = 4;
+};
+
 }  // namespace massdb
 
 #endif  // MASSDB_INCLUDE_OPTIONS_H
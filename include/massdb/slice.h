@@ -15,10 +15,6 @@ class Slice {
 public:
     // 创建一个空的 slice
     Slice() : data_(""), size_(0) {}
-    ~Slice() {
-        delete[] data_;
-        size_ = 0;
-    }
 
     Slice(const char* str, size_t n) : data_(str), size_(n) {}
 
@@ -26,6 +22,8 @@ public:
 
     Slice(const char* str) : data_(str), size_(strlen(str)) {}
 
+    // Slice 只是一个视图，不拥有 data_ 指向的内存，
+    // 调用者需要保证在 Slice 使用期间底层数据一直有效。
     // 允许同类型之间的复制
     Slice(const Slice&) = default;
     Slice& operator=(const Slice&) = default;
@@ -0,0 +1,139 @@
+//
+// Created by Xsakura on 2023/5/27.
+//
+
+#ifndef MASSDB_INCLUDE_SPECTRUM_H
+#define MASSDB_INCLUDE_SPECTRUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "massdb/slice.h"
+
+namespace massdb {
+
+class Comparator;
+
+// 质谱峰列表 value 的编码格式（小端序）：
+//    num_peaks : fixed32
+//    mz        : double[num_peaks]   // 按升序排列
+//    intensity : float[num_peaks]
+//
+// m/z 和强度分别连续存放，便于按列计算相似度。
+// 使用 kSpectrumCompression 时，符合这个格式的 value 会被专门压缩
+static const size_t kPeakListHeaderSize = 4;
+
+// 返回 num_peaks 个峰编码之后的长度
+inline size_t PeakListEncodedLength(size_t num_peaks) {
+    return kPeakListHeaderSize + num_peaks * (sizeof(double) + sizeof(float));
+}
+
+// 将 n 个峰编码之后追加到 *dst 中。要求：mz 按升序排列
+void EncodePeakList(const double* mz, const float* intensity, size_t n,
+                    std::string* dst);
+
+// 解析 value 中的峰列表。value 不符合上面的格式时返回 false
+bool DecodePeakList(const Slice& value, std::vector<double>* mz,
+                    std::vector<float>* intensity);
+
+// 如果 value 的长度与头部记录的峰数量一致，返回 true 并将峰数量存入 *n
+bool GetPeakListSize(const Slice& value, uint32_t* n);
+
+// 谱图 key 的编码格式，按字节比较的顺序与
+// (precursor m/z, 电荷, 扫描号) 的数值顺序一致：
+//    precursor_mz : 8 字节   // double 的位模式变换后按大端序存放
+//    charge       : 1 字节   // int8 的符号位取反
+//    scan_id      : 8 字节   // 大端序
+//
+// 使用 BytewiseComparator() 时，precursor m/z 相近的谱图在数据库中相邻，
+// 按 precursor m/z 的范围查询只需要一次 Seek
+static const size_t kPrecursorMzSize = 8;
+static const size_t kSpectrumKeySize = kPrecursorMzSize + 1 + 8;
+
+// 返回谱图 key 专用的比较器。
+// 顺序与 BytewiseComparator() 完全相同，但是把定宽的谱图 key 当作整数比较，
+// MemTable 和 table 的查找、压实的归并都会使用内联的比较函数。
+// 名字与 BytewiseComparator() 不同，已有的数据库不能换用这个比较器打开
+const Comparator* SpectrumKeyComparator();
+
+// 将 precursor m/z 编码为 kPrecursorMzSize 字节后追加到 *dst 中。
+// 这是所有 precursor m/z 相同的谱图 key 的公共前缀
+void EncodePrecursorMz(double precursor_mz, std::string* dst);
+
+// 将谱图 key 追加到 *dst 中。要求：-128 <= charge <= 127
+void EncodeSpectrumKey(double precursor_mz, int charge, uint64_t scan_id,
+                       std::string* dst);
+
+// 解析谱图 key。key 的长度不是 kSpectrumKeySize 时返回 false
+bool DecodeSpectrumKey(const Slice& key, double* precursor_mz, int* charge,
+                       uint64_t* scan_id);
+
+// 计算 precursor m/z 在 [mz - d, mz + d] 中的谱图 key 的范围，
+// 其中 d = mz * tolerance_ppm / 10^6。
+// 范围内的 key 满足 *lower <= key < *upper；
+// *upper 为空表示没有上界
+void PrecursorMzRange(double mz, double tolerance_ppm, std::string* lower,
+                      std::string* upper);
+
+// 按 m/z 分箱（bin）的谱图相似度打分。
+// 峰按 trunc(mz / bin_width) 分箱，同一个箱中的强度相加，
+// 两个谱图的相似度是分箱后的强度向量的点积或者余弦相似度。
+//
+// 打分直接读取峰列表格式的 value，不复制也不解码成 vector；
+// 在 x86-64 上按 CPU 支持的指令集使用 AVX-512 或 AVX2 计算，
+// 否则使用标量实现。线程安全
+class SpectrumScorer {
+public:
+    enum Similarity {
+        kDotProduct,  // 分箱后的点积
+        kCosine,      // 点积除以两个向量的长度，范围为 [0, 1]
+    };
+
+    // query 是峰列表格式的查询谱图，bin_width 应该是正的有限值。
+    // query 不符合峰列表格式时按空谱图处理，所有打分都为 0。
+    // bin_width 无效时 valid() 返回 false，所有打分也都为 0
+    SpectrumScorer(const Slice& query, double bin_width,
+                   Similarity similarity = kCosine);
+
+    // 构造时的 bin_width 有效时返回 true
+    bool valid() const { return inv_bin_width_ > 0; }
+
+    // 计算峰列表格式的 value 与查询谱图的相似度，存入 *score。
+    // value 不符合峰列表格式时返回 false
+    bool Score(const Slice& value, float* score) const;
+
+private:
+    const double inv_bin_width_;  // bin_width 无效时为 0
+    const Similarity similarity_;
+    // 查询谱图分箱后的强度。
+    // 箱的跨度不大时 query_[i] 是第 base_bin_ + i 个箱，sparse_bins_ 为空；
+    // 否则 query_[i] 是第 sparse_bins_[i] 个箱，sparse_bins_ 升序排列
+    std::vector<float> query_;
+    std::vector<int32_t> sparse_bins_;
+    int32_t base_bin_;
+    float query_norm_;  // 查询向量的长度
+};
+
+// 打分结果
+struct ScoredSpectrum {
+    std::string key;
+    float score;
+};
+
+// 将峰列表格式的 value 中的峰按 trunc(mz / bin_width) 分箱，
+// 分箱方式与 SpectrumScorer 相同。出现过的箱按升序存入 *bins，不重复。
+// value 不符合峰列表格式，或者 bin_width 不是正的有限值时返回 false
+bool GetPeakBins(const Slice& value, double bin_width,
+                 std::vector<int32_t>* bins);
+
+// 碎片离子索引的查询结果：与查询谱图相同的箱的数量
+struct FragmentMatch {
+    std::string key;
+    uint32_t shared_peaks;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_SPECTRUM_H
@@ -0,0 +1,95 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_INCLUDE_TABLE_H
+#define MASSDB_INCLUDE_TABLE_H
+
+#include <cstdint>
+
+#include "massdb/iterator.h"
+
+namespace massdb {
+
+class Block;
+class BlockHandle;
+struct BlockContents;
+class Footer;
+struct Options;
+class RandomAccessFile;
+struct ReadOptions;
+
+// Table 是一个从字符串到字符串的有序映射。
+// Table 是不可变的、持久化的。
+// 多个线程可以同时访问 Table 而不需要外部同步
+class Table {
+public:
+    // 打开存放在 file[0, file_size) 中的 table，
+    // 读取必要的元数据以便之后从中查找数据。
+    //
+    // 成功时返回 Ok 并将新打开的 table 存入 *table，调用者不需要时应当删除它。
+    // 失败时返回非 Ok 的状态并将 nullptr 存入 *table。
+    //
+    // 调用者必须保证 file 在返回的 table 存活期间一直有效。
+    // table 不再使用时调用者负责删除 file
+    static Status Open(const Options& options, RandomAccessFile* file,
+                       uint64_t file_size, Table** table);
+
+    Table(const Table&) = delete;
+    Table& operator=(const Table&) = delete;
+
+    ~Table();
+
+    // 返回一个遍历 table 内容的迭代器。
+    // 返回的迭代器初始时无效，调用者必须先调用 Seek 方法
+    Iterator* NewIterator(const ReadOptions&) const;
+
+    // 返回 key 的数据在文件中大致的起始偏移量。
+    // 如果 key 不存在，返回它将会出现的位置
+    uint64_t ApproximateOffsetOf(const Slice& key) const;
+
+private:
+    friend class TableCache;
+    struct Rep;
+
+    static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+
+    // 返回数据块和过滤器块之后的位置，再往后是元数据索引块、索引块和 footer
+    uint64_t DataEndOffset() const;
+
+    // 返回遍历索引块的迭代器。key 是每个数据块的分隔 key：
+    // 不小于块中最大的 key，并且小于下一个块中最小的 key
+    Iterator* NewIndexIterator() const;
+
+    explicit Table(Rep* rep) : rep_(rep) {}
+
+    // Seek(key) 找到一个条目后调用 (*handle_result)(arg, ...)。
+    // 如果过滤器判断 key 不存在则不会调用
+    Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
+                       void (*handle_result)(void* arg, const Slice& k,
+                                             const Slice& v));
+
+    // MultiGet 使用。用过滤器批量排除 keys[0, n - 1]（按升序排列）中
+    // 不存在的 key，并在索引块中找到其余 key 所在的数据块：
+    // 可能存在的 key 的 may_match[i] 为 true，handles[i] 为数据块的位置
+    Status PrepareMultiGet(const Slice* keys, size_t n, bool* may_match,
+                           BlockHandle* handles) const;
+
+    // handle 指向的数据块在块缓存中时返回遍历它的迭代器，否则返回 nullptr
+    Iterator* CachedBlockIterator(const BlockHandle& handle) const;
+
+    // 返回遍历 contents 的迭代器，contents 是 handle 指向的数据块的内容，
+    // 由迭代器接管。可以缓存时按 options.fill_cache 放入块缓存
+    Iterator* NewBlockIterator(const ReadOptions& options,
+                               const BlockHandle& handle,
+                               const BlockContents& contents) const;
+
+    void ReadMeta(const Footer& footer);
+    void ReadFilter(const Slice& filter_handle_value);
+
+    Rep* const rep_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_TABLE_H
@@ -0,0 +1,78 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_INCLUDE_TABLE_BUILDER_H
+#define MASSDB_INCLUDE_TABLE_BUILDER_H
+
+#include <cstdint>
+
+#include "massdb/options.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class BlockBuilder;
+class BlockHandle;
+class WritableFile;
+
+// TableBuilder 用于构建 table 文件：一个持久化的、不可变的有序映射。
+//
+// 多个线程可以同时调用 TableBuilder 的 const 方法，
+// 但只要有一个线程调用了非 const 方法，就需要外部同步
+class TableBuilder {
+public:
+    // 创建一个 builder，将 table 的内容写入 *file。
+    // 不会关闭 file，调用者需要在 Finish() 之后自行关闭
+    TableBuilder(const Options& options, WritableFile* file);
+
+    TableBuilder(const TableBuilder&) = delete;
+    TableBuilder& operator=(const TableBuilder&) = delete;
+
+    // 要求：已经调用过 Finish() 或 Abandon()
+    ~TableBuilder();
+
+    // 修改 builder 使用的选项。只有部分字段可以在构造之后修改，
+    // 如果试图修改不允许修改的字段（例如 comparator）会返回错误
+    Status ChangeOptions(const Options& options);
+
+    // 向 table 中添加一个键值对。
+    // 要求：key 大于之前添加的所有 key
+    // 要求：没有调用过 Finish() 和 Abandon()
+    void Add(const Slice& key, const Slice& value);
+
+    // 将缓冲的键值对立刻写成一个数据块。
+    // 可以用来保证两个相邻的 key 不会落在同一个块中，大多数调用者不需要使用
+    // 要求：没有调用过 Finish() 和 Abandon()
+    void Flush();
+
+    // 发生错误时返回非 Ok 的状态
+    Status status() const;
+
+    // 完成 table 的构建。此函数返回后不再使用 file。
+    // 要求：没有调用过 Finish() 和 Abandon()
+    Status Finish();
+
+    // 放弃构建 table 的内容。此函数返回后不再使用 file。
+    // 如果调用者不打算调用 Finish()，必须在析构之前调用此函数。
+    // 要求：没有调用过 Finish() 和 Abandon()
+    void Abandon();
+
+    // 已经调用 Add() 的次数
+    uint64_t NumEntries() const;
+
+    // 目前为止生成的文件大小。在 Finish() 之后调用时返回最终的文件大小
+    uint64_t FileSize() const;
+
+private:
+    bool ok() const { return status().IsOk(); }
+    void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+    void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+
+    struct Rep;
+    Rep* rep_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_TABLE_BUILDER_H
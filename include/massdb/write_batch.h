@@ -0,0 +1,58 @@
+//
+// Created by Xsakura on 2023/4/29.
+//
+
+#ifndef MASSDB_INCLUDE_WRITE_BATCH_H
+#define MASSDB_INCLUDE_WRITE_BATCH_H
+
+#include <string>
+
+#include "massdb/status.h"
+
+namespace massdb {
+
+class Slice;
+
+// WriteBatch 保存一组按顺序执行的更新，通过 DB::Write() 原子地写入数据库。
+//
+// 多个线程可以同时调用 WriteBatch 的 const 方法，
+// 但只要有一个线程调用了非 const 方法，就需要外部同步
+class WriteBatch {
+public:
+    // 用于遍历 WriteBatch 内容的回调接口
+    class Handler {
+    public:
+        virtual ~Handler();
+        virtual void Put(const Slice& key, const Slice& value) = 0;
+        virtual void Delete(const Slice& key) = 0;
+    };
+
+    WriteBatch();
+
+    // 允许复制
+    WriteBatch(const WriteBatch&) = default;
+    WriteBatch& operator=(const WriteBatch&) = default;
+
+    ~WriteBatch();
+
+    // 在数据库中存储 key -> value 的映射
+    void Put(const Slice& key, const Slice& value);
+
+    // 如果数据库中有 key 对应的条目，将其删除
+    void Delete(const Slice& key);
+
+    // 清空所有的更新
+    void Clear();
+
+    // 按顺序将每个更新交给 handler 处理
+    Status Iterate(Handler* handler) const;
+
+private:
+    friend class WriteBatchInternal;
+
+    std::string rep_;  // 格式见 write_batch.cpp 开头的注释
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_INCLUDE_WRITE_BATCH_H
@@ -0,0 +1,305 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "table/block.h"
+
+#include <cassert>
+#include <string>
+
+#include "db/dbformat.h"
+#include "massdb/comparator.h"
+#include "table/format.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+inline uint32_t Block::NumRestarts() const {
+    assert(size_ >= sizeof(uint32_t));
+    return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+}
+
+Block::Block(const BlockContents& contents)
+    : data_(contents.data.data()),
+      size_(contents.data.size()),
+      owned_(contents.heap_allocated) {
+    if (size_ < sizeof(uint32_t)) {
+        size_ = 0;  // 出错，标记为损坏
+    } else {
+        size_t max_restarts_allowed =
+            (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
+        if (NumRestarts() > max_restarts_allowed) {
+            // 块太小，放不下声明数量的重启点
+            size_ = 0;
+        } else {
+            restart_offset_ = static_cast<uint32_t>(
+                size_ - (1 + NumRestarts()) * sizeof(uint32_t));
+        }
+    }
+}
+
+Block::~Block() {
+    if (owned_) {
+        delete[] data_;
+    }
+}
+
+// 从 p 开始解析一条记录的头部，将公共前缀长度存入 *shared，
+// 非公共部分长度存入 *non_shared，value 的长度存入 *value_length。
+// p 之后不会读取超过 limit 的位置。
+//
+// 出错时返回 nullptr，否则返回指向 key 差异部分的指针
+static inline const char* DecodeEntry(const char* p, const char* limit,
+                                      uint32_t* shared, uint32_t* non_shared,
+                                      uint32_t* value_length) {
+    if (limit - p < 3) return nullptr;
+    *shared = reinterpret_cast<const uint8_t*>(p)[0];
+    *non_shared = reinterpret_cast<const uint8_t*>(p)[1];
+    *value_length = reinterpret_cast<const uint8_t*>(p)[2];
+    if ((*shared | *non_shared | *value_length) < 128) {
+        // 快速路径：三个长度都只占一个字节
+        p += 3;
+    } else {
+        if ((p = GetVarint32Ptr(p, limit, shared)) == nullptr) {
+            return nullptr;
+        }
+        if ((p = GetVarint32Ptr(p, limit, non_shared)) == nullptr) {
+            return nullptr;
+        }
+        if ((p = GetVarint32Ptr(p, limit, value_length)) == nullptr) {
+            return nullptr;
+        }
+    }
+
+    if (static_cast<uint32_t>(limit - p) < (*non_shared + *value_length)) {
+        return nullptr;
+    }
+    return p;
+}
+
+template <typename KeyCompare>
+class Block::Iter : public Iterator {
+public:
+    Iter(const KeyCompare& compare, const char* data, uint32_t restarts,
+         uint32_t num_restarts)
+        : compare_(compare),
+          data_(data),
+          restarts_(restarts),
+          num_restarts_(num_restarts),
+          current_(restarts_),
+          restart_index_(num_restarts_) {
+        assert(num_restarts_ > 0);
+    }
+
+    bool Valid() const override { return current_ < restarts_; }
+    Status status() const override { return status_; }
+    Slice key() const override {
+        assert(Valid());
+        return key_;
+    }
+    Slice value() const override {
+        assert(Valid());
+        return value_;
+    }
+
+    void Next() override {
+        assert(Valid());
+        ParseNextKey();
+    }
+
+    void Prev() override {
+        assert(Valid());
+
+        // 向前找到位于 current_ 之前的重启点
+        const uint32_t original = current_;
+        while (GetRestartPoint(restart_index_) >= original) {
+            if (restart_index_ == 0) {
+                // 没有更前面的条目了
+                current_ = restarts_;
+                restart_index_ = num_restarts_;
+                return;
+            }
+            restart_index_--;
+        }
+
+        SeekToRestartPoint(restart_index_);
+        do {
+            // 一直前进到 original 之前的那条记录
+        } while (ParseNextKey() && NextEntryOffset() < original);
+    }
+
+    void Seek(const Slice& target) override {
+        // 在重启点数组中二分查找最后一个 key < target 的重启点
+        uint32_t left = 0;
+        uint32_t right = num_restarts_ - 1;
+        int current_key_compare = 0;
+
+        if (Valid()) {
+            // 如果已经在扫描中，用当前的 key 缩小查找范围
+            current_key_compare = Compare(key_, target);
+            if (current_key_compare < 0) {
+                // key_ 小于 target，重启点 >= restart_index_
+                left = restart_index_;
+            } else if (current_key_compare > 0) {
+                right = restart_index_;
+            } else {
+                // 已经指向目标
+                return;
+            }
+        }
+
+        while (left < right) {
+            uint32_t mid = (left + right + 1) / 2;
+            uint32_t region_offset = GetRestartPoint(mid);
+            uint32_t shared, non_shared, value_length;
+            const char* key_ptr =
+                DecodeEntry(data_ + region_offset, data_ + restarts_, &shared,
+                            &non_shared, &value_length);
+            if (key_ptr == nullptr || (shared != 0)) {
+                CorruptionError();
+                return;
+            }
+            Slice mid_key(key_ptr, non_shared);
+            if (Compare(mid_key, target) < 0) {
+                // mid 处的 key 小于 target，mid 之前的重启点都无需考虑
+                left = mid;
+            } else {
+                // mid 处的 key 大于等于 target，mid 及之后的重启点都无需考虑
+                right = mid - 1;
+            }
+        }
+
+        // 如果已经在 left 对应的区域中扫描，可以直接从当前位置继续
+        assert(current_key_compare == 0 || Valid());
+        bool skip_seek = left == restart_index_ && current_key_compare < 0;
+        if (!skip_seek) {
+            SeekToRestartPoint(left);
+        }
+        // 线性查找第一个 key >= target 的记录
+        while (true) {
+            if (!ParseNextKey()) {
+                return;
+            }
+            if (Compare(key_, target) >= 0) {
+                return;
+            }
+        }
+    }
+
+    void SeekToFirst() override {
+        SeekToRestartPoint(0);
+        ParseNextKey();
+    }
+
+    void SeekToLast() override {
+        SeekToRestartPoint(num_restarts_ - 1);
+        while (ParseNextKey() && NextEntryOffset() < restarts_) {
+            // 一直前进到最后一条记录
+        }
+    }
+
+private:
+    inline int Compare(const Slice& a, const Slice& b) const {
+        return compare_(a, b);
+    }
+
+    // 返回当前记录之后的下一条记录在 data_ 中的偏移量
+    inline uint32_t NextEntryOffset() const {
+        return static_cast<uint32_t>((value_.data() + value_.size()) - data_);
+    }
+
+    uint32_t GetRestartPoint(uint32_t index) {
+        assert(index < num_restarts_);
+        return DecodeFixed32(data_ + restarts_ + index * sizeof(uint32_t));
+    }
+
+    void SeekToRestartPoint(uint32_t index) {
+        key_.clear();
+        restart_index_ = index;
+        // current_ 会在 ParseNextKey() 中修正
+
+        // ParseNextKey() 从 value_ 的末尾开始解析，所以在这里设置 value_
+        uint32_t offset = GetRestartPoint(index);
+        value_ = Slice(data_ + offset, 0);
+    }
+
+    void CorruptionError() {
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        status_ = Status::Corruption("bad entry in block");
+        key_.clear();
+        value_ = Slice();
+    }
+
+    bool ParseNextKey() {
+        current_ = NextEntryOffset();
+        const char* p = data_ + current_;
+        const char* limit = data_ + restarts_;  // 重启点数组从这里开始
+        if (p >= limit) {
+            // 没有更多的记录了，标记为无效
+            current_ = restarts_;
+            restart_index_ = num_restarts_;
+            return false;
+        }
+
+        // 解析记录
+        uint32_t shared, non_shared, value_length;
+        p = DecodeEntry(p, limit, &shared, &non_shared, &value_length);
+        if (p == nullptr || key_.size() < shared) {
+            CorruptionError();
+            return false;
+        } else {
+            key_.resize(shared);
+            key_.append(p, non_shared);
+            value_ = Slice(p + non_shared, value_length);
+            while (restart_index_ + 1 < num_restarts_ &&
+                   GetRestartPoint(restart_index_ + 1) < current_) {
+                ++restart_index_;
+            }
+            return true;
+        }
+    }
+
+    const KeyCompare compare_;
+    const char* const data_;       // 块的内容
+    uint32_t const restarts_;      // 重启点数组的偏移量
+    uint32_t const num_restarts_;  // 重启点的数量
+
+    // current_ 是当前记录在 data_ 中的偏移量，>= restarts_ 时表示无效
+    uint32_t current_;
+    uint32_t restart_index_;  // current_ 所在区域的重启点下标
+    std::string key_;
+    Slice value_;
+    Status status_;
+};
+
+Iterator* Block::NewIterator(const Comparator* comparator) {
+    if (size_ < sizeof(uint32_t)) {
+        return NewErrorIterator(Status::Corruption("bad block contents"));
+    }
+    const uint32_t num_restarts = NumRestarts();
+    if (num_restarts == 0) {
+        return NewEmptyIterator();
+    }
+
+    // 二分查找和线性查找中的比较是热点，
+    // 已知的 internal key 比较器使用可以内联的比较函数
+    switch (GetUserKeyKind(comparator)) {
+        case InternalKeyComparator::kBytewiseUserKey: {
+            typedef InternalKeyCompare<BytewiseKeyCompare> Compare;
+            return new Iter<Compare>(Compare(), data_, restart_offset_,
+                                     num_restarts);
+        }
+        case InternalKeyComparator::kSpectrumUserKey: {
+            typedef InternalKeyCompare<SpectrumKeyCompare> Compare;
+            return new Iter<Compare>(Compare(), data_, restart_offset_,
+                                     num_restarts);
+        }
+        default:
+            return new Iter<VirtualKeyCompare>(VirtualKeyCompare(comparator),
+                                               data_, restart_offset_,
+                                               num_restarts);
+    }
+}
+
+}  // namespace massdb
@@ -0,0 +1,47 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_TABLE_BLOCK_H
+#define MASSDB_TABLE_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "massdb/iterator.h"
+
+namespace massdb {
+
+struct BlockContents;
+class Comparator;
+
+// 只读的数据块，格式见 BlockBuilder
+class Block {
+public:
+    // 用指定的内容初始化块
+    explicit Block(const BlockContents& contents);
+
+    Block(const Block&) = delete;
+    Block& operator=(const Block&) = delete;
+
+    ~Block();
+
+    size_t size() const { return size_; }
+    Iterator* NewIterator(const Comparator* comparator);
+
+private:
+    // KeyCompare 是编译期确定的比较函数，见 util/key_compare.h
+    template <typename KeyCompare>
+    class Iter;
+
+    uint32_t NumRestarts() const;
+
+    const char* data_;
+    size_t size_;
+    uint32_t restart_offset_;  // 重启点数组在 data_ 中的偏移量
+    bool owned_;               // 为 true 时 Block 负责 delete[] data_
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_TABLE_BLOCK_H
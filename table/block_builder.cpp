@@ -0,0 +1,84 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "table/block_builder.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "massdb/comparator.h"
+#include "massdb/options.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+BlockBuilder::BlockBuilder(const Options* options)
+    : options_(options), restarts_(), counter_(0), finished_(false) {
+    assert(options->block_restart_interval >= 1);
+    restarts_.push_back(0);  // 第一个重启点在偏移量 0 处
+}
+
+void BlockBuilder::Reset() {
+    buffer_.clear();
+    restarts_.clear();
+    restarts_.push_back(0);
+    counter_ = 0;
+    finished_ = false;
+    last_key_.clear();
+}
+
+size_t BlockBuilder::CurrentSizeEstimate() const {
+    return (buffer_.size() +                       // 原始数据
+            restarts_.size() * sizeof(uint32_t) +  // 重启点数组
+            sizeof(uint32_t));                     // 重启点数组的长度
+}
+
+Slice BlockBuilder::Finish() {
+    // 在末尾追加重启点数组
+    for (uint32_t restart : restarts_) {
+        PutFixed32(&buffer_, restart);
+    }
+    PutFixed32(&buffer_, static_cast<uint32_t>(restarts_.size()));
+    finished_ = true;
+    return Slice(buffer_);
+}
+
+void BlockBuilder::Add(const Slice& key, const Slice& value) {
+    Slice last_key_piece(last_key_);
+    assert(!finished_);
+    assert(counter_ <= options_->block_restart_interval);
+    assert(buffer_.empty() ||
+           options_->comparator->Compare(key, last_key_piece) > 0);
+    size_t shared = 0;
+    if (counter_ < options_->block_restart_interval) {
+        // 计算与前一个 key 的公共前缀长度
+        const size_t min_length = std::min(last_key_piece.size(), key.size());
+        while ((shared < min_length) &&
+               (last_key_piece[shared] == key[shared])) {
+            shared++;
+        }
+    } else {
+        // 重启点处不进行压缩
+        restarts_.push_back(static_cast<uint32_t>(buffer_.size()));
+        counter_ = 0;
+    }
+    const size_t non_shared = key.size() - shared;
+
+    // 写入 "<shared><non_shared><value_size>"
+    PutVarint32(&buffer_, static_cast<uint32_t>(shared));
+    PutVarint32(&buffer_, static_cast<uint32_t>(non_shared));
+    PutVarint32(&buffer_, static_cast<uint32_t>(value.size()));
+
+    // 写入 key 的差异部分和 value
+    buffer_.append(key.data() + shared, non_shared);
+    buffer_.append(value.data(), value.size());
+
+    // 更新状态
+    last_key_.resize(shared);
+    last_key_.append(key.data() + shared, non_shared);
+    assert(Slice(last_key_) == key);
+    counter_++;
+}
+
+}  // namespace massdb
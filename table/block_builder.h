@@ -0,0 +1,67 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_TABLE_BLOCK_BUILDER_H
+#define MASSDB_TABLE_BLOCK_BUILDER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "massdb/slice.h"
+
+namespace massdb {
+
+struct Options;
+
+// BlockBuilder 生成 key 经过前缀压缩的块：
+// 每条记录只保存与前一个 key 不同的部分。
+// 每隔 block_restart_interval 条记录设置一个重启点（restart point），
+// 重启点处保存完整的 key，读取时可以在重启点之间二分查找。
+//
+// 每条记录的格式：
+//     shared_bytes: varint32
+//     unshared_bytes: varint32
+//     value_length: varint32
+//     key_delta: char[unshared_bytes]
+//     value: char[value_length]
+// 块的末尾：
+//     restarts: uint32[num_restarts]
+//     num_restarts: uint32
+class BlockBuilder {
+public:
+    explicit BlockBuilder(const Options* options);
+
+    BlockBuilder(const BlockBuilder&) = delete;
+    BlockBuilder& operator=(const BlockBuilder&) = delete;
+
+    // 重置内容，就像刚刚构造出来一样
+    void Reset();
+
+    // 要求：上次 Reset() 之后没有调用过 Finish()，
+    // 并且 key 大于之前添加的所有 key
+    void Add(const Slice& key, const Slice& value);
+
+    // 完成块的构建并返回指向块内容的 Slice。
+    // 返回的 Slice 在 builder 的生命周期内或者调用 Reset() 之前有效
+    Slice Finish();
+
+    // 返回当前正在构建的块（未压缩）大小的估计值
+    size_t CurrentSizeEstimate() const;
+
+    // 上次 Reset() 之后没有添加过任何记录时返回 true
+    bool empty() const { return buffer_.empty(); }
+
+private:
+    const Options* options_;
+    std::string buffer_;              // 目标缓冲区
+    std::vector<uint32_t> restarts_;  // 重启点
+    int counter_;                     // 自上一个重启点以来添加的记录数
+    bool finished_;                   // 是否已经调用了 Finish()
+    std::string last_key_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_TABLE_BLOCK_BUILDER_H
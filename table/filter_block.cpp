@@ -0,0 +1,86 @@
+//
+// Created by Xsakura on 2023/5/13.
+//
+
+#include "table/filter_block.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "massdb/filter_policy.h"
+
+namespace massdb {
+
+// 过滤器内容对齐的字节数。
+// 分块的 Bloom 过滤器以缓存行为单位组织，对齐后每次探测只访问一条缓存行
+static const size_t kFilterAlignment = 64;
+
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
+    : policy_(policy) {}
+
+void FilterBlockBuilder::AddKey(const Slice& key) {
+    start_.push_back(keys_.size());
+    keys_.append(key.data(), key.size());
+}
+
+Slice FilterBlockBuilder::Finish() {
+    const size_t num_keys = start_.size();
+    if (num_keys == 0) {
+        return Slice(result_);
+    }
+
+    // 根据拼接的 key 生成 Slice 列表
+    start_.push_back(keys_.size());  // 简化下面计算 key 长度的逻辑
+    std::vector<Slice> tmp_keys(num_keys);
+    for (size_t i = 0; i < num_keys; i++) {
+        const char* base = keys_.data() + start_[i];
+        size_t length = start_[i + 1] - start_[i];
+        tmp_keys[i] = Slice(base, length);
+    }
+
+    policy_->CreateFilter(&tmp_keys[0], static_cast<int>(num_keys), &result_);
+
+    keys_.clear();
+    start_.clear();
+    return Slice(result_);
+}
+
+FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
+                                     const Slice& contents)
+    : policy_(policy), buf_(nullptr) {
+    if (contents.empty()) return;
+    // 分配的大小需要是对齐字节数的整数倍
+    size_t alloc = (contents.size() + kFilterAlignment - 1) /
+                   kFilterAlignment * kFilterAlignment;
+    void* p = nullptr;
+    if (posix_memalign(&p, kFilterAlignment, alloc) != 0) {
+        // 退化为不对齐的内存，只影响探测时访问的缓存行数量
+        p = std::malloc(alloc);
+    }
+    buf_ = static_cast<char*>(p);
+    std::memcpy(buf_, contents.data(), contents.size());
+    filter_ = Slice(buf_, contents.size());
+}
+
+FilterBlockReader::~FilterBlockReader() { std::free(buf_); }
+
+bool FilterBlockReader::KeyMayMatch(const Slice& key) const {
+    if (filter_.empty()) {
+        // 空的过滤器（例如没有任何 key 的 table）不能排除任何 key
+        return true;
+    }
+    return policy_->KeyMayMatch(key, filter_);
+}
+
+void FilterBlockReader::KeysMayMatch(const Slice* keys, int n,
+                                     bool* results) const {
+    if (filter_.empty()) {
+        for (int i = 0; i < n; i++) {
+            results[i] = true;
+        }
+        return;
+    }
+    policy_->KeysMayMatch(keys, n, filter_, results);
+}
+
+}  // namespace massdb
@@ -0,0 +1,67 @@
+//
+// Created by Xsakura on 2023/5/13.
+//
+
+#ifndef MASSDB_TABLE_FILTER_BLOCK_H
+#define MASSDB_TABLE_FILTER_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "massdb/slice.h"
+
+namespace massdb {
+
+class FilterPolicy;
+
+// 过滤器块保存在 table 的末尾，为整个 table 中的所有 key 构建一个过滤器。
+// 点查时在读取索引块和数据块之前先检查过滤器，
+// 对于不存在的 key 绝大多数情况下不需要读取任何数据块。
+//
+// 过滤器块的内容就是 FilterPolicy::CreateFilter() 生成的过滤器
+class FilterBlockBuilder {
+public:
+    explicit FilterBlockBuilder(const FilterPolicy* policy);
+
+    FilterBlockBuilder(const FilterBlockBuilder&) = delete;
+    FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
+
+    void AddKey(const Slice& key);
+    Slice Finish();
+
+private:
+    const FilterPolicy* policy_;
+    std::string keys_;           // 所有 key 拼接在一起
+    std::vector<size_t> start_;  // 每个 key 在 keys_ 中的起始位置
+    std::string result_;         // 生成的过滤器
+};
+
+class FilterBlockReader {
+public:
+    // 要求：policy 在 *this 存活期间一直有效。
+    // 会复制 contents 的内容，调用者可以在构造之后释放 contents
+    FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+
+    FilterBlockReader(const FilterBlockReader&) = delete;
+    FilterBlockReader& operator=(const FilterBlockReader&) = delete;
+
+    ~FilterBlockReader();
+
+    bool KeyMayMatch(const Slice& key) const;
+
+    // 依次判断 keys[0, n - 1] 是否可能存在，结果存入 results[i]
+    void KeysMayMatch(const Slice* keys, int n, bool* results) const;
+
+    size_t size() const { return filter_.size(); }
+
+private:
+    const FilterPolicy* policy_;
+    char* buf_;      // 按缓存行对齐的过滤器内容
+    Slice filter_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_TABLE_FILTER_BLOCK_H
@@ -0,0 +1,172 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "table/format.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "massdb/env.h"
+#include "massdb/options.h"
+#include "util/coding.h"
+#include "util/compression.h"
+#include "util/crc32c.h"
+
+namespace massdb {
+
+void BlockHandle::EncodeTo(std::string* dst) const {
+    // 检查所有字段都已经被设置过
+    assert(offset_ != ~static_cast<uint64_t>(0));
+    assert(size_ != ~static_cast<uint64_t>(0));
+    PutVarint64(dst, offset_);
+    PutVarint64(dst, size_);
+}
+
+Status BlockHandle::DecodeFrom(Slice* input) {
+    if (GetVarint64(input, &offset_) && GetVarint64(input, &size_)) {
+        return Status::Ok();
+    } else {
+        return Status::Corruption("bad block handle");
+    }
+}
+
+void Footer::EncodeTo(std::string* dst) const {
+    const size_t original_size = dst->size();
+    metaindex_handle_.EncodeTo(dst);
+    index_handle_.EncodeTo(dst);
+    dst->resize(original_size + 2 * BlockHandle::kMaxEncodedLength);  // 补 0
+    PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
+    PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+    assert(dst->size() == original_size + kEncodedLength);
+    (void)original_size;
+}
+
+Status Footer::DecodeFrom(Slice* input) {
+    if (input->size() < kEncodedLength) {
+        return Status::Corruption("not an sstable (footer too short)");
+    }
+
+    const char* magic_ptr = input->data() + kEncodedLength - 8;
+    const uint32_t magic_lo = DecodeFixed32(magic_ptr);
+    const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
+    const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
+                            (static_cast<uint64_t>(magic_lo)));
+    if (magic != kTableMagicNumber) {
+        return Status::Corruption("not an sstable (bad magic number)");
+    }
+
+    Status result = metaindex_handle_.DecodeFrom(input);
+    if (result.IsOk()) {
+        result = index_handle_.DecodeFrom(input);
+    }
+    if (result.IsOk()) {
+        // 跳过补 0 的部分和 magic number
+        const char* end = magic_ptr + 8;
+        *input = Slice(end, input->data() + input->size() - end);
+    }
+    return result;
+}
+
+// 校验 data[0, n + kBlockTrailerSize) 中块的类型和 crc，并解码块的内容。
+// owned 为 true 时 data 是 new[] 分配的，由这里接管；
+// 否则 stable 为 true 表示 data 在文件打开期间一直有效（例如 mmap），
+// 未压缩的块直接引用它，为 false 时复制一份
+static Status DecodeBlockContents(const ReadOptions& options,
+                                  const char* data, size_t n, bool owned,
+                                  bool stable, BlockContents* result) {
+    Status s;
+    if (options.verify_checksums) {
+        const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
+        const uint32_t actual = crc32c::Value(data, n + 1);
+        if (actual != crc) {
+            s = Status::Corruption("block checksum mismatch");
+        }
+    }
+
+    if (s.IsOk()) {
+        switch (data[n]) {
+            case kNoCompression:
+                if (owned) {
+                    result->data = Slice(data, n);
+                    result->heap_allocated = true;
+                    result->cachable = true;
+                    return s;
+                } else if (stable) {
+                    // 文件的实现直接返回了指向其内部数据的指针，
+                    // 这部分数据在文件打开期间一直有效，直接使用即可
+                    result->data = Slice(data, n);
+                    result->heap_allocated = false;
+                    result->cachable = false;  // 不需要再缓存一份
+                } else {
+                    char* copy = new char[n];
+                    std::memcpy(copy, data, n);
+                    result->data = Slice(copy, n);
+                    result->heap_allocated = true;
+                    result->cachable = true;
+                }
+                break;
+            default: {
+                char* ubuf;
+                size_t ulength;
+                s = UncompressBlock(static_cast<CompressionType>(data[n]),
+                                    Slice(data, n), &ubuf, &ulength);
+                if (s.IsOk()) {
+                    result->data = Slice(ubuf, ulength);
+                    result->heap_allocated = true;
+                    result->cachable = true;
+                }
+                break;
+            }
+        }
+    }
+
+    if (owned) {
+        delete[] data;
+    }
+    return s;
+}
+
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result) {
+    result->data = Slice();
+    result->cachable = false;
+    result->heap_allocated = false;
+
+    // 读取块的内容以及尾部的类型和校验和
+    size_t n = static_cast<size_t>(handle.size());
+    char* buf = new char[n + kBlockTrailerSize];
+    Slice contents;
+    Status s =
+        file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+    if (!s.IsOk()) {
+        delete[] buf;
+        return s;
+    }
+    if (contents.size() != n + kBlockTrailerSize) {
+        delete[] buf;
+        return Status::Corruption("truncated block read");
+    }
+
+    if (contents.data() != buf) {
+        delete[] buf;
+        return DecodeBlockContents(options, contents.data(), n, false, true,
+                                   result);
+    }
+    return DecodeBlockContents(options, buf, n, true, false, result);
+}
+
+Status DecodeBlock(const ReadOptions& options, const Slice& raw,
+                   BlockContents* result) {
+    result->data = Slice();
+    result->cachable = false;
+    result->heap_allocated = false;
+    if (raw.size() < kBlockTrailerSize) {
+        return Status::Corruption("truncated block read");
+    }
+    return DecodeBlockContents(options, raw.data(),
+                               raw.size() - kBlockTrailerSize, false, false,
+                               result);
+}
+
+}  // namespace massdb
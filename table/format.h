@@ -0,0 +1,98 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_TABLE_FORMAT_H
+#define MASSDB_TABLE_FORMAT_H
+
+#include <cstdint>
+#include <string>
+
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+class RandomAccessFile;
+struct ReadOptions;
+
+// BlockHandle 指向文件中存放数据块或元数据块的区域
+class BlockHandle {
+public:
+    // BlockHandle 编码后的最大长度：两个 varint64
+    enum { kMaxEncodedLength = 10 + 10 };
+
+    BlockHandle();
+
+    // 块在文件中的偏移量
+    uint64_t offset() const { return offset_; }
+    void set_offset(uint64_t offset) { offset_ = offset; }
+
+    // 块的大小（不包含尾部的类型和校验和）
+    uint64_t size() const { return size_; }
+    void set_size(uint64_t size) { size_ = size; }
+
+    void EncodeTo(std::string* dst) const;
+    Status DecodeFrom(Slice* input);
+
+private:
+    uint64_t offset_;
+    uint64_t size_;
+};
+
+// Footer 存放在每个 table 文件的末尾，长度固定
+class Footer {
+public:
+    // Footer 编码后的长度。
+    // 由两个 BlockHandle 和一个 magic number 组成，BlockHandle 不足的部分补 0
+    enum { kEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8 };
+
+    Footer() = default;
+
+    // 元数据索引块（metaindex block）的位置，
+    // 其中记录了过滤器块等元数据块的位置
+    const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
+    void set_metaindex_handle(const BlockHandle& h) { metaindex_handle_ = h; }
+
+    // 索引块（index block）的位置
+    const BlockHandle& index_handle() const { return index_handle_; }
+    void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
+
+    void EncodeTo(std::string* dst) const;
+    Status DecodeFrom(Slice* input);
+
+private:
+    BlockHandle metaindex_handle_;
+    BlockHandle index_handle_;
+};
+
+// 用于识别 table 文件的 magic number
+static const uint64_t kTableMagicNumber = 0x6d617373646221aaull;
+
+// 每个块的末尾有 1 字节的压缩类型和 4 字节的 crc32 校验和
+static const size_t kBlockTrailerSize = 5;
+
+struct BlockContents {
+    Slice data;           // 块的实际内容
+    bool cachable;        // 是否可以放入缓存
+    bool heap_allocated;  // 为 true 时调用者需要 delete[] data.data()
+};
+
+// 从 file 中读取 handle 指向的块，并将其内容存入 result。
+// 失败时返回非 Ok 的状态
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result);
+
+// 与 ReadBlock() 相同，但块已经读到内存中：raw 是块的内容以及尾部。
+// 结果不引用 raw 的内存，调用者之后可以释放它
+Status DecodeBlock(const ReadOptions& options, const Slice& raw,
+                   BlockContents* result);
+
+// 实现细节
+
+inline BlockHandle::BlockHandle()
+    : offset_(~static_cast<uint64_t>(0)), size_(~static_cast<uint64_t>(0)) {}
+
+}  // namespace massdb
+
+#endif  // MASSDB_TABLE_FORMAT_H
@@ -0,0 +1,90 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_TABLE_ITERATOR_WRAPPER_H
+#define MASSDB_TABLE_ITERATOR_WRAPPER_H
+
+#include <cassert>
+
+#include "massdb/iterator.h"
+#include "massdb/slice.h"
+
+namespace massdb {
+
+// IteratorWrapper 与 Iterator 的接口相同，但缓存了 valid() 和 key() 的结果。
+// 这样可以避免虚函数调用，也能获得更好的缓存局部性
+class IteratorWrapper {
+public:
+    IteratorWrapper() : iter_(nullptr), valid_(false) {}
+    explicit IteratorWrapper(Iterator* iter) : iter_(nullptr) { Set(iter); }
+    ~IteratorWrapper() { delete iter_; }
+    Iterator* iter() const { return iter_; }
+
+    // 接管 iter 的所有权，之前持有的迭代器会被删除
+    void Set(Iterator* iter) {
+        delete iter_;
+        iter_ = iter;
+        if (iter_ == nullptr) {
+            valid_ = false;
+        } else {
+            Update();
+        }
+    }
+
+    // 迭代器接口
+    bool Valid() const { return valid_; }
+    Slice key() const {
+        assert(Valid());
+        return key_;
+    }
+    Slice value() const {
+        assert(Valid());
+        return iter_->value();
+    }
+    Status status() const {
+        assert(iter_);
+        return iter_->status();
+    }
+    void Next() {
+        assert(iter_);
+        iter_->Next();
+        Update();
+    }
+    void Prev() {
+        assert(iter_);
+        iter_->Prev();
+        Update();
+    }
+    void Seek(const Slice& k) {
+        assert(iter_);
+        iter_->Seek(k);
+        Update();
+    }
+    void SeekToFirst() {
+        assert(iter_);
+        iter_->SeekToFirst();
+        Update();
+    }
+    void SeekToLast() {
+        assert(iter_);
+        iter_->SeekToLast();
+        Update();
+    }
+
+private:
+    void Update() {
+        valid_ = iter_->Valid();
+        if (valid_) {
+            key_ = iter_->key();
+        }
+    }
+
+    Iterator* iter_;
+    bool valid_;
+    Slice key_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_TABLE_ITERATOR_WRAPPER_H
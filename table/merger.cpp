@@ -0,0 +1,205 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "table/merger.h"
+
+#include "db/dbformat.h"
+#include "massdb/comparator.h"
+#include "massdb/iterator.h"
+#include "table/iterator_wrapper.h"
+
+namespace massdb {
+
+namespace {
+
+// KeyCompare 是编译期确定的比较函数，见 util/key_compare.h
+template <typename KeyCompare>
+class MergingIterator : public Iterator {
+public:
+    MergingIterator(const KeyCompare& compare, Iterator** children, int n)
+        : compare_(compare),
+          children_(new IteratorWrapper[n]),
+          n_(n),
+          current_(nullptr),
+          direction_(kForward) {
+        for (int i = 0; i < n; i++) {
+            children_[i].Set(children[i]);
+        }
+    }
+
+    ~MergingIterator() override { delete[] children_; }
+
+    bool Valid() const override { return (current_ != nullptr); }
+
+    void SeekToFirst() override {
+        for (int i = 0; i < n_; i++) {
+            children_[i].SeekToFirst();
+        }
+        FindSmallest();
+        direction_ = kForward;
+    }
+
+    void SeekToLast() override {
+        for (int i = 0; i < n_; i++) {
+            children_[i].SeekToLast();
+        }
+        FindLargest();
+        direction_ = kReverse;
+    }
+
+    void Seek(const Slice& target) override {
+        for (int i = 0; i < n_; i++) {
+            children_[i].Seek(target);
+        }
+        FindSmallest();
+        direction_ = kForward;
+    }
+
+    void Next() override {
+        assert(Valid());
+
+        // 保证所有子迭代器都位于 key() 之后。
+        // 如果当前是正向移动，除 current_ 之外的子迭代器已经满足条件，
+        // 否则需要显式地调整其他子迭代器
+        if (direction_ != kForward) {
+            for (int i = 0; i < n_; i++) {
+                IteratorWrapper* child = &children_[i];
+                if (child != current_) {
+                    child->Seek(key());
+                    if (child->Valid() &&
+                        compare_(key(), child->key()) == 0) {
+                        child->Next();
+                    }
+                }
+            }
+            direction_ = kForward;
+        }
+
+        current_->Next();
+        FindSmallest();
+    }
+
+    void Prev() override {
+        assert(Valid());
+
+        // 保证所有子迭代器都位于 key() 之前。
+        // 如果当前是反向移动，除 current_ 之外的子迭代器已经满足条件，
+        // 否则需要显式地调整其他子迭代器
+        if (direction_ != kReverse) {
+            for (int i = 0; i < n_; i++) {
+                IteratorWrapper* child = &children_[i];
+                if (child != current_) {
+                    child->Seek(key());
+                    if (child->Valid()) {
+                        // child 位于第一个 >= key() 的条目，后退一步
+                        child->Prev();
+                    } else {
+                        // child 中没有 >= key() 的条目，移动到最后一个条目
+                        child->SeekToLast();
+                    }
+                }
+            }
+            direction_ = kReverse;
+        }
+
+        current_->Prev();
+        FindLargest();
+    }
+
+    Slice key() const override {
+        assert(Valid());
+        return current_->key();
+    }
+
+    Slice value() const override {
+        assert(Valid());
+        return current_->value();
+    }
+
+    Status status() const override {
+        Status status;
+        for (int i = 0; i < n_; i++) {
+            status = children_[i].status();
+            if (!status.IsOk()) {
+                break;
+            }
+        }
+        return status;
+    }
+
+private:
+    // 迭代的方向
+    enum Direction { kForward, kReverse };
+
+    void FindSmallest();
+    void FindLargest();
+
+    const KeyCompare compare_;
+    IteratorWrapper* children_;
+    int n_;
+    IteratorWrapper* current_;
+    Direction direction_;
+};
+
+template <typename KeyCompare>
+void MergingIterator<KeyCompare>::FindSmallest() {
+    IteratorWrapper* smallest = nullptr;
+    for (int i = 0; i < n_; i++) {
+        IteratorWrapper* child = &children_[i];
+        if (child->Valid()) {
+            if (smallest == nullptr) {
+                smallest = child;
+            } else if (compare_(child->key(), smallest->key()) < 0) {
+                smallest = child;
+            }
+        }
+    }
+    current_ = smallest;
+}
+
+template <typename KeyCompare>
+void MergingIterator<KeyCompare>::FindLargest() {
+    IteratorWrapper* largest = nullptr;
+    for (int i = n_ - 1; i >= 0; i--) {
+        IteratorWrapper* child = &children_[i];
+        if (child->Valid()) {
+            if (largest == nullptr) {
+                largest = child;
+            } else if (compare_(child->key(), largest->key()) > 0) {
+                largest = child;
+            }
+        }
+    }
+    current_ = largest;
+}
+
+}  // namespace
+
+Iterator* NewMergingIterator(const Comparator* comparator, Iterator** children,
+                             int n) {
+    assert(n >= 0);
+    if (n == 0) {
+        return NewEmptyIterator();
+    } else if (n == 1) {
+        return children[0];
+    }
+
+    // 压实和读取时每次 Next() 都要在所有子迭代器之间比较，
+    // 已知的 internal key 比较器使用可以内联的比较函数
+    switch (GetUserKeyKind(comparator)) {
+        case InternalKeyComparator::kBytewiseUserKey: {
+            typedef InternalKeyCompare<BytewiseKeyCompare> Compare;
+            return new MergingIterator<Compare>(Compare(), children, n);
+        }
+        case InternalKeyComparator::kSpectrumUserKey: {
+            typedef InternalKeyCompare<SpectrumKeyCompare> Compare;
+            return new MergingIterator<Compare>(Compare(), children, n);
+        }
+        default:
+            return new MergingIterator<VirtualKeyCompare>(
+                VirtualKeyCompare(comparator), children, n);
+    }
+}
+
+}  // namespace massdb
@@ -0,0 +1,24 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_TABLE_MERGER_H
+#define MASSDB_TABLE_MERGER_H
+
+namespace massdb {
+
+class Comparator;
+class Iterator;
+
+// 返回一个迭代器，按顺序返回 children[0, n-1] 中所有数据的并集。
+// 接管所有子迭代器的所有权，结果迭代器被删除时一并删除它们。
+//
+// 不会去除重复的 key。如果某个 key 在 K 个子迭代器中出现，它会被返回 K 次。
+//
+// 要求：n >= 0
+Iterator* NewMergingIterator(const Comparator* comparator, Iterator** children,
+                             int n);
+
+}  // namespace massdb
+
+#endif  // MASSDB_TABLE_MERGER_H
@@ -0,0 +1,323 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "massdb/table.h"
+
+#include "massdb/cache.h"
+#include "massdb/comparator.h"
+#include "massdb/env.h"
+#include "massdb/filter_policy.h"
+#include "massdb/options.h"
+#include "table/block.h"
+#include "table/filter_block.h"
+#include "table/format.h"
+#include "table/two_level_iterator.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+struct Table::Rep {
+    ~Rep() {
+        delete filter;
+        delete index_block;
+    }
+
+    Options options;
+    Status status;
+    RandomAccessFile* file;
+    // 在块缓存中区分不同 table 的前缀，缓存的 key 为 cache_id + 块的偏移量
+    uint64_t cache_id;
+
+    FilterBlockReader* filter;  // 没有过滤器时为 nullptr
+
+    // 元数据索引块的位置，过滤器块的 handle 会记录在其中
+    BlockHandle metaindex_handle;
+    Block* index_block;
+};
+
+Status Table::Open(const Options& options, RandomAccessFile* file,
+                   uint64_t size, Table** table) {
+    *table = nullptr;
+    if (size < Footer::kEncodedLength) {
+        return Status::Corruption("file is too short to be an sstable");
+    }
+
+    char footer_space[Footer::kEncodedLength];
+    Slice footer_input;
+    Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength,
+                          &footer_input, footer_space);
+    if (!s.IsOk()) return s;
+
+    Footer footer;
+    s = footer.DecodeFrom(&footer_input);
+    if (!s.IsOk()) return s;
+
+    // 读取索引块
+    BlockContents index_block_contents;
+    ReadOptions opt;
+    if (options.paranoid_checks) {
+        opt.verify_checksums = true;
+    }
+    s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
+
+    if (s.IsOk()) {
+        // 已经成功读取了 footer 和索引块，可以开始提供服务了
+        Block* index_block = new Block(index_block_contents);
+        Rep* rep = new Table::Rep;
+        rep->options = options;
+        rep->file = file;
+        rep->cache_id =
+            (options.block_cache ? options.block_cache->NewId() : 0);
+        rep->filter = nullptr;
+        rep->metaindex_handle = footer.metaindex_handle();
+        rep->index_block = index_block;
+        *table = new Table(rep);
+        (*table)->ReadMeta(footer);
+    }
+
+    return s;
+}
+
+void Table::ReadMeta(const Footer& footer) {
+    if (rep_->options.filter_policy == nullptr) {
+        return;  // 不需要任何元数据
+    }
+
+    // 目前元数据索引块中只有过滤器的信息，
+    // 读取失败时不使用过滤器，不影响 table 的正常读取
+    ReadOptions opt;
+    if (rep_->options.paranoid_checks) {
+        opt.verify_checksums = true;
+    }
+    BlockContents contents;
+    if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents)
+             .IsOk()) {
+        return;
+    }
+    Block* meta = new Block(contents);
+
+    Iterator* iter = meta->NewIterator(BytewiseComparator());
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value());
+    }
+    delete iter;
+    delete meta;
+}
+
+void Table::ReadFilter(const Slice& filter_handle_value) {
+    Slice v = filter_handle_value;
+    BlockHandle filter_handle;
+    if (!filter_handle.DecodeFrom(&v).IsOk()) {
+        return;
+    }
+
+    ReadOptions opt;
+    if (rep_->options.paranoid_checks) {
+        opt.verify_checksums = true;
+    }
+    BlockContents block;
+    if (!ReadBlock(rep_->file, opt, filter_handle, &block).IsOk()) {
+        return;
+    }
+    // FilterBlockReader 会把过滤器复制到按缓存行对齐的内存中
+    rep_->filter =
+        new FilterBlockReader(rep_->options.filter_policy, block.data);
+    if (block.heap_allocated) {
+        delete[] block.data.data();
+    }
+}
+
+Table::~Table() { delete rep_; }
+
+static void DeleteBlock(void* arg, void* ignored) {
+    delete reinterpret_cast<Block*>(arg);
+}
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+    Block* block = reinterpret_cast<Block*>(value);
+    delete block;
+}
+
+static void ReleaseBlock(void* arg, void* h) {
+    Cache* cache = reinterpret_cast<Cache*>(arg);
+    Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
+    cache->Release(handle);
+}
+
+// 数据块在块缓存中的 key：table 的 cache_id 加上块的偏移量
+static Slice BlockCacheKey(uint64_t cache_id, const BlockHandle& handle,
+                           char* buf) {
+    EncodeFixed64(buf, cache_id);
+    EncodeFixed64(buf + 8, handle.offset());
+    return Slice(buf, 16);
+}
+
+Iterator* Table::CachedBlockIterator(const BlockHandle& handle) const {
+    Cache* block_cache = rep_->options.block_cache;
+    if (block_cache == nullptr) {
+        return nullptr;
+    }
+    char cache_key_buffer[16];
+    Cache::Handle* cache_handle = block_cache->Lookup(
+        BlockCacheKey(rep_->cache_id, handle, cache_key_buffer));
+    if (cache_handle == nullptr) {
+        return nullptr;
+    }
+    Block* block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+    Iterator* iter = block->NewIterator(rep_->options.comparator);
+    // 迭代器持有缓存句柄，期间块不会被释放，直接使用缓存中的块
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+    return iter;
+}
+
+Iterator* Table::NewBlockIterator(const ReadOptions& options,
+                                  const BlockHandle& handle,
+                                  const BlockContents& contents) const {
+    Cache* block_cache = rep_->options.block_cache;
+    Block* block = new Block(contents);
+    Iterator* iter = block->NewIterator(rep_->options.comparator);
+    // fill_cache 为 false 时不放入缓存，
+    // 以免批量扫描淘汰缓存中的热点块
+    if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+        char cache_key_buffer[16];
+        Cache::Handle* cache_handle = block_cache->Insert(
+            BlockCacheKey(rep_->cache_id, handle, cache_key_buffer), block,
+            block->size(), &DeleteCachedBlock);
+        iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+    } else {
+        iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+    }
+    return iter;
+}
+
+// 将索引迭代器的 value（一个编码后的 BlockHandle）
+// 转换为对应数据块内容的迭代器
+Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
+                             const Slice& index_value) {
+    Table* table = reinterpret_cast<Table*>(arg);
+    BlockHandle handle;
+    Slice input = index_value;
+    Status s = handle.DecodeFrom(&input);
+    // 这里有意忽略 input 中剩余的内容，以便之后在 BlockHandle 中加入更多字段
+    if (!s.IsOk()) {
+        return NewErrorIterator(s);
+    }
+
+    Iterator* iter = table->CachedBlockIterator(handle);
+    if (iter != nullptr) {
+        return iter;
+    }
+    BlockContents contents;
+    s = ReadBlock(table->rep_->file, options, handle, &contents);
+    if (!s.IsOk()) {
+        return NewErrorIterator(s);
+    }
+    return table->NewBlockIterator(options, handle, contents);
+}
+
+Iterator* Table::NewIterator(const ReadOptions& options) const {
+    return NewTwoLevelIterator(
+        rep_->index_block->NewIterator(rep_->options.comparator),
+        &Table::BlockReader, const_cast<Table*>(this), options);
+}
+
+Iterator* Table::NewIndexIterator() const {
+    return rep_->index_block->NewIterator(rep_->options.comparator);
+}
+
+Status Table::InternalGet(const ReadOptions& options, const Slice& k,
+                          void* arg,
+                          void (*handle_result)(void*, const Slice&,
+                                                const Slice&)) {
+    // 过滤器排除了 k 时不需要读取索引块和数据块
+    FilterBlockReader* filter = rep_->filter;
+    if (filter != nullptr && !filter->KeyMayMatch(k)) {
+        return Status::Ok();
+    }
+
+    Status s;
+    Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+    iiter->Seek(k);
+    if (iiter->Valid()) {
+        Iterator* block_iter = BlockReader(this, options, iiter->value());
+        block_iter->Seek(k);
+        if (block_iter->Valid()) {
+            (*handle_result)(arg, block_iter->key(), block_iter->value());
+        }
+        s = block_iter->status();
+        delete block_iter;
+    }
+    if (s.IsOk()) {
+        s = iiter->status();
+    }
+    delete iiter;
+    return s;
+}
+
+Status Table::PrepareMultiGet(const Slice* keys, size_t n, bool* may_match,
+                              BlockHandle* handles) const {
+    FilterBlockReader* filter = rep_->filter;
+    if (filter != nullptr) {
+        filter->KeysMayMatch(keys, static_cast<int>(n), may_match);
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            may_match[i] = true;
+        }
+    }
+
+    Status s;
+    Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+    for (size_t i = 0; i < n && s.IsOk(); i++) {
+        if (!may_match[i]) {
+            continue;
+        }
+        iiter->Seek(keys[i]);
+        if (!iiter->Valid()) {
+            // key 大于文件中所有的 key
+            may_match[i] = false;
+            continue;
+        }
+        Slice input = iiter->value();
+        s = handles[i].DecodeFrom(&input);
+    }
+    if (s.IsOk()) {
+        s = iiter->status();
+    }
+    delete iiter;
+    return s;
+}
+
+uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
+    Iterator* index_iter =
+        rep_->index_block->NewIterator(rep_->options.comparator);
+    index_iter->Seek(key);
+    uint64_t result;
+    if (index_iter->Valid()) {
+        BlockHandle handle;
+        Slice input = index_iter->value();
+        Status s = handle.DecodeFrom(&input);
+        if (s.IsOk()) {
+            result = handle.offset();
+        } else {
+            // 无法解析索引块中的 handle，
+            // 用元数据索引块的偏移量作为近似值（接近文件末尾）
+            result = rep_->metaindex_handle.offset();
+        }
+    } else {
+        // key 大于文件中最后一个 key，
+        // 用元数据索引块的偏移量作为近似值（接近文件末尾）
+        result = rep_->metaindex_handle.offset();
+    }
+    delete index_iter;
+    return result;
+}
+
+uint64_t Table::DataEndOffset() const {
+    return rep_->metaindex_handle.offset();
+}
+
+}  // namespace massdb
@@ -0,0 +1,251 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "massdb/table_builder.h"
+
+#include <cassert>
+
+#include "massdb/comparator.h"
+#include "massdb/env.h"
+#include "massdb/filter_policy.h"
+#include "table/block_builder.h"
+#include "table/filter_block.h"
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/compression.h"
+#include "util/crc32c.h"
+
+namespace massdb {
+
+struct TableBuilder::Rep {
+    Rep(const Options& opt, WritableFile* f)
+        : options(opt),
+          index_block_options(opt),
+          file(f),
+          offset(0),
+          data_block(&options),
+          index_block(&index_block_options),
+          num_entries(0),
+          closed(false),
+          filter_block(opt.filter_policy == nullptr
+                           ? nullptr
+                           : new FilterBlockBuilder(opt.filter_policy)),
+          pending_index_entry(false) {
+        index_block_options.block_restart_interval = 1;
+    }
+
+    Options options;
+    Options index_block_options;
+    WritableFile* file;
+    uint64_t offset;
+    Status status;
+    BlockBuilder data_block;
+    BlockBuilder index_block;
+    std::string last_key;
+    int64_t num_entries;
+    bool closed;  // 是否已经调用了 Finish() 或 Abandon()
+    FilterBlockBuilder* filter_block;  // 没有设置过滤器策略时为 nullptr
+
+    // 直到看到下一个数据块的第一个 key 时才写入上一个数据块的索引项，
+    // 这样可以在索引中使用更短的 key。例如上一个块的最后一个 key 为
+    // "the quick brown fox"，下一个块的第一个 key 为 "the who"，
+    // 索引项就可以使用 "the r"，因为它 >= 上一个块的所有 key
+    // 且 < 下一个块的所有 key。
+    //
+    // 不变式：当且仅当 data_block 为空时 pending_index_entry 为 true
+    bool pending_index_entry;
+    BlockHandle pending_handle;  // 添加到索引块中的 handle
+
+    std::string compressed_output;
+};
+
+TableBuilder::TableBuilder(const Options& options, WritableFile* file)
+    : rep_(new Rep(options, file)) {}
+
+TableBuilder::~TableBuilder() {
+    assert(rep_->closed);  // 调用者忘记调用 Finish() 了
+    delete rep_->filter_block;
+    delete rep_;
+}
+
+Status TableBuilder::ChangeOptions(const Options& options) {
+    // 构造之后不允许修改的字段
+    if (options.comparator != rep_->options.comparator) {
+        return Status::InvalidArgument(
+            "changing comparator while building table");
+    }
+    if (options.filter_policy != rep_->options.filter_policy) {
+        return Status::InvalidArgument(
+            "changing filter policy while building table");
+    }
+
+    // 注意：data_block 和 index_block 持有的是指向 rep_ 中 Options 的指针，
+    // 这里更新 Options 之后它们也会立刻使用新的值
+    rep_->options = options;
+    rep_->index_block_options = options;
+    rep_->index_block_options.block_restart_interval = 1;
+    return Status::Ok();
+}
+
+void TableBuilder::Add(const Slice& key, const Slice& value) {
+    Rep* r = rep_;
+    assert(!r->closed);
+    if (!ok()) return;
+    if (r->num_entries > 0) {
+        assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
+    }
+
+    if (r->pending_index_entry) {
+        assert(r->data_block.empty());
+        r->options.comparator->FindShortestSeparator(&r->last_key, key);
+        std::string handle_encoding;
+        r->pending_handle.EncodeTo(&handle_encoding);
+        r->index_block.Add(r->last_key, Slice(handle_encoding));
+        r->pending_index_entry = false;
+    }
+
+    if (r->filter_block != nullptr) {
+        r->filter_block->AddKey(key);
+    }
+
+    r->last_key.assign(key.data(), key.size());
+    r->num_entries++;
+    r->data_block.Add(key, value);
+
+    const size_t estimated_block_size = r->data_block.CurrentSizeEstimate();
+    if (estimated_block_size >= r->options.block_size) {
+        Flush();
+    }
+}
+
+void TableBuilder::Flush() {
+    Rep* r = rep_;
+    assert(!r->closed);
+    if (!ok()) return;
+    if (r->data_block.empty()) return;
+    assert(!r->pending_index_entry);
+    WriteBlock(&r->data_block, &r->pending_handle);
+    if (ok()) {
+        r->pending_index_entry = true;
+        r->status = r->file->Flush();
+    }
+}
+
+void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+    // 文件中的块由以下部分组成：
+    //    block_data: uint8[n]
+    //    type: uint8
+    //    crc: uint32
+    assert(ok());
+    Rep* r = rep_;
+    Slice raw = block->Finish();
+
+    Slice block_contents;
+    CompressionType type = r->options.compression;
+    if (type != kNoCompression &&
+        CompressBlock(type, r->options.compression_level, raw,
+                      &r->compressed_output) &&
+        r->compressed_output.size() <=
+            raw.size() -
+                static_cast<size_t>(raw.size() *
+                                    r->options.compression_min_savings)) {
+        block_contents = r->compressed_output;
+    } else {
+        // 算法不可用、压缩失败或者节省的空间太少时，存储未压缩的内容
+        block_contents = raw;
+        type = kNoCompression;
+    }
+    WriteRawBlock(block_contents, type, handle);
+    r->compressed_output.clear();
+    block->Reset();
+}
+
+void TableBuilder::WriteRawBlock(const Slice& block_contents,
+                                 CompressionType type, BlockHandle* handle) {
+    Rep* r = rep_;
+    handle->set_offset(r->offset);
+    handle->set_size(block_contents.size());
+    r->status = r->file->Append(block_contents);
+    if (r->status.IsOk()) {
+        char trailer[kBlockTrailerSize];
+        trailer[0] = type;
+        uint32_t crc =
+            crc32c::Value(block_contents.data(), block_contents.size());
+        crc = crc32c::Extend(crc, trailer, 1);  // 将块的类型也计入校验和
+        EncodeFixed32(trailer + 1, crc32c::Mask(crc));
+        r->status = r->file->Append(Slice(trailer, kBlockTrailerSize));
+        if (r->status.IsOk()) {
+            r->offset += block_contents.size() + kBlockTrailerSize;
+        }
+    }
+}
+
+Status TableBuilder::status() const { return rep_->status; }
+
+Status TableBuilder::Finish() {
+    Rep* r = rep_;
+    Flush();
+    assert(!r->closed);
+    r->closed = true;
+
+    BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+
+    // 写入过滤器块，过滤器块不压缩
+    if (ok() && r->filter_block != nullptr) {
+        WriteRawBlock(r->filter_block->Finish(), kNoCompression,
+                      &filter_block_handle);
+    }
+
+    // 写入元数据索引块
+    if (ok()) {
+        BlockBuilder meta_index_block(&r->options);
+        if (r->filter_block != nullptr) {
+            // 添加 "filter.<policy name>" 到过滤器块位置的映射
+            std::string key = "filter.";
+            key.append(r->options.filter_policy->Name());
+            std::string handle_encoding;
+            filter_block_handle.EncodeTo(&handle_encoding);
+            meta_index_block.Add(key, handle_encoding);
+        }
+        WriteBlock(&meta_index_block, &metaindex_block_handle);
+    }
+
+    // 写入索引块
+    if (ok()) {
+        if (r->pending_index_entry) {
+            r->options.comparator->FindShortestSuccessor(&r->last_key);
+            std::string handle_encoding;
+            r->pending_handle.EncodeTo(&handle_encoding);
+            r->index_block.Add(r->last_key, Slice(handle_encoding));
+            r->pending_index_entry = false;
+        }
+        WriteBlock(&r->index_block, &index_block_handle);
+    }
+
+    // 写入 footer
+    if (ok()) {
+        Footer footer;
+        footer.set_metaindex_handle(metaindex_block_handle);
+        footer.set_index_handle(index_block_handle);
+        std::string footer_encoding;
+        footer.EncodeTo(&footer_encoding);
+        r->status = r->file->Append(footer_encoding);
+        if (r->status.IsOk()) {
+            r->offset += footer_encoding.size();
+        }
+    }
+    return r->status;
+}
+
+void TableBuilder::Abandon() {
+    Rep* r = rep_;
+    assert(!r->closed);
+    r->closed = true;
+}
+
+uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
+
+uint64_t TableBuilder::FileSize() const { return rep_->offset; }
+
+}  // namespace massdb
@@ -0,0 +1,305 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "massdb/table.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "massdb/env.h"
+#include "massdb/filter_policy.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "massdb/table_builder.h"
+#include "table/format.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+TEST(FormatTest, BlockHandleRoundTrip) {
+    for (uint64_t offset : {uint64_t(0), uint64_t(300), ~uint64_t(0) >> 1}) {
+        BlockHandle handle;
+        handle.set_offset(offset);
+        handle.set_size(offset / 3 + 7);
+        std::string encoded = "prefix";
+        handle.EncodeTo(&encoded);
+        ASSERT_LE(encoded.size(), 6 + BlockHandle::kMaxEncodedLength);
+
+        Slice input(encoded);
+        input.remove_prefix(6);
+        BlockHandle decoded;
+        ASSERT_TRUE(decoded.DecodeFrom(&input).IsOk());
+        ASSERT_TRUE(input.empty());
+        ASSERT_EQ(offset, decoded.offset());
+        ASSERT_EQ(offset / 3 + 7, decoded.size());
+    }
+    Slice truncated("\x80", 1);
+    BlockHandle handle;
+    ASSERT_TRUE(handle.DecodeFrom(&truncated).IsCorruption());
+}
+
+TEST(FormatTest, FooterRoundTrip) {
+    BlockHandle metaindex, index;
+    metaindex.set_offset(1000);
+    metaindex.set_size(50);
+    index.set_offset(1055);
+    index.set_size(1234567);
+    Footer footer;
+    footer.set_metaindex_handle(metaindex);
+    footer.set_index_handle(index);
+
+    // footer 追加在已有的数据之后，长度固定
+    std::string encoded = "data";
+    footer.EncodeTo(&encoded);
+    ASSERT_EQ(4 + Footer::kEncodedLength, encoded.size());
+    ASSERT_EQ("data", encoded.substr(0, 4));
+
+    Slice input(encoded);
+    input.remove_prefix(4);
+    Footer decoded;
+    ASSERT_TRUE(decoded.DecodeFrom(&input).IsOk());
+    ASSERT_TRUE(input.empty());
+    ASSERT_EQ(1000u, decoded.metaindex_handle().offset());
+    ASSERT_EQ(50u, decoded.metaindex_handle().size());
+    ASSERT_EQ(1055u, decoded.index_handle().offset());
+    ASSERT_EQ(1234567u, decoded.index_handle().size());
+
+    // magic number 错误或者长度不足
+    std::string bad = encoded.substr(4);
+    bad[bad.size() - 1] ^= 1;
+    input = bad;
+    ASSERT_TRUE(decoded.DecodeFrom(&input).IsCorruption());
+    input = Slice(encoded.data() + 5, Footer::kEncodedLength - 1);
+    ASSERT_TRUE(decoded.DecodeFrom(&input).IsCorruption());
+}
+
+class TableTest : public testing::Test {
+public:
+    TableTest()
+        : env_(Env::Default()),
+          dir_(test::NewTestDirectory("table_test")),
+          fname_(dir_ + "/000001.sst"),
+          file_(nullptr),
+          table_(nullptr) {
+        env_->CreateDir(dir_);
+    }
+
+    ~TableTest() override {
+        Close();
+        test::DestroyDirectory(env_, dir_);
+    }
+
+    void Close() {
+        delete table_;
+        table_ = nullptr;
+        delete file_;
+        file_ = nullptr;
+    }
+
+    // 把 model 写成 table 文件并打开
+    void Build(const std::map<std::string, std::string>& model) {
+        Close();
+        WritableFile* file;
+        ASSERT_TRUE(env_->NewWritableFile(fname_, &file).IsOk());
+        TableBuilder builder(options_, file);
+        for (const auto& kv : model) {
+            builder.Add(kv.first, kv.second);
+        }
+        ASSERT_TRUE(builder.Finish().IsOk());
+        ASSERT_EQ(model.size(), builder.NumEntries());
+        ASSERT_TRUE(file->Close().IsOk());
+        delete file;
+
+        uint64_t size;
+        ASSERT_TRUE(env_->GetFileSize(fname_, &size).IsOk());
+        ASSERT_EQ(builder.FileSize(), size);
+        ASSERT_TRUE(Open(size).IsOk());
+    }
+
+    Status Open(uint64_t size) {
+        Close();
+        Status s = options_.use_mmap_reads
+                       ? env_->NewMmapReadableFile(fname_, &file_)
+                       : env_->NewRandomAccessFile(fname_, &file_);
+        if (s.IsOk()) {
+            s = Table::Open(options_, file_, size, &table_);
+        }
+        return s;
+    }
+
+    // 覆盖文件中 offset 处的一个字节
+    void CorruptByte(uint64_t offset) {
+        Close();
+        std::string contents;
+        ASSERT_TRUE(ReadFileToString(&contents).IsOk());
+        contents[offset] ^= 0x40;
+        WritableFile* file;
+        ASSERT_TRUE(env_->NewWritableFile(fname_, &file).IsOk());
+        ASSERT_TRUE(file->Append(contents).IsOk());
+        ASSERT_TRUE(file->Close().IsOk());
+        delete file;
+    }
+
+    Status ReadFileToString(std::string* contents) {
+        uint64_t size;
+        Status s = env_->GetFileSize(fname_, &size);
+        if (!s.IsOk()) return s;
+        SequentialFile* file;
+        s = env_->NewSequentialFile(fname_, &file);
+        if (!s.IsOk()) return s;
+        contents->resize(size);
+        Slice result;
+        s = file->Read(size, &result, &(*contents)[0]);
+        contents->assign(result.data(), result.size());
+        delete file;
+        return s;
+    }
+
+    // 检查正向、反向遍历和 Seek() 的结果都与 model 一致
+    void CheckContents(const std::map<std::string, std::string>& model) {
+        ReadOptions read_options;
+        read_options.verify_checksums = true;
+        std::unique_ptr<Iterator> iter(table_->NewIterator(read_options));
+        iter->SeekToFirst();
+        for (const auto& kv : model) {
+            ASSERT_TRUE(iter->Valid());
+            ASSERT_EQ(kv.first, iter->key().to_string());
+            ASSERT_EQ(kv.second, iter->value().to_string());
+            iter->Next();
+        }
+        ASSERT_FALSE(iter->Valid());
+        iter->SeekToLast();
+        for (auto it = model.rbegin(); it != model.rend(); ++it) {
+            ASSERT_TRUE(iter->Valid());
+            ASSERT_EQ(it->first, iter->key().to_string());
+            iter->Prev();
+        }
+        ASSERT_FALSE(iter->Valid());
+
+        // 每个 key 本身以及它之后的位置
+        for (auto it = model.begin(); it != model.end(); ++it) {
+            iter->Seek(it->first);
+            ASSERT_TRUE(iter->Valid());
+            ASSERT_EQ(it->first, iter->key().to_string());
+            iter->Seek(it->first + '\0');
+            auto next = std::next(it);
+            if (next == model.end()) {
+                ASSERT_FALSE(iter->Valid());
+            } else {
+                ASSERT_TRUE(iter->Valid());
+                ASSERT_EQ(next->first, iter->key().to_string());
+            }
+        }
+        ASSERT_TRUE(iter->status().IsOk());
+    }
+
+    Env* const env_;
+    const std::string dir_;
+    const std::string fname_;
+    Options options_;
+    RandomAccessFile* file_;
+    Table* table_;
+};
+
+// 随机的 key 和 value，key 有很长的公共前缀，value 的长度从 0 到几 KB
+static std::map<std::string, std::string> RandomModel(Random* rnd, int n) {
+    std::map<std::string, std::string> model;
+    for (int i = 0; i < n; i++) {
+        std::string key = "spectrum/" + std::to_string(rnd->Uniform(n * 10));
+        key.append(rnd->Uniform(3), 'x');
+        const int len = rnd->OneIn(20) ? 2000 + rnd->Uniform(3000)
+                                       : rnd->Uniform(100);
+        model[key] = test::RandomString(rnd, len);
+    }
+    return model;
+}
+
+TEST_F(TableTest, Empty) {
+    Build({});
+    CheckContents({});
+    ASSERT_EQ(0u, table_->ApproximateOffsetOf("anything"));
+}
+
+TEST_F(TableTest, SingleEntry) {
+    Build({{"key", "value"}});
+    CheckContents({{"key", "value"}});
+    Build({{"", ""}});
+    CheckContents({{"", ""}});
+}
+
+TEST_F(TableTest, BuildAndRead) {
+    const FilterPolicy* filter = NewBloomFilterPolicy(10);
+    Random rnd(301);
+    const std::map<std::string, std::string> model = RandomModel(&rnd, 2000);
+    for (int config = 0; config < 8; config++) {
+        options_.block_size = (config & 1) ? 256 : 4096;
+        options_.block_restart_interval = (config & 2) ? 1 : 16;
+        options_.filter_policy = (config & 4) ? filter : nullptr;
+        options_.use_mmap_reads = (config & 4) != 0;
+        Build(model);
+        CheckContents(model);
+
+        // 偏移量随 key 单调不减，最后一个 key 之后接近数据的末尾
+        uint64_t last = 0;
+        for (const auto& kv : model) {
+            const uint64_t offset = table_->ApproximateOffsetOf(kv.first);
+            ASSERT_GE(offset, last);
+            last = offset;
+        }
+        uint64_t size;
+        ASSERT_TRUE(env_->GetFileSize(fname_, &size).IsOk());
+        ASSERT_EQ(0u, table_->ApproximateOffsetOf(""));
+        ASSERT_GT(table_->ApproximateOffsetOf("\xff"), size / 2);
+        ASSERT_LE(table_->ApproximateOffsetOf("\xff"), size);
+    }
+    Close();
+    delete filter;
+}
+
+TEST_F(TableTest, FooterErrors) {
+    Random rnd(301);
+    Build(RandomModel(&rnd, 100));
+    uint64_t size;
+    ASSERT_TRUE(env_->GetFileSize(fname_, &size).IsOk());
+
+    // 文件比 footer 还短，或者只打开了文件的一部分
+    ASSERT_TRUE(Open(Footer::kEncodedLength - 1).IsCorruption());
+    ASSERT_FALSE(Open(size - 1).IsOk());
+    ASSERT_TRUE(table_ == nullptr);
+
+    // magic number 损坏
+    CorruptByte(size - 1);
+    ASSERT_TRUE(Open(size).IsCorruption());
+    ASSERT_TRUE(table_ == nullptr);
+}
+
+TEST_F(TableTest, BlockChecksum) {
+    options_.block_size = 256;
+    Random rnd(301);
+    const std::map<std::string, std::string> model = RandomModel(&rnd, 200);
+    Build(model);
+    uint64_t size;
+    ASSERT_TRUE(env_->GetFileSize(fname_, &size).IsOk());
+
+    // 第一个数据块中的一个字节损坏：校验时跳过这个块并记录错误，
+    // 不会返回损坏的数据
+    CorruptByte(10);
+    ASSERT_TRUE(Open(size).IsOk());
+    ReadOptions read_options;
+    read_options.verify_checksums = true;
+    std::unique_ptr<Iterator> iter(table_->NewIterator(read_options));
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->status().IsCorruption()) << iter->status().ToString();
+    for (; iter->Valid(); iter->Next()) {
+        auto it = model.find(iter->key().to_string());
+        ASSERT_TRUE(it != model.end());
+        ASSERT_NE(model.begin()->first, it->first);
+        ASSERT_EQ(it->second, iter->value().to_string());
+    }
+}
+
+}  // namespace massdb
@@ -0,0 +1,29 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_TABLE_TWO_LEVEL_ITERATOR_H
+#define MASSDB_TABLE_TWO_LEVEL_ITERATOR_H
+
+#include "massdb/iterator.h"
+
+namespace massdb {
+
+struct ReadOptions;
+
+// 返回一个两层迭代器。
+// 两层迭代器包含一个索引迭代器，索引迭代器的 value 指向一系列块，
+// 每个块本身又是一个键值对序列。
+// 两层迭代器返回所有块中键值对的拼接结果。
+// 接管 index_iter 的所有权，不再需要时将其删除。
+//
+// block_function 用于将 index_iter 的 value 转换为对应块内容的迭代器
+Iterator* NewTwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* (*block_function)(void* arg, const ReadOptions& options,
+                                const Slice& index_value),
+    void* arg, const ReadOptions& options);
+
+}  // namespace massdb
+
+#endif  // MASSDB_TABLE_TWO_LEVEL_ITERATOR_H
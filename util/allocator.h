@@ -0,0 +1,30 @@
+//
+// Created by Xsakura on 2023/4/15.
+//
+
+#ifndef MASSDB_UTIL_ALLOCATOR_H
+#define MASSDB_UTIL_ALLOCATOR_H
+
+#include <cstddef>
+
+namespace massdb {
+
+// 内存分配器接口。
+// SkipList 通过它分配节点，具体使用单线程的 Arena
+// 还是线程安全的 ConcurrentArena 由 MemTable 决定
+class Allocator {
+public:
+    virtual ~Allocator() = default;
+
+    // 分配指定空间
+    virtual char* Allocate(size_t bytes) = 0;
+    // 分配指定空间并保证内存对齐
+    virtual char* AllocateAligned(size_t bytes) = 0;
+
+    // 返回分配器每次向系统申请的内存块大小
+    virtual size_t BlockSize() const = 0;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_ALLOCATOR_H
@@ -4,17 +4,39 @@
 
 #include "arena.h"
 
+#include <algorithm>
+
+#include <sys/mman.h>
+
 namespace massdb {
 
-static const int kBlockSize = 4096;
+const size_t Arena::kMinBlockSize = 4096;
+const size_t Arena::kMaxBlockSize = 2u << 30;
+
+// 将 block_size 调整到合法范围内，并对齐到 8 字节
+static size_t OptimizeBlockSize(size_t block_size) {
+    block_size = std::max(Arena::kMinBlockSize, block_size);
+    block_size = std::min(Arena::kMaxBlockSize, block_size);
+    if (block_size % 8 != 0) {
+        block_size = (1 + block_size / 8) * 8;
+    }
+    return block_size;
+}
 
-Arena::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+Arena::Arena(size_t block_size, size_t huge_page_size)
+    : block_size_(OptimizeBlockSize(block_size)),
+      huge_page_size_(huge_page_size),
+      alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      memory_usage_(0) {}
 
 Arena::~Arena() {
     for (char*& block : blocks_) {
         delete[] block;
     }
+    for (auto& block : huge_blocks_) {
+        munmap(block.first, block.second);
+    }
 }
 
 char* Arena::Allocate(size_t bytes) {
@@ -28,16 +50,22 @@ char* Arena::Allocate(size_t bytes) {
     return AllocateFallback(bytes);
 }
 
-// the size of new block = bytes > kBlockSize / 4 ? bytes : kBlockSize
+// the size of new block = bytes > block_size_ / 4 ? bytes : block_size_
 char* Arena::AllocateFallback(size_t bytes) {
-    if (bytes > kBlockSize / 4) {
-        // 如果要分配的字节大于 1024 的话新开辟一个块
+    if (bytes > block_size_ / 4) {
+        // 如果要分配的字节大于块大小的 1/4 的话单独开辟一个块，
+        // 避免浪费当前块剩余的空间
         char* result = AllocateNewBlock(bytes);
         return result;
     }
 
-    alloc_ptr_ = AllocateNewBlock(kBlockSize);
-    alloc_bytes_remaining_ = kBlockSize;
+    // 常规大小的块优先使用大页，这样 SkipList 遍历时 TLB 未命中更少
+    char* block = nullptr;
+    if (huge_page_size_ > 0) {
+        block = AllocateFromHugePage(block_size_);
+    }
+    alloc_ptr_ = (block != nullptr) ? block : AllocateNewBlock(block_size_);
+    alloc_bytes_remaining_ = block_size_;
 
     char* result = alloc_ptr_;
     alloc_ptr_ += bytes;
@@ -55,6 +83,34 @@ char* Arena::AllocateNewBlock(size_t block_bytes) {
     return result;
 }
 
+char* Arena::AllocateFromHugePage(size_t block_bytes) {
+#ifdef MAP_HUGETLB
+    // mmap 的长度需要是大页大小的整数倍
+    const size_t reserved =
+        ((block_bytes - 1) / huge_page_size_ + 1) * huge_page_size_;
+    void* addr = mmap(nullptr, reserved, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr == MAP_FAILED) {
+        // 系统没有预留足够的大页（vm.nr_hugepages），
+        // 退化为普通的匿名映射，并建议内核使用透明大页
+        addr = mmap(nullptr, reserved, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            return nullptr;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(addr, reserved, MADV_HUGEPAGE);
+#endif
+    }
+    huge_blocks_.emplace_back(addr, reserved);
+    memory_usage_.fetch_add(reserved, std::memory_order_relaxed);
+    return reinterpret_cast<char*>(addr);
+#else
+    (void)block_bytes;
+    return nullptr;
+#endif
+}
+
 char* Arena::AllocateAligned(size_t bytes) {
     // 获取当前系统的指针大小
     const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
@@ -8,23 +8,39 @@
 #include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <utility>
 #include <vector>
 
+#include "util/allocator.h"
+
 namespace massdb {
 
-// 内存分配类
-class Arena {
+// 内存分配类，不是线程安全的。
+// 多个线程并发分配时请使用 ConcurrentArena
+class Arena : public Allocator {
 public:
-    Arena();
-    ~Arena();
+    // 内存块大小的取值范围
+    static const size_t kMinBlockSize;
+    static const size_t kMaxBlockSize;
+
+    // block_size 会被调整到 [kMinBlockSize, kMaxBlockSize] 之间，
+    // 并向上对齐到 8 字节。
+    // huge_page_size 不为 0 时，内存块会优先通过 mmap(MAP_HUGETLB) 分配，
+    // 系统没有预留大页时退化为普通的 mmap 并通过
+    // madvise(MADV_HUGEPAGE) 建议内核使用透明大页
+    explicit Arena(size_t block_size = kMinBlockSize,
+                   size_t huge_page_size = 0);
+    ~Arena() override;
 
     Arena(const Arena&) = delete;
     Arena operator=(const Arena&) = delete;
 
     // 分配指定空间
-    char* Allocate(size_t bytes);
+    char* Allocate(size_t bytes) override;
     // 分配指定空间并保证内存对齐
-    char* AllocateAligned(size_t bytes);
+    char* AllocateAligned(size_t bytes) override;
+
+    size_t BlockSize() const override { return block_size_; }
 
     // 返回 Arena 中总体的内存使用大小
     size_t memory_usage() const {
@@ -32,13 +48,21 @@ public:
     }
 
 private:
-    // 如果 bytes > kBlockSize / 4 的话，单独开辟一个 bytes 大小的块
-    // 否则开辟一个 kBlockSize 大小的块
+    // 如果 bytes > block_size_ / 4 的话，单独开辟一个 bytes 大小的块
+    // 否则开辟一个 block_size_ 大小的块
     char* AllocateFallback(size_t bytes);
 
     // 分配一个新块，并挂载到 blocks 上
     char* AllocateNewBlock(size_t block_bytes);
 
+    // 通过 mmap 分配一个大页内存块，失败时返回 nullptr
+    char* AllocateFromHugePage(size_t block_bytes);
+
+    // 每个内存块的大小
+    const size_t block_size_;
+    // 大页的大小，为 0 时不使用大页
+    const size_t huge_page_size_;
+
     // 分配器状态
 
     // 指向当前内存块的指针
@@ -48,6 +72,8 @@ private:
 
     // 存储已分配的内存块的数组
     std::vector<char*> blocks_;
+    // 通过 mmap 分配的内存块及其大小，析构时需要 munmap
+    std::vector<std::pair<void*, size_t>> huge_blocks_;
 
     // Arena 中总体的内存使用大小
     std::atomic<size_t> memory_usage_;
@@ -0,0 +1,226 @@
+//
+// Created by Xsakura on 2023/5/13.
+//
+
+#include "util/blocked_bloom.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+
+#include "massdb/filter_policy.h"
+#include "massdb/slice.h"
+#include "util/hash.h"
+
+namespace massdb {
+
+namespace {
+
+// 每个块的大小，与缓存行相同
+static const size_t kBlockBytes = 64;
+
+// 每个 key 在块中设置的比特数。
+// 块被看作 8 个 64 位的字，每个字中恰好设置一个比特
+static const int kNumProbes = 8;
+
+// 过滤器最后一个字节记录的编码方式。
+// kLegacyFormat 用同一个 32 位哈希值选择块和块内的比特，
+// 块内的比特与块的下标相关，误判率高于预期，只用于读取已有的过滤器；
+// kFormat 使用 64 位哈希值，高 32 位选择块，低 32 位生成块内的比特
+static const char kLegacyFormat = kNumProbes;
+static const char kFormat = kNumProbes + 1;
+
+// 为每个字生成比特位置时使用的乘数（奇数），
+// 与 Parquet/Impala 的 split block Bloom 过滤器相同
+static const uint32_t kSalt[kNumProbes] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+// 用哈希值乘法取模选择块，以避免除法
+static inline uint32_t BlockIndex(uint32_t h, uint32_t num_blocks) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(h) * num_blocks) >> 32);
+}
+
+// 按 format 计算 key 所在的块的下标，以及生成块内比特位置的哈希值 *hb
+static inline uint32_t Locate(const Slice& key, char format,
+                              uint32_t num_blocks, uint32_t* hb) {
+    if (format == kLegacyFormat) {
+        const uint32_t h = Hash(key.data(), key.size(), 0xbc9f1d34);
+        *hb = (h >> 17) | (h << 15);
+        return BlockIndex(h, num_blocks);
+    }
+    const uint64_t h = Hash64(key.data(), key.size(), 0xbc9f1d34);
+    *hb = static_cast<uint32_t>(h);
+    return BlockIndex(static_cast<uint32_t>(h >> 32), num_blocks);
+}
+
+// 第 i 个字中要设置的比特：取 hash * salt 的最高 6 位
+static inline uint32_t BitInWord(uint32_t hb, int i) {
+    return (hb * kSalt[i]) >> 26;
+}
+
+// 可移植的实现。字以小端序存储，每次只访问需要的那个字节
+static bool BlockMayMatchPortable(const char* block, uint32_t hb) {
+    for (int i = 0; i < kNumProbes; i++) {
+        const uint32_t bit = BitInWord(hb, i);
+        const uint8_t byte = static_cast<uint8_t>(block[i * 8 + bit / 8]);
+        if ((byte & (1 << (bit % 8))) == 0) return false;
+    }
+    return true;
+}
+
+#if defined(__x86_64__)
+// 使用 AVX2 一次计算 8 个比特位置，并用两次 256 位的测试检查整个块
+__attribute__((target("avx2"))) static bool BlockMayMatchAvx2(
+    const char* block, uint32_t hb) {
+    const __m256i salt = _mm256_setr_epi32(
+        static_cast<int>(kSalt[0]), static_cast<int>(kSalt[1]),
+        static_cast<int>(kSalt[2]), static_cast<int>(kSalt[3]),
+        static_cast<int>(kSalt[4]), static_cast<int>(kSalt[5]),
+        static_cast<int>(kSalt[6]), static_cast<int>(kSalt[7]));
+    const __m256i bits = _mm256_srli_epi32(
+        _mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(hb)), salt),
+        26);
+
+    // 8 个 32 位的比特位置扩展成两组 4 个 64 位的掩码
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i mask_lo = _mm256_sllv_epi64(
+        one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(bits)));
+    const __m256i mask_hi = _mm256_sllv_epi64(
+        one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(bits, 1)));
+
+    const __m256i data_lo =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i data_hi =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+
+    // testc 在 (~data & mask) == 0，即掩码中的比特全部被设置时返回 1
+    return _mm256_testc_si256(data_lo, mask_lo) &
+           _mm256_testc_si256(data_hi, mask_hi);
+}
+#endif
+
+// 运行时检测 CPU 是否支持 AVX2
+static bool CanUseAvx2() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+// 按缓存行分块的 Bloom 过滤器：
+//    blocks : uint8[num_blocks * 64]
+//    format : uint8     // kFormat，每个 key 在块中设置 8 个比特
+//
+// 与经典 Bloom 过滤器的 k 次随机访问不同，这里一次探测只访问一个块。
+// 块的起始地址相对于过滤器数据按 64 字节对齐，
+// 读取方把过滤器放在对齐的内存中时每次探测只会访问一条缓存行
+class BlockedBloomFilterPolicy : public FilterPolicy {
+public:
+    BlockedBloomFilterPolicy(int bits_per_key, bool use_avx2)
+        : bits_per_key_(bits_per_key), use_avx2_(use_avx2) {}
+
+    const char* Name() const override { return "massdb.BlockedBloomFilter"; }
+
+    void CreateFilter(const Slice* keys, int n,
+                      std::string* dst) const override {
+        // 按块向上取整，最少使用一个块
+        size_t bits = n * bits_per_key_;
+        size_t num_blocks = (bits + kBlockBytes * 8 - 1) / (kBlockBytes * 8);
+        if (num_blocks == 0) num_blocks = 1;
+
+        const size_t init_size = dst->size();
+        dst->resize(init_size + num_blocks * kBlockBytes, 0);
+        dst->push_back(kFormat);
+        char* array = &(*dst)[init_size];
+        for (int i = 0; i < n; i++) {
+            uint32_t hb;
+            char* block =
+                array + Locate(keys[i], kFormat,
+                               static_cast<uint32_t>(num_blocks), &hb) *
+                            kBlockBytes;
+            for (int j = 0; j < kNumProbes; j++) {
+                const uint32_t bit = BitInWord(hb, j);
+                block[j * 8 + bit / 8] |= static_cast<char>(1 << (bit % 8));
+            }
+        }
+    }
+
+    bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+        const size_t len = filter.size();
+        if (len < kBlockBytes + 1 || (len - 1) % kBlockBytes != 0) {
+            return false;
+        }
+        const char format = filter[len - 1];
+        if (format != kFormat && format != kLegacyFormat) {
+            // 保留给将来可能出现的新编码，认为匹配
+            return true;
+        }
+
+        const uint32_t num_blocks = static_cast<uint32_t>(len / kBlockBytes);
+        uint32_t hb;
+        const char* block =
+            filter.data() + Locate(key, format, num_blocks, &hb) * kBlockBytes;
+        return BlockMayMatch(block, hb);
+    }
+
+    void KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                      bool* results) const override {
+        const size_t len = filter.size();
+        const char format = len > 0 ? filter[len - 1] : 0;
+        if (len < kBlockBytes + 1 || (len - 1) % kBlockBytes != 0 ||
+            (format != kFormat && format != kLegacyFormat)) {
+            FilterPolicy::KeysMayMatch(keys, n, filter, results);
+            return;
+        }
+
+        // 每次先算出一组 key 的块并预取，再依次检查，
+        // 这样每个 key 的缓存未命中不再串行地等待
+        static const int kGroup = 16;
+        const uint32_t num_blocks = static_cast<uint32_t>(len / kBlockBytes);
+        const char* blocks[kGroup];
+        uint32_t probes[kGroup];
+        for (int start = 0; start < n; start += kGroup) {
+            const int m = std::min(kGroup, n - start);
+            for (int i = 0; i < m; i++) {
+                blocks[i] = filter.data() + Locate(keys[start + i], format,
+                                                   num_blocks, &probes[i]) *
+                                                kBlockBytes;
+                __builtin_prefetch(blocks[i]);
+            }
+            for (int i = 0; i < m; i++) {
+                results[start + i] = BlockMayMatch(blocks[i], probes[i]);
+            }
+        }
+    }
+
+private:
+    bool BlockMayMatch(const char* block, uint32_t hb) const {
+#if defined(__x86_64__)
+        if (use_avx2_) {
+            return BlockMayMatchAvx2(block, hb);
+        }
+#endif
+        return BlockMayMatchPortable(block, hb);
+    }
+
+    size_t bits_per_key_;
+    bool use_avx2_;
+};
+
+}  // namespace
+
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+    return new BlockedBloomFilterPolicy(bits_per_key, CanUseAvx2());
+}
+
+const FilterPolicy* NewPortableBlockedBloomFilterPolicy(int bits_per_key) {
+    return new BlockedBloomFilterPolicy(bits_per_key, false);
+}
+
+}  // namespace massdb
@@ -0,0 +1,18 @@
+//
+// Created by Xsakura on 2023/5/13.
+//
+
+#ifndef MASSDB_UTIL_BLOCKED_BLOOM_H
+#define MASSDB_UTIL_BLOCKED_BLOOM_H
+
+#include "massdb/filter_policy.h"
+
+namespace massdb {
+
+// 与 NewBlockedBloomFilterPolicy() 相同，但探测总是使用可移植的实现，
+// 不使用 AVX2。生成的过滤器完全相同，测试用它检查两种探测的结果一致
+const FilterPolicy* NewPortableBlockedBloomFilterPolicy(int bits_per_key);
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_BLOCKED_BLOOM_H
@@ -0,0 +1,95 @@
+//
+// Created by Xsakura on 2023/5/13.
+//
+
+#include "massdb/filter_policy.h"
+#include "massdb/slice.h"
+#include "util/hash.h"
+
+namespace massdb {
+
+namespace {
+
+static uint32_t BloomHash(const Slice& key) {
+    return Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+// 经典的 Bloom 过滤器，编码与 LevelDB 的 BuiltinBloomFilter2 相同：
+//    bits   : uint8[n]
+//    k      : uint8     // 探测的次数
+class BloomFilterPolicy : public FilterPolicy {
+public:
+    explicit BloomFilterPolicy(int bits_per_key) : bits_per_key_(bits_per_key) {
+        // 有意向下取整以减少探测的开销
+        k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+        if (k_ < 1) k_ = 1;
+        if (k_ > 30) k_ = 30;
+    }
+
+    const char* Name() const override { return "massdb.BuiltinBloomFilter"; }
+
+    void CreateFilter(const Slice* keys, int n,
+                      std::string* dst) const override {
+        // 计算过滤器的大小（比特数和字节数）
+        size_t bits = n * bits_per_key_;
+
+        // n 很小时误判率会非常高，这里强制最少使用 64 比特
+        if (bits < 64) bits = 64;
+
+        size_t bytes = (bits + 7) / 8;
+        bits = bytes * 8;
+
+        const size_t init_size = dst->size();
+        dst->resize(init_size + bytes, 0);
+        dst->push_back(static_cast<char>(k_));  // 记录探测的次数
+        char* array = &(*dst)[init_size];
+        for (int i = 0; i < n; i++) {
+            // 使用双重哈希生成一系列哈希值，
+            // 参见 [Kirsch, Mitzenmacher 2006] 的分析
+            uint32_t h = BloomHash(keys[i]);
+            const uint32_t delta = (h >> 17) | (h << 15);  // 循环右移 17 位
+            for (size_t j = 0; j < k_; j++) {
+                const uint32_t bitpos = h % bits;
+                array[bitpos / 8] |= (1 << (bitpos % 8));
+                h += delta;
+            }
+        }
+    }
+
+    bool KeyMayMatch(const Slice& key,
+                     const Slice& bloom_filter) const override {
+        const size_t len = bloom_filter.size();
+        if (len < 2) return false;
+
+        const char* array = bloom_filter.data();
+        const size_t bits = (len - 1) * 8;
+
+        // 使用编码在过滤器中的 k，这样可以读取使用不同参数创建的过滤器
+        const size_t k = array[len - 1];
+        if (k > 30) {
+            // 保留给将来可能出现的新编码，认为匹配
+            return true;
+        }
+
+        uint32_t h = BloomHash(key);
+        const uint32_t delta = (h >> 17) | (h << 15);  // 循环右移 17 位
+        for (size_t j = 0; j < k; j++) {
+            const uint32_t bitpos = h % bits;
+            if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+            h += delta;
+        }
+        return true;
+    }
+
+private:
+    size_t bits_per_key_;
+    size_t k_;
+};
+
+}  // namespace
+
+const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
+    return new BloomFilterPolicy(bits_per_key);
+}
+
+}  // namespace massdb
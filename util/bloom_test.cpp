@@ -0,0 +1,158 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "massdb/filter_policy.h"
+#include "massdb/slice.h"
+#include "util/blocked_bloom.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+namespace {
+
+std::string Key(int i) {
+    std::string key;
+    PutFixed32(&key, static_cast<uint32_t>(i));
+    return key;
+}
+
+}  // namespace
+
+class BloomTest : public testing::TestWithParam<bool> {
+public:
+    // 参数为 true 时测试分块的过滤器
+    BloomTest()
+        : policy_(GetParam() ? NewBlockedBloomFilterPolicy(10)
+                             : NewBloomFilterPolicy(10)) {}
+
+    void Build(int n) {
+        std::vector<std::string> keys;
+        for (int i = 0; i < n; i++) {
+            keys.push_back(Key(i));
+        }
+        std::vector<Slice> slices(keys.begin(), keys.end());
+        filter_.clear();
+        policy_->CreateFilter(slices.data(), n, &filter_);
+    }
+
+    bool Matches(int i) const { return policy_->KeyMayMatch(Key(i), filter_); }
+
+    // 用没有加入过滤器的 key 估计误判率
+    double FalsePositiveRate() const {
+        int result = 0;
+        for (int i = 0; i < 10000; i++) {
+            if (Matches(i + 1000000000)) {
+                result++;
+            }
+        }
+        return result / 10000.0;
+    }
+
+    std::unique_ptr<const FilterPolicy> policy_;
+    std::string filter_;
+};
+
+TEST_P(BloomTest, EmptyFilter) {
+    Build(0);
+    ASSERT_FALSE(Matches(0));
+    ASSERT_FALSE(Matches(100));
+}
+
+TEST_P(BloomTest, VaryingLengths) {
+    for (int n = 1; n <= 10000; n = n < 10 ? n + 1 : n * 3 / 2) {
+        Build(n);
+        // 过滤器的大小与 key 的数量成正比，加上块的取整和尾部
+        ASSERT_LE(filter_.size(), static_cast<size_t>(n * 10 / 8 + 65))
+            << n;
+
+        // 没有误报的遗漏
+        for (int i = 0; i < n; i++) {
+            ASSERT_TRUE(Matches(i)) << "n " << n << " key " << i;
+        }
+        std::vector<std::string> keys;
+        for (int i = 0; i < n; i++) {
+            keys.push_back(Key(i));
+        }
+        std::vector<Slice> slices(keys.begin(), keys.end());
+        std::unique_ptr<bool[]> results(new bool[n]);
+        policy_->KeysMayMatch(slices.data(), n, filter_, results.get());
+        for (int i = 0; i < n; i++) {
+            ASSERT_TRUE(results[i]) << "n " << n << " key " << i;
+        }
+
+        // 10 bits/key 时两种过滤器的误判率都约为 1%。
+        // key 很少时经典过滤器的比特数太少，误判率更高
+        ASSERT_LE(FalsePositiveRate(), n < 100 ? 0.03 : 0.02) << n;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Policies, BloomTest, testing::Bool());
+
+TEST(BlockedBloomTest, PortableMatchesAvx2) {
+    std::unique_ptr<const FilterPolicy> policy(NewBlockedBloomFilterPolicy(8));
+    std::unique_ptr<const FilterPolicy> portable(
+        NewPortableBlockedBloomFilterPolicy(8));
+    ASSERT_STREQ(policy->Name(), portable->Name());
+
+    for (int n : {1, 100, 5000}) {
+        std::vector<std::string> keys;
+        for (int i = 0; i < n; i++) {
+            keys.push_back(Key(i * 7));
+        }
+        std::vector<Slice> slices(keys.begin(), keys.end());
+        std::string filter, portable_filter;
+        policy->CreateFilter(slices.data(), n, &filter);
+        portable->CreateFilter(slices.data(), n, &portable_filter);
+        ASSERT_EQ(filter, portable_filter);
+
+        // 加入过和没有加入过的 key 混在一起，单个和批量的探测结果都相同
+        std::vector<std::string> probes;
+        for (int i = 0; i < 7 * n + 1000; i++) {
+            probes.push_back(Key(i));
+        }
+        std::vector<Slice> probe_slices(probes.begin(), probes.end());
+        const int m = static_cast<int>(probes.size());
+        std::unique_ptr<bool[]> batch(new bool[m]);
+        std::unique_ptr<bool[]> portable_batch(new bool[m]);
+        policy->KeysMayMatch(probe_slices.data(), m, filter, batch.get());
+        portable->KeysMayMatch(probe_slices.data(), m, filter,
+                               portable_batch.get());
+        int positives = 0;
+        for (int i = 0; i < m; i++) {
+            const bool expected = portable->KeyMayMatch(probes[i], filter);
+            ASSERT_EQ(expected, policy->KeyMayMatch(probes[i], filter)) << i;
+            ASSERT_EQ(expected, batch[i]) << i;
+            ASSERT_EQ(expected, portable_batch[i]) << i;
+            positives += expected;
+        }
+        ASSERT_GE(positives, n);
+        ASSERT_LT(positives, m);
+    }
+}
+
+TEST(BlockedBloomTest, UnknownEncoding) {
+    std::unique_ptr<const FilterPolicy> policy(NewBlockedBloomFilterPolicy(10));
+    std::string filter;
+    const std::string key = Key(1);
+    const Slice keys[] = {key};
+    policy->CreateFilter(keys, 1, &filter);
+    ASSERT_EQ(65u, filter.size());
+    ASSERT_TRUE(policy->KeyMayMatch(key, filter));
+
+    // 长度不是整数个块时不匹配，未知的编码认为匹配
+    ASSERT_FALSE(policy->KeyMayMatch(key, Slice(filter.data(), 64)));
+    std::string unknown(65, '\0');
+    unknown[64] = 0x7f;
+    ASSERT_TRUE(policy->KeyMayMatch(Key(2), unknown));
+    bool result = false;
+    policy->KeysMayMatch(keys, 1, unknown, &result);
+    ASSERT_TRUE(result);
+}
+
+}  // namespace massdb
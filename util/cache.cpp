@@ -0,0 +1,419 @@
+//
+// Created by Xsakura on 2023/5/6.
+//
+
+#include "massdb/cache.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "util/hash.h"
+
+namespace massdb {
+
+Cache::~Cache() = default;
+
+namespace {
+
+// LRU 缓存的实现
+//
+// 缓存中的条目有一个 in_cache 标记，表示缓存是否持有该条目的引用。
+// 只有以下几种情况会使 in_cache 变为 false 而不调用 deleter：
+// 条目被 Erase()，被 Insert() 相同 key 的条目替换，或者缓存被销毁。
+//
+// 缓存维护两个链表，缓存中的每个条目都恰好在其中一个链表上。
+// 被调用者 Erase() 但仍被客户端引用的条目不在任何一个链表上。
+// - in_use_：正在被客户端引用的条目，没有特定的顺序
+//   （这个链表用于检查不变式，被客户端引用的条目的 in_cache 一定为 true，
+//   在此之前它们不能被淘汰）
+// - lru_：没有被客户端引用的条目，按 LRU 顺序排列
+// 当 Ref() 和 Unref() 检测到条目获得或失去唯一的外部引用时，
+// 条目在两个链表之间移动
+
+// 条目是一个变长的、分配在堆上的结构体。
+// 条目按访问时间排列在一个双向循环链表中
+struct LRUHandle {
+    void* value;
+    void (*deleter)(const Slice&, void* value);
+    LRUHandle* next_hash;
+    LRUHandle* next;
+    LRUHandle* prev;
+    size_t charge;
+    size_t key_length;
+    bool in_cache;     // 条目是否在缓存中
+    uint32_t refs;     // 引用计数，包括缓存持有的引用
+    uint32_t hash;     // key() 的哈希值，用于快速分片和比较
+    char key_data[1];  // key 的起始位置
+
+    Slice key() const {
+        // 只有链表头部的空条目的 next 才会等于 this，它没有有效的 key
+        assert(next != this);
+        return Slice(key_data, key_length);
+    }
+};
+
+// 简单的哈希表。
+// 比一些编译器或运行时库自带的哈希表快 5% 左右，
+// 并且不依赖于具体的平台
+class HandleTable {
+public:
+    HandleTable() : length_(0), elems_(0), list_(nullptr) { Resize(); }
+    ~HandleTable() { delete[] list_; }
+
+    LRUHandle* Lookup(const Slice& key, uint32_t hash) {
+        return *FindPointer(key, hash);
+    }
+
+    LRUHandle* Insert(LRUHandle* h) {
+        LRUHandle** ptr = FindPointer(h->key(), h->hash);
+        LRUHandle* old = *ptr;
+        h->next_hash = (old == nullptr ? nullptr : old->next_hash);
+        *ptr = h;
+        if (old == nullptr) {
+            ++elems_;
+            if (elems_ > length_) {
+                // 每个条目都比较大，所以让哈希表的平均长度不超过 1
+                Resize();
+            }
+        }
+        return old;
+    }
+
+    LRUHandle* Remove(const Slice& key, uint32_t hash) {
+        LRUHandle** ptr = FindPointer(key, hash);
+        LRUHandle* result = *ptr;
+        if (result != nullptr) {
+            *ptr = result->next_hash;
+            --elems_;
+        }
+        return result;
+    }
+
+private:
+    // 返回指向 key/hash 对应的位置的指针。
+    // 如果有匹配的条目，返回指向它的指针，
+    // 否则返回指向对应链表末尾的空指针的指针
+    LRUHandle** FindPointer(const Slice& key, uint32_t hash) {
+        LRUHandle** ptr = &list_[hash & (length_ - 1)];
+        while (*ptr != nullptr &&
+               ((*ptr)->hash != hash || key != (*ptr)->key())) {
+            ptr = &(*ptr)->next_hash;
+        }
+        return ptr;
+    }
+
+    void Resize() {
+        uint32_t new_length = 4;
+        while (new_length < elems_) {
+            new_length *= 2;
+        }
+        LRUHandle** new_list = new LRUHandle*[new_length];
+        std::memset(new_list, 0, sizeof(new_list[0]) * new_length);
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < length_; i++) {
+            LRUHandle* h = list_[i];
+            while (h != nullptr) {
+                LRUHandle* next = h->next_hash;
+                uint32_t hash = h->hash;
+                LRUHandle** ptr = &new_list[hash & (new_length - 1)];
+                h->next_hash = *ptr;
+                *ptr = h;
+                h = next;
+                count++;
+            }
+        }
+        assert(elems_ == count);
+        delete[] list_;
+        list_ = new_list;
+        length_ = new_length;
+    }
+
+    // 哈希表由一组桶组成，每个桶是一个链表
+    uint32_t length_;
+    uint32_t elems_;
+    LRUHandle** list_;
+};
+
+// 分片缓存中的一个分片
+class LRUCache {
+public:
+    LRUCache();
+    ~LRUCache();
+
+    // 与构造函数分开，这样调用者可以方便地创建 LRUCache 数组
+    void SetCapacity(size_t capacity) { capacity_ = capacity; }
+
+    // 与 Cache 中的方法类似，但多了一个 hash 参数
+    Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                          size_t charge,
+                          void (*deleter)(const Slice& key, void* value));
+    Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+    void Release(Cache::Handle* handle);
+    void Erase(const Slice& key, uint32_t hash);
+    void Prune();
+    size_t TotalCharge() const {
+        std::lock_guard<std::mutex> l(mutex_);
+        return usage_;
+    }
+
+private:
+    void LRU_Remove(LRUHandle* e);
+    void LRU_Append(LRUHandle* list, LRUHandle* e);
+    void Ref(LRUHandle* e);
+    void Unref(LRUHandle* e);
+    bool FinishErase(LRUHandle* e);
+    // 从最旧的条目开始淘汰 lru_ 中的条目，直到使用量不超过容量。
+    // 要求：持有 mutex_
+    void EvictOverCapacity();
+
+    // 在使用之前初始化
+    size_t capacity_;
+
+    // mutex_ 保护下面的状态
+    mutable std::mutex mutex_;
+    size_t usage_;
+
+    // LRU 链表的空头部。
+    // lru_.prev 是最新的条目，lru_.next 是最旧的条目。
+    // 链表中的条目 refs == 1 且 in_cache == true
+    LRUHandle lru_;
+
+    // in_use_ 链表的空头部。
+    // 链表中的条目正在被客户端引用，refs >= 2 且 in_cache == true
+    LRUHandle in_use_;
+
+    HandleTable table_;
+};
+
+LRUCache::LRUCache() : capacity_(0), usage_(0) {
+    // 初始化空的循环链表
+    lru_.next = &lru_;
+    lru_.prev = &lru_;
+    in_use_.next = &in_use_;
+    in_use_.prev = &in_use_;
+}
+
+LRUCache::~LRUCache() {
+    assert(in_use_.next == &in_use_);  // 调用者还有没释放的句柄
+    for (LRUHandle* e = lru_.next; e != &lru_;) {
+        LRUHandle* next = e->next;
+        assert(e->in_cache);
+        e->in_cache = false;
+        assert(e->refs == 1);  // lru_ 中的条目不变式
+        Unref(e);
+        e = next;
+    }
+}
+
+void LRUCache::Ref(LRUHandle* e) {
+    if (e->refs == 1 && e->in_cache) {  // 如果在 lru_ 中，移动到 in_use_ 中
+        LRU_Remove(e);
+        LRU_Append(&in_use_, e);
+    }
+    e->refs++;
+}
+
+void LRUCache::Unref(LRUHandle* e) {
+    assert(e->refs > 0);
+    e->refs--;
+    if (e->refs == 0) {  // 释放条目
+        assert(!e->in_cache);
+        (*e->deleter)(e->key(), e->value);
+        free(e);
+    } else if (e->in_cache && e->refs == 1) {
+        // 不再被客户端引用，移动到 lru_ 中
+        LRU_Remove(e);
+        LRU_Append(&lru_, e);
+    }
+}
+
+void LRUCache::LRU_Remove(LRUHandle* e) {
+    e->next->prev = e->prev;
+    e->prev->next = e->next;
+}
+
+void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
+    // 将 e 作为最新的条目插入到 *list 之前
+    e->next = list;
+    e->prev = list->prev;
+    e->prev->next = e;
+    e->next->prev = e;
+}
+
+Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
+    std::lock_guard<std::mutex> l(mutex_);
+    LRUHandle* e = table_.Lookup(key, hash);
+    if (e != nullptr) {
+        Ref(e);
+    }
+    return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void LRUCache::EvictOverCapacity() {
+    while (usage_ > capacity_ && lru_.next != &lru_) {
+        LRUHandle* old = lru_.next;
+        assert(old->refs == 1);
+        bool erased = FinishErase(table_.Remove(old->key(), old->hash));
+        if (!erased) {  // 避免编译器关于未使用变量的警告
+            assert(erased);
+        }
+    }
+}
+
+void LRUCache::Release(Cache::Handle* handle) {
+    std::lock_guard<std::mutex> l(mutex_);
+    Unref(reinterpret_cast<LRUHandle*>(handle));
+    // 所有条目都被引用时插入会超过容量，
+    // 这些条目被释放后立即淘汰，而不是等到下一次插入
+    EvictOverCapacity();
+}
+
+Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
+                                size_t charge,
+                                void (*deleter)(const Slice& key,
+                                                void* value)) {
+    std::lock_guard<std::mutex> l(mutex_);
+
+    LRUHandle* e = reinterpret_cast<LRUHandle*>(
+        malloc(sizeof(LRUHandle) - 1 + key.size()));
+    e->value = value;
+    e->deleter = deleter;
+    e->charge = charge;
+    e->key_length = key.size();
+    e->hash = hash;
+    e->in_cache = false;
+    e->refs = 1;  // 返回的句柄持有的引用
+    std::memcpy(e->key_data, key.data(), key.size());
+
+    if (capacity_ > 0) {
+        e->refs++;  // 缓存持有的引用
+        e->in_cache = true;
+        LRU_Append(&in_use_, e);
+        usage_ += charge;
+        FinishErase(table_.Insert(e));
+    } else {
+        // capacity_ == 0 表示关闭缓存。
+        // 使用的是 next 字段，所以这里需要初始化它
+        e->next = nullptr;
+    }
+    EvictOverCapacity();
+
+    return reinterpret_cast<Cache::Handle*>(e);
+}
+
+// 如果 e != nullptr，完成将 e 从缓存中删除的工作。
+// e 已经从哈希表中移除了。返回 e 是否不为 nullptr
+bool LRUCache::FinishErase(LRUHandle* e) {
+    if (e != nullptr) {
+        assert(e->in_cache);
+        LRU_Remove(e);
+        e->in_cache = false;
+        usage_ -= e->charge;
+        Unref(e);
+    }
+    return e != nullptr;
+}
+
+void LRUCache::Erase(const Slice& key, uint32_t hash) {
+    std::lock_guard<std::mutex> l(mutex_);
+    FinishErase(table_.Remove(key, hash));
+}
+
+void LRUCache::Prune() {
+    std::lock_guard<std::mutex> l(mutex_);
+    while (lru_.next != &lru_) {
+        LRUHandle* e = lru_.next;
+        assert(e->refs == 1);
+        bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+        if (!erased) {  // 避免编译器关于未使用变量的警告
+            assert(erased);
+        }
+    }
+}
+
+static const int kNumShardBits = 4;
+static const int kNumShards = 1 << kNumShardBits;
+// 容量很小时减少分片，让每个分片至少能容纳这么多个单位的 charge
+static const size_t kMinShardCapacity = 4;
+
+// 按 key 的哈希值将条目分配到最多 kNumShards 个分片中，每个分片有自己的锁
+class ShardedLRUCache : public Cache {
+public:
+    // 各分片的容量之和恰好是 capacity，余数分给前面的分片。
+    // 向上取整会让总容量最多多出 kNumShards - 1，
+    // 对 TableCache 来说就是超出 max_open_files 的打开文件
+    explicit ShardedLRUCache(size_t capacity)
+        : shard_bits_(kNumShardBits), last_id_(0) {
+        while (shard_bits_ > 0 &&
+               (capacity >> shard_bits_) < kMinShardCapacity) {
+            shard_bits_--;
+        }
+        const size_t num_shards = size_t(1) << shard_bits_;
+        for (size_t s = 0; s < num_shards; s++) {
+            shard_[s].SetCapacity(capacity / num_shards +
+                                  (s < capacity % num_shards ? 1 : 0));
+        }
+    }
+
+    ~ShardedLRUCache() override = default;
+
+    Handle* Insert(const Slice& key, void* value, size_t charge,
+                   void (*deleter)(const Slice& key, void* value)) override {
+        const uint32_t hash = HashSlice(key);
+        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    }
+    Handle* Lookup(const Slice& key) override {
+        const uint32_t hash = HashSlice(key);
+        return shard_[Shard(hash)].Lookup(key, hash);
+    }
+    void Release(Handle* handle) override {
+        LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
+        shard_[Shard(h->hash)].Release(handle);
+    }
+    void Erase(const Slice& key) override {
+        const uint32_t hash = HashSlice(key);
+        shard_[Shard(hash)].Erase(key, hash);
+    }
+    void* Value(Handle* handle) override {
+        return reinterpret_cast<LRUHandle*>(handle)->value;
+    }
+    uint64_t NewId() override {
+        std::lock_guard<std::mutex> l(id_mutex_);
+        return ++(last_id_);
+    }
+    void Prune() override {
+        for (int s = 0; s < kNumShards; s++) {
+            shard_[s].Prune();
+        }
+    }
+    size_t TotalCharge() const override {
+        size_t total = 0;
+        for (int s = 0; s < kNumShards; s++) {
+            total += shard_[s].TotalCharge();
+        }
+        return total;
+    }
+
+private:
+    static inline uint32_t HashSlice(const Slice& s) {
+        return Hash(s.data(), s.size(), 0);
+    }
+
+    // 使用哈希值的高位选择分片，低位留给分片内的哈希表
+    uint32_t Shard(uint32_t hash) const {
+        return shard_bits_ == 0 ? 0 : hash >> (32 - shard_bits_);
+    }
+
+    int shard_bits_;  // 实际使用的分片是 shard_[0, 2^shard_bits_)
+    LRUCache shard_[kNumShards];
+    std::mutex id_mutex_;
+    uint64_t last_id_;
+};
+
+}  // namespace
+
+Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+
+}  // namespace massdb
@@ -0,0 +1,379 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "massdb/cache.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "massdb/env.h"
+#include "massdb/iterator.h"
+#include "massdb/options.h"
+#include "massdb/table.h"
+#include "massdb/table_builder.h"
+#include "util/coding.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+namespace {
+
+std::string EncodeKey(int k) {
+    std::string result;
+    PutFixed32(&result, static_cast<uint32_t>(k));
+    return result;
+}
+
+int DecodeKey(const Slice& k) {
+    assert(k.size() == 4);
+    return static_cast<int>(DecodeFixed32(k.data()));
+}
+
+void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
+
+int DecodeValue(void* v) {
+    return static_cast<int>(reinterpret_cast<uintptr_t>(v));
+}
+
+}  // namespace
+
+class CacheTest : public testing::Test {
+public:
+    static const int kCacheSize = 1000;
+
+    CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+
+    // 记录被释放的条目
+    static void Deleter(const Slice& key, void* v) {
+        current_->deleted_keys_.push_back(DecodeKey(key));
+        current_->deleted_values_.push_back(DecodeValue(v));
+    }
+
+    int Lookup(int key) {
+        Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
+        const int r =
+            (handle == nullptr) ? -1 : DecodeValue(cache_->Value(handle));
+        if (handle != nullptr) {
+            cache_->Release(handle);
+        }
+        return r;
+    }
+
+    void Insert(int key, int value, int charge = 1) {
+        cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value),
+                                       charge, &CacheTest::Deleter));
+    }
+
+    Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
+        return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                              &CacheTest::Deleter);
+    }
+
+    void Erase(int key) { cache_->Erase(EncodeKey(key)); }
+
+    static CacheTest* current_;
+
+    std::vector<int> deleted_keys_;
+    std::vector<int> deleted_values_;
+    std::unique_ptr<Cache> cache_;
+};
+
+const int CacheTest::kCacheSize;
+CacheTest* CacheTest::current_;
+
+TEST_F(CacheTest, HitAndMiss) {
+    ASSERT_EQ(-1, Lookup(100));
+
+    Insert(100, 101);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1, Lookup(200));
+    ASSERT_EQ(-1, Lookup(300));
+
+    Insert(200, 201);
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(-1, Lookup(300));
+
+    // 相同 key 的新条目替换旧条目，旧条目被释放
+    Insert(100, 102);
+    ASSERT_EQ(102, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(-1, Lookup(300));
+
+    ASSERT_EQ(1u, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST_F(CacheTest, Erase) {
+    Erase(200);
+    ASSERT_EQ(0u, deleted_keys_.size());
+
+    Insert(100, 101);
+    Insert(200, 201);
+    Erase(100);
+    ASSERT_EQ(-1, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(1u, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+
+    Erase(100);
+    ASSERT_EQ(-1, Lookup(100));
+    ASSERT_EQ(201, Lookup(200));
+    ASSERT_EQ(1u, deleted_keys_.size());
+}
+
+TEST_F(CacheTest, EntriesArePinned) {
+    Insert(100, 101);
+    Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+    ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+    Insert(100, 102);
+    Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+    ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+    ASSERT_EQ(0u, deleted_keys_.size());
+
+    // 被替换或删除的条目在句柄释放之后才被释放
+    cache_->Release(h1);
+    ASSERT_EQ(1u, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[0]);
+    ASSERT_EQ(101, deleted_values_[0]);
+
+    Erase(100);
+    ASSERT_EQ(-1, Lookup(100));
+    ASSERT_EQ(1u, deleted_keys_.size());
+
+    cache_->Release(h2);
+    ASSERT_EQ(2u, deleted_keys_.size());
+    ASSERT_EQ(100, deleted_keys_[1]);
+    ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST_F(CacheTest, EvictionPolicy) {
+    Insert(100, 101);
+    Insert(200, 201);
+    Insert(300, 301);
+    Cache::Handle* h = cache_->Lookup(EncodeKey(300));
+
+    // 经常访问的条目和被引用的条目不会被淘汰
+    for (int i = 0; i < kCacheSize + 100; i++) {
+        Insert(1000 + i, 2000 + i);
+        ASSERT_EQ(2000 + i, Lookup(1000 + i));
+        ASSERT_EQ(101, Lookup(100));
+    }
+    ASSERT_EQ(101, Lookup(100));
+    ASSERT_EQ(-1, Lookup(200));
+    ASSERT_EQ(301, Lookup(300));
+    cache_->Release(h);
+}
+
+TEST_F(CacheTest, HeavyEntries) {
+    // 混合插入开销为 1 和 10 的条目，总开销不超过容量
+    const int kLight = 1;
+    const int kHeavy = 10;
+    int added = 0;
+    int index = 0;
+    while (added < 2 * kCacheSize) {
+        const int weight = (index & 1) ? kLight : kHeavy;
+        Insert(index, 1000 + index, weight);
+        added += weight;
+        index++;
+    }
+
+    int cached_weight = 0;
+    for (int i = 0; i < index; i++) {
+        const int weight = (i & 1 ? kLight : kHeavy);
+        const int r = Lookup(i);
+        if (r >= 0) {
+            cached_weight += weight;
+            ASSERT_EQ(1000 + i, r);
+        }
+    }
+    ASSERT_LE(cached_weight, kCacheSize);
+    ASSERT_EQ(static_cast<size_t>(cached_weight), cache_->TotalCharge());
+}
+
+TEST_F(CacheTest, ZeroCapacity) {
+    // 容量为 0 时关闭缓存，插入返回的句柄仍然可以使用
+    cache_.reset(NewLRUCache(0));
+    Cache::Handle* h = InsertAndReturnHandle(1, 100);
+    ASSERT_EQ(100, DecodeValue(cache_->Value(h)));
+    ASSERT_EQ(-1, Lookup(1));
+    cache_->Release(h);
+    ASSERT_EQ(1u, deleted_keys_.size());
+    ASSERT_EQ(0u, cache_->TotalCharge());
+}
+
+TEST_F(CacheTest, Prune) {
+    Insert(1, 100);
+    Insert(2, 200);
+    Cache::Handle* h = cache_->Lookup(EncodeKey(1));
+    ASSERT_NE(nullptr, h);
+    cache_->Prune();
+    cache_->Release(h);
+
+    ASSERT_EQ(100, Lookup(1));
+    ASSERT_EQ(-1, Lookup(2));
+}
+
+TEST_F(CacheTest, NewId) {
+    const uint64_t a = cache_->NewId();
+    const uint64_t b = cache_->NewId();
+    ASSERT_NE(a, b);
+}
+
+// 多个线程同时插入、查找和删除。每个分片有自己的锁，
+// 没有被引用的条目的总开销任何时候都不超过容量
+TEST(CacheConcurrencyTest, CapacityBound) {
+    const size_t kCapacity = 4096;
+    const int kThreads = 4;
+    const int kOps = 20000;
+    const int kMaxCharge = 16;
+    std::unique_ptr<Cache> cache(NewLRUCache(kCapacity));
+    static std::atomic<int> live;
+    live.store(0);
+    auto deleter = [](const Slice&, void*) {
+        live.fetch_sub(1);
+    };
+
+    std::atomic<bool> exceeded(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t]() {
+            Random rnd(301 + t);
+            for (int i = 0; i < kOps; i++) {
+                const std::string key = EncodeKey(rnd.Uniform(5000));
+                switch (rnd.Uniform(4)) {
+                    case 0:
+                    case 1: {
+                        live.fetch_add(1);
+                        Cache::Handle* h =
+                            cache->Insert(key, EncodeValue(i),
+                                          1 + rnd.Uniform(kMaxCharge), deleter);
+                        cache->Release(h);
+                        break;
+                    }
+                    case 2: {
+                        Cache::Handle* h = cache->Lookup(key);
+                        if (h != nullptr) {
+                            cache->Release(h);
+                        }
+                        break;
+                    }
+                    default:
+                        cache->Erase(key);
+                        break;
+                }
+                // 其他线程最多各持有一个句柄
+                if (cache->TotalCharge() >
+                    kCapacity + kThreads * kMaxCharge) {
+                    exceeded.store(true);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    ASSERT_FALSE(exceeded.load());
+    ASSERT_LE(cache->TotalCharge(), kCapacity);
+    ASSERT_GT(cache->TotalCharge(), 0u);
+
+    // 每个条目都恰好释放一次
+    cache->Prune();
+    ASSERT_EQ(0u, cache->TotalCharge());
+    ASSERT_EQ(0, live.load());
+}
+
+class CacheFillTest : public testing::Test {
+public:
+    CacheFillTest()
+        : env_(Env::Default()),
+          dir_(test::NewTestDirectory("cache_test")),
+          cache_(NewLRUCache(1 << 20)),
+          file_(nullptr),
+          table_(nullptr) {
+        env_->CreateDir(dir_);
+    }
+
+    ~CacheFillTest() override {
+        delete table_;
+        delete file_;
+        test::DestroyDirectory(env_, dir_);
+    }
+
+    // 写入 n 个条目的 table 文件，使用 cache_ 作为块缓存打开
+    void Build(int n) {
+        Options options;
+        options.block_size = 256;
+        options.compression = kNoCompression;
+        const std::string fname = dir_ + "/000001.sst";
+        WritableFile* file;
+        ASSERT_TRUE(env_->NewWritableFile(fname, &file).IsOk());
+        TableBuilder builder(options, file);
+        for (int i = 0; i < n; i++) {
+            char key[16];
+            std::snprintf(key, sizeof(key), "key%06d", i);
+            builder.Add(key, std::string(50, 'v'));
+        }
+        ASSERT_TRUE(builder.Finish().IsOk());
+        ASSERT_TRUE(file->Close().IsOk());
+        delete file;
+
+        options.block_cache = cache_.get();
+        uint64_t size;
+        ASSERT_TRUE(env_->GetFileSize(fname, &size).IsOk());
+        ASSERT_TRUE(env_->NewRandomAccessFile(fname, &file_).IsOk());
+        ASSERT_TRUE(Table::Open(options, file_, size, &table_).IsOk());
+    }
+
+    // 读取 [from, to) 中的条目
+    void Scan(bool fill_cache, const char* from, const char* to) {
+        ReadOptions options;
+        options.fill_cache = fill_cache;
+        std::unique_ptr<Iterator> iter(table_->NewIterator(options));
+        int n = 0;
+        for (iter->Seek(from); iter->Valid() && iter->key().compare(to) < 0;
+             iter->Next()) {
+            n++;
+        }
+        ASSERT_TRUE(iter->status().IsOk());
+        ASSERT_GT(n, 0);
+    }
+
+    Env* const env_;
+    const std::string dir_;
+    std::unique_ptr<Cache> cache_;
+    RandomAccessFile* file_;
+    Table* table_;
+};
+
+TEST_F(CacheFillTest, FillCacheFalseDoesNotInsert) {
+    Build(2000);
+
+    // 不填充缓存的扫描读取所有块，缓存保持为空
+    Scan(false, "", "\xff");
+    ASSERT_EQ(0u, cache_->TotalCharge());
+
+    // 热点块放入缓存后，批量扫描既不插入也不淘汰它们
+    Scan(true, "key000100", "key000200");
+    const size_t hot = cache_->TotalCharge();
+    ASSERT_GT(hot, 0u);
+    Scan(false, "", "\xff");
+    ASSERT_EQ(hot, cache_->TotalCharge());
+
+    // 填充缓存的扫描插入所有块
+    Scan(true, "", "\xff");
+    ASSERT_GT(cache_->TotalCharge(), hot);
+}
+
+}  // namespace massdb
@@ -0,0 +1,130 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#ifndef MASSDB_UTIL_CODING_H
+#define MASSDB_UTIL_CODING_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "massdb/slice.h"
+
+namespace massdb {
+
+// 编码规则参考 leveldb：
+//    定长整数按小端序存放；
+//    变长整数（varint）每个字节低 7 位存数据，最高位表示后面是否还有字节。
+
+// 向 string 末尾追加编码后的整数
+void PutFixed32(std::string* dst, uint32_t value);
+void PutFixed64(std::string* dst, uint64_t value);
+void PutVarint32(std::string* dst, uint32_t value);
+void PutVarint64(std::string* dst, uint64_t value);
+// 追加 varint32 长度前缀以及 value 本身
+void PutLengthPrefixedSlice(std::string* dst, const Slice& value);
+
+// 从 input 的开头解析整数，并将 input 前移越过已解析的部分。
+// 解析失败返回 false
+bool GetVarint32(Slice* input, uint32_t* value);
+bool GetVarint64(Slice* input, uint64_t* value);
+bool GetLengthPrefixedSlice(Slice* input, Slice* result);
+
+// 从 [p, limit) 中解析 varint，返回指向解析后下一个字节的指针。
+// 出错时返回 nullptr
+const char* GetVarint32Ptr(const char* p, const char* limit, uint32_t* v);
+const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* v);
+
+// 返回 v 编码成 varint 后占用的字节数
+int VarintLength(uint64_t v);
+
+// 将 varint 写入 dst，返回写入后的下一个位置。
+// 要求：dst 有足够的空间
+char* EncodeVarint32(char* dst, uint32_t value);
+char* EncodeVarint64(char* dst, uint64_t value);
+
+// 将定长整数写入 dst。要求：dst 有足够的空间
+inline void EncodeFixed32(char* dst, uint32_t value) {
+    uint8_t* const buffer = reinterpret_cast<uint8_t*>(dst);
+    buffer[0] = static_cast<uint8_t>(value);
+    buffer[1] = static_cast<uint8_t>(value >> 8);
+    buffer[2] = static_cast<uint8_t>(value >> 16);
+    buffer[3] = static_cast<uint8_t>(value >> 24);
+}
+
+inline void EncodeFixed64(char* dst, uint64_t value) {
+    uint8_t* const buffer = reinterpret_cast<uint8_t*>(dst);
+    for (int i = 0; i < 8; i++) {
+        buffer[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+// 读取定长整数。编译器会把这些循环优化成一条 load 指令
+inline uint32_t DecodeFixed32(const char* ptr) {
+    const uint8_t* const buffer = reinterpret_cast<const uint8_t*>(ptr);
+    return (static_cast<uint32_t>(buffer[0])) |
+           (static_cast<uint32_t>(buffer[1]) << 8) |
+           (static_cast<uint32_t>(buffer[2]) << 16) |
+           (static_cast<uint32_t>(buffer[3]) << 24);
+}
+
+inline uint64_t DecodeFixed64(const char* ptr) {
+    const uint8_t* const buffer = reinterpret_cast<const uint8_t*>(ptr);
+    uint64_t result = 0;
+    for (int i = 7; i >= 0; i--) {
+        result = (result << 8) | static_cast<uint64_t>(buffer[i]);
+    }
+    return result;
+}
+
+// 将 value 按大端序写入 dst 开头的 8 个字节。
+// 大端序编码的无符号整数按 memcmp 字典序比较的结果与数值大小一致
+inline void EncodeBigEndian64(char* dst, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        dst[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+// 将 ptr 开头的 min(n, 8) 个字节按大端序读成一个 64 位整数，不足 8 字节的部分补 0。
+// 这样对于两段字节串 a、b，当它们的前缀整数不相等时，
+// 前缀整数的大小关系与 memcmp 字典序的大小关系一致
+inline uint64_t DecodeBigEndianPrefix(const char* ptr, size_t n) {
+    if (n >= 8) {
+        uint64_t result;
+        std::memcpy(&result, ptr, sizeof(result));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        result = __builtin_bswap64(result);
+#endif
+        return result;
+    }
+    const uint8_t* const buffer = reinterpret_cast<const uint8_t*>(ptr);
+    uint64_t result = 0;
+    for (size_t i = 0; i < 8; i++) {
+        result <<= 8;
+        if (i < n) result |= buffer[i];
+    }
+    return result;
+}
+
+// GetVarint32Ptr 的慢路径，处理多字节的情况
+const char* GetVarint32PtrFallback(const char* p, const char* limit,
+                                   uint32_t* value);
+
+inline const char* GetVarint32Ptr(const char* p, const char* limit,
+                                  uint32_t* value) {
+    if (p < limit) {
+        uint32_t result = *(reinterpret_cast<const uint8_t*>(p));
+        // 绝大多数长度前缀都小于 128，只有一个字节
+        if ((result & 128) == 0) {
+            *value = result;
+            return p + 1;
+        }
+    }
+    return GetVarint32PtrFallback(p, limit, value);
+}
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_CODING_H
@@ -4,8 +4,12 @@
 
 #include "massdb/comparator.h"
 
+#include <algorithm>
+#include <cstdint>
+
 #include "massdb/slice.h"
 
+#include "util/key_compare.h"
 #include "util/no_destructor.h"
 
 namespace massdb {
@@ -19,7 +23,7 @@ public:
     const char* Name() const override { return "massdb.BytewiseComparator"; }
 
     int Compare(const Slice& a, const Slice& b) const override {
-        return a.compare(b);
+        return BytewiseKeyCompare()(a, b);
     }
 
     // 获取 start 和 limit 的共同前缀长度
@@ -60,10 +64,27 @@ public:
     }
 };
 
+// 谱图 key 的顺序就是字节序，分隔 key 的计算与 BytewiseComparator() 相同
+class SpectrumKeyComparatorImpl : public BytewiseComparatorImpl {
+public:
+    const char* Name() const override {
+        return "massdb.SpectrumKeyComparator";
+    }
+
+    int Compare(const Slice& a, const Slice& b) const override {
+        return SpectrumKeyCompare()(a, b);
+    }
+};
+
 }  // namespace
 
 const Comparator* BytewiseComparator() {
     static NoDestructor<BytewiseComparatorImpl> singleton;
     return singleton.get();
 }
+
+const Comparator* SpectrumKeyComparator() {
+    static NoDestructor<SpectrumKeyComparatorImpl> singleton;
+    return singleton.get();
+}
 }  // namespace massdb
@@ -0,0 +1,275 @@
+//
+// Created by Xsakura on 2023/5/20.
+//
+
+#include "util/compression.h"
+
+#if HAVE_SNAPPY
+#include <snappy.h>
+#endif
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_LZ4
+#include <lz4.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <climits>
+#include <cstdint>
+
+#include "util/coding.h"
+#include "util/no_destructor.h"
+#include "util/spectrum_codec.h"
+
+namespace massdb {
+
+namespace {
+
+#if HAVE_SNAPPY
+class SnappyCodec : public CompressionCodec {
+public:
+    CompressionType type() const override { return kSnappyCompression; }
+    const char* Name() const override { return "Snappy"; }
+
+    bool Compress(const Slice& input, int level,
+                  std::string* output) const override {
+        const size_t base = output->size();
+        output->resize(base + snappy::MaxCompressedLength(input.size()));
+        size_t outlen;
+        snappy::RawCompress(input.data(), input.size(), &(*output)[base],
+                            &outlen);
+        output->resize(base + outlen);
+        return true;
+    }
+
+    bool Uncompress(const Slice& input, char* output,
+                    size_t n) const override {
+        size_t ulength;
+        if (!snappy::GetUncompressedLength(input.data(), input.size(),
+                                           &ulength) ||
+            ulength != n) {
+            return false;
+        }
+        return snappy::RawUncompress(input.data(), input.size(), output);
+    }
+};
+#endif  // HAVE_SNAPPY
+
+#if HAVE_ZLIB
+class ZlibCodec : public CompressionCodec {
+public:
+    CompressionType type() const override { return kZlibCompression; }
+    const char* Name() const override { return "Zlib"; }
+
+    bool Compress(const Slice& input, int level,
+                  std::string* output) const override {
+        // zlib 的级别 0 表示不压缩，这里用 0 表示默认级别
+        if (level == 0) level = Z_DEFAULT_COMPRESSION;
+        const size_t base = output->size();
+        uLongf outlen = compressBound(input.size());
+        output->resize(base + outlen);
+        int ret = compress2(reinterpret_cast<Bytef*>(&(*output)[base]),
+                            &outlen,
+                            reinterpret_cast<const Bytef*>(input.data()),
+                            input.size(), level);
+        if (ret != Z_OK) return false;
+        output->resize(base + outlen);
+        return true;
+    }
+
+    bool Uncompress(const Slice& input, char* output,
+                    size_t n) const override {
+        uLongf outlen = n;
+        int ret = uncompress(reinterpret_cast<Bytef*>(output), &outlen,
+                             reinterpret_cast<const Bytef*>(input.data()),
+                             input.size());
+        return ret == Z_OK && outlen == n;
+    }
+};
+#endif  // HAVE_ZLIB
+
+#if HAVE_LZ4
+class LZ4Codec : public CompressionCodec {
+public:
+    CompressionType type() const override { return kLZ4Compression; }
+    const char* Name() const override { return "LZ4"; }
+
+    bool Compress(const Slice& input, int level,
+                  std::string* output) const override {
+        if (input.size() > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+            return false;
+        }
+        const int n = static_cast<int>(input.size());
+        const int bound = LZ4_compressBound(n);
+        const size_t base = output->size();
+        output->resize(base + bound);
+        int outlen = LZ4_compress_default(input.data(), &(*output)[base], n,
+                                          bound);
+        if (outlen <= 0) return false;
+        output->resize(base + outlen);
+        return true;
+    }
+
+    bool Uncompress(const Slice& input, char* output,
+                    size_t n) const override {
+        if (input.size() > INT_MAX || n > INT_MAX) return false;
+        int ret = LZ4_decompress_safe(input.data(), output,
+                                      static_cast<int>(input.size()),
+                                      static_cast<int>(n));
+        return ret >= 0 && static_cast<size_t>(ret) == n;
+    }
+};
+#endif  // HAVE_LZ4
+
+#if HAVE_ZSTD
+// 每个线程缓存一组 zstd 的上下文。
+// ZSTD_compress()/ZSTD_decompress() 每次调用都会创建新的上下文，
+// 对于几 KB 大小的块，创建上下文的开销比解压本身还要大
+struct ZstdContexts {
+    ZstdContexts() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) {}
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+
+    ZSTD_CCtx* const cctx;
+    ZSTD_DCtx* const dctx;
+};
+
+static ZstdContexts* ThreadZstdContexts() {
+    static thread_local ZstdContexts contexts;
+    return &contexts;
+}
+
+class ZstdCodec : public CompressionCodec {
+public:
+    CompressionType type() const override { return kZstdCompression; }
+    const char* Name() const override { return "Zstd"; }
+
+    bool Compress(const Slice& input, int level,
+                  std::string* output) const override {
+        // ZSTD_compressCCtx() 的级别 0 即为默认级别
+        const size_t bound = ZSTD_compressBound(input.size());
+        const size_t base = output->size();
+        output->resize(base + bound);
+        size_t outlen =
+            ZSTD_compressCCtx(ThreadZstdContexts()->cctx, &(*output)[base],
+                              bound, input.data(), input.size(), level);
+        if (ZSTD_isError(outlen)) return false;
+        output->resize(base + outlen);
+        return true;
+    }
+
+    bool Uncompress(const Slice& input, char* output,
+                    size_t n) const override {
+        size_t ret = ZSTD_decompressDCtx(ThreadZstdContexts()->dctx, output,
+                                         n, input.data(), input.size());
+        return !ZSTD_isError(ret) && ret == n;
+    }
+};
+#endif  // HAVE_ZSTD
+
+// 以 CompressionType 为下标的注册表，只包含编译进来的算法
+class CodecRegistry {
+public:
+    CodecRegistry() : codecs_() {
+#if HAVE_SNAPPY
+        Register(new SnappyCodec);
+#endif
+#if HAVE_ZLIB
+        Register(new ZlibCodec);
+#endif
+#if HAVE_LZ4
+        Register(new LZ4Codec);
+#endif
+#if HAVE_ZSTD
+        Register(new ZstdCodec);
+#endif
+        Register(NewSpectrumCodec());
+    }
+
+    const CompressionCodec* Get(CompressionType type) const {
+        return codecs_[static_cast<unsigned char>(type)];
+    }
+
+private:
+    void Register(const CompressionCodec* codec) {
+        codecs_[static_cast<unsigned char>(codec->type())] = codec;
+    }
+
+    // 注册的实现在进程退出前一直有效
+    const CompressionCodec* codecs_[256];
+};
+
+const CodecRegistry* Registry() {
+    static NoDestructor<CodecRegistry> registry;
+    return registry.get();
+}
+
+}  // namespace
+
+const CompressionCodec* GetCompressionCodec(CompressionType type) {
+    return Registry()->Get(type);
+}
+
+CompressionType SupportedCompression(CompressionType type) {
+    if (type == kNoCompression || type == kDisableCompressionOption ||
+        GetCompressionCodec(type) != nullptr) {
+        return type;
+    }
+    static const CompressionType kFast[] = {kLZ4Compression,
+                                            kSnappyCompression,
+                                            kZstdCompression};
+    static const CompressionType kStrong[] = {
+        kZstdCompression, kZlibCompression, kLZ4Compression,
+        kSnappyCompression};
+    // zlib 的速度太慢，不作为快速算法的替代
+    const bool strong = (type == kZlibCompression || type == kZstdCompression);
+    const CompressionType* begin = strong ? kStrong : kFast;
+    const CompressionType* end =
+        strong ? kStrong + sizeof(kStrong) / sizeof(kStrong[0])
+               : kFast + sizeof(kFast) / sizeof(kFast[0]);
+    for (const CompressionType* p = begin; p != end; ++p) {
+        if (GetCompressionCodec(*p) != nullptr) {
+            return *p;
+        }
+    }
+    return kNoCompression;
+}
+
+bool CompressBlock(CompressionType type, int level, const Slice& raw,
+                   std::string* output) {
+    const CompressionCodec* codec = GetCompressionCodec(type);
+    if (codec == nullptr || raw.size() > UINT32_MAX) {
+        return false;
+    }
+    output->clear();
+    PutVarint32(output, static_cast<uint32_t>(raw.size()));
+    return codec->Compress(raw, level, output);
+}
+
+Status UncompressBlock(CompressionType type, const Slice& input,
+                       char** result, size_t* n) {
+    const CompressionCodec* codec = GetCompressionCodec(type);
+    if (codec == nullptr) {
+        return Status::NotSupported("compression type not supported");
+    }
+    Slice payload = input;
+    uint32_t raw_size;
+    if (!GetVarint32(&payload, &raw_size)) {
+        return Status::Corruption("bad compressed block length");
+    }
+    char* buf = new char[raw_size];
+    if (!codec->Uncompress(payload, buf, raw_size)) {
+        delete[] buf;
+        return Status::Corruption("corrupted compressed block contents");
+    }
+    *result = buf;
+    *n = raw_size;
+    return Status::Ok();
+}
+
+}  // namespace massdb
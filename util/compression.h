@@ -0,0 +1,67 @@
+//
+// Created by Xsakura on 2023/5/20.
+//
+
+#ifndef MASSDB_UTIL_COMPRESSION_H
+#define MASSDB_UTIL_COMPRESSION_H
+
+#include <cstddef>
+#include <string>
+
+#include "massdb/options.h"
+#include "massdb/slice.h"
+#include "massdb/status.h"
+
+namespace massdb {
+
+// 块压缩算法的接口，每个 CompressionType 对应一个实现。
+// TableBuilder 和 ReadBlock() 都通过 GetCompressionCodec() 查找实现，
+// 新的算法只需要在 compression.cpp 的注册表中加入一项。
+//
+// 实现必须是线程安全的
+class CompressionCodec {
+public:
+    virtual ~CompressionCodec() = default;
+
+    virtual CompressionType type() const = 0;
+    virtual const char* Name() const = 0;
+
+    // 将 input 压缩后追加到 *output 中。
+    // level 为 0 时使用算法默认的压缩级别，不支持级别的算法会忽略它。
+    // 失败时返回 false，*output 中可能有部分内容
+    virtual bool Compress(const Slice& input, int level,
+                          std::string* output) const = 0;
+
+    // 将 input 解压到 output[0, n)，n 为原始数据的长度。
+    // 数据损坏或者解压后的长度不为 n 时返回 false
+    virtual bool Uncompress(const Slice& input, char* output,
+                            size_t n) const = 0;
+};
+
+// 返回 type 对应的实现。
+// type 为 kNoCompression，或者对应的库没有编译进来时返回 nullptr
+const CompressionCodec* GetCompressionCodec(CompressionType type);
+
+// 返回实际可用的压缩算法：type 编译进来时返回 type 本身，
+// 否则按相近的特性选择替代的算法。
+// 快速的算法（Snappy、LZ4）依次尝试 LZ4、Snappy、Zstd，都没有时不压缩；
+// 压缩率高的算法（zlib、Zstd）依次尝试 Zstd、zlib、LZ4、Snappy。
+// kNoCompression 和 kDisableCompressionOption 原样返回
+CompressionType SupportedCompression(CompressionType type);
+
+// 压缩后的块的格式：
+//    raw_size : varint32   // 解压后的长度
+//    payload  : char[]     // 压缩算法的输出
+//
+// 将 raw 压缩成上述格式存入 *output。算法不可用或压缩失败时返回 false
+bool CompressBlock(CompressionType type, int level, const Slice& raw,
+                   std::string* output);
+
+// 解压 CompressBlock() 生成的数据。
+// 成功时 *result 指向 new[] 分配的内存，长度存入 *n，调用者负责 delete[]
+Status UncompressBlock(CompressionType type, const Slice& input,
+                       char** result, size_t* n);
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_COMPRESSION_H
@@ -0,0 +1,210 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "util/compression.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "massdb/env.h"
+#include "massdb/options.h"
+#include "massdb/table_builder.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace massdb {
+
+namespace {
+
+const CompressionType kAllTypes[] = {kSnappyCompression, kZlibCompression,
+                                     kLZ4Compression, kZstdCompression,
+                                     kSpectrumCompression};
+
+// 编译进来的所有算法
+std::vector<CompressionType> RegisteredTypes() {
+    std::vector<CompressionType> types;
+    for (CompressionType type : kAllTypes) {
+        if (GetCompressionCodec(type) != nullptr) {
+            types.push_back(type);
+        }
+    }
+    return types;
+}
+
+// 由 n 条记录组成的数据块，value 中 random 比例的内容是随机的，其余重复
+std::string BuildBlock(Random* rnd, int n, double random) {
+    Options options;
+    BlockBuilder builder(&options);
+    for (int i = 0; i < n; i++) {
+        char key[16];
+        std::snprintf(key, sizeof(key), "key%06d", i);
+        const int len = 100;
+        const int random_len = static_cast<int>(len * random);
+        std::string value = test::RandomString(rnd, random_len);
+        value.append(len - random_len, 'v');
+        builder.Add(key, value);
+    }
+    return builder.Finish().to_string();
+}
+
+}  // namespace
+
+TEST(CompressionTest, RoundTrip) {
+    Random rnd(301);
+    const std::string inputs[] = {
+        BuildBlock(&rnd, 1, 0.5), BuildBlock(&rnd, 200, 0.0),
+        BuildBlock(&rnd, 200, 0.5), BuildBlock(&rnd, 200, 1.0)};
+    for (CompressionType type : RegisteredTypes()) {
+        const CompressionCodec* codec = GetCompressionCodec(type);
+        ASSERT_EQ(type, codec->type());
+        for (const std::string& raw : inputs) {
+            for (int level : {0, 1, 9}) {
+                std::string compressed;
+                ASSERT_TRUE(CompressBlock(type, level, raw, &compressed))
+                    << codec->Name();
+                char* result;
+                size_t n;
+                ASSERT_TRUE(
+                    UncompressBlock(type, compressed, &result, &n).IsOk())
+                    << codec->Name();
+                ASSERT_EQ(raw, std::string(result, n)) << codec->Name();
+                delete[] result;
+            }
+        }
+
+        // 重复的内容一定能压缩，kSpectrumCompression 只压缩质谱 value
+        std::string compressed;
+        ASSERT_TRUE(CompressBlock(type, 0, inputs[1], &compressed));
+        if (type != kSpectrumCompression) {
+            ASSERT_LT(compressed.size(), inputs[1].size() / 2)
+                << codec->Name();
+        }
+
+        // 截断的数据解压失败
+        ASSERT_TRUE(CompressBlock(type, 0, inputs[2], &compressed));
+        for (size_t len = 0; len < compressed.size(); len += 7) {
+            char* result;
+            size_t n;
+            Status s = UncompressBlock(type, Slice(compressed.data(), len),
+                                       &result, &n);
+            ASSERT_FALSE(s.IsOk()) << codec->Name() << " length " << len;
+        }
+    }
+}
+
+TEST(CompressionTest, UnsupportedType) {
+    std::string compressed;
+    ASSERT_FALSE(CompressBlock(kNoCompression, 0, "abc", &compressed));
+    char* result;
+    size_t n;
+    ASSERT_TRUE(UncompressBlock(static_cast<CompressionType>(0x7f), "\x03xyz",
+                                &result, &n)
+                    .IsNotSupportedError());
+}
+
+TEST(CompressionTest, SupportedCompression) {
+    ASSERT_EQ(kNoCompression, SupportedCompression(kNoCompression));
+    ASSERT_EQ(kDisableCompressionOption,
+              SupportedCompression(kDisableCompressionOption));
+    for (CompressionType type : kAllTypes) {
+        const CompressionType actual = SupportedCompression(type);
+        if (GetCompressionCodec(type) != nullptr) {
+            ASSERT_EQ(type, actual);
+            continue;
+        }
+        // 替代的算法必须可用；快速的算法不会被替换成 zlib
+        ASSERT_TRUE(actual == kNoCompression ||
+                    GetCompressionCodec(actual) != nullptr);
+        if (type == kSnappyCompression || type == kLZ4Compression) {
+            ASSERT_NE(kZlibCompression, actual);
+        } else if (GetCompressionCodec(kZlibCompression) != nullptr) {
+            ASSERT_NE(kNoCompression, actual);
+        }
+    }
+}
+
+class CompressionMinSavingsTest : public testing::Test {
+public:
+    CompressionMinSavingsTest()
+        : env_(Env::Default()),
+          dir_(test::NewTestDirectory("compression_test")) {
+        env_->CreateDir(dir_);
+    }
+
+    ~CompressionMinSavingsTest() override {
+        test::DestroyDirectory(env_, dir_);
+    }
+
+    // 用 options 把 n 条记录写成一个数据块，返回块尾部记录的压缩类型
+    CompressionType StoredType(const Options& options, int n, double random) {
+        WritableFile* file;
+        EXPECT_TRUE(
+            env_->NewWritableFile(dir_ + "/000001.sst", &file).IsOk());
+        TableBuilder builder(options, file);
+        Random rnd(301);
+        for (int i = 0; i < n; i++) {
+            char key[16];
+            std::snprintf(key, sizeof(key), "key%06d", i);
+            const int len = 100;
+            const int random_len = static_cast<int>(len * random);
+            std::string value = test::RandomString(&rnd, random_len);
+            value.append(len - random_len, 'v');
+            builder.Add(key, value);
+        }
+        builder.Flush();
+        const uint64_t block_end = builder.FileSize();
+        EXPECT_TRUE(builder.Finish().IsOk());
+        EXPECT_TRUE(file->Close().IsOk());
+        delete file;
+
+        std::string contents;
+        EXPECT_TRUE(
+            ReadFileToString(env_, dir_ + "/000001.sst", &contents).IsOk());
+        return static_cast<CompressionType>(
+            contents[block_end - kBlockTrailerSize]);
+    }
+
+    Env* const env_;
+    const std::string dir_;
+};
+
+TEST_F(CompressionMinSavingsTest, Threshold) {
+    for (CompressionType type : RegisteredTypes()) {
+        if (type == kSpectrumCompression) {
+            continue;  // 只压缩质谱 value，普通的块没有收益
+        }
+        Options options;
+        options.block_size = 1 << 20;
+        options.compression = type;
+
+        // 实际节省的比例，与 TableBuilder 写入的块相同
+        Random rnd(301);
+        const std::string raw = BuildBlock(&rnd, 200, 0.5);
+        std::string compressed;
+        ASSERT_TRUE(CompressBlock(type, 0, raw, &compressed));
+        const double savings =
+            1.0 - static_cast<double>(compressed.size()) / raw.size();
+        ASSERT_GT(savings, 0.05);
+
+        options.compression_min_savings = savings - 0.02;
+        ASSERT_EQ(type, StoredType(options, 200, 0.5));
+        options.compression_min_savings = savings + 0.02;
+        ASSERT_EQ(kNoCompression, StoredType(options, 200, 0.5));
+        options.compression_min_savings = 0;
+        ASSERT_EQ(type, StoredType(options, 200, 0.0));
+
+        // 不可用的算法以及不压缩时存储原始内容
+        options.compression = kNoCompression;
+        ASSERT_EQ(kNoCompression, StoredType(options, 200, 0.0));
+    }
+    Options options;
+    options.compression = static_cast<CompressionType>(0x7f);
+    ASSERT_EQ(kNoCompression, StoredType(options, 200, 0.0));
+}
+
+}  // namespace massdb
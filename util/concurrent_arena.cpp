@@ -0,0 +1,120 @@
+//
+// Created by Xsakura on 2023/4/15.
+//
+
+#include "util/concurrent_arena.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace massdb {
+
+// chunk 的大小取块大小的 1/8，并限制在下面的范围内。
+// 太大的话每个分片浪费在尾部的空间会变多
+static const size_t kMinShardChunkSize = 512;
+static const size_t kMaxShardChunkSize = 128 * 1024;
+
+ConcurrentArena::ConcurrentArena(size_t block_size, size_t huge_page_size)
+    : shard_chunk_size_(std::min(
+          kMaxShardChunkSize, std::max(kMinShardChunkSize, block_size / 8))),
+      large_usage_(0),
+      arena_(block_size, huge_page_size) {
+    // 分片数量取不小于 CPU 核心数的 2 的幂，便于用掩码取模
+    unsigned int cores = std::thread::hardware_concurrency();
+    size_t num_shards = 1;
+    while (num_shards < cores) {
+        num_shards <<= 1;
+    }
+    shard_mask_ = num_shards - 1;
+    shards_.reset(new Shard[num_shards]);
+}
+
+ConcurrentArena::Shard* ConcurrentArena::CurrentShard() {
+    int cpu = sched_getcpu();
+    if (cpu < 0) {
+        // 不支持 sched_getcpu() 时按线程划分
+        static thread_local size_t tid =
+            std::hash<std::thread::id>()(std::this_thread::get_id());
+        return &shards_[tid & shard_mask_];
+    }
+    return &shards_[static_cast<size_t>(cpu) & shard_mask_];
+}
+
+char* ConcurrentArena::AllocateFromChunk(Chunk* chunk, size_t bytes,
+                                         bool aligned) {
+    if (chunk == nullptr) {
+        return nullptr;
+    }
+    const size_t align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+    size_t used = chunk->used.load(std::memory_order_relaxed);
+    size_t start;
+    do {
+        // chunk->base 本身是对齐的，所以只需要对齐偏移量
+        start = aligned ? ((used + align - 1) & ~(align - 1)) : used;
+        if (start + bytes > chunk->size) {
+            return nullptr;
+        }
+        // CAS 失败时 used 会被更新为最新值，重新计算即可
+    } while (!chunk->used.compare_exchange_weak(used, start + bytes,
+                                                std::memory_order_relaxed));
+    return chunk->base + start;
+}
+
+char* ConcurrentArena::AllocateImpl(size_t bytes, bool aligned) {
+    assert(bytes > 0);
+    if (bytes > shard_chunk_size_ / 4) {
+        // 大块内存单独申请，避免浪费分片中剩余的空间。
+        // new[] 返回的内存满足任何基本类型的对齐要求
+        return AllocateLarge(bytes);
+    }
+
+    Shard* shard = CurrentShard();
+    Chunk* chunk = shard->chunk.load(std::memory_order_acquire);
+    char* result = AllocateFromChunk(chunk, bytes, aligned);
+    if (result != nullptr) {
+        return result;
+    }
+    return AllocateSlow(shard, chunk, bytes, aligned);
+}
+
+char* ConcurrentArena::AllocateLarge(size_t bytes) {
+    // 申请内存时不持有任何锁
+    std::unique_ptr<char[]> block(new char[bytes]);
+    char* result = block.get();
+    Shard* shard = CurrentShard();
+    {
+        std::lock_guard<std::mutex> l(shard->large_mutex);
+        shard->large_blocks.push_back(std::move(block));
+    }
+    large_usage_.fetch_add(bytes + sizeof(char*), std::memory_order_relaxed);
+    return result;
+}
+
+char* ConcurrentArena::AllocateSlow(Shard* shard, Chunk* old_chunk,
+                                    size_t bytes, bool aligned) {
+    std::lock_guard<std::mutex> l(mutex_);
+    // 等锁期间其他线程可能已经为这个分片换上了新的 chunk
+    Chunk* chunk = shard->chunk.load(std::memory_order_acquire);
+    if (chunk != old_chunk) {
+        char* result = AllocateFromChunk(chunk, bytes, aligned);
+        if (result != nullptr) {
+            return result;
+        }
+    }
+
+    // 旧 chunk 尾部剩余的空间直接丢弃，它最多只有 bytes 个字节
+    char* memory = arena_.AllocateAligned(sizeof(Chunk) + shard_chunk_size_);
+    chunk = new (memory) Chunk(memory + sizeof(Chunk), shard_chunk_size_);
+    char* result = AllocateFromChunk(chunk, bytes, aligned);
+    assert(result != nullptr);
+    // 使用 release 发布，保证其他线程看到的 chunk 已经完全初始化
+    shard->chunk.store(chunk, std::memory_order_release);
+    return result;
+}
+
+}  // namespace massdb
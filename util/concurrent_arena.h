@@ -0,0 +1,107 @@
+//
+// Created by Xsakura on 2023/4/15.
+//
+
+#ifndef MASSDB_UTIL_CONCURRENT_ARENA_H
+#define MASSDB_UTIL_CONCURRENT_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "util/allocator.h"
+#include "util/arena.h"
+
+namespace massdb {
+
+// 线程安全的内存分配类，供多个写者并发插入 MemTable 时使用。
+//
+// 内部按 CPU 核心划分为多个分片，每个分片持有一段从 Arena 中切出的
+// 连续内存（chunk）。常规大小的分配只需要在当前核心对应的分片上
+// 做一次 CAS，不需要加锁；只有分片的 chunk 用完时才会加锁向底层的
+// Arena 申请内存。
+// 比 chunk 的 1/4 大的分配（例如几十到几百 KB 的峰列表）单独申请一块
+// 内存，申请时不持有锁，只在登记到当前分片时短暂地加分片自己的锁，
+// 不同核心上的大块分配互不阻塞。
+class ConcurrentArena : public Allocator {
+public:
+    explicit ConcurrentArena(size_t block_size = Arena::kMinBlockSize,
+                             size_t huge_page_size = 0);
+    ~ConcurrentArena() override = default;
+
+    ConcurrentArena(const ConcurrentArena&) = delete;
+    ConcurrentArena& operator=(const ConcurrentArena&) = delete;
+
+    char* Allocate(size_t bytes) override {
+        return AllocateImpl(bytes, false);
+    }
+    char* AllocateAligned(size_t bytes) override {
+        return AllocateImpl(bytes, true);
+    }
+
+    size_t BlockSize() const override { return arena_.BlockSize(); }
+
+    // 返回已经向系统申请的内存总量。
+    // 分片中的 chunk 都是从 arena_ 中分配的，大块内存单独计数，
+    // 所以这里和 Arena 一样精确
+    size_t memory_usage() const {
+        return arena_.memory_usage() +
+               large_usage_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // 分片当前用于分配的一段连续内存，本身也分配在 arena_ 中
+    struct Chunk {
+        Chunk(char* b, size_t s) : base(b), size(s), used(0) {}
+
+        char* const base;
+        const size_t size;
+        std::atomic<size_t> used;  // 已经分配出去的字节数
+    };
+
+    // 每个分片的 chunk 独占一条缓存行，避免不同核心之间的伪共享
+    struct Shard {
+        Shard() : chunk(nullptr) {}
+
+        std::atomic<Chunk*> chunk;
+        char padding[64 - sizeof(std::atomic<Chunk*>)];
+
+        // 在这个分片上分配的大块内存，由 large_mutex 保护
+        std::mutex large_mutex;
+        std::vector<std::unique_ptr<char[]>> large_blocks;
+    };
+
+    char* AllocateImpl(size_t bytes, bool aligned);
+
+    // 单独申请一块 bytes 字节的内存，登记到当前分片
+    char* AllocateLarge(size_t bytes);
+
+    // 尝试在 chunk 中无锁地分配，空间不足时返回 nullptr
+    static char* AllocateFromChunk(Chunk* chunk, size_t bytes, bool aligned);
+
+    // 加锁为 shard 换一个新的 chunk 并在其中分配
+    char* AllocateSlow(Shard* shard, Chunk* old_chunk, size_t bytes,
+                       bool aligned);
+
+    // 返回当前线程所在 CPU 核心对应的分片
+    Shard* CurrentShard();
+
+    // 每个分片一次从 arena_ 中切出的 chunk 大小
+    const size_t shard_chunk_size_;
+
+    size_t shard_mask_;  // 分片数量 - 1，分片数量是 2 的幂
+    std::unique_ptr<Shard[]> shards_;
+
+    // 所有分片中大块内存的总量
+    std::atomic<size_t> large_usage_;
+
+    // 保护 arena_
+    std::mutex mutex_;
+    Arena arena_;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_CONCURRENT_ARENA_H
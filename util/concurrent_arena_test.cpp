@@ -0,0 +1,110 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "util/concurrent_arena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/random.h"
+
+namespace massdb {
+
+namespace {
+
+// 一次分配：地址、大小以及填充的字节
+struct Allocation {
+    char* ptr;
+    size_t size;
+    char fill;
+    bool aligned;
+};
+
+// 大小从几个字节到 200KB：常规大小的分配来自分片的 chunk，
+// 大块分配（例如峰列表）单独申请
+size_t RandomSize(Random* rnd) {
+    switch (rnd->Uniform(4)) {
+        case 0:
+            return 1 + rnd->Uniform(64);
+        case 1:
+            return 64 + rnd->Uniform(1024);
+        case 2:
+            return 5 * 1024 + rnd->Uniform(20 * 1024);
+        default:
+            return 50 * 1024 + rnd->Uniform(150 * 1024);
+    }
+}
+
+void CheckAllocations(const std::vector<Allocation>& allocations) {
+    for (const Allocation& a : allocations) {
+        if (a.aligned) {
+            ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(a.ptr) & 7);
+        }
+        const std::string expected(a.size, a.fill);
+        ASSERT_EQ(0, std::memcmp(expected.data(), a.ptr, a.size)) << a.size;
+    }
+}
+
+}  // namespace
+
+TEST(ConcurrentArenaTest, MixedSizes) {
+    ConcurrentArena arena(4096);
+    Random rnd(301);
+    std::vector<Allocation> allocations;
+    size_t total = 0;
+    for (int i = 0; i < 500; i++) {
+        const size_t size = RandomSize(&rnd);
+        const bool aligned = rnd.OneIn(2);
+        char* ptr = aligned ? arena.AllocateAligned(size) : arena.Allocate(size);
+        const char fill = static_cast<char>(i);
+        std::memset(ptr, fill, size);
+        allocations.push_back(Allocation{ptr, size, fill, aligned});
+        total += size;
+        ASSERT_GE(arena.memory_usage(), total);
+    }
+    CheckAllocations(allocations);
+    // 大块分配不会在分片中留下大量浪费的空间
+    ASSERT_LE(arena.memory_usage(), total + total / 4 + 64 * 1024);
+}
+
+TEST(ConcurrentArenaTest, ConcurrentMixedSizes) {
+    const int kThreads = 8;
+    const int kAllocations = 300;
+    ConcurrentArena arena(4096);
+    std::vector<std::vector<Allocation>> allocations(kThreads);
+    std::vector<size_t> totals(kThreads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&arena, &allocations, &totals, t]() {
+            Random rnd(301 + t);
+            for (int i = 0; i < kAllocations; i++) {
+                const size_t size = RandomSize(&rnd);
+                const bool aligned = rnd.OneIn(2);
+                char* ptr = aligned ? arena.AllocateAligned(size)
+                                    : arena.Allocate(size);
+                const char fill = static_cast<char>(t * kAllocations + i);
+                std::memset(ptr, fill, size);
+                allocations[t].push_back(Allocation{ptr, size, fill, aligned});
+                totals[t] += size;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // 不同线程得到的内存互不重叠：每次分配填充的内容都没有被覆盖
+    size_t total = 0;
+    for (int t = 0; t < kThreads; t++) {
+        CheckAllocations(allocations[t]);
+        total += totals[t];
+    }
+    ASSERT_GE(arena.memory_usage(), total);
+}
+
+}  // namespace massdb
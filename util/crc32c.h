@@ -0,0 +1,41 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#ifndef MASSDB_UTIL_CRC32C_H
+#define MASSDB_UTIL_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace massdb {
+namespace crc32c {
+
+// 返回 concat(A, data[0,n-1]) 的 crc32c，其中 init_crc 是某个字符串 A 的 crc32c。
+// 通常用于计算一个数据流的 crc32c
+uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
+
+// 返回 data[0,n-1] 的 crc32c
+inline uint32_t Value(const char* data, size_t n) { return Extend(0, data, n); }
+
+static const uint32_t kMaskDelta = 0xa282ead8ul;
+
+// 返回 crc 的掩码形式。
+//
+// 对包含 crc 的字符串再计算 crc 容易出问题，
+// 所以存储到文件中的 crc 都要先做掩码处理
+inline uint32_t Mask(uint32_t crc) {
+    // 循环右移 15 位再加上一个常数
+    return ((crc >> 15) | (crc << 17)) + kMaskDelta;
+}
+
+// Mask() 的逆操作
+inline uint32_t Unmask(uint32_t masked_crc) {
+    uint32_t rot = masked_crc - kMaskDelta;
+    return ((rot >> 17) | (rot << 15));
+}
+
+}  // namespace crc32c
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_CRC32C_H
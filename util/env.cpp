@@ -0,0 +1,89 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include "massdb/env.h"
+
+#include "massdb/slice.h"
+
+namespace massdb {
+
+Env::~Env() = default;
+
+SequentialFile::~SequentialFile() = default;
+
+RandomAccessFile::~RandomAccessFile() = default;
+
+Status Env::NewMmapReadableFile(const std::string& fname,
+                                RandomAccessFile** result) {
+    return NewRandomAccessFile(fname, result);
+}
+
+void Env::MultiRead(ReadRequest* requests, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        ReadRequest* r = &requests[i];
+        r->status = r->file->Read(r->offset, r->n, &r->result, r->scratch);
+    }
+}
+
+WritableFile::~WritableFile() = default;
+
+FileLock::~FileLock() = default;
+
+static Status DoWriteStringToFile(Env* env, const Slice& data,
+                                  const std::string& fname, bool should_sync) {
+    WritableFile* file;
+    Status s = env->NewWritableFile(fname, &file);
+    if (!s.IsOk()) {
+        return s;
+    }
+    s = file->Append(data);
+    if (s.IsOk() && should_sync) {
+        s = file->Sync();
+    }
+    if (s.IsOk()) {
+        s = file->Close();
+    }
+    delete file;  // 即使 Close 失败也要释放
+    if (!s.IsOk()) {
+        env->RemoveFile(fname);
+    }
+    return s;
+}
+
+Status WriteStringToFile(Env* env, const Slice& data,
+                         const std::string& fname) {
+    return DoWriteStringToFile(env, data, fname, false);
+}
+
+Status WriteStringToFileSync(Env* env, const Slice& data,
+                             const std::string& fname) {
+    return DoWriteStringToFile(env, data, fname, true);
+}
+
+Status ReadFileToString(Env* env, const std::string& fname, std::string* data) {
+    data->clear();
+    SequentialFile* file;
+    Status s = env->NewSequentialFile(fname, &file);
+    if (!s.IsOk()) {
+        return s;
+    }
+    static const int kBufferSize = 8192;
+    char* space = new char[kBufferSize];
+    while (true) {
+        Slice fragment;
+        s = file->Read(kBufferSize, &fragment, space);
+        if (!s.IsOk()) {
+            break;
+        }
+        data->append(fragment.data(), fragment.size());
+        if (fragment.empty()) {
+            break;
+        }
+    }
+    delete[] space;
+    delete file;
+    return s;
+}
+
+}  // namespace massdb
@@ -0,0 +1,974 @@
+//
+// Created by Xsakura on 2023/4/22.
+//
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+// IORING_OP_READ 从 Linux 5.6 开始提供，更旧的头文件中不使用 io_uring
+#if !defined(__NR_io_uring_setup) || !defined(IORING_FEAT_RW_CUR_POS)
+#undef HAVE_IO_URING
+#endif
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "massdb/env.h"
+#include "massdb/slice.h"
+#include "util/no_destructor.h"
+
+namespace massdb {
+
+namespace {
+
+// 写文件时使用的缓冲区大小
+constexpr const size_t kWritableFileBufferSize = 65536;
+
+// 没有 io_uring 时，MultiRead() 最多使用这么多个读取线程并行执行 pread()，
+// 以便同时向存储设备发出多个请求
+constexpr const int kMaxReadThreads = 16;
+
+Status PosixError(const std::string& context, int error_number) {
+    if (error_number == ENOENT) {
+        return Status::NotFound(context, std::strerror(error_number));
+    } else {
+        return Status::IOError(context, std::strerror(error_number));
+    }
+}
+
+// RandomAccessFile::AccessPattern 对应的 posix_fadvise() 参数
+int FileAdvice(RandomAccessFile::AccessPattern pattern) {
+    switch (pattern) {
+        case RandomAccessFile::kRandom:
+            return POSIX_FADV_RANDOM;
+        case RandomAccessFile::kSequential:
+            return POSIX_FADV_SEQUENTIAL;
+        case RandomAccessFile::kWillNeed:
+            return POSIX_FADV_WILLNEED;
+        case RandomAccessFile::kDontNeed:
+            return POSIX_FADV_DONTNEED;
+        default:
+            return POSIX_FADV_NORMAL;
+    }
+}
+
+// RandomAccessFile::AccessPattern 对应的 madvise() 参数
+int MmapAdvice(RandomAccessFile::AccessPattern pattern) {
+    switch (pattern) {
+        case RandomAccessFile::kRandom:
+            return MADV_RANDOM;
+        case RandomAccessFile::kSequential:
+            return MADV_SEQUENTIAL;
+        case RandomAccessFile::kWillNeed:
+            return MADV_WILLNEED;
+        case RandomAccessFile::kDontNeed:
+            return MADV_DONTNEED;
+        default:
+            return MADV_NORMAL;
+    }
+}
+
+class PosixSequentialFile final : public SequentialFile {
+public:
+    PosixSequentialFile(std::string filename, int fd)
+        : fd_(fd), filename_(std::move(filename)) {}
+    ~PosixSequentialFile() override { close(fd_); }
+
+    Status Read(size_t n, Slice* result, char* scratch) override {
+        Status status;
+        while (true) {
+            ::ssize_t read_size = ::read(fd_, scratch, n);
+            if (read_size < 0) {
+                if (errno == EINTR) {
+                    continue;  // 被信号中断，重试
+                }
+                status = PosixError(filename_, errno);
+                break;
+            }
+            *result = Slice(scratch, read_size);
+            break;
+        }
+        return status;
+    }
+
+    Status Skip(uint64_t n) override {
+        if (::lseek(fd_, n, SEEK_CUR) == static_cast<off_t>(-1)) {
+            return PosixError(filename_, errno);
+        }
+        return Status::Ok();
+    }
+
+private:
+    const int fd_;
+    const std::string filename_;
+};
+
+// 使用 pread() 随机读取的文件，文件描述符在对象的整个生命周期内保持打开
+class PosixRandomAccessFile final : public RandomAccessFile {
+public:
+    PosixRandomAccessFile(std::string filename, int fd)
+        : fd_(fd), filename_(std::move(filename)) {}
+    ~PosixRandomAccessFile() override { close(fd_); }
+
+    Status Read(uint64_t offset, size_t n, Slice* result,
+                char* scratch) const override {
+        Status status;
+        ssize_t read_size =
+            ::pread(fd_, scratch, n, static_cast<off_t>(offset));
+        *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
+        if (read_size < 0) {
+            status = PosixError(filename_, errno);
+        }
+        return status;
+    }
+
+    void Hint(AccessPattern pattern) override {
+        // 提示失败不影响正确性，忽略错误
+        ::posix_fadvise(fd_, 0, 0, FileAdvice(pattern));
+    }
+
+    void HintRange(AccessPattern pattern, uint64_t offset,
+                   uint64_t n) override {
+        // Linux 上 kRandom 和 kSequential 作用于整个打开的文件
+        ::posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(n),
+                        FileAdvice(pattern));
+    }
+
+    int fd() const { return fd_; }
+
+private:
+    const int fd_;
+    const std::string filename_;
+};
+
+// 通过 mmap 读取的文件。Read() 直接返回指向映射区域的 Slice，不复制数据，
+// 映射在对象的整个生命周期内保持有效
+class PosixMmapReadableFile final : public RandomAccessFile {
+public:
+    // mmap_base[0, length - 1] 是文件的只读映射，析构时 munmap
+    PosixMmapReadableFile(std::string filename, char* mmap_base, size_t length)
+        : mmap_base_(mmap_base),
+          length_(length),
+          filename_(std::move(filename)) {}
+    ~PosixMmapReadableFile() override {
+        ::munmap(static_cast<void*>(mmap_base_), length_);
+    }
+
+    Status Read(uint64_t offset, size_t n, Slice* result,
+                char* scratch) const override {
+        if (offset > length_ || n > length_ - offset) {
+            *result = Slice();
+            return PosixError(filename_, EINVAL);
+        }
+        *result = Slice(mmap_base_ + offset, n);
+        return Status::Ok();
+    }
+
+    void Hint(AccessPattern pattern) override {
+        // 提示失败不影响正确性，忽略错误
+        ::madvise(static_cast<void*>(mmap_base_), length_,
+                  MmapAdvice(pattern));
+    }
+
+    void HintRange(AccessPattern pattern, uint64_t offset,
+                   uint64_t n) override {
+        if (offset >= length_) {
+            return;
+        }
+        const uint64_t end =
+            (n == 0 || n > length_ - offset) ? length_ : offset + n;
+        // madvise() 要求起始地址按页对齐，mmap_base_ 本身是对齐的
+        static const uint64_t kPageSize = ::sysconf(_SC_PAGESIZE);
+        const uint64_t start = offset - offset % kPageSize;
+        ::madvise(static_cast<void*>(mmap_base_ + start), end - start,
+                  MmapAdvice(pattern));
+    }
+
+private:
+    char* const mmap_base_;
+    const size_t length_;
+    const std::string filename_;
+};
+
+// 按 RandomAccessFile::Read() 的语义完成一个读取请求
+void ReadDirectly(ReadRequest* r) {
+    r->status = r->file->Read(r->offset, r->n, &r->result, r->scratch);
+}
+
+#if HAVE_IO_URING
+// 通过 io_uring 一次提交多个 pread 请求，只需要一次系统调用，
+// 请求在存储设备上并行执行。直接使用系统调用，不依赖 liburing。
+// 提交队列不是线程安全的，每个线程使用自己的实例
+class IoUring {
+public:
+    // 返回当前线程的实例。内核不支持（或者禁止使用）io_uring 时返回 nullptr，
+    // 之后所有线程都不会再尝试
+    static IoUring* ThisThread() {
+        static std::atomic<bool> unavailable(false);
+        thread_local std::unique_ptr<IoUring> ring;
+        if (ring == nullptr && !unavailable.load(std::memory_order_relaxed)) {
+            ring.reset(new IoUring);
+            if (!ring->Init()) {
+                ring.reset();
+                unavailable.store(true, std::memory_order_relaxed);
+            }
+        }
+        return ring.get();
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (sqes_ != nullptr) ::munmap(sqes_, sqes_size_);
+        if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+            ::munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != nullptr) ::munmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ >= 0) ::close(ring_fd_);
+    }
+
+    // 读取 requests[0, n - 1]，要求它们的文件都是 PosixRandomAccessFile。
+    // 返回时所有请求都已经完成
+    void Read(ReadRequest* const* requests, size_t n);
+
+private:
+    // 队列的长度，更多的请求分批提交
+    static const unsigned kEntries = 64;
+
+    IoUring()
+        : ring_fd_(-1),
+          sq_ring_(nullptr),
+          cq_ring_(nullptr),
+          sqes_(nullptr) {}
+
+    bool Init();
+
+    // 完成一个请求：res 是 pread 的返回值或者 -errno
+    static void Complete(ReadRequest* r, int res);
+
+    // 将已经放入提交队列的请求交给内核，并等待至少一个请求完成。
+    // 成功时返回 true
+    bool Enter(unsigned to_submit);
+
+    int ring_fd_;
+    unsigned sq_entries_;
+
+    void* sq_ring_;
+    size_t sq_ring_size_;
+    void* cq_ring_;
+    size_t cq_ring_size_;
+    io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    // 提交队列，头部由内核移动，尾部由我们移动
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_;
+    unsigned* sq_array_;
+
+    // 完成队列，头部由我们移动，尾部由内核移动
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+};
+
+bool IoUring::Init() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, kEntries, &params));
+    if (ring_fd_ < 0) {
+        return false;
+    }
+    sq_entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    void* p = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    sq_ring_ = p;
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        p = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        cq_ring_ = p;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    p = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(p);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void IoUring::Complete(ReadRequest* r, int res) {
+    if (res < 0) {
+        // 出错（包括内核不支持 IORING_OP_READ）时用 pread 重新读取，
+        // 由它给出带文件名的错误
+        ReadDirectly(r);
+        return;
+    }
+    const size_t done = static_cast<size_t>(res);
+    if (done < r->n && done > 0) {
+        // 只读取了一部分，剩余的部分用 pread 读取（到达文件末尾时读不到）
+        Slice rest;
+        r->status = r->file->Read(r->offset + done, r->n - done, &rest,
+                                  r->scratch + done);
+        r->result = Slice(r->scratch, done + rest.size());
+        return;
+    }
+    r->result = Slice(r->scratch, done);
+    r->status = Status::Ok();
+}
+
+bool IoUring::Enter(unsigned to_submit) {
+    while (true) {
+        const long ret =
+            ::syscall(__NR_io_uring_enter, ring_fd_, to_submit, 1,
+                      IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret >= 0) {
+            return true;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return false;
+        }
+        // 被信号中断时没有提交任何请求，重试
+    }
+}
+
+void IoUring::Read(ReadRequest* const* requests, size_t n) {
+    size_t next = 0;      // 下一个要放入提交队列的请求
+    size_t inflight = 0;  // 已经放入提交队列、还没有完成的请求
+    while (next < n || inflight > 0) {
+        // 填充提交队列。请求的 user_data 是它在 requests 中的下标
+        unsigned tail = *sq_tail_;
+        while (next < n && inflight < sq_entries_) {
+            const ReadRequest* r = requests[next];
+            const unsigned index = tail & sq_mask_;
+            io_uring_sqe* sqe = &sqes_[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd =
+                static_cast<const PosixRandomAccessFile*>(r->file)->fd();
+            sqe->addr = reinterpret_cast<uint64_t>(r->scratch);
+            sqe->len = static_cast<uint32_t>(r->n);
+            sqe->off = r->offset;
+            sqe->user_data = next;
+            sq_array_[index] = index;
+            tail++;
+            next++;
+            inflight++;
+        }
+        // 内核在 io_uring_enter() 中读取尾部，之前的写入需要对它可见
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        const unsigned to_submit =
+            tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+        if (!Enter(to_submit)) {
+            // 提交失败：还在提交队列中的请求撤回，改为直接读取。
+            // 已经提交的请求仍然会完成，继续等待它们
+            const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            for (unsigned i = head; i != tail; i++) {
+                const unsigned index = i & sq_mask_;
+                ReadDirectly(requests[sqes_[index].user_data]);
+                inflight--;
+            }
+            __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+            if (inflight > 0 && !Enter(0)) {
+                // 无法再等待已经提交的请求，不能继续使用它们的缓冲区
+                std::abort();
+            }
+        }
+
+        // 收集完成的请求
+        unsigned head = *cq_head_;
+        const unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != cq_tail) {
+            const io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+            Complete(requests[cqe->user_data], cqe->res);
+            head++;
+            inflight--;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+}
+#endif  // HAVE_IO_URING
+
+class PosixWritableFile final : public WritableFile {
+public:
+    PosixWritableFile(std::string filename, int fd)
+        : pos_(0), fd_(fd), filename_(std::move(filename)) {}
+
+    ~PosixWritableFile() override {
+        if (fd_ >= 0) {
+            // 忽略关闭时的错误，调用者应该主动调用 Close() 检查错误
+            Close();
+        }
+    }
+
+    Status Append(const Slice& data) override {
+        size_t write_size = data.size();
+        const char* write_data = data.data();
+
+        // 尽量放入缓冲区
+        size_t copy_size = std::min(write_size, kWritableFileBufferSize - pos_);
+        std::memcpy(buf_ + pos_, write_data, copy_size);
+        write_data += copy_size;
+        write_size -= copy_size;
+        pos_ += copy_size;
+        if (write_size == 0) {
+            return Status::Ok();
+        }
+
+        // 缓冲区满了，写出缓冲区
+        Status status = FlushBuffer();
+        if (!status.IsOk()) {
+            return status;
+        }
+
+        // 较小的写入放进缓冲区，较大的写入直接写入文件
+        if (write_size < kWritableFileBufferSize) {
+            std::memcpy(buf_, write_data, write_size);
+            pos_ = write_size;
+            return Status::Ok();
+        }
+        return WriteUnbuffered(write_data, write_size);
+    }
+
+    Status Close() override {
+        Status status = FlushBuffer();
+        const int close_result = ::close(fd_);
+        if (close_result < 0 && status.IsOk()) {
+            status = PosixError(filename_, errno);
+        }
+        fd_ = -1;
+        return status;
+    }
+
+    Status Flush() override { return FlushBuffer(); }
+
+    Status Sync() override {
+        Status status = FlushBuffer();
+        if (!status.IsOk()) {
+            return status;
+        }
+        // 只需要持久化数据和文件大小，使用 fdatasync() 可以省去
+        // 更新访问时间等元数据的开销
+        if (::fdatasync(fd_) != 0) {
+            return PosixError(filename_, errno);
+        }
+        return Status::Ok();
+    }
+
+private:
+    Status FlushBuffer() {
+        Status status = WriteUnbuffered(buf_, pos_);
+        pos_ = 0;
+        return status;
+    }
+
+    Status WriteUnbuffered(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t write_result = ::write(fd_, data, size);
+            if (write_result < 0) {
+                if (errno == EINTR) {
+                    continue;  // 被信号中断，重试
+                }
+                return PosixError(filename_, errno);
+            }
+            data += write_result;
+            size -= write_result;
+        }
+        return Status::Ok();
+    }
+
+    // buf_[0, pos_ - 1] 中是还没有写入 fd_ 的数据
+    char buf_[kWritableFileBufferSize];
+    size_t pos_;
+    int fd_;
+
+    const std::string filename_;
+};
+
+int LockOrUnlock(int fd, bool lock) {
+    errno = 0;
+    struct ::flock file_lock_info;
+    std::memset(&file_lock_info, 0, sizeof(file_lock_info));
+    file_lock_info.l_type = (lock ? F_WRLCK : F_UNLCK);
+    file_lock_info.l_whence = SEEK_SET;
+    file_lock_info.l_start = 0;
+    file_lock_info.l_len = 0;  // 锁定整个文件
+    return ::fcntl(fd, F_SETLK, &file_lock_info);
+}
+
+class PosixFileLock : public FileLock {
+public:
+    PosixFileLock(int fd, std::string filename)
+        : fd_(fd), filename_(std::move(filename)) {}
+
+    int fd() const { return fd_; }
+    const std::string& filename() const { return filename_; }
+
+private:
+    const int fd_;
+    const std::string filename_;
+};
+
+// fcntl 锁是进程级别的，同一个进程内重复加锁不会失败，
+// 所以还需要在进程内记录已经锁定的文件
+class PosixLockTable {
+public:
+    bool Insert(const std::string& fname) {
+        std::lock_guard<std::mutex> l(mu_);
+        return locked_files_.insert(fname).second;
+    }
+    void Remove(const std::string& fname) {
+        std::lock_guard<std::mutex> l(mu_);
+        locked_files_.erase(fname);
+    }
+
+private:
+    std::mutex mu_;
+    std::set<std::string> locked_files_;
+};
+
+class PosixEnv : public Env {
+public:
+    PosixEnv();
+    ~PosixEnv() override {
+        static const char msg[] =
+            "PosixEnv singleton destroyed. Unsupported behavior!\n";
+        std::fwrite(msg, 1, sizeof(msg), stderr);
+        std::abort();
+    }
+
+    Status NewSequentialFile(const std::string& filename,
+                             SequentialFile** result) override {
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            *result = nullptr;
+            return PosixError(filename, errno);
+        }
+        *result = new PosixSequentialFile(filename, fd);
+        return Status::Ok();
+    }
+
+    Status NewRandomAccessFile(const std::string& filename,
+                               RandomAccessFile** result) override {
+        *result = nullptr;
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return PosixError(filename, errno);
+        }
+        *result = new PosixRandomAccessFile(filename, fd);
+        return Status::Ok();
+    }
+
+    Status NewMmapReadableFile(const std::string& filename,
+                               RandomAccessFile** result) override {
+        *result = nullptr;
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return PosixError(filename, errno);
+        }
+        struct ::stat file_stat;
+        if (::fstat(fd, &file_stat) != 0) {
+            Status s = PosixError(filename, errno);
+            ::close(fd);
+            return s;
+        }
+        const size_t length = static_cast<size_t>(file_stat.st_size);
+        void* mmap_base = MAP_FAILED;
+        if (length > 0) {
+            mmap_base = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        if (mmap_base == MAP_FAILED) {
+            // 空文件不能映射；映射失败（例如超过 vm.max_map_count）时
+            // 也退化为使用 pread() 读取
+            *result = new PosixRandomAccessFile(filename, fd);
+            return Status::Ok();
+        }
+        // 映射建立之后不再需要文件描述符
+        ::close(fd);
+        *result = new PosixMmapReadableFile(
+            filename, reinterpret_cast<char*>(mmap_base), length);
+        return Status::Ok();
+    }
+
+    Status NewWritableFile(const std::string& filename,
+                           WritableFile** result) override {
+        int fd = ::open(filename.c_str(),
+                        O_TRUNC | O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            *result = nullptr;
+            return PosixError(filename, errno);
+        }
+        *result = new PosixWritableFile(filename, fd);
+        return Status::Ok();
+    }
+
+    bool FileExists(const std::string& filename) override {
+        return ::access(filename.c_str(), F_OK) == 0;
+    }
+
+    Status GetChildren(const std::string& directory_path,
+                       std::vector<std::string>* result) override {
+        result->clear();
+        ::DIR* dir = ::opendir(directory_path.c_str());
+        if (dir == nullptr) {
+            return PosixError(directory_path, errno);
+        }
+        struct ::dirent* entry;
+        while ((entry = ::readdir(dir)) != nullptr) {
+            result->emplace_back(entry->d_name);
+        }
+        ::closedir(dir);
+        return Status::Ok();
+    }
+
+    Status RemoveFile(const std::string& filename) override {
+        if (::unlink(filename.c_str()) != 0) {
+            return PosixError(filename, errno);
+        }
+        return Status::Ok();
+    }
+
+    Status CreateDir(const std::string& dirname) override {
+        if (::mkdir(dirname.c_str(), 0755) != 0) {
+            return PosixError(dirname, errno);
+        }
+        return Status::Ok();
+    }
+
+    Status RemoveDir(const std::string& dirname) override {
+        if (::rmdir(dirname.c_str()) != 0) {
+            return PosixError(dirname, errno);
+        }
+        return Status::Ok();
+    }
+
+    Status GetFileSize(const std::string& filename, uint64_t* size) override {
+        struct ::stat file_stat;
+        if (::stat(filename.c_str(), &file_stat) != 0) {
+            *size = 0;
+            return PosixError(filename, errno);
+        }
+        *size = file_stat.st_size;
+        return Status::Ok();
+    }
+
+    Status RenameFile(const std::string& from, const std::string& to) override {
+        if (std::rename(from.c_str(), to.c_str()) != 0) {
+            return PosixError(from, errno);
+        }
+        return Status::Ok();
+    }
+
+    Status LockFile(const std::string& filename, FileLock** lock) override {
+        *lock = nullptr;
+
+        int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return PosixError(filename, errno);
+        }
+
+        if (!locks_.Insert(filename)) {
+            ::close(fd);
+            return Status::IOError("lock " + filename,
+                                   "already held by process");
+        }
+
+        if (LockOrUnlock(fd, true) == -1) {
+            int lock_errno = errno;
+            ::close(fd);
+            locks_.Remove(filename);
+            return PosixError("lock " + filename, lock_errno);
+        }
+
+        *lock = new PosixFileLock(fd, filename);
+        return Status::Ok();
+    }
+
+    Status UnlockFile(FileLock* lock) override {
+        PosixFileLock* posix_file_lock = static_cast<PosixFileLock*>(lock);
+        if (LockOrUnlock(posix_file_lock->fd(), false) == -1) {
+            return PosixError("unlock " + posix_file_lock->filename(), errno);
+        }
+        locks_.Remove(posix_file_lock->filename());
+        ::close(posix_file_lock->fd());
+        delete posix_file_lock;
+        return Status::Ok();
+    }
+
+    void MultiRead(ReadRequest* requests, size_t n) override;
+
+    void Schedule(void (*background_work_function)(void* background_work_arg),
+                  void* background_work_arg) override;
+
+    void SetBackgroundThreads(int number) override;
+
+    void StartThread(void (*thread_main)(void* thread_main_arg),
+                     void* thread_main_arg) override {
+        std::thread new_thread(thread_main, thread_main_arg);
+        new_thread.detach();
+    }
+
+    uint64_t NowMicros() override {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void SleepForMicroseconds(int micros) override {
+        std::this_thread::sleep_for(std::chrono::microseconds(micros));
+    }
+
+private:
+    // 后台线程的主循环
+    void BackgroundThreadMain();
+
+    static void BackgroundThreadEntryPoint(PosixEnv* env) {
+        env->BackgroundThreadMain();
+    }
+
+    // 存放在后台工作队列中的任务
+    struct BackgroundWorkItem {
+        explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
+            : function(function), arg(arg) {}
+
+        void (*const function)(void*);
+        void* const arg;
+    };
+
+    // 要求：持有 background_work_mutex_
+    void StartBackgroundThreads(int number);
+
+    // MultiRead() 交给读取线程的一批请求。
+    // 调用者和读取线程从 next 开始各自领取请求，直到全部领取完
+    struct ReadBatch {
+        ReadBatch(ReadRequest* const* requests, size_t n)
+            : requests(requests), n(n), next(0), readers(0) {}
+
+        ReadRequest* const* const requests;
+        const size_t n;
+        std::atomic<size_t> next;
+        int readers;  // 正在处理这批请求的读取线程数，由 read_mutex_ 保护
+    };
+
+    // 读取线程的主循环
+    void ReadThreadMain();
+
+    static void ReadThreadEntryPoint(PosixEnv* env) { env->ReadThreadMain(); }
+
+    // 领取并完成 batch 中的请求，直到没有剩余的请求
+    static void RunReadBatch(ReadBatch* batch);
+
+    // 使用读取线程并行地完成 requests[0, n - 1]
+    void ParallelRead(ReadRequest* const* requests, size_t n);
+
+    std::mutex background_work_mutex_;
+    std::condition_variable background_work_cv_;
+    int background_threads_;  // 已经启动的后台线程数量
+
+    std::queue<BackgroundWorkItem> background_work_queue_;
+
+    PosixLockTable locks_;
+
+    std::mutex read_mutex_;
+    std::condition_variable read_work_cv_;  // read_queue_ 中有新的批次
+    std::condition_variable read_done_cv_;  // 某个批次的读取线程都已经退出
+    int read_threads_;                      // 已经启动的读取线程数量
+    // 每个元素表示批次需要一个读取线程，同一个批次可能出现多次
+    std::deque<ReadBatch*> read_queue_;
+};
+
+PosixEnv::PosixEnv() : background_threads_(0), read_threads_(0) {}
+
+void PosixEnv::MultiRead(ReadRequest* requests, size_t n) {
+    // 通过 pread 读取的请求一起提交；其他文件（例如 mmap 映射的文件）
+    // 读取时不会等待 I/O，直接在当前线程完成
+    std::vector<ReadRequest*> io;
+    io.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        ReadRequest* r = &requests[i];
+        if (dynamic_cast<const PosixRandomAccessFile*>(r->file) != nullptr) {
+            io.push_back(r);
+        } else {
+            ReadDirectly(r);
+        }
+    }
+    if (io.size() <= 1) {
+        for (ReadRequest* r : io) {
+            ReadDirectly(r);
+        }
+        return;
+    }
+#if HAVE_IO_URING
+    IoUring* ring = IoUring::ThisThread();
+    if (ring != nullptr) {
+        ring->Read(io.data(), io.size());
+        return;
+    }
+#endif
+    ParallelRead(io.data(), io.size());
+}
+
+void PosixEnv::RunReadBatch(ReadBatch* batch) {
+    size_t i;
+    while ((i = batch->next.fetch_add(1, std::memory_order_relaxed)) <
+           batch->n) {
+        ReadDirectly(batch->requests[i]);
+    }
+}
+
+void PosixEnv::ParallelRead(ReadRequest* const* requests, size_t n) {
+    ReadBatch batch(requests, n);
+    const int helpers = static_cast<int>(
+        std::min<size_t>(n - 1, static_cast<size_t>(kMaxReadThreads)));
+    {
+        std::lock_guard<std::mutex> l(read_mutex_);
+        while (read_threads_ < helpers) {
+            read_threads_++;
+            std::thread read_thread(PosixEnv::ReadThreadEntryPoint, this);
+            read_thread.detach();
+        }
+        for (int i = 0; i < helpers; i++) {
+            read_queue_.push_back(&batch);
+        }
+    }
+    read_work_cv_.notify_all();
+
+    // 调用者自己也领取请求，读取线程都在忙时不需要等待它们
+    RunReadBatch(&batch);
+
+    // 撤回还没有被读取线程取走的部分，并等待正在处理的读取线程退出，
+    // 之后 batch 不会再被访问
+    std::unique_lock<std::mutex> l(read_mutex_);
+    read_queue_.erase(
+        std::remove(read_queue_.begin(), read_queue_.end(), &batch),
+        read_queue_.end());
+    read_done_cv_.wait(l, [&batch] { return batch.readers == 0; });
+}
+
+void PosixEnv::ReadThreadMain() {
+    std::unique_lock<std::mutex> l(read_mutex_);
+    while (true) {
+        read_work_cv_.wait(l, [this] { return !read_queue_.empty(); });
+        ReadBatch* batch = read_queue_.front();
+        read_queue_.pop_front();
+        batch->readers++;
+
+        l.unlock();
+        RunReadBatch(batch);
+        l.lock();
+
+        if (--batch->readers == 0) {
+            read_done_cv_.notify_all();
+        }
+    }
+}
+
+void PosixEnv::StartBackgroundThreads(int number) {
+    while (background_threads_ < number) {
+        background_threads_++;
+        std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint,
+                                      this);
+        background_thread.detach();
+    }
+}
+
+void PosixEnv::SetBackgroundThreads(int number) {
+    std::lock_guard<std::mutex> l(background_work_mutex_);
+    StartBackgroundThreads(number);
+}
+
+void PosixEnv::Schedule(
+    void (*background_work_function)(void* background_work_arg),
+    void* background_work_arg) {
+    std::lock_guard<std::mutex> l(background_work_mutex_);
+
+    // 第一次调用时至少启动一个后台线程
+    StartBackgroundThreads(1);
+
+    background_work_queue_.emplace(background_work_function,
+                                   background_work_arg);
+    // 唤醒一个空闲的后台线程
+    background_work_cv_.notify_one();
+}
+
+void PosixEnv::BackgroundThreadMain() {
+    while (true) {
+        std::unique_lock<std::mutex> l(background_work_mutex_);
+
+        // 等待直到有任务
+        while (background_work_queue_.empty()) {
+            background_work_cv_.wait(l);
+        }
+
+        assert(!background_work_queue_.empty());
+        auto background_work_function = background_work_queue_.front().function;
+        void* background_work_arg = background_work_queue_.front().arg;
+        background_work_queue_.pop();
+
+        l.unlock();
+        background_work_function(background_work_arg);
+    }
+}
+
+}  // namespace
+
+Env* Env::Default() {
+    // PosixEnv 不会被析构
+    static NoDestructor<PosixEnv> env_container;
+    return env_container.get();
+}
+
+}  // namespace massdb
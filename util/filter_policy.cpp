@@ -0,0 +1,20 @@
+//
+// Created by Xsakura on 2023/5/13.
+//
+
+#include "massdb/filter_policy.h"
+
+#include "massdb/slice.h"
+
+namespace massdb {
+
+FilterPolicy::~FilterPolicy() = default;
+
+void FilterPolicy::KeysMayMatch(const Slice* keys, int n, const Slice& filter,
+                                bool* results) const {
+    for (int i = 0; i < n; i++) {
+        results[i] = KeyMayMatch(keys[i], filter);
+    }
+}
+
+}  // namespace massdb
@@ -0,0 +1,78 @@
+//
+// Created by Xsakura on 2023/5/6.
+//
+
+#include "util/hash.h"
+
+#include "util/coding.h"
+
+namespace massdb {
+
+uint32_t Hash(const char* data, size_t n, uint32_t seed) {
+    // 与 murmur hash 类似
+    const uint32_t m = 0xc6a4a793;
+    const uint32_t r = 24;
+    const char* limit = data + n;
+    uint32_t h = seed ^ (n * m);
+
+    // 每次处理 4 个字节
+    while (data + 4 <= limit) {
+        uint32_t w = DecodeFixed32(data);
+        data += 4;
+        h += w;
+        h *= m;
+        h ^= (h >> 16);
+    }
+
+    // 处理剩余的字节
+    switch (limit - data) {
+        case 3:
+            h += static_cast<uint8_t>(data[2]) << 16;
+            // fall through
+        case 2:
+            h += static_cast<uint8_t>(data[1]) << 8;
+            // fall through
+        case 1:
+            h += static_cast<uint8_t>(data[0]);
+            h *= m;
+            h ^= (h >> r);
+            break;
+    }
+    return h;
+}
+
+uint64_t Hash64(const char* data, size_t n, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const char* limit = data + n;
+    uint64_t h = seed ^ (n * m);
+
+    // 每次处理 8 个字节
+    while (data + 8 <= limit) {
+        uint64_t k = DecodeFixed64(data);
+        data += 8;
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    // 处理剩余的字节
+    const size_t rest = limit - data;
+    if (rest > 0) {
+        for (size_t i = 0; i < rest; i++) {
+            h ^= static_cast<uint64_t>(static_cast<uint8_t>(data[i]))
+                 << (8 * i);
+        }
+        h *= m;
+    }
+
+    // 最后的混合让每一位都依赖所有输入
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+}  // namespace massdb
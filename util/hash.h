@@ -0,0 +1,21 @@
+//
+// Created by Xsakura on 2023/5/6.
+//
+
+#ifndef MASSDB_UTIL_HASH_H
+#define MASSDB_UTIL_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace massdb {
+
+// 与 murmur hash 类似的简单哈希函数，用于内部的哈希表
+uint32_t Hash(const char* data, size_t n, uint32_t seed);
+
+// 64 位的哈希函数（MurmurHash64A），高 32 位和低 32 位可以分别使用
+uint64_t Hash64(const char* data, size_t n, uint64_t seed);
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_HASH_H
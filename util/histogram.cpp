@@ -0,0 +1,155 @@
+//
+// Created by Xsakura on 2023/6/25.
+//
+
+#include "util/histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace massdb {
+
+namespace {
+
+// 每个桶的上限，低位的桶更密
+struct BucketTable {
+    BucketTable(int buckets_per_decade, int num_buckets) {
+        static const double kSteps[] = {
+            1.2, 1.4, 1.6, 1.8, 2.0, 2.5, 3.0, 3.5,
+            4.0, 4.5, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0,
+        };
+        for (int b = 0; b < num_buckets - 1; b++) {
+            // 第一个数量级是 [0.1, 1)，可以分辨小于 1 微秒的延迟
+            limits.push_back(kSteps[b % buckets_per_decade] *
+                             std::pow(10.0, b / buckets_per_decade - 1));
+        }
+        limits.push_back(std::numeric_limits<double>::infinity());
+    }
+
+    std::vector<double> limits;
+};
+
+}  // namespace
+
+const double* Histogram::BucketLimits() {
+    static const BucketTable table(kBucketsPerDecade, kNumBuckets);
+    return table.limits.data();
+}
+
+double Histogram::BucketLimit(int b) { return BucketLimits()[b]; }
+
+void Histogram::Clear() {
+    min_ = std::numeric_limits<double>::max();
+    max_ = 0;
+    num_ = 0;
+    sum_ = 0;
+    sum_squares_ = 0;
+    for (int b = 0; b < kNumBuckets; b++) {
+        buckets_[b] = 0;
+    }
+}
+
+void Histogram::Add(double value) {
+    const double* limits = BucketLimits();
+    const int b = static_cast<int>(
+        std::upper_bound(limits, limits + kNumBuckets - 1, value) - limits);
+    buckets_[b] += 1.0;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    num_++;
+    sum_ += value;
+    sum_squares_ += value * value;
+}
+
+void Histogram::Merge(const Histogram& other) {
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    num_ += other.num_;
+    sum_ += other.sum_;
+    sum_squares_ += other.sum_squares_;
+    for (int b = 0; b < kNumBuckets; b++) {
+        buckets_[b] += other.buckets_[b];
+    }
+}
+
+double Histogram::Percentile(double p) const {
+    if (num_ == 0) {
+        return 0;
+    }
+    const double threshold = num_ * (p / 100.0);
+    double sum = 0;
+    for (int b = 0; b < kNumBuckets; b++) {
+        sum += buckets_[b];
+        if (sum >= threshold) {
+            // 在桶内按数量线性插值
+            const double left = (b == 0) ? 0 : BucketLimit(b - 1);
+            const double right =
+                (b == kNumBuckets - 1) ? max_ : BucketLimit(b);
+            const double left_sum = sum - buckets_[b];
+            const double pos = (buckets_[b] == 0)
+                                   ? 0
+                                   : (threshold - left_sum) / buckets_[b];
+            double r = left + (right - left) * pos;
+            r = std::max(r, min_);
+            r = std::min(r, max_);
+            return r;
+        }
+    }
+    return max_;
+}
+
+double Histogram::Average() const {
+    if (num_ == 0) {
+        return 0;
+    }
+    return sum_ / num_;
+}
+
+double Histogram::StandardDeviation() const {
+    if (num_ == 0) {
+        return 0;
+    }
+    const double variance =
+        (sum_squares_ * num_ - sum_ * sum_) / (num_ * num_);
+    return std::sqrt(std::max(variance, 0.0));
+}
+
+std::string Histogram::ToString() const {
+    std::string r;
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Count: %.0f  Average: %.4f  StdDev: %.2f\n", num_,
+                  Average(), StandardDeviation());
+    r.append(buf);
+    std::snprintf(buf, sizeof(buf), "Min: %.4f  Median: %.4f  Max: %.4f\n",
+                  (num_ == 0 ? 0 : min_), Median(), max_);
+    r.append(buf);
+    r.append("------------------------------------------------------\n");
+    if (num_ == 0) {
+        return r;
+    }
+    const double mult = 100.0 / num_;
+    double sum = 0;
+    for (int b = 0; b < kNumBuckets; b++) {
+        if (buckets_[b] <= 0) {
+            continue;
+        }
+        sum += buckets_[b];
+        std::snprintf(buf, sizeof(buf),
+                      "[ %9.1f, %9.1f ) %7.0f %7.3f%% %7.3f%% ",
+                      (b == 0) ? 0 : BucketLimit(b - 1), BucketLimit(b),
+                      buckets_[b], mult * buckets_[b], mult * sum);
+        r.append(buf);
+
+        // 20 个 '#' 表示 100%
+        const int marks = static_cast<int>(20 * (buckets_[b] / num_) + 0.5);
+        r.append(marks, '#');
+        r.push_back('\n');
+    }
+    return r;
+}
+
+}  // namespace massdb
@@ -0,0 +1,58 @@
+//
+// Created by Xsakura on 2023/6/25.
+//
+
+#ifndef MASSDB_UTIL_HISTOGRAM_H
+#define MASSDB_UTIL_HISTOGRAM_H
+
+#include <string>
+
+namespace massdb {
+
+// 记录一组数值（例如每次操作的延迟）的分布，用于计算平均值、
+// 标准差和百分位数。数值按近似对数划分的桶计数，
+// 百分位数在桶内线性插值，相对误差在 10% 以内。非线程安全
+class Histogram {
+public:
+    Histogram() { Clear(); }
+    ~Histogram() = default;
+
+    void Clear();
+    void Add(double value);
+    // 把 other 中的数值合并进来
+    void Merge(const Histogram& other);
+
+    double Count() const { return num_; }
+    double Min() const { return min_; }
+    double Max() const { return max_; }
+    double Median() const { return Percentile(50.0); }
+    // 返回 p 百分位数，p 的范围为 [0, 100]
+    double Percentile(double p) const;
+    double Average() const;
+    double StandardDeviation() const;
+
+    // 返回统计信息和每个非空的桶，每个桶一行
+    std::string ToString() const;
+
+private:
+    // 每个十进制数量级分为 kBucketsPerDecade 个桶，
+    // 覆盖 [0, 1e11)，更大的数值计入最后一个桶
+    static const int kBucketsPerDecade = 16;
+    static const int kNumBuckets = 12 * kBucketsPerDecade + 1;
+
+    // 第 b 个桶的范围为 [BucketLimit(b - 1), BucketLimit(b))
+    static double BucketLimit(int b);
+    static const double* BucketLimits();
+
+    double min_;
+    double max_;
+    double num_;
+    double sum_;
+    double sum_squares_;
+
+    double buckets_[kNumBuckets];
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_HISTOGRAM_H
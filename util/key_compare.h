@@ -0,0 +1,61 @@
+//
+// Created by Xsakura on 2023/6/11.
+//
+
+#ifndef MASSDB_UTIL_KEY_COMPARE_H
+#define MASSDB_UTIL_KEY_COMPARE_H
+
+#include "massdb/comparator.h"
+#include "massdb/slice.h"
+#include "massdb/spectrum.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+// 编译期确定的 key 比较函数对象。
+// 作为模板参数传给 SkipList、块迭代器和归并迭代器时，
+// 比较可以在查找和归并的循环中内联，不需要每次都调用虚函数 Compare()
+
+// 按字节比较，与 BytewiseComparator() 的顺序相同
+struct BytewiseKeyCompare {
+    int operator()(const Slice& a, const Slice& b) const {
+        return a.compare(b);
+    }
+};
+
+// 定宽的谱图 key（见 massdb/spectrum.h）按两个大端序 64 位整数和一个字节
+// 比较，不调用 memcmp。其他长度的 key 按字节比较，
+// 所以与 BytewiseComparator() 的顺序完全相同
+struct SpectrumKeyCompare {
+    int operator()(const Slice& a, const Slice& b) const {
+        if (a.size() != kSpectrumKeySize || b.size() != kSpectrumKeySize) {
+            return a.compare(b);
+        }
+        uint64_t x = DecodeBigEndianPrefix(a.data(), 8);
+        uint64_t y = DecodeBigEndianPrefix(b.data(), 8);
+        if (x == y) {
+            x = DecodeBigEndianPrefix(a.data() + 8, 8);
+            y = DecodeBigEndianPrefix(b.data() + 8, 8);
+            if (x == y) {
+                x = static_cast<uint8_t>(a[16]);
+                y = static_cast<uint8_t>(b[16]);
+            }
+        }
+        return (x < y) ? -1 : (x > y);
+    }
+};
+
+// 通过虚函数调用任意的比较器，用于无法特化的情况
+struct VirtualKeyCompare {
+    explicit VirtualKeyCompare(const Comparator* c) : cmp(c) {}
+
+    int operator()(const Slice& a, const Slice& b) const {
+        return cmp->Compare(a, b);
+    }
+
+    const Comparator* cmp;
+};
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_KEY_COMPARE_H
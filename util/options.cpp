@@ -0,0 +1,14 @@
+//
+// Created by Xsakura on 2023/4/8.
+//
+
+#include "massdb/options.h"
+
+#include "massdb/comparator.h"
+#include "massdb/env.h"
+
+namespace massdb {
+
+Options::Options() : comparator(BytewiseComparator()), env(Env::Default()) {}
+
+}  // namespace massdb
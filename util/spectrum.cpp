@@ -0,0 +1,125 @@
+//
+// Created by Xsakura on 2023/5/27.
+//
+
+#include "massdb/spectrum.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "util/coding.h"
+
+namespace massdb {
+
+void EncodePeakList(const double* mz, const float* intensity, size_t n,
+                    std::string* dst) {
+    const size_t base = dst->size();
+    dst->resize(base + PeakListEncodedLength(n));
+    char* p = &(*dst)[base];
+    EncodeFixed32(p, static_cast<uint32_t>(n));
+    p += kPeakListHeaderSize;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t bits;
+        std::memcpy(&bits, &mz[i], sizeof(bits));
+        EncodeFixed64(p, bits);
+        p += sizeof(double);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint32_t bits;
+        std::memcpy(&bits, &intensity[i], sizeof(bits));
+        EncodeFixed32(p, bits);
+        p += sizeof(float);
+    }
+}
+
+bool GetPeakListSize(const Slice& value, uint32_t* n) {
+    if (value.size() < kPeakListHeaderSize) return false;
+    const uint32_t num = DecodeFixed32(value.data());
+    // 先检查上限，避免计算长度时溢出
+    if (num > (value.size() - kPeakListHeaderSize) /
+                  (sizeof(double) + sizeof(float))) {
+        return false;
+    }
+    if (value.size() != PeakListEncodedLength(num)) return false;
+    *n = num;
+    return true;
+}
+
+bool DecodePeakList(const Slice& value, std::vector<double>* mz,
+                    std::vector<float>* intensity) {
+    uint32_t n;
+    if (!GetPeakListSize(value, &n)) return false;
+    mz->resize(n);
+    intensity->resize(n);
+    const char* p = value.data() + kPeakListHeaderSize;
+    for (uint32_t i = 0; i < n; i++) {
+        const uint64_t bits = DecodeFixed64(p);
+        std::memcpy(&(*mz)[i], &bits, sizeof(bits));
+        p += sizeof(double);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const uint32_t bits = DecodeFixed32(p);
+        std::memcpy(&(*intensity)[i], &bits, sizeof(bits));
+        p += sizeof(float);
+    }
+    return true;
+}
+
+// 将 double 的位模式变换为按无符号整数比较时与数值顺序一致的形式：
+// 正数只需要把符号位置 1，负数需要把所有位取反（绝对值越大越小）
+static uint64_t OrderedMzBits(double mz) {
+    uint64_t bits;
+    std::memcpy(&bits, &mz, sizeof(bits));
+    const uint64_t kSignBit = uint64_t(1) << 63;
+    return (bits & kSignBit) ? ~bits : (bits | kSignBit);
+}
+
+void EncodePrecursorMz(double precursor_mz, std::string* dst) {
+    char buf[kPrecursorMzSize];
+    EncodeBigEndian64(buf, OrderedMzBits(precursor_mz));
+    dst->append(buf, sizeof(buf));
+}
+
+void EncodeSpectrumKey(double precursor_mz, int charge, uint64_t scan_id,
+                       std::string* dst) {
+    assert(charge >= -128 && charge <= 127);
+    char buf[kSpectrumKeySize];
+    EncodeBigEndian64(buf, OrderedMzBits(precursor_mz));
+    buf[kPrecursorMzSize] = static_cast<char>(
+        static_cast<uint8_t>(static_cast<int8_t>(charge)) ^ 0x80);
+    EncodeBigEndian64(buf + kPrecursorMzSize + 1, scan_id);
+    dst->append(buf, sizeof(buf));
+}
+
+bool DecodeSpectrumKey(const Slice& key, double* precursor_mz, int* charge,
+                       uint64_t* scan_id) {
+    if (key.size() != kSpectrumKeySize) return false;
+    const uint64_t kSignBit = uint64_t(1) << 63;
+    uint64_t bits = DecodeBigEndianPrefix(key.data(), kPrecursorMzSize);
+    bits = (bits & kSignBit) ? (bits & ~kSignBit) : ~bits;
+    std::memcpy(precursor_mz, &bits, sizeof(bits));
+    const uint8_t c = static_cast<uint8_t>(key[kPrecursorMzSize]) ^ 0x80;
+    *charge = static_cast<int8_t>(c);
+    *scan_id = DecodeBigEndianPrefix(key.data() + kPrecursorMzSize + 1, 8);
+    return true;
+}
+
+void PrecursorMzRange(double mz, double tolerance_ppm, std::string* lower,
+                      std::string* upper) {
+    const double delta = std::fabs(mz * tolerance_ppm) * 1e-6;
+    lower->clear();
+    upper->clear();
+    EncodePrecursorMz(mz - delta, lower);
+
+    // 上界是 mz + delta 之后的下一个编码值，
+    // 以 mz + delta 的编码为前缀的 key 都小于它
+    const uint64_t last = OrderedMzBits(mz + delta);
+    if (last != ~uint64_t(0)) {
+        char buf[kPrecursorMzSize];
+        EncodeBigEndian64(buf, last + 1);
+        upper->append(buf, sizeof(buf));
+    }
+}
+
+}  // namespace massdb
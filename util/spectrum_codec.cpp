@@ -0,0 +1,663 @@
+//
+// Created by Xsakura on 2023/5/27.
+//
+
+#include "util/spectrum_codec.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "massdb/spectrum.h"
+#include "util/coding.h"
+#include "util/compression.h"
+
+namespace massdb {
+
+namespace {
+
+// 峰列表中一列数据的编码方式，存放在编码结果第一个字节的高低 4 位中。
+// 不超过 kMaxMzScale（kMaxIntensityScale）的值 e 表示按 10^e 缩放后的整数
+static const int kMaxMzScale = 8;
+static const int kMaxIntensityScale = 6;
+static const uint8_t kFloatBitsMode = 0xe;  // 只用于 m/z
+static const uint8_t kXorMode = 0xf;
+
+static const double kPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4,
+                                1e5, 1e6, 1e7, 1e8};
+
+// 大于这个值的数在 double 中已经无法精确表示所有整数
+static const double kMaxExactInteger = 9007199254740992.0;  // 2^53
+
+inline uint64_t DoubleBits(double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+inline double BitsToDouble(uint64_t bits) {
+    double v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+inline uint32_t FloatBits(float v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+inline float BitsToFloat(uint32_t bits) {
+    float v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+inline uint64_t ZigZagEncode(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t ZigZagDecode(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+// 解码时使用的表达式，编码时必须用同一个表达式验证
+inline double ScaledToDouble(int64_t q, int e) {
+    return static_cast<double>(q) / kPow10[e];
+}
+
+inline float ScaledToFloat(int64_t q, int e) {
+    return static_cast<float>(static_cast<double>(q) / kPow10[e]);
+}
+
+// 尝试把 v[0, n) 表示为 q[i] / 10^e，并且解码后比特完全一致。
+// 成功时返回最小的 e，失败时返回 -1
+template <typename T>
+int FindDecimalScale(const T* v, size_t n, int max_scale,
+                     std::vector<int64_t>* q) {
+    q->resize(n);
+    for (int e = 0; e <= max_scale; e++) {
+        const double p = kPow10[e];
+        size_t i = 0;
+        for (; i < n; i++) {
+            const double x = static_cast<double>(v[i]) * p;
+            if (!(std::fabs(x) < kMaxExactInteger)) break;  // 包括 NaN
+            const int64_t qi = std::llround(x);
+            T back;
+            if (sizeof(T) == sizeof(double)) {
+                back = static_cast<T>(ScaledToDouble(qi, e));
+            } else {
+                back = static_cast<T>(ScaledToFloat(qi, e));
+            }
+            // 比较比特位而不是数值，以区分 -0.0 和 0.0
+            if (std::memcmp(&back, &v[i], sizeof(T)) != 0) break;
+            (*q)[i] = qi;
+        }
+        if (i == n) return e;
+    }
+    return -1;
+}
+
+// 按比特写入，高位在前
+class BitWriter {
+public:
+    explicit BitWriter(std::string* dst) : dst_(dst), acc_(0), bits_(0) {}
+
+    // 写入 value 的低 n 位，要求 n <= 64
+    void Write(uint64_t value, int n) {
+        while (n > 0) {
+            const int take = (n < 8 - bits_) ? n : 8 - bits_;
+            const uint64_t chunk =
+                (value >> (n - take)) & ((uint64_t{1} << take) - 1);
+            acc_ = static_cast<uint8_t>((acc_ << take) | chunk);
+            bits_ += take;
+            n -= take;
+            if (bits_ == 8) {
+                dst_->push_back(static_cast<char>(acc_));
+                acc_ = 0;
+                bits_ = 0;
+            }
+        }
+    }
+
+    // 将最后不满一个字节的部分补 0 写出
+    void Finish() {
+        if (bits_ > 0) {
+            dst_->push_back(static_cast<char>(acc_ << (8 - bits_)));
+            acc_ = 0;
+            bits_ = 0;
+        }
+    }
+
+private:
+    std::string* dst_;
+    uint8_t acc_;
+    int bits_;
+};
+
+class BitReader {
+public:
+    BitReader(const char* p, const char* limit)
+        : p_(reinterpret_cast<const uint8_t*>(p)),
+          limit_(reinterpret_cast<const uint8_t*>(limit)),
+          bit_(0) {}
+
+    // 读取 n 位，要求 n <= 64。数据不足时返回 false
+    bool Read(int n, uint64_t* value) {
+        uint64_t result = 0;
+        while (n > 0) {
+            if (p_ >= limit_) return false;
+            const int avail = 8 - bit_;
+            const int take = (n < avail) ? n : avail;
+            const uint64_t chunk =
+                (*p_ >> (avail - take)) & ((uint64_t{1} << take) - 1);
+            result = (result << take) | chunk;
+            bit_ += take;
+            n -= take;
+            if (bit_ == 8) {
+                p_++;
+                bit_ = 0;
+            }
+        }
+        *value = result;
+        return true;
+    }
+
+    // 跳过当前字节剩余的填充位，返回下一个字节的位置
+    const char* Finish() {
+        if (bit_ > 0) {
+            p_++;
+            bit_ = 0;
+        }
+        return reinterpret_cast<const char*>(p_);
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* limit_;
+    int bit_;
+};
+
+inline int CountLeadingZeros(uint64_t x, int width) {
+    return __builtin_clzll(x) - (64 - width);
+}
+
+// Gorilla 的 XOR 编码（Pelkonen et al., VLDB 2015）。
+// 第一个值原样写入，之后写入与前一个值的 XOR：
+//    '0'                          XOR 为 0
+//    '1' '0' <meaningful bits>    有效位落在上一次的窗口中
+//    '1' '1' <leading> <length-1> <meaningful bits>
+// width 为 32 或 64，前导 0 的个数和有效位的长度各用 log2(width) 位
+void XorEncode(const uint64_t* v, size_t n, int width, std::string* dst) {
+    if (n == 0) return;
+    const int field_bits = (width == 64) ? 6 : 5;
+    BitWriter writer(dst);
+    writer.Write(v[0], width);
+    int prev_leading = -1;
+    int prev_trailing = 0;
+    for (size_t i = 1; i < n; i++) {
+        const uint64_t x = v[i] ^ v[i - 1];
+        if (x == 0) {
+            writer.Write(0, 1);
+            continue;
+        }
+        writer.Write(1, 1);
+        const int leading = CountLeadingZeros(x, width);
+        const int trailing = __builtin_ctzll(x);
+        if (prev_leading >= 0 && leading >= prev_leading &&
+            trailing >= prev_trailing) {
+            writer.Write(0, 1);
+            writer.Write(x >> prev_trailing,
+                         width - prev_leading - prev_trailing);
+        } else {
+            const int length = width - leading - trailing;
+            writer.Write(1, 1);
+            writer.Write(leading, field_bits);
+            writer.Write(length - 1, field_bits);
+            writer.Write(x >> trailing, length);
+            prev_leading = leading;
+            prev_trailing = trailing;
+        }
+    }
+    writer.Finish();
+}
+
+bool XorDecode(Slice* input, size_t n, int width, uint64_t* v) {
+    if (n == 0) return true;
+    const int field_bits = (width == 64) ? 6 : 5;
+    BitReader reader(input->data(), input->data() + input->size());
+    if (!reader.Read(width, &v[0])) return false;
+    int prev_leading = -1;
+    int prev_trailing = 0;
+    uint64_t bit;
+    for (size_t i = 1; i < n; i++) {
+        if (!reader.Read(1, &bit)) return false;
+        if (bit == 0) {
+            v[i] = v[i - 1];
+            continue;
+        }
+        if (!reader.Read(1, &bit)) return false;
+        if (bit == 1) {
+            uint64_t leading, length;
+            if (!reader.Read(field_bits, &leading) ||
+                !reader.Read(field_bits, &length)) {
+                return false;
+            }
+            length += 1;
+            if (leading + length > static_cast<uint64_t>(width)) {
+                return false;
+            }
+            prev_leading = static_cast<int>(leading);
+            prev_trailing = width - prev_leading - static_cast<int>(length);
+        } else if (prev_leading < 0) {
+            return false;
+        }
+        uint64_t meaningful;
+        if (!reader.Read(width - prev_leading - prev_trailing, &meaningful)) {
+            return false;
+        }
+        v[i] = v[i - 1] ^ (meaningful << prev_trailing);
+    }
+    const char* end = reader.Finish();
+    *input = Slice(end, input->data() + input->size() - end);
+    return true;
+}
+
+// 帧参考（frame of reference）位打包：
+//    base  : varint64     // 所有值中的最小值，zigzag 编码
+//    width : uint8        // 每个值减去 base 之后需要的比特数
+//    bits  : char[(n * width + 7) / 8]，低位在前
+// 比 varint 更接近数据的熵，并且解码时每个值的位置都可以直接算出，
+// 循环之间没有依赖，便于编译器向量化
+void PutPacked(const int64_t* v, size_t n, std::string* dst) {
+    if (n == 0) return;
+    int64_t base = v[0];
+    for (size_t i = 1; i < n; i++) {
+        if (v[i] < base) base = v[i];
+    }
+    uint64_t max_delta = 0;
+    for (size_t i = 0; i < n; i++) {
+        const uint64_t d =
+            static_cast<uint64_t>(v[i]) - static_cast<uint64_t>(base);
+        if (d > max_delta) max_delta = d;
+    }
+    const int width = (max_delta == 0) ? 0 : 64 - __builtin_clzll(max_delta);
+    PutVarint64(dst, ZigZagEncode(base));
+    dst->push_back(static_cast<char>(width));
+    if (width == 0) return;
+
+    uint64_t acc = 0;  // 尚未写出的比特，低位在前
+    int filled = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t d = static_cast<uint64_t>(v[i]) - static_cast<uint64_t>(base);
+        // 每次最多放入 32 位，保证 acc 不会溢出
+        for (int remain = width; remain > 0;) {
+            const int take = remain < 32 ? remain : 32;
+            acc |= (d & ((uint64_t{1} << take) - 1)) << filled;
+            filled += take;
+            d >>= take;
+            remain -= take;
+            while (filled >= 8) {
+                dst->push_back(static_cast<char>(acc & 0xff));
+                acc >>= 8;
+                filled -= 8;
+            }
+        }
+    }
+    if (filled > 0) {
+        dst->push_back(static_cast<char>(acc & 0xff));
+    }
+}
+
+bool GetPacked(Slice* input, size_t n, int64_t* v) {
+    if (n == 0) return true;
+    uint64_t zbase;
+    if (!GetVarint64(input, &zbase) || input->empty()) return false;
+    const int64_t base = ZigZagDecode(zbase);
+    const int width = static_cast<uint8_t>((*input)[0]);
+    input->remove_prefix(1);
+    if (width > 64) return false;
+    if (width == 0) {
+        for (size_t i = 0; i < n; i++) v[i] = base;
+        return true;
+    }
+
+    const size_t bytes = (n * width + 7) / 8;
+    if (input->size() < bytes) return false;
+    const char* data = input->data();
+    const uint64_t mask = (width == 64) ? ~uint64_t{0}
+                                        : (uint64_t{1} << width) - 1;
+    size_t i = 0;
+    if (width <= 56) {
+        // 快速路径：一次 8 字节的读取一定包含完整的值，
+        // 最后几个值可能越过数据的末尾，留给下面的慢路径
+        for (; i < n; i++) {
+            const size_t bit = i * width;
+            if ((bit >> 3) + 8 > bytes) break;
+            const uint64_t word = DecodeFixed64(data + (bit >> 3));
+            v[i] = static_cast<int64_t>(
+                static_cast<uint64_t>(base) + ((word >> (bit & 7)) & mask));
+        }
+    }
+    for (; i < n; i++) {
+        uint64_t d = 0;
+        size_t bit = i * width;
+        for (int got = 0; got < width;) {
+            const int offset = static_cast<int>(bit & 7);
+            const int take = (8 - offset < width - got) ? 8 - offset
+                                                        : width - got;
+            const uint64_t b =
+                (static_cast<uint8_t>(data[bit >> 3]) >> offset) &
+                ((1u << take) - 1);
+            d |= b << got;
+            got += take;
+            bit += take;
+        }
+        v[i] = static_cast<int64_t>(static_cast<uint64_t>(base) + d);
+    }
+    input->remove_prefix(bytes);
+    return true;
+}
+
+// 编解码时使用的临时缓冲区
+struct PeakScratch {
+    std::vector<double> mz;
+    std::vector<float> intensity;
+    std::vector<int64_t> q;
+    std::vector<uint64_t> u;
+};
+
+PeakScratch* ThreadPeakScratch() {
+    static thread_local PeakScratch scratch;
+    return &scratch;
+}
+
+// 有序的整数序列：第一个值单独保存，其余的差值位打包
+void PutSorted(std::vector<int64_t>* q, std::string* dst) {
+    const size_t n = q->size();
+    PutVarint64(dst, ZigZagEncode((*q)[0]));
+    for (size_t i = n - 1; i > 0; i--) {
+        (*q)[i] -= (*q)[i - 1];
+    }
+    PutPacked(q->data() + 1, n - 1, dst);
+}
+
+bool GetSorted(Slice* input, size_t n, int64_t* q) {
+    uint64_t first;
+    if (!GetVarint64(input, &first)) return false;
+    q[0] = ZigZagDecode(first);
+    if (!GetPacked(input, n - 1, q + 1)) return false;
+    // 前缀和。按无符号数计算，损坏的数据只会得到错误的结果而不会溢出
+    for (size_t i = 1; i < n; i++) {
+        q[i] = static_cast<int64_t>(static_cast<uint64_t>(q[i]) +
+                                    static_cast<uint64_t>(q[i - 1]));
+    }
+    return true;
+}
+
+void CompressMz(const std::vector<double>& mz, PeakScratch* s, uint8_t* mode,
+                std::string* dst) {
+    const size_t n = mz.size();
+    if (n == 0) {
+        *mode = 0;
+        return;
+    }
+    int e = FindDecimalScale(mz.data(), n, kMaxMzScale, &s->q);
+    if (e >= 0) {
+        *mode = static_cast<uint8_t>(e);
+        PutSorted(&s->q, dst);
+        return;
+    }
+
+    size_t i = 0;
+    for (; i < n; i++) {
+        const float f = static_cast<float>(mz[i]);
+        if (DoubleBits(static_cast<double>(f)) != DoubleBits(mz[i])) break;
+    }
+    if (i == n) {
+        // 有序的正 float 的比特位也是有序的，差值通常只有十几位
+        *mode = kFloatBitsMode;
+        for (size_t j = 0; j < n; j++) {
+            s->q[j] = FloatBits(static_cast<float>(mz[j]));
+        }
+        PutSorted(&s->q, dst);
+        return;
+    }
+
+    *mode = kXorMode;
+    s->u.resize(n);
+    for (size_t j = 0; j < n; j++) {
+        s->u[j] = DoubleBits(mz[j]);
+    }
+    XorEncode(s->u.data(), n, 64, dst);
+}
+
+void CompressIntensity(const std::vector<float>& intensity, PeakScratch* s,
+                       uint8_t* mode, std::string* dst) {
+    const size_t n = intensity.size();
+    if (n == 0) {
+        *mode = 0;
+        return;
+    }
+    int e = FindDecimalScale(intensity.data(), n, kMaxIntensityScale, &s->q);
+    if (e >= 0) {
+        *mode = static_cast<uint8_t>(e);
+        PutPacked(s->q.data(), n, dst);
+        return;
+    }
+
+    *mode = kXorMode;
+    s->u.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        s->u[i] = FloatBits(intensity[i]);
+    }
+    XorEncode(s->u.data(), n, 32, dst);
+}
+
+bool UncompressMz(uint8_t mode, Slice* input, size_t n, PeakScratch* s) {
+    s->mz.resize(n);
+    if (n == 0) return true;
+    if (mode <= kMaxMzScale || mode == kFloatBitsMode) {
+        s->q.resize(n);
+        if (!GetSorted(input, n, s->q.data())) return false;
+        if (mode == kFloatBitsMode) {
+            for (size_t i = 0; i < n; i++) {
+                s->mz[i] = static_cast<double>(
+                    BitsToFloat(static_cast<uint32_t>(s->q[i])));
+            }
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                s->mz[i] = ScaledToDouble(s->q[i], mode);
+            }
+        }
+        return true;
+    } else if (mode == kXorMode) {
+        s->u.resize(n);
+        if (!XorDecode(input, n, 64, s->u.data())) return false;
+        for (size_t i = 0; i < n; i++) {
+            s->mz[i] = BitsToDouble(s->u[i]);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool UncompressIntensity(uint8_t mode, Slice* input, size_t n,
+                         PeakScratch* s) {
+    s->intensity.resize(n);
+    if (n == 0) return true;
+    if (mode <= kMaxIntensityScale) {
+        s->q.resize(n);
+        if (!GetPacked(input, n, s->q.data())) return false;
+        for (size_t i = 0; i < n; i++) {
+            s->intensity[i] = ScaledToFloat(s->q[i], mode);
+        }
+        return true;
+    } else if (mode == kXorMode) {
+        s->u.resize(n);
+        if (!XorDecode(input, n, 32, s->u.data())) return false;
+        for (size_t i = 0; i < n; i++) {
+            s->intensity[i] = BitsToFloat(static_cast<uint32_t>(s->u[i]));
+        }
+        return true;
+    }
+    return false;
+}
+
+// 块中的 value 的类型
+enum ValueKind : char { kRawValue = 0, kPeakListValue = 1 };
+
+// 压缩后的块的格式：
+//    restarts_offset : varint32    // 记录部分的长度
+//    entries         : entry[]
+//    restarts        : char[]      // 重启点数组，原样保存
+// entry 的格式：
+//    shared, non_shared, value_length : 与块中相同的三个 varint32
+//    key_delta                        : char[non_shared]
+//    kind                             : ValueKind
+//    value                            : char[value_length] 或者压缩的峰列表
+class SpectrumCodec : public CompressionCodec {
+public:
+    CompressionType type() const override { return kSpectrumCompression; }
+    const char* Name() const override { return "Spectrum"; }
+
+    bool Compress(const Slice& input, int level,
+                  std::string* output) const override {
+        const size_t size = input.size();
+        if (size < sizeof(uint32_t)) return false;
+        const uint32_t num_restarts = DecodeFixed32(input.data() + size - 4);
+        if (num_restarts > (size - sizeof(uint32_t)) / sizeof(uint32_t)) {
+            return false;
+        }
+        const size_t restarts_offset =
+            size - (1 + num_restarts) * sizeof(uint32_t);
+        PutVarint32(output, static_cast<uint32_t>(restarts_offset));
+
+        const char* p = input.data();
+        const char* limit = p + restarts_offset;
+        while (p < limit) {
+            const char* entry = p;
+            uint32_t shared, non_shared, value_length;
+            if ((p = GetVarint32Ptr(p, limit, &shared)) == nullptr ||
+                (p = GetVarint32Ptr(p, limit, &non_shared)) == nullptr ||
+                (p = GetVarint32Ptr(p, limit, &value_length)) == nullptr ||
+                static_cast<uint32_t>(limit - p) < non_shared + value_length) {
+                return false;  // 不是 BlockBuilder 生成的块
+            }
+            p += non_shared;
+            output->append(entry, p - entry);
+
+            Slice value(p, value_length);
+            uint32_t n;
+            if (GetPeakListSize(value, &n) && n > 0) {
+                output->push_back(kPeakListValue);
+                CompressPeakList(value, output);
+            } else {
+                output->push_back(kRawValue);
+                output->append(value.data(), value.size());
+            }
+            p += value_length;
+        }
+        output->append(limit, size - restarts_offset);
+        return true;
+    }
+
+    bool Uncompress(const Slice& input, char* output,
+                    size_t n) const override {
+        Slice in = input;
+        uint32_t restarts_offset;
+        if (!GetVarint32(&in, &restarts_offset) || restarts_offset > n) {
+            return false;
+        }
+
+        char* out = output;
+        char* const out_limit = output + restarts_offset;
+        while (out < out_limit) {
+            const char* p = in.data();
+            const char* limit = p + in.size();
+            uint32_t shared, non_shared, value_length;
+            if ((p = GetVarint32Ptr(p, limit, &shared)) == nullptr ||
+                (p = GetVarint32Ptr(p, limit, &non_shared)) == nullptr ||
+                (p = GetVarint32Ptr(p, limit, &value_length)) == nullptr ||
+                static_cast<size_t>(limit - p) < non_shared + 1u) {
+                return false;
+            }
+            p += non_shared;
+            const size_t header = p - in.data();
+            if (static_cast<size_t>(out_limit - out) < header + value_length) {
+                return false;
+            }
+            std::memcpy(out, in.data(), header);
+            out += header;
+
+            const char kind = *p++;
+            in = Slice(p, limit - p);
+            if (kind == kRawValue) {
+                if (in.size() < value_length) return false;
+                std::memcpy(out, in.data(), value_length);
+                in.remove_prefix(value_length);
+            } else if (kind == kPeakListValue) {
+                if (value_length < kPeakListHeaderSize ||
+                    (value_length - kPeakListHeaderSize) %
+                            (sizeof(double) + sizeof(float)) !=
+                        0) {
+                    return false;
+                }
+                const uint32_t peaks = (value_length - kPeakListHeaderSize) /
+                                       (sizeof(double) + sizeof(float));
+                if (!UncompressPeakList(&in, peaks, out)) return false;
+            } else {
+                return false;
+            }
+            out += value_length;
+        }
+
+        // 剩下的是原样保存的重启点数组
+        if (in.size() != n - restarts_offset) return false;
+        std::memcpy(out, in.data(), in.size());
+        return true;
+    }
+};
+
+}  // namespace
+
+CompressionCodec* NewSpectrumCodec() { return new SpectrumCodec; }
+
+void CompressPeakList(const Slice& value, std::string* dst) {
+    PeakScratch* s = ThreadPeakScratch();
+    DecodePeakList(value, &s->mz, &s->intensity);
+
+    // 先占位模式字节，两列都编码完之后再填入
+    const size_t mode_pos = dst->size();
+    dst->push_back(0);
+    uint8_t mz_mode, intensity_mode;
+    CompressMz(s->mz, s, &mz_mode, dst);
+    CompressIntensity(s->intensity, s, &intensity_mode, dst);
+    (*dst)[mode_pos] = static_cast<char>(mz_mode | (intensity_mode << 4));
+}
+
+bool UncompressPeakList(Slice* input, uint32_t n, char* out) {
+    if (input->empty()) return false;
+    const uint8_t mode = static_cast<uint8_t>((*input)[0]);
+    input->remove_prefix(1);
+
+    PeakScratch* s = ThreadPeakScratch();
+    if (!UncompressMz(mode & 0xf, input, n, s) ||
+        !UncompressIntensity(mode >> 4, input, n, s)) {
+        return false;
+    }
+
+    EncodeFixed32(out, n);
+    char* p = out + kPeakListHeaderSize;
+    for (uint32_t i = 0; i < n; i++) {
+        EncodeFixed64(p, DoubleBits(s->mz[i]));
+        p += sizeof(double);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        EncodeFixed32(p, FloatBits(s->intensity[i]));
+        p += sizeof(float);
+    }
+    return true;
+}
+
+}  // namespace massdb
@@ -0,0 +1,41 @@
+//
+// Created by Xsakura on 2023/5/27.
+//
+
+#ifndef MASSDB_UTIL_SPECTRUM_CODEC_H
+#define MASSDB_UTIL_SPECTRUM_CODEC_H
+
+#include <cstdint>
+#include <string>
+
+#include "massdb/slice.h"
+
+namespace massdb {
+
+class CompressionCodec;
+
+// 返回 kSpectrumCompression 的实现。
+// 解析块中的每条记录，符合峰列表格式（见 massdb/spectrum.h）的 value
+// 使用 CompressPeakList() 编码，其他内容原样保存
+CompressionCodec* NewSpectrumCodec();
+
+// 无损地压缩一个峰列表 value，结果追加到 *dst 中。
+// 要求：GetPeakListSize(value) 返回 true
+//
+// m/z 依次尝试：
+//   1. 所有值都是 10^-e 的整数倍（文本格式导入的数据）：
+//      转换为整数后对差值做 zigzag varint 编码
+//   2. 所有值都可以用 float 精确表示（仪器输出的单精度数据）：
+//      对 float 的比特位的差值做 zigzag varint 编码
+//   3. 否则使用 Gorilla 的 XOR 编码
+// 强度依次尝试 1 和 Gorilla 的 XOR 编码
+void CompressPeakList(const Slice& value, std::string* dst);
+
+// 从 *input 的开头解压一个包含 n 个峰的峰列表，
+// 写入 out[0, PeakListEncodedLength(n))，并跳过 *input 中已经解析的部分。
+// 数据损坏时返回 false
+bool UncompressPeakList(Slice* input, uint32_t n, char* out);
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_SPECTRUM_CODEC_H
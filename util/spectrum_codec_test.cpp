@@ -0,0 +1,240 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "util/spectrum_codec.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "massdb/options.h"
+#include "massdb/spectrum.h"
+#include "table/block_builder.h"
+#include "util/coding.h"
+#include "util/compression.h"
+#include "util/random.h"
+
+namespace massdb {
+
+// 按峰列表的格式编码，不要求 m/z 有序
+static std::string RawPeakList(const std::vector<double>& mz,
+                               const std::vector<float>& intensity) {
+    std::string result;
+    PutFixed32(&result, static_cast<uint32_t>(mz.size()));
+    for (double v : mz) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        PutFixed64(&result, bits);
+    }
+    for (float v : intensity) {
+        uint32_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        PutFixed32(&result, bits);
+    }
+    return result;
+}
+
+// 压缩再解压 value，要求结果与 value 的每个字节都相同
+static void CheckPeakListRoundTrip(const std::string& value) {
+    uint32_t n;
+    ASSERT_TRUE(GetPeakListSize(value, &n));
+    std::string compressed;
+    CompressPeakList(value, &compressed);
+
+    Slice input(compressed);
+    std::string output(value.size(), '\0');
+    ASSERT_TRUE(UncompressPeakList(&input, n, &output[0]));
+    ASSERT_TRUE(input.empty());
+    ASSERT_EQ(value, output);
+
+    // 截断的输入都解压失败
+    for (size_t len = 0; len < compressed.size(); len++) {
+        Slice truncated(compressed.data(), len);
+        ASSERT_FALSE(UncompressPeakList(&truncated, n, &output[0]))
+            << "length " << len;
+    }
+}
+
+static void CheckPeakListRoundTrip(const std::vector<double>& mz,
+                                   const std::vector<float>& intensity) {
+    CheckPeakListRoundTrip(RawPeakList(mz, intensity));
+}
+
+TEST(SpectrumCodecTest, EmptyAndSinglePeak) {
+    CheckPeakListRoundTrip({}, {});
+    CheckPeakListRoundTrip({500.25}, {1000.0f});
+    CheckPeakListRoundTrip({0.0}, {0.0f});
+}
+
+TEST(SpectrumCodecTest, DecimalMz) {
+    // 文本格式导入的数据：m/z 和强度都是 10^-e 的整数倍
+    Random rnd(301);
+    std::vector<double> mz;
+    std::vector<float> intensity;
+    double v = 100.0;
+    for (int i = 0; i < 500; i++) {
+        v += (1 + rnd.Uniform(100000)) / 10000.0;
+        mz.push_back(std::round(v * 10000) / 10000);
+        intensity.push_back(static_cast<float>(rnd.Uniform(100000) / 10.0));
+    }
+    CheckPeakListRoundTrip(mz, intensity);
+}
+
+TEST(SpectrumCodecTest, FloatMz) {
+    // 仪器输出的单精度数据
+    Random rnd(301);
+    std::vector<double> mz;
+    std::vector<float> intensity;
+    float v = 150.0f;
+    for (int i = 0; i < 500; i++) {
+        v += rnd.Uniform(1000000) / 1e4f;
+        mz.push_back(v);
+        intensity.push_back(rnd.Uniform(1 << 20) * 0.37f);
+    }
+    CheckPeakListRoundTrip(mz, intensity);
+}
+
+TEST(SpectrumCodecTest, ArbitraryDoubles) {
+    Random rnd(301);
+    std::vector<double> mz;
+    std::vector<float> intensity;
+    double v = 200.0;
+    for (int i = 0; i < 500; i++) {
+        v += rnd.Uniform(1000000) / 7919.0 + 1.0 / 3;
+        mz.push_back(v);
+        intensity.push_back(static_cast<float>(std::sqrt(1.0 + i)));
+    }
+    CheckPeakListRoundTrip(mz, intensity);
+}
+
+TEST(SpectrumCodecTest, NonMonotonicMz) {
+    // 不满足升序的 value 仍然是合法的峰列表格式，也要无损地保存
+    CheckPeakListRoundTrip({500.5, 100.25, 300.0, 300.0, 99.125},
+                           {1.0f, 2.0f, 3.0f, 4.0f, 5.0f});
+    CheckPeakListRoundTrip({1000.0, 1e-3, -5.5, 1e300, 2.0},
+                           {1.0f, 1.0f, 1.0f, 1.0f, 1.0f});
+    Random rnd(301);
+    std::vector<double> mz;
+    std::vector<float> intensity;
+    for (int i = 0; i < 300; i++) {
+        mz.push_back(rnd.Uniform(2000000) / 1000.0);
+        intensity.push_back(static_cast<float>(rnd.Uniform(1000)));
+    }
+    CheckPeakListRoundTrip(mz, intensity);
+}
+
+TEST(SpectrumCodecTest, SpecialValues) {
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const float finf = std::numeric_limits<float>::infinity();
+    const float fnan = std::numeric_limits<float>::quiet_NaN();
+    const float denorm = std::numeric_limits<float>::denorm_min();
+    CheckPeakListRoundTrip({100.0, 200.0, 300.0, 400.0, 500.0, 600.0},
+                           {fnan, finf, -finf, -0.0f, denorm, 1.5f});
+    CheckPeakListRoundTrip({-0.0, 0.0, 1e-300, nan, inf, -inf},
+                           {1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f});
+    // 带负载的 NaN 的每一位也要保留
+    uint32_t payload_bits = 0x7fc12345;
+    float payload;
+    std::memcpy(&payload, &payload_bits, sizeof(payload));
+    CheckPeakListRoundTrip({1.0, 2.0}, {payload, payload});
+}
+
+// 用 BlockBuilder 生成一个混合了普通 value 和峰列表的块
+static std::string BuildMixedBlock() {
+    Options options;
+    options.block_restart_interval = 4;
+    BlockBuilder builder(&options);
+    Random rnd(301);
+    std::string not_peak_list;
+    PutFixed32(&not_peak_list, 3);  // 头部的峰数量与长度不一致
+    not_peak_list.append("short");
+    for (int i = 0; i < 200; i++) {
+        char key[32];
+        std::snprintf(key, sizeof(key), "spectrum%06d", i);
+        std::string value;
+        switch (i % 6) {
+            case 0:
+                value = RawPeakList({}, {});
+                break;
+            case 1:
+                value = "";
+                break;
+            case 2:
+                value = not_peak_list;
+                break;
+            case 3:
+                value.assign(1 + rnd.Uniform(100), static_cast<char>('a' + i % 26));
+                break;
+            default: {
+                std::vector<double> mz;
+                std::vector<float> intensity;
+                double v = 100.0 + i;
+                for (int p = 0; p < 1 + i % 50; p++) {
+                    v += rnd.Uniform(10000) / 100.0;
+                    mz.push_back(v);
+                    intensity.push_back(static_cast<float>(rnd.Uniform(5000)));
+                }
+                value = RawPeakList(mz, intensity);
+            }
+        }
+        builder.Add(key, value);
+    }
+    return builder.Finish().to_string();
+}
+
+TEST(SpectrumCodecTest, BlockRoundTrip) {
+    const std::string raw = BuildMixedBlock();
+    std::string compressed;
+    ASSERT_TRUE(CompressBlock(kSpectrumCompression, 0, raw, &compressed));
+    ASSERT_LT(compressed.size(), raw.size());
+
+    char* result;
+    size_t n;
+    ASSERT_TRUE(UncompressBlock(kSpectrumCompression, compressed, &result, &n)
+                    .IsOk());
+    ASSERT_EQ(raw, std::string(result, n));
+    delete[] result;
+}
+
+TEST(SpectrumCodecTest, NotABlock) {
+    // 不是 BlockBuilder 生成的数据不能使用这个算法压缩
+    std::string compressed;
+    ASSERT_FALSE(CompressBlock(kSpectrumCompression, 0, "abc", &compressed));
+    compressed.clear();
+    std::string bad(64, '\xff');
+    ASSERT_FALSE(CompressBlock(kSpectrumCompression, 0, bad, &compressed));
+}
+
+TEST(SpectrumCodecTest, TruncatedAndCorruptedBlock) {
+    const std::string raw = BuildMixedBlock();
+    std::string compressed;
+    ASSERT_TRUE(CompressBlock(kSpectrumCompression, 0, raw, &compressed));
+
+    char* result;
+    size_t n;
+    for (size_t len = 0; len < compressed.size(); len++) {
+        Status s = UncompressBlock(kSpectrumCompression,
+                                   Slice(compressed.data(), len), &result, &n);
+        ASSERT_FALSE(s.IsOk()) << "length " << len;
+    }
+
+    // 损坏的数据不一定能被发现，但不能越界读写，成功时长度不变
+    Random rnd(301);
+    for (int i = 0; i < 500; i++) {
+        std::string corrupted = compressed;
+        const size_t pos = rnd.Uniform(static_cast<int>(corrupted.size()));
+        corrupted[pos] ^= static_cast<char>(1 + rnd.Uniform(255));
+        Status s = UncompressBlock(kSpectrumCompression, corrupted, &result, &n);
+        if (s.IsOk()) {
+            delete[] result;
+        }
+    }
+}
+
+}  // namespace massdb
@@ -0,0 +1,334 @@
+//
+// Created by Xsakura on 2023/6/17.
+//
+
+#include "util/spectrum_score.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "massdb/spectrum.h"
+#include "util/coding.h"
+
+namespace massdb {
+
+namespace {
+
+// 查询向量的箱跨度不超过这个值时按箱展开成连续的数组（最多 1MB），
+// 否则只保存出现过的箱，打分时二分查找
+static const int64_t kMaxDenseQueryBins = 1 << 18;
+
+// m/z 所在的箱。与 cvttpd 指令的结果一致：向零取整，
+// 超出 int32 范围或者是 NaN 时为 INT32_MIN
+inline int32_t BinOf(double mz, double inv_bin_width) {
+    const double x = mz * inv_bin_width;
+    if (x > -2147483649.0 && x < 2147483648.0) {
+        return static_cast<int32_t>(x);
+    }
+    return INT32_MIN;
+}
+
+inline double MzAt(const char* mz, uint32_t i) {
+    const uint64_t bits = DecodeFixed64(mz + i * sizeof(double));
+    double result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+inline float IntensityAt(const char* intensity, uint32_t i) {
+    const uint32_t bits = DecodeFixed32(intensity + i * sizeof(float));
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// 可移植的实现，也用于处理向量化实现剩下的峰
+float DotPortable(const float* query, uint32_t size, int32_t base,
+                  double inv_bin_width, const char* mz,
+                  const char* intensity, uint32_t n) {
+    float sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        // 按 uint32 相减，箱小于 base 时下标回绕成很大的数
+        const uint32_t index = static_cast<uint32_t>(BinOf(MzAt(mz, i),
+                                                           inv_bin_width)) -
+                               static_cast<uint32_t>(base);
+        if (index < size) {
+            sum += query[index] * IntensityAt(intensity, i);
+        }
+    }
+    return sum;
+}
+
+#if defined(__x86_64__)
+// 每次处理 8 个峰：两次读取 4 个 double 计算箱，
+// 用带掩码的 gather 读取查询向量，与 8 个强度相乘后累加
+__attribute__((target("avx2,fma"))) float DotAvx2(
+    const float* query, uint32_t size, int32_t base, double inv_bin_width,
+    const char* mz, const char* intensity, uint32_t n) {
+    const __m256d inv = _mm256_set1_pd(inv_bin_width);
+    const __m256i vbase = _mm256_set1_epi32(base);
+    // AVX2 没有无符号比较，两边都翻转符号位后使用有符号比较
+    const __m256i sign = _mm256_set1_epi32(INT32_MIN);
+    const __m256i vsize =
+        _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(size)), sign);
+    __m256 acc = _mm256_setzero_ps();
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const double* p = reinterpret_cast<const double*>(mz) + i;
+        const __m128i lo =
+            _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_loadu_pd(p), inv));
+        const __m128i hi =
+            _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_loadu_pd(p + 4), inv));
+        const __m256i index = _mm256_sub_epi32(
+            _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1),
+            vbase);
+        const __m256i in_range =
+            _mm256_cmpgt_epi32(vsize, _mm256_xor_si256(index, sign));
+        const __m256 q = _mm256_mask_i32gather_ps(
+            _mm256_setzero_ps(), query, index, _mm256_castsi256_ps(in_range),
+            sizeof(float));
+        const __m256 it = _mm256_loadu_ps(
+            reinterpret_cast<const float*>(intensity) + i);
+        acc = _mm256_fmadd_ps(q, it, acc);
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+                            _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum) +
+           DotPortable(query, size, base, inv_bin_width,
+                       mz + i * sizeof(double),
+                       intensity + i * sizeof(float), n - i);
+}
+
+// 与 DotAvx2() 相同，每次处理 16 个峰，并使用无符号比较生成掩码
+__attribute__((target("avx512f"))) float DotAvx512(
+    const float* query, uint32_t size, int32_t base, double inv_bin_width,
+    const char* mz, const char* intensity, uint32_t n) {
+    const __m512d inv = _mm512_set1_pd(inv_bin_width);
+    const __m512i vbase = _mm512_set1_epi32(base);
+    const __m512i vsize = _mm512_set1_epi32(static_cast<int>(size));
+    __m512 acc = _mm512_setzero_ps();
+
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const double* p = reinterpret_cast<const double*>(mz) + i;
+        const __m256i lo =
+            _mm512_cvttpd_epi32(_mm512_mul_pd(_mm512_loadu_pd(p), inv));
+        const __m256i hi =
+            _mm512_cvttpd_epi32(_mm512_mul_pd(_mm512_loadu_pd(p + 8), inv));
+        const __m512i index = _mm512_sub_epi32(
+            _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1), vbase);
+        const __mmask16 in_range = _mm512_cmplt_epu32_mask(index, vsize);
+        const __m512 q = _mm512_mask_i32gather_ps(
+            _mm512_setzero_ps(), in_range, index, query, sizeof(float));
+        const __m512 it = _mm512_loadu_ps(
+            reinterpret_cast<const float*>(intensity) + i);
+        acc = _mm512_fmadd_ps(q, it, acc);
+    }
+
+    return _mm512_reduce_add_ps(acc) +
+           DotPortable(query, size, base, inv_bin_width,
+                       mz + i * sizeof(double),
+                       intensity + i * sizeof(float), n - i);
+}
+#endif
+
+// 查询向量稀疏存储时的点积：bins 升序排列，values[i] 是第 bins[i] 个箱。
+// 与 DotPortable() 按相同的顺序累加
+float DotSparse(const int32_t* bins, const float* values, size_t size,
+                double inv_bin_width, const char* mz, const char* intensity,
+                uint32_t n) {
+    const int32_t* const end = bins + size;
+    const int32_t* pos = bins;
+    int32_t last_bin = INT32_MIN;
+    float sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const int32_t bin = BinOf(MzAt(mz, i), inv_bin_width);
+        if (bin == INT32_MIN) {
+            continue;
+        }
+        // 峰按 m/z 升序排列时从上一个峰的位置继续查找
+        if (bin < last_bin) {
+            pos = bins;
+        }
+        last_bin = bin;
+        pos = std::lower_bound(pos, end, bin);
+        if (pos != end && *pos == bin) {
+            sum += values[pos - bins] * IntensityAt(intensity, i);
+        }
+    }
+    return sum;
+}
+
+// 分箱后的强度向量的长度。峰按 m/z 升序排列，同一个箱中的峰是连续的。
+// 与查询向量相同，超出 int32 范围的峰不计入
+float BinnedNorm(double inv_bin_width, const char* mz, const char* intensity,
+                 uint32_t n) {
+    float sum_squares = 0;
+    float bin_sum = 0;
+    int32_t last_bin = INT32_MIN;
+    for (uint32_t i = 0; i < n; i++) {
+        const int32_t bin = BinOf(MzAt(mz, i), inv_bin_width);
+        if (bin == INT32_MIN) {
+            continue;
+        }
+        const float value = IntensityAt(intensity, i);
+        if (bin == last_bin) {
+            bin_sum += value;
+        } else {
+            sum_squares += bin_sum * bin_sum;
+            bin_sum = value;
+            last_bin = bin;
+        }
+    }
+    sum_squares += bin_sum * bin_sum;
+    return std::sqrt(sum_squares);
+}
+
+}  // namespace
+
+// 向量化实现直接按本机字节序读取 value，只在小端序的 x86-64 上使用
+std::vector<NamedSpectrumDotKernel> SpectrumDotKernels() {
+    std::vector<NamedSpectrumDotKernel> kernels;
+    kernels.push_back(NamedSpectrumDotKernel{"portable", DotPortable});
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        kernels.push_back(NamedSpectrumDotKernel{"avx2", DotAvx2});
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels.push_back(NamedSpectrumDotKernel{"avx512", DotAvx512});
+    }
+#endif
+    return kernels;
+}
+
+// 箱宽度必须是正的有限值，并且倒数也是有限值
+static bool ValidBinWidth(double bin_width) {
+    return bin_width > 0 && std::isfinite(bin_width) &&
+           std::isfinite(1.0 / bin_width);
+}
+
+SpectrumScorer::SpectrumScorer(const Slice& query, double bin_width,
+                               Similarity similarity)
+    : inv_bin_width_(ValidBinWidth(bin_width) ? 1.0 / bin_width : 0),
+      similarity_(similarity),
+      base_bin_(0),
+      query_norm_(0) {
+    uint32_t n;
+    if (!valid() || !GetPeakListSize(query, &n) || n == 0) {
+        return;
+    }
+    const char* mz = query.data() + kPeakListHeaderSize;
+    const char* intensity = mz + n * sizeof(double);
+
+    // 查询向量只覆盖查询谱图中出现的箱，
+    // 超出 int32 范围的峰（BinOf() 返回 INT32_MIN）不参与打分
+    std::vector<std::pair<int32_t, float>> peaks;
+    peaks.reserve(n);
+    for (uint32_t i = 0; i < n; i++) {
+        const int32_t bin = BinOf(MzAt(mz, i), inv_bin_width_);
+        if (bin != INT32_MIN) {
+            peaks.emplace_back(bin, IntensityAt(intensity, i));
+        }
+    }
+    if (peaks.empty()) {
+        return;
+    }
+    // 稳定排序，同一个箱中的强度按峰的顺序相加
+    std::stable_sort(peaks.begin(), peaks.end(),
+                     [](const std::pair<int32_t, float>& a,
+                        const std::pair<int32_t, float>& b) {
+                         return a.first < b.first;
+                     });
+    const int32_t min_bin = peaks.front().first;
+    const int64_t span = static_cast<int64_t>(peaks.back().first) - min_bin + 1;
+    if (span <= kMaxDenseQueryBins) {
+        base_bin_ = min_bin;
+        query_.assign(span, 0.0f);
+        for (const auto& peak : peaks) {
+            query_[peak.first - base_bin_] += peak.second;
+        }
+    } else {
+        for (const auto& peak : peaks) {
+            if (sparse_bins_.empty() || sparse_bins_.back() != peak.first) {
+                sparse_bins_.push_back(peak.first);
+                query_.push_back(0.0f);
+            }
+            query_.back() += peak.second;
+        }
+    }
+    float sum_squares = 0;
+    for (float value : query_) {
+        sum_squares += value * value;
+    }
+    query_norm_ = std::sqrt(sum_squares);
+}
+
+bool GetPeakBins(const Slice& value, double bin_width,
+                 std::vector<int32_t>* bins) {
+    bins->clear();
+    uint32_t n;
+    if (!ValidBinWidth(bin_width) || !GetPeakListSize(value, &n)) {
+        return false;
+    }
+    const char* mz = value.data() + kPeakListHeaderSize;
+    const double inv_bin_width = 1.0 / bin_width;
+    for (uint32_t i = 0; i < n; i++) {
+        const int32_t bin = BinOf(MzAt(mz, i), inv_bin_width);
+        if (bin != INT32_MIN && (bins->empty() || bins->back() != bin)) {
+            bins->push_back(bin);
+        }
+    }
+    // 峰按 m/z 升序排列时箱也是升序的，否则需要重新排序去重
+    if (!std::is_sorted(bins->begin(), bins->end())) {
+        std::sort(bins->begin(), bins->end());
+        bins->erase(std::unique(bins->begin(), bins->end()), bins->end());
+    }
+    return true;
+}
+
+bool SpectrumScorer::Score(const Slice& value, float* score) const {
+    static const SpectrumDotKernel kDot = SpectrumDotKernels().back().dot;
+
+    uint32_t n;
+    if (!GetPeakListSize(value, &n)) {
+        return false;
+    }
+    const char* mz = value.data() + kPeakListHeaderSize;
+    const char* intensity = mz + n * sizeof(double);
+
+    float dot = 0;
+    if (!sparse_bins_.empty()) {
+        dot = DotSparse(sparse_bins_.data(), query_.data(), query_.size(),
+                        inv_bin_width_, mz, intensity, n);
+    } else if (!query_.empty()) {
+        dot = kDot(query_.data(), static_cast<uint32_t>(query_.size()),
+                   base_bin_, inv_bin_width_, mz, intensity, n);
+    }
+    if (similarity_ == kDotProduct) {
+        *score = dot;
+        return true;
+    }
+
+    const float norm = BinnedNorm(inv_bin_width_, mz, intensity, n);
+    if (dot == 0 || norm == 0 || query_norm_ == 0) {
+        *score = 0;
+    } else {
+        *score = dot / (norm * query_norm_);
+    }
+    return true;
+}
+
+}  // namespace massdb
@@ -0,0 +1,32 @@
+//
+// Created by Xsakura on 2023/6/17.
+//
+
+#ifndef MASSDB_UTIL_SPECTRUM_SCORE_H
+#define MASSDB_UTIL_SPECTRUM_SCORE_H
+
+#include <cstdint>
+#include <vector>
+
+namespace massdb {
+
+// 计算 sum(query[bin(mz[i]) - base] * intensity[i])，
+// 箱不在 [base, base + size) 中的峰贡献为 0。
+// mz 和 intensity 直接指向峰列表格式的 value，按小端序存放，不要求对齐
+typedef float (*SpectrumDotKernel)(const float* query, uint32_t size,
+                                   int32_t base, double inv_bin_width,
+                                   const char* mz, const char* intensity,
+                                   uint32_t n);
+
+struct NamedSpectrumDotKernel {
+    const char* name;
+    SpectrumDotKernel dot;
+};
+
+// 返回当前 CPU 支持的所有点积实现，第一个总是可移植的实现。
+// SpectrumScorer 使用其中最后一个，测试用它检查各个实现的结果一致
+std::vector<NamedSpectrumDotKernel> SpectrumDotKernels();
+
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_SPECTRUM_SCORE_H
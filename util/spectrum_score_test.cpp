@@ -0,0 +1,208 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "util/spectrum_score.h"
+
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "massdb/slice.h"
+#include "massdb/spectrum.h"
+#include "util/random.h"
+
+namespace massdb {
+
+namespace {
+
+std::string PeakList(const std::vector<double>& mz,
+                     const std::vector<float>& intensity) {
+    std::string value;
+    EncodePeakList(mz.data(), intensity.data(), mz.size(), &value);
+    return value;
+}
+
+// 随机谱图，箱的下标在 [0, max_mz / bin_width) 附近。
+// 少数峰落在 int32 范围之外、是负数或者 NaN，这时 m/z 不是升序的。
+// sorted 为 true 时只在两端加入超出 int32 范围的峰，保持升序
+std::string RandomSpectrum(Random* rnd, int n, double max_mz,
+                           bool sorted = false) {
+    std::vector<double> mz;
+    std::vector<float> intensity;
+    double x = 0;
+    for (int i = 0; i < n; i++) {
+        x += max_mz / n * rnd->Uniform(200) / 100.0;
+        double v = x;
+        if (sorted) {
+            if (i == 0 && rnd->OneIn(3)) v = -1e300;
+            if (i == n - 1 && rnd->OneIn(3)) v = 1e300;
+        } else if (rnd->OneIn(30)) {
+            static const double kSpecial[] = {
+                -5.0, 1e300, -1e300, std::numeric_limits<double>::quiet_NaN(),
+                std::numeric_limits<double>::infinity()};
+            v = kSpecial[rnd->Uniform(5)];
+        }
+        mz.push_back(v);
+        intensity.push_back(static_cast<float>(rnd->Uniform(10000)) / 7);
+    }
+    return PeakList(mz, intensity);
+}
+
+// 分箱后的强度，用 double 累加
+std::map<int32_t, double> Bins(const std::string& value, double bin_width) {
+    std::vector<double> mz;
+    std::vector<float> intensity;
+    EXPECT_TRUE(DecodePeakList(value, &mz, &intensity));
+    std::map<int32_t, double> bins;
+    for (size_t i = 0; i < mz.size(); i++) {
+        const double x = mz[i] * (1 / bin_width);
+        if (x > -2147483649.0 && x < 2147483648.0) {
+            bins[static_cast<int32_t>(x)] += intensity[i];
+        }
+    }
+    return bins;
+}
+
+double ExpectedScore(const std::string& query, const std::string& value,
+                     double bin_width, SpectrumScorer::Similarity similarity) {
+    const std::map<int32_t, double> q = Bins(query, bin_width);
+    const std::map<int32_t, double> v = Bins(value, bin_width);
+    double dot = 0, qnorm = 0, vnorm = 0;
+    for (const auto& kv : q) {
+        qnorm += kv.second * kv.second;
+        auto it = v.find(kv.first);
+        if (it != v.end()) {
+            dot += kv.second * it->second;
+        }
+    }
+    for (const auto& kv : v) {
+        vnorm += kv.second * kv.second;
+    }
+    if (similarity == SpectrumScorer::kDotProduct) {
+        return dot;
+    }
+    return dot == 0 ? 0 : dot / std::sqrt(qnorm * vnorm);
+}
+
+}  // namespace
+
+TEST(SpectrumScoreTest, KernelsAgree) {
+    const std::vector<NamedSpectrumDotKernel> kernels = SpectrumDotKernels();
+    ASSERT_STREQ("portable", kernels[0].name);
+
+    Random rnd(301);
+    for (int iter = 0; iter < 2000; iter++) {
+        // 长度覆盖向量化实现剩下的 0 到 15 个峰
+        const int n = rnd.Uniform(iter < 100 ? 40 : 300);
+        const std::string value = RandomSpectrum(&rnd, n, 2000);
+        const char* mz = value.data() + kPeakListHeaderSize;
+        const char* intensity = mz + n * sizeof(double);
+        const double bin_width = 0.01 + rnd.Uniform(100) / 100.0;
+
+        // 查询向量只覆盖一部分箱，base 可能是负数
+        std::vector<float> query(1 + rnd.Uniform(5000));
+        for (float& q : query) {
+            q = rnd.OneIn(3) ? static_cast<float>(rnd.Uniform(1000)) : 0.0f;
+        }
+        const int32_t base = static_cast<int32_t>(rnd.Uniform(3000)) - 1000;
+        const uint32_t size = static_cast<uint32_t>(query.size());
+
+        // 用 double 计算的结果。各个实现累加的顺序不同，
+        // 误差以各项绝对值之和为尺度
+        std::vector<double> mzs;
+        std::vector<float> intensities;
+        ASSERT_TRUE(DecodePeakList(value, &mzs, &intensities));
+        double expected = 0, scale = 0;
+        for (int i = 0; i < n; i++) {
+            const double x = mzs[i] * (1 / bin_width);
+            if (!(x > -2147483649.0 && x < 2147483648.0)) continue;
+            const int64_t index = static_cast<int64_t>(x) - base;
+            if (index >= 0 && index < size) {
+                expected += query[index] * intensities[i];
+                scale += std::fabs(query[index] * intensities[i]);
+            }
+        }
+        for (const NamedSpectrumDotKernel& kernel : kernels) {
+            const float actual = kernel.dot(query.data(), size, base,
+                                            1 / bin_width, mz, intensity, n);
+            ASSERT_NEAR(expected, actual, 1e-5 * scale)
+                << kernel.name << " n=" << n << " iter=" << iter;
+        }
+    }
+}
+
+TEST(SpectrumScoreTest, MatchesReference) {
+    Random rnd(301);
+    for (int iter = 0; iter < 200; iter++) {
+        const double bin_width = iter % 2 ? 0.02 : 1.0;
+        const std::string query =
+            RandomSpectrum(&rnd, 1 + rnd.Uniform(100), 500, true);
+        for (auto similarity :
+             {SpectrumScorer::kDotProduct, SpectrumScorer::kCosine}) {
+            SpectrumScorer scorer(query, bin_width, similarity);
+            ASSERT_TRUE(scorer.valid());
+            for (int i = 0; i < 5; i++) {
+                const std::string value =
+                    i == 0 ? query
+                           : RandomSpectrum(&rnd, rnd.Uniform(100), 500, true);
+                const double expected =
+                    ExpectedScore(query, value, bin_width, similarity);
+                float score;
+                ASSERT_TRUE(scorer.Score(value, &score));
+                ASSERT_NEAR(expected, score,
+                            1e-4 * std::fabs(expected) + 1e-4);
+            }
+        }
+    }
+}
+
+TEST(SpectrumScoreTest, WideQueryUsesBoundedMemory) {
+    // 箱的跨度约 10^9，不能展开成连续的数组
+    const std::string query =
+        PeakList({100.0, 100.005, 250.5, 1e7}, {1.0f, 2.0f, 3.0f, 4.0f});
+    const std::string value =
+        PeakList({99.0, 100.001, 250.509, 5e6, 1e7}, {9.0f, 5.0f, 7.0f, 8.0f,
+                                                     6.0f});
+    const double bin_width = 0.01;
+    SpectrumScorer dot(query, bin_width, SpectrumScorer::kDotProduct);
+    float score;
+    ASSERT_TRUE(dot.Score(value, &score));
+    ASSERT_NEAR(3.0 * 5 + 3 * 7 + 4 * 6, score, 1e-4);
+
+    SpectrumScorer cosine(query, bin_width);
+    ASSERT_TRUE(cosine.Score(value, &score));
+    ASSERT_NEAR(ExpectedScore(query, value, bin_width, SpectrumScorer::kCosine),
+                score, 1e-5);
+    ASSERT_TRUE(cosine.Score(query, &score));
+    ASSERT_NEAR(1.0, score, 1e-5);
+
+    // value 中的峰不按 m/z 排列时结果相同
+    const std::string unsorted =
+        PeakList({1e7, 250.509, 99.0, 100.001, 5e6}, {6.0f, 7.0f, 9.0f, 5.0f,
+                                                     8.0f});
+    ASSERT_TRUE(dot.Score(unsorted, &score));
+    ASSERT_NEAR(3.0 * 5 + 3 * 7 + 4 * 6, score, 1e-4);
+}
+
+TEST(SpectrumScoreTest, InvalidBinWidth) {
+    const std::string query = PeakList({100.0, 200.0}, {1.0f, 2.0f});
+    std::vector<int32_t> bins;
+    for (double bin_width :
+         {0.0, -1.0, 1e-320, std::numeric_limits<double>::quiet_NaN(),
+          std::numeric_limits<double>::infinity()}) {
+        SpectrumScorer scorer(query, bin_width);
+        ASSERT_FALSE(scorer.valid()) << bin_width;
+        float score = -1;
+        ASSERT_TRUE(scorer.Score(query, &score));
+        ASSERT_EQ(0, score);
+        ASSERT_FALSE(GetPeakBins(query, bin_width, &bins));
+    }
+    ASSERT_TRUE(GetPeakBins(query, 1.0, &bins));
+    ASSERT_EQ(std::vector<int32_t>({100, 200}), bins);
+}
+
+}  // namespace massdb
@@ -0,0 +1,156 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "massdb/comparator.h"
+#include "massdb/slice.h"
+#include "massdb/spectrum.h"
+#include "util/random.h"
+
+namespace massdb {
+
+namespace {
+
+struct SpectrumId {
+    double mz;
+    int charge;
+    uint64_t scan;
+
+    bool operator<(const SpectrumId& other) const {
+        return std::make_tuple(mz, charge, scan) <
+               std::make_tuple(other.mz, other.charge, other.scan);
+    }
+};
+
+std::string Encode(const SpectrumId& id) {
+    std::string key;
+    EncodeSpectrumKey(id.mz, id.charge, id.scan, &key);
+    return key;
+}
+
+int Sign(int r) { return (r > 0) - (r < 0); }
+
+}  // namespace
+
+TEST(SpectrumKeyTest, RoundTrip) {
+    const double values[] = {0.0, 1e-300, 0.5, 445.12003, 1e6, -3.25,
+                             std::numeric_limits<double>::max()};
+    for (double mz : values) {
+        for (int charge : {-128, -1, 0, 1, 2, 127}) {
+            for (uint64_t scan : {uint64_t(0), uint64_t(1), ~uint64_t(0)}) {
+                const std::string key = Encode({mz, charge, scan});
+                ASSERT_EQ(kSpectrumKeySize, key.size());
+                double m;
+                int c;
+                uint64_t s;
+                ASSERT_TRUE(DecodeSpectrumKey(key, &m, &c, &s));
+                ASSERT_EQ(mz, m);
+                ASSERT_EQ(charge, c);
+                ASSERT_EQ(scan, s);
+            }
+        }
+    }
+    double m;
+    int c;
+    uint64_t s;
+    ASSERT_FALSE(DecodeSpectrumKey("short", &m, &c, &s));
+}
+
+TEST(SpectrumKeyTest, OrderMatchesNumericOrder) {
+    // m/z 的取值有正有负，有相同的 m/z 和电荷，也有很接近的 m/z
+    Random rnd(301);
+    std::vector<SpectrumId> ids;
+    for (int i = 0; i < 2000; i++) {
+        SpectrumId id;
+        switch (rnd.Uniform(4)) {
+            case 0:
+                id.mz = rnd.Uniform(2000000) / 1000.0;
+                break;
+            case 1:
+                id.mz = -(rnd.Uniform(1000) / 7.0);
+                break;
+            case 2:
+                id.mz = 500.0 + rnd.Uniform(3) * 1e-12;
+                break;
+            default:
+                id.mz = std::nextafter(500.0, 1000.0);
+        }
+        id.charge = static_cast<int>(rnd.Uniform(256)) - 128;
+        id.scan = rnd.OneIn(2) ? rnd.Uniform(10)
+                               : (uint64_t(rnd.Next()) << 32) | rnd.Next();
+        ids.push_back(id);
+    }
+    std::vector<std::string> keys;
+    for (const SpectrumId& id : ids) keys.push_back(Encode(id));
+
+    const Comparator* bytewise = BytewiseComparator();
+    const Comparator* spectrum = SpectrumKeyComparator();
+    for (size_t i = 0; i < ids.size(); i++) {
+        const size_t j = rnd.Uniform(static_cast<int>(ids.size()));
+        const int expected = ids[i] < ids[j] ? -1 : (ids[j] < ids[i] ? 1 : 0);
+        ASSERT_EQ(expected, Sign(bytewise->Compare(keys[i], keys[j])));
+        ASSERT_EQ(expected, Sign(spectrum->Compare(keys[i], keys[j])));
+    }
+
+    // 排序后的 key 与排序后的 (m/z, 电荷, 扫描号) 一一对应
+    std::sort(ids.begin(), ids.end());
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < ids.size(); i++) {
+        ASSERT_EQ(Encode(ids[i]), keys[i]);
+    }
+}
+
+TEST(SpectrumKeyTest, ComparatorMatchesBytewiseOnOtherKeys) {
+    // SpectrumKeyComparator() 对长度不是 kSpectrumKeySize 的 key 也按字节比较
+    Random rnd(301);
+    const Comparator* spectrum = SpectrumKeyComparator();
+    for (int i = 0; i < 5000; i++) {
+        std::string a, b;
+        const int la = rnd.Uniform(30), lb = rnd.Uniform(30);
+        for (int k = 0; k < la; k++) a.push_back(static_cast<char>(rnd.Uniform(4)));
+        for (int k = 0; k < lb; k++) b.push_back(static_cast<char>(rnd.Uniform(4)));
+        ASSERT_EQ(Sign(Slice(a).compare(Slice(b))),
+                  Sign(spectrum->Compare(a, b)))
+            << i;
+    }
+}
+
+TEST(SpectrumKeyTest, PrecursorMzRange) {
+    Random rnd(301);
+    const Comparator* cmp = BytewiseComparator();
+    for (int i = 0; i < 200; i++) {
+        const double mz = 100.0 + rnd.Uniform(1000000) / 1000.0;
+        const double ppm = 1 + rnd.Uniform(50);
+        const double delta = mz * ppm * 1e-6;
+        std::string lower, upper;
+        PrecursorMzRange(mz, ppm, &lower, &upper);
+        ASSERT_FALSE(upper.empty());
+
+        // 边界上的 m/z 和任意的电荷、扫描号都在范围内
+        for (double v : {mz, mz - delta, mz + delta}) {
+            for (const SpectrumId& id :
+                 {SpectrumId{v, -128, 0}, SpectrumId{v, 127, ~uint64_t(0)}}) {
+                const std::string key = Encode(id);
+                ASSERT_GE(cmp->Compare(key, lower), 0);
+                ASSERT_LT(cmp->Compare(key, upper), 0);
+            }
+        }
+        // 相邻的 m/z 在范围外
+        const std::string below =
+            Encode({std::nextafter(mz - delta, 0.0), 127, ~uint64_t(0)});
+        const std::string above =
+            Encode({std::nextafter(mz + delta, 1e9), -128, 0});
+        ASSERT_LT(cmp->Compare(below, lower), 0);
+        ASSERT_GE(cmp->Compare(above, upper), 0);
+    }
+}
+
+}  // namespace massdb
@@ -5,6 +5,7 @@
 #include "massdb/status.h"
 
 #include <cstdio>
+#include <cstring>
 
 namespace massdb {
 
@@ -61,7 +62,7 @@ Status::Status(Status::Code code, const Slice& msg, const Slice& msg2) {
     std::memcpy(result + 5, msg.data(), len1);
     if (len2) {
         result[5 + len1] = ':';
-        result[6 + len2] = ' ';
+        result[6 + len1] = ' ';
         std::memcpy(result + 7 + len1, msg2.data(), len2);
     }
     state_ = result;
@@ -0,0 +1,43 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#include "util/testutil.h"
+
+#include <cstdlib>
+
+namespace massdb {
+namespace test {
+
+std::string NewTestDirectory(const std::string& name) {
+    const char* env = std::getenv("TEST_TMPDIR");
+    std::string dir = (env != nullptr && env[0] != '\0') ? env : "/tmp";
+    dir += "/massdb_test-" + name;
+    DestroyDirectory(Env::Default(), dir);
+    return dir;
+}
+
+void DestroyDirectory(Env* env, const std::string& dir) {
+    std::vector<std::string> children;
+    if (!env->GetChildren(dir, &children).IsOk()) {
+        return;
+    }
+    for (const std::string& child : children) {
+        if (child != "." && child != "..") {
+            env->RemoveFile(dir + "/" + child);
+        }
+    }
+    env->RemoveDir(dir);
+}
+
+std::string RandomString(Random* rnd, int len) {
+    std::string result;
+    result.reserve(len);
+    for (int i = 0; i < len; i++) {
+        result.push_back(static_cast<char>(' ' + rnd->Uniform(95)));
+    }
+    return result;
+}
+
+}  // namespace test
+}  // namespace massdb
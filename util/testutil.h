@@ -0,0 +1,103 @@
+//
+// Created by Xsakura on 2023/6/27.
+//
+
+#ifndef MASSDB_UTIL_TESTUTIL_H
+#define MASSDB_UTIL_TESTUTIL_H
+
+#include <string>
+#include <vector>
+
+#include "massdb/env.h"
+#include "util/random.h"
+
+namespace massdb {
+namespace test {
+
+// 返回测试 name 使用的数据库目录，目录中已有的文件都被删除
+std::string NewTestDirectory(const std::string& name);
+
+// 删除目录 dir 中的所有文件以及目录本身
+void DestroyDirectory(Env* env, const std::string& dir);
+
+// 返回长度为 len 的随机字符串，只包含可打印字符
+std::string RandomString(Random* rnd, int len);
+
+// 把所有调用转发给 target 的 Env，测试继承它以拦截部分操作
+class EnvWrapper : public Env {
+public:
+    explicit EnvWrapper(Env* target) : target_(target) {}
+
+    Env* target() const { return target_; }
+
+    Status NewSequentialFile(const std::string& fname,
+                             SequentialFile** result) override {
+        return target_->NewSequentialFile(fname, result);
+    }
+    Status NewRandomAccessFile(const std::string& fname,
+                               RandomAccessFile** result) override {
+        return target_->NewRandomAccessFile(fname, result);
+    }
+    Status NewMmapReadableFile(const std::string& fname,
+                               RandomAccessFile** result) override {
+        return target_->NewMmapReadableFile(fname, result);
+    }
+    void MultiRead(ReadRequest* requests, size_t n) override {
+        target_->MultiRead(requests, n);
+    }
+    Status NewWritableFile(const std::string& fname,
+                           WritableFile** result) override {
+        return target_->NewWritableFile(fname, result);
+    }
+    bool FileExists(const std::string& fname) override {
+        return target_->FileExists(fname);
+    }
+    Status GetChildren(const std::string& dir,
+                       std::vector<std::string>* result) override {
+        return target_->GetChildren(dir, result);
+    }
+    Status RemoveFile(const std::string& fname) override {
+        return target_->RemoveFile(fname);
+    }
+    Status CreateDir(const std::string& dirname) override {
+        return target_->CreateDir(dirname);
+    }
+    Status RemoveDir(const std::string& dirname) override {
+        return target_->RemoveDir(dirname);
+    }
+    Status GetFileSize(const std::string& fname,
+                       uint64_t* file_size) override {
+        return target_->GetFileSize(fname, file_size);
+    }
+    Status RenameFile(const std::string& src,
+                      const std::string& target) override {
+        return target_->RenameFile(src, target);
+    }
+    Status LockFile(const std::string& fname, FileLock** lock) override {
+        return target_->LockFile(fname, lock);
+    }
+    Status UnlockFile(FileLock* lock) override {
+        return target_->UnlockFile(lock);
+    }
+    void Schedule(void (*function)(void* arg), void* arg) override {
+        target_->Schedule(function, arg);
+    }
+    void SetBackgroundThreads(int number) override {
+        target_->SetBackgroundThreads(number);
+    }
+    void StartThread(void (*function)(void* arg), void* arg) override {
+        target_->StartThread(function, arg);
+    }
+    uint64_t NowMicros() override { return target_->NowMicros(); }
+    void SleepForMicroseconds(int micros) override {
+        target_->SleepForMicroseconds(micros);
+    }
+
+private:
+    Env* const target_;
+};
+
+}  // namespace test
+}  // namespace massdb
+
+#endif  // MASSDB_UTIL_TESTUTIL_H